@@ -149,6 +149,8 @@ extern USBD_ClassTypeDef USBD_CDC;
 // these are used to hack in an optional MIDI mode
 #define USBD_MODE_CDC  0
 #define USBD_MODE_MIDI 1
+// USB Audio Class 2.0, handled by USBD_AUDIO2 in src/usbd/usbd_audio2.c
+#define USBD_MODE_AUDIO2 2
 extern uint8_t usbd_mode;
 
 /**
@@ -6,6 +6,7 @@
 #include "version.h"
 
 #include "sys/system.h"
+#include "sys/memory.h"
 #include "per/qspi.h"
 #include "per/dac.h"
 #include "per/gpio.h"
@@ -21,20 +22,27 @@
 #include "per/i2c.h"
 #include "per/adc.h"
 #include "per/uart.h"
+#include "per/uart_stream.h"
 #include "hid/midi.h"
+#include "hid/VoiceAllocator.h"
+#include "hid/midi_clock.h"
 #include "hid/encoder.h"
 #include "hid/switch.h"
 #include "hid/switch3.h"
 #include "hid/ctrl.h"
 #include "hid/gatein.h"
 #include "hid/parameter.h"
+#include "hid/ctrl_bank.h"
 #include "hid/usb.h"
 #include "hid/logger.h"
+#include "hid/serial_link.h"
+#include "hid/usb_audio.h"
 #include "hid/usb_host.h"
 #include "per/sai.h"
 #include "per/sdmmc.h"
 #include "per/spi.h"
 #include "per/spiMultislave.h"
+#include "per/sharedBus.h"
 #include "per/rng.h"
 #include "hid/disp/display.h"
 #include "hid/disp/oled_display.h"
@@ -45,6 +53,7 @@
 #include "hid/led.h"
 #include "hid/rgb_led.h"
 #include "dev/sr_595.h"
+#include "dev/sr_scanner.h"
 #include "dev/apds9960.h"
 #include "dev/codec_ak4556.h"
 #include "dev/codec_pcm3060.h"
@@ -66,7 +75,13 @@
 #include "ui/FullScreenItemMenu.h"
 #include "util/scopedirqblocker.h"
 #include "util/CpuLoadMeter.h"
+#include "util/DacStream.h"
+#include "util/LedBrightness.h"
+#include "util/InputDebouncer.h"
 #include "util/FIFO.h"
+#include "util/FileIoService.h"
+#include "util/WavIndex.h"
+#include "util/LockFreeFIFO.h"
 #include "util/FixedCapStr.h"
 #include "util/MappedValue.h"
 #include "util/PersistentStorage.h"
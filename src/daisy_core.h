@@ -29,6 +29,12 @@ for DMA transfers. Performance is on par with internal SRAM w/
 cache enabled.
 */
 #define DTCM_MEM_SECTION __attribute__((section(".dtcmram_bss")))
+/** 
+The AXI SRAM section is cached, and is the only internal memory the
+SDMMC1 IDMA can reach. Plain .bss may be in the DTCM, e.g. for
+BOOT_SRAM apps, so buffers for it should be placed here.
+*/
+#define AXI_SRAM_MEM_SECTION __attribute__((section(".axi_sram_bss")))
 
 #define FBIPMAX 0.999985f             /**< close to 1.0f-LSB at 16 bit */
 #define FBIPMIN (-FBIPMAX)            /**< - (1 - LSB) */
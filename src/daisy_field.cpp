@@ -110,10 +110,12 @@ void DaisyField::Init(bool boost)
     for(size_t i = 0; i < KNOB_LAST; i++)
     {
         knob[i].Init(seed.adc.GetMuxPtr(4, pot_order[i]), AudioCallbackRate());
+        control_bank_.Bind(i, knob[i]);
     }
     for(size_t i = 0; i < CV_LAST; i++)
     {
         cv[i].InitBipolarCv(seed.adc.GetPtr(i), AudioCallbackRate());
+        control_bank_.Bind(KNOB_LAST + i, cv[i]);
     }
 
     // Keyboard
@@ -122,6 +124,9 @@ void DaisyField::Init(bool boost)
     keyboard_cfg.latch   = PIN_CD4021_CS;
     keyboard_cfg.data[0] = PIN_CD4021_D1;
     keyboard_sr_.Init(keyboard_cfg);
+    keyboard_.Init(System::GetNow());
+    // pressed keys read LOW
+    keyboard_.SetInvertMask(0, 0xffff);
 
     // OLED
     OledDisplay<SSD130x4WireSpi128x64Driver>::Config display_config;
@@ -245,10 +250,10 @@ void DaisyField::StartDac()
 
 void DaisyField::ProcessAnalogControls()
 {
-    for(size_t i = 0; i < KNOB_LAST; i++)
-        knob[i].Process();
-    for(size_t i = 0; i < CV_LAST; i++)
-        cv[i].Process();
+    // knobs first, then the CV inputs
+    control_bank_.Process();
+    control_bank_.CopyValuesTo(knob, KNOB_LAST);
+    control_bank_.CopyValuesTo(cv, CV_LAST, KNOB_LAST);
 }
 
 void DaisyField::ProcessDigitalControls()
@@ -259,16 +264,17 @@ void DaisyField::ProcessDigitalControls()
         sw[i].Debounce();
         // Keyboard SM
     }
-    //dsy_sr_4021_update(&keyboard_sr_);
     keyboard_sr_.Update();
+    // The keys are wired in reverse order within each 4021
+    uint32_t keys = 0;
     for(size_t i = 0; i < 16; i++)
     {
         uint8_t keyidx, keyoffset;
         keyoffset = i > 7 ? 8 : 0;
         keyidx    = (7 - (i % 8)) + keyoffset;
-        keyboard_state_[keyidx]
-            = keyboard_sr_.State(i) | (keyboard_state_[keyidx] << 1);
+        keys |= uint32_t(keyboard_sr_.State(i)) << keyidx;
     }
+    keyboard_.Update(keys, System::GetNow());
     // Gate Input
     gate_in_trig_ = gate_in.Trig();
 }
@@ -285,27 +291,27 @@ void DaisyField::SetCvOut2(uint16_t val)
 
 bool DaisyField::KeyboardState(size_t idx) const
 {
-    return keyboard_state_[idx] == 0x00;
+    return keyboard_.Pressed(idx);
 }
 
 bool DaisyField::KeyboardRisingEdge(size_t idx) const
 {
-    return keyboard_state_[idx] == 0x80;
+    return keyboard_.RisingEdge(idx);
 }
 
 bool DaisyField::KeyboardFallingEdge(size_t idx) const
 {
-    return keyboard_state_[idx] == 0x7F;
+    return keyboard_.FallingEdge(idx);
 }
 
 float DaisyField::GetKnobValue(size_t idx) const
 {
-    return knob[idx < KNOB_LAST ? idx : 0].Value();
+    return control_bank_.Value(idx < KNOB_LAST ? idx : 0);
 }
 
 float DaisyField::GetCvValue(size_t idx) const
 {
-    return cv[idx < CV_LAST ? idx : 0].Value();
+    return control_bank_.Value(KNOB_LAST + (idx < CV_LAST ? idx : 0));
 }
 
 Switch* DaisyField::GetSwitch(size_t idx)
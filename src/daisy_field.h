@@ -3,6 +3,7 @@
 #define DSY_FIELD_BSP_H /**< & */
 #include "daisy_seed.h"
 #include "dev/oled_ssd130x.h"
+#include "util/InputDebouncer.h"
 
 /**
    @brief Hardware defines and helpers for daisy field platform.
@@ -147,7 +148,10 @@ class DaisyField
      ** The polling use of the DACs now handles starting the tranmission.  */
     void StartDac();
 
-    /** Processes the ADC inputs, updating their values */
+    /** Processes the ADC inputs in one batched pass, see AnalogControlBank.
+     *  The values are copied to knob[] and cv[], and settings changed on
+     *  them apply to the batch.
+     */
     void ProcessAnalogControls();
 
     /** Process tactile switches and keyboard states */
@@ -225,8 +229,10 @@ class DaisyField
     void SetHidUpdateRates();
     void InitMidi();
 
+    AnalogControlBank<KNOB_LAST + CV_LAST> control_bank_;
+
     ShiftRegister4021<2> keyboard_sr_; /**< Two 4021s daisy-chained. */
-    uint8_t              keyboard_state_[16];
+    InputDebouncer<1, 3> keyboard_;
     uint32_t             last_led_update_; // for vegas mode
     bool                 gate_in_trig_;    // True when triggered.
 };
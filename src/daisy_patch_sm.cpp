@@ -126,47 +126,57 @@ namespace patch_sm
         Impl()
         {
             dac_running_            = false;
+            dac_callback_           = nullptr;
+            dac_samplerate_         = 48000;
             dac_buffer_size_        = 48;
-            dac_output_[0]          = 0;
-            dac_output_[1]          = 0;
             internal_dac_buffer_[0] = dsy_patch_sm_dac_buffer[0];
             internal_dac_buffer_[1] = dsy_patch_sm_dac_buffer[1];
         }
 
         void InitDac();
 
+        void SetDacSampleRate(float samplerate);
+
         void StartDac(DacHandle::DacCallback callback);
 
         void StopDac();
 
         static void InternalDacCallback(uint16_t **output, size_t size);
 
-        /** Based on a 0-5V output with a 0-4095 12-bit DAC */
-        static inline uint16_t VoltageToCode(float input)
+        inline void WriteCvOut(int channel, float voltage)
         {
-            float pre = input * 819.f;
-            if(pre > 4095.f)
-                pre = 4095.f;
-            else if(pre < 0.f)
-                pre = 0.f;
-            return (uint16_t)pre;
+            if(channel == 0 || channel == 1)
+                cv_stream_.SetValue(0, voltage);
+            if(channel == 0 || channel == 2)
+                cv_stream_.SetValue(1, voltage);
         }
 
-        inline void WriteCvOut(int channel, float voltage)
+        inline void
+        WriteCvOutBlock(int channel, const float *voltages, size_t size)
+        {
+            if(channel == 0 || channel == 1)
+                cv_stream_.Write(0, voltages, size);
+            if(channel == 0 || channel == 2)
+                cv_stream_.Write(1, voltages, size);
+        }
+
+        inline void SetCvOutCalibration(int channel, const DacCalibration &cal)
         {
             if(channel == 0 || channel == 1)
-                dac_output_[0] = VoltageToCode(voltage);
+                cv_stream_.SetCalibration(0, cal);
             if(channel == 0 || channel == 2)
-                dac_output_[1] = VoltageToCode(voltage);
+                cv_stream_.SetCalibration(1, cal);
         }
 
-        size_t    dac_buffer_size_;
-        uint16_t *internal_dac_buffer_[2];
-        uint16_t  dac_output_[2];
-        DacHandle dac_;
+        size_t       dac_buffer_size_;
+        uint16_t *   internal_dac_buffer_[2];
+        DacStream<2> cv_stream_; /**< 0-5V on 0-4095 by default */
+        DacHandle    dac_;
 
       private:
-        bool dac_running_;
+        bool                   dac_running_;
+        DacHandle::DacCallback dac_callback_;
+        uint32_t               dac_samplerate_;
     };
 
     /** Static Local Object */
@@ -182,14 +192,32 @@ namespace patch_sm
             BITS_12; /**< Sets the output value to 0-4095 */
         dac_config.chn               = DacHandle::Channel::BOTH;
         dac_config.buff_state        = DacHandle::BufferState::ENABLED;
-        dac_config.target_samplerate = 48000;
+        dac_config.target_samplerate = dac_samplerate_;
         dac_.Init(dac_config);
     }
 
+    void DaisyPatchSM::Impl::SetDacSampleRate(float samplerate)
+    {
+        // WriteCvOutBlock() queues one value per audio sample, so the DAC
+        // has to run at the audio rate
+        const uint32_t rate = uint32_t(samplerate + 0.5f);
+        if(rate == dac_samplerate_)
+            return;
+        const bool running = dac_running_;
+        if(running)
+            StopDac();
+        dac_samplerate_ = rate;
+        InitDac();
+        cv_stream_.Restart();
+        if(running)
+            StartDac(dac_callback_);
+    }
+
     void DaisyPatchSM::Impl::StartDac(DacHandle::DacCallback callback)
     {
         if(dac_running_)
             dac_.Stop();
+        dac_callback_ = callback;
         dac_.Start(internal_dac_buffer_[0],
                    internal_dac_buffer_[1],
                    dac_buffer_size_,
@@ -206,14 +234,7 @@ namespace patch_sm
 
     void DaisyPatchSM::Impl::InternalDacCallback(uint16_t **output, size_t size)
     {
-        /** We could add some smoothing, interp, or something to make this a bit less waste-y */
-        // std::fill(&output[0][0], &output[0][size], patch_sm_hw.dac_output_[0]);
-        // std::fill(&output[1][1], &output[1][size], patch_sm_hw.dac_output_[1]);
-        for(size_t i = 0; i < size; i++)
-        {
-            output[0][i] = patch_sm_hw.dac_output_[0];
-            output[1][i] = patch_sm_hw.dac_output_[1];
-        }
+        patch_sm_hw.cv_stream_.Process(output, size);
     }
 
     /** Actual DaisyPatchSM implementation
@@ -327,6 +348,7 @@ namespace patch_sm
                 controls[i].InitBipolarCv(adc.GetPtr(i), callback_rate_);
             else
                 controls[i].Init(adc.GetPtr(i), callback_rate_);
+            control_bank_.Bind(i, controls[i]);
         }
 
         /** Fixed-function Digital I/O */
@@ -376,6 +398,7 @@ namespace patch_sm
         {
             controls[i].SetSampleRate(callback_rate_);
         }
+        pimpl_->cv_stream_.SetLatency(size);
     }
 
     void DaisyPatchSM::SetAudioSampleRate(float sr)
@@ -404,6 +427,7 @@ namespace patch_sm
         {
             controls[i].SetSampleRate(callback_rate_);
         }
+        pimpl_->SetDacSampleRate(AudioSampleRate());
     }
 
     void
@@ -415,6 +439,7 @@ namespace patch_sm
         {
             controls[i].SetSampleRate(callback_rate_);
         }
+        pimpl_->SetDacSampleRate(AudioSampleRate());
     }
 
     size_t DaisyPatchSM::AudioBlockSize()
@@ -432,15 +457,16 @@ namespace patch_sm
 
     void DaisyPatchSM::ProcessAnalogControls()
     {
-        for(int i = 0; i < ADC_LAST; i++)
-        {
-            controls[i].Process();
-        }
+        control_bank_.Process();
+        control_bank_.CopyValuesTo(controls, ADC_LAST);
     }
 
     void DaisyPatchSM::ProcessDigitalControls() {}
 
-    float DaisyPatchSM::GetAdcValue(int idx) { return controls[idx].Value(); }
+    float DaisyPatchSM::GetAdcValue(int idx)
+    {
+        return control_bank_.Value(idx);
+    }
 
     Pin DaisyPatchSM::GetPin(const PinBank bank, const int idx)
     {
@@ -462,6 +488,19 @@ namespace patch_sm
         pimpl_->WriteCvOut(channel, voltage);
     }
 
+    void DaisyPatchSM::WriteCvOutBlock(const int    channel,
+                                       const float *voltages,
+                                       size_t       size)
+    {
+        pimpl_->WriteCvOutBlock(channel, voltages, size);
+    }
+
+    void DaisyPatchSM::SetCvOutCalibration(const int             channel,
+                                           const DacCalibration &cal)
+    {
+        pimpl_->SetCvOutCalibration(channel, cal);
+    }
+
     void DaisyPatchSM::SetLed(bool state) { user_led.Write(state); }
 
     bool DaisyPatchSM::ValidateSDRAM()
@@ -117,7 +117,10 @@ namespace patch_sm
         /** Stops the Control ADCs */
         void StopAdc();
 
-        /** Reads and filters all of the analog control inputs */
+        /** Reads and filters all of the analog control inputs in one batched
+         *  pass, see AnalogControlBank. The values are copied to controls[],
+         *  and settings changed on them apply to the batch.
+         */
         void ProcessAnalogControls();
 
         /** Reads and debounces any of the digital control inputs 
@@ -148,9 +151,9 @@ namespace patch_sm
         /** Starts the DAC for the CV Outputs 
          * 
          *  By default this starts by running the 
-         *  internal callback at 48kHz, which will 
-         *  update the values based on the SetCvOut 
-         *  function.
+         *  internal callback at the audio sample rate
+         *  (48kHz by default), which will update the
+         *  values based on the SetCvOut function.
          * 
          *  This is started automatically when Init() is called.
          */
@@ -162,15 +165,35 @@ namespace patch_sm
         void StopDac();
 
         /** Sets specified DAC channel to the target voltage. 
-         *  This may not be 100% accurate without calibration. 
-         *  
-         *  \todo Add Calibration to CV Outputs
+         *  This may not be 100% accurate without calibration,
+         *  see SetCvOutCalibration().
          * 
          *  \param channel desired channel to update. 0 is both, otherwise 1 or 2 are valid.
          *  \param voltage value in Volts that you'd like to write to the DAC. The valid range is 0-5V.
          */
         void WriteCvOut(const int channel, float voltage);
 
+        /** Queues one voltage per sample for the CV outputs, e.g. an
+         *  envelope computed in the audio callback. The values are output
+         *  with a constant latency of one audio block, so they stay aligned
+         *  with the audio. The DAC follows SetAudioSampleRate() for this.
+         *  Calling WriteCvOut() stops the stream.
+         *
+         *  \param channel desired channel to update. 0 is both, otherwise 1 or 2 are valid.
+         *  \param voltages one value in Volts per sample, in the range 0-5V.
+         *  \param size number of values, usually the audio block size.
+         */
+        void
+        WriteCvOutBlock(const int channel, const float* voltages, size_t size);
+
+        /** Sets the calibration of the CV outputs, e.g. from
+         *  DacCalibration::FromMeasurements().
+         *
+         *  \param channel desired channel to calibrate. 0 is both, otherwise 1 or 2 are valid.
+         *  \param cal the conversion from Volts to DAC codes.
+         */
+        void SetCvOutCalibration(const int channel, const DacCalibration& cal);
+
         /** Here are some wrappers around libDaisy Static functions 
          *  to provide simpler syntax to those who prefer it. */
 
@@ -310,6 +333,8 @@ namespace patch_sm
 
         float callback_rate_;
 
+        AnalogControlBank<ADC_LAST> control_bank_;
+
         /** Background callback for updating the DACs. */
         Impl* pimpl_;
     };
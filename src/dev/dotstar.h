@@ -2,13 +2,20 @@
 #ifndef DSY_DOTSTAR_H
 #define DSY_DOTSTAR_H
 
+#include <algorithm>
+#include <cstring>
 #include "per/i2c.h"
 #include "per/spi.h"
+#include "util/color.h"
 
 namespace daisy
 {
 /**
  * \brief SPI Transport for DotStars
+ * \details Each frame is sent with a single transfer. With `use_dma` set,
+ *          Write() starts a DMA transfer and returns immediately. The data
+ *          must then stay valid until the transfer is finished, i.e. until
+ *          the next call to Write() returns or IsBusy() returns false.
  */
 class DotStarSpiTransport
 {
@@ -19,6 +26,9 @@ class DotStarSpiTransport
         SpiHandle::Config::BaudPrescaler baud_prescaler;
         Pin                              clk_pin;
         Pin                              data_pin;
+        /** Send frames with DMA. DotStar::Init() then requires
+         *  DotStar::Config::frame_buffer_a and frame_buffer_b. */
+        bool use_dma;
 
         void Defaults()
         {
@@ -26,6 +36,7 @@ class DotStarSpiTransport
             baud_prescaler = SpiHandle::Config::BaudPrescaler::PS_4;
             clk_pin        = Pin(PORTG, 11);
             data_pin       = Pin(PORTB, 5);
+            use_dma        = false;
         };
     };
 
@@ -46,26 +57,85 @@ class DotStarSpiTransport
         spi_cfg.pin_config.nss  = Pin();
 
         spi_.Init(spi_cfg);
+        use_dma_ = config.use_dma;
+        busy_    = false;
     };
 
     bool Write(uint8_t *data, size_t size)
     {
-        return spi_.BlockingTransmit(data, size) == SpiHandle::Result::OK;
+        if(!use_dma_)
+            return spi_.BlockingTransmit(data, size) == SpiHandle::Result::OK;
+
+        // wait for the previous frame
+        while(busy_) {};
+        busy_ = true;
+        if(spi_.DmaTransmit(data, size, nullptr, &TxCpltCallback, this)
+           != SpiHandle::Result::OK)
+        {
+            busy_ = false;
+            return false;
+        }
+        return true;
     };
 
+    /** Returns true while a DMA transfer is in progress */
+    bool IsBusy() const { return busy_; }
+
+    /** Returns true if Write() sends from the data with DMA */
+    bool UsesDma() const { return use_dma_; }
+
   private:
-    SpiHandle spi_;
+    static void TxCpltCallback(void *context, SpiHandle::Result result)
+    {
+        (void)result;
+        static_cast<DotStarSpiTransport *>(context)->busy_ = false;
+    }
+
+    SpiHandle     spi_;
+    bool          use_dma_ = false;
+    volatile bool busy_    = false;
 };
 
 
 /** \brief Device support for Adafruit DotStar LEDs (Opsco SK9822)
+    \details The pixels are stored as a ready-to-send frame: a start frame
+              of 32 zero bits, 4 bytes per pixel and an end frame. Show()
+              sends the whole frame with a single Write() and continues
+              drawing on a second frame buffer, so that a non-blocking
+              transport can send one frame while the next one is drawn.
     \author Nick Donaldson
     \date March 2023
+    \tparam Transport      The transport, e.g. DotStarSpiTransport
+    \tparam maxNumPixels   The maximum number of pixels in the chain
 */
-template <typename Transport>
+template <typename Transport, size_t maxNumPixels = 64>
 class DotStar
 {
   public:
+    /** Size in bytes of the start frame */
+    static constexpr size_t kStartFrameSize = 4;
+
+    /** Size in bytes of the end frame for `num_pixels` pixels. The data
+     *  is delayed by half a clock cycle per pixel, so at least one extra
+     *  clock edge per two pixels is needed, but never less than 32 bits.
+     */
+    static constexpr size_t GetEndFrameSize(size_t num_pixels)
+    {
+        return (num_pixels + 15) / 16 > 4 ? (num_pixels + 15) / 16 : 4;
+    }
+
+    /** Size in bytes of the complete frame for `num_pixels` pixels */
+    static constexpr size_t GetFrameSize(size_t num_pixels)
+    {
+        return kStartFrameSize + 4 * num_pixels + GetEndFrameSize(num_pixels);
+    }
+
+    /** Buffer type for one frame with `maxNumPixels` pixels */
+    using FrameBuffer
+        = uint8_t[kStartFrameSize + 4 * maxNumPixels
+                  + ((maxNumPixels + 15) / 16 > 4 ? (maxNumPixels + 15) / 16
+                                                  : 4)];
+
     enum class Result
     {
         OK,
@@ -89,13 +159,23 @@ class DotStar
         typename Transport::Config
                    transport_config; /**< Transport-specific configuration */
         ColorOrder color_order;      /**< Pixel color channel ordering */
-        uint16_t   num_pixels;       /**< Number of pixels/LEDs (max 64) */
+        uint16_t num_pixels; /**< Number of pixels/LEDs (max maxNumPixels) */
+
+        /** Frame buffers, required when the transport uses DMA. If
+         *  nullptr, blocking transports use internal buffers.
+         *  @note must be in DMA_BUFFER_MEM_SECTION, e.g.
+         *  `DotStarSpi::FrameBuffer DMA_BUFFER_MEM_SECTION buffer_a;`
+         */
+        uint8_t *frame_buffer_a;
+        uint8_t *frame_buffer_b; /**< \see frame_buffer_a */
 
         void Defaults()
         {
             transport_config.Defaults();
-            color_order = ColorOrder::RGB;
-            num_pixels  = 1;
+            color_order    = ColorOrder::RGB;
+            num_pixels     = 1;
+            frame_buffer_a = nullptr;
+            frame_buffer_b = nullptr;
         };
     };
 
@@ -109,7 +189,29 @@ class DotStar
             return Result::ERR_INVALID_ARGUMENT;
         }
         transport_.Init(config.transport_config);
+        if(transport_.UsesDma()
+           && (config.frame_buffer_a == nullptr
+               || config.frame_buffer_b == nullptr))
+        {
+            // the internal buffers aren't reachable for the DMA
+            num_pixels_     = 0;
+            draw_frame_     = nullptr;
+            transmit_frame_ = nullptr;
+            return Result::ERR_INVALID_ARGUMENT;
+        }
         num_pixels_ = config.num_pixels;
+        draw_frame_ = config.frame_buffer_a ? config.frame_buffer_a
+                                            : internal_frames_[0];
+        transmit_frame_ = config.frame_buffer_b ? config.frame_buffer_b
+                                                : internal_frames_[1];
+        // start and end frames never change
+        for(uint8_t *frame : {draw_frame_, transmit_frame_})
+        {
+            std::memset(frame, 0x00, kStartFrameSize);
+            std::memset(frame + kStartFrameSize + 4 * num_pixels_,
+                        0xFF,
+                        GetEndFrameSize(num_pixels_));
+        }
         // first color byte is always global brightness (hence +1 offset)
         r_offset_ = ((config.color_order >> 4) & 0b11) + 1;
         g_offset_ = ((config.color_order >> 2) & 0b11) + 1;
@@ -157,7 +259,7 @@ class DotStar
         {
             return Result::ERR_INVALID_ARGUMENT;
         }
-        uint8_t *pixel = (uint8_t *)(&pixels_[idx]);
+        uint8_t *pixel = GetPixel(idx);
         pixel[0]       = 0xE0 | std::min(b, (uint16_t)31);
         return Result::OK;
     };
@@ -167,7 +269,7 @@ class DotStar
         if(idx >= num_pixels_)
             return 0;
         uint32_t       c     = 0;
-        const uint8_t *pixel = (uint8_t *)&pixels_[idx];
+        const uint8_t *pixel = GetPixel(idx);
         c                    = c | (pixel[r_offset_] << 16);
         c                    = c | (pixel[g_offset_] << 8);
         c                    = c | pixel[b_offset_];
@@ -211,7 +313,7 @@ class DotStar
         {
             return Result::ERR_INVALID_ARGUMENT;
         }
-        uint8_t *pixel   = (uint8_t *)(&pixels_[idx]);
+        uint8_t *pixel   = GetPixel(idx);
         pixel[r_offset_] = r;
         pixel[b_offset_] = b;
         pixel[g_offset_] = g;
@@ -268,35 +370,47 @@ class DotStar
         }
     };
 
-    /** \brief Writes current pixel buffer data to LEDs */
+    /** \brief Writes current pixel buffer data to LEDs
+     *  \details The frame is sent with a single transport Write(). Drawing
+     *           continues on the other frame buffer, which starts out with
+     *           a copy of the pixels that were just sent.
+     */
     Result Show()
     {
-        uint8_t sf[4] = {0x00, 0x00, 0x00, 0x00};
-        uint8_t ef[4] = {0xFF, 0xFF, 0xFF, 0xFF};
-        if(!transport_.Write(sf, 4))
-        {
-            return Result::ERR_TRANSPORT;
-        }
-        for(uint16_t i = 0; i < num_pixels_; i++)
-        {
-            if(!transport_.Write((uint8_t *)&pixels_[i], 4))
-            {
-                return Result::ERR_TRANSPORT;
-            }
-        }
-        if(!transport_.Write(ef, 4))
+        uint8_t *frame = draw_frame_;
+        if(frame == nullptr
+           || !transport_.Write(frame, GetFrameSize(num_pixels_)))
         {
             return Result::ERR_TRANSPORT;
         }
+        // Write() waited for the previous frame, so the other buffer is free
+        draw_frame_     = transmit_frame_;
+        transmit_frame_ = frame;
+        std::memcpy(draw_frame_ + kStartFrameSize,
+                    frame + kStartFrameSize,
+                    4 * num_pixels_);
         return Result::OK;
     };
 
+    /** Returns the frame that is currently drawn to and will be sent with
+     *  the next call to Show(). It's GetFrameSize(num_pixels) bytes long.
+     */
+    const uint8_t *GetFrame() const { return draw_frame_; }
+
   private:
-    static const size_t kMaxNumPixels = 64;
-    Transport           transport_;
-    uint16_t            num_pixels_;
-    uint32_t            pixels_[kMaxNumPixels];
-    uint8_t             r_offset_, g_offset_, b_offset_;
+    static const size_t kMaxNumPixels = maxNumPixels;
+
+    uint8_t *GetPixel(uint16_t idx)
+    {
+        return draw_frame_ + kStartFrameSize + 4 * idx;
+    }
+
+    Transport   transport_;
+    uint16_t    num_pixels_ = 0;
+    FrameBuffer internal_frames_[2];
+    uint8_t    *draw_frame_     = nullptr;
+    uint8_t    *transmit_frame_ = nullptr;
+    uint8_t     r_offset_, g_offset_, b_offset_;
 };
 
 using DotStarSpi = DotStar<DotStarSpiTransport>;
@@ -7,13 +7,15 @@
 #include <stdint.h>
 #include "per/i2c.h"
 #include "per/gpio.h"
+#include "util/LedBrightness.h"
 
 namespace daisy
 {
 /** LED driver for one or multiple PCA9685 12bit PWM chips connected to
  * a single I2C peripheral.
- * It includes gamma correction from 8bit brightness values but it 
- * can also be supplied with raw 12bit values.
+ * It includes gamma correction from 8bit or float brightness values but it 
+ * can also be supplied with raw 12bit values. Gamma corrected values can
+ * optionally be dithered over successive frames, see SetDithering().
  * This driver uses two buffers - one for drawing, one for transmitting.
  * Multiple LedDriverPca9685 instances can be used at the same time.
  * \param numDrivers    The number of PCA9685 driver attached to the I2C
@@ -25,10 +27,13 @@ namespace daisy
  *                      If you will alway update all leds before calling 
  *                      SwapBuffersAndTransmit(), you can set this to false
  *                      and safe some cycles.
+ * \param gamma         The gamma curve for SetLed() and SetAllTo()
  * 
  *  @ingroup device
  */
-template <int numDrivers, bool persistentBufferContents = true>
+template <int      numDrivers,
+          bool     persistentBufferContents = true,
+          LedGamma gamma                    = LedGamma::SQUARE>
 class LedDriverPca9685
 {
   public:
@@ -75,6 +80,7 @@ class LedDriverPca9685
         for(int d = 0; d < numDrivers; d++)
             addresses_[d] = addresses[d];
         current_driver_idx_ = -1;
+        brightness_.Init();
 
         InitializeBuffers();
         InitializeDrivers();
@@ -86,16 +92,17 @@ class LedDriverPca9685
     /** Sets all leds to a gamma corrected brightness between 0.0f and 1.0f. */
     void SetAllTo(float brightness)
     {
-        const uint8_t intBrightness
-            = (uint8_t)(clamp(brightness * 255.0f, 0.0f, 255.0f));
-        SetAllTo(intBrightness);
+        const uint16_t intensity = Brightness::Curve::Apply(brightness);
+        for(int led = 0; led < GetNumLeds(); led++)
+            brightness_.SetIntensity(led, intensity);
     }
 
     /** Sets all leds to a gamma corrected brightness between 0 and 255. */
     void SetAllTo(uint8_t brightness)
     {
-        const uint16_t cycles = gamma_table_[brightness];
-        SetAllToRaw(cycles);
+        const uint16_t intensity = Brightness::Curve::Apply(brightness);
+        for(int led = 0; led < GetNumLeds(); led++)
+            brightness_.SetIntensity(led, intensity);
     }
 
     /** Sets all leds to a raw 12bit brightness between 0 and 4095. */
@@ -105,36 +112,36 @@ class LedDriverPca9685
             SetLedRaw(led, rawBrightness);
     }
 
-    /** Sets a single led to a gamma corrected brightness between 0.0f and 1.0f. */
+    /** Sets a single led to a gamma corrected brightness between 0.0f and 1.0f.
+     *  The value is written to the draw buffer in SwapBuffersAndTransmit().
+     */
     void SetLed(int ledIndex, float brightness)
     {
-        const uint8_t intBrightness
-            = (uint8_t)(clamp(brightness * 255.0f, 0.0f, 255.0f));
-        SetLed(ledIndex, intBrightness);
+        brightness_.Set(ledIndex, brightness);
     }
 
-    /** Sets a single led to a gamma corrected brightness between 0 and 255. */
+    /** Sets a single led to a gamma corrected brightness between 0 and 255.
+     *  The value is written to the draw buffer in SwapBuffersAndTransmit().
+     */
     void SetLed(int ledIndex, uint8_t brightness)
     {
-        const uint16_t cycles = gamma_table_[brightness];
-        SetLedRaw(ledIndex, cycles);
+        brightness_.Set(ledIndex, brightness);
     }
 
     /** Sets a single led to a raw 12bit brightness between 0 and 4095. */
     void SetLedRaw(int ledIndex, uint16_t rawBrightness)
     {
-        const auto d  = GetDriverForLed(ledIndex);
-        const auto ch = GetDriverChannelForLed(ledIndex);
-        // mask away the "full on" bit
-        const auto on                = draw_buffer_[d].leds[ch].on & (0x0FFF);
-        draw_buffer_[d].leds[ch].off = (on + rawBrightness) & (0x0FFF);
-        // full on condition
-        if(rawBrightness >= 0x0FFF)
-            draw_buffer_[d].leds[ch].on = 0x1000 | on; // set "full on" bit
-        else
-            draw_buffer_[d].leds[ch].on = on; // clear "full on" bit
+        brightness_.SetDuty(ledIndex, rawBrightness);
+        WriteLedToDrawBuffer(ledIndex, rawBrightness);
     }
 
+    /** Enables temporal dithering for gamma corrected brightness values.
+     *  The fraction of a brightness value that falls between two 12 bit
+     *  steps is spread over successive calls to SwapBuffersAndTransmit(),
+     *  so that low brightness fades don't step visibly.
+     */
+    void SetDithering(bool dither) { brightness_.SetDithering(dither); }
+
     /** Swaps the current draw buffer and the current transmit buffer and
      *  starts transmitting the values to all chips.
      */
@@ -143,6 +150,13 @@ class LedDriverPca9685
         // wait for current transmission to complete
         while(current_driver_idx_ >= 0) {};
 
+        // write the leds that changed or are dithered
+        brightness_.Encode(
+            [this](size_t led, uint16_t duty) {
+                WriteLedToDrawBuffer(led, duty);
+            },
+            !persistentBufferContents);
+
         // swap buffers
         auto tmp         = transmit_buffer_;
         transmit_buffer_ = draw_buffer_;
@@ -154,8 +168,12 @@ class LedDriverPca9685
         {
             for(int d = 0; d < numDrivers; d++)
                 for(int ch = 0; ch < 16; ch++)
+                {
+                    draw_buffer_[d].leds[ch].on
+                        = transmit_buffer_[d].leds[ch].on;
                     draw_buffer_[d].leds[ch].off
                         = transmit_buffer_[d].leds[ch].off;
+                }
         }
 
         // start transmission
@@ -164,6 +182,22 @@ class LedDriverPca9685
     }
 
   private:
+    using Brightness = LedBrightnessEncoder<numDrivers * 16, 0x0FFF, gamma>;
+
+    void WriteLedToDrawBuffer(int ledIndex, uint16_t rawBrightness)
+    {
+        const auto d  = GetDriverForLed(ledIndex);
+        const auto ch = GetDriverChannelForLed(ledIndex);
+        // mask away the "full on" bit
+        const auto on                = draw_buffer_[d].leds[ch].on & (0x0FFF);
+        draw_buffer_[d].leds[ch].off = (on + rawBrightness) & (0x0FFF);
+        // full on condition
+        if(rawBrightness >= 0x0FFF)
+            draw_buffer_[d].leds[ch].on = 0x1000 | on; // set "full on" bit
+        else
+            draw_buffer_[d].leds[ch].on = on; // clear "full on" bit
+    }
+
     void ContinueTransmission()
     {
         current_driver_idx_ = current_driver_idx_ + 1;
@@ -252,19 +286,13 @@ class LedDriverPca9685
         }
     }
 
-    // no std::clamp available in C++14.... remove this when C++17 is available
-    template <typename T>
-    T clamp(T in, T low, T high)
-    {
-        return (in < low) ? low : (high < in) ? high : in;
-    }
-
     // an internal function to handle i2c callbacks
     // called when an I2C transmission completes and the next driver must be updated
     static void TxCpltCallback(void* context, I2CHandle::Result result)
     {
         auto drv_ptr = reinterpret_cast<
-            LedDriverPca9685<numDrivers, persistentBufferContents>*>(context);
+            LedDriverPca9685<numDrivers, persistentBufferContents, gamma>*>(
+            context);
         drv_ptr->ContinueTransmission();
     }
 
@@ -276,29 +304,7 @@ class LedDriverPca9685
     GPIO                   oe_pin_gpio_;
     // index of the dirver that is currently updated.
     volatile int8_t current_driver_idx_;
-    const uint16_t  gamma_table_[256] = {
-        0,    1,    1,    1,    1,    1,    1,    1,    1,    1,    1,    1,
-        2,    2,    2,    2,    2,    2,    2,    3,    3,    4,    4,    5,
-        5,    6,    7,    8,    8,    9,    10,   11,   12,   13,   15,   16,
-        17,   18,   20,   21,   23,   25,   26,   28,   30,   32,   34,   36,
-        38,   40,   43,   45,   48,   50,   53,   56,   59,   62,   65,   68,
-        71,   75,   78,   82,   85,   89,   93,   97,   101,  105,  110,  114,
-        119,  123,  128,  133,  138,  143,  149,  154,  159,  165,  171,  177,
-        183,  189,  195,  202,  208,  215,  222,  229,  236,  243,  250,  258,
-        266,  273,  281,  290,  298,  306,  315,  324,  332,  341,  351,  360,
-        369,  379,  389,  399,  409,  419,  430,  440,  451,  462,  473,  485,
-        496,  508,  520,  532,  544,  556,  569,  582,  594,  608,  621,  634,
-        648,  662,  676,  690,  704,  719,  734,  749,  764,  779,  795,  811,
-        827,  843,  859,  876,  893,  910,  927,  944,  962,  980,  998,  1016,
-        1034, 1053, 1072, 1091, 1110, 1130, 1150, 1170, 1190, 1210, 1231, 1252,
-        1273, 1294, 1316, 1338, 1360, 1382, 1404, 1427, 1450, 1473, 1497, 1520,
-        1544, 1568, 1593, 1617, 1642, 1667, 1693, 1718, 1744, 1770, 1797, 1823,
-        1850, 1877, 1905, 1932, 1960, 1988, 2017, 2045, 2074, 2103, 2133, 2162,
-        2192, 2223, 2253, 2284, 2315, 2346, 2378, 2410, 2442, 2474, 2507, 2540,
-        2573, 2606, 2640, 2674, 2708, 2743, 2778, 2813, 2849, 2884, 2920, 2957,
-        2993, 3030, 3067, 3105, 3143, 3181, 3219, 3258, 3297, 3336, 3376, 3416,
-        3456, 3496, 3537, 3578, 3619, 3661, 3703, 3745, 3788, 3831, 3874, 3918,
-        3962, 4006, 4050, 4095};
+    Brightness      brightness_;
 
     static constexpr uint8_t PCA9685_I2C_BASE_ADDRESS = 0b01000000;
     static constexpr uint8_t PCA9685_MODE1
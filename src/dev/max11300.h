@@ -5,6 +5,7 @@
 #include "daisy_core.h"
 #include "per/spiMultislave.h"
 #include "sys/system.h"
+#include "util/scopedirqblocker.h"
 #include <cstring>
 
 
@@ -27,6 +28,8 @@ namespace daisy
 #define MAX11300_ADCDAT_BASE 0x40
 #define MAX11300_DACDAT_BASE 0x60
 #define MAX11300_TRANSPORT_BUFFER_LENGTH 41
+// DAC (41), ADC (41), GPO (5) and GPI (5) transactions of a stream frame
+#define MAX11300_STREAM_DEVICE_LENGTH 92
 
 namespace MAX11300Types
 {
@@ -115,6 +118,54 @@ namespace MAX11300Types
     /** A function called when all MAX11300s have been updated */
     typedef void (*UpdateCompleteCallbackFunctionPtr)(void* context);
 
+    /**
+     * Two frames of DMA buffers for all devices, used by the streaming mode.
+     * The user must put it in non-cached memory, like this:
+     * `MAX11300Types::StreamBuffer<2> DMA_BUFFER_MEM_SECTION myBuffer;`
+     */
+    template <size_t num_devices>
+    struct StreamBuffer
+    {
+        uint8_t tx_buffer[2][num_devices][MAX11300_STREAM_DEVICE_LENGTH];
+        uint8_t rx_buffer[2][num_devices][MAX11300_STREAM_DEVICE_LENGTH];
+    };
+
+    /** Defines when the frames of the streaming mode are started */
+    enum class StreamTrigger
+    {
+        /** The next frame starts as soon as the previous one is complete */
+        CONTINUOUS,
+        /** Each frame is started by MAX11300Driver::TriggerStreamFrame(),
+         *  e.g. from a timer interrupt, for a fixed update rate */
+        EXTERNAL,
+    };
+
+    /** Statistics of the streaming mode */
+    struct StreamStats
+    {
+        /** The number of completed frames */
+        uint32_t frames = 0;
+        /** Triggers that were dropped because a frame was still running */
+        uint32_t overruns = 0;
+        /** The number of failed transfers */
+        uint32_t errors = 0;
+        /** The bus time of the last frame */
+        uint32_t frame_time_us = 0;
+        /** The longest bus time of a frame */
+        uint32_t max_frame_time_us = 0;
+        /** The time between the starts of the last two frames */
+        uint32_t frame_period_us = 0;
+        /** The time from the end of a frame until the outputs that were
+         *  written in its callback start to be transmitted */
+        uint32_t latency_us = 0;
+
+        /** Returns the number of frames per second */
+        float GetUpdateRate() const
+        {
+            return frame_period_us > 0 ? 1000000.0f / frame_period_us : 0.0f;
+        }
+    };
+
 } // namespace MAX11300Types
 
 class MAX11300MultiSlaveSpiTransport
@@ -262,6 +313,14 @@ class MAX11300MultiSlaveSpiTransport
  * which are not exposed, as well as a number of configuration decisions 
  * that were made in order to simplify usage and improve ergonomics, 
  * even at the cost of flexibility.
+ *
+ * There are two ways to keep the MAX11300s updated:
+ * - Start() sequences the updates step by step through one DmaBuffer.
+ * - StartStreaming() runs the transfers of all devices from a precomputed
+ *   schedule with two frames of DMA buffers. While one frame is on the bus,
+ *   the inputs of the previous frame are read and the outputs for the next
+ *   frame are written, so the bus doesn't wait for the CPU. Frames run back
+ *   to back or are started from a timer interrupt for a fixed update rate.
 */
 template <typename Transport, size_t num_devices>
 class MAX11300Driver
@@ -294,6 +353,9 @@ class MAX11300Driver
         update_complete_callback_         = nullptr;
         update_complete_callback_context_ = nullptr;
         run_                              = false;
+        stream_buffer_                    = nullptr;
+        streaming_                        = false;
+        stream_frame_active_              = false;
 
         if(transport_.Init(config.transport_config) != Transport::Result::OK)
             return MAX11300Types::Result::ERR;
@@ -367,6 +429,10 @@ class MAX11300Driver
                                                     MAX11300Types::Pin pin,
                                                     float threshold_voltage)
     {
+        // the stream schedule depends on the pin configuration
+        if(IsStreamRunning())
+            return MAX11300Types::Result::ERR;
+
         auto& device = devices_[device_index];
 
         if(threshold_voltage > 5.0f)
@@ -386,6 +452,10 @@ class MAX11300Driver
                                                      MAX11300Types::Pin pin,
                                                      float output_voltage)
     {
+        // the stream schedule depends on the pin configuration
+        if(IsStreamRunning())
+            return MAX11300Types::Result::ERR;
+
         auto& device = devices_[device_index];
 
         if(output_voltage > 5.0f)
@@ -406,6 +476,10 @@ class MAX11300Driver
                              MAX11300Types::Pin             pin,
                              MAX11300Types::AdcVoltageRange range)
     {
+        // the stream schedule depends on the pin configuration
+        if(IsStreamRunning())
+            return MAX11300Types::Result::ERR;
+
         auto& device = devices_[device_index];
 
         device.pin_configurations_[pin].Defaults();
@@ -420,6 +494,10 @@ class MAX11300Driver
                               MAX11300Types::Pin             pin,
                               MAX11300Types::DacVoltageRange range)
     {
+        // the stream schedule depends on the pin configuration
+        if(IsStreamRunning())
+            return MAX11300Types::Result::ERR;
+
         auto& device = devices_[device_index];
 
         device.pin_configurations_[pin].Defaults();
@@ -430,8 +508,13 @@ class MAX11300Driver
     }
 
 
-    MAX11300Types::Result DisablePin(size_t device_index, Pin pin)
+    MAX11300Types::Result DisablePin(size_t             device_index,
+                                     MAX11300Types::Pin pin)
     {
+        // the stream schedule depends on the pin configuration
+        if(IsStreamRunning())
+            return MAX11300Types::Result::ERR;
+
         auto& device = devices_[device_index];
         device.pin_configurations_[pin].Defaults();
         return SetPinConfig(device_index, pin);
@@ -611,6 +694,9 @@ class MAX11300Driver
           = nullptr,
           void* complete_callback_context = nullptr)
     {
+        if(IsStreamRunning())
+            return MAX11300Types::Result::ERR;
+
         if(sequencer_.IsBusy() && run_)
         {
             // When the sequencer is currently busy, we can just return right away, and only
@@ -634,6 +720,146 @@ class MAX11300Driver
     /** Call this to stop the auto updating, but complete the current update. */
     void Stop() { run_ = false; }
 
+    /**
+     * Starts the streaming mode. Each frame does the same as one update of
+     * Start(), for all devices:
+     * 
+     * - Write all ANALOG_OUT (DAC) values and GPO states
+     * - Read all ANALOG_IN (ADC) values and GPI states
+     * 
+     * The transfers of a frame are chained from the DMA interrupts. The
+     * next frame is started right away (StreamTrigger::CONTINUOUS) or by
+     * TriggerStreamFrame() (StreamTrigger::EXTERNAL). When a frame is
+     * complete, its inputs are copied to memory, the callback is called
+     * and the current outputs are copied into the frame's buffer, to be
+     * transmitted two frames later. Inside the callback, the pin functions
+     * of this class access the inputs and outputs of that frame, which
+     * makes it the place for processing CV at the update rate.
+     * 
+     * The pin configuration can't be changed while streaming.
+     * 
+     * \param stream_buffer two frames of buffers in DMA-accessible memory
+     * \param trigger defines when frames are started
+     * \param frame_callback An optional callback function that's called after each frame.
+     *                       Keep it fast, it's called from an interrupt.
+     * \param frame_callback_context An optional context pointer provided to the frame_callback
+     * \return ERR if an update or stream is still running, or if no pins are configured
+     */
+    MAX11300Types::Result
+    StartStreaming(MAX11300Types::StreamBuffer<num_devices>* stream_buffer,
+                   MAX11300Types::StreamTrigger              trigger
+                   = MAX11300Types::StreamTrigger::CONTINUOUS,
+                   MAX11300Types::UpdateCompleteCallbackFunctionPtr
+                         frame_callback         = nullptr,
+                   void* frame_callback_context = nullptr)
+    {
+        if(stream_buffer == nullptr || IsStreamRunning()
+           || sequencer_.IsBusy())
+            return MAX11300Types::Result::ERR;
+
+        stream_buffer_       = stream_buffer;
+        stream_trigger_      = trigger;
+        stream_callback_     = frame_callback;
+        stream_callback_ctx_ = frame_callback_context;
+        stream_buffer_index_ = 0;
+        stream_started_      = false;
+        stream_stats_        = MAX11300Types::StreamStats();
+        stream_end_valid_[0] = false;
+        stream_end_valid_[1] = false;
+        BuildStreamSchedule();
+        if(num_stream_steps_ == 0)
+            return MAX11300Types::Result::ERR;
+        for(uint8_t b = 0; b < 2; b++)
+            PrepareStreamFrame(b);
+
+        streaming_ = true;
+        if(trigger == MAX11300Types::StreamTrigger::CONTINUOUS)
+            StartStreamFrame();
+        return MAX11300Types::Result::OK;
+    }
+
+    /**
+     * Starts the next frame in StreamTrigger::EXTERNAL mode. Call this from
+     * a timer interrupt (see TimerHandle::SetCallback()) for a fixed update
+     * rate.
+     * \return false if the previous frame is still running (an overrun) or
+     *         the stream was stopped
+     */
+    bool TriggerStreamFrame()
+    {
+        if(!streaming_)
+            return false;
+        return StartStreamFrame();
+    }
+
+    /** Stops the streaming mode after the current frame. */
+    void StopStreaming() { streaming_ = false; }
+
+    /** Returns true while the streaming mode is running */
+    bool IsStreaming() const { return streaming_; }
+
+    /** Returns the statistics of the streaming mode */
+    MAX11300Types::StreamStats GetStreamStats() const
+    {
+        ScopedIrqBlocker irqBlocker;
+        return stream_stats_;
+    }
+
+    /** Resets the statistics of the streaming mode */
+    void ResetStreamStats()
+    {
+        ScopedIrqBlocker irqBlocker;
+        stream_stats_ = MAX11300Types::StreamStats();
+    }
+
+    /** Returns the number of ANALOG_OUT (DAC) pins of a device */
+    size_t GetNumAnalogOutputs(size_t device_index) const
+    {
+        return devices_[device_index].dac_pin_count_;
+    }
+
+    /** Returns the number of ANALOG_IN (ADC) pins of a device */
+    size_t GetNumAnalogInputs(size_t device_index) const
+    {
+        return devices_[device_index].adc_pin_count_;
+    }
+
+    /**
+     * Writes the raw 12 bit values of all ANALOG_OUT (DAC) pins of a
+     * device, in the order of the pins.
+     * 
+     * \param values GetNumAnalogOutputs() values
+     */
+    void WriteAnalogPinsRaw(size_t device_index, const uint16_t* values)
+    {
+        auto& device = devices_[device_index];
+        for(size_t i = 0; i < device.dac_pin_count_; i++)
+        {
+            const uint16_t value          = values[i];
+            device.dac_buffer_[1 + 2 * i] = static_cast<uint8_t>(value >> 8);
+            device.dac_buffer_[2 + 2 * i] = static_cast<uint8_t>(value);
+        }
+    }
+
+    /**
+     * Reads the raw 12 bit values of all ANALOG_IN (ADC) pins of a device,
+     * in the order of the pins.
+     * 
+     * \param values room for GetNumAnalogInputs() values
+     * \return the number of values
+     */
+    size_t ReadAnalogPinsRaw(size_t device_index, uint16_t* values) const
+    {
+        const auto& device = devices_[device_index];
+        for(size_t i = 0; i < device.adc_pin_count_; i++)
+        {
+            const uint8_t msb = device.adc_buffer_[1 + 2 * i];
+            const uint8_t lsb = device.adc_buffer_[2 + 2 * i];
+            values[i]         = static_cast<uint16_t>((msb << 8) | lsb);
+        }
+        return device.adc_pin_count_;
+    }
+
     /**
      * A utility funtion for converting a voltage (float) value, bound to a given
      * voltage range, to the first 12 bits (0-4095) of an unsigned 16 bit integer value. 
@@ -1240,6 +1466,219 @@ class MAX11300Driver
         }
     }
 
+    bool IsStreamRunning() const { return streaming_ || stream_frame_active_; }
+
+    // offsets of the transactions of a device in a stream frame
+    static constexpr size_t stream_dac_offset_ = 0;
+    static constexpr size_t stream_adc_offset_
+        = MAX11300_TRANSPORT_BUFFER_LENGTH;
+    static constexpr size_t stream_gpo_offset_
+        = 2 * MAX11300_TRANSPORT_BUFFER_LENGTH;
+    static constexpr size_t stream_gpi_offset_
+        = 2 * MAX11300_TRANSPORT_BUFFER_LENGTH + 5;
+
+    /** Lists the transactions of a frame, in the same order as Start() */
+    void BuildStreamSchedule()
+    {
+        num_stream_steps_ = 0;
+        for(size_t device_index = 0; device_index < num_devices;
+            device_index++)
+        {
+            const auto& device = devices_[device_index];
+            if(device.dac_pin_count_ > 0)
+                AddStreamStep(device_index,
+                              stream_dac_offset_,
+                              (device.dac_pin_count_ * 2) + 1,
+                              false);
+            if(device.adc_pin_count_ > 0)
+                AddStreamStep(device_index,
+                              stream_adc_offset_,
+                              (device.adc_pin_count_ * 2) + 1,
+                              true);
+            if(device.gpo_pin_count_ > 0)
+                AddStreamStep(device_index,
+                              stream_gpo_offset_,
+                              sizeof(device.gpo_buffer_),
+                              false);
+            if(device.gpi_pin_count_ > 0)
+                AddStreamStep(device_index,
+                              stream_gpi_offset_,
+                              sizeof(device.gpi_buffer_),
+                              true);
+        }
+    }
+
+    void
+    AddStreamStep(size_t device_index, size_t offset, size_t size, bool read)
+    {
+        auto& step  = stream_steps_[num_stream_steps_++];
+        step.device = static_cast<uint8_t>(device_index);
+        step.offset = static_cast<uint8_t>(offset);
+        step.size   = static_cast<uint8_t>(size);
+        step.read   = read;
+    }
+
+    uint8_t* TxStreamBuffer(uint8_t buffer_index, size_t device_index)
+    {
+        return stream_buffer_->tx_buffer[buffer_index][device_index];
+    }
+
+    /** Writes the register addresses and the outputs to a frame buffer */
+    void PrepareStreamFrame(uint8_t buffer_index)
+    {
+        for(size_t device_index = 0; device_index < num_devices;
+            device_index++)
+        {
+            const auto& device = devices_[device_index];
+            uint8_t*    tx     = TxStreamBuffer(buffer_index, device_index);
+            std::memset(tx, 0, MAX11300_STREAM_DEVICE_LENGTH);
+            tx[stream_adc_offset_] = device.adc_first_adress;
+            tx[stream_gpi_offset_] = (MAX11300_GPIDAT << 1) | 1;
+            CopyStreamOutputs(buffer_index, device_index);
+        }
+    }
+
+    /** Copies the DAC values and GPO states of a device to a frame buffer */
+    void CopyStreamOutputs(uint8_t buffer_index, size_t device_index)
+    {
+        const auto& device = devices_[device_index];
+        uint8_t*    tx     = TxStreamBuffer(buffer_index, device_index);
+        if(device.dac_pin_count_ > 0)
+            memcpy(tx + stream_dac_offset_,
+                   device.dac_buffer_,
+                   (device.dac_pin_count_ * 2) + 1);
+        if(device.gpo_pin_count_ > 0)
+        {
+            memcpy(tx + stream_gpo_offset_,
+                   device.gpo_buffer_,
+                   sizeof(device.gpo_buffer_));
+            tx[stream_gpo_offset_] = (MAX11300_GPODAT << 1);
+        }
+    }
+
+    /** Starts a frame with the current buffer, unless one is running */
+    bool StartStreamFrame()
+    {
+        {
+            ScopedIrqBlocker irqBlocker;
+            if(stream_frame_active_)
+            {
+                stream_stats_.overruns++;
+                return false;
+            }
+            stream_frame_active_ = true;
+        }
+
+        const uint32_t now          = System::GetUs();
+        const uint8_t  buffer_index = stream_buffer_index_;
+        if(stream_started_)
+            stream_stats_.frame_period_us = now - stream_frame_start_us_;
+        if(stream_end_valid_[buffer_index])
+            stream_stats_.latency_us = now - stream_end_us_[buffer_index];
+        stream_started_        = true;
+        stream_frame_start_us_ = now;
+        stream_step_           = 0;
+        StartStreamStep();
+        return true;
+    }
+
+    void StartStreamStep()
+    {
+        const auto&    step = stream_steps_[stream_step_];
+        const uint8_t  b    = stream_buffer_index_;
+        uint8_t* const tx   = &stream_buffer_->tx_buffer[b][step.device][0];
+        uint8_t* const rx   = &stream_buffer_->rx_buffer[b][step.device][0];
+
+        typename Transport::Result result;
+        if(step.read)
+            result = transport_.TransmitAndReceiveDma(step.device,
+                                                      tx + step.offset,
+                                                      rx + step.offset,
+                                                      step.size,
+                                                      &StreamDmaCallback,
+                                                      this);
+        else
+            result = transport_.TransmitDma(step.device,
+                                            tx + step.offset,
+                                            step.size,
+                                            &StreamDmaCallback,
+                                            this);
+        if(result != Transport::Result::OK)
+            AbortStreamFrame();
+    }
+
+    /** Drops the current frame after an error. Like Start(), the
+     *  continuous mode stops; the external trigger starts a new frame. */
+    void AbortStreamFrame()
+    {
+        ScopedIrqBlocker irqBlocker;
+        if(!stream_frame_active_)
+            return;
+        stream_frame_active_ = false;
+        stream_stats_.errors++;
+        if(stream_trigger_ == MAX11300Types::StreamTrigger::CONTINUOUS)
+            streaming_ = false;
+    }
+
+    static void StreamDmaCallback(void* context, SpiHandle::Result result)
+    {
+        auto& driver = *reinterpret_cast<MAX11300Driver*>(context);
+        if(result != SpiHandle::Result::OK)
+        {
+            driver.AbortStreamFrame();
+            return;
+        }
+        if(++driver.stream_step_ < driver.num_stream_steps_)
+            driver.StartStreamStep();
+        else
+            driver.FinishStreamFrame();
+    }
+
+    void FinishStreamFrame()
+    {
+        const uint32_t now          = System::GetUs();
+        const uint8_t  buffer_index = stream_buffer_index_;
+        stream_stats_.frames++;
+        stream_stats_.frame_time_us = now - stream_frame_start_us_;
+        if(stream_stats_.frame_time_us > stream_stats_.max_frame_time_us)
+            stream_stats_.max_frame_time_us = stream_stats_.frame_time_us;
+
+        // keep the bus busy with the other buffer...
+        stream_buffer_index_ = buffer_index ^ 1;
+        {
+            ScopedIrqBlocker irqBlocker;
+            stream_frame_active_ = false;
+        }
+        if(streaming_
+           && stream_trigger_ == MAX11300Types::StreamTrigger::CONTINUOUS)
+            StartStreamFrame();
+
+        // ...while the inputs are read and the outputs for the frame after
+        // the next one are written
+        for(size_t device_index = 0; device_index < num_devices;
+            device_index++)
+        {
+            auto&          device = devices_[device_index];
+            const uint8_t* rx
+                = stream_buffer_->rx_buffer[buffer_index][device_index];
+            if(device.adc_pin_count_ > 0)
+                memcpy(device.adc_buffer_,
+                       rx + stream_adc_offset_,
+                       (device.adc_pin_count_ * 2) + 1);
+            if(device.gpi_pin_count_ > 0)
+                memcpy(device.gpi_buffer_,
+                       rx + stream_gpi_offset_,
+                       sizeof(device.gpi_buffer_));
+        }
+        if(stream_callback_)
+            stream_callback_(stream_callback_ctx_);
+        for(size_t device_index = 0; device_index < num_devices;
+            device_index++)
+            CopyStreamOutputs(buffer_index, device_index);
+        stream_end_us_[buffer_index]    = now;
+        stream_end_valid_[buffer_index] = true;
+    }
+
     MAX11300Types::DmaBuffer* dma_buffer_;
 
     struct Device
@@ -1284,6 +1723,30 @@ class MAX11300Driver
     MAX11300Types::UpdateCompleteCallbackFunctionPtr update_complete_callback_;
     void* update_complete_callback_context_;
     bool  run_;
+
+    struct StreamStep
+    {
+        uint8_t device;
+        uint8_t offset;
+        uint8_t size;
+        bool    read;
+    };
+    StreamStep stream_steps_[4 * num_devices];
+    size_t     num_stream_steps_;
+
+    MAX11300Types::StreamBuffer<num_devices>*        stream_buffer_;
+    MAX11300Types::StreamTrigger                     stream_trigger_;
+    MAX11300Types::UpdateCompleteCallbackFunctionPtr stream_callback_;
+    void*                                            stream_callback_ctx_;
+    MAX11300Types::StreamStats                       stream_stats_;
+    volatile bool                                    streaming_;
+    volatile bool                                    stream_frame_active_;
+    volatile size_t                                  stream_step_;
+    volatile uint8_t                                 stream_buffer_index_;
+    bool                                             stream_started_;
+    uint32_t                                         stream_frame_start_us_;
+    uint32_t                                         stream_end_us_[2];
+    bool                                             stream_end_valid_[2];
 };
 template <size_t num_devices = 1>
 using MAX11300
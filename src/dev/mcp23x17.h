@@ -2,6 +2,7 @@
 
 #include "per/gpio.h"
 #include "per/i2c.h"
+#include "per/sharedBus.h"
 
 // This get defined in a public (ST) header file
 #undef SetBit
@@ -71,7 +72,6 @@ enum class MCPMode : uint8_t
 
 /**
  * Barebones driver for MCP23017 I2C 16-Bit I/O Expander
- * For now it supports only polling approach.
  * 
  * Usage:
  *  Mcp23017 mcp;
@@ -80,14 +80,28 @@ enum class MCPMode : uint8_t
  *  mcp.PortMode(MCP23017Port::B, 0xFF);
  *  mcp.Read();
  *  mcp.GetPin(2);
+ *
+ * With the INT pin connected, the expander only needs to be read after a
+ * pin changed:
+ *  mcp.SetInterrupts(0xFFFF);
+ *  // in the main loop
+ *  if(mcp.Update())
+ *      mcp.GetPin(2);
+ *
+ * StartReadAll() reads the pins with DMA instead.
  */
 class Mcp23017Transport
 {
   public:
+    /** Called from an interrupt when a DMA read is finished */
+    using Callback = void (*)(void* context, bool success);
+
     struct Config
     {
         I2CHandle::Config i2c_config;
         uint8_t           i2c_address;
+        /** The INT pin (active low), or an invalid Pin if not connected */
+        Pin               irq_pin;
         void              Defaults()
         {
             i2c_config.periph         = I2CHandle::Config::Peripheral::I2C_1;
@@ -96,6 +110,7 @@ class Mcp23017Transport
             i2c_config.pin_config.scl = Pin(PORTB, 8);
             i2c_config.pin_config.sda = Pin(PORTB, 9);
             i2c_address               = 0x27;
+            irq_pin                   = Pin();
         }
     };
 
@@ -109,7 +124,11 @@ class Mcp23017Transport
     void Init(const Config& config)
     {
         i2c_address_ = config.i2c_address;
+        irq_pin_     = config.irq_pin;
         i2c_.Init(config.i2c_config);
+        dma_.Init(i2c_);
+        if(irq_pin_.IsValid())
+            irq_.Init(irq_pin_, GPIO::Mode::INPUT, GPIO::Pull::PULLUP);
     };
 
     I2CHandle::Result WriteReg(MCPRegister reg, uint8_t val)
@@ -144,18 +163,60 @@ class Mcp23017Transport
         portB = data[1];
     }
 
+    /** Reads `size` consecutive registers starting at `reg` */
+    I2CHandle::Result ReadRegs(MCPRegister reg, uint8_t* data, uint16_t size)
+    {
+        return i2c_.ReadDataAtAddress(
+            i2c_address_, static_cast<uint8_t>(reg), 1, data, size, timeout);
+    }
+
+    /**
+     * Reads `size` consecutive registers starting at `reg` with DMA. `data`
+     * is also used to transmit the register address, so it must be placed
+     * in D2 memory with the DMA_BUFFER_MEM_SECTION attribute.
+     */
+    I2CHandle::Result ReadRegsDma(MCPRegister reg,
+                                  uint8_t*    data,
+                                  uint16_t    size,
+                                  Callback    callback,
+                                  void*       context)
+    {
+        data[0] = static_cast<uint8_t>(reg);
+        return dma_.Start(i2c_address_, data, 1, data, size, callback, context)
+                   ? I2CHandle::Result::OK
+                   : I2CHandle::Result::ERR;
+    }
+
+    /** Returns true if the INT pin is asserted, or if it's not connected */
+    bool IsIrqActive() { return !irq_pin_.IsValid() || !irq_.Read(); }
+
     daisy::I2CHandle i2c_;
     uint8_t          i2c_address_;
     uint8_t          timeout{10};
+
+  private:
+    I2CBusAdapter dma_;
+    GPIO          irq_;
+    Pin           irq_pin_;
 };
 
 template <typename Transport>
 class Mcp23X17
 {
   public:
+    /** Called from an interrupt when StartReadAll() is finished */
+    using Callback = void (*)(void* context, bool success);
+
+    /** The number of bytes read by a burst, from INTF_A to GPIO_B */
+    static constexpr uint16_t kBurstSize = 6;
+
     struct Config
     {
         typename Transport::Config transport_config;
+        /** Buffer of kBurstSize bytes for StartReadAll(), which fails
+         *  without it.
+         *  @note must be in DMA_BUFFER_MEM_SECTION */
+        uint8_t* dma_buffer = nullptr;
     };
 
     void Init()
@@ -168,15 +229,20 @@ class Mcp23X17
     void Init(const Config& config)
     {
         transport.Init(config.transport_config);
+        dma_buffer_      = config.dma_buffer;
+        reading_         = false;
+        pin_data         = 0;
+        interrupt_flags_ = 0;
+        captured_pins_   = 0;
 
         //BANK =     0 : sequential register addresses
-        //MIRROR =     0 : use configureInterrupt
-        //SEQOP =     1 : sequential operation disabled, address pointer does not increment
+        //MIRROR =     1 : INTA and INTB are connected, one pin for both ports
+        //SEQOP =     0 : sequential operation enabled, allows burst reads
         //DISSLW =     0 : slew rate enabled
         //HAEN =     0 : hardware address pin is always enabled on 23017
-        //ODR =     0 : open drain output
+        //ODR =     0 : active driver output
         //INTPOL =     0 : interrupt active low
-        transport.WriteReg(MCPRegister::IOCON, 0b00100000);
+        transport.WriteReg(MCPRegister::IOCON, 0b01000000);
 
         //enable all pull up resistors (will be effective for input pins only)
         transport.WriteReg(MCPRegister::GPPU_A, 0xFF, 0xFF);
@@ -353,13 +419,99 @@ class Mcp23X17
      */
     uint16_t Read()
     {
-        uint8_t a = ReadPort(MCPPort::A);
-        uint8_t b = ReadPort(MCPPort::B);
+        uint8_t a, b;
+        transport.ReadReg(MCPRegister::GPIO_A, a, b);
 
         pin_data = a | b << 8;
         return pin_data;
     }
 
+    /**
+     * Enables the interrupt-on-change for the pins in `mask` (bit 0-7 for
+     * port A, 8-15 for port B). The INT pin is asserted when one of them
+     * changes and released when the pins are read.
+     *
+     * See "3.5.3 Interrupt-on-change control register".
+     */
+    void SetInterrupts(uint16_t mask)
+    {
+        // compare against the previous value, not DEFVAL
+        transport.WriteReg(MCPRegister::INTCON_A, 0x00, 0x00);
+        transport.WriteReg(
+            MCPRegister::GPINTEN_A, LowByte(mask), HighByte(mask));
+    }
+
+    /**
+     * Reads the interrupt flags, the captured pin states and the pin
+     * states of both ports in one burst. This also clears the interrupt.
+     *
+     * @return uint16_t the pin states, like Read()
+     */
+    uint16_t ReadAll()
+    {
+        uint8_t data[kBurstSize] = {};
+        transport.ReadRegs(MCPRegister::INTF_A, data, kBurstSize);
+        Decode(data);
+        return pin_data;
+    }
+
+    /**
+     * Calls ReadAll() if the INT pin is asserted. Without an INT pin, the
+     * pins are read with every call.
+     *
+     * @return true if the pins were read
+     */
+    bool Update()
+    {
+        if(!IsChangePending())
+            return false;
+        ReadAll();
+        return true;
+    }
+
+    /**
+     * Starts reading the pins like ReadAll(), but with DMA. The results are
+     * updated from the completion interrupt, before `callback` is called.
+     *
+     * @return false if a read is still running or failed to start, or if
+     *         no Config::dma_buffer was given
+     */
+    bool StartReadAll(Callback callback = nullptr, void* context = nullptr)
+    {
+        if(reading_ || dma_buffer_ == nullptr)
+            return false;
+        reading_          = true;
+        callback_         = callback;
+        callback_context_ = context;
+        if(transport.ReadRegsDma(MCPRegister::INTF_A,
+                                 dma_buffer_,
+                                 kBurstSize,
+                                 &DmaCallback,
+                                 this)
+           != I2CHandle::Result::OK)
+        {
+            reading_ = false;
+            return false;
+        }
+        return true;
+    }
+
+    /** Returns true while a read started by StartReadAll() is running */
+    bool IsReading() const { return reading_; }
+
+    /** Returns true if the INT pin is asserted, or if it's not connected */
+    bool IsChangePending() { return transport.IsIrqActive(); }
+
+    /** Returns the pins that caused the interrupt, from the last burst */
+    uint16_t GetInterruptFlags() const { return interrupt_flags_; }
+
+    /**
+     * Returns the pin states at the time of the interrupt, from the last
+     * burst. Short pulses that are already over when the pins are read
+     * show up here.
+     */
+    uint16_t GetCapturedPins() const { return captured_pins_; }
+
     /**
      * @brief Fetches pin state from the result of recent Read() call. Useful to preserve unneeded reads
      * 
@@ -396,9 +548,36 @@ class Mcp23X17
     uint8_t LowByte(uint16_t val) { return val & 0xFF; }
     uint8_t HighByte(uint16_t val) { return (val >> 8) & 0xff; }
 
-    uint16_t  pin_data;
-    Transport transport;
+    /** Decodes the registers from INTF_A to GPIO_B */
+    void Decode(const uint8_t* data)
+    {
+        interrupt_flags_ = data[0] | data[1] << 8;
+        captured_pins_   = data[2] | data[3] << 8;
+        pin_data         = data[4] | data[5] << 8;
+    }
+
+    static void DmaCallback(void* context, bool success)
+    {
+        auto mcp = static_cast<Mcp23X17*>(context);
+        if(success)
+            mcp->Decode(mcp->dma_buffer_);
+        mcp->reading_ = false;
+        if(mcp->callback_)
+            mcp->callback_(mcp->callback_context_, success);
+    }
+
+    uint16_t      pin_data;
+    uint16_t      interrupt_flags_;
+    uint16_t      captured_pins_;
+    uint8_t*      dma_buffer_;
+    volatile bool reading_;
+    Callback      callback_;
+    void*         callback_context_;
+    Transport     transport;
 };
 
+template <typename Transport>
+constexpr uint16_t Mcp23X17<Transport>::kBurstSize;
+
 using Mcp23017 = Mcp23X17<Mcp23017Transport>;
 } // namespace daisy
@@ -2,6 +2,11 @@
 #ifndef DSY_MPR121_H
 #define DSY_MPR121_H
 
+#include "per/gpio.h"
+#include "per/i2c.h"
+#include "per/sharedBus.h"
+#include "sys/system.h"
+
 // The default I2C address
 #define MPR121_I2CADDR_DEFAULT 0x5A        ///< default I2C address
 #define MPR121_TOUCH_THRESHOLD_DEFAULT 12  ///< default touch threshold value
@@ -17,6 +22,9 @@ namespace daisy
 class Mpr121I2CTransport
 {
   public:
+    /** Called from an interrupt when a DMA read is finished */
+    using Callback = void (*)(void *context, bool success);
+
     Mpr121I2CTransport() {}
     ~Mpr121I2CTransport() {}
 
@@ -31,6 +39,10 @@ class Mpr121I2CTransport
 
         uint8_t dev_addr;
 
+        /** The IRQ pin of the device (active low), or an invalid Pin if
+         *  it's not connected. */
+        Pin irq;
+
         Config()
         {
             periph = I2CHandle::Config::Peripheral::I2C_1;
@@ -56,7 +68,12 @@ class Mpr121I2CTransport
         i2c_conf.pin_config.scl = config.scl;
         i2c_conf.pin_config.sda = config.sda;
 
-        return I2CHandle::Result::OK != i2c_.Init(i2c_conf);
+        if(config_.irq.IsValid())
+            irq_.Init(config_.irq, GPIO::Mode::INPUT, GPIO::Pull::PULLUP);
+
+        const bool err = I2CHandle::Result::OK != i2c_.Init(i2c_conf);
+        dma_.Init(i2c_);
+        return err;
     }
 
     /** \return Did the transaction error? i.e. Return true if error, false if ok */
@@ -73,15 +90,43 @@ class Mpr121I2CTransport
                != i2c_.ReceiveBlocking(config_.dev_addr, data, size, 10);
     }
 
+    /** Reads `size` registers starting at `reg` with DMA. `data` is also
+        used to transmit the register address, so it must be placed in D2
+        memory with the DMA_BUFFER_MEM_SECTION attribute.
+        \return Did the transaction error? i.e. Return true if error, false if ok
+    */
+    bool ReadDma(uint8_t   reg,
+                 uint8_t  *data,
+                 uint16_t  size,
+                 Callback  callback,
+                 void     *context)
+    {
+        data[0] = reg;
+        return !dma_.Start(
+            config_.dev_addr, data, 1, data, size, callback, context);
+    }
+
+    /** \return true if the IRQ pin is asserted, or if it's not connected */
+    bool IsIrqActive() { return !config_.irq.IsValid() || !irq_.Read(); }
+
   private:
-    I2CHandle i2c_;
-    Config    config_;
+    I2CHandle     i2c_;
+    I2CBusAdapter dma_;
+    GPIO          irq_;
+    Config        config_;
 };
 
 
 /** @brief Device support for MPR121 12x Capacitive Touch Sensor
     @author beserge
     @date December 2021
+
+    Besides reading single registers, the driver can read the touch status,
+    the out of range status and the filtered data of all channels with one
+    burst transaction, either blocking with ReadAll() or with DMA with
+    StartReadAll(). The results are available from GetTouched(),
+    GetOutOfRange() and GetFilteredData(). If the IRQ pin is connected,
+    Update() only reads the device after the touch status changed.
 */
 template <typename Transport>
 class Mpr121
@@ -90,16 +135,31 @@ class Mpr121
     Mpr121() {}
     ~Mpr121() {}
 
+    /** The number of channels, i.e. 12 electrodes and the proximity channel */
+    static constexpr uint8_t kNumChannels = 13;
+    /** The number of bytes read by a burst, from the touch status to the
+        filtered data of the last channel. */
+    static constexpr uint16_t kBurstSize = 0x1E;
+
+    /** Called from an interrupt when StartReadAll() is finished */
+    using Callback = void (*)(void *context, bool success);
+
     struct Config
     {
         typename Transport::Config transport_config;
         uint8_t                    touch_threshold;
         uint8_t                    release_threshold;
 
+        /** Buffer of kBurstSize bytes for StartReadAll(), which fails
+            without it.
+            @note must be in DMA_BUFFER_MEM_SECTION */
+        uint8_t *dma_buffer;
+
         Config()
         {
             touch_threshold   = MPR121_TOUCH_THRESHOLD_DEFAULT;
             release_threshold = MPR121_RELEASE_THRESHOLD_DEFAULT;
+            dma_buffer        = nullptr;
         }
     };
 
@@ -114,7 +174,15 @@ class Mpr121
     */
     Result Init(Config config)
     {
-        config_ = config;
+        config_           = config;
+        transport_error_  = false;
+        reading_          = false;
+        touched_          = 0;
+        previous_touched_ = 0;
+        out_of_range_     = 0;
+        for(uint8_t t = 0; t < kNumChannels; t++)
+            filtered_[t] = 0;
+        dma_buffer_ = config_.dma_buffer;
 
         SetTransportErr(transport_.Init(config_.transport_config));
 
@@ -224,6 +292,79 @@ class Mpr121
         return t & 0x0FFF;
     }
 
+    /** Reads the touch status, the out of range status and the filtered
+        data of all channels in one burst.
+        \returns   OK, or ERR if the transaction failed
+    */
+    Result ReadAll()
+    {
+        uint8_t buff[kBurstSize];
+        uint8_t reg = MPR121_TOUCHSTATUS_L;
+        SetTransportErr(transport_.Write(&reg, 1));
+        SetTransportErr(transport_.Read(buff, kBurstSize));
+        Result result = GetTransportErr();
+        if(result == OK)
+            Decode(buff);
+        return result;
+    }
+
+    /** Calls ReadAll() if the IRQ pin signals a changed touch status. Without
+        an IRQ pin, the device is read with every call.
+        \returns   true if the device was read successfully
+    */
+    bool Update() { return IsChangePending() && ReadAll() == OK; }
+
+    /** Starts reading all channels like ReadAll(), but with DMA. The results
+        are updated from the completion interrupt, before `callback` is
+        called.
+        \returns   OK, or ERR if a read is still running or failed to start,
+                   or if no Config::dma_buffer was given
+    */
+    Result StartReadAll(Callback callback = nullptr, void *context = nullptr)
+    {
+        if(reading_ || dma_buffer_ == nullptr)
+            return ERR;
+        reading_          = true;
+        callback_         = callback;
+        callback_context_ = context;
+        if(transport_.ReadDma(MPR121_TOUCHSTATUS_L,
+                              dma_buffer_,
+                              kBurstSize,
+                              &DmaCallback,
+                              this))
+        {
+            reading_ = false;
+            return ERR;
+        }
+        return OK;
+    }
+
+    /** \returns true while a read started by StartReadAll() is running */
+    bool IsReading() const { return reading_; }
+
+    /** \returns true if the IRQ pin is asserted, i.e. the touch status changed
+        since the last read, or if the IRQ pin isn't connected.
+    */
+    bool IsChangePending() { return transport_.IsIrqActive(); }
+
+    /** \returns the touch status of the 12 electrodes from the last burst */
+    uint16_t GetTouched() const { return touched_; }
+
+    /** \returns the electrodes that were touched or released between the
+        last two bursts */
+    uint16_t GetChanged() const { return touched_ ^ previous_touched_; }
+
+    /** \returns the out of range status of all 13 channels from the last
+        burst */
+    uint16_t GetOutOfRange() const { return out_of_range_; }
+
+    /** \returns the filtered data of channel t from the last burst, as a
+        10 bit unsigned value */
+    uint16_t GetFilteredData(uint8_t t) const
+    {
+        return t < kNumChannels ? filtered_[t] : 0;
+    }
+
     /** Read the contents of an 8 bit device register.
         \param      reg the register address to read from
         \returns    the 8 bit value that was read.
@@ -335,9 +476,37 @@ class Mpr121
     };
 
   private:
-    Config    config_;
-    Transport transport_;
-    bool      transport_error_;
+    Config        config_;
+    Transport     transport_;
+    bool          transport_error_;
+    uint16_t      touched_;
+    uint16_t      previous_touched_;
+    uint16_t      out_of_range_;
+    uint16_t      filtered_[kNumChannels];
+    uint8_t      *dma_buffer_;
+    volatile bool reading_;
+    Callback      callback_;
+    void         *callback_context_;
+
+    /** Decodes the registers from TOUCHSTATUS_L to FILTDATA_12H */
+    void Decode(const uint8_t *data)
+    {
+        previous_touched_ = touched_;
+        touched_          = (data[0] | (data[1] << 8)) & 0x0FFF;
+        out_of_range_     = (data[2] | (data[3] << 8)) & 0x1FFF;
+        for(uint8_t t = 0; t < kNumChannels; t++)
+            filtered_[t] = (data[4 + 2 * t] | (data[5 + 2 * t] << 8)) & 0x03FF;
+    }
+
+    static void DmaCallback(void *context, bool success)
+    {
+        auto dev = static_cast<Mpr121 *>(context);
+        if(success)
+            dev->Decode(dev->dma_buffer_);
+        dev->reading_ = false;
+        if(dev->callback_)
+            dev->callback_(dev->callback_context_, success);
+    }
 
     /** Set the global transport_error_ bool */
     void SetTransportErr(bool err) { transport_error_ |= err; }
@@ -352,6 +521,11 @@ class Mpr121
 
 }; // class
 
+template <typename Transport>
+constexpr uint8_t Mpr121<Transport>::kNumChannels;
+template <typename Transport>
+constexpr uint16_t Mpr121<Transport>::kBurstSize;
+
 using Mpr121I2C = Mpr121<Mpr121I2CTransport>;
 
 /** @} */
@@ -2,6 +2,9 @@
 #ifndef DSY_NEO_PIXEL_H
 #define DSY_NEO_PIXEL_H
 
+#include "per/i2c.h"
+#include "sys/system.h"
+
 #define NEO_TRELLIS_ADDR_NEOPIXEL (0x2E) ///< Default Neotrellis I2C address
 
 // RGB NeoPixel permutations; white and red offsets are always same
@@ -184,6 +187,10 @@ class NeoPixelI2CTransport
 };
 
 /** \brief Device support for Adafruit Neopixel Device
+    \details Pixel colors are only stored locally until Show() is called.
+              Show() then sends the bytes that changed since the last call
+              to the seesaw pixel buffer, merging nearby changes into as few
+              transfers as possible, and latches them.
     @author beserge
     @date December 2021
 */
@@ -191,7 +198,7 @@ template <typename Transport>
 class NeoPixel
 {
   public:
-    NeoPixel() {}
+    NeoPixel() : brightness(0), rOffset(0), wOffset(0) {}
     ~NeoPixel() {}
 
     struct Config
@@ -260,6 +267,14 @@ class NeoPixel
         SEESAW_STATUS_SWRST   = 0x7F,
     };
 
+    /** Maximum number of pixel bytes in one write to the seesaw buffer */
+    static constexpr uint16_t kMaxBufferWriteSize = 28;
+
+    /** Unchanged bytes between two changes are sent along if there are at
+     *  most this many, which is cheaper than starting another transfer.
+     */
+    static constexpr uint16_t kMaxBufferWriteGap = 4;
+
     /** Initialize the NeoPixel device
         \param config Configuration settings
     */
@@ -271,6 +286,8 @@ class NeoPixel
         numLEDs = config_.numLEDs;
         pin     = config_.output_pin;
         pixels  = pixelsd;
+        endTime = 0;
+        mymemset(dirty, 0, sizeof(dirty));
 
         transport_.Init(config_.transport_config);
 
@@ -334,6 +351,8 @@ class NeoPixel
         numBytes = n * ((wOffset == rOffset) ? 3 : 4);
         mymemset(pixels, 0, numBytes);
         numLEDs = n;
+        // the device keeps its old buffer contents, so send everything
+        MarkDirty(0, numBytes);
 
         uint8_t buf[] = {(uint8_t)(numBytes >> 8), (uint8_t)(numBytes & 0xFF)};
         Write(SEESAW_NEOPIXEL_BASE, SEESAW_NEOPIXEL_BUF_LENGTH, buf, 2);
@@ -371,6 +390,7 @@ class NeoPixel
         while(!CanShow())
             ;
 
+        SendDirtyBytes();
         Write(SEESAW_NEOPIXEL_BASE, SEESAW_NEOPIXEL_SHOW, NULL, 0);
 
         endTime = System::GetUs(); // Save EOD time for latch on next call
@@ -394,29 +414,19 @@ class NeoPixel
                 g = (g * brightness) >> 8;
                 b = (b * brightness) >> 8;
             }
-            uint8_t *p;
+            uint16_t p;
             if(wOffset == rOffset)
-            {                       // Is an RGB-type strip
-                p = &pixels[n * 3]; // 3 bytes per pixel
+            {              // Is an RGB-type strip
+                p = n * 3; // 3 bytes per pixel
             }
             else
-            {                                // Is a WRGB-type strip
-                p          = &pixels[n * 4]; // 4 bytes per pixel
-                p[wOffset] = 0; // But only R,G,B passed -- set W to 0
+            {                            // Is a WRGB-type strip
+                p = n * 4;               // 4 bytes per pixel
+                SetByte(p + wOffset, 0); // But only R,G,B passed -- set W to 0
             }
-            p[rOffset] = r; // R,G,B always stored
-            p[gOffset] = g;
-            p[bOffset] = b;
-
-            uint8_t  len    = (wOffset == rOffset ? 3 : 4);
-            uint16_t offset = n * len;
-
-            uint8_t writeBuf[6];
-            writeBuf[0] = (offset >> 8);
-            writeBuf[1] = offset;
-            mymemcpy(&writeBuf[2], p, len);
-
-            Write(SEESAW_NEOPIXEL_BASE, SEESAW_NEOPIXEL_BUF, writeBuf, len + 2);
+            SetByte(p + rOffset, r); // R,G,B always stored
+            SetByte(p + gOffset, g);
+            SetByte(p + bOffset, b);
         }
     }
 
@@ -431,29 +441,19 @@ class NeoPixel
                 b = (b * brightness) >> 8;
                 w = (w * brightness) >> 8;
             }
-            uint8_t *p;
+            uint16_t p;
             if(wOffset == rOffset)
-            {                       // Is an RGB-type strip
-                p = &pixels[n * 3]; // 3 bytes per pixel (ignore W)
+            {              // Is an RGB-type strip
+                p = n * 3; // 3 bytes per pixel (ignore W)
             }
             else
-            {                                // Is a WRGB-type strip
-                p          = &pixels[n * 4]; // 4 bytes per pixel
-                p[wOffset] = w;              // Store W
+            {                            // Is a WRGB-type strip
+                p = n * 4;               // 4 bytes per pixel
+                SetByte(p + wOffset, w); // Store W
             }
-            p[rOffset] = r; // Store R,G,B
-            p[gOffset] = g;
-            p[bOffset] = b;
-
-            uint8_t  len    = (wOffset == rOffset ? 3 : 4);
-            uint16_t offset = n * len;
-
-            uint8_t writeBuf[6];
-            writeBuf[0] = (offset >> 8);
-            writeBuf[1] = offset;
-            mymemcpy(&writeBuf[2], p, len);
-
-            Write(SEESAW_NEOPIXEL_BASE, SEESAW_NEOPIXEL_BUF, writeBuf, len + 2);
+            SetByte(p + rOffset, r); // Store R,G,B
+            SetByte(p + gOffset, g);
+            SetByte(p + bOffset, b);
         }
     }
 
@@ -462,8 +462,9 @@ class NeoPixel
     {
         if(n < numLEDs)
         {
-            uint8_t *p, r = (uint8_t)(c >> 16), g = (uint8_t)(c >> 8),
-                        b = (uint8_t)c;
+            uint16_t p;
+            uint8_t  r = (uint8_t)(c >> 16), g = (uint8_t)(c >> 8),
+                    b = (uint8_t)c;
             if(brightness)
             { // See notes in setBrightness()
                 r = (r * brightness) >> 8;
@@ -472,27 +473,17 @@ class NeoPixel
             }
             if(wOffset == rOffset)
             {
-                p = &pixels[n * 3];
+                p = n * 3;
             }
             else
             {
-                p          = &pixels[n * 4];
-                uint8_t w  = (uint8_t)(c >> 24);
-                p[wOffset] = brightness ? ((w * brightness) >> 8) : w;
+                p         = n * 4;
+                uint8_t w = (uint8_t)(c >> 24);
+                SetByte(p + wOffset, brightness ? ((w * brightness) >> 8) : w);
             }
-            p[rOffset] = r;
-            p[gOffset] = g;
-            p[bOffset] = b;
-
-            uint8_t  len    = (wOffset == rOffset ? 3 : 4);
-            uint16_t offset = n * len;
-
-            uint8_t writeBuf[6];
-            writeBuf[0] = (offset >> 8);
-            writeBuf[1] = offset;
-            mymemcpy(&writeBuf[2], p, len);
-
-            Write(SEESAW_NEOPIXEL_BASE, SEESAW_NEOPIXEL_BUF, writeBuf, len + 2);
+            SetByte(p + rOffset, r);
+            SetByte(p + gOffset, g);
+            SetByte(p + bOffset, b);
         }
     }
 
@@ -566,41 +557,89 @@ class NeoPixel
 
     uint16_t NumPixels(void) const { return numLEDs; }
 
+    // Clears all pixels. The seesaw is updated with the next Show().
     void Clear()
     {
-        // Clear local pixel buffer
-        mymemset(pixels, 0, numBytes);
-
-        // Now clear the pixels on the seesaw
-        uint8_t writeBuf[32];
-        mymemset(writeBuf, 0, 32);
-        for(uint8_t offset = 0; offset < numBytes; offset += 32 - 4)
+        for(uint16_t i = 0; i < numBytes; i++)
         {
-            writeBuf[0] = (offset >> 8);
-            writeBuf[1] = offset;
-            Write(SEESAW_NEOPIXEL_BASE, SEESAW_NEOPIXEL_BUF, writeBuf, 32);
+            SetByte(i, 0);
         }
     }
 
     void SetBrightness(uint8_t b) { brightness = b; }
 
+    // Returns true if pixel byte i changed since the last Show()
+    bool IsDirty(uint16_t i) const { return dirty[i >> 3] & (1 << (i & 7)); }
+
   private:
-    void mymemcpy(uint8_t *dest, uint8_t *src, uint8_t len)
+    void mymemcpy(uint8_t *dest, uint8_t *src, uint16_t len)
     {
-        for(uint8_t i = 0; i < len; i++)
+        for(uint16_t i = 0; i < len; i++)
         {
             dest[i] = src[i];
         }
     }
 
-    void mymemset(uint8_t *addr, uint8_t val, uint8_t len)
+    void mymemset(uint8_t *addr, uint8_t val, uint16_t len)
     {
-        for(uint8_t i = 0; i < len; i++)
+        for(uint16_t i = 0; i < len; i++)
         {
             addr[i] = val;
         }
     }
 
+    // Stores a pixel byte and marks it dirty if it changed
+    void SetByte(uint16_t i, uint8_t value)
+    {
+        if(pixels[i] != value)
+        {
+            pixels[i] = value;
+            dirty[i >> 3] |= (1 << (i & 7));
+        }
+    }
+
+    void MarkDirty(uint16_t start, uint16_t len)
+    {
+        for(uint16_t i = start; i < start + len; i++)
+        {
+            dirty[i >> 3] |= (1 << (i & 7));
+        }
+    }
+
+    // Sends all dirty bytes to the seesaw buffer
+    void SendDirtyBytes()
+    {
+        for(uint16_t start = 0; start < numBytes; start++)
+        {
+            if(!IsDirty(start))
+                continue;
+
+            // extend the transfer over small gaps of unchanged bytes
+            uint16_t end = start + 1;
+            for(uint16_t i = end;
+                i < numBytes && i - start < kMaxBufferWriteSize;
+                i++)
+            {
+                if(IsDirty(i))
+                    end = i + 1;
+                else if(i - end >= kMaxBufferWriteGap)
+                    break;
+            }
+
+            uint8_t writeBuf[kMaxBufferWriteSize + 2];
+            writeBuf[0] = (start >> 8);
+            writeBuf[1] = start;
+            mymemcpy(&writeBuf[2], &pixels[start], end - start);
+            Write(SEESAW_NEOPIXEL_BASE,
+                  SEESAW_NEOPIXEL_BUF,
+                  writeBuf,
+                  end - start + 2);
+
+            start = end - 1;
+        }
+        mymemset(dirty, 0, sizeof(dirty));
+    }
+
     Config    config_;
     Transport transport_;
 
@@ -612,6 +651,7 @@ class NeoPixel
     int8_t pin;
 
     uint8_t pixelsd[256]; // hopefully we won't need more than this...
+    uint8_t dirty[256 / 8]; // one bit per byte in pixelsd
 
     uint8_t brightness,
         *pixels,      // Holds LED color values (3 or 4 bytes each)
@@ -32,6 +32,9 @@ namespace daisy
  ** When combining multiple daisy chained and parallel devices the number of devices chained should match
  ** for each parallel device chain.
  **
+ ** Update() bit-bangs the chain and waits between the clock edges. To scan
+ ** a chain on SPI pins in the background, see ShiftRegisterScanner.
+ **
  ***/
 template <size_t num_daisychained = 1, size_t num_parallel = 1>
 class ShiftRegister4021
@@ -105,6 +108,19 @@ class ShiftRegister4021
      ***/
     inline bool State(int index) const { return states_[index]; }
 
+    /** returns the last read states of up to 32 inputs as a bit mask,
+     ** bit n is the state of input (32 * word + n).
+     **
+     ** Useful for debouncing all inputs at once with an InputDebouncer.
+     ***/
+    uint32_t StateWord(size_t word = 0) const
+    {
+        uint32_t bits = 0;
+        for(size_t i = 0; i < 32 && 32 * word + i < size_t(kTotalStates); i++)
+            bits |= uint32_t(states_[32 * word + i]) << i;
+        return bits;
+    }
+
     inline const Config& GetConfig() const { return config_; }
 
   private:
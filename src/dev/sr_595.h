@@ -17,6 +17,8 @@ const size_t kMaxSr595DaisyChain
 /**
    @brief Device Driver for 8-bit shift register. \n 
    CD74HC595 - 8-bit serial to parallel output shift
+   Write() bit-bangs the chain. To send the outputs on SPI pins in the
+   background, see ShiftRegisterScanner.
    @author shensley
    @date May 2020
 */
@@ -0,0 +1,460 @@
+#pragma once
+#ifndef DSY_DEV_SR_SCANNER_H
+#define DSY_DEV_SR_SCANNER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "per/gpio.h"
+#include "per/spi.h"
+#include "per/tim.h"
+#include "sys/system.h"
+#include "util/scopedirqblocker.h"
+
+namespace daisy
+{
+/** @brief SPI transport for the ShiftRegisterScanner
+ ** @ingroup shiftregister
+ **
+ ** Both chains hang off one SPI peripheral and share its clock and a
+ ** single latch pin:
+ ** - SPI clock  -> CLK (pin 10) of the 4021s and SRCLK (pin 11) of the 595s
+ ** - SPI MISO   <- Q8 (pin 3) of the 4021 at the end of the chain
+ ** - SPI MOSI   -> SER (pin 14) of the 595 at the start of the chain
+ ** - latch pin  -> P/S (pin 9) of the 4021s and RCLK (pin 12) of the 595s
+ **
+ ** After each transfer the latch pin is pulsed. The rising edge latches
+ ** the outputs that were just shifted into the 595s, and the high level
+ ** loads the inputs of the 4021s for the next transfer.
+ **
+ ** The transfers use DMA, so the buffers must be placed in D2 memory,
+ ** see ShiftRegisterScanner::Config::dma_buffer. The scan rate is set by
+ ** a hardware timer, which should be one of the 32 bit timers.
+ ***/
+class ShiftRegisterSpiTransport
+{
+  public:
+    /** Called from the DMA interrupt after the latch pulse */
+    typedef void (*Callback)(void* context, bool success);
+
+    struct Config
+    {
+        SpiHandle::Config::Peripheral    periph;
+        SpiHandle::Config::BaudPrescaler baud_prescaler;
+        Pin                              clk;
+        Pin                              data_in;
+        Pin                              data_out;
+        Pin                              latch;
+        TimerHandle::Config::Peripheral  timer;
+        /** Width of the latch pulse, each tick is approx. 4.16ns */
+        uint32_t latch_delay_ticks;
+
+        void Defaults()
+        {
+            periph            = SpiHandle::Config::Peripheral::SPI_1;
+            baud_prescaler    = SpiHandle::Config::BaudPrescaler::PS_64;
+            clk               = Pin(PORTG, 11);
+            data_in           = Pin(PORTB, 4);
+            data_out          = Pin(PORTB, 5);
+            latch             = Pin(PORTG, 10);
+            timer             = TimerHandle::Config::Peripheral::TIM_5;
+            latch_delay_ticks = 40;
+        }
+    };
+
+    void Init(const Config& config)
+    {
+        SpiHandle::Config spi_cfg;
+        spi_cfg.periph          = config.periph;
+        spi_cfg.mode            = SpiHandle::Config::Mode::MASTER;
+        spi_cfg.direction       = SpiHandle::Config::Direction::TWO_LINES;
+        spi_cfg.clock_polarity  = SpiHandle::Config::ClockPolarity::LOW;
+        spi_cfg.clock_phase     = SpiHandle::Config::ClockPhase::ONE_EDGE;
+        spi_cfg.datasize        = 8;
+        spi_cfg.nss             = SpiHandle::Config::NSS::SOFT;
+        spi_cfg.baud_prescaler  = config.baud_prescaler;
+        spi_cfg.pin_config.sclk = config.clk;
+        spi_cfg.pin_config.miso = config.data_in;
+        spi_cfg.pin_config.mosi = config.data_out;
+        spi_cfg.pin_config.nss  = Pin();
+        spi_.Init(spi_cfg);
+
+        latch_.Init(config.latch, GPIO::Mode::OUTPUT);
+        latch_delay_ticks_ = config.latch_delay_ticks;
+        timer_periph_      = config.timer;
+        // load the inputs for the first transfer
+        PulseLatch();
+    }
+
+    /** Calls `callback` from the timer interrupt `rate` times per second */
+    bool StartTimer(float                              rate,
+                    TimerHandle::PeriodElapsedCallback callback,
+                    void*                              context)
+    {
+        TimerHandle::Config timer_cfg;
+        timer_cfg.periph     = timer_periph_;
+        timer_cfg.enable_irq = true;
+        if(timer_.Init(timer_cfg) != TimerHandle::Result::OK)
+            return false;
+        timer_.SetPeriod(static_cast<uint32_t>(timer_.GetFreq() / rate) - 1);
+        timer_.SetCallback(callback, context);
+        return timer_.Start() == TimerHandle::Result::OK;
+    }
+
+    void StopTimer() { timer_.Stop(); }
+
+    /** Starts a full duplex transfer, returns false if it couldn't start */
+    bool Transfer(uint8_t* tx,
+                  uint8_t* rx,
+                  size_t   size,
+                  Callback callback,
+                  void*    context)
+    {
+        callback_ = callback;
+        context_  = context;
+        return spi_.DmaTransmitAndReceive(
+                   tx, rx, size, nullptr, &TransferComplete, this)
+               == SpiHandle::Result::OK;
+    }
+
+  private:
+    void PulseLatch()
+    {
+        latch_.Write(true);
+        System::DelayTicks(latch_delay_ticks_);
+        latch_.Write(false);
+    }
+
+    static void TransferComplete(void* context, SpiHandle::Result result)
+    {
+        auto self = static_cast<ShiftRegisterSpiTransport*>(context);
+        self->PulseLatch();
+        self->callback_(self->context_, result == SpiHandle::Result::OK);
+    }
+
+    SpiHandle                       spi_;
+    GPIO                            latch_;
+    TimerHandle                     timer_;
+    TimerHandle::Config::Peripheral timer_periph_;
+    uint32_t                        latch_delay_ticks_;
+    Callback                        callback_ = nullptr;
+    void*                           context_  = nullptr;
+};
+
+/** @brief Scans chains of 4021 inputs and 595 outputs in the background
+ ** @ingroup shiftregister
+ **
+ ** ShiftRegister4021 and ShiftRegister595 bit-bang their chains and wait
+ ** between every clock edge. The scanner instead shifts both chains as
+ ** one SPI frame with DMA, started from a timer at a fixed rate (or back
+ ** to back), so that a scan costs the CPU only a short interrupt.
+ **
+ ** The inputs are decoded into double buffered snapshots of 32 bit words.
+ ** Reading them never blocks and always returns the inputs of one
+ ** complete scan, ready to be fed to an InputDebouncer. The outputs are
+ ** set on a staging copy and published with CommitOutputs(), which
+ ** encodes them into the transmit buffer that isn't currently sent.
+ **
+ ** The numbering of the inputs and outputs matches ShiftRegister4021
+ ** and ShiftRegister595: index 0 is bit 0 of the first device. The inputs
+ ** of a scan are the ones that were loaded by the latch pulse at the end
+ ** of the previous scan.
+ **
+ ** @tparam Transport The transport, e.g. ShiftRegisterSpiTransport
+ ** @tparam num_4021  Number of daisy chained 4021 input registers
+ ** @tparam num_595   Number of daisy chained 595 output registers
+ ***/
+template <typename Transport, size_t num_4021, size_t num_595>
+class ShiftRegisterScanner
+{
+  public:
+    static_assert(num_4021 > 0 || num_595 > 0, "no shift registers to scan");
+
+    /** Number of inputs of the 4021 chain */
+    static constexpr size_t kNumInputs = 8 * num_4021;
+    /** Number of outputs of the 595 chain */
+    static constexpr size_t kNumOutputs = 8 * num_595;
+    /** Number of 32 bit words of an input snapshot, at least one */
+    static constexpr size_t kNumInputWords
+        = kNumInputs > 32 ? (kNumInputs + 31) / 32 : 1;
+    /** Size in bytes of the SPI frame of one scan */
+    static constexpr size_t kFrameSize
+        = num_4021 > num_595 ? num_4021 : num_595;
+
+    /** Buffers for the DMA transfers, two frames in each direction */
+    struct DmaBuffer
+    {
+        uint8_t tx[2][kFrameSize];
+        uint8_t rx[2][kFrameSize];
+    };
+
+    struct Config
+    {
+        typename Transport::Config transport_config;
+        /** Scans per second, or 0 to start every scan right after the
+         *  previous one */
+        float scan_rate;
+        /** DMA buffers, Init() fails without them.
+         *  @note must be in DMA_BUFFER_MEM_SECTION */
+        DmaBuffer* dma_buffer;
+
+        void Defaults()
+        {
+            transport_config.Defaults();
+            scan_rate  = 1000.f;
+            dma_buffer = nullptr;
+        }
+    };
+
+    enum class Result
+    {
+        OK,
+        ERR,
+    };
+
+    ShiftRegisterScanner() : buffer_(nullptr), running_(false) {}
+    ~ShiftRegisterScanner() {}
+
+    /** Initializes the transport and clears all inputs and outputs
+     *  @return Result::ERR if Config::dma_buffer is missing
+     */
+    Result Init(const Config& config)
+    {
+        config_     = config;
+        buffer_     = config.dma_buffer;
+        running_    = false;
+        busy_       = false;
+        front_      = 0;
+        back_       = 1;
+        tx_sending_ = 0;
+        tx_next_    = 0;
+        frames_     = 0;
+        overruns_   = 0;
+        errors_     = 0;
+        for(size_t d = 0; d < sizeof(outputs_); d++)
+            outputs_[d] = 0;
+        if(buffer_ == nullptr)
+            return Result::ERR;
+        for(size_t b = 0; b < 2; b++)
+        {
+            EncodeOutputs(outputs_, buffer_->tx[b]);
+            for(size_t w = 0; w < kNumInputWords; w++)
+                inputs_[b][w] = 0;
+        }
+        transport_.Init(config_.transport_config);
+        return Result::OK;
+    }
+
+    /** Starts scanning in the background at Config::scan_rate */
+    Result Start()
+    {
+        if(running_ || buffer_ == nullptr)
+            return Result::ERR;
+        running_ = true;
+        if(config_.scan_rate > 0.f)
+        {
+            if(!transport_.StartTimer(config_.scan_rate, &TimerCallback, this))
+            {
+                running_ = false;
+                return Result::ERR;
+            }
+            return Result::OK;
+        }
+        if(!TriggerScan())
+        {
+            running_ = false;
+            return Result::ERR;
+        }
+        return Result::OK;
+    }
+
+    /** Stops scanning after the current scan */
+    void Stop()
+    {
+        if(running_ && config_.scan_rate > 0.f)
+            transport_.StopTimer();
+        running_ = false;
+    }
+
+    /** @return true while scanning in the background */
+    bool IsRunning() const { return running_; }
+
+    /** Starts a single scan, e.g. from your own timer interrupt.
+     *  @return false if the previous scan is still busy (an overrun) or
+     *          the transfer couldn't be started
+     */
+    bool TriggerScan()
+    {
+        if(buffer_ == nullptr)
+            return false;
+        if(busy_)
+        {
+            overruns_++;
+            return false;
+        }
+        busy_       = true;
+        tx_sending_ = tx_next_;
+        if(!transport_.Transfer(buffer_->tx[tx_sending_],
+                                buffer_->rx[back_],
+                                kFrameSize,
+                                &TransferCallback,
+                                this))
+        {
+            busy_ = false;
+            errors_++;
+            return false;
+        }
+        return true;
+    }
+
+    /** @return true while a scan is in progress */
+    bool IsBusy() const { return busy_; }
+
+    /** Copies the inputs of the latest complete scan.
+     *  Bit n of word w is input (32 * w + n), set bits are HIGH inputs.
+     */
+    void GetInputs(uint32_t (&words)[kNumInputWords]) const
+    {
+        uint32_t frames;
+        do
+        {
+            // retry if scans completed while copying
+            frames = frames_;
+            for(size_t w = 0; w < kNumInputWords; w++)
+                words[w] = inputs_[front_][w];
+        } while(frames != frames_);
+    }
+
+    /** @return one word of inputs of the latest complete scan */
+    uint32_t GetInputWord(size_t word = 0) const
+    {
+        return inputs_[front_][word];
+    }
+
+    /** @return the state of one input in the latest complete scan */
+    bool GetInput(size_t idx) const
+    {
+        return (GetInputWord(idx / 32) >> (idx % 32)) & 1;
+    }
+
+    /** Sets an output on the staging copy, see CommitOutputs()
+     *  @param idx   0 is QA of the first device, 8 is QA of the second...
+     *  @param state true sets the output HIGH
+     */
+    void SetOutput(size_t idx, bool state)
+    {
+        const uint8_t bit = 1 << (idx % 8);
+        outputs_[idx / 8] = state ? outputs_[idx / 8] | bit
+                                  : outputs_[idx / 8] & ~bit;
+    }
+
+    /** Sets all eight outputs of one device on the staging copy */
+    void SetOutputByte(size_t device, uint8_t value)
+    {
+        outputs_[device] = value;
+    }
+
+    /** Sends the staged outputs with the next scan that starts after this
+     *  returns. Scans starting while this encodes keep sending the
+     *  previously committed outputs.
+     */
+    void CommitOutputs()
+    {
+        if(buffer_ == nullptr)
+            return;
+        uint8_t free;
+        {
+            ScopedIrqBlocker block;
+            // withdraw the pending frame, it may be the one to overwrite
+            tx_next_ = tx_sending_;
+            free     = 1 - tx_sending_;
+        }
+        EncodeOutputs(outputs_, buffer_->tx[free]);
+        tx_next_ = free;
+    }
+
+    /** @return the number of complete scans */
+    uint32_t GetScanCount() const { return frames_; }
+
+    /** @return the number of scans that were triggered while busy */
+    uint32_t GetOverruns() const { return overruns_; }
+
+    /** @return the number of failed transfers */
+    uint32_t GetErrors() const { return errors_; }
+
+    /** Decodes a received frame to input words */
+    static void DecodeInputs(const uint8_t* rx, uint32_t* words)
+    {
+        for(size_t w = 0; w < kNumInputWords; w++)
+            words[w] = 0;
+        // the first byte is shifted out of the last device in the chain
+        for(size_t d = 0; d < num_4021; d++)
+            words[d / 4] |= uint32_t(rx[num_4021 - 1 - d]) << (8 * (d % 4));
+    }
+
+    /** Encodes the output bytes of all devices to a frame to send */
+    static void EncodeOutputs(const uint8_t* outputs, uint8_t* tx)
+    {
+        // the 595s keep the last bytes of the frame, and the first device
+        // receives the last byte
+        for(size_t i = 0; i < kFrameSize; i++)
+            tx[i] = 0;
+        for(size_t d = 0; d < num_595; d++)
+            tx[kFrameSize - 1 - d] = outputs[d];
+    }
+
+  private:
+    static void TimerCallback(void* context)
+    {
+        static_cast<ShiftRegisterScanner*>(context)->TriggerScan();
+    }
+
+    static void TransferCallback(void* context, bool success)
+    {
+        auto self = static_cast<ShiftRegisterScanner*>(context);
+        if(success)
+        {
+            const uint8_t back = self->back_;
+            DecodeInputs(self->buffer_->rx[back], self->inputs_[back]);
+            self->back_  = self->front_;
+            self->front_ = back;
+            self->frames_++;
+        }
+        else
+        {
+            self->errors_++;
+        }
+        self->busy_ = false;
+        if(self->running_ && self->config_.scan_rate <= 0.f)
+            self->TriggerScan();
+    }
+
+    Config            config_;
+    Transport         transport_;
+    DmaBuffer*        buffer_;
+    uint32_t          inputs_[2][kNumInputWords];
+    uint8_t           outputs_[num_595 > 0 ? num_595 : 1];
+    volatile bool     running_;
+    volatile bool     busy_;
+    volatile uint8_t  front_;
+    uint8_t           back_;
+    volatile uint8_t  tx_sending_;
+    volatile uint8_t  tx_next_;
+    volatile uint32_t frames_;
+    uint32_t          overruns_;
+    uint32_t          errors_;
+};
+
+template <typename Transport, size_t num_4021, size_t num_595>
+constexpr size_t ShiftRegisterScanner<Transport, num_4021, num_595>::kNumInputs;
+template <typename Transport, size_t num_4021, size_t num_595>
+constexpr size_t
+    ShiftRegisterScanner<Transport, num_4021, num_595>::kNumOutputs;
+template <typename Transport, size_t num_4021, size_t num_595>
+constexpr size_t
+    ShiftRegisterScanner<Transport, num_4021, num_595>::kNumInputWords;
+template <typename Transport, size_t num_4021, size_t num_595>
+constexpr size_t ShiftRegisterScanner<Transport, num_4021, num_595>::kFrameSize;
+
+} // namespace daisy
+
+#endif
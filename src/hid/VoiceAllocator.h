@@ -0,0 +1,751 @@
+#pragma once
+#ifndef DSY_VOICE_ALLOCATOR_H
+#define DSY_VOICE_ALLOCATOR_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "hid/midi_parser.h"
+
+namespace daisy
+{
+/** @brief Tracks the notes of a MIDI stream and assigns them to voices
+ *  @ingroup midi
+ *
+ *  Feed it the events from MidiHandler::PopEvent() and read the voices
+ *  in the audio callback:
+ *  @code
+ *  while(midi.HasEvents())
+ *      voices.ProcessEvent(midi.PopEvent());
+ *  ...
+ *  for(size_t i = 0; i < voices.GetNumVoices(); i++)
+ *  {
+ *      const auto& voice = voices.GetVoice(i);
+ *      if(voice.trigger != synth[i].last_trigger) // (re)started
+ *          synth[i].Start(voice.note, voice.velocity);
+ *      synth[i].SetGate(voices.IsGateOn(i));
+ *  }
+ *  @endcode
+ *
+ *  - Note on and note off take constant time. Voices are kept in lists
+ *    per state, in the order they were started, and a table maps each
+ *    note of each channel to its voice, so nothing is searched.
+ *  - A new note takes a voice in this order: the voice that plays the
+ *    same note (optional), an idle voice, the oldest released voice, the
+ *    oldest voice that only sounds because of a pedal, and finally a held
+ *    voice picked by the Stealing mode.
+ *  - The sustain pedal (CC 64) holds all released notes, the sostenuto
+ *    pedal (CC 66) the notes that were held when it was pressed.
+ *  - MPE zones: notes on member channels get their own pitch bend,
+ *    pressure and timbre (CC 74), and the master channel's bend and
+ *    pedals apply to the whole zone. Zones are set with Config or the
+ *    MPE configuration message (RPN 6).
+ *  - Held keys are tracked per channel in bitsets, also for notes that
+ *    have no voice (e.g. for mono or arpeggiator modes).
+ *
+ *  Released voices keep sounding until they're reused, or FreeVoice() is
+ *  called when their envelope has finished.
+ *
+ *  @tparam num_voices Number of voices, up to 254
+ */
+template <size_t num_voices>
+class VoiceAllocator
+{
+  public:
+    static_assert(num_voices > 0 && num_voices < 255,
+                  "between 1 and 254 voices");
+
+    /** Which held voice a new note takes when no other voice is left */
+    enum class Stealing
+    {
+        OLDEST,   /**< The voice that was started first */
+        NEWEST,   /**< The voice that was started last */
+        QUIETEST, /**< The voice with the lowest velocity, oldest first */
+        NONE,     /**< Held voices are kept, the new note is dropped */
+    };
+
+    enum class VoiceState
+    {
+        IDLE,      /**< Silent */
+        HELD,      /**< The key is down */
+        SUSTAINED, /**< The key is up, but a pedal holds the note */
+        RELEASED,  /**< The note is over, but may still sound */
+    };
+
+    struct Voice
+    {
+        VoiceState state;
+        uint8_t    channel;  /**< MIDI channel, 0 to 15 */
+        uint8_t    note;     /**< MIDI note number */
+        uint8_t    velocity; /**< Note on velocity */
+        /** Note off velocity, once the key was released */
+        uint8_t release_velocity;
+        /** Pressure of the note, from polyphonic key pressure, or from
+         *  channel pressure on MPE member channels */
+        uint8_t pressure;
+        /** CC 74 of MPE member channels, 64 otherwise */
+        uint8_t timbre;
+        /** Pitch bend of MPE member channels, -8192 to 8191 */
+        int16_t bend;
+        /** Counts the note ons of this voice, changes with each restart */
+        uint32_t trigger;
+    };
+
+    struct Config
+    {
+        Stealing stealing = Stealing::OLDEST;
+        /** A note that's played again takes the voice that plays it */
+        bool retrigger_same_note = true;
+        /** Member channels of the MPE lower zone (master channel 1), 0 to
+         *  15, 0 for no zone */
+        uint8_t mpe_lower_members = 0;
+        /** Member channels of the MPE upper zone (master channel 16) */
+        uint8_t mpe_upper_members = 0;
+    };
+
+    static constexpr int kNoVoice = -1;
+
+    VoiceAllocator() {}
+    ~VoiceAllocator() {}
+
+    void Init(const Config& config)
+    {
+        config_ = config;
+        SetMpeZones(config.mpe_lower_members, config.mpe_upper_members);
+        Reset();
+    }
+
+    /** Silences all voices and resets the pedals and controllers */
+    void Reset()
+    {
+        for(size_t i = 0; i < kNumLists; i++)
+        {
+            lists_[i].head = lists_[i].tail = kNone;
+            list_size_[i]                   = 0;
+        }
+        for(size_t i = 0; i < kNumNotes; i++)
+            velocity_lists_[i].head = velocity_lists_[i].tail = kNone;
+        for(size_t w = 0; w < 4; w++)
+            velocity_mask_[w] = 0;
+        for(size_t v = 0; v < num_voices; v++)
+        {
+            Voice& voice           = voices_[v];
+            voice.state            = VoiceState::IDLE;
+            voice.channel          = 0;
+            voice.note             = 0;
+            voice.velocity         = 0;
+            voice.release_velocity = 0;
+            voice.pressure         = 0;
+            voice.timbre           = 64;
+            voice.bend             = 0;
+            voice.trigger          = 0;
+            latched_[v]            = false;
+            Link(v, VoiceState::IDLE);
+        }
+        for(size_t c = 0; c < kNumChannels; c++)
+        {
+            for(size_t n = 0; n < kNumNotes; n++)
+                voice_of_note_[c][n] = kNone;
+            for(size_t w = 0; w < 4; w++)
+                held_[c][w] = 0;
+            channel_voice_[c] = kNone;
+            ResetControllers(c);
+        }
+        num_steals_ = 0;
+    }
+
+    /** Handles note, pedal, expression and channel mode events
+     *  @return the voice a note event started or released, or kNoVoice
+     */
+    int ProcessEvent(const MidiEvent& event)
+    {
+        const int ch = event.channel;
+        switch(event.type)
+        {
+            case MidiMessageType::NoteOn:
+                return NoteOn(ch, event.data[0], event.data[1]);
+            case MidiMessageType::NoteOff:
+                return NoteOff(ch, event.data[0], event.data[1]);
+            case PolyphonicKeyPressure:
+            {
+                const uint8_t v = voice_of_note_[ch][event.data[0] & 0x7f];
+                if(v != kNone)
+                    voices_[v].pressure = event.data[1];
+                break;
+            }
+            case MidiMessageType::ControlChange:
+                ControlChange(ch, event.data[0], event.data[1]);
+                break;
+            case ChannelPressure:
+                pressure_[ch] = event.data[0];
+                if(IsMpeMemberChannel(ch) && channel_voice_[ch] != kNone)
+                    voices_[channel_voice_[ch]].pressure = event.data[0];
+                break;
+            case PitchBend:
+                bend_[ch] = int16_t(((event.data[1] << 7) | event.data[0])
+                                    - 8192);
+                if(IsMpeMemberChannel(ch) && channel_voice_[ch] != kNone)
+                    voices_[channel_voice_[ch]].bend = bend_[ch];
+                break;
+            case ChannelMode:
+                switch(event.cm_type)
+                {
+                    case ChannelModeType::AllSoundOff: AllSoundOff(ch); break;
+                    case ChannelModeType::ResetAllControllers:
+                        SetSustain(ch, false);
+                        SetSostenuto(ch, false);
+                        ResetControllers(ch);
+                        break;
+                    case LocalControl: break;
+                    // the mode messages end all notes as well
+                    default: AllNotesOff(ch); break;
+                }
+                break;
+            default: break;
+        }
+        return kNoVoice;
+    }
+
+    /** Starts a note, a velocity of 0 releases it
+     *  @return the voice, or kNoVoice if none was free
+     */
+    int NoteOn(int channel, uint8_t note, uint8_t velocity)
+    {
+        if(velocity == 0)
+            return NoteOff(channel, note, 64);
+        note &= 0x7f;
+        SetHeld(channel, note, true);
+
+        uint8_t v = voice_of_note_[channel][note];
+        if(v != kNone && !config_.retrigger_same_note)
+        {
+            // let the old voice ring out, but forget its note
+            if(voices_[v].state != VoiceState::RELEASED)
+                Release(v);
+            voice_of_note_[channel][note] = kNone;
+            v                             = kNone;
+        }
+        if(v == kNone)
+            v = Allocate();
+        if(v == kNone)
+            return kNoVoice;
+
+        Unlink(v);
+        Voice& voice   = voices_[v];
+        voice.channel  = uint8_t(channel);
+        voice.note     = note;
+        voice.velocity = velocity;
+        voice.trigger++;
+        const bool member      = IsMpeMemberChannel(channel);
+        voice.release_velocity = 0;
+        voice.pressure         = member ? pressure_[channel] : 0;
+        voice.timbre           = member ? timbre_[channel] : 64;
+        voice.bend             = member ? bend_[channel] : 0;
+        latched_[v]            = false;
+        voice_of_note_[channel][note] = v;
+        channel_voice_[channel]       = v;
+        Link(v, VoiceState::HELD);
+        return v;
+    }
+
+    /** Releases a note, or lets a pedal hold it
+     *  @return the voice of the note, or kNoVoice
+     */
+    int NoteOff(int channel, uint8_t note, uint8_t velocity = 64)
+    {
+        note &= 0x7f;
+        SetHeld(channel, note, false);
+        const uint8_t v = voice_of_note_[channel][note];
+        if(v == kNone || voices_[v].state != VoiceState::HELD)
+            return kNoVoice;
+        voices_[v].release_velocity = velocity;
+        if(IsHeldByPedal(v))
+        {
+            Unlink(v);
+            Link(v, VoiceState::SUSTAINED);
+        }
+        else
+        {
+            Release(v);
+        }
+        return v;
+    }
+
+    /** Handles the controllers the allocator uses, and ignores others */
+    void ControlChange(int channel, uint8_t control, uint8_t value)
+    {
+        switch(control)
+        {
+            case 64: SetSustain(channel, value >= 64); break;
+            case 66: SetSostenuto(channel, value >= 64); break;
+            case 74:
+                timbre_[channel] = value;
+                if(IsMpeMemberChannel(channel)
+                   && channel_voice_[channel] != kNone)
+                    voices_[channel_voice_[channel]].timbre = value;
+                break;
+            case 100: rpn_[channel] = (rpn_[channel] & 0x3f80) | value; break;
+            case 101:
+                rpn_[channel] = (rpn_[channel] & 0x7f) | (value << 7);
+                break;
+            case 6:
+                // MPE configuration message on a master channel
+                if(rpn_[channel] == 6 && channel == 0)
+                    SetMpeZones(value, upper_members_);
+                else if(rpn_[channel] == 6 && channel == 15)
+                {
+                    // the new upper zone shrinks the lower one
+                    uint8_t lower = lower_members_;
+                    if(value >= 14)
+                        lower = 0;
+                    else if(value > 0 && lower + value > 14)
+                        lower = uint8_t(14 - value);
+                    SetMpeZones(lower, value);
+                }
+                break;
+            default: break;
+        }
+    }
+
+    /** Presses or releases the sustain pedal. On an MPE member channel,
+     *  this acts on the master channel of its zone. */
+    void SetSustain(int channel, bool on)
+    {
+        channel = GetPedalChannel(channel);
+        if(sustain_[channel] == on)
+            return;
+        sustain_[channel] = on;
+        if(!on)
+            ReleaseSustained(uint8_t(channel));
+    }
+
+    /** Presses or releases the sostenuto pedal, which holds the notes
+     *  that are held at the moment it's pressed */
+    void SetSostenuto(int channel, bool on)
+    {
+        channel = GetPedalChannel(channel);
+        if(sostenuto_[channel] == on)
+            return;
+        sostenuto_[channel] = on;
+        for(uint8_t v = lists_[ListOf(VoiceState::HELD)].head; v != kNone;
+            v         = next_[v])
+            if(GetPedalChannel(voices_[v].channel) == channel)
+                latched_[v] = on;
+        if(!on)
+        {
+            for(uint8_t v = lists_[ListOf(VoiceState::SUSTAINED)].head;
+                v != kNone;
+                v = next_[v])
+                if(GetPedalChannel(voices_[v].channel) == channel)
+                    latched_[v] = false;
+            ReleaseSustained(uint8_t(channel));
+        }
+    }
+
+    /** Releases all notes of a channel (or of a zone, on its master
+     *  channel). Pedals still hold them. */
+    void AllNotesOff(int channel)
+    {
+        for(uint8_t v = lists_[ListOf(VoiceState::HELD)].head; v != kNone;)
+        {
+            const uint8_t next = next_[v];
+            if(IsInScope(voices_[v].channel, channel))
+                NoteOff(voices_[v].channel, voices_[v].note);
+            v = next;
+        }
+        ClearHeld(channel);
+    }
+
+    /** Silences all voices of a channel (or zone) immediately */
+    void AllSoundOff(int channel)
+    {
+        for(size_t v = 0; v < num_voices; v++)
+            if(voices_[v].state != VoiceState::IDLE
+               && IsInScope(voices_[v].channel, channel))
+                FreeVoice(v);
+        ClearHeld(channel);
+    }
+
+    /** Marks a released voice as silent, e.g. when its envelope ended,
+     *  so it's reused before voices that still sound */
+    void FreeVoice(size_t voice)
+    {
+        const uint8_t v     = uint8_t(voice);
+        Voice&        state = voices_[v];
+        if(state.state == VoiceState::IDLE)
+            return;
+        if(voice_of_note_[state.channel][state.note] == v)
+            voice_of_note_[state.channel][state.note] = kNone;
+        if(channel_voice_[state.channel] == v)
+            channel_voice_[state.channel] = kNone;
+        Unlink(v);
+        Link(v, VoiceState::IDLE);
+    }
+
+    /** Sets the number of member channels of the MPE zones. The upper
+     *  zone shrinks if both don't fit. */
+    void SetMpeZones(uint8_t lower_members, uint8_t upper_members)
+    {
+        lower_members_ = lower_members > 15 ? 15 : lower_members;
+        upper_members_ = upper_members > 15 ? 15 : upper_members;
+        if(lower_members_ > 0 && lower_members_ + upper_members_ > 14)
+            upper_members_ = lower_members_ >= 14 ? 0 : 14 - lower_members_;
+    }
+
+    /** Returns true if the channel is a member channel of an MPE zone */
+    bool IsMpeMemberChannel(int channel) const
+    {
+        return (channel >= 1 && channel <= lower_members_)
+               || (channel <= 14 && channel >= 15 - upper_members_);
+    }
+
+    /** Returns the channel whose pedals and bend apply to a channel: the
+     *  master channel of an MPE zone, or the channel itself */
+    int GetPedalChannel(int channel) const
+    {
+        if(channel >= 1 && channel <= lower_members_)
+            return 0;
+        if(channel <= 14 && channel >= 15 - upper_members_)
+            return 15;
+        return channel;
+    }
+
+    size_t GetNumVoices() const { return num_voices; }
+
+    const Voice& GetVoice(size_t voice) const { return voices_[voice]; }
+
+    /** Returns true if the voice is held by its key or a pedal */
+    bool IsGateOn(size_t voice) const
+    {
+        return voices_[voice].state == VoiceState::HELD
+               || voices_[voice].state == VoiceState::SUSTAINED;
+    }
+
+    /** Returns the pitch bend of a voice, -8192 to 8191 for a whole bend
+     *  range. Member voices of an MPE zone add the bend of the master
+     *  channel to their own. */
+    int GetVoiceBend(size_t voice) const
+    {
+        const Voice& v = voices_[voice];
+        if(IsMpeMemberChannel(v.channel))
+            return v.bend + bend_[GetPedalChannel(v.channel)];
+        return bend_[v.channel];
+    }
+
+    /** Returns the pressure of a voice: its own, or the channel pressure,
+     *  whichever is higher */
+    uint8_t GetVoicePressure(size_t voice) const
+    {
+        const Voice& v = voices_[voice];
+        if(IsMpeMemberChannel(v.channel))
+            return v.pressure;
+        return v.pressure > pressure_[v.channel] ? v.pressure
+                                                 : pressure_[v.channel];
+    }
+
+    /** Returns the timbre (CC 74) of a voice */
+    uint8_t GetVoiceTimbre(size_t voice) const
+    {
+        const Voice& v = voices_[voice];
+        return IsMpeMemberChannel(v.channel) ? v.timbre : timbre_[v.channel];
+    }
+
+    /** Returns the voice that plays a note, or kNoVoice */
+    int GetVoiceForNote(int channel, uint8_t note) const
+    {
+        const uint8_t v = voice_of_note_[channel][note & 0x7f];
+        return v == kNone ? kNoVoice : v;
+    }
+
+    /** Returns the number of voices that aren't idle */
+    size_t GetNumActiveVoices() const
+    {
+        return num_voices - list_size_[ListOf(VoiceState::IDLE)];
+    }
+
+    /** Returns the number of voices that were taken from notes that were
+     *  still held by a key or pedal */
+    uint32_t GetNumSteals() const { return num_steals_; }
+
+    /** Returns true if the key of a note is down */
+    bool IsNoteHeld(int channel, uint8_t note) const
+    {
+        note &= 0x7f;
+        return held_[channel][note >> 5] & (1u << (note & 31));
+    }
+
+    /** Returns the number of keys that are down on a channel */
+    size_t GetNumHeldNotes(int channel) const
+    {
+        size_t num = 0;
+        for(size_t w = 0; w < 4; w++)
+            num += __builtin_popcount(held_[channel][w]);
+        return num;
+    }
+
+    /** Returns the lowest note whose key is down, or -1 */
+    int GetLowestHeldNote(int channel) const
+    {
+        for(int w = 0; w < 4; w++)
+            if(held_[channel][w] != 0)
+                return w * 32 + __builtin_ctz(held_[channel][w]);
+        return -1;
+    }
+
+    /** Returns the highest note whose key is down, or -1 */
+    int GetHighestHeldNote(int channel) const
+    {
+        for(int w = 3; w >= 0; w--)
+            if(held_[channel][w] != 0)
+                return w * 32 + 31 - __builtin_clz(held_[channel][w]);
+        return -1;
+    }
+
+    bool IsSustainOn(int channel) const
+    {
+        return sustain_[GetPedalChannel(channel)];
+    }
+
+    bool IsSostenutoOn(int channel) const
+    {
+        return sostenuto_[GetPedalChannel(channel)];
+    }
+
+#ifdef UNIT_TEST
+    /** Returns the number of list links, unlinks and velocity words
+     *  searched so far, to test that events take constant time */
+    uint32_t GetNumListOpsForUnitTest() const { return num_list_ops_; }
+#endif
+
+  private:
+    static constexpr uint8_t kNone        = 0xff;
+    static constexpr size_t  kNumChannels = 16;
+    static constexpr size_t  kNumNotes    = 128;
+    static constexpr size_t  kNumLists    = 4;
+
+    struct List
+    {
+        uint8_t head;
+        uint8_t tail;
+    };
+
+    static size_t ListOf(VoiceState state) { return size_t(state); }
+
+    /** Appends a voice to the list of a state, in the order of starts */
+    void Link(uint8_t v, VoiceState state)
+    {
+        CountListOp();
+        voices_[v].state = state;
+        List& list       = lists_[ListOf(state)];
+        prev_[v]         = list.tail;
+        next_[v]         = kNone;
+        if(list.tail != kNone)
+            next_[list.tail] = v;
+        else
+            list.head = v;
+        list.tail = v;
+        list_size_[ListOf(state)]++;
+
+        // held voices are also sorted by velocity for QUIETEST
+        if(state == VoiceState::HELD)
+        {
+            const uint8_t vel = voices_[v].velocity;
+            List&         bin = velocity_lists_[vel];
+            velocity_prev_[v] = bin.tail;
+            velocity_next_[v] = kNone;
+            if(bin.tail != kNone)
+                velocity_next_[bin.tail] = v;
+            else
+                bin.head = v;
+            bin.tail = v;
+            velocity_mask_[vel >> 5] |= 1u << (vel & 31);
+        }
+    }
+
+    /** Removes a voice from the list of its state */
+    void Unlink(uint8_t v)
+    {
+        CountListOp();
+        const VoiceState state = voices_[v].state;
+        List&            list  = lists_[ListOf(state)];
+        if(prev_[v] != kNone)
+            next_[prev_[v]] = next_[v];
+        else
+            list.head = next_[v];
+        if(next_[v] != kNone)
+            prev_[next_[v]] = prev_[v];
+        else
+            list.tail = prev_[v];
+        list_size_[ListOf(state)]--;
+
+        if(state == VoiceState::HELD)
+        {
+            const uint8_t vel = voices_[v].velocity;
+            List&         bin = velocity_lists_[vel];
+            if(velocity_prev_[v] != kNone)
+                velocity_next_[velocity_prev_[v]] = velocity_next_[v];
+            else
+                bin.head = velocity_next_[v];
+            if(velocity_next_[v] != kNone)
+                velocity_prev_[velocity_next_[v]] = velocity_prev_[v];
+            else
+                bin.tail = velocity_prev_[v];
+            if(bin.head == kNone)
+                velocity_mask_[vel >> 5] &= ~(1u << (vel & 31));
+        }
+    }
+
+    /** Ends the note of a voice, it keeps sounding as released */
+    void Release(uint8_t v)
+    {
+        Unlink(v);
+        latched_[v] = false;
+        Link(v, VoiceState::RELEASED);
+    }
+
+    /** Picks a voice for a new note and detaches it from its old note */
+    uint8_t Allocate()
+    {
+        uint8_t v = lists_[ListOf(VoiceState::IDLE)].head;
+        if(v == kNone)
+            v = lists_[ListOf(VoiceState::RELEASED)].head;
+        if(v == kNone && config_.stealing != Stealing::NONE)
+        {
+            v = lists_[ListOf(VoiceState::SUSTAINED)].head;
+            if(v == kNone)
+                v = PickHeldVoice();
+            if(v != kNone)
+                num_steals_++;
+        }
+        if(v == kNone)
+            return kNone;
+
+        Voice& voice = voices_[v];
+        if(voice.state != VoiceState::IDLE)
+        {
+            if(voice_of_note_[voice.channel][voice.note] == v)
+                voice_of_note_[voice.channel][voice.note] = kNone;
+            if(channel_voice_[voice.channel] == v)
+                channel_voice_[voice.channel] = kNone;
+        }
+        return v;
+    }
+
+    uint8_t PickHeldVoice() const
+    {
+        const List& held = lists_[ListOf(VoiceState::HELD)];
+        switch(config_.stealing)
+        {
+            case Stealing::NEWEST: return held.tail;
+            case Stealing::QUIETEST:
+                for(size_t w = 0; w < 4; w++)
+                {
+                    CountListOp();
+                    if(velocity_mask_[w] != 0)
+                        return velocity_lists_[w * 32
+                                               + __builtin_ctz(
+                                                   velocity_mask_[w])]
+                            .head;
+                }
+                return kNone;
+            default: return held.head;
+        }
+    }
+
+    bool IsHeldByPedal(uint8_t v) const
+    {
+        const int pedal = GetPedalChannel(voices_[v].channel);
+        return sustain_[pedal] || (latched_[v] && sostenuto_[pedal]);
+    }
+
+    /** Releases the sustained voices a pedal of a channel no longer holds */
+    void ReleaseSustained(uint8_t channel)
+    {
+        for(uint8_t v = lists_[ListOf(VoiceState::SUSTAINED)].head;
+            v != kNone;)
+        {
+            const uint8_t next = next_[v];
+            if(GetPedalChannel(voices_[v].channel) == channel
+               && !IsHeldByPedal(v))
+                Release(v);
+            v = next;
+        }
+    }
+
+    /** Returns true if a channel message on `channel` applies to notes
+     *  on `note_channel`, directly or through its MPE zone */
+    bool IsInScope(int note_channel, int channel) const
+    {
+        return note_channel == channel
+               || (GetPedalChannel(note_channel) == channel
+                   && IsMpeMemberChannel(note_channel));
+    }
+
+    void SetHeld(int channel, uint8_t note, bool held)
+    {
+        if(held)
+            held_[channel][note >> 5] |= 1u << (note & 31);
+        else
+            held_[channel][note >> 5] &= ~(1u << (note & 31));
+    }
+
+    void ClearHeld(int channel)
+    {
+        for(size_t c = 0; c < kNumChannels; c++)
+            if(IsInScope(int(c), channel))
+                for(size_t w = 0; w < 4; w++)
+                    held_[c][w] = 0;
+    }
+
+#ifdef UNIT_TEST
+    void CountListOp() const { num_list_ops_++; }
+#else
+    void CountListOp() const {}
+#endif
+
+    void ResetControllers(size_t channel)
+    {
+        sustain_[channel]   = false;
+        sostenuto_[channel] = false;
+        bend_[channel]      = 0;
+        pressure_[channel]  = 0;
+        timbre_[channel]    = 64;
+        rpn_[channel]       = 0x3fff;
+    }
+
+    Config   config_;
+    Voice    voices_[num_voices];
+    uint8_t  next_[num_voices];
+    uint8_t  prev_[num_voices];
+    uint8_t  velocity_next_[num_voices];
+    uint8_t  velocity_prev_[num_voices];
+    bool     latched_[num_voices];
+    List     lists_[kNumLists];
+    uint8_t  list_size_[kNumLists];
+    List     velocity_lists_[kNumNotes];
+    uint32_t velocity_mask_[4];
+    uint8_t  voice_of_note_[kNumChannels][kNumNotes];
+    uint8_t  channel_voice_[kNumChannels];
+    uint32_t held_[kNumChannels][4];
+    bool     sustain_[kNumChannels];
+    bool     sostenuto_[kNumChannels];
+    int16_t  bend_[kNumChannels];
+    uint8_t  pressure_[kNumChannels];
+    uint8_t  timbre_[kNumChannels];
+    uint16_t rpn_[kNumChannels];
+    uint8_t  lower_members_ = 0;
+    uint8_t  upper_members_ = 0;
+    uint32_t num_steals_    = 0;
+#ifdef UNIT_TEST
+    mutable uint32_t num_list_ops_ = 0;
+#endif
+};
+
+template <size_t num_voices>
+constexpr int VoiceAllocator<num_voices>::kNoVoice;
+
+template <size_t num_voices>
+constexpr uint8_t VoiceAllocator<num_voices>::kNone;
+
+} // namespace daisy
+
+#endif
@@ -87,6 +87,9 @@ class AudioHandle::Impl
 
     void *callback_, *interleaved_callback_;
 
+    AudioHandle::StreamTap tap_before_, tap_after_;
+    void*                  tap_context_;
+
     // Data
     AudioHandle::Config config_;
     SaiHandle           sai1_, sai2_;
@@ -281,6 +284,26 @@ void AudioHandle::Impl::InternalCallback(int32_t* in, int32_t* out, size_t size)
     chns = audio_handle.GetChannels();
     if(chns == 0)
         return;
+
+    // the taps see the DMA buffers themselves, before and after conversion
+    const AudioHandle::StreamTap tap_before = audio_handle.tap_before_;
+    const AudioHandle::StreamTap tap_after  = audio_handle.tap_after_;
+    AudioHandle::RawBlock        raw        = {};
+    if(tap_before || tap_after)
+    {
+        const size_t offset = audio_handle.sai2_.GetOffset();
+        raw.in[0]           = in;
+        raw.out[0]          = out;
+        raw.in[1]  = chns > 2 ? audio_handle.buff_rx_[1] + offset : nullptr;
+        raw.out[1] = chns > 2 ? audio_handle.buff_tx_[1] + offset : nullptr;
+        raw.num_channels
+            = audio_handle.interleaved_callback_ ? 2 : (chns > 2 ? 4 : 2);
+        raw.size      = size / 2;
+        raw.bit_depth = bd;
+    }
+    if(tap_before)
+        tap_before(raw, audio_handle.tap_context_);
+
     // Handle Interleaved / Non Interleaved separate
     if(audio_handle.interleaved_callback_)
     {
@@ -479,6 +502,8 @@ void AudioHandle::Impl::InternalCallback(int32_t* in, int32_t* out, size_t size)
             default: break;
         }
     }
+    if(tap_after)
+        tap_after(raw, audio_handle.tap_context_);
 }
 
 // ================================================================
@@ -557,6 +582,18 @@ AudioHandle::ChangeCallback(InterleavingAudioCallback callback)
     return pimpl_->ChangeCallback(callback);
 }
 
+AudioHandle::Result
+AudioHandle::SetStreamTaps(StreamTap before, StreamTap after, void* context)
+{
+    // the context has to be in place before the taps can run
+    pimpl_->tap_before_  = nullptr;
+    pimpl_->tap_after_   = nullptr;
+    pimpl_->tap_context_ = context;
+    pimpl_->tap_before_  = before;
+    pimpl_->tap_after_   = after;
+    return Result::OK;
+}
+
 AudioHandle::Result AudioHandle::SetPostGain(float val)
 {
     return pimpl_->SetPostGain(val);
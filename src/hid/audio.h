@@ -84,6 +84,22 @@ class AudioHandle
                                               InterleavingOutputBuffer out,
                                               size_t                   size);
 
+    /** Samples of one block as the SAIs move them, see SetStreamTaps().
+     ** Each buffer holds two interleaved channels in the format of the SAI
+     ** bit depth.
+     */
+    struct RawBlock
+    {
+        int32_t* in[2];        /**< Inputs of SAI1 and SAI2 */
+        int32_t* out[2];       /**< Outputs of SAI1 and SAI2 */
+        size_t   num_channels; /**< 2, or 4 with both SAIs */
+        size_t   size;         /**< Samples per channel */
+        SaiHandle::Config::BitDepth bit_depth; /**< Format of the samples */
+    };
+
+    /** Type for a stream tap, see SetStreamTaps() */
+    typedef void (*StreamTap)(const RawBlock& block, void* context);
+
     AudioHandle() : pimpl_(nullptr) {}
     ~AudioHandle() {}
 
@@ -153,6 +169,17 @@ class AudioHandle
     /** Immediatley changes the audio callback to the interleaving callback passed in. */
     Result ChangeCallback(InterleavingAudioCallback callback);
 
+    /** Sets functions that see every block in the format of the SAIs,
+     ** e.g. to stream the audio over USB without converting it twice.
+     **
+     ** \param before Called ahead of the conversion to floats, may change
+     **               the inputs the callback gets. May be nullptr.
+     ** \param after  Called once the outputs are converted back, may change
+     **               what goes to the codecs. May be nullptr.
+     ** \param context Passed to both
+     */
+    Result SetStreamTaps(StreamTap before, StreamTap after, void* context);
+
 
     class Impl;
 
@@ -20,6 +20,9 @@ void AnalogControl::Init(uint16_t *adcptr,
     invert_       = invert;
     is_bipolar_   = false;
     slew_seconds_ = slew_seconds;
+    UpdateGainAndBias();
+    interpolation_ = Interpolation::LINEAR;
+    smooth_        = 0.0f;
 }
 
 void AnalogControl::InitBipolarCv(uint16_t *adcptr, float sr)
@@ -33,19 +36,97 @@ void AnalogControl::InitBipolarCv(uint16_t *adcptr, float sr)
     flip_       = false;
     invert_     = true;
     is_bipolar_ = true;
+    UpdateGainAndBias();
+    interpolation_ = Interpolation::LINEAR;
+    smooth_        = 0.0f;
 }
 
 float AnalogControl::Process()
 {
-    float t;
-    t = (float)*raw_ / 65536.0f;
-    if(flip_)
-        t = 1.f - t;
-    t = (t - offset_) * scale_ * (invert_ ? -1.0f : 1.0f);
+    // equivalent to: t = raw / 65536, flipped if required, then
+    // t = (t - offset) * scale, inverted if required.
+    const float t = (float)*raw_ * gain_ + bias_;
     val_ += coeff_ * (t - val_);
     return val_;
 }
 
+void AnalogControl::ProcessBlock(float *out, size_t size)
+{
+    ProcessBlock(out, size, nullptr, 0);
+}
+
+void AnalogControl::ProcessBlock(float          *out,
+                                 size_t          size,
+                                 const uint16_t *raw,
+                                 size_t          num_raw)
+{
+    if(size == 0)
+        return;
+    if(raw == nullptr || num_raw == 0)
+    {
+        raw     = raw_;
+        num_raw = 1;
+    }
+    num_raw = num_raw > size ? size : num_raw;
+
+    if(interpolation_ == Interpolation::LINEAR)
+    {
+        // run the one-pole at the rate of the ADC readings and draw straight
+        // lines between the results, spread evenly across the block
+        const float coeff
+            = num_raw == 1 ? coeff_
+                           : 1.0f - powf(1.0f - coeff_, 1.0f / num_raw);
+        size_t start = 0;
+        for(size_t k = 0; k < num_raw; k++)
+        {
+            const float  prev = val_;
+            const float  t    = (float)raw[k] * gain_ + bias_;
+            const size_t end  = (k + 1) * size / num_raw;
+            val_ += coeff * (t - val_);
+            const float step = (val_ - prev) / (float)(end - start);
+            float       v    = prev;
+            for(size_t i = start; i < end; i++)
+            {
+                v += step;
+                out[i] = v;
+            }
+            out[end - 1] = val_;
+            start        = end;
+        }
+    }
+    else
+    {
+        // hold each ADC reading for its share of the block and smooth
+        // the steps with two one-pole stages running at audio rate. Each
+        // stage gets half of the slew time, but at least half the time
+        // between two ADC readings.
+        const float slew_coeff = 1.0f - powf(1.0f - coeff_, 2.0f / size);
+        const float min_coeff  = 1.0f - expf(-2.0f * num_raw / size);
+        const float coeff = slew_coeff < min_coeff ? slew_coeff : min_coeff;
+        size_t      start = 0;
+        for(size_t k = 0; k < num_raw; k++)
+        {
+            const float  t   = (float)raw[k] * gain_ + bias_;
+            const size_t end = (k + 1) * size / num_raw;
+            for(size_t i = start; i < end; i++)
+            {
+                smooth_ += coeff * (t - smooth_);
+                val_ += coeff * (smooth_ - val_);
+                out[i] = val_;
+            }
+            start = end;
+        }
+    }
+}
+
+void AnalogControl::UpdateGainAndBias()
+{
+    const float scale = scale_ * (invert_ ? -1.0f : 1.0f);
+    gain_             = (flip_ ? -scale : scale) / 65536.0f;
+    bias_             = ((flip_ ? 1.0f : 0.0f) - offset_) * scale;
+    UpdateBank();
+}
+
 void AnalogControl::SetSampleRate(float sample_rate)
 {
     samplerate_ = sample_rate;
@@ -2,10 +2,14 @@
 #ifndef DSY_KNOB_H
 #define DSY_KNOB_H /**< & */
 #include <stdint.h>
+#include <stddef.h>
 
 #ifdef __cplusplus
 namespace daisy
 {
+template <size_t numChannels>
+class AnalogControlBank;
+
 /**
     @brief Hardware Interface for control inputs \n
     Primarily designed for ADC input controls such as \n
@@ -17,6 +21,16 @@ namespace daisy
 class AnalogControl
 {
   public:
+    /** Interpolation modes used by ProcessBlock() */
+    enum class Interpolation
+    {
+        /** Straight lines between the control values */
+        LINEAR,
+        /** Two cascaded one-pole filters running at audio rate.
+         *  Smoother than LINEAR, with no corners at block boundaries. */
+        TWO_POLE,
+    };
+
     /** Constructor */
     AnalogControl() {}
     /** destructor */
@@ -52,6 +66,39 @@ class AnalogControl
     */
     float Process();
 
+    /** Filters and transforms the control like Process(), but writes one
+     *  interpolated value per audio sample to `out`, so that the control can
+     *  be used for audio rate modulation without stair-stepping at block
+     *  boundaries. Call this once per audio block instead of Process(); the
+     *  sample rate specified at Init time is the block rate.
+     *  LINEAR interpolation introduces one block of latency. TWO_POLE
+     *  smoothes over at least one ADC reading, even if the slew time is
+     *  shorter than that.
+     *  \param out         Buffer for `size` control values
+     *  \param size        The audio block size
+     */
+    void ProcessBlock(float *out, size_t size);
+
+    /** Same as ProcessBlock(float*, size_t), but uses all ADC readings that
+     *  were acquired during the block - e.g. the oversampled history of the
+     *  ADC channel - instead of only the latest one.
+     *  \param out         Buffer for `size` control values
+     *  \param size        The audio block size
+     *  \param raw         `num_raw` consecutive ADC readings, oldest first.
+     *                     Passing nullptr uses the latest reading.
+     *  \param num_raw     Number of ADC readings in `raw`, at most `size`
+     */
+    void ProcessBlock(float          *out,
+                      size_t          size,
+                      const uint16_t *raw,
+                      size_t          num_raw);
+
+    /** Sets the interpolation used by ProcessBlock(). Defaults to LINEAR. */
+    inline void SetInterpolation(Interpolation interpolation)
+    {
+        interpolation_ = interpolation;
+    }
+
     /** Returns the current stored value, without reprocessing */
     inline float Value() const { return val_; }
 
@@ -65,19 +112,28 @@ class AnalogControl
         val = val < 0.f ? 0.f : val;
 
         coeff_ = val;
+        UpdateBank();
     }
 
     /** Directly set the scaling factor used by the process function
      *  Normally this will be set during initialization, but
      *  the can be used when calibartion data is used to adjust the control.
      */
-    inline void SetScale(const float scale) { scale_ = scale; }
+    inline void SetScale(const float scale)
+    {
+        scale_ = scale;
+        UpdateGainAndBias();
+    }
 
     /** Directly set the offset used by the process function
      *  Normally this will be set during initialization, but
      *  the can be used when calibartion data is used to adjust the control.
      */
-    inline void SetOffset(const float offset) { offset_ = offset; }
+    inline void SetOffset(const float offset)
+    {
+        offset_ = offset;
+        UpdateGainAndBias();
+    }
 
     /** Returns the raw unsigned 16-bit value from the ADC */
     inline uint16_t GetRawValue() { return *raw_; }
@@ -91,13 +147,46 @@ class AnalogControl
     void SetSampleRate(float sample_rate);
 
   private:
+    template <size_t numChannels>
+    friend class AnalogControlBank;
+
+    /** Folds flip, invert, offset and scale into a single multiply-add
+     *  that's applied to the raw ADC value in Process() */
+    void UpdateGainAndBias();
+
+    /** Applies the settings to the bank channel the control is bound to,
+     *  see AnalogControlBank::Bind() */
+    void UpdateBank()
+    {
+        if(bank_.update != nullptr)
+            bank_.update(bank_.bank, bank_.idx, *this);
+    }
+
+    /** The bank channel of a bound control. Copies aren't bound. */
+    struct BankLink
+    {
+        BankLink() {}
+        BankLink(const BankLink &) {}
+        BankLink &operator=(const BankLink &) { return *this; }
+
+        void (*update)(void *bank, size_t idx, const AnalogControl &control)
+            = nullptr;
+        void  *bank = nullptr;
+        size_t idx  = 0;
+    };
+
     uint16_t *raw_;
     float     coeff_, samplerate_, val_;
     float     scale_, offset_;
+    float     gain_, bias_;
     bool      flip_;
     bool      invert_;
     bool      is_bipolar_;
     float     slew_seconds_;
+
+    Interpolation interpolation_;
+    float         smooth_;
+    BankLink      bank_;
 };
 } // namespace daisy
 #endif
@@ -0,0 +1,353 @@
+#pragma once
+#ifndef DSY_CTRL_BANK_H
+#define DSY_CTRL_BANK_H
+#include <stdint.h>
+#include <stddef.h>
+#include <math.h>
+#include <string.h>
+#include "hid/ctrl.h"
+#include "hid/parameter.h"
+
+namespace daisy
+{
+/** @brief Processes many analog controls in one batched pass
+    @ingroup controls
+
+    A structure-of-arrays alternative to an array of AnalogControl and
+    Parameter objects. Each channel is configured just like an
+    AnalogControl (raw ADC pointer, flip/invert, scale/offset, slew) and can
+    optionally map its value through a Parameter::Curve.
+
+    Process() handles all channels in a few tight loops over contiguous
+    arrays: flip, invert, offset and scale are folded into one multiply-add
+    per channel, followed by the one-pole slew filter and the curve mapping.
+    Logarithmic curves use a fast exp() approximation with a relative error
+    below 1e-5. The results are available as contiguous float arrays that can
+    be passed on directly to DSP code.
+
+    Example:
+    \code
+    AnalogControlBank<8> cvs;
+    for(size_t i = 0; i < 8; i++)
+        cvs.InitBipolarCv(i, adc.GetPtr(i), callback_rate);
+    cvs.SetCurve(0, 20.0f, 20000.0f, Parameter::LOGARITHMIC);
+
+    // in the audio callback
+    cvs.Process();
+    const float* values = cvs.GetMappedValues();
+    \endcode
+
+    @tparam numChannels The number of analog controls in the bank
+*/
+template <size_t numChannels>
+class AnalogControlBank
+{
+  public:
+    AnalogControlBank() { Reset(); }
+
+    /** Initializes a channel. The arguments are the same as for
+        AnalogControl::Init(). The curve is reset to Parameter::LINEAR
+        in the range 0..1.
+        \param idx Index of the channel to initialize
+        \param adcptr Pointer to the raw adc value, e.g. from AdcHandle::GetPtr()
+        \param sr The rate in Hz at which Process() will be called
+        \param flip If true, the input is flipped (i.e. 1.f - input)
+        \param invert If true, the input is inverted (i.e. -1.f * input)
+        \param slew_seconds Slew time of the one-pole smoothing filter
+    */
+    void Init(size_t    idx,
+              uint16_t *adcptr,
+              float     sr,
+              bool      flip         = false,
+              bool      invert       = false,
+              float     slew_seconds = 0.002f)
+    {
+        if(idx >= numChannels)
+            return;
+        raw_[idx]          = adcptr;
+        val_[idx]          = 0.0f;
+        mapped_[idx]       = 0.0f;
+        scale_[idx]        = 1.0f;
+        offset_[idx]       = 0.0f;
+        flip_[idx]         = flip;
+        invert_[idx]       = invert;
+        slew_seconds_[idx] = slew_seconds;
+        samplerate_[idx]   = sr;
+        UpdateCoeff(idx);
+        UpdateGainAndBias(idx);
+        SetCurve(idx, 0.0f, 1.0f, Parameter::LINEAR);
+    }
+
+    /** Initializes a channel with the settings and the current value of an
+        AnalogControl, e.g. one of the controls of a board. The curve is
+        reset to Parameter::LINEAR in the range 0..1.
+        \param idx Index of the channel to initialize
+        \param control The control to copy
+    */
+    void Init(size_t idx, const AnalogControl &control)
+    {
+        if(idx >= numChannels)
+            return;
+        CopySettings(idx, control);
+        mapped_[idx] = 0.0f;
+        SetCurve(idx, 0.0f, 1.0f, Parameter::LINEAR);
+    }
+
+    /** Initializes a channel like Init(size_t, const AnalogControl&) and
+        keeps it in sync with the control: settings changed later, e.g. with
+        AnalogControl::SetScale() or SetSampleRate(), apply to the channel.
+        The control stays bound for the lifetime of the bank; copies of the
+        control aren't bound.
+        \param idx Index of the channel
+        \param control The control to process in the channel
+    */
+    void Bind(size_t idx, AnalogControl &control)
+    {
+        if(idx >= numChannels)
+            return;
+        Init(idx, control);
+        control.bank_.update = &UpdateChannel;
+        control.bank_.bank   = this;
+        control.bank_.idx    = idx;
+    }
+
+    /** Initializes a channel for a -5V to 5V inverted input,
+        same as AnalogControl::InitBipolarCv()
+        \param idx Index of the channel to initialize
+        \param adcptr Pointer to the raw adc value
+        \param sr The rate in Hz at which Process() will be called
+    */
+    void InitBipolarCv(size_t idx, uint16_t *adcptr, float sr)
+    {
+        Init(idx, adcptr, sr, false, true, 0.002f);
+        scale_[idx]  = 2.0f;
+        offset_[idx] = 0.5f;
+        UpdateGainAndBias(idx);
+    }
+
+    /** Maps the value of a channel through a curve, same as Parameter::Init().
+        The mapped values are returned by GetMappedValues().
+        \param idx Index of the channel
+        \param min Output value when the control value is 0.0
+        \param max Output value when the control value is 1.0
+        \param curve The scaling curve to apply
+    */
+    void SetCurve(size_t idx, float min, float max, Parameter::Curve curve)
+    {
+        if(idx >= numChannels)
+            return;
+        // polynomial: min + range * v^n with n = 1, 2 or 3
+        const float range = max - min;
+        poly_[0][idx]     = min;
+        poly_[1][idx]     = curve == Parameter::LINEAR ? range : 0.0f;
+        poly_[2][idx]     = curve == Parameter::EXPONENTIAL ? range : 0.0f;
+        poly_[3][idx]     = curve == Parameter::CUBE ? range : 0.0f;
+
+        // logarithmic: exp(lmin + v * (lmax - lmin))
+        is_log_[idx]     = curve == Parameter::LOGARITHMIC;
+        const float lmin = logf(min < 0.0000001f ? 0.0000001f : min);
+        const float lmax = logf(max);
+        log_offset_[idx] = lmin;
+        log_scale_[idx]  = lmax - lmin;
+    }
+
+    /** Sets the one pole smoothing coefficient of a channel,
+        see AnalogControl::SetCoeff() */
+    void SetCoeff(size_t idx, float val)
+    {
+        if(idx >= numChannels)
+            return;
+        val         = val > 1.f ? 1.f : val;
+        val         = val < 0.f ? 0.f : val;
+        coeff_[idx] = val;
+    }
+
+    /** Sets the scaling factor of a channel, see AnalogControl::SetScale() */
+    void SetScale(size_t idx, const float scale)
+    {
+        if(idx >= numChannels)
+            return;
+        scale_[idx] = scale;
+        UpdateGainAndBias(idx);
+    }
+
+    /** Sets the offset of a channel, see AnalogControl::SetOffset() */
+    void SetOffset(size_t idx, const float offset)
+    {
+        if(idx >= numChannels)
+            return;
+        offset_[idx] = offset;
+        UpdateGainAndBias(idx);
+    }
+
+    /** Sets a new rate at which Process() is called for all channels */
+    void SetSampleRate(float sample_rate)
+    {
+        for(size_t i = 0; i < numChannels; i++)
+        {
+            samplerate_[i] = sample_rate;
+            UpdateCoeff(i);
+        }
+    }
+
+    /** Reads all ADC values, filters them and applies the curves.
+        This should be called at the rate specified at Init time.
+    */
+    void Process()
+    {
+        // gather the ADC values first, so that the following loops only
+        // touch contiguous arrays.
+        for(size_t i = 0; i < numChannels; i++)
+            in_[i] = (float)(*raw_[i]);
+
+        // flip, invert, offset, scale & slew
+        for(size_t i = 0; i < numChannels; i++)
+        {
+            const float t = in_[i] * gain_[i] + bias_[i];
+            val_[i] += coeff_[i] * (t - val_[i]);
+        }
+
+        // curves
+        for(size_t i = 0; i < numChannels; i++)
+        {
+            const float v = val_[i];
+            mapped_[i]
+                = poly_[0][i]
+                  + v * (poly_[1][i] + v * (poly_[2][i] + v * poly_[3][i]));
+        }
+        for(size_t i = 0; i < numChannels; i++)
+        {
+            if(is_log_[i])
+                mapped_[i] = FastExp(log_offset_[i] + val_[i] * log_scale_[i]);
+        }
+    }
+
+    /** Returns the filtered control values of all channels, equivalent
+        to AnalogControl::Value(). */
+    const float *GetValues() const { return val_; }
+
+    /** Returns the values of all channels after they were mapped through
+        their curve, equivalent to Parameter::Value(). */
+    const float *GetMappedValues() const { return mapped_; }
+
+    /** Copies the filtered values of consecutive channels to AnalogControls,
+        so that their Value() matches the bank.
+        \param controls The controls to update
+        \param num Number of controls
+        \param first Index of the channel of the first control
+    */
+    void CopyValuesTo(AnalogControl *controls, size_t num, size_t first = 0)
+        const
+    {
+        for(size_t i = 0; i < num && first + i < numChannels; i++)
+            controls[i].val_ = val_[first + i];
+    }
+
+    /** Returns the filtered control value of a single channel */
+    float Value(size_t idx) const
+    {
+        return val_[idx < numChannels ? idx : 0];
+    }
+
+    /** Returns the mapped value of a single channel */
+    float MappedValue(size_t idx) const
+    {
+        return mapped_[idx < numChannels ? idx : 0];
+    }
+
+    /** Returns the number of channels in the bank */
+    size_t GetNumChannels() const { return numChannels; }
+
+    /** Approximates expf(x) with a relative error below 1e-5. Values outside
+        of the range of normalized floats are clamped. */
+    static float FastExp(float x)
+    {
+        // exp(x) = 2^(x * log2(e)) = 2^i * 2^f, with integer i and 0 <= f < 1
+        float y   = x * 1.44269504f;
+        y         = y < -126.0f ? -126.0f : (y > 127.0f ? 127.0f : y);
+        int32_t i = (int32_t)y;
+        i -= (y < (float)i) ? 1 : 0; // floor()
+        const float f = y - (float)i;
+
+        // 2^f on [0, 1)
+        const float p
+            = 1.00000349f
+              + f
+                    * (0.692972922f
+                       + f
+                             * (0.241604357f
+                                + f * (0.0517449978f + f * 0.0136703095f)));
+
+        // 2^i by constructing the float exponent directly
+        const uint32_t bits = (uint32_t)(i + 127) << 23;
+        float          pow2i;
+        memcpy(&pow2i, &bits, sizeof(pow2i));
+        return p * pow2i;
+    }
+
+  private:
+    /** Called by a bound AnalogControl when its settings change */
+    static void
+    UpdateChannel(void *bank, size_t idx, const AnalogControl &control)
+    {
+        static_cast<AnalogControlBank *>(bank)->CopySettings(idx, control);
+    }
+
+    void CopySettings(size_t idx, const AnalogControl &control)
+    {
+        raw_[idx]          = control.raw_;
+        val_[idx]          = control.val_;
+        scale_[idx]        = control.scale_;
+        offset_[idx]       = control.offset_;
+        flip_[idx]         = control.flip_;
+        invert_[idx]       = control.invert_;
+        slew_seconds_[idx] = control.slew_seconds_;
+        samplerate_[idx]   = control.samplerate_;
+        coeff_[idx]        = control.coeff_;
+        UpdateGainAndBias(idx);
+    }
+
+    void Reset()
+    {
+        for(size_t i = 0; i < numChannels; i++)
+            Init(i, &zero_, 1000.0f);
+    }
+
+    void UpdateCoeff(size_t idx)
+    {
+        SetCoeff(idx, 1.0f / (slew_seconds_[idx] * samplerate_[idx] * 0.5f));
+    }
+
+    /** see AnalogControl::UpdateGainAndBias() */
+    void UpdateGainAndBias(size_t idx)
+    {
+        const float scale = scale_[idx] * (invert_[idx] ? -1.0f : 1.0f);
+        gain_[idx]        = (flip_[idx] ? -scale : scale) / 65536.0f;
+        bias_[idx]        = ((flip_[idx] ? 1.0f : 0.0f) - offset_[idx]) * scale;
+    }
+
+    // processing state, accessed by Process()
+    float in_[numChannels];
+    float gain_[numChannels];
+    float bias_[numChannels];
+    float coeff_[numChannels];
+    float val_[numChannels];
+    float poly_[4][numChannels];
+    float log_offset_[numChannels];
+    float log_scale_[numChannels];
+    bool  is_log_[numChannels];
+    float mapped_[numChannels];
+
+    // configuration
+    uint16_t *raw_[numChannels];
+    float     scale_[numChannels];
+    float     offset_[numChannels];
+    float     slew_seconds_[numChannels];
+    float     samplerate_[numChannels];
+    bool      flip_[numChannels];
+    bool      invert_[numChannels];
+    uint16_t  zero_ = 0;
+};
+
+} // namespace daisy
+#endif
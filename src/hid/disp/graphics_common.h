@@ -256,6 +256,29 @@ class Rectangle
         }
     }
 
+    /** Returns the smallest Rectangle that contains both this and the 
+     *  other Rectangle. Empty Rectangles are ignored. */
+    Rectangle GetUnion(const Rectangle& other) const
+    {
+        if(other.IsEmpty())
+            return *this;
+        if(IsEmpty())
+            return other;
+        const int16_t right       = GetRight();
+        const int16_t bottom      = GetBottom();
+        const int16_t otherRight  = other.GetRight();
+        const int16_t otherBottom = other.GetBottom();
+
+        const int16_t newLeft   = (x_ < other.x_) ? x_ : other.x_;
+        const int16_t newTop    = (y_ < other.y_) ? y_ : other.y_;
+        const int16_t newRight  = (right > otherRight) ? right : otherRight;
+        const int16_t newBottom = (bottom > otherBottom) ? bottom : otherBottom;
+        return {newLeft,
+                newTop,
+                int16_t(newRight - newLeft),
+                int16_t(newBottom - newTop)};
+    }
+
   private:
     int16_t x_, y_, width_, height_;
     int16_t max(int16_t a, int16_t b) { return (a > b) ? a : b; }
@@ -1,11 +1,70 @@
 #include "hid/encoder.h"
+#include "stm32h7xx_hal.h"
+#include "util/hal_map.h"
 
 using namespace daisy;
 
+/** Pins connected to channel 1 and 2 of the timers, all on AF2 */
+struct EncoderTimerPins
+{
+    Pin ch1[3];
+    Pin ch2[3];
+};
+
+static const EncoderTimerPins encoder_timer_pins[] = {
+    // TIM3
+    {{{PORTA, 6}, {PORTB, 4}, {PORTC, 6}},
+     {{PORTA, 7}, {PORTB, 5}, {PORTC, 7}}},
+    // TIM4
+    {{{PORTB, 6}, {PORTD, 12}, Pin()}, {{PORTB, 7}, {PORTD, 13}, Pin()}},
+    // TIM5
+    {{{PORTA, 0}, {PORTH, 10}, Pin()}, {{PORTA, 1}, {PORTH, 11}, Pin()}},
+};
+
+static TIM_TypeDef *GetEncoderTimer(Encoder::Backend backend)
+{
+    switch(backend)
+    {
+        case Encoder::Backend::TIM_3: return TIM3;
+        case Encoder::Backend::TIM_4: return TIM4;
+        case Encoder::Backend::TIM_5: return TIM5;
+        default: return nullptr;
+    }
+}
+
+static bool IsPinInList(Pin p, const Pin (&list)[3])
+{
+    for(const Pin &candidate : list)
+        if(candidate.IsValid() && candidate == p)
+            return true;
+    return false;
+}
+
+static void InitEncoderTimerPin(Pin p, uint32_t alternate)
+{
+    switch(p.port)
+    {
+        case PORTA: __HAL_RCC_GPIOA_CLK_ENABLE(); break;
+        case PORTB: __HAL_RCC_GPIOB_CLK_ENABLE(); break;
+        case PORTC: __HAL_RCC_GPIOC_CLK_ENABLE(); break;
+        case PORTD: __HAL_RCC_GPIOD_CLK_ENABLE(); break;
+        case PORTH: __HAL_RCC_GPIOH_CLK_ENABLE(); break;
+        default: break;
+    }
+    GPIO_InitTypeDef GPIO_InitStruct = {0};
+    GPIO_InitStruct.Pin              = GetHALPin(p);
+    GPIO_InitStruct.Mode             = GPIO_MODE_AF_PP;
+    GPIO_InitStruct.Pull             = GPIO_PULLUP;
+    GPIO_InitStruct.Speed            = GPIO_SPEED_FREQ_LOW;
+    GPIO_InitStruct.Alternate        = alternate;
+    HAL_GPIO_Init(GetHALPort(p), &GPIO_InitStruct);
+}
+
 void Encoder::Init(Pin a, Pin b, Pin click, float update_rate)
 {
     last_update_ = System::GetNow();
     updated_     = false;
+    backend_     = Backend::SOFTWARE;
 
     // Init GPIO for A, and B
     hw_a_.Init(a, GPIO::Mode::INPUT, GPIO::Pull::PULLUP);
@@ -15,6 +74,95 @@ void Encoder::Init(Pin a, Pin b, Pin click, float update_rate)
     // Set initial states, etc.
     inc_ = 0;
     a_ = b_ = 0xff;
+
+    counts_per_step_ = 1;
+    counts_          = 0;
+    accumulated_     = 0;
+    position_        = 0;
+    velocity_.Init(1000000);
+}
+
+bool Encoder::Init(Pin      a,
+                   Pin      b,
+                   Pin      click,
+                   Backend  backend,
+                   uint32_t counts_per_step)
+{
+    Init(a, b, click);
+    if(backend == Backend::SOFTWARE)
+        return true;
+
+    const auto &pins = encoder_timer_pins[static_cast<int>(backend) - 1];
+    if(!IsPinInList(a, pins.ch1) || !IsPinInList(b, pins.ch2))
+        return false;
+
+    backend_         = backend;
+    counts_per_step_ = counts_per_step > 0 ? counts_per_step : 1;
+    return InitTimer(a, b);
+}
+
+bool Encoder::InitTimer(Pin a, Pin b)
+{
+    uint32_t alternate;
+    switch(backend_)
+    {
+        case Backend::TIM_3:
+            __HAL_RCC_TIM3_CLK_ENABLE();
+            alternate = GPIO_AF2_TIM3;
+            break;
+        case Backend::TIM_4:
+            __HAL_RCC_TIM4_CLK_ENABLE();
+            alternate = GPIO_AF2_TIM4;
+            break;
+        case Backend::TIM_5:
+            __HAL_RCC_TIM5_CLK_ENABLE();
+            alternate = GPIO_AF2_TIM5;
+            break;
+        default: return false;
+    }
+    InitEncoderTimerPin(a, alternate);
+    InitEncoderTimerPin(b, alternate);
+
+    // Count every edge of A and B. The input filters need 8 samples at
+    // fDTS / 32 to agree, which rejects short spikes; contact bounce just
+    // counts back and forth.
+    TIM_HandleTypeDef       htim    = {0};
+    TIM_Encoder_InitTypeDef sConfig = {0};
+    htim.Instance                   = GetEncoderTimer(backend_);
+    htim.Init.Prescaler             = 0;
+    htim.Init.CounterMode           = TIM_COUNTERMODE_UP;
+    htim.Init.Period                = 0xffff;
+    htim.Init.ClockDivision         = TIM_CLOCKDIVISION_DIV4;
+    htim.Init.AutoReloadPreload     = TIM_AUTORELOAD_PRELOAD_DISABLE;
+    sConfig.EncoderMode             = TIM_ENCODERMODE_TI12;
+    sConfig.IC1Polarity             = TIM_ICPOLARITY_RISING;
+    sConfig.IC1Selection            = TIM_ICSELECTION_DIRECTTI;
+    sConfig.IC1Prescaler            = TIM_ICPSC_DIV1;
+    sConfig.IC1Filter               = 0xf;
+    sConfig.IC2Polarity             = TIM_ICPOLARITY_RISING;
+    sConfig.IC2Selection            = TIM_ICSELECTION_DIRECTTI;
+    sConfig.IC2Prescaler            = TIM_ICPSC_DIV1;
+    sConfig.IC2Filter               = 0xf;
+    if(HAL_TIM_Encoder_Init(&htim, &sConfig) != HAL_OK
+       || HAL_TIM_Encoder_Start(&htim, TIM_CHANNEL_ALL) != HAL_OK)
+    {
+        backend_         = Backend::SOFTWARE;
+        counts_per_step_ = 1;
+        return false;
+    }
+    last_count_ = htim.Instance->CNT;
+    return true;
+}
+
+void Encoder::ReadTimer()
+{
+    // the counter is 16 bits wide on all timers, see InitTimer()
+    const uint16_t count = GetEncoderTimer(backend_)->CNT;
+    // Debounce() counts up when B leads A, the timer counts down then
+    counts_ -= int16_t(count - last_count_);
+    last_count_ = count;
+    inc_        = counts_ / int32_t(counts_per_step_);
+    counts_ -= inc_ * int32_t(counts_per_step_);
 }
 
 void Encoder::Debounce()
@@ -23,7 +171,13 @@ void Encoder::Debounce()
     uint32_t now = System::GetNow();
     updated_     = false;
 
-    if(now - last_update_ >= 1)
+    if(backend_ != Backend::SOFTWARE)
+    {
+        // the timer doesn't miss edges, report them on every call
+        updated_ = true;
+        ReadTimer();
+    }
+    else if(now - last_update_ >= 1)
     {
         last_update_ = now;
         updated_     = true;
@@ -44,6 +198,13 @@ void Encoder::Debounce()
         }
     }
 
+    if(updated_)
+    {
+        accumulated_ += inc_;
+        position_ += inc_;
+        velocity_.Update(inc_, System::GetUs());
+    }
+
     // Debounce built-in switch
     sw_.Debounce();
 }
@@ -1,9 +1,11 @@
 #pragma once
 #ifndef DSY_ENCODER_H
 #define DSY_ENCODER_H
+#include <atomic>
 #include "daisy_core.h"
 #include "per/gpio.h"
 #include "hid/switch.h"
+#include "util/EncoderAcceleration.h"
 
 namespace daisy
 {
@@ -13,10 +15,24 @@ namespace daisy
     @author Stephen Hensley
     @date December 2019
     @ingroup controls
+
+    By default, A and B are sampled in software each time Debounce() is
+    called, which can miss steps when the encoder is spun quickly. If A and B
+    are connected to channel 1 and 2 of a timer, the timer can decode them
+    in hardware instead, see Init(Pin, Pin, Pin, Backend, uint32_t).
 */
 class Encoder
 {
   public:
+    /** @brief How A and B are decoded */
+    enum class Backend
+    {
+        SOFTWARE, /**< Sampled in Debounce(), works with any pins */
+        TIM_3,    /**< A on PA6, PB4 or PC6, B on PA7, PB5 or PC7 */
+        TIM_4,    /**< A on PB6 or PD12, B on PB7 or PD13 */
+        TIM_5,    /**< A on PA0 or PH10, B on PA1 or PH11 */
+    };
+
     Encoder() {}
     ~Encoder() {}
 
@@ -24,14 +40,54 @@ class Encoder
      * Update rate is to be deprecated in a future release
      */
     void Init(Pin a, Pin b, Pin click, float update_rate = 0.f);
+
+    /** Initializes the encoder with a timer in encoder mode counting every
+     *  edge of A and B, so that no steps are lost between calls to
+     *  Debounce(). The timer can't be used for anything else.
+     *  \param a, b, click The pins of the encoder
+     *  \param backend Timer to use, SOFTWARE is the same as Init(a, b, click)
+     *  \param counts_per_step Edges per detent, 4 for most encoders with
+     *         detents
+     *  \return false if a and b aren't channel 1 and 2 of the timer, the
+     *          encoder is decoded in software then
+     */
+    bool Init(Pin      a,
+              Pin      b,
+              Pin      click,
+              Backend  backend,
+              uint32_t counts_per_step = 4);
+
     /** Called at update_rate to debounce and handle timing for the switch.
      * In order for events not to be missed, its important that the Edge/Pressed checks be made at the same rate as the debounce function is being called.
      */
     void Debounce();
 
-    /** Returns +1 if the encoder was turned clockwise, -1 if it was turned counter-clockwise, or 0 if it was not just turned. */
+    /** Returns +1 if the encoder was turned clockwise, -1 if it was turned counter-clockwise, or 0 if it was not just turned.
+     *  With a timer backend, this is the number of steps since the last
+     *  call to Debounce(), which can be more than one.
+     */
     inline int32_t Increment() const { return updated_ ? inc_ : 0; }
 
+    /** Returns the steps since the last call and resets them, e.g. to read
+     *  an encoder debounced in a timer callback from the main loop. */
+    inline int32_t ReadIncrements() { return accumulated_.exchange(0); }
+
+    /** Returns the steps since Init(), clockwise is positive. */
+    inline int32_t GetPosition() const { return position_; }
+
+    /** Returns the velocity in steps per second, negative when turned
+     *  counter-clockwise. */
+    inline float GetVelocity() const { return velocity_.GetVelocity(); }
+
+    /** Returns the acceleration in steps per second squared. */
+    inline float GetAcceleration() const
+    {
+        return velocity_.GetAcceleration();
+    }
+
+    /** Returns the backend that decodes A and B. */
+    inline Backend GetBackend() const { return backend_; }
+
     /** Returns true if the encoder was just pressed. */
     inline bool RisingEdge() const { return sw_.RisingEdge(); }
 
@@ -50,12 +106,22 @@ class Encoder
     inline void SetUpdateRate(float update_rate) {}
 
   private:
-    uint32_t last_update_;
-    bool     updated_;
-    Switch   sw_;
-    GPIO     hw_a_, hw_b_;
-    uint8_t  a_, b_;
-    int32_t  inc_;
+    bool InitTimer(Pin a, Pin b);
+    void ReadTimer();
+
+    uint32_t              last_update_;
+    bool                  updated_;
+    Switch                sw_;
+    GPIO                  hw_a_, hw_b_;
+    uint8_t               a_, b_;
+    int32_t               inc_;
+    Backend               backend_;
+    uint32_t              counts_per_step_;
+    uint16_t              last_count_;
+    int32_t               counts_;
+    std::atomic<int32_t>  accumulated_;
+    int32_t               position_;
+    EncoderVelocityFilter velocity_;
 };
 } // namespace daisy
 #endif
@@ -1,4 +1,5 @@
 #include "hid/gatein.h"
+#include "sys/system.h"
 
 using namespace daisy;
 
@@ -16,4 +17,37 @@ bool GateIn::Trig()
     prev_state_ = state_;
     state_      = invert_ ? !pin_.Read() : pin_.Read();
     return state_ && !prev_state_;
-}
\ No newline at end of file
+}
+
+bool GateIn::StartCapture(uint8_t priority)
+{
+    edges_.Clear(State());
+    clock_.Init(System::GetTickFreq());
+    return pin_.EnableInterrupt(GPIO::Edge::BOTH, &OnEdge, this, priority);
+}
+
+void GateIn::StopCapture()
+{
+    pin_.DisableInterrupt();
+}
+
+size_t GateIn::GetTriggersInBlock(const AudioBlockClock& clock,
+                                  size_t*                offsets,
+                                  size_t                 max_offsets)
+{
+    size_t   num = 0;
+    GateEdge edge;
+    while(num < max_offsets && edges_.PopEdgesInBlock(clock, &edge, 1, true))
+        offsets[num++] = edge.offset;
+    return num;
+}
+
+void GateIn::OnEdge(void* context)
+{
+    // timestamp first, before anything else delays it
+    const uint32_t tick  = System::GetTick();
+    GateIn*        self  = static_cast<GateIn*>(context);
+    const bool     level = self->State();
+    if(self->edges_.PushEdge(tick, level, self->pin_.IsInterruptPending()))
+        self->clock_.AddEdge(tick);
+}
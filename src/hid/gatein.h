@@ -2,6 +2,7 @@
 #ifndef DSY_GATEIN_H
 #define DSY_GATEIN_H
 #include "per/gpio.h"
+#include "util/GateTiming.h"
 
 namespace daisy
 {
@@ -41,10 +42,69 @@ class GateIn
      */
     inline bool State() { return invert_ ? !pin_.Read() : pin_.Read(); }
 
+    /** @brief Starts capturing timestamped edges in the EXTI interrupt.
+     *
+     *  Instead of being quantized to the rate at which Trig() is polled,
+     *  the edges are timestamped with the system tick and can be placed
+     *  at the right sample within an audio block with GetTriggersInBlock().
+     *  The rising edges also feed a ClockPeriodEstimator, see GetClock().
+     *  Trig() and State() keep working while capturing.
+     *
+     *  @param priority NVIC priority of the EXTI interrupt. The timestamps
+     *                  are late by the time higher priority interrupts,
+     *                  e.g. the audio callback, keep it waiting.
+     *  @return false if the EXTI line of the pin is used by another port
+     */
+    bool StartCapture(uint8_t priority = 0x0f);
+
+    /** Stops capturing edges */
+    void StopCapture();
+
+    /** @brief Fetches the triggers (rising edges) for the current block
+     *
+     *  Call this in the audio callback, after clock.StartBlock(). The
+     *  triggers that happened during the previous block period are
+     *  returned as sample offsets into the current block, so they are
+     *  delayed by exactly one block but keep their relative timing.
+     *
+     *  @param clock        The AudioBlockClock of the audio callback
+     *  @param offsets      Receives the sample offsets, in order
+     *  @param max_offsets  Size of `offsets`. Any more triggers are kept
+     *                      for the next call.
+     *  @return the number of triggers written to `offsets`
+     */
+    size_t GetTriggersInBlock(const AudioBlockClock& clock,
+                              size_t*                offsets,
+                              size_t                 max_offsets);
+
+    /** @brief Like GetTriggersInBlock(), but returns the rising and
+     *         falling edges, e.g. to follow the length of gates.
+     */
+    size_t GetEdgesInBlock(const AudioBlockClock& clock,
+                           GateEdge*              edges,
+                           size_t                 max_edges)
+    {
+        return edges_.PopEdgesInBlock(clock, edges, max_edges);
+    }
+
+    /** @return the clock period estimated from the captured rising edges,
+     *          e.g. for following an external clock or tap tempo
+     */
+    const ClockPeriodEstimator& GetClock() const { return clock_; }
+
+    /** @return the number of edges that were lost because they weren't
+     *          fetched in time
+     */
+    uint32_t GetNumDroppedEdges() const { return edges_.GetNumDropped(); }
+
   private:
-    GPIO pin_;
-    bool prev_state_, state_;
-    bool invert_;
+    static void OnEdge(void* context);
+
+    GPIO                 pin_;
+    bool                 prev_state_, state_;
+    bool                 invert_;
+    GateEdgeQueue<16>    edges_;
+    ClockPeriodEstimator clock_;
 };
 } // namespace daisy
 #endif
@@ -3,19 +3,16 @@
 
 using namespace daisy;
 
-#define RESOLUTION_MAX (65535)
-
 void Led::Init(Pin pin, bool invert, float samplerate)
 {
     // Init hardware LED
     // Simple OUTPUT GPIO for now.
     hw_pin_.Init(pin, GPIO::Mode::OUTPUT);
     // Set internal stuff.
-    bright_  = 0.0f;
-    pwm_cnt_ = 0;
-    Set(bright_);
-    invert_     = invert;
-    samplerate_ = samplerate;
+    pwm_ = 0;
+    Set(0.0f);
+    invert_ = invert;
+    SetSampleRate(samplerate);
     if(invert_)
     {
         on_  = false;
@@ -29,15 +26,14 @@ void Led::Init(Pin pin, bool invert, float samplerate)
 }
 void Led::Set(float val)
 {
-    bright_     = cube(val);
-    pwm_thresh_ = bright_ * static_cast<float>(RESOLUTION_MAX);
+    const uint32_t intensity = GammaCurve::Apply(val);
+    // full brightness must stay above the whole PWM ramp
+    bright_ = intensity == 65535 ? 65536 : intensity;
 }
 
 void Led::Update()
 {
     // Shout out to @grrwaaa for the quick fix for pwm
-    pwm_ += 120.f / samplerate_;
-    if(pwm_ > 1.f)
-        pwm_ -= 1.f;
+    pwm_ = (pwm_ + pwm_inc_) & 0xFFFF;
     hw_pin_.Write(bright_ > pwm_ ? on_ : off_);
 }
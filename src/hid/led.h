@@ -4,6 +4,7 @@
 #define DSY_LED_H
 #include "daisy_core.h"
 #include "per/gpio.h"
+#include "util/LedBrightness.h"
 
 /* TODO - Get this set up to work with the dev_leddriver stuff as well
 - Setup Hardware PWM for pins that have it
@@ -34,8 +35,8 @@ class Led
 
     /** 
     Sets the brightness of the Led.
-    \param val will be cubed for gamma correction, and then quantized to 8-bit values for Software PWM
-    8-bit is for more flexible update rate options, as 12-bit or more would require faster update rates.
+    \param val will be cubed for gamma correction with a lookup table, and then compared
+    to a 16-bit PWM ramp. The effective resolution depends on the update rate.
     */
     void Set(float val);
 
@@ -48,15 +49,22 @@ class Led
     /** Set the rate at which you'll update the leds without reiniting the led
      *  \param sample_rate New update rate in hz.
     */
-    inline void SetSampleRate(float sample_rate) { samplerate_ = sample_rate; }
+    inline void SetSampleRate(float sample_rate)
+    {
+        samplerate_ = sample_rate;
+        // 120Hz PWM frequency, as a 16 bit phase increment
+        pwm_inc_ = static_cast<uint32_t>(120.0f / samplerate_ * 65536.0f);
+    }
 
   private:
-    size_t pwm_cnt_, pwm_thresh_;
-    float  bright_;
-    float  pwm_;
-    float  samplerate_;
-    bool   invert_, on_, off_;
-    GPIO   hw_pin_;
+    using GammaCurve = LedGammaCurve<LedGamma::CUBE>;
+
+    uint32_t bright_; // 0 to 65536
+    uint32_t pwm_;    // 0 to 65535
+    uint32_t pwm_inc_;
+    float    samplerate_;
+    bool     invert_, on_, off_;
+    GPIO     hw_pin_;
 };
 
 } // namespace daisy
@@ -222,15 +222,42 @@ class MidiHandler
         MidiEvent event;
         if(parser_.Parse(byte, &event))
         {
+            if(event_callback_)
+                event_callback_(event, System::GetTick(), event_context_);
             event_q_.PushBack(event);
         }
     }
 
+    /** Callback for the events as they are parsed
+        \param event The parsed event
+        \param tick The system tick at which it was parsed
+        \param context The pointer passed to SetEventCallback()
+    */
+    typedef void (*EventCallback)(const MidiEvent& event,
+                                  uint32_t         tick,
+                                  void*            context);
+
+    /** Sets a callback for each event, called from the receive interrupt
+        right before the event is queued. The tick keeps the timing of
+        clock and transport messages, see MidiClock. The events are still
+        queued for PopEvent().
+        \note Bytes that arrive together are parsed together, so the tick
+        is only precise for messages that arrive on their own, like clock
+        pulses.
+    */
+    void SetEventCallback(EventCallback callback, void* context)
+    {
+        event_context_  = context;
+        event_callback_ = callback;
+    }
+
   private:
     Config               config_;
     Transport            transport_;
     MidiParser           parser_;
     FIFO<MidiEvent, 256> event_q_;
+    EventCallback        event_callback_ = nullptr;
+    void*                event_context_  = nullptr;
 
     static void ParseCallback(uint8_t* data, size_t size, void* context)
     {
@@ -0,0 +1,68 @@
+#include "hid/midi_clock.h"
+#include "sys/system.h"
+
+using namespace daisy;
+
+void MidiClock::Init(const Config& config)
+{
+    config_ = config;
+    follower_.Init(System::GetTickFreq(), config.divisions_per_beat);
+    // rescaled to the timer frequency by StartOutput()
+    generator_.Init(System::GetTickFreq());
+}
+
+void MidiClock::ProcessBlock(const AudioBlockClock& clock)
+{
+    MidiClockDivision divisions[8];
+    size_t            num;
+    do
+    {
+        num = follower_.ProcessBlock(clock, divisions, 8);
+        for(size_t i = 0; i < num && division_callback_; i++)
+            division_callback_(divisions[i], division_context_);
+    } while(num == 8);
+
+    if(follow_input_ && follower_.IsLocked())
+        generator_.SetPeriod(follower_.GetPeriodTicks(),
+                             System::GetTickFreq());
+}
+
+bool MidiClock::StartOutput(SendCallback send, void* context)
+{
+    send_         = send;
+    send_context_ = context;
+
+    TimerHandle::Config timer_cfg;
+    timer_cfg.periph     = config_.timer;
+    timer_cfg.enable_irq = true;
+    if(timer_.Init(timer_cfg) != TimerHandle::Result::OK)
+        return false;
+    // keep the tempo set before the output started
+    generator_.Init(timer_.GetFreq(), generator_.GetBpm());
+    timer_.SetPeriod(generator_.NextInterval() - 1);
+    timer_.SetCallback(&OnTimer, this);
+    return timer_.Start() == TimerHandle::Result::OK;
+}
+
+void MidiClock::StopOutput()
+{
+    timer_.Stop();
+}
+
+void MidiClock::SendSongPosition(uint16_t sixteenths)
+{
+    uint8_t bytes[3] = {0xf2,
+                        uint8_t(sixteenths & 0x7f),
+                        uint8_t((sixteenths >> 7) & 0x7f)};
+    if(send_)
+        send_(bytes, 3, send_context_);
+}
+
+void MidiClock::OnTimer(void* context)
+{
+    auto self = static_cast<MidiClock*>(context);
+    // the timer restarted with this pulse, its new period applies to the
+    // interval to the next one
+    self->timer_.SetPeriod(self->generator_.NextInterval() - 1);
+    self->SendRealTime(0xf8);
+}
@@ -0,0 +1,150 @@
+#pragma once
+#ifndef DSY_MIDI_CLOCK_H
+#define DSY_MIDI_CLOCK_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "per/tim.h"
+#include "util/MidiClockSync.h"
+
+namespace daisy
+{
+/** @brief Syncs to an incoming MIDI clock and sends a MIDI clock
+ *  @ingroup midi
+ *
+ *  Input: the MidiHandler passes the clock and transport messages with the
+ *  time they were received, and the audio callback places the beats and
+ *  divisions on the smoothed clock at the right sample, see
+ *  MidiClockFollower:
+ *  @code
+ *  midi.SetEventCallback(MidiClock::EventCallback, &midi_clock);
+ *  midi_clock.SetDivisionCallback(OnSixteenth, nullptr);
+ *  ...
+ *  void AudioCallback(AudioHandle::InputBuffer  in,
+ *                     AudioHandle::OutputBuffer out,
+ *                     size_t                    size)
+ *  {
+ *      block_clock.StartBlock(System::GetTick());
+ *      midi_clock.ProcessBlock(block_clock); // calls OnSixteenth()
+ *      ...
+ *  }
+ *  @endcode
+ *
+ *  Output: the pulses are timed by a hardware timer, so they don't jitter
+ *  with the main loop or the audio callback. The tempo is set with
+ *  SetOutputTempo(), or follows the input.
+ */
+class MidiClock
+{
+  public:
+    /** Called from ProcessBlock() for each beat and division in the block */
+    typedef void (*DivisionCallback)(const MidiClockDivision& division,
+                                     void*                    context);
+
+    /** Sends MIDI bytes, e.g. with MidiHandler::SendMessage(). Called from
+     *  the timer interrupt for the clock pulses, so it should be quick:
+     *  at 31250 baud, a blocking UART write takes 320us per byte.
+     */
+    typedef void (*SendCallback)(uint8_t* bytes, size_t size, void* context);
+
+    struct Config
+    {
+        /** Divisions per quarter note passed to the DivisionCallback, e.g.
+         *  4 for sixteenths, 1 to 24 */
+        uint8_t divisions_per_beat;
+        /** Timer for the clock output, needs a 32-bit counter for slow
+         *  tempos. TIM_2 runs the system tick, so this defaults to TIM_5. */
+        TimerHandle::Config::Peripheral timer;
+
+        Config()
+        : divisions_per_beat(4), timer(TimerHandle::Config::Peripheral::TIM_5)
+        {
+        }
+    };
+
+    MidiClock() {}
+    ~MidiClock() {}
+
+    void Init(const Config& config);
+
+    /** Passes the clock and transport events to a MidiClock, for
+     *  MidiHandler::SetEventCallback() with the MidiClock as context.
+     */
+    static void
+    EventCallback(const MidiEvent& event, uint32_t tick, void* context)
+    {
+        static_cast<MidiClock*>(context)->follower_.PushEvent(event, tick);
+    }
+
+    /** Sets the callback for the beats and divisions of the input */
+    void SetDivisionCallback(DivisionCallback callback, void* context)
+    {
+        division_callback_ = callback;
+        division_context_  = context;
+    }
+
+    /** Applies the received events and calls the DivisionCallback for the
+     *  divisions of the block. Call this in the audio callback, after
+     *  clock.StartBlock().
+     */
+    void ProcessBlock(const AudioBlockClock& clock);
+
+    /** Starts sending clock pulses from the timer interrupt
+     *  @return false if the timer couldn't be started
+     */
+    bool StartOutput(SendCallback send, void* context);
+
+    /** Stops sending clock pulses */
+    void StopOutput();
+
+    /** Sets the tempo of the output in quarter notes per minute */
+    void SetOutputTempo(float bpm) { generator_.SetBpm(bpm); }
+
+    /** Makes the output follow the tempo of the input while it's locked,
+     *  e.g. to pass on a clock without its jitter */
+    void SetOutputFollowsInput(bool follow) { follow_input_ = follow; }
+
+    /** Sends Start, the next pulse is the first beat */
+    void SendStart() { SendRealTime(0xfa); }
+
+    /** Sends Continue */
+    void SendContinue() { SendRealTime(0xfb); }
+
+    /** Sends Stop */
+    void SendStop() { SendRealTime(0xfc); }
+
+    /** Sends a song position pointer, in sixteenth notes */
+    void SendSongPosition(uint16_t sixteenths);
+
+    const MidiClockFollower<>& GetFollower() const { return follower_; }
+
+    /** @return the tempo of the input, 0 without a lock */
+    float GetBpm() const { return follower_.GetBpm(); }
+
+    bool IsPlaying() const { return follower_.IsPlaying(); }
+
+    bool IsLocked() const { return follower_.IsLocked(); }
+
+  private:
+    static void OnTimer(void* context);
+
+    void SendRealTime(uint8_t status)
+    {
+        if(send_)
+            send_(&status, 1, send_context_);
+    }
+
+    MidiClockFollower<> follower_;
+    MidiClockGenerator  generator_;
+    TimerHandle         timer_;
+    Config              config_;
+    DivisionCallback    division_callback_ = nullptr;
+    void*               division_context_  = nullptr;
+    SendCallback        send_              = nullptr;
+    void*               send_context_      = nullptr;
+    bool                follow_input_      = false;
+};
+
+} // namespace daisy
+
+#endif
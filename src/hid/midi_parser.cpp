@@ -191,4 +191,6 @@ void MidiParser::Reset()
 {
     pstate_                = ParserEmpty;
     incoming_message_.type = MessageLast;
+    // checked for running status, must not be left uninitialized
+    incoming_message_.sc_type = SystemCommonLast;
 }
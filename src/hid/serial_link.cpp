@@ -0,0 +1,79 @@
+#include "hid/serial_link.h"
+
+using namespace daisy;
+
+bool SerialLinkUartTransport::Init(const Config& config)
+{
+    if(uart_.Init(config.uart_config) != UartHandler::Result::OK)
+        return false;
+
+    UartStream::Config stream_config;
+    stream_config.Defaults();
+    stream_config.rx_buffer = config.rx_buffer;
+    stream_config.rx_size   = config.rx_size;
+    stream_config.tx_buffer = config.tx_buffer;
+    stream_config.tx_size   = config.tx_size;
+    return stream_.Init(uart_, stream_config) == UartStream::Result::OK
+           && stream_.Start() == UartStream::Result::OK;
+}
+
+// the USB receive callback has no context
+static SerialLinkUsbTransport* usb_transport = nullptr;
+
+bool SerialLinkUsbTransport::Init(const Config& config)
+{
+    config_       = config;
+    rx_pos_       = 0;
+    tx_size_[0]   = 0;
+    tx_size_[1]   = 0;
+    tx_active_    = 0;
+    usb_transport = this;
+    rx_.Init(rx_buffer_, kRxBufferSize);
+    usb_.Init(config_.periph);
+    usb_.SetReceiveCallback(OnReceive, config_.periph);
+    return true;
+}
+
+void SerialLinkUsbTransport::OnReceive(uint8_t* data, uint32_t* size)
+{
+    SerialLinkUsbTransport* transport = usb_transport;
+    if(transport == nullptr)
+        return;
+    // copy into the ring like a circular DMA would, so that the reader
+    // gets the same overflow detection. A USB packet is much smaller than
+    // the buffer, so one report per packet is enough.
+    const size_t pos   = transport->rx_pos_;
+    const size_t len   = *size < kRxBufferSize ? *size : kRxBufferSize;
+    const size_t first = len < kRxBufferSize - pos ? len : kRxBufferSize - pos;
+    memcpy(transport->rx_buffer_ + pos, data, first);
+    memcpy(transport->rx_buffer_, data + first, len - first);
+    transport->rx_pos_ = (pos + len) & (kRxBufferSize - 1);
+    transport->rx_.OnDmaPosition(transport->rx_pos_, true);
+}
+
+size_t SerialLinkUsbTransport::Write(const uint8_t* data, size_t size)
+{
+    if(size > GetTxFree())
+        return 0;
+    memcpy(tx_buffer_[tx_active_] + tx_size_[tx_active_], data, size);
+    tx_size_[tx_active_] += size;
+    return size;
+}
+
+void SerialLinkUsbTransport::Flush()
+{
+    const size_t size = tx_size_[tx_active_];
+    if(size == 0)
+        return;
+    // the driver refuses a transfer while the previous one runs, which
+    // also means the other buffer is free again once this one is accepted
+    uint8_t* buffer = tx_buffer_[tx_active_];
+    const UsbHandle::Result result
+        = config_.periph == UsbHandle::FS_EXTERNAL
+              ? usb_.TransmitExternal(buffer, size)
+              : usb_.TransmitInternal(buffer, size);
+    if(result != UsbHandle::Result::OK)
+        return;
+    tx_active_ ^= 1;
+    tx_size_[tx_active_] = 0;
+}
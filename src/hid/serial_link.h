@@ -0,0 +1,396 @@
+#pragma once
+#ifndef DSY_SERIAL_LINK_H
+#define DSY_SERIAL_LINK_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "hid/usb.h"
+#include "per/uart.h"
+#include "per/uart_stream.h"
+#include "util/SerialFraming.h"
+
+namespace daisy
+{
+/** @addtogroup serial
+    @{
+    */
+
+/** @brief UART transport for SerialLink
+ *
+ *  Receives and transmits with a UartStream, the buffers must be in D2
+ *  memory (DMA_BUFFER_MEM_SECTION).
+ */
+class SerialLinkUartTransport
+{
+  public:
+    struct Config
+    {
+        UartHandler::Config uart_config;
+        /** Receive buffer, size must be a power of two */
+        uint8_t* rx_buffer;
+        size_t   rx_size;
+        /** Transmit buffer, size must be a power of two */
+        uint8_t* tx_buffer;
+        size_t   tx_size;
+
+        Config()
+        {
+            uart_config.baudrate = 921600;
+            uart_config.mode     = UartHandler::Config::Mode::TX_RX;
+            rx_buffer            = nullptr;
+            rx_size              = 0;
+            tx_buffer            = nullptr;
+            tx_size              = 0;
+        }
+    };
+
+    SerialLinkUartTransport() {}
+    ~SerialLinkUartTransport() {}
+
+    /** Initializes the UART and starts receiving */
+    bool Init(const Config& config);
+
+    /** @return received bytes, in place in the DMA buffer */
+    UartSpan GetReadable() { return stream_.GetReadable(); }
+
+    /** Marks received bytes as read */
+    void Consume(size_t size) { stream_.Consume(size); }
+
+    /** @return how many bytes Write() accepts */
+    size_t GetTxFree() const { return stream_.GetTxFree(); }
+
+    /** Queues bytes, they're sent in the background */
+    size_t Write(const uint8_t* data, size_t size)
+    {
+        return stream_.Write(data, size);
+    }
+
+    /** Sending starts in Write() already */
+    void Flush() {}
+
+    /** @return the stream, e.g. for its statistics */
+    UartStream& GetStream() { return stream_; }
+
+  private:
+    UartHandler uart_;
+    UartStream  stream_;
+};
+
+/** @brief USB CDC transport for SerialLink
+ *
+ *  Frames are collected in one of two buffers while the other one is being
+ *  sent, so that many small frames share a USB transfer. Only one instance
+ *  can be used.
+ */
+class SerialLinkUsbTransport
+{
+  public:
+    struct Config
+    {
+        /** The USB port, FS_INTERNAL or FS_EXTERNAL */
+        UsbHandle::UsbPeriph periph;
+
+        Config() : periph(UsbHandle::FS_INTERNAL) {}
+    };
+
+    static constexpr size_t kRxBufferSize = 2048;
+    static constexpr size_t kTxBufferSize = 512;
+
+    SerialLinkUsbTransport() {}
+    ~SerialLinkUsbTransport() {}
+
+    /** Initializes the USB port and starts receiving */
+    bool Init(const Config& config);
+
+    /** @return received bytes, in place in the receive buffer */
+    UartSpan GetReadable() { return rx_.GetReadable(); }
+
+    /** Marks received bytes as read */
+    void Consume(size_t size) { rx_.Consume(size); }
+
+    /** @return how many bytes Write() accepts */
+    size_t GetTxFree() const { return kTxBufferSize - tx_size_[tx_active_]; }
+
+    /** Adds bytes to the next transfer
+     *  @return the number of bytes accepted, 0 if they don't fit
+     */
+    size_t Write(const uint8_t* data, size_t size);
+
+    /** Starts a transfer with the collected bytes, unless the previous one
+     *  is still running */
+    void Flush();
+
+    /** @return the receive ring, e.g. for its statistics */
+    const UartRxRing& GetRxRing() const { return rx_; }
+
+  private:
+    static void OnReceive(uint8_t* data, uint32_t* size);
+
+    UsbHandle  usb_;
+    Config     config_;
+    UartRxRing rx_;
+    size_t     rx_pos_;
+    uint8_t    rx_buffer_[kRxBufferSize];
+    uint8_t    tx_buffer_[2][kTxBufferSize];
+    size_t     tx_size_[2];
+    size_t     tx_active_;
+};
+
+/** @brief Framed binary link for telemetry, parameters and bulk data
+ *
+ *  Sends and receives frames of SerialFrameEncoder over a transport, e.g.
+ *  SerialLinkUsbTransport or SerialLinkUartTransport. Frames are only
+ *  ever sent whole: when the transport can't take a frame, it's dropped
+ *  and counted, so that streaming never blocks the caller.
+ *
+ *  Call Process() regularly from the main loop. It decodes the received
+ *  frames, answers PING, PARAM_GET and PARAM_SET with the parameter
+ *  callbacks, passes all other frames to the frame callback, and flushes
+ *  the transmit buffer of the transport.
+ *
+ *  The payloads are described by SerialEndpoint. A host can use
+ *  util/SerialFraming.h to talk to the link.
+ *
+ *  @tparam Transport   The transport
+ *  @tparam max_payload The largest payload in either direction
+ */
+template <typename Transport, size_t max_payload = 256>
+class SerialLink
+{
+  public:
+    /** Reads a parameter, returns false if the id is unknown */
+    typedef bool (*ParamGetCallback)(uint16_t id, float& value, void* context);
+    /** Sets a parameter, returns false if the id is unknown */
+    typedef bool (*ParamSetCallback)(uint16_t id, float value, void* context);
+    /** Receives frames that aren't handled by the link */
+    typedef void (*FrameCallback)(const SerialFrame& frame, void* context);
+
+    struct Config
+    {
+        typename Transport::Config transport_config;
+        ParamGetCallback           param_get;
+        ParamSetCallback           param_set;
+        FrameCallback              frame_callback;
+        void*                      context;
+
+        Config()
+        : param_get(nullptr),
+          param_set(nullptr),
+          frame_callback(nullptr),
+          context(nullptr)
+        {
+        }
+    };
+
+    SerialLink() {}
+    ~SerialLink() {}
+
+    /** Initializes the link and its transport */
+    bool Init(const Config& config)
+    {
+        config_         = config;
+        num_tx_dropped_ = 0;
+        for(size_t i = 0; i < kNumEndpoints; i++)
+            sequence_[i] = 0;
+        decoder_.Reset();
+        return transport_.Init(config_.transport_config);
+    }
+
+    /** Handles received frames and sends the collected frames */
+    void Process()
+    {
+        UartSpan span = transport_.GetReadable();
+        while(span.size > 0)
+        {
+            SerialFrame frame;
+            for(size_t i = 0; i < span.size; i++)
+                if(decoder_.Feed(span.data[i], frame))
+                    HandleFrame(frame);
+            transport_.Consume(span.size);
+            span = transport_.GetReadable();
+        }
+        transport_.Flush();
+    }
+
+    /** Sends a frame
+     *  @return false if it was dropped because the transport is busy or
+     *          the payload is too large
+     */
+    bool SendFrame(uint8_t endpoint, const uint8_t* payload, size_t size)
+    {
+        if(size > max_payload || endpoint >= kNumEndpoints)
+            return false;
+        const size_t encoded_size = SerialFrameEncoder::Encode(
+            endpoint, sequence_[endpoint], payload, size, tx_frame_);
+        if(transport_.GetTxFree() < encoded_size)
+            transport_.Flush();
+        if(transport_.GetTxFree() < encoded_size)
+        {
+            num_tx_dropped_++;
+            return false;
+        }
+        transport_.Write(tx_frame_, encoded_size);
+        sequence_[endpoint]++;
+        return true;
+    }
+
+    /** Sends a frame to one of the predefined endpoints */
+    bool SendFrame(SerialEndpoint endpoint, const uint8_t* payload, size_t size)
+    {
+        return SendFrame(static_cast<uint8_t>(endpoint), payload, size);
+    }
+
+    /** Sends meter values, e.g. levels, to the METER endpoint */
+    bool SendMeters(const float* values, size_t num)
+    {
+        SerialPayloadWriter writer(payload_, max_payload);
+        for(size_t i = 0; i < num; i++)
+            writer.PutFloat(values[i]);
+        return !writer.IsOverflow()
+               && SendFrame(SerialEndpoint::METER, payload_, writer.GetSize());
+    }
+
+    /** Sends audio samples to the SCOPE endpoint, as 16 bit integers
+     *  @param channel      The channel, to tell several scopes apart
+     *  @param index        The index of the first sample, lets the host
+     *                      notice gaps
+     *  @param samples      The samples, from -1 to 1
+     *  @param num          The number of samples, see GetMaxScopeSamples()
+     */
+    bool SendScope(uint8_t      channel,
+                   uint32_t     index,
+                   const float* samples,
+                   size_t       num)
+    {
+        SerialPayloadWriter writer(payload_, max_payload);
+        writer.PutU8(channel);
+        writer.PutU32(index);
+        for(size_t i = 0; i < num; i++)
+        {
+            float s = samples[i];
+            s       = s > 1.f ? 1.f : (s < -1.f ? -1.f : s);
+            writer.PutU16(uint16_t(int16_t(s * 32767.f)));
+        }
+        return !writer.IsOverflow()
+               && SendFrame(SerialEndpoint::SCOPE, payload_, writer.GetSize());
+    }
+
+    /** @return the most samples SendScope() can send in one frame */
+    static constexpr size_t GetMaxScopeSamples()
+    {
+        return (max_payload - 5) / 2;
+    }
+
+    /** Sends a block of data to the BULK endpoint, split into frames
+     *  @return the number of bytes that were sent. When the transport is
+     *          busy, call again later with the rest, at that offset.
+     */
+    size_t
+    SendBulk(const uint8_t* data, size_t size, uint32_t offset, size_t total)
+    {
+        static_assert(max_payload > 8, "payload too small for bulk data");
+        size_t sent = 0;
+        while(sent < size)
+        {
+            const size_t chunk = size - sent < max_payload - 8
+                                     ? size - sent
+                                     : max_payload - 8;
+            SerialPayloadWriter writer(payload_, max_payload);
+            writer.PutU32(offset + sent);
+            writer.PutU32(total);
+            writer.PutBytes(data + sent, chunk);
+            if(!SendFrame(SerialEndpoint::BULK, payload_, writer.GetSize()))
+                break;
+            sent += chunk;
+        }
+        return sent;
+    }
+
+    /** Sends a block of data to the BULK endpoint, split into frames
+     *  @return the number of bytes that were sent
+     */
+    size_t SendBulk(const uint8_t* data, size_t size)
+    {
+        return SendBulk(data, size, 0, size);
+    }
+
+    /** @return the number of frames that weren't sent because the
+     *          transport was busy */
+    uint32_t GetNumTxDropped() const { return num_tx_dropped_; }
+
+    /** @return the decoder, for the receive statistics */
+    const SerialFrameDecoder<max_payload>& GetDecoder() const
+    {
+        return decoder_;
+    }
+
+    /** @return the transport */
+    Transport& GetTransport() { return transport_; }
+
+  private:
+    void HandleFrame(const SerialFrame& frame)
+    {
+        switch(static_cast<SerialEndpoint>(frame.endpoint))
+        {
+            case SerialEndpoint::PING:
+                SendFrame(SerialEndpoint::PONG, frame.payload, frame.size);
+                return;
+            case SerialEndpoint::PARAM_GET:
+            case SerialEndpoint::PARAM_SET:
+                if(config_.param_get != nullptr)
+                {
+                    HandleParam(frame);
+                    return;
+                }
+                break;
+            default: break;
+        }
+        if(config_.frame_callback != nullptr)
+            config_.frame_callback(frame, config_.context);
+    }
+
+    void HandleParam(const SerialFrame& frame)
+    {
+        SerialPayloadReader reader(frame.payload, frame.size);
+        const uint16_t      id = reader.GetU16();
+        float               value = 0.f;
+        bool                ok;
+        if(frame.endpoint == uint8_t(SerialEndpoint::PARAM_SET))
+        {
+            value = reader.GetFloat();
+            ok    = !reader.IsError() && config_.param_set != nullptr
+                 && config_.param_set(id, value, config_.context);
+        }
+        else
+        {
+            ok = !reader.IsError();
+        }
+        // answer with the value the parameter has now
+        ok = ok && config_.param_get(id, value, config_.context);
+
+        uint8_t             answer[7];
+        SerialPayloadWriter writer(answer, sizeof(answer));
+        writer.PutU16(id);
+        writer.PutFloat(ok ? value : 0.f);
+        writer.PutU8(ok ? 0 : 1);
+        SendFrame(SerialEndpoint::PARAM_VALUE, answer, writer.GetSize());
+    }
+
+    static constexpr size_t kNumEndpoints
+        = SerialFrameDecoder<max_payload>::kNumEndpoints;
+    static constexpr size_t kMaxFrameSize
+        = SerialFrameEncoder::GetMaxEncodedSize(max_payload);
+
+    Config                          config_;
+    Transport                       transport_;
+    SerialFrameDecoder<max_payload> decoder_;
+    uint8_t                         sequence_[kNumEndpoints];
+    uint8_t                         payload_[max_payload];
+    uint8_t                         tx_frame_[kMaxFrameSize];
+    uint32_t                        num_tx_dropped_;
+};
+
+/** @} */
+} // namespace daisy
+
+#endif
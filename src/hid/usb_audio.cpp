@@ -0,0 +1,259 @@
+#include "hid/usb_audio.h"
+#include "sys/system.h"
+#include "util/scopedirqblocker.h"
+#include "usbd_core.h"
+#include "usbd_desc.h"
+#include "usbd_cdc.h"
+#include "usbd_audio2.h"
+
+using namespace daisy;
+
+extern "C"
+{
+    extern USBD_HandleTypeDef hUsbDeviceFS;
+    extern USBD_HandleTypeDef hUsbDeviceHS;
+}
+
+UsbAudio* UsbAudio::instance_ = nullptr;
+
+static USBD_AUDIO2_ItfTypeDef usb_audio_fops;
+
+// Samples are moved in chunks through a buffer on the stack
+static constexpr size_t kChunkFrames = 32;
+
+/** @return how far SAI samples are shifted to be left justified */
+static int GetShift(SaiHandle::Config::BitDepth bit_depth)
+{
+    switch(bit_depth)
+    {
+        case SaiHandle::Config::BitDepth::SAI_16BIT: return 16;
+        case SaiHandle::Config::BitDepth::SAI_24BIT: return 8;
+        default: return 0;
+    }
+}
+
+UsbAudio::Result UsbAudio::Init(AudioHandle& audio, const Config& config)
+{
+    config_ = config;
+    const size_t channels = audio.GetChannels();
+    if(config.record_channels > channels || config.record_channels > 4
+       || config.playback_channels > channels || config.playback_channels > 4
+       || (config.bit_resolution != 16 && config.bit_resolution != 24
+           && config.bit_resolution != 32))
+        return Result::ERR;
+
+    const uint32_t sample_rate = uint32_t(audio.GetSampleRate() + 0.5f);
+    subslot_size_              = config.bit_resolution / 8;
+    block_size_                = audio.GetConfig().blocksize;
+
+    USBD_AUDIO2_ConfigTypeDef usb_config;
+    usb_config.sample_rate    = sample_rate;
+    usb_config.out_channels   = config.playback_channels;
+    usb_config.in_channels    = config.record_channels;
+    usb_config.subslot_size   = uint8_t(subslot_size_);
+    usb_config.bit_resolution = config.bit_resolution;
+    if(USBD_AUDIO2_Configure(&usb_config) != USBD_OK)
+        return Result::ERR;
+
+    // a block and a packet can arrive at once, twice that leaves margin
+    const float  nominal = sample_rate / 1000.f;
+    const size_t latency = config.latency > 0
+                               ? config.latency
+                               : 2 * (block_size_ + size_t(nominal) + 1);
+    if(2 * latency > kFifoFrames)
+        return Result::ERR;
+
+    UsbAudioLoopConfig loop;
+    loop.nominal_rate = nominal;
+    loop.target_fill  = float(latency);
+    meter_.Init(nominal);
+    feedback_.Init(loop);
+    pacer_.Init(loop);
+    playback_.Init(playback_buffer_, kFifoFrames, config.playback_channels);
+    playback_.SetStartFill(latency);
+    record_.Init(record_buffer_, kFifoFrames, config.record_channels);
+    record_.SetStartFill(latency);
+
+    clock_.Init(float(sample_rate), block_size_, System::GetTickFreq());
+    num_blocks_ = 0;
+    playing_    = false;
+    recording_  = false;
+    instance_   = this;
+    audio.SetStreamTaps(TapBefore, TapAfter, this);
+
+    usb_audio_fops.StreamChanged = OnStreamChanged;
+    usb_audio_fops.Received      = OnReceived;
+    usb_audio_fops.Sof           = OnSof;
+    usb_audio_fops.GetFeedback   = GetFeedback;
+    usb_audio_fops.FillPacket    = FillPacket;
+
+    // This tells the USB middleware to set up for audio instead of CDC
+    usbd_mode = USBD_MODE_AUDIO2;
+
+    const bool          internal = config.periph == Config::Periph::INTERNAL;
+    USBD_HandleTypeDef* device   = internal ? &hUsbDeviceFS : &hUsbDeviceHS;
+    if(USBD_Init(device, internal ? &FS_Desc : &HS_Desc,
+                 internal ? DEVICE_FS : DEVICE_HS)
+           != USBD_OK
+       || USBD_RegisterClass(device, &USBD_AUDIO2) != USBD_OK
+       || USBD_AUDIO2_RegisterInterface(device, &usb_audio_fops) != USBD_OK
+       || USBD_Start(device) != USBD_OK)
+        return Result::ERR;
+
+    HAL_PWREx_EnableUSBVoltageDetector();
+    return Result::OK;
+}
+
+// Audio side, from the audio interrupt
+
+void UsbAudio::StartBlock()
+{
+    // the start of frame may interrupt this, but never see half of it
+    ScopedIrqBlocker irq;
+    clock_.StartBlock(System::GetTick());
+    num_blocks_ = num_blocks_ + 1;
+}
+
+void UsbAudio::Record(const AudioHandle::RawBlock& block,
+                      int32_t* const*              buffers)
+{
+    const size_t channels = config_.record_channels;
+    const int    shift    = GetShift(block.bit_depth);
+    int32_t      chunk[kChunkFrames * kMaxChannels];
+    for(size_t start = 0; start < block.size; start += kChunkFrames)
+    {
+        const size_t size = block.size - start < kChunkFrames
+                                ? block.size - start
+                                : kChunkFrames;
+        for(size_t i = 0; i < size; i++)
+            for(size_t c = 0; c < channels; c++)
+                chunk[i * channels + c] = int32_t(
+                    uint32_t(buffers[c / 2][(start + i) * 2 + c % 2]) << shift);
+        record_.Write(chunk, size);
+    }
+}
+
+void UsbAudio::Play(const AudioHandle::RawBlock& block,
+                    int32_t* const*              buffers,
+                    bool                         mix)
+{
+    const size_t channels = config_.playback_channels;
+    const int    shift    = GetShift(block.bit_depth);
+    int32_t      chunk[kChunkFrames * kMaxChannels];
+    for(size_t start = 0; start < block.size; start += kChunkFrames)
+    {
+        const size_t size = block.size - start < kChunkFrames
+                                ? block.size - start
+                                : kChunkFrames;
+        playback_.Read(chunk, size);
+        for(size_t i = 0; i < size; i++)
+        {
+            for(size_t c = 0; c < channels; c++)
+            {
+                int32_t& dest  = buffers[c / 2][(start + i) * 2 + c % 2];
+                int64_t  value = chunk[i * channels + c];
+                if(mix)
+                {
+                    value += int32_t(uint32_t(dest) << shift);
+                    value = value > INT32_MAX ? INT32_MAX : value;
+                    value = value < INT32_MIN ? INT32_MIN : value;
+                }
+                dest = int32_t(value) >> shift;
+            }
+        }
+    }
+}
+
+void UsbAudio::TapBefore(const AudioHandle::RawBlock& block, void* context)
+{
+    UsbAudio* usb = static_cast<UsbAudio*>(context);
+    usb->StartBlock();
+    // record the inputs before the playback replaces them
+    if(usb->recording_ && usb->config_.source == Config::Source::INPUTS)
+        usb->Record(block, block.in);
+    if(usb->config_.sink == Config::Sink::INPUTS)
+    {
+        if(usb->playing_)
+            usb->Play(block, block.in, false);
+        else
+            usb->playback_.Flush();
+    }
+}
+
+void UsbAudio::TapAfter(const AudioHandle::RawBlock& block, void* context)
+{
+    UsbAudio* usb = static_cast<UsbAudio*>(context);
+    // record the outputs before the playback is mixed in
+    if(usb->recording_ && usb->config_.source == Config::Source::OUTPUTS)
+        usb->Record(block, block.out);
+    if(usb->config_.sink == Config::Sink::OUTPUTS)
+    {
+        if(usb->playing_)
+            usb->Play(block, block.out, true);
+        else
+            usb->playback_.Flush();
+    }
+}
+
+// USB side, from the USB interrupt
+
+void UsbAudio::OnStreamChanged(uint8_t is_out, uint8_t active)
+{
+    UsbAudio* usb = instance_;
+    if(is_out)
+    {
+        usb->feedback_.Reset();
+        usb->playing_ = active != 0;
+    }
+    else
+    {
+        // the USB side reads the recording
+        usb->record_.Flush();
+        usb->pacer_.Reset();
+        usb->recording_ = active != 0;
+    }
+}
+
+void UsbAudio::OnReceived(const uint8_t* data, uint32_t size)
+{
+    UsbAudio*    usb   = instance_;
+    const size_t frame = usb->subslot_size_ * usb->config_.playback_channels;
+    usb->playback_.WritePcm(data, size / frame, usb->subslot_size_);
+}
+
+void UsbAudio::OnSof()
+{
+    UsbAudio* usb = instance_;
+    if(usb->num_blocks_ == 0)
+        return; // no audio yet, keep the nominal rate
+
+    // interpolate the position of the audio clock within the block
+    const uint32_t tick  = System::GetTick();
+    const float    ticks = float(tick - usb->clock_.GetBlockStartTick());
+    float          into  = ticks / usb->clock_.GetTicksPerSample();
+    into                 = into < 0.f ? 0.f : into;
+    into = into > float(usb->block_size_) ? float(usb->block_size_) : into;
+    const uint32_t position
+        = (usb->num_blocks_ - 1) * uint32_t(usb->block_size_) * 256
+          + uint32_t(into * 256.f);
+    usb->meter_.OnSof(position);
+
+    if(usb->playing_)
+        usb->feedback_.Update(usb->meter_.GetRate(), usb->playback_.GetFill());
+}
+
+uint32_t UsbAudio::GetFeedback()
+{
+    return UsbAudioFeedback::ToFullSpeed(instance_->feedback_.GetFeedback());
+}
+
+uint32_t UsbAudio::FillPacket(uint8_t* data, uint32_t max_size)
+{
+    UsbAudio*    usb   = instance_;
+    const size_t frame = usb->subslot_size_ * usb->config_.record_channels;
+    const size_t fill  = usb->record_.GetFill();
+    size_t       size  = usb->pacer_.Next(usb->meter_.GetRate(), fill);
+    size               = size * frame > max_size ? max_size / frame : size;
+    usb->record_.ReadPcm(data, size, usb->subslot_size_);
+    return uint32_t(size * frame);
+}
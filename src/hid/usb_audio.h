@@ -0,0 +1,164 @@
+#pragma once
+#ifndef DSY_USB_AUDIO_H
+#define DSY_USB_AUDIO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "hid/audio.h"
+#include "util/GateTiming.h"
+#include "util/UsbAudioSync.h"
+
+namespace daisy
+{
+/** @addtogroup human_interface
+    @{
+    */
+
+/** @brief USB Audio Class 2.0 device that streams the AudioHandle channels
+ *
+ *  The Daisy shows up as an audio interface. The host records a stream
+ *  of the codec outputs (or inputs), and its playback is mixed into the
+ *  outputs (or replaces the inputs the audio callback sees). Both are
+ *  class compliant, no driver is needed on macOS, Linux or Windows 10 and
+ *  later.
+ *
+ *  The streams are asynchronous, the audio clock of the codec is the
+ *  master. Its rate is measured against the USB frames, the host is told
+ *  how many samples to send through a feedback endpoint, and the recorded
+ *  packets carry as many samples as the codec produced. See
+ *  util/UsbAudioSync.h for the control loops.
+ *
+ *  Samples go straight between the DMA buffers of the SAIs and the USB
+ *  packets, through AudioHandle::SetStreamTaps(), so the audio callback
+ *  is unaffected and nothing is converted to floats and back.
+ *
+ *  Usage:
+ *  @code
+ *  hw.Init();
+ *  UsbAudio::Config usb_config;
+ *  usb_audio.Init(hw.audio_handle, usb_config);
+ *  hw.StartAudio(AudioCallback);
+ *  @endcode
+ *
+ *  This takes over the USB peripheral, it can't be used for CDC or MIDI
+ *  at the same time. There can only be one UsbAudio.
+ */
+class UsbAudio
+{
+  public:
+    enum class Result
+    {
+        OK,
+        ERR,
+    };
+
+    struct Config
+    {
+        /** The USB peripheral, both run at full speed */
+        enum class Periph
+        {
+            INTERNAL,
+            EXTERNAL,
+        };
+
+        /** What the host records */
+        enum class Source
+        {
+            OUTPUTS, /**< What goes to the codecs */
+            INPUTS,  /**< What comes from the codecs */
+        };
+
+        /** Where the host playback goes */
+        enum class Sink
+        {
+            OUTPUTS, /**< Mixed into the outputs after the callback */
+            INPUTS,  /**< Replaces the inputs of the callback */
+        };
+
+        Periph periph = Periph::INTERNAL;
+        /** Channels recorded by the host, 0 to 4 */
+        uint8_t record_channels = 2;
+        /** Channels played by the host, 0 to 4 */
+        uint8_t playback_channels = 2;
+        /** Bits per sample, 16, 24 or 32. 24 bits are sent in three
+         *  bytes, which leaves room for more channels. */
+        uint8_t bit_resolution = 24;
+        Source  source         = Source::OUTPUTS;
+        Sink    sink           = Sink::OUTPUTS;
+        /** Fill of the FIFOs between USB and audio in samples per
+         *  channel, 0 for twice a block and a packet. */
+        size_t latency = 0;
+    };
+
+    /** Largest number of channels in each direction */
+    static constexpr size_t kMaxChannels = 4;
+    /** Size of the FIFOs in samples per channel */
+    static constexpr size_t kFifoFrames = 512;
+
+    UsbAudio() {}
+    ~UsbAudio() {}
+
+    /** Starts the USB device and taps into the audio. The audio handle
+     *  must be initialized, audio may already be running.
+     *  @return ERR if the streams don't fit into full speed packets, or
+     *          there aren't enough channels
+     */
+    Result Init(AudioHandle& audio, const Config& config);
+
+    /** @return true while the host plays */
+    bool IsPlaying() const { return playing_; }
+
+    /** @return true while the host records */
+    bool IsRecording() const { return recording_; }
+
+    /** @return the measured sample rate in samples per USB frame */
+    float GetMeasuredRate() const { return meter_.GetRate(); }
+
+    /** @return the rate the host is asked to send, samples per frame */
+    float GetFeedbackRate() const { return feedback_.GetFeedback(); }
+
+    /** @return the FIFO of the host playback, e.g. for its statistics */
+    const UsbAudioFifo& GetPlaybackFifo() const { return playback_; }
+
+    /** @return the FIFO of the host recording */
+    const UsbAudioFifo& GetRecordFifo() const { return record_; }
+
+  private:
+    static void TapBefore(const AudioHandle::RawBlock& block, void* context);
+    static void TapAfter(const AudioHandle::RawBlock& block, void* context);
+
+    static void     OnStreamChanged(uint8_t is_out, uint8_t active);
+    static void     OnReceived(const uint8_t* data, uint32_t size);
+    static void     OnSof();
+    static uint32_t GetFeedback();
+    static uint32_t FillPacket(uint8_t* data, uint32_t max_size);
+
+    void StartBlock();
+    void Record(const AudioHandle::RawBlock& block, int32_t* const* buffers);
+    void Play(const AudioHandle::RawBlock& block,
+              int32_t* const*              buffers,
+              bool                         mix);
+
+    static UsbAudio* instance_;
+
+    Config            config_;
+    size_t            subslot_size_;
+    size_t            block_size_;
+    AudioBlockClock   clock_;
+    volatile uint32_t num_blocks_;
+    volatile bool     playing_;
+    volatile bool     recording_;
+
+    UsbAudioRateMeter meter_;
+    UsbAudioFeedback  feedback_;
+    UsbAudioPacer     pacer_;
+    UsbAudioFifo      playback_;
+    UsbAudioFifo      record_;
+    int32_t           playback_buffer_[kFifoFrames * kMaxChannels];
+    int32_t           record_buffer_[kFifoFrames * kMaxChannels];
+};
+
+/** @} */
+} // namespace daisy
+
+#endif
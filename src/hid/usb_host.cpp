@@ -4,6 +4,8 @@
 #include "daisy_core.h"
 #include "usbh_core.h"
 #include "usbh_msc.h"
+#include "ff_gen_drv.h"
+#include "util/usbh_diskio.h"
 #include "logger.h"
 
 using namespace daisy;
@@ -116,8 +118,13 @@ USBHostHandle::Result USBHostHandle::Impl::Process()
     // abort state, re-initialize to try and clear it.
     if(hUsbHostHS.gState == HOST_ABORT_STATE)
         return Reinit();
-    else
-        return ConvertStatus(USBH_Process(&hUsbHostHS));
+
+    USBH_StatusTypeDef sta = USBH_Process(&hUsbHostHS);
+#if !defined(DSY_USBH_DISABLE_CACHE)
+    // let the drive read ahead while the application does other things
+    USBH_CachePoll();
+#endif
+    return ConvertStatus(sta);
 }
 
 USBHostHandle::Result USBHostHandle::Impl::ReEnumerate()
@@ -193,6 +200,32 @@ bool USBHostHandle::IsDeviceConnected()
     return pimpl_->IsDeviceConnected();
 }
 
+USBHostHandle::MscStats USBHostHandle::GetMscStats()
+{
+    MscStats stats = {};
+#if !defined(DSY_USBH_DISABLE_CACHE)
+    USBH_CacheStatsTypeDef cache;
+    USBH_CacheGetStats(&cache);
+    stats.cache_hits       = cache.hits;
+    stats.cache_misses     = cache.misses;
+    stats.reads            = cache.device_reads;
+    stats.writes           = cache.device_writes;
+    stats.sectors_read     = cache.sectors_read;
+    stats.sectors_written  = cache.sectors_written;
+    stats.read_aheads      = cache.read_aheads;
+    stats.read_throughput  = cache.read_throughput;
+    stats.write_throughput = cache.write_throughput;
+#endif
+    return stats;
+}
+
+void USBHostHandle::ResetMscStats()
+{
+#if !defined(DSY_USBH_DISABLE_CACHE)
+    USBH_CacheResetStats();
+#endif
+}
+
 // Shared USB IRQ Handlers are located in sys/System.cpps
 
 // This isn't super useful for our typical code structure
@@ -221,6 +254,10 @@ static void USBH_UserProcess(USBH_HandleTypeDef* phost, uint8_t id)
             break;
         case HOST_USER_DISCONNECTION:
             Appli_state = APPLICATION_DISCONNECT;
+#if !defined(DSY_USBH_DISABLE_CACHE)
+            // whatever wasn't flushed can't be written anymore
+            USBH_CacheInvalidate();
+#endif
             if(conf.disconnect_callback)
             {
                 auto cb = (conf.disconnect_callback);
@@ -85,6 +85,25 @@ class USBHostHandle
         void*               userdata;
     };
 
+    /** @brief Transfer statistics of a mass storage device
+     *
+     *  FatFs accesses the drive through a sector cache that reads lines
+     *  of consecutive sectors with one command, and reads the next line
+     *  of a stream ahead in the background while Process() is called.
+     */
+    struct MscStats
+    {
+        uint32_t cache_hits;       /**< Sectors read from the cache */
+        uint32_t cache_misses;     /**< Sectors that required a read */
+        uint32_t reads;            /**< Read commands sent to the drive */
+        uint32_t writes;           /**< Write commands sent to the drive */
+        uint32_t sectors_read;     /**< Sectors read from the drive */
+        uint32_t sectors_written;  /**< Sectors written to the drive */
+        uint32_t read_aheads;      /**< Lines read in the background */
+        float    read_throughput;  /**< Bytes per second read */
+        float    write_throughput; /**< Bytes per second written */
+    };
+
     /**
      * Register a USB class
      */
@@ -106,7 +125,8 @@ class USBHostHandle
      */
     bool IsActiveClass(USBH_ClassTypeDef* usbClass);
 
-    /** Manages usb host functionality
+    /** Manages usb host functionality, and completes reads ahead of
+     *  the mass storage cache in the background
      *
      */
     Result Process();
@@ -136,6 +156,13 @@ class USBHostHandle
     /** @brief Returns if the ST Middleware detects a connected device */
     bool IsDeviceConnected();
 
+    /** @brief Returns the transfer statistics of the mass storage device
+     *  since startup or the last ResetMscStats() */
+    MscStats GetMscStats();
+
+    /** @brief Resets the transfer statistics of the mass storage device */
+    void ResetMscStats();
+
     USBHostHandle() : pimpl_(nullptr) {}
     USBHostHandle(const USBHostHandle& other) = default;
     USBHostHandle& operator=(const USBHostHandle& other) = default;
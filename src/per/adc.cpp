@@ -1,5 +1,6 @@
 #include <stm32h7xx_hal.h>
 #include "per/adc.h"
+#include "sys/system.h"
 
 using namespace daisy;
 
@@ -96,6 +97,10 @@ struct dsy_adc
     ADC_HandleTypeDef hadc1;
     DMA_HandleTypeDef hdma_adc1;
     bool              mux_used; // flag set when mux is configured
+    // streaming mode, with a double buffer interleaved by channel
+    bool               streaming;
+    uint16_t*          stream_buffer;
+    AdcChannelHistory* history[DSY_ADC_MAX_CHANNELS];
 };
 
 // Static Functions
@@ -203,12 +208,15 @@ void AdcHandle::Init(AdcChannelConfig* cfg,
     // Generic Init
     oversampling_ = ovs;
     // Set DMA buffers
-    num_channels_  = num_channels;
-    adc.dma_buffer = adc1_dma_buffer;
-    adc.mux_cache  = &adc1_mux_cache[0];
+    num_channels_     = num_channels;
+    adc.dma_buffer    = adc1_dma_buffer;
+    adc.mux_cache     = &adc1_mux_cache[0];
+    adc.streaming     = false;
+    adc.stream_buffer = nullptr;
     // Clear Buffers
     for(size_t i = 0; i < DSY_ADC_MAX_CHANNELS; i++)
     {
+        adc.history[i]      = nullptr;
         adc.dma_buffer[i]   = 0;
         adc.mux_channels[i] = 0; // set to 0 mux first.
         adc.mux_index[i]    = 0;
@@ -380,11 +388,32 @@ void AdcHandle::Init(AdcChannelConfig* cfg,
     }
 }
 
+void AdcHandle::InitStreaming(AdcChannelConfig*   cfg,
+                              size_t              num_channels,
+                              AdcChannelHistory** histories,
+                              uint16_t*           dma_buffer,
+                              OverSampling        ovs)
+{
+    Init(cfg, num_channels, ovs);
+    // multiplexed inputs need the one-shot DMA
+    if(adc.mux_used || dma_buffer == nullptr)
+        return;
+    adc.streaming     = true;
+    adc.stream_buffer = dma_buffer;
+    for(size_t i = 0; i < num_channels_; i++)
+        adc.history[i] = histories ? histories[i] : nullptr;
+}
+
 void AdcHandle::Start()
 {
     HAL_ADCEx_Calibration_Start(
         &adc.hadc1, ADC_CALIB_OFFSET_LINEARITY, ADC_SINGLE_ENDED);
-    HAL_ADC_Start_DMA(&adc.hadc1, (uint32_t*)adc.dma_buffer, adc.channels);
+    if(adc.streaming)
+        HAL_ADC_Start_DMA(&adc.hadc1,
+                          (uint32_t*)adc.stream_buffer,
+                          DSY_ADC_STREAM_BUFFER_SIZE(adc.channels));
+    else
+        HAL_ADC_Start_DMA(&adc.hadc1, (uint32_t*)adc.dma_buffer, adc.channels);
 }
 
 void AdcHandle::Stop()
@@ -425,6 +454,11 @@ float AdcHandle::GetMuxFloat(uint8_t chn, uint8_t idx) const
            / DSY_ADC_MAX_RESOLUTION;
 }
 
+AdcChannelHistory* AdcHandle::GetHistory(uint8_t chn) const
+{
+    return adc.history[chn < DSY_ADC_MAX_CHANNELS ? chn : 0];
+}
+
 
 // Internal Implementations
 
@@ -502,6 +536,25 @@ static void adc_internal_callback()
     HAL_ADC_Start_DMA(&adc.hadc1, (uint32_t*)adc.dma_buffer, adc.channels);
 }
 
+// Handles one half of the streaming double buffer.
+// Called from the half and full transfer complete callbacks, while the DMA
+// keeps writing to the other half.
+static void adc_stream_callback(size_t half)
+{
+    const uint16_t* frames
+        = &adc.stream_buffer[half * DSY_ADC_STREAM_FRAMES * adc.channels];
+    const uint16_t* last_frame
+        = &frames[(DSY_ADC_STREAM_FRAMES - 1) * adc.channels];
+    const uint32_t tick = System::GetTick();
+    for(size_t i = 0; i < adc.channels; i++)
+    {
+        if(adc.history[i])
+            adc.history[i]->PushBlock(
+                &frames[i], DSY_ADC_STREAM_FRAMES, adc.channels, tick);
+        // keep Get() and GetPtr() up to date
+        adc.dma_buffer[i] = last_frame[i];
+    }
+}
 
 // STM32 HAL function callbacks
 void HAL_ADC_MspInit(ADC_HandleTypeDef* adcHandle)
@@ -536,9 +589,21 @@ extern "C"
 {
     void DMA1_Stream2_IRQHandler(void) { HAL_DMA_IRQHandler(&adc.hdma_adc1); }
 
+    void HAL_ADC_ConvHalfCpltCallback(ADC_HandleTypeDef* hadc)
+    {
+        if(hadc->Instance == ADC1 && adc.streaming)
+        {
+            adc_stream_callback(0);
+        }
+    }
+
     void HAL_ADC_ConvCpltCallback(ADC_HandleTypeDef* hadc)
     {
-        if(hadc->Instance == ADC1 && adc.mux_used)
+        if(hadc->Instance == ADC1 && adc.streaming)
+        {
+            adc_stream_callback(1);
+        }
+        else if(hadc->Instance == ADC1 && adc.mux_used)
         {
             adc_internal_callback();
         }
@@ -5,8 +5,14 @@
 #include <stdlib.h>
 #include "daisy_core.h"
 #include "per/gpio.h"
+#include "util/AdcHistory.h"
 
 #define DSY_ADC_MAX_CHANNELS 16 /**< Maximum number of ADC channels */
+/** Number of conversions per channel in each half of the streaming DMA buffer */
+#define DSY_ADC_STREAM_FRAMES 32
+/** Size in samples of the DMA buffer passed to AdcHandle::InitStreaming() */
+#define DSY_ADC_STREAM_BUFFER_SIZE(num_channels) \
+    ((num_channels)*DSY_ADC_STREAM_FRAMES * 2)
 
 namespace daisy
 {
@@ -117,6 +123,36 @@ class AdcHandle
     void
     Init(AdcChannelConfig *cfg, size_t num_channels, OverSampling ovs = OVS_32);
 
+    /**
+    Initializes the ADC in streaming mode. The DMA continuously writes
+    into a double buffer and every conversion is pushed into a per-channel
+    AdcChannelHistory, each with its own ring size and decimation. This
+    allows e.g. CV inputs to be recorded at several kHz while pots are
+    decimated heavily.
+    The hardware oversampling (`ovs`) applies to all channels and
+    determines the input rate of the histories.
+    Get() and GetPtr() keep returning the latest conversion.
+    Multiplexed inputs are not supported in this mode. If any channel
+    uses a mux, the ADC falls back to the regular mode.
+    \param *cfg an array of AdcChannelConfig of the desired channel
+    \param num_channels number of ADC channels to initialize
+    \param histories an array of `num_channels` pointers to the history of
+           each channel. Initialize them before starting the ADC.
+           Channels with a nullptr history are only available via Get().
+    \param dma_buffer the double buffer written by the DMA, with
+           DSY_ADC_STREAM_BUFFER_SIZE(num_channels) samples. It must be
+           in the DMA_BUFFER_MEM_SECTION, e.g.
+           `static uint16_t DMA_BUFFER_MEM_SECTION
+           buf[DSY_ADC_STREAM_BUFFER_SIZE(4)];`
+           With a nullptr, the ADC falls back to the regular mode.
+    \param ovs Oversampling amount - Defaults to OVS_4
+    */
+    void InitStreaming(AdcChannelConfig*   cfg,
+                       size_t              num_channels,
+                       AdcChannelHistory** histories,
+                       uint16_t*           dma_buffer,
+                       OverSampling        ovs = OVS_4);
+
     /** Starts reading from the ADC */
     void Start();
 
@@ -168,6 +204,13 @@ class AdcHandle
     */
     float GetMuxFloat(uint8_t chn, uint8_t idx) const;
 
+    /**
+       Returns the history of a channel in streaming mode
+       \param chn Channel to get from
+       \return The history passed to InitStreaming() or nullptr
+    */
+    AdcChannelHistory* GetHistory(uint8_t chn) const;
+
   private:
     OverSampling oversampling_;
     size_t       num_channels_;
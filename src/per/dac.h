@@ -17,6 +17,9 @@ namespace daisy
  ** Since the DAC channels have dedicated pins we don't need to pass in a pin config like with
  ** other modules. However, it is still important to not try to use the DAC pins for anything else.
  ** DAC Channel 1 is on PA4, and DAC Channel 2 is on PA5
+ **
+ ** To output calibrated voltages in sync with the audio callback, pass the
+ ** buffers of the DacCallback on to a DacStream (util/DacStream.h).
  ***/
 class DacHandle
 {
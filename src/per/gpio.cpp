@@ -3,6 +3,47 @@
 
 using namespace daisy;
 
+static GPIO_TypeDef *GetPortBase(GPIOPort port)
+{
+    switch(port)
+    {
+        case PORTA: return GPIOA;
+        case PORTB: return GPIOB;
+        case PORTC: return GPIOC;
+        case PORTD: return GPIOD;
+        case PORTE: return GPIOE;
+        case PORTF: return GPIOF;
+        case PORTG: return GPIOG;
+        case PORTH: return GPIOH;
+        case PORTI: return GPIOI;
+        case PORTJ: return GPIOJ;
+        case PORTK: return GPIOK;
+        default: return NULL;
+    }
+}
+
+/** Callbacks of the 16 EXTI lines, see GPIO::EnableInterrupt() */
+struct ExtiHandler
+{
+    GPIO::InterruptCallback callback;
+    void                   *context;
+    GPIOPort                port;
+};
+static ExtiHandler exti_handlers[16];
+
+static IRQn_Type GetExtiIrq(uint8_t line)
+{
+    switch(line)
+    {
+        case 0: return EXTI0_IRQn;
+        case 1: return EXTI1_IRQn;
+        case 2: return EXTI2_IRQn;
+        case 3: return EXTI3_IRQn;
+        case 4: return EXTI4_IRQn;
+        default: return line < 10 ? EXTI9_5_IRQn : EXTI15_10_IRQn;
+    }
+}
+
 void GPIO::Init(const Config &cfg)
 {
     /** Copy Config */
@@ -90,6 +131,71 @@ bool GPIO::Read()
     return HAL_GPIO_ReadPin((GPIO_TypeDef *)port_base_addr_,
                             (1 << cfg_.pin.pin));
 }
+uint16_t GPIO::ReadPort(GPIOPort port)
+{
+    GPIO_TypeDef *base = GetPortBase(port);
+    return base != NULL ? base->IDR & 0xffff : 0;
+}
+bool GPIO::EnableInterrupt(Edge              edge,
+                           InterruptCallback callback,
+                           void             *context,
+                           uint8_t           priority)
+{
+    if(!cfg_.pin.IsValid() || callback == nullptr)
+        return false;
+    const uint8_t line    = cfg_.pin.pin;
+    ExtiHandler  &handler = exti_handlers[line];
+    if(handler.callback != nullptr && handler.port != cfg_.pin.port)
+        return false;
+
+    // Route the EXTI line to this port. The pin stays an input.
+    GPIO_InitTypeDef ginit;
+    ginit.Pin = (1 << line);
+    switch(edge)
+    {
+        case Edge::RISING: ginit.Mode = GPIO_MODE_IT_RISING; break;
+        case Edge::FALLING: ginit.Mode = GPIO_MODE_IT_FALLING; break;
+        case Edge::BOTH:
+        default: ginit.Mode = GPIO_MODE_IT_RISING_FALLING; break;
+    }
+    switch(cfg_.pull)
+    {
+        case Pull::PULLUP: ginit.Pull = GPIO_PULLUP; break;
+        case Pull::PULLDOWN: ginit.Pull = GPIO_PULLDOWN; break;
+        case Pull::NOPULL:
+        default: ginit.Pull = GPIO_NOPULL;
+    }
+    ginit.Speed = GPIO_SPEED_FREQ_LOW;
+
+    const IRQn_Type irq = GetExtiIrq(line);
+    HAL_NVIC_DisableIRQ(irq);
+    handler.callback = callback;
+    handler.context  = context;
+    handler.port     = cfg_.pin.port;
+    HAL_GPIO_Init((GPIO_TypeDef *)port_base_addr_, &ginit);
+    __HAL_GPIO_EXTI_CLEAR_IT(1 << line);
+    HAL_NVIC_SetPriority(irq, priority, 0);
+    HAL_NVIC_EnableIRQ(irq);
+    return true;
+}
+
+void GPIO::DisableInterrupt()
+{
+    const uint8_t line    = cfg_.pin.pin;
+    ExtiHandler  &handler = exti_handlers[line];
+    if(!cfg_.pin.IsValid() || handler.port != cfg_.pin.port)
+        return;
+    EXTI_D1->IMR1 &= ~(1 << line);
+    __HAL_GPIO_EXTI_CLEAR_IT(1 << line);
+    handler.callback = nullptr;
+}
+
+bool GPIO::IsInterruptPending() const
+{
+    return cfg_.pin.IsValid()
+           && __HAL_GPIO_EXTI_GET_IT(1 << cfg_.pin.pin) != 0;
+}
+
 void GPIO::Write(bool state)
 {
     HAL_GPIO_WritePin((GPIO_TypeDef *)port_base_addr_,
@@ -103,19 +209,33 @@ void GPIO::Toggle()
 
 uint32_t *GPIO::GetGPIOBaseRegister()
 {
-    switch(cfg_.pin.port)
+    return (uint32_t *)GetPortBase(cfg_.pin.port);
+}
+
+static void HandleExti(uint8_t first, uint8_t last)
+{
+    for(uint8_t line = first; line <= last; line++)
     {
-        case PORTA: return (uint32_t *)GPIOA;
-        case PORTB: return (uint32_t *)GPIOB;
-        case PORTC: return (uint32_t *)GPIOC;
-        case PORTD: return (uint32_t *)GPIOD;
-        case PORTE: return (uint32_t *)GPIOE;
-        case PORTF: return (uint32_t *)GPIOF;
-        case PORTG: return (uint32_t *)GPIOG;
-        case PORTH: return (uint32_t *)GPIOH;
-        case PORTI: return (uint32_t *)GPIOI;
-        case PORTJ: return (uint32_t *)GPIOJ;
-        case PORTK: return (uint32_t *)GPIOK;
-        default: return NULL;
+        const uint32_t mask = 1 << line;
+        if(__HAL_GPIO_EXTI_GET_IT(mask) == 0)
+            continue;
+        __HAL_GPIO_EXTI_CLEAR_IT(mask);
+        const ExtiHandler &handler = exti_handlers[line];
+        if(handler.callback != nullptr)
+            handler.callback(handler.context);
     }
 }
+
+// Define DSY_NO_EXTI_HANDLERS to handle the EXTI interrupts yourself
+#ifndef DSY_NO_EXTI_HANDLERS
+extern "C"
+{
+    void EXTI0_IRQHandler() { HandleExti(0, 0); }
+    void EXTI1_IRQHandler() { HandleExti(1, 1); }
+    void EXTI2_IRQHandler() { HandleExti(2, 2); }
+    void EXTI3_IRQHandler() { HandleExti(3, 3); }
+    void EXTI4_IRQHandler() { HandleExti(4, 4); }
+    void EXTI9_5_IRQHandler() { HandleExti(5, 9); }
+    void EXTI15_10_IRQHandler() { HandleExti(10, 15); }
+}
+#endif
@@ -54,6 +54,19 @@ class GPIO
         VERY_HIGH,
     };
 
+    /** @brief Edges that trigger an interrupt, see EnableInterrupt() */
+    enum class Edge
+    {
+        RISING,
+        FALLING,
+        BOTH,
+    };
+
+    /** @brief Called from the EXTI interrupt on an edge of the pin
+     *  @param context pointer to arbitrary user-provided data
+     */
+    typedef void (*InterruptCallback)(void *context);
+
     /** @brief Configuration for a given GPIO */
     struct Config
     {
@@ -107,6 +120,14 @@ class GPIO
      */
     bool Read();
 
+    /** @brief Reads the state of all 16 pins of a GPIO port at once.
+     *  Bit n is the state of pin n, regardless of the pins' modes.
+     *  This is a single register read, which makes it a cheap way to feed
+     *  many inputs on one port to an InputDebouncer.
+     *  @param port The port to read
+     */
+    static uint16_t ReadPort(GPIOPort port);
+
     /** @brief Changes the state of the GPIO hardware when configured as an OUTPUT. 
      *  @param state setting true writes an output HIGH, while setting false writes an output LOW.
      */
@@ -117,6 +138,32 @@ class GPIO
      */
     void Toggle();
 
+    /** @brief Calls `callback` from the EXTI interrupt on edges of the pin.
+     *  The pin keeps working as an input and can still be read.
+     *  Pins with the same number on different ports (e.g. PA3 and PB3) share
+     *  one EXTI line, so only one of them can use interrupts at a time.
+     *  Not available when libDaisy is built with DSY_NO_EXTI_HANDLERS.
+     *  @param edge Edges that trigger the interrupt
+     *  @param callback Called from the interrupt
+     *  @param context Passed to the callback
+     *  @param priority NVIC preemption priority, 0 is the highest. The
+     *  default is the lowest, so the callback never delays the audio DMA.
+     *  Lines 5-9 and 10-15 share one interrupt and its priority.
+     *  @return false if the line is already used by another port
+     */
+    bool EnableInterrupt(Edge              edge,
+                         InterruptCallback callback,
+                         void             *context  = nullptr,
+                         uint8_t           priority = 0x0f);
+
+    /** @brief Stops calling the callback set with EnableInterrupt() */
+    void DisableInterrupt();
+
+    /** @return true if an edge is waiting for the EXTI interrupt, e.g. to
+     *  tell from the callback if the pin changed again since it was called
+     */
+    bool IsInterruptPending() const;
+
     /** Return a reference to the internal Config struct */
     Config &GetConfig() { return cfg_; }
 
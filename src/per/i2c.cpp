@@ -40,6 +40,15 @@ class I2CHandle::Impl
                                         uint16_t data_size,
                                         uint32_t timeout);
 
+    I2CHandle::Result
+    ReadDataAtAddressDma(uint16_t                       address,
+                         uint16_t                       mem_address,
+                         uint16_t                       mem_address_size,
+                         uint8_t*                       data,
+                         uint16_t                       data_size,
+                         I2CHandle::CallbackFunctionPtr callback,
+                         void*                          callback_context);
+
     I2CHandle::Result WriteDataAtAddress(uint16_t address,
                                          uint16_t mem_address,
                                          uint16_t mem_address_size,
@@ -57,6 +66,9 @@ class I2CHandle::Impl
         I2CHandle::CallbackFunctionPtr callback         = nullptr;
         void*                          callback_context = nullptr;
         I2CHandle::Direction direction = I2CHandle::Direction::TRANSMIT;
+        // receptions with a memory address size > 0 read from that address
+        uint16_t mem_address      = 0;
+        uint16_t mem_address_size = 0;
 
         bool IsValidJob() const { return data != nullptr; }
         void Invalidate() { data = nullptr; }
@@ -64,7 +76,7 @@ class I2CHandle::Impl
     static void GlobalInit();
     static bool IsDmaActive();
     static bool IsDmaTransferQueuedFor(size_t i2c_peripheral_idx);
-    static void QueueDmaTransfer(size_t i2c_peripheral_idx, const DmaJob& job);
+    static bool QueueDmaTransfer(size_t i2c_peripheral_idx, const DmaJob& job);
     static void DmaTransferFinished(I2C_HandleTypeDef* hal_i2c_handle,
                                     I2CHandle::Result  result);
 
@@ -88,6 +100,8 @@ class I2CHandle::Impl
                          void*                          callback_context);
 
     I2CHandle::Result StartDmaReception(uint16_t                       address,
+                                        uint16_t mem_address,
+                                        uint16_t mem_address_size,
                                         uint8_t*                       data,
                                         uint16_t                       size,
                                         I2CHandle::CallbackFunctionPtr callback,
@@ -135,9 +149,14 @@ bool I2CHandle::Impl::IsDmaTransferQueuedFor(size_t i2c_peripheral_idx)
     return queued_dma_transfers_[i2c_peripheral_idx].IsValidJob();
 }
 
-void I2CHandle::Impl::QueueDmaTransfer(size_t i2c_peripheral_idx,
+bool I2CHandle::Impl::QueueDmaTransfer(size_t i2c_peripheral_idx,
                                        const I2CHandle::Impl::DmaJob& job)
 {
+    // in an interrupt, e.g. the callback of a transfer, the queue
+    // can't drain while we wait - fail instead of locking up
+    if(__get_IPSR() != 0 && IsDmaTransferQueuedFor(i2c_peripheral_idx))
+        return false;
+
     // wait for any previous job on this peripheral to finish
     // and the queue position to bevome free
     while(IsDmaTransferQueuedFor(i2c_peripheral_idx)) {};
@@ -145,6 +164,7 @@ void I2CHandle::Impl::QueueDmaTransfer(size_t i2c_peripheral_idx,
     // queue the job
     ScopedIrqBlocker block;
     queued_dma_transfers_[i2c_peripheral_idx] = job;
+    return true;
 }
 
 void I2CHandle::Impl::DmaTransferFinished(I2C_HandleTypeDef* hal_i2c_handle,
@@ -191,6 +211,8 @@ void I2CHandle::Impl::DmaTransferFinished(I2C_HandleTypeDef* hal_i2c_handle,
             {
                 result = i2c_handles[per].StartDmaReception(
                     queued_dma_transfers_[per].slave_address,
+                    queued_dma_transfers_[per].mem_address,
+                    queued_dma_transfers_[per].mem_address_size,
                     queued_dma_transfers_[per].data,
                     queued_dma_transfers_[per].size,
                     queued_dma_transfers_[per].callback,
@@ -330,8 +352,10 @@ I2CHandle::Impl::TransmitDma(uint16_t                       address,
         job.direction        = direction;
         job.callback         = callback;
         job.callback_context = callback_context;
-        // queue a job (blocks until the queue position is free)
-        QueueDmaTransfer(i2cIdx, job);
+        // queue a job (blocks until the queue position is free,
+        // fails if it is taken in an interrupt)
+        if(!QueueDmaTransfer(i2cIdx, job))
+            return I2CHandle::Result::ERR;
         // TODO: the user can't tell if he got returned "OK"
         // because the transfer was executed or because it was queued...
         // should we change that?
@@ -391,8 +415,10 @@ I2CHandle::Impl::ReceiveDma(uint16_t                       address,
         job.direction        = direction;
         job.callback         = callback;
         job.callback_context = callback_context;
-        // queue a job (blocks until the queue position is free)
-        QueueDmaTransfer(i2cIdx, job);
+        // queue a job (blocks until the queue position is free,
+        // fails if it is taken in an interrupt)
+        if(!QueueDmaTransfer(i2cIdx, job))
+            return I2CHandle::Result::ERR;
         // TODO: the user can't tell if he got returned "OK"
         // because the transfer was executed or because it was queued...
         // should we change that?
@@ -401,7 +427,7 @@ I2CHandle::Impl::ReceiveDma(uint16_t                       address,
     else
         // start reception right away
         return StartDmaReception(
-            address, data, size, callback, callback_context);
+            address, 0, 0, data, size, callback, callback_context);
 }
 
 I2CHandle::Result I2CHandle::Impl::ReadDataAtAddress(uint16_t address,
@@ -431,6 +457,51 @@ I2CHandle::Result I2CHandle::Impl::ReadDataAtAddress(uint16_t address,
     return I2CHandle::Result::OK;
 }
 
+I2CHandle::Result
+I2CHandle::Impl::ReadDataAtAddressDma(uint16_t address,
+                                      uint16_t mem_address,
+                                      uint16_t mem_address_size,
+                                      uint8_t* data,
+                                      uint16_t data_size,
+                                      I2CHandle::CallbackFunctionPtr callback,
+                                      void* callback_context)
+{
+    // Only master devices can make requests. I2C4 has no DMA yet.
+    if(config_.mode != I2CHandle::Config::Mode::I2C_MASTER
+       || config_.periph == I2CHandle::Config::Peripheral::I2C_4)
+        return I2CHandle::Result::ERR;
+
+    const int i2cIdx = int(config_.periph);
+
+    // if dma is currently running - queue a job
+    if(IsDmaActive())
+    {
+        DmaJob job;
+        job.slave_address    = address;
+        job.data             = data;
+        job.size             = data_size;
+        job.direction        = I2CHandle::Direction::RECEIVE;
+        job.mem_address      = mem_address;
+        job.mem_address_size = mem_address_size;
+        job.callback         = callback;
+        job.callback_context = callback_context;
+        // queue a job (blocks until the queue position is free,
+        // fails if it is taken in an interrupt)
+        if(!QueueDmaTransfer(i2cIdx, job))
+            return I2CHandle::Result::ERR;
+        return I2CHandle::Result::OK;
+    }
+    else
+        // start reception right away
+        return StartDmaReception(address,
+                                 mem_address,
+                                 mem_address_size,
+                                 data,
+                                 data_size,
+                                 callback,
+                                 callback_context);
+}
+
 I2CHandle::Result I2CHandle::Impl::WriteDataAtAddress(uint16_t address,
                                                       uint16_t mem_address,
                                                       uint16_t mem_address_size,
@@ -536,6 +607,8 @@ I2CHandle::Impl::StartDmaTransmission(uint16_t                       address,
 
 I2CHandle::Result
 I2CHandle::Impl::StartDmaReception(uint16_t                       address,
+                                   uint16_t                       mem_address,
+                                   uint16_t mem_address_size,
                                    uint8_t*                       data,
                                    uint16_t                       size,
                                    I2CHandle::CallbackFunctionPtr callback,
@@ -586,7 +659,20 @@ I2CHandle::Impl::StartDmaReception(uint16_t                       address,
     next_callback_context_ = callback_context;
 
     HAL_StatusTypeDef status;
-    if(config_.mode == I2CHandle::Config::Mode::I2C_MASTER)
+    if(config_.mode == I2CHandle::Config::Mode::I2C_MASTER
+       && mem_address_size > 0)
+    {
+        const uint16_t mem_add_size = mem_address_size == 2
+                                          ? I2C_MEMADD_SIZE_16BIT
+                                          : I2C_MEMADD_SIZE_8BIT;
+        status = HAL_I2C_Mem_Read_DMA(&i2c_hal_handle_,
+                                      address << 1,
+                                      mem_address,
+                                      mem_add_size,
+                                      data,
+                                      size);
+    }
+    else if(config_.mode == I2CHandle::Config::Mode::I2C_MASTER)
     {
         status = HAL_I2C_Master_Receive_DMA(
             &i2c_hal_handle_, address << 1, data, size);
@@ -777,6 +863,11 @@ extern "C" void HAL_I2C_MasterRxCpltCallback(I2C_HandleTypeDef* i2c_handle)
     I2CHandle::Impl::DmaTransferFinished(i2c_handle, I2CHandle::Result::OK);
 }
 
+extern "C" void HAL_I2C_MemRxCpltCallback(I2C_HandleTypeDef* i2c_handle)
+{
+    I2CHandle::Impl::DmaTransferFinished(i2c_handle, I2CHandle::Result::OK);
+}
+
 extern "C" void HAL_I2C_SlaveTxCpltCallback(I2C_HandleTypeDef* i2c_handle)
 {
     I2CHandle::Impl::DmaTransferFinished(i2c_handle, I2CHandle::Result::OK);
@@ -855,6 +946,24 @@ I2CHandle::Result I2CHandle::ReadDataAtAddress(uint16_t address,
         address, mem_address, mem_address_size, data, data_size, timeout);
 }
 
+I2CHandle::Result
+I2CHandle::ReadDataAtAddressDma(uint16_t            address,
+                                uint16_t            mem_address,
+                                uint16_t            mem_address_size,
+                                uint8_t*            data,
+                                uint16_t            data_size,
+                                CallbackFunctionPtr callback,
+                                void*               callback_context)
+{
+    return pimpl_->ReadDataAtAddressDma(address,
+                                        mem_address,
+                                        mem_address_size,
+                                        data,
+                                        data_size,
+                                        callback,
+                                        callback_context);
+}
+
 I2CHandle::Result I2CHandle::WriteDataAtAddress(uint16_t address,
                                                 uint16_t mem_address,
                                                 uint16_t mem_address_size,
@@ -1,7 +1,10 @@
 #pragma once
-#include "util/hal_map.h"
 #include "daisy_core.h"
 
+#if !UNIT_TEST
+#include "util/hal_map.h"
+#endif
+
 namespace daisy
 {
 /** A handle for interacting with an I2C peripheral. This is a dumb
@@ -130,7 +133,8 @@ class I2CHandle
      *  A single DMA is shared across I2C1, I2C2 and I2C3. I2C4 has no DMA support (yet).
      *  If the DMA is busy with another transfer, the job will be queued and executed later.
      *  If there is a job waiting to be executed for this I2C peripheral, this function
-     *  will block until the queue is free and the job can be queued.
+     *  will block until the queue is free and the job can be queued. When called from
+     *  an interrupt, e.g. a transfer callback, it returns an error instead.
      * 
      *  \param address      The slave device address. Unused in slave mode.
      *  \param data         A pointer to the data to be sent.
@@ -155,7 +159,8 @@ class I2CHandle
      *  A single DMA is shared across I2C, I2C2 and I2C3. I2C4 has no DMA support (yet).
      *  If the DMA is busy with another transfer, the job will be queued and executed later.
      *  If there is a job waiting to be executed for this I2C peripheral, this function
-     *  will block until the queue is free and the job can be queued.
+     *  will block until the queue is free and the job can be queued. When called from
+     *  an interrupt, e.g. a transfer callback, it returns an error instead.
      * 
      *  \param address      The slave device address. Unused in slave mode.
      *  \param data         A pointer to the data buffer.
@@ -193,6 +198,28 @@ class I2CHandle
                              uint16_t data_size,
                              uint32_t timeout);
 
+    /** Reads an amount of data from a specific memory address / register
+    *   with a DMA and returns immediately. The memory address is sent with a
+    *   repeated start before the read, like `ReadDataAtAddress`. The same
+    *   requirements for the data buffer and the same queueing apply as for
+    *   `ReceiveDma`. Only available in master mode.
+    * 
+    * \param address            The slave device address.
+    * \param mem_address        The address to read from the device.
+    * \param mem_address_size   Size of the memory address in bytes (either 1 or 2).
+    * \param data               Pointer to buffer that will be filled with contents at mem_address
+    * \param data_size          Size of the data to be read in bytes.
+    * \param callback           A callback to execute when the transfer finishes, or NULL.
+    * \param callback_context   A pointer that will be passed back to you in the callback.
+    */
+    Result ReadDataAtAddressDma(uint16_t            address,
+                                uint16_t            mem_address,
+                                uint16_t            mem_address_size,
+                                uint8_t*            data,
+                                uint16_t            data_size,
+                                CallbackFunctionPtr callback,
+                                void*               callback_context);
+
     /** Writes an amount of data to a specific memory address / register. 
     *   This method will return an error if the I2C peripheral is in slave mode. 
     *   This method is equivalent to calling `TransmitBlocking` to send `mem_address`, followed 
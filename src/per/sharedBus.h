@@ -0,0 +1,136 @@
+#pragma once
+#ifndef DSY_SHARED_BUS_H
+#define DSY_SHARED_BUS_H
+
+#include "daisy_core.h"
+#include "per/i2c.h"
+#include "per/spiMultislave.h"
+#include "util/BusScheduler.h"
+
+namespace daisy
+{
+/** @addtogroup serial
+@{
+*/
+
+/** Runs BusScheduler transactions on an I2C peripheral with DMA. The
+ *  device of a transaction is the 7 bit I2C address. A write of a 1 or 2
+ *  byte register address followed by a read is a single combined transfer
+ *  with a repeated start (`I2CHandle::ReadDataAtAddressDma()`); other
+ *  transactions with both a write and a read are rejected.
+ */
+class I2CBusAdapter
+{
+  public:
+    using Callback = void (*)(void* context, bool success);
+
+    I2CBusAdapter() {}
+
+    void Init(I2CHandle i2c) { i2c_ = i2c; }
+
+    bool Start(uint16_t device,
+               uint8_t* tx,
+               size_t   txSize,
+               uint8_t* rx,
+               size_t   rxSize,
+               Callback callback,
+               void*    context)
+    {
+        callback_ = callback;
+        context_  = context;
+        I2CHandle::Result result;
+        if(txSize > 0 && rxSize > 0)
+        {
+            if(txSize > 2)
+                return false;
+            // the register address is sent MSB first
+            const uint16_t reg = txSize == 2 ? (tx[0] << 8) | tx[1] : tx[0];
+            result             = i2c_.ReadDataAtAddressDma(
+                device, reg, txSize, rx, rxSize, &EndCallback, this);
+        }
+        else if(txSize > 0)
+            result = i2c_.TransmitDma(device, tx, txSize, &EndCallback, this);
+        else
+            result = i2c_.ReceiveDma(device, rx, rxSize, &EndCallback, this);
+        return result == I2CHandle::Result::OK;
+    }
+
+  private:
+    static void EndCallback(void* context, I2CHandle::Result result)
+    {
+        auto adapter = static_cast<I2CBusAdapter*>(context);
+        adapter->callback_(adapter->context_,
+                           result == I2CHandle::Result::OK);
+    }
+
+    I2CHandle i2c_;
+    Callback  callback_;
+    void*     context_;
+};
+
+/** Runs BusScheduler transactions on a MultiSlaveSpiHandle with DMA. The
+ *  device of a transaction is the chip select index. Transactions with
+ *  both `tx` and `rx` are full duplex and must have the same size.
+ */
+class MultiSlaveSpiBusAdapter
+{
+  public:
+    using Callback = void (*)(void* context, bool success);
+
+    MultiSlaveSpiBusAdapter() {}
+
+    void Init(MultiSlaveSpiHandle& spi) { spi_ = &spi; }
+
+    bool Start(uint16_t device,
+               uint8_t* tx,
+               size_t   txSize,
+               uint8_t* rx,
+               size_t   rxSize,
+               Callback callback,
+               void*    context)
+    {
+        callback_ = callback;
+        context_  = context;
+        SpiHandle::Result result;
+        if(tx != nullptr && rx != nullptr)
+        {
+            if(txSize != rxSize)
+                return false;
+            result = spi_->DmaTransmitAndReceive(
+                device, tx, rx, txSize, nullptr, &EndCallback, this);
+        }
+        else if(tx != nullptr)
+            result = spi_->DmaTransmit(
+                device, tx, txSize, nullptr, &EndCallback, this);
+        else
+            result = spi_->DmaReceive(
+                device, rx, rxSize, nullptr, &EndCallback, this);
+        return result == SpiHandle::Result::OK;
+    }
+
+  private:
+    static void EndCallback(void* context, SpiHandle::Result result)
+    {
+        auto adapter = static_cast<MultiSlaveSpiBusAdapter*>(context);
+        adapter->callback_(adapter->context_,
+                           result == SpiHandle::Result::OK);
+    }
+
+    MultiSlaveSpiHandle* spi_ = nullptr;
+    Callback             callback_;
+    void*                context_;
+};
+
+/** Transaction scheduler for a shared I2C bus */
+template <size_t maxQueued = 16, size_t maxPeriodic = 8>
+using I2CBusScheduler = BusScheduler<I2CBusAdapter, maxQueued, maxPeriodic>;
+
+/** Transaction scheduler for a shared SPI bus */
+template <size_t maxQueued = 16, size_t maxPeriodic = 8>
+using SpiBusScheduler
+    = BusScheduler<MultiSlaveSpiBusAdapter, maxQueued, maxPeriodic>;
+
+/** @} */
+} // namespace daisy
+
+#endif // ifndef DSY_SHARED_BUS_H
@@ -3,7 +3,9 @@
 #define DSY_TIM_H
 
 #include <cstdint>
+#if !UNIT_TEST
 #include "stm32h7xx_hal.h"
+#endif
 
 namespace daisy
 {
@@ -94,6 +94,8 @@ class UartHandler::Impl
      */
     bool IsListening() const;
 
+    Result SetRxTimeout(uint32_t bits);
+
 
     Result StartDmaTx(uint8_t*                 buff,
                       size_t                   size,
@@ -128,6 +130,7 @@ class UartHandler::Impl
 
     static constexpr uint8_t      kNumUartWithDma = 9;
     static volatile int8_t        dma_active_peripheral_;
+    static volatile int8_t        listen_peripheral_;
     static UartDmaJob             queued_dma_transfers_[kNumUartWithDma];
     static EndCallbackFunctionPtr next_end_callback_;
     static void*                  next_callback_context_;
@@ -142,6 +145,8 @@ class UartHandler::Impl
     size_t                        circular_rx_total_size_;
     size_t                        circular_rx_last_pos_;
     bool                          listener_mode_;
+    uint32_t                      rx_timeout_bits_;
+    volatile bool                 rx_idle_;
 
     Config             config_;
     UART_HandleTypeDef huart_;
@@ -183,6 +188,7 @@ void UartHandler::Impl::GlobalInit()
 {
     // init the scheduler queue
     dma_active_peripheral_ = -1;
+    listen_peripheral_     = -1;
     for(int per = 0; per < kNumUartWithDma; per++)
         queued_dma_transfers_[per] = UartHandler::Impl::UartDmaJob();
 }
@@ -275,11 +281,33 @@ UartHandler::Result UartHandler::Impl::Init(const UartHandler::Config& config)
     }
 
     /** New listener mode to replace old "Fifo" stuff */
-    listener_mode_ = false;
+    listener_mode_   = false;
+    rx_timeout_bits_ = 0;
+    rx_idle_         = false;
 
     return Result::OK;
 }
 
+UartHandler::Result UartHandler::Impl::SetRxTimeout(uint32_t bits)
+{
+    // the receiver timeout isn't available on the LPUART
+    if(config_.periph == Config::Peripheral::LPUART_1)
+        return Result::ERR;
+    // the counter is 24 bits wide
+    rx_timeout_bits_ = bits < 0xffffff ? bits : 0xffffff;
+    HAL_StatusTypeDef status;
+    if(rx_timeout_bits_ > 0)
+    {
+        HAL_UART_ReceiverTimeout_Config(&huart_, rx_timeout_bits_);
+        status = HAL_UART_EnableReceiverTimeout(&huart_);
+    }
+    else
+    {
+        status = HAL_UART_DisableReceiverTimeout(&huart_);
+    }
+    return status == HAL_OK ? Result::OK : Result::ERR;
+}
+
 
 UartHandler::Result UartHandler::Impl::SetDmaPeripheral()
 {
@@ -326,29 +354,21 @@ UartHandler::Result UartHandler::Impl::SetDmaPeripheral()
 
 UartHandler::Result UartHandler::Impl::InitDma(bool rx, bool tx)
 {
-    hdma_rx_.Instance                 = DMA1_Stream5;
-    hdma_rx_.Init.PeriphInc           = DMA_PINC_DISABLE;
-    hdma_rx_.Init.MemInc              = DMA_MINC_ENABLE;
-    hdma_rx_.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
-    hdma_rx_.Init.MemDataAlignment    = DMA_MDATAALIGN_BYTE;
-    hdma_rx_.Init.Mode                = DMA_NORMAL;
-    hdma_rx_.Init.Priority            = DMA_PRIORITY_VERY_HIGH;
-    hdma_rx_.Init.FIFOMode            = DMA_FIFOMODE_DISABLE;
-    hdma_rx_.Init.Direction           = DMA_PERIPH_TO_MEMORY;
-
-    hdma_tx_.Instance                 = DMA2_Stream4;
-    hdma_tx_.Init.PeriphInc           = DMA_PINC_DISABLE;
-    hdma_tx_.Init.MemInc              = DMA_MINC_ENABLE;
-    hdma_tx_.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
-    hdma_tx_.Init.MemDataAlignment    = DMA_MDATAALIGN_BYTE;
-    hdma_tx_.Init.Mode                = DMA_NORMAL;
-    hdma_tx_.Init.Priority            = DMA_PRIORITY_VERY_HIGH;
-    hdma_tx_.Init.FIFOMode            = DMA_FIFOMODE_DISABLE;
-    hdma_tx_.Init.Direction           = DMA_MEMORY_TO_PERIPH;
     SetDmaPeripheral();
 
+    // only touch the handle of the stream that's initialized, the other
+    // one may be busy in listen mode
     if(rx)
     {
+        hdma_rx_.Instance                 = DMA1_Stream5;
+        hdma_rx_.Init.PeriphInc           = DMA_PINC_DISABLE;
+        hdma_rx_.Init.MemInc              = DMA_MINC_ENABLE;
+        hdma_rx_.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+        hdma_rx_.Init.MemDataAlignment    = DMA_MDATAALIGN_BYTE;
+        hdma_rx_.Init.Mode                = DMA_NORMAL;
+        hdma_rx_.Init.Priority            = DMA_PRIORITY_VERY_HIGH;
+        hdma_rx_.Init.FIFOMode            = DMA_FIFOMODE_DISABLE;
+        hdma_rx_.Init.Direction           = DMA_PERIPH_TO_MEMORY;
         if(HAL_DMA_Init(&hdma_rx_) != HAL_OK)
         {
             Error_Handler();
@@ -359,6 +379,15 @@ UartHandler::Result UartHandler::Impl::InitDma(bool rx, bool tx)
 
     if(tx)
     {
+        hdma_tx_.Instance                 = DMA2_Stream4;
+        hdma_tx_.Init.PeriphInc           = DMA_PINC_DISABLE;
+        hdma_tx_.Init.MemInc              = DMA_MINC_ENABLE;
+        hdma_tx_.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+        hdma_tx_.Init.MemDataAlignment    = DMA_MDATAALIGN_BYTE;
+        hdma_tx_.Init.Mode                = DMA_NORMAL;
+        hdma_tx_.Init.Priority            = DMA_PRIORITY_VERY_HIGH;
+        hdma_tx_.Init.FIFOMode            = DMA_FIFOMODE_DISABLE;
+        hdma_tx_.Init.Direction           = DMA_MEMORY_TO_PERIPH;
         if(HAL_DMA_Init(&hdma_tx_) != HAL_OK)
         {
             Error_Handler();
@@ -492,6 +521,10 @@ UartHandler::Impl::DmaListenStart(uint8_t* buff,
                                   UartHandler::CircularRxCallbackFunctionPtr cb,
                                   void* callback_context)
 {
+    // there's only one DMA stream for receiving
+    if(listen_peripheral_ >= 0 && listen_peripheral_ != int(config_.periph))
+        return UartHandler::Result::ERR;
+
     /** Set internal data*/
     circular_rx_buff_       = buff;
     circular_rx_total_size_ = size;
@@ -518,14 +551,23 @@ UartHandler::Impl::DmaListenStart(uint8_t* buff,
         return UartHandler::Result::ERR;
     __HAL_LINKDMA(&huart_, hdmarx, hdma_rx_);
 
-    // enable idle interrupts so that TC, HT, and IDLE are triggers
-    __HAL_UART_ENABLE_IT(&huart_, UART_IT_IDLE);
+    // enable idle interrupts so that TC, HT, and IDLE are triggers.
+    // With a receiver timeout, that replaces IDLE.
+    if(rx_timeout_bits_ > 0)
+        SET_BIT(huart_.Instance->CR1, USART_CR1_RTOIE);
+    else
+        __HAL_UART_ENABLE_IT(&huart_, UART_IT_IDLE);
 
     /** cache maintanence to allow memory from cache-able regions  */
     dsy_dma_invalidate_cache_for_buffer(buff, size);
+    // the listener has its own stream, so it doesn't block DMA transmits
+    listen_peripheral_ = int(config_.periph);
     if(HAL_UART_Receive_DMA(&huart_, buff, size) != HAL_OK)
+    {
+        listener_mode_     = false;
+        listen_peripheral_ = -1;
         return UartHandler::Result::ERR;
-    dma_active_peripheral_ = int(config_.periph);
+    }
     return UartHandler::Result::OK;
 }
 
@@ -533,12 +575,13 @@ UartHandler::Result UartHandler::Impl::DmaListenStop()
 {
     /** Set Listener Mode */
     listener_mode_ = false;
-    /** Disable IDLE IRQ*/
+    /** Disable IDLE and timeout IRQs*/
     __HAL_UART_DISABLE_IT(&huart_, UART_IT_IDLE);
-    /** Stop DMA */
-    if(HAL_UART_DMAStop(&huart_) != HAL_OK)
-        return UartHandler::Result::ERR;
-    return UartHandler::Result::OK;
+    CLEAR_BIT(huart_.Instance->CR1, USART_CR1_RTOIE);
+    /** Stop DMA reception, a DMA transmission may still be running */
+    const bool ok      = HAL_UART_AbortReceive(&huart_) == HAL_OK;
+    listen_peripheral_ = -1;
+    return ok ? UartHandler::Result::OK : UartHandler::Result::ERR;
 }
 
 bool UartHandler::Impl::IsListening() const
@@ -553,7 +596,8 @@ UartHandler::Result UartHandler::Impl::StartDmaTx(
     UartHandler::EndCallbackFunctionPtr   end_callback,
     void*                                 callback_context)
 {
-    while(HAL_UART_GetState(&huart_) != HAL_UART_STATE_READY) {};
+    // only wait for the transmitter, the receiver may be listening
+    while(huart_.gState != HAL_UART_STATE_READY) {};
 
     if(InitDma(false, true) != UartHandler::Result::OK)
     {
@@ -590,8 +634,9 @@ UartHandler::Result UartHandler::Impl::DmaReceive(
     UartHandler::EndCallbackFunctionPtr   end_callback,
     void*                                 callback_context)
 {
-    /** Normal transfer is not listener mode */
-    listener_mode_ = false;
+    // the listener occupies the DMA stream for receiving
+    if(listen_peripheral_ >= 0)
+        return UartHandler::Result::ERR;
     // if dma is currently running - queue a job
     if(IsDmaBusy())
     {
@@ -833,6 +878,7 @@ UartHandler::Result UartHandler::Impl::DeInitPins()
 }
 
 volatile int8_t UartHandler::Impl::dma_active_peripheral_;
+volatile int8_t UartHandler::Impl::listen_peripheral_;
 UartHandler::Impl::UartDmaJob
     UartHandler::Impl::queued_dma_transfers_[kNumUartWithDma];
 
@@ -1023,13 +1069,27 @@ static void UART_CheckRxListener(UartHandler::Impl* handle)
 // HAL Interrupts.
 void UART_IRQHandler(UartHandler::Impl* handle)
 {
+    // the HAL treats a receiver timeout as an error and aborts the
+    // reception, in listen mode it just ends a burst like IDLE does
+    if(handle->listener_mode_ && handle->rx_timeout_bits_ > 0
+       && __HAL_UART_GET_FLAG(&handle->huart_, UART_FLAG_RTOF))
+    {
+        handle->huart_.Instance->ICR = USART_ICR_RTOCF;
+        handle->rx_idle_             = true;
+        UART_CheckRxListener(handle);
+        handle->rx_idle_ = false;
+    }
+
     HAL_UART_IRQHandler(&handle->huart_);
 
     if(handle->listener_mode_
+       && __HAL_UART_GET_IT_SOURCE(&handle->huart_, UART_IT_IDLE)
        && __HAL_UART_GET_FLAG(&handle->huart_, UART_FLAG_IDLE))
     {
         /** find position, and call callback */
+        handle->rx_idle_ = true;
         UART_CheckRxListener(handle);
+        handle->rx_idle_ = false;
         /** Clear IDLE Interrupt flag */
         handle->huart_.Instance->ICR = UART_FLAG_IDLE;
     }
@@ -1051,7 +1111,10 @@ extern "C"
 void HalUartDmaRxStreamCallback(void)
 {
     ScopedIrqBlocker block;
-    if(UartHandler::Impl::dma_active_peripheral_ >= 0)
+    if(UartHandler::Impl::listen_peripheral_ >= 0)
+        HAL_DMA_IRQHandler(
+            &uart_handles[UartHandler::Impl::listen_peripheral_].hdma_rx_);
+    else if(UartHandler::Impl::dma_active_peripheral_ >= 0)
         HAL_DMA_IRQHandler(
             &uart_handles[UartHandler::Impl::dma_active_peripheral_].hdma_rx_);
 }
@@ -1103,8 +1166,21 @@ extern "C" void HAL_UART_RxHalfCpltCallback(UART_HandleTypeDef* huart)
 
 extern "C" void HAL_UART_ErrorCallback(UART_HandleTypeDef* huart)
 {
-    auto* handle           = MapInstanceToHandle(huart->Instance);
-    handle->listener_mode_ = false;
+    auto* handle = MapInstanceToHandle(huart->Instance);
+    // in DMA mode, the HAL aborts the reception on any receive error
+    if(handle->listener_mode_ && huart->RxState == HAL_UART_STATE_READY)
+    {
+        // the listener stopped, tell the user so they can restart it.
+        // This must not finish another DMA transfer.
+        handle->listener_mode_                = false;
+        UartHandler::Impl::listen_peripheral_ = -1;
+        if(handle->circular_rx_callback_)
+            handle->circular_rx_callback_(nullptr,
+                                          0,
+                                          handle->circular_rx_context_,
+                                          UartHandler::Result::ERR);
+        return;
+    }
     UartHandler::Impl::DmaTransferFinished(huart, UartHandler::Result::ERR);
 }
 
@@ -1192,6 +1268,16 @@ bool UartHandler::IsListening() const
     return pimpl_->IsListening();
 }
 
+UartHandler::Result UartHandler::SetRxTimeout(uint32_t bits)
+{
+    return pimpl_->SetRxTimeout(bits);
+}
+
+bool UartHandler::IsRxIdle() const
+{
+    return pimpl_->rx_idle_;
+}
+
 int UartHandler::CheckError()
 {
     return pimpl_->CheckError();
@@ -196,6 +196,11 @@ class UartHandler
      *  Size must be set so that at maximum bandwidth, the software
      *  has time to process N bytes before the next circular IRQ is fired
      * 
+     *  Only one UART can listen at a time, DmaReceive() fails while
+     *  listening. DmaTransmit() works, it uses a separate DMA stream.
+     *  When the reception stops because of an error, e.g. an overrun,
+     *  the callback is called with a nullptr and Result::ERR.
+     * 
      *  @param buff buffer of data accessible by DMA.
      *  @param size size of buffer
      *  @param cb callback that happens containing new bytes to process in software
@@ -212,6 +217,19 @@ class UartHandler
     /** Returns whether listen the DmaListen mode is active or not */
     bool IsListening() const;
 
+    /** Sets a receiver timeout for listen mode. The callback then fires
+     *  after the line was idle for the given number of bit periods,
+     *  instead of after one idle character. Call before DmaListenStart().
+     *  Not available on LPUART_1.
+     *  @param bits timeout in bit periods, 0 to use the IDLE interrupt
+     */
+    Result SetRxTimeout(uint32_t bits);
+
+    /** Returns true while the listen mode callback runs because the line
+     *  went idle or timed out, i.e. the sender paused
+     */
+    bool IsRxIdle() const;
+
     /** \return the result of HAL_UART_GetError() to the user. */
     int CheckError();
 
@@ -0,0 +1,118 @@
+#include "per/uart_stream.h"
+#include "util/scopedirqblocker.h"
+
+using namespace daisy;
+
+UartStream::Result UartStream::Init(UartHandler& uart, const Config& config)
+{
+    uart_          = &uart;
+    config_        = config;
+    running_       = false;
+    num_rx_errors_ = 0;
+    num_tx_errors_ = 0;
+
+    if(!rx_.Init(config_.rx_buffer, config_.rx_size))
+        return Result::ERR;
+    rx_.SetThreshold(config_.rx_threshold);
+    if(config_.tx_buffer != nullptr
+       && !tx_.Init(config_.tx_buffer, config_.tx_size))
+        return Result::ERR;
+
+    if(uart_->SetRxTimeout(config_.rx_timeout_bits) != UartHandler::Result::OK
+       && config_.rx_timeout_bits > 0)
+        return Result::ERR;
+    return Result::OK;
+}
+
+UartStream::Result UartStream::Start()
+{
+    running_ = true;
+    if(uart_->DmaListenStart(config_.rx_buffer, config_.rx_size, OnRx, this)
+       != UartHandler::Result::OK)
+    {
+        running_ = false;
+        return Result::ERR;
+    }
+    return Result::OK;
+}
+
+UartStream::Result UartStream::Stop()
+{
+    running_ = false;
+    return uart_->DmaListenStop() == UartHandler::Result::OK ? Result::OK
+                                                              : Result::ERR;
+}
+
+size_t UartStream::Write(const uint8_t* data, size_t size)
+{
+    if(config_.tx_buffer == nullptr)
+        return 0;
+    const size_t queued = tx_.Write(data, size);
+    StartTx();
+    return queued;
+}
+
+void UartStream::StartTx()
+{
+    UartSpan chunk;
+    {
+        // only the claim races with the completion interrupt, starting
+        // the transfer may have to wait for the UART and the DMA
+        ScopedIrqBlocker block;
+        chunk = tx_.StartChunk();
+    }
+    if(chunk.size == 0)
+        return;
+    // DmaTransmit() queues the transfer while another UART uses the DMA
+    if(uart_->DmaTransmit(const_cast<uint8_t*>(chunk.data),
+                          chunk.size,
+                          nullptr,
+                          OnTxDone,
+                          this)
+       != UartHandler::Result::OK)
+    {
+        // the bytes stay queued and are retried by the next Write()
+        num_tx_errors_++;
+        tx_.CancelChunk();
+    }
+}
+
+void UartStream::OnTxDone(void* context, UartHandler::Result result)
+{
+    auto* stream = static_cast<UartStream*>(context);
+    if(result != UartHandler::Result::OK)
+        stream->num_tx_errors_++;
+    // a failed chunk is dropped, so one error doesn't stall the queue
+    stream->tx_.FinishChunk();
+    stream->StartTx();
+}
+
+void UartStream::OnRx(uint8_t*            data,
+                      size_t              size,
+                      void*               context,
+                      UartHandler::Result result)
+{
+    auto* stream = static_cast<UartStream*>(context);
+    if(result != UartHandler::Result::OK)
+    {
+        stream->num_rx_errors_++;
+        // the reception was aborted, e.g. by an overrun: the DMA starts
+        // over at the start of the buffer
+        if(stream->running_ && !stream->uart_->IsListening())
+        {
+            stream->rx_.OnDmaRestart();
+            stream->uart_->DmaListenStart(stream->config_.rx_buffer,
+                                          stream->config_.rx_size,
+                                          OnRx,
+                                          stream);
+        }
+        return;
+    }
+
+    // the listener passes the bytes since the last call, split in two
+    // where they wrap around; only the end position is needed here
+    const size_t pos  = (data - stream->config_.rx_buffer) + size;
+    const bool   idle = stream->uart_->IsRxIdle();
+    if(stream->rx_.OnDmaPosition(pos, idle) && stream->config_.data_callback)
+        stream->config_.data_callback(stream->config_.callback_context);
+}
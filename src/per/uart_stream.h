@@ -0,0 +1,461 @@
+#pragma once
+#ifndef DSY_UART_STREAM_H
+#define DSY_UART_STREAM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <atomic>
+#include "per/uart.h"
+
+namespace daisy
+{
+/** @addtogroup serial
+    @{
+    */
+
+/** @brief A contiguous region of a stream buffer */
+struct UartSpan
+{
+    const uint8_t* data; /**< First byte, nullptr if empty */
+    size_t         size; /**< Number of bytes */
+};
+
+/** @brief Tracks the unread region of a circular DMA receive buffer
+ *
+ *  The DMA writes the buffer round and round, the interrupt reports its
+ *  position with OnDmaPosition() and the consumer reads the bytes in place
+ *  with GetReadable() and Consume(). Both sides count bytes with free
+ *  running counters, so the ring notices when the DMA overtook the consumer
+ *  and overwrote unread bytes. The unread bytes are dropped then and
+ *  counted, and the consumer continues with the newest data.
+ *
+ *  The interrupt must run at least twice per pass over the buffer, which
+ *  the half and full transfer interrupts of a circular DMA guarantee.
+ */
+class UartRxRing
+{
+  public:
+    UartRxRing() {}
+    ~UartRxRing() {}
+
+    /** Initializes the ring
+     *  @param buffer   The DMA buffer
+     *  @param size     Size of the buffer, must be a power of two
+     *  @return false if the size isn't a power of two
+     */
+    bool Init(uint8_t* buffer, size_t size)
+    {
+        if(buffer == nullptr || size < 2 || (size & (size - 1)) != 0)
+            return false;
+        buffer_    = buffer;
+        size_      = size;
+        threshold_ = 0;
+        Reset();
+        return true;
+    }
+
+    /** Forgets all data and statistics. Not thread safe. */
+    void Reset()
+    {
+        last_pos_      = 0;
+        read_count_    = 0;
+        max_fill_      = 0;
+        num_overflows_ = 0;
+        num_dropped_   = 0;
+        num_restarts_  = 0;
+        write_count_.store(0, std::memory_order_relaxed);
+        resync_count_.store(0, std::memory_order_release);
+    }
+
+    /** Sets how many bytes must be available before OnDmaPosition() asks
+     *  to notify the consumer, unless the line went idle. */
+    void SetThreshold(size_t threshold) { threshold_ = threshold; }
+
+    /** Called from the interrupt with the current write position of the
+     *  DMA, i.e. size minus the remaining transfer count.
+     *  @param write_pos    The position the DMA writes next, 0..size
+     *  @param idle         True if the line went idle, the sender paused
+     *  @return true if the consumer should be notified
+     */
+    bool OnDmaPosition(size_t write_pos, bool idle)
+    {
+        write_pos &= size_ - 1;
+        const size_t new_bytes = (write_pos - last_pos_) & (size_ - 1);
+        last_pos_              = write_pos;
+        const uint32_t written
+            = write_count_.load(std::memory_order_relaxed) + new_bytes;
+        write_count_.store(written, std::memory_order_release);
+
+        const uint32_t available = written - read_count_;
+        if(available > max_fill_)
+            max_fill_ = available;
+        return available > 0 && (idle || available >= threshold_);
+    }
+
+    /** Called from the interrupt when the DMA was restarted at the start
+     *  of the buffer, e.g. after a receive error. Unread bytes are dropped.
+     */
+    void OnDmaRestart()
+    {
+        const uint32_t written = write_count_.load(std::memory_order_relaxed);
+        const uint32_t aligned = (written + size_ - 1) & ~uint32_t(size_ - 1);
+        last_pos_              = 0;
+        write_count_.store(aligned, std::memory_order_relaxed);
+        resync_count_.store(aligned, std::memory_order_release);
+    }
+
+    /** @return the number of unread bytes */
+    size_t GetAvailable()
+    {
+        Resync();
+        return write_count_.load(std::memory_order_acquire) - read_count_;
+    }
+
+    /** @return the oldest unread bytes that are contiguous in memory. When
+     *  the unread region wraps around the end of the buffer, the rest is
+     *  returned after Consume().
+     */
+    UartSpan GetReadable()
+    {
+        Resync();
+        const uint32_t available
+            = write_count_.load(std::memory_order_acquire) - read_count_;
+        const size_t pos = read_count_ & (size_ - 1);
+        UartSpan     span;
+        span.size = available < size_ - pos ? available : size_ - pos;
+        span.data = span.size > 0 ? buffer_ + pos : nullptr;
+        return span;
+    }
+
+    /** Marks bytes as read, after they were processed in place.
+     *  @return false if the DMA overwrote some of them in the meantime,
+     *          i.e. the data that was processed may be corrupt
+     */
+    bool Consume(size_t size)
+    {
+        const uint32_t start     = read_count_;
+        const uint32_t available = GetAvailable();
+        if(size > available)
+            size = available;
+        if(read_count_ != start)
+            return false; // dropped before we got here
+        read_count_ += size;
+        const uint32_t written = write_count_.load(std::memory_order_acquire);
+        if(written - start > size_)
+        {
+            Drop(written);
+            return false;
+        }
+        return true;
+    }
+
+    /** Copies up to `max_size` unread bytes and marks them as read
+     *  @return the number of bytes copied
+     */
+    size_t Read(uint8_t* dest, size_t max_size)
+    {
+        size_t copied = 0;
+        while(copied < max_size)
+        {
+            const UartSpan span = GetReadable();
+            if(span.size == 0)
+                break;
+            const size_t size = span.size < max_size - copied
+                                    ? span.size
+                                    : max_size - copied;
+            memcpy(dest + copied, span.data, size);
+            if(!Consume(size))
+                break; // overwritten while copying, drop the copy
+            copied += size;
+        }
+        return copied;
+    }
+
+    /** @return the size of the buffer */
+    size_t GetSize() const { return size_; }
+
+    /** @return the most bytes that were unread at once, including bytes
+     *          that were dropped */
+    uint32_t GetMaxFill() const { return max_fill_; }
+
+    /** @return how often unread bytes were overwritten */
+    uint32_t GetNumOverflows() const { return num_overflows_; }
+
+    /** @return the number of bytes dropped after overflows */
+    uint32_t GetNumDroppedBytes() const { return num_dropped_; }
+
+    /** @return how often the reader skipped ahead after OnDmaRestart() */
+    uint32_t GetNumRestarts() const { return num_restarts_; }
+
+  private:
+    /** Skips bytes that were dropped by a restart or overwritten */
+    void Resync()
+    {
+        const uint32_t resync = resync_count_.load(std::memory_order_acquire);
+        if(int32_t(resync - read_count_) > 0)
+        {
+            // the bytes up to the restart are lost, and the rest of that
+            // pass over the buffer was never written
+            num_restarts_++;
+            read_count_ = resync;
+        }
+        const uint32_t written = write_count_.load(std::memory_order_acquire);
+        if(written - read_count_ > size_)
+            Drop(written);
+    }
+
+    void Drop(uint32_t written)
+    {
+        num_overflows_++;
+        num_dropped_ += written - read_count_;
+        read_count_ = written;
+    }
+
+    uint8_t*              buffer_ = nullptr;
+    size_t                size_   = 0;
+    size_t                threshold_;
+    size_t                last_pos_;
+    uint32_t              read_count_;
+    uint32_t              max_fill_;
+    uint32_t              num_overflows_;
+    uint32_t              num_dropped_;
+    uint32_t              num_restarts_;
+    std::atomic<uint32_t> write_count_;
+    std::atomic<uint32_t> resync_count_;
+};
+
+/** @brief Queue of bytes to transmit with chained DMA transfers
+ *
+ *  Write() copies into a circular buffer. StartChunk() returns the oldest
+ *  queued bytes that are contiguous in memory for the next DMA transfer,
+ *  and FinishChunk() frees them once it completed, so that the completion
+ *  interrupt can start the next chunk right away. One writer and one
+ *  sender can use the queue concurrently.
+ */
+class UartTxQueue
+{
+  public:
+    UartTxQueue() {}
+    ~UartTxQueue() {}
+
+    /** Initializes the queue
+     *  @param buffer   The DMA buffer
+     *  @param size     Size of the buffer, must be a power of two
+     *  @return false if the size isn't a power of two
+     */
+    bool Init(uint8_t* buffer, size_t size)
+    {
+        if(buffer == nullptr || size < 2 || (size & (size - 1)) != 0)
+            return false;
+        buffer_ = buffer;
+        size_   = size;
+        write_count_.store(0, std::memory_order_relaxed);
+        read_count_.store(0, std::memory_order_relaxed);
+        in_flight_.store(0, std::memory_order_release);
+        return true;
+    }
+
+    /** Queues as many bytes as fit
+     *  @return the number of bytes queued
+     */
+    size_t Write(const uint8_t* data, size_t size)
+    {
+        const uint32_t written = write_count_.load(std::memory_order_relaxed);
+        const size_t   free    = GetFree();
+        if(size > free)
+            size = free;
+        const size_t pos   = written & (size_ - 1);
+        const size_t first = size < size_ - pos ? size : size_ - pos;
+        memcpy(buffer_ + pos, data, first);
+        memcpy(buffer_, data + first, size - first);
+        write_count_.store(written + size, std::memory_order_release);
+        return size;
+    }
+
+    /** @return the number of bytes that can be queued */
+    size_t GetFree() const
+    {
+        return size_
+               - (write_count_.load(std::memory_order_relaxed)
+                  - read_count_.load(std::memory_order_acquire));
+    }
+
+    /** @return the number of queued bytes, including those being sent */
+    size_t GetPending() const { return size_ - GetFree(); }
+
+    /** @return true while a chunk is being sent */
+    bool IsSending() const
+    {
+        return in_flight_.load(std::memory_order_acquire) > 0;
+    }
+
+    /** Takes the next chunk to send
+     *  @return the chunk, empty if a chunk is being sent or nothing is
+     *          queued
+     */
+    UartSpan StartChunk()
+    {
+        UartSpan span = {nullptr, 0};
+        if(IsSending())
+            return span;
+        const uint32_t read = read_count_.load(std::memory_order_relaxed);
+        const uint32_t queued
+            = write_count_.load(std::memory_order_acquire) - read;
+        const size_t pos = read & (size_ - 1);
+        span.size        = queued < size_ - pos ? queued : size_ - pos;
+        if(span.size > 0)
+            span.data = buffer_ + pos;
+        in_flight_.store(span.size, std::memory_order_release);
+        return span;
+    }
+
+    /** Frees the chunk that was sent */
+    void FinishChunk()
+    {
+        const uint32_t sent = in_flight_.load(std::memory_order_relaxed);
+        read_count_.store(read_count_.load(std::memory_order_relaxed) + sent,
+                          std::memory_order_release);
+        in_flight_.store(0, std::memory_order_release);
+    }
+
+    /** Keeps the chunk queued, e.g. if its transfer couldn't be started */
+    void CancelChunk() { in_flight_.store(0, std::memory_order_release); }
+
+  private:
+    uint8_t*              buffer_ = nullptr;
+    size_t                size_   = 0;
+    std::atomic<uint32_t> write_count_;
+    std::atomic<uint32_t> read_count_;
+    std::atomic<uint32_t> in_flight_;
+};
+
+/** @brief Buffered, DMA driven UART stream for fast serial links
+ *
+ *  Receives into a circular DMA buffer continuously. The consumer reads
+ *  the received bytes in place from the main loop or a task, and is
+ *  notified from the interrupt when `rx_threshold` bytes arrived or the
+ *  line went idle for `rx_timeout_bits`. Overflows of the buffer are
+ *  detected and counted, and reception restarts by itself after overrun
+ *  errors of the UART.
+ *
+ *  Transmitted bytes are queued in a second buffer and sent with DMA,
+ *  each transfer starting the next one from its completion interrupt.
+ *
+ *  The buffers must be in D2 memory (DMA_BUFFER_MEM_SECTION). Only one
+ *  UART can receive with DMA at a time, see UartHandler::DmaListenStart().
+ */
+class UartStream
+{
+  public:
+    /** Called from the interrupt when data is ready to be read */
+    typedef void (*DataCallback)(void* context);
+
+    struct Config
+    {
+        /** Receive buffer, size must be a power of two */
+        uint8_t* rx_buffer;
+        size_t   rx_size;
+        /** Transmit buffer, size must be a power of two. nullptr to only
+         *  receive */
+        uint8_t* tx_buffer;
+        size_t   tx_size;
+        /** Notify after this many bytes, 0 notifies on every interrupt */
+        size_t rx_threshold;
+        /** Notify after the line was idle for this many bit periods, 0 for
+         *  one character (the IDLE flag). Not available on LPUART_1. */
+        uint32_t rx_timeout_bits;
+        /** Optional notification, called from the interrupt */
+        DataCallback data_callback;
+        void*        callback_context;
+
+        void Defaults()
+        {
+            rx_buffer        = nullptr;
+            rx_size          = 0;
+            tx_buffer        = nullptr;
+            tx_size          = 0;
+            rx_threshold     = 0;
+            rx_timeout_bits  = 0;
+            data_callback    = nullptr;
+            callback_context = nullptr;
+        }
+    };
+
+    enum class Result
+    {
+        OK,
+        ERR,
+    };
+
+    UartStream() {}
+    ~UartStream() {}
+
+    /** Initializes the stream on an initialized UART */
+    Result Init(UartHandler& uart, const Config& config);
+
+    /** Starts receiving */
+    Result Start();
+
+    /** Stops receiving, unread bytes remain readable */
+    Result Stop();
+
+    /** @return the oldest unread bytes, contiguous in memory */
+    UartSpan GetReadable() { return rx_.GetReadable(); }
+
+    /** Marks bytes returned by GetReadable() as read
+     *  @return false if they were overwritten while being processed
+     */
+    bool Consume(size_t size) { return rx_.Consume(size); }
+
+    /** Copies received bytes, returns the number of bytes copied */
+    size_t Read(uint8_t* dest, size_t max_size)
+    {
+        return rx_.Read(dest, max_size);
+    }
+
+    /** @return the number of unread bytes */
+    size_t GetAvailable() { return rx_.GetAvailable(); }
+
+    /** Queues bytes for transmission and starts sending if idle
+     *  @return the number of bytes queued, less than size if the transmit
+     *          buffer is full
+     */
+    size_t Write(const uint8_t* data, size_t size);
+
+    /** @return the free space in the transmit buffer */
+    size_t GetTxFree() const { return tx_.GetFree(); }
+
+    /** @return true while bytes are queued or being sent */
+    bool IsSending() const { return tx_.GetPending() > 0; }
+
+    /** @return the receive ring, e.g. for its statistics */
+    const UartRxRing& GetRxRing() const { return rx_; }
+
+    /** @return the number of receive errors of the UART */
+    uint32_t GetNumRxErrors() const { return num_rx_errors_; }
+
+    /** @return the number of failed transmit transfers */
+    uint32_t GetNumTxErrors() const { return num_tx_errors_; }
+
+  private:
+    static void OnRx(uint8_t*            data,
+                     size_t              size,
+                     void*               context,
+                     UartHandler::Result result);
+    static void OnTxDone(void* context, UartHandler::Result result);
+    void        StartTx();
+
+    UartHandler*      uart_ = nullptr;
+    Config            config_;
+    UartRxRing        rx_;
+    UartTxQueue       tx_;
+    volatile bool     running_ = false;
+    volatile uint32_t num_rx_errors_ = 0;
+    volatile uint32_t num_tx_errors_ = 0;
+};
+
+/** @} */
+} // namespace daisy
+
+#endif
@@ -102,6 +102,108 @@ class FatFSInterface
     bool   initialized_;
 };
 
+/** @brief FatFs adapter for FileIoService and WavIndex
+ *  @ingroup utility
+ *
+ *  Usage:
+ *  \code
+ *  FatFsFileSystem                fs;
+ *  FileIoService<FatFsFileSystem> io;
+ *  io.Init(fs);
+ *  \endcode
+ */
+struct FatFsFileSystem
+{
+    using File = FIL;
+
+    /** An open directory */
+    struct Dir
+    {
+        DIR     dir;
+        FILINFO info;
+    };
+
+    /** A directory entry, as returned by ReadDir() */
+    struct FileInfo
+    {
+        /** The name of the entry, empty at the end of the directory */
+        const char* name;
+        uint32_t    size;
+        /** FAT date in the upper and time in the lower 16 bits */
+        uint32_t timestamp;
+        bool     isDirectory;
+        bool     isHidden;
+    };
+
+    /** Opens an existing file for reading, or creates a new file for
+     *  writing. Returns an FRESULT. */
+    int Open(File& file, const char* path, bool write)
+    {
+        const BYTE mode = write ? (FA_WRITE | FA_CREATE_ALWAYS)
+                                : (FA_READ | FA_OPEN_EXISTING);
+        return f_open(&file, path, mode);
+    }
+
+    /** Closes a file, returns an FRESULT */
+    int Close(File& file) { return f_close(&file); }
+
+    /** Returns the first cluster of an open file */
+    uint32_t GetStartCluster(const File& file) { return file.obj.sclust; }
+
+    /** Opens a directory, returns an FRESULT */
+    int OpenDir(Dir& dir, const char* path)
+    {
+        return f_opendir(&dir.dir, path);
+    }
+
+    /** Reads the next directory entry, returns an FRESULT */
+    int ReadDir(Dir& dir, FileInfo& info)
+    {
+        const auto res   = f_readdir(&dir.dir, &dir.info);
+        info.name        = dir.info.fname;
+        info.size        = dir.info.fsize;
+        info.timestamp   = (uint32_t(dir.info.fdate) << 16) | dir.info.ftime;
+        info.isDirectory = (dir.info.fattrib & AM_DIR) != 0;
+        info.isHidden    = (dir.info.fattrib & AM_HID) != 0;
+        return res;
+    }
+
+    /** Closes a directory, returns an FRESULT */
+    int CloseDir(Dir& dir) { return f_closedir(&dir.dir); }
+
+    /** Reads the modification timestamp of a file or directory in the same
+     *  format as FileInfo::timestamp, returns an FRESULT */
+    int GetTimestamp(const char* path, uint32_t& timestamp)
+    {
+        FILINFO    info;
+        const auto res = f_stat(path, &info);
+        if(res == FR_OK)
+            timestamp = (uint32_t(info.fdate) << 16) | info.ftime;
+        return res;
+    }
+
+    /** Reads from the current position, returns an FRESULT */
+    int Read(File& file, void* dest, size_t size, size_t& bytesRead)
+    {
+        UINT       br  = 0;
+        const auto res = f_read(&file, dest, size, &br);
+        bytesRead      = br;
+        return res;
+    }
+
+    /** Writes to the current position, returns an FRESULT */
+    int Write(File& file, const void* src, size_t size, size_t& bytesWritten)
+    {
+        UINT       bw  = 0;
+        const auto res = f_write(&file, src, size, &bw);
+        bytesWritten   = bw;
+        return res;
+    }
+
+    /** Moves the position of the file, returns an FRESULT */
+    int Seek(File& file, uint32_t position) { return f_lseek(&file, position); }
+};
+
 } // namespace daisy
 
 /** Implementation of FatFS time method 
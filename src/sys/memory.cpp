@@ -0,0 +1,63 @@
+#include "sys/memory.h"
+#include "daisy_core.h"
+
+#ifndef DSY_MEMORY_DMA_ARENA_SIZE
+#define DSY_MEMORY_DMA_ARENA_SIZE 8192
+#endif
+
+#ifndef DSY_MEMORY_DTCM_ARENA_SIZE
+#define DSY_MEMORY_DTCM_ARENA_SIZE 16384
+#endif
+
+#define SDRAM_BASE 0xC0000000
+#define SDRAM_SIZE 0x4000000
+
+using namespace daisy;
+
+// end of the .sdram_bss section, provided by the linker script
+extern "C" char _esdram_bss[];
+
+static uint8_t DMA_BUFFER_MEM_SECTION
+    __attribute__((aligned(MemoryArena::kCacheLineSize)))
+    dma_arena_memory[DSY_MEMORY_DMA_ARENA_SIZE];
+
+static uint8_t DTCM_MEM_SECTION
+    __attribute__((aligned(MemoryArena::kCacheLineSize)))
+    dtcm_arena_memory[DSY_MEMORY_DTCM_ARENA_SIZE];
+
+MemoryArena& Memory::GetSdramArena()
+{
+    static MemoryArena arena;
+    static bool        initialized = false;
+    if(!initialized)
+    {
+        const uintptr_t start = reinterpret_cast<uintptr_t>(_esdram_bss);
+        arena.Init(_esdram_bss, SDRAM_BASE + SDRAM_SIZE - start);
+        initialized = true;
+    }
+    return arena;
+}
+
+MemoryArena& Memory::GetDmaArena()
+{
+    static MemoryArena arena;
+    static bool        initialized = false;
+    if(!initialized)
+    {
+        arena.Init(dma_arena_memory, sizeof(dma_arena_memory));
+        initialized = true;
+    }
+    return arena;
+}
+
+MemoryArena& Memory::GetDtcmArena()
+{
+    static MemoryArena arena;
+    static bool        initialized = false;
+    if(!initialized)
+    {
+        arena.Init(dtcm_arena_memory, sizeof(dtcm_arena_memory));
+        initialized = true;
+    }
+    return arena;
+}
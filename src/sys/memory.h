@@ -0,0 +1,45 @@
+#pragma once
+#ifndef DSY_MEMORY_H
+#define DSY_MEMORY_H
+
+#include "util/MemoryArena.h"
+
+namespace daisy
+{
+/** @brief Global allocators for the memory regions of the Daisy
+ *  @ingroup system
+ *
+ *  Instead of placing many statically sized arrays with DSY_SDRAM_BSS or
+ *  DMA_BUFFER_MEM_SECTION, buffers can be allocated from these arenas at
+ *  runtime. All allocations are aligned to 32 byte cache lines by default.
+ *  Use MemoryPool on top of an arena for objects that are created and
+ *  destroyed frequently.
+ *
+ *  The arenas are created on first use and are not thread safe. Allocate
+ *  from the main thread, e.g. during initialization.
+ */
+class Memory
+{
+  public:
+    /** Returns the arena that spans all of the external SDRAM that's not used
+     *  by DSY_SDRAM_BSS variables. The SDRAM must be initialized before
+     *  allocating from this arena, which DaisySeed::Init() does.
+     */
+    static MemoryArena& GetSdramArena();
+
+    /** Returns an arena in the non-cached D2 SRAM that's suitable for DMA
+     *  buffers. Its size is set with DSY_MEMORY_DMA_ARENA_SIZE, which
+     *  defaults to 8kB.
+     */
+    static MemoryArena& GetDmaArena();
+
+    /** Returns an arena in the fast DTCM RAM, which is not suitable for DMA
+     *  buffers. Its size is set with DSY_MEMORY_DTCM_ARENA_SIZE, which
+     *  defaults to 16kB.
+     */
+    static MemoryArena& GetDtcmArena();
+};
+
+} // namespace daisy
+
+#endif // DSY_MEMORY_H
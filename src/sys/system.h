@@ -275,6 +275,18 @@ class System
     {
         return testIsolator_.GetStateForCurrentTest()->tickFreqHz_;
     }
+    /** Advances the current time instead of waiting */
+    static void Delay(uint32_t delay_ms) { DelayUs(delay_ms * 1000); }
+    /** Advances the current time instead of waiting */
+    static void DelayUs(uint32_t delay_us)
+    {
+        testIsolator_.GetStateForCurrentTest()->currentUs_ += delay_us;
+    }
+    /** Advances the current tick instead of waiting */
+    static void DelayTicks(uint32_t delay_ticks)
+    {
+        testIsolator_.GetStateForCurrentTest()->currentTick_ += delay_ticks;
+    }
 
     /** Sets the current "tick" value for the test that's currently running. */
     static void SetTickForUnitTest(uint32_t tick)
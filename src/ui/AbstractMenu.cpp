@@ -1,5 +1,7 @@
 #include "AbstractMenu.h"
 #include "util/FixedCapStr.h"
+#include "sys/system.h"
+#include <algorithm>
 
 namespace daisy
 {
@@ -9,6 +11,23 @@ void AbstractMenu::SelectItem(uint16_t itemIdx)
         return;
     selectedItemIdx_ = itemIdx;
     isEditing_       = false;
+    Invalidate();
+}
+
+void AbstractMenu::EnableEncoderAcceleration(
+    const EncoderAccelerationCurve::Config& config)
+{
+    acceleration_.Init(config);
+    menuEncoderVelocity_.Init(1000000);
+    valueEncoderVelocity_.Init(1000000);
+    accelerationEnabled_ = true;
+}
+
+void AbstractMenu::EnableEncoderAcceleration()
+{
+    EncoderAccelerationCurve::Config config;
+    config.Defaults();
+    EnableEncoderAcceleration(config);
 }
 
 // inherited from UiPage
@@ -19,6 +38,7 @@ bool AbstractMenu::OnOkayButton(uint8_t numberOfPresses, bool isRetriggering)
     if(numberOfPresses < 1)
         return true;
 
+    Invalidate();
     if(allowEntering_ && CanItemBeEnteredForEditing(selectedItemIdx_))
     {
         isEditing_ = !isEditing_;
@@ -38,6 +58,7 @@ bool AbstractMenu::OnCancelButton(uint8_t numberOfPresses, bool isRetriggering)
     if(numberOfPresses < 1)
         return true;
 
+    Invalidate();
     if(isEditing_)
         isEditing_ = false;
     else
@@ -54,6 +75,7 @@ bool AbstractMenu::OnArrowButton(ArrowButtonType arrowType,
     if(numberOfPresses < 1)
         return true;
 
+    Invalidate();
     if(orientation_ == Orientation::leftRightSelectUpDownModify)
     {
         if(arrowType == ArrowButtonType::down)
@@ -114,14 +136,20 @@ bool AbstractMenu::OnFunctionButton(uint8_t numberOfPresses,
 bool AbstractMenu::OnMenuEncoderTurned(int16_t  turns,
                                        uint16_t stepsPerRevolution)
 {
+    Invalidate();
+    const float velocity = UpdateEncoderVelocity(menuEncoderVelocity_, turns);
     // edit value
     if(isEditing_)
-        ModifyItemValue(
-            selectedItemIdx_, turns, stepsPerRevolution, isFuncButtonDown_);
+        ModifyItemValue(selectedItemIdx_,
+                        turns,
+                        stepsPerRevolution,
+                        isFuncButtonDown_,
+                        velocity);
     else
     // scroll through menu
     {
-        int16_t result = selectedItemIdx_ + turns;
+        int16_t result
+            = selectedItemIdx_ + AccelerateTurns(turns, velocity, false);
         selectedItemIdx_
             = (result < 0) ? 0
                            : ((result >= numItems_) ? numItems_ - 1 : result);
@@ -132,13 +160,19 @@ bool AbstractMenu::OnMenuEncoderTurned(int16_t  turns,
 bool AbstractMenu::OnValueEncoderTurned(int16_t  turns,
                                         uint16_t stepsPerRevolution)
 {
-    ModifyItemValue(
-        selectedItemIdx_, turns, stepsPerRevolution, isFuncButtonDown_);
+    Invalidate();
+    const float velocity = UpdateEncoderVelocity(valueEncoderVelocity_, turns);
+    ModifyItemValue(selectedItemIdx_,
+                    turns,
+                    stepsPerRevolution,
+                    isFuncButtonDown_,
+                    velocity);
     return true;
 }
 
 bool AbstractMenu::OnValuePotMoved(float newPosition)
 {
+    Invalidate();
     ModifyItemValue(selectedItemIdx_, newPosition, isFuncButtonDown_);
     return true;
 }
@@ -163,6 +197,7 @@ void AbstractMenu::Init(const ItemConfig* items,
     selectedItemIdx_  = 0;
     isEditing_        = false;
     isFuncButtonDown_ = false;
+    Invalidate();
 }
 
 bool AbstractMenu::CanItemBeEnteredForEditing(uint16_t itemIdx)
@@ -187,7 +222,8 @@ bool AbstractMenu::CanItemBeEnteredForEditing(uint16_t itemIdx)
 void AbstractMenu::ModifyItemValue(uint16_t itemIdx,
                                    int16_t  increments,
                                    uint16_t stepsPerRevolution,
-                                   bool     isFunctionButtonPressed)
+                                   bool     isFunctionButtonPressed,
+                                   float    encoderVelocity)
 {
     if(itemIdx >= numItems_)
         return;
@@ -203,8 +239,10 @@ void AbstractMenu::ModifyItemValue(uint16_t itemIdx,
         case ItemType::closeMenuItem: break;
         case ItemType::openUiPageItem: break;
         case ItemType::valueItem:
-            item.asMappedValueItem.valueToModify->Step(increments,
-                                                       isFunctionButtonPressed);
+            item.asMappedValueItem.valueToModify->Step(
+                AccelerateTurns(
+                    increments, encoderVelocity, isFunctionButtonPressed),
+                isFunctionButtonPressed);
             break;
         case ItemType::customItem:
             item.asCustomItem.itemObject->ModifyValue(
@@ -272,4 +310,24 @@ void AbstractMenu::TriggerItemAction(uint16_t itemIdx)
     }
 }
 
+float AbstractMenu::UpdateEncoderVelocity(EncoderVelocityFilter& filter,
+                                          int16_t                turns)
+{
+    if(!accelerationEnabled_)
+        return 0.0f;
+    filter.Update(turns, System::GetUs());
+    return filter.GetVelocity();
+}
+
+int16_t AbstractMenu::AccelerateTurns(int16_t turns,
+                                      float   encoderVelocity,
+                                      bool    useCoarseStepSize)
+{
+    if(!accelerationEnabled_)
+        return turns;
+    const auto accelerated
+        = acceleration_.Apply(turns, encoderVelocity, useCoarseStepSize);
+    return int16_t(std::max(-32767, std::min(32767, int(accelerated))));
+}
+
 } // namespace daisy
\ No newline at end of file
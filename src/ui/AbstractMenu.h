@@ -2,6 +2,7 @@
 
 #include "hid/disp/display.h"
 #include "util/MappedValue.h"
+#include "util/EncoderAcceleration.h"
 #include "UI.h"
 
 namespace daisy
@@ -196,6 +197,18 @@ class AbstractMenu : public UiPage
     void    SelectItem(uint16_t itemIdx);
     int16_t GetSelectedItemIdx() const { return selectedItemIdx_; }
 
+    /** Speeds up scrolling and editing values with the encoders when they
+     *  are turned quickly. The gain for value edits follows the fine or
+     *  coarse curve, depending on the function button. Disabled by default.
+     * @param config    The acceleration curve
+     */
+    void EnableEncoderAcceleration(
+        const EncoderAccelerationCurve::Config& config);
+    /** Enables encoder acceleration with the default curve. */
+    void EnableEncoderAcceleration();
+    /** Disables encoder acceleration, each encoder step is one step. */
+    void DisableEncoderAcceleration() { accelerationEnabled_ = false; }
+
     // inherited from UiPage
     bool OnOkayButton(uint8_t numberOfPresses, bool isRetriggering) override;
     bool OnCancelButton(uint8_t numberOfPresses, bool isRetriggering) override;
@@ -260,13 +273,22 @@ class AbstractMenu : public UiPage
     void ModifyItemValue(uint16_t itemIdx,
                          int16_t  increments,
                          uint16_t stepsPerRevolution,
-                         bool     isFunctionButtonPressed);
+                         bool     isFunctionButtonPressed,
+                         float    encoderVelocity = 0.0f);
     void ModifyItemValue(uint16_t itemIdx,
                          float    valueSliderPosition0To1,
                          bool     isFunctionButtonPressed);
-    void TriggerItemAction(uint16_t itemIdx);
+    void    TriggerItemAction(uint16_t itemIdx);
+    float   UpdateEncoderVelocity(EncoderVelocityFilter& filter, int16_t turns);
+    int16_t AccelerateTurns(int16_t turns,
+                            float   encoderVelocity,
+                            bool    useCoarseStepSize);
 
-    bool isFuncButtonDown_ = false;
+    bool                     isFuncButtonDown_    = false;
+    bool                     accelerationEnabled_ = false;
+    EncoderAccelerationCurve acceleration_;
+    EncoderVelocityFilter    menuEncoderVelocity_;
+    EncoderVelocityFilter    valueEncoderVelocity_;
 };
 
 
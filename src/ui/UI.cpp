@@ -9,6 +9,24 @@ void UiPage::Close()
         parent_->ClosePage(*this);
 }
 
+void UiPage::Invalidate()
+{
+    if(parent_ != nullptr)
+        parent_->InvalidateAllCanvases();
+}
+
+void UiPage::Invalidate(uint8_t canvasId)
+{
+    if(parent_ != nullptr)
+        parent_->InvalidateCanvas(canvasId);
+}
+
+void UiPage::Invalidate(uint8_t canvasId, const Rectangle& region)
+{
+    if(parent_ != nullptr)
+        parent_->InvalidateCanvas(canvasId, region);
+}
+
 // =========================================================================
 
 // =========================================================================
@@ -28,7 +46,13 @@ void UI::Init(UiEventQueue&                             inputQueue,
     primaryOneBitGraphicsDisplayId_ = primaryOneBitGraphicsDisplayId;
 
     for(int i = 0; i < kMaxNumCanvases; i++)
+    {
         lastUpdateTimes_[i] = 0;
+        isDirty_[i]         = false;
+        isFullyDirty_[i]    = false;
+        dirtyRegions_[i]    = Rectangle();
+    }
+    InvalidateAllCanvases();
 }
 
 UI::~UI()
@@ -44,7 +68,11 @@ void UI::Process()
     // handle user input
     if(!isMuted_)
     {
-        while(!eventQueue_->IsQueueEmpty())
+        // Only process the events that were queued before this call. Encoder
+        // turns and pot movements are coalesced in the queue, so each of these
+        // controls is handled at most once per call.
+        size_t numEventsToProcess = eventQueue_->GetNumEventsInQueue();
+        while((numEventsToProcess-- > 0) && !eventQueue_->IsQueueEmpty())
         {
             // clear next event if screen is off
             for(uint32_t i = 0; i < canvases_.GetNumElements(); i++)
@@ -53,6 +81,7 @@ void UI::Process()
                 {
                     eventQueue_->GetAndRemoveNextEvent();
                     canvases_[i].screenSaverOn = false;
+                    InvalidateCanvasAtIndex(i);
                     break;
                 }
             }
@@ -82,10 +111,12 @@ void UI::Process()
                   < canvases_[i].screenSaverTimeOut)
         {
             const uint32_t timeDiff = currentTimeInMs - lastUpdateTimes_[i];
-            if(timeDiff > canvases_[i].updateRateMs_)
+            const bool     needsRedraw
+                = isDirty_[i] || !canvases_[i].redrawOnlyWhenInvalidated_;
+            if(needsRedraw && (timeDiff > canvases_[i].updateRateMs_))
                 RedrawCanvas(i, currentTimeInMs);
         }
-        else
+        else if(!canvases_[i].screenSaverOn)
         { // turn off oled
             canvases_[i].clearFunction_(canvases_[i]);
             canvases_[i].flushFunction_(canvases_[i]);
@@ -119,6 +150,7 @@ void UI::OpenPage(UiPage& page)
     pages_.PushBack(&page);
     page.parent_ = this;
     page.OnShow();
+    InvalidateAllCanvases();
 
     // was there a page below?
     if(pages_.GetNumElements() > 1)
@@ -160,6 +192,45 @@ void UI::ClosePage(UiPage& page)
     // close the page
     page.OnHide();
     page.parent_ = nullptr;
+    InvalidateAllCanvases();
+}
+
+void UI::InvalidateAllCanvases()
+{
+    for(uint32_t i = 0; i < canvases_.GetNumElements(); i++)
+        InvalidateCanvasAtIndex(i);
+}
+
+void UI::InvalidateCanvas(uint8_t canvasId)
+{
+    for(uint32_t i = 0; i < canvases_.GetNumElements(); i++)
+    {
+        if(canvases_[i].id_ == canvasId)
+            InvalidateCanvasAtIndex(i);
+    }
+}
+
+void UI::InvalidateCanvas(uint8_t canvasId, const Rectangle& region)
+{
+    if(region.IsEmpty())
+        return;
+
+    for(uint32_t i = 0; i < canvases_.GetNumElements(); i++)
+    {
+        if(canvases_[i].id_ != canvasId)
+            continue;
+        // merge with the regions invalidated since the last redraw
+        if(!isFullyDirty_[i])
+            dirtyRegions_[i] = dirtyRegions_[i].GetUnion(region);
+        isDirty_[i] = true;
+    }
+}
+
+void UI::InvalidateCanvasAtIndex(uint32_t index)
+{
+    isDirty_[index]      = true;
+    isFullyDirty_[index] = true;
+    dirtyRegions_[index] = Rectangle();
 }
 
 void UI::ProcessEvent(const UiEventQueue::Event& e)
@@ -269,6 +340,14 @@ void UI::RedrawCanvas(uint8_t index, uint32_t currentTimeInSysticks)
     if(firstToDraw < 0)
         firstToDraw = 0;
 
+    // tell the canvas which region has changed. An empty region is used
+    // to signal that the entire canvas has changed.
+    canvas.dirtyRegion_
+        = isFullyDirty_[index] ? Rectangle() : dirtyRegions_[index];
+    isDirty_[index]      = false;
+    isFullyDirty_[index] = false;
+    dirtyRegions_[index] = Rectangle();
+
     // clear canvas
     canvas.clearFunction_(canvas);
 
@@ -2,6 +2,7 @@
 #include <initializer_list>
 #include "UiEventQueue.h"
 #include "../util/Stack.h"
+#include "../hid/disp/graphics_common.h"
 
 namespace daisy
 {
@@ -63,6 +64,20 @@ struct UiCanvasDescriptor
      */
     using FlushFuncPtr = void (*)(const UiCanvasDescriptor& canvasToFlush);
     FlushFuncPtr flushFunction_;
+
+    /** If true, the canvas is only redrawn after it was invalidated, e.g. 
+     *  by a call to UiPage::Invalidate() or when pages were opened or closed.
+     *  The update rate still limits how often the canvas is redrawn.
+     *  If false (default), the canvas is redrawn continuously at the update rate.
+     */
+    bool redrawOnlyWhenInvalidated_ = false;
+
+    /** The region that was invalidated since the last redraw. This is set by the 
+     *  UI before the canvas is cleared, drawn and flushed, so that the flush function 
+     *  can choose to transfer only this part to the device. An empty Rectangle 
+     *  means that the entire canvas must be flushed.
+     */
+    Rectangle dirtyRegion_;
 };
 
 class OneBitGraphicsLookAndFeel;
@@ -323,6 +338,26 @@ class UiPage
     /** Called when the page is no longer the topmost page in the page stack. */
     virtual void OnFocusLost(){};
 
+    /** Marks all canvases as changed, so that they are redrawn on the next
+     *  call to UI::Process(). Call this whenever the state displayed by this
+     *  page has changed. Has no effect if the page is not added to a UI.
+     */
+    void Invalidate();
+
+    /** Marks an entire canvas as changed, so that it's redrawn on the next 
+     *  call to UI::Process().
+     *  @param canvasId     The id_ of the UiCanvasDescriptor to invalidate.
+     */
+    void Invalidate(uint8_t canvasId);
+
+    /** Marks a region of a canvas as changed, so that it's redrawn on the next 
+     *  call to UI::Process(). Regions invalidated between two redraws are merged 
+     *  and passed to the flush function in UiCanvasDescriptor::dirtyRegion_.
+     *  @param canvasId     The id_ of the UiCanvasDescriptor to invalidate.
+     *  @param region       The region that has changed.
+     */
+    void Invalidate(uint8_t canvasId, const Rectangle& region);
+
     /** Called to make the UIPage repaint everything on a canvas. 
      *  Check the ID to determine which display this corresponds to.
      *  Cast the handle to the corresponding type and do your draw operations on it.
@@ -356,7 +391,10 @@ class UiPage
  *  used for the drawing, where each canvas could be a graphics display, 
  *  LEDs, alphanumeric displays, etc. The UI system makes sure that drawing 
  *  is executed with a constant refresh rate that can be individually 
- *  specified for each canvas.
+ *  specified for each canvas. Canvases can also be configured to only redraw
+ *  after pages have invalidated them (see UiPage::Invalidate() and
+ *  UiCanvasDescriptor::redrawOnlyWhenInvalidated_), which avoids redrawing
+ *  static content over and over again.
  */
 class UI
 {
@@ -445,6 +483,18 @@ class UI
         return specialControlIds_;
     }
 
+    /** Marks all canvases as changed so that they're redrawn on the next call 
+     *  to Process(). @see UiPage::Invalidate() */
+    void InvalidateAllCanvases();
+
+    /** Marks an entire canvas as changed so that it's redrawn on the next call 
+     *  to Process(). @see UiPage::Invalidate() */
+    void InvalidateCanvas(uint8_t canvasId);
+
+    /** Marks a region of a canvas as changed so that it's redrawn on the next 
+     *  call to Process(). @see UiPage::Invalidate() */
+    void InvalidateCanvas(uint8_t canvasId, const Rectangle& region);
+
   private:
     bool                                       isMuted_;
     bool                                       queueEvents_;
@@ -453,6 +503,9 @@ class UI
     Stack<UiPage*, kMaxNumPages>               pages_;
     Stack<UiCanvasDescriptor, kMaxNumCanvases> canvases_;
     uint32_t          lastUpdateTimes_[kMaxNumCanvases];
+    bool              isDirty_[kMaxNumCanvases];
+    bool              isFullyDirty_[kMaxNumCanvases];
+    Rectangle         dirtyRegions_[kMaxNumCanvases];
     uint32_t          lastEventTime_;
     UiEventQueue*     eventQueue_;
     SpecialControlIds specialControlIds_;
@@ -463,6 +516,7 @@ class UI
     void AddPage(UiPage* p);
     void ProcessEvent(const UiEventQueue::Event& m);
     void RedrawCanvas(uint8_t index, uint32_t currentTimeInMs);
+    void InvalidateCanvasAtIndex(uint32_t index);
     void ForwardToButtonHandler(uint16_t buttonID,
                                 uint8_t  numberOfPresses,
                                 bool     isRetriggering);
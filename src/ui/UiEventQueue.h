@@ -1,7 +1,7 @@
 #pragma once
 #include <stdint.h>
-#include "../util/FIFO.h"
-#include "../util/scopedirqblocker.h"
+#include <atomic>
+#include "../util/LockFreeFIFO.h"
 
 namespace daisy
 {
@@ -11,8 +11,17 @@ namespace daisy
  * 
  * A queue that holds user interface events such as button presses or encoder turns.
  * The queue can be filled from hardware drivers and read from a UI object.
- * Access to the queue is protected by a ScopedIrqBlocker - that means it's safe to add
- * events from interrupt handlers.
+ * The queue is lock-free - events can be added from interrupt handlers and from 
+ * multiple producers concurrently without disabling interrupts. Only a single 
+ * consumer (usually the UI) should read events from the queue.
+ * 
+ * Consecutive encoder turns and pot movements are coalesced: While an event for an
+ * encoder is waiting in the queue, additional turns are added to that event. 
+ * Likewise, a waiting pot movement event is updated with the latest position.
+ * This way, fast encoder spins or noisy pots can't flood the queue and the UI 
+ * processes at most one turn/movement event per control each time it reads 
+ * the queue. Up to kMaxNumCoalescedEncoders encoders and kMaxNumCoalescedPots 
+ * pots are coalesced, additional controls are queued without coalescing.
  */
 class UiEventQueue
 {
@@ -110,11 +119,18 @@ class UiEventQueue
         };
     };
 
+    /** The maximum number of encoders for which turns are coalesced. */
+    static constexpr int kMaxNumCoalescedEncoders = 16;
+
+    /** The maximum number of pots for which movements are coalesced. */
+    static constexpr int kMaxNumCoalescedPots = 32;
+
     UiEventQueue() {}
     ~UiEventQueue() {}
 
-    /** Adds a Event::EventType::buttonPressed event to the queue. */
-    void AddButtonPressed(uint16_t buttonID,
+    /** Adds a Event::EventType::buttonPressed event to the queue.
+     *  Returns false if the queue was full. */
+    bool AddButtonPressed(uint16_t buttonID,
                           uint16_t numSuccessivePresses,
                           bool     isRetriggering = false)
     {
@@ -123,22 +139,23 @@ class UiEventQueue
         e.asButtonPressed.id = buttonID;
         e.asButtonPressed.numSuccessivePresses = numSuccessivePresses;
         e.asButtonPressed.isRetriggering       = isRetriggering;
-        ScopedIrqBlocker sIrqBl;
-        events_.PushBack(e);
+        return PushUncoalescedEvent(e);
     }
 
-    /** Adds a Event::EventType::buttonReleased event to the queue. */
-    void AddButtonReleased(uint16_t buttonID)
+    /** Adds a Event::EventType::buttonReleased event to the queue.
+     *  Returns false if the queue was full. */
+    bool AddButtonReleased(uint16_t buttonID)
     {
         Event m;
         m.type                = Event::EventType::buttonReleased;
         m.asButtonReleased.id = buttonID;
-        ScopedIrqBlocker sIrqBl;
-        events_.PushBack(m);
+        return PushUncoalescedEvent(m);
     }
 
-    /** Adds a Event::EventType::encoderTurned event to the queue. */
-    void AddEncoderTurned(uint16_t encoderID,
+    /** Adds a Event::EventType::encoderTurned event to the queue. If an event
+     *  for this encoder is already waiting in the queue, the increments are 
+     *  added to the waiting event instead. Returns false if the queue was full. */
+    bool AddEncoderTurned(uint16_t encoderID,
                           int16_t  increments,
                           uint16_t stepsPerRev)
     {
@@ -147,12 +164,30 @@ class UiEventQueue
         e.asEncoderTurned.id          = encoderID;
         e.asEncoderTurned.increments  = increments;
         e.asEncoderTurned.stepsPerRev = stepsPerRev;
-        ScopedIrqBlocker sIrqBl;
-        events_.PushBack(e);
+
+        EncoderSlot* slot = FindSlot(encoderSlots_, encoderID, true);
+        if(slot == nullptr)
+            // too many encoders - queue without coalescing
+            return PushUncoalescedEvent(e);
+
+        slot->stepsPerRev.store(stepsPerRev, std::memory_order_relaxed);
+        slot->increments.fetch_add(increments, std::memory_order_acq_rel);
+        if(slot->isQueued.exchange(true, std::memory_order_acq_rel))
+            return true; // the waiting event will pick up our increments
+
+        // the increments are read from the slot when the event is removed
+        e.asEncoderTurned.increments = 0;
+        if(events_.PushBack(e))
+            return true;
+        // queue is full. The increments stay in the slot and will be
+        // delivered with the next turn of this encoder.
+        slot->isQueued.store(false, std::memory_order_release);
+        return false;
     }
 
-    /** Adds a Event::EventType::encoderActivityChanged event to the queue. */
-    void AddEncoderActivityChanged(uint16_t encoderId, bool isActive)
+    /** Adds a Event::EventType::encoderActivityChanged event to the queue.
+     *  Returns false if the queue was full. */
+    bool AddEncoderActivityChanged(uint16_t encoderId, bool isActive)
     {
         Event e;
         e.type = Event::EventType::encoderActivityChanged;
@@ -160,23 +195,38 @@ class UiEventQueue
         e.asEncoderActivityChanged.newActivityType
             = isActive ? Event::ActivityType::active
                        : Event::ActivityType::inactive;
-        ScopedIrqBlocker sIrqBl;
-        events_.PushBack(e);
+        return PushUncoalescedEvent(e);
     }
 
-    /** Adds a Event::EventType::potMoved event to the queue. */
-    void AddPotMoved(uint16_t potId, float newPosition)
+    /** Adds a Event::EventType::potMoved event to the queue. If an event 
+     *  for this pot is already waiting in the queue, the waiting event is 
+     *  updated to the new position instead. Returns false if the queue was full. */
+    bool AddPotMoved(uint16_t potId, float newPosition)
     {
         Event e;
         e.type                   = Event::EventType::potMoved;
         e.asPotMoved.id          = potId;
         e.asPotMoved.newPosition = newPosition;
-        ScopedIrqBlocker sIrqBl;
-        events_.PushBack(e);
+
+        PotSlot* slot = FindSlot(potSlots_, potId, true);
+        if(slot == nullptr)
+            // too many pots - queue without coalescing
+            return PushUncoalescedEvent(e);
+
+        slot->position.store(newPosition, std::memory_order_release);
+        slot->numUpdates.fetch_add(1, std::memory_order_acq_rel);
+        if(slot->isQueued.exchange(true, std::memory_order_acq_rel))
+            return true; // the waiting event will pick up our position
+
+        if(events_.PushBack(e))
+            return true;
+        slot->isQueued.store(false, std::memory_order_release);
+        return false;
     }
 
-    /** Adds a Event::EventType::potActivityChanged event to the queue. */
-    void AddPotActivityChanged(uint16_t potId, bool isActive)
+    /** Adds a Event::EventType::potActivityChanged event to the queue.
+     *  Returns false if the queue was full. */
+    bool AddPotActivityChanged(uint16_t potId, bool isActive)
     {
         Event e;
         e.type                    = Event::EventType::potActivityChanged;
@@ -184,35 +234,165 @@ class UiEventQueue
         e.asPotActivityChanged.newActivityType
             = isActive ? Event::ActivityType::active
                        : Event::ActivityType::inactive;
-        ScopedIrqBlocker sIrqBl;
-        events_.PushBack(e);
+        return PushUncoalescedEvent(e);
     }
 
-    /** Removes and returns an event from the queue. */
+    /** Removes and returns an event from the queue. Coalesced encoder turns and
+     *  pot movements are returned with the accumulated increments / the latest 
+     *  position. */
     Event GetAndRemoveNextEvent()
     {
-        ScopedIrqBlocker sIrqBl;
-        if(events_.IsEmpty())
+        Event e;
+        while(events_.PopFront(e))
+        {
+            if(e.type == Event::EventType::encoderTurned)
+            {
+                EncoderSlot* slot
+                    = FindSlot(encoderSlots_, e.asEncoderTurned.id, false);
+                if((slot != nullptr) && !TakeAccumulatedTurns(*slot, e))
+                    continue; // turns were delivered with a previous event
+            }
+            else if(e.type == Event::EventType::potMoved)
+            {
+                PotSlot* slot = FindSlot(potSlots_, e.asPotMoved.id, false);
+                if((slot != nullptr) && !TakeLatestPosition(*slot, e))
+                    continue; // position was delivered with a previous event
+            }
+            return e;
+        }
+
+        e.type = Event::EventType::invalid;
+        return e;
+    }
+
+    /** Returns true, if the queue is empty. */
+    bool IsQueueEmpty() { return events_.IsEmpty(); }
+
+    /** Returns the number of events waiting in the queue. */
+    size_t GetNumEventsInQueue() const { return events_.GetNumElements(); }
+
+  private:
+    UiEventQueue(const UiEventQueue&) = delete;
+    UiEventQueue& operator=(const UiEventQueue&) = delete;
+
+    static constexpr uint32_t kFreeSlotId = UINT32_MAX;
+    static constexpr size_t   kQueueSize  = 256;
+    /** Space in the queue that's reserved for the events of coalesced 
+     *  controls, one for each slot. */
+    static constexpr size_t kNumReservedEvents
+        = kMaxNumCoalescedEncoders + kMaxNumCoalescedPots;
+
+    /** Accumulates the turns of an encoder while an event is waiting in the queue */
+    struct EncoderSlot
+    {
+        std::atomic<uint32_t> id{kFreeSlotId};
+        std::atomic<bool>     isQueued{false};
+        std::atomic<int32_t>  increments{0};
+        std::atomic<uint16_t> stepsPerRev{0};
+    };
+
+    /** Holds the latest position of a pot while an event is waiting in the queue */
+    struct PotSlot
+    {
+        std::atomic<uint32_t> id{kFreeSlotId};
+        std::atomic<bool>     isQueued{false};
+        std::atomic<float>    position{0.0f};
+        std::atomic<uint32_t> numUpdates{0};
+        /** only accessed by the consumer */
+        uint32_t numUpdatesDelivered = 0;
+    };
+
+    /** Returns the slot used for a control or nullptr if there is none.
+     *  Slots are claimed in ascending order and never released, so each 
+     *  control ID is assigned to exactly one slot, even if multiple
+     *  producers try to claim a slot for it at the same time. */
+    template <typename SlotType, int numSlots>
+    static SlotType*
+    FindSlot(SlotType (&slots)[numSlots], uint16_t id, bool claimIfNotFound)
+    {
+        for(int i = 0; i < numSlots; i++)
         {
-            Event m;
-            m.type = Event::EventType::invalid;
-            return m;
+            uint32_t slotId = slots[i].id.load(std::memory_order_acquire);
+            if(slotId == kFreeSlotId)
+            {
+                if(!claimIfNotFound)
+                    return nullptr;
+                // If another producer was faster, slotId is updated to the
+                // ID it claimed this slot for.
+                if(slots[i].id.compare_exchange_strong(
+                       slotId, id, std::memory_order_acq_rel))
+                    return &slots[i];
+            }
+            if(slotId == id)
+                return &slots[i];
         }
-        else
+        return nullptr;
+    }
+
+    /** Moves the increments accumulated in a slot into an encoderTurned
+     *  event. Returns false if there were no increments to deliver. */
+    bool TakeAccumulatedTurns(EncoderSlot& slot, Event& e)
+    {
+        // clear the flag first, so that turns arriving from now
+        // on will post a new event.
+        slot.isQueued.store(false, std::memory_order_release);
+
+        // take as many increments as fit into the event
+        int32_t increments = slot.increments.load(std::memory_order_acquire);
+        int32_t toTake;
+        do
+        {
+            toTake = (increments > INT16_MAX)   ? INT16_MAX
+                     : (increments < INT16_MIN) ? INT16_MIN
+                                                : increments;
+        } while(!slot.increments.compare_exchange_weak(
+            increments, increments - toTake, std::memory_order_acq_rel));
+
+        if(toTake == 0)
+            return false;
+
+        // post another event for the remaining increments
+        if((increments != toTake)
+           && !slot.isQueued.exchange(true, std::memory_order_acq_rel))
         {
-            return events_.PopFront();
+            if(!events_.PushBack(e))
+                slot.isQueued.store(false, std::memory_order_release);
         }
+
+        e.asEncoderTurned.increments = int16_t(toTake);
+        e.asEncoderTurned.stepsPerRev
+            = slot.stepsPerRev.load(std::memory_order_relaxed);
+        return true;
     }
 
-    /** Returns true, if the queue is empty. */
-    bool IsQueueEmpty()
+    /** Moves the latest position stored in a slot into a potMoved event.
+     *  Returns false if this position was already delivered. */
+    bool TakeLatestPosition(PotSlot& slot, Event& e)
     {
-        ScopedIrqBlocker sIrqBl;
-        return events_.IsEmpty();
+        slot.isQueued.store(false, std::memory_order_release);
+        const uint32_t numUpdates
+            = slot.numUpdates.load(std::memory_order_acquire);
+        if(numUpdates == slot.numUpdatesDelivered)
+            return false;
+        slot.numUpdatesDelivered = numUpdates;
+        e.asPotMoved.newPosition = slot.position.load(std::memory_order_acquire);
+        return true;
     }
 
-  private:
-    FIFO<Event, 256> events_;
+    /** Adds an event that is not coalesced. Space for the events of 
+     *  coalesced controls is kept free, so that their accumulated turns 
+     *  and movements can always be delivered, even if other controls
+     *  flood the queue. */
+    bool PushUncoalescedEvent(const Event& e)
+    {
+        if(events_.GetNumElements() >= kQueueSize - kNumReservedEvents)
+            return false;
+        return events_.PushBack(e);
+    }
+
+    LockFreeFIFO<Event, kQueueSize> events_;
+    EncoderSlot              encoderSlots_[kMaxNumCoalescedEncoders];
+    PotSlot                  potSlots_[kMaxNumCoalescedPots];
 };
 
-} // namespace daisy
\ No newline at end of file
+} // namespace daisy
@@ -0,0 +1,717 @@
+/**
+  ******************************************************************************
+  * @file           : usbd_audio2.c
+  * @brief          : USB Audio Class 2.0 device class
+  ******************************************************************************
+  * An audio function with one fixed rate clock and up to two streams:
+  *
+  *   OUT: USB streaming -> line out, isochronous asynchronous, with an
+  *        explicit feedback endpoint
+  *   IN:  line in -> USB streaming, isochronous asynchronous
+  *
+  * The descriptors are built at runtime from USBD_AUDIO2_ConfigTypeDef, so
+  * the channel count and the sample format follow the application. Both
+  * USB peripherals run at full speed, so there's only one set of them.
+  *
+  * Packets are queued at the start of frame, the application measures its
+  * audio clock against the same event, see util/UsbAudioSync.h.
+  */
+
+#include "usbd_audio2.h"
+#include "usbd_ctlreq.h"
+
+/* Entities of the audio function */
+#define AUDIO2_CLOCK_ID 0x10U
+#define AUDIO2_OUT_IT_ID 0x01U /* USB streaming in from the host */
+#define AUDIO2_OUT_OT_ID 0x02U /* line out */
+#define AUDIO2_IN_IT_ID 0x03U  /* line in */
+#define AUDIO2_IN_OT_ID 0x04U  /* USB streaming out to the host */
+
+/* Class specific requests and controls */
+#define AUDIO2_REQ_CUR 0x01U
+#define AUDIO2_REQ_RANGE 0x02U
+#define AUDIO2_CS_SAM_FREQ 0x01U
+#define AUDIO2_CS_CLOCK_VALID 0x02U
+
+static uint8_t USBD_AUDIO2_Init(USBD_HandleTypeDef *pdev, uint8_t cfgidx);
+static uint8_t USBD_AUDIO2_DeInit(USBD_HandleTypeDef *pdev, uint8_t cfgidx);
+static uint8_t USBD_AUDIO2_Setup(USBD_HandleTypeDef   *pdev,
+                                 USBD_SetupReqTypedef *req);
+static uint8_t USBD_AUDIO2_DataIn(USBD_HandleTypeDef *pdev, uint8_t epnum);
+static uint8_t USBD_AUDIO2_DataOut(USBD_HandleTypeDef *pdev, uint8_t epnum);
+static uint8_t USBD_AUDIO2_SOF(USBD_HandleTypeDef *pdev);
+static uint8_t USBD_AUDIO2_IsoINIncomplete(USBD_HandleTypeDef *pdev,
+                                           uint8_t             epnum);
+static uint8_t USBD_AUDIO2_IsoOUTIncomplete(USBD_HandleTypeDef *pdev,
+                                            uint8_t             epnum);
+static uint8_t *USBD_AUDIO2_GetCfgDesc(uint16_t *length);
+static uint8_t *USBD_AUDIO2_GetDeviceQualifierDesc(uint16_t *length);
+
+USBD_ClassTypeDef USBD_AUDIO2 = {
+    USBD_AUDIO2_Init,
+    USBD_AUDIO2_DeInit,
+    USBD_AUDIO2_Setup,
+    NULL, /* EP0_TxSent */
+    NULL, /* EP0_RxReady, the clock can't be set */
+    USBD_AUDIO2_DataIn,
+    USBD_AUDIO2_DataOut,
+    USBD_AUDIO2_SOF,
+    USBD_AUDIO2_IsoINIncomplete,
+    USBD_AUDIO2_IsoOUTIncomplete,
+    USBD_AUDIO2_GetCfgDesc,
+    USBD_AUDIO2_GetCfgDesc,
+    USBD_AUDIO2_GetCfgDesc,
+    USBD_AUDIO2_GetDeviceQualifierDesc,
+};
+
+__ALIGN_BEGIN static uint8_t
+    USBD_AUDIO2_DeviceQualifierDesc[USB_LEN_DEV_QUALIFIER_DESC] __ALIGN_END
+    = {
+        USB_LEN_DEV_QUALIFIER_DESC,
+        USB_DESC_TYPE_DEVICE_QUALIFIER,
+        0x00,
+        0x02,
+        0x00,
+        0x00,
+        0x00,
+        0x40,
+        0x01,
+        0x00,
+};
+
+__ALIGN_BEGIN static uint8_t
+    USBD_AUDIO2_CfgDesc[AUDIO2_CFG_DESC_MAX_SIZE] __ALIGN_END;
+static uint16_t                  USBD_AUDIO2_CfgDescSize = 0U;
+static USBD_AUDIO2_ConfigTypeDef USBD_AUDIO2_Config;
+static uint8_t                   USBD_AUDIO2_OutItf = 0xffU;
+static uint8_t                   USBD_AUDIO2_InItf  = 0xffU;
+
+/* Descriptor building ------------------------------------------------------*/
+
+static uint8_t *Put8(uint8_t *p, uint8_t value)
+{
+    *p++ = value;
+    return p;
+}
+
+static uint8_t *Put16(uint8_t *p, uint16_t value)
+{
+    *p++ = LOBYTE(value);
+    *p++ = HIBYTE(value);
+    return p;
+}
+
+static uint8_t *Put32(uint8_t *p, uint32_t value)
+{
+    p = Put16(p, (uint16_t)(value & 0xffffU));
+    return Put16(p, (uint16_t)(value >> 16));
+}
+
+uint16_t USBD_AUDIO2_GetMaxPacketSize(uint8_t num_channels)
+{
+    /* one sample more than the nominal rate, for the feedback to work with */
+    const uint32_t frames
+        = (USBD_AUDIO2_Config.sample_rate + 999U) / 1000U + 1U;
+    return (uint16_t)(frames * num_channels * USBD_AUDIO2_Config.subslot_size);
+}
+
+/* Input and output terminal of one direction */
+static uint8_t *PutTerminals(uint8_t *p,
+                             uint8_t  it_id,
+                             uint16_t it_type,
+                             uint8_t  ot_id,
+                             uint16_t ot_type,
+                             uint8_t  num_channels)
+{
+    p = Put8(p, 17U);   /* bLength */
+    p = Put8(p, 0x24U); /* CS_INTERFACE */
+    p = Put8(p, 0x02U); /* INPUT_TERMINAL */
+    p = Put8(p, it_id);
+    p = Put16(p, it_type);
+    p = Put8(p, 0x00U); /* bAssocTerminal */
+    p = Put8(p, AUDIO2_CLOCK_ID);
+    p = Put8(p, num_channels);
+    p = Put32(p, 0U);   /* bmChannelConfig, no spatial positions */
+    p = Put8(p, 0x00U); /* iChannelNames */
+    p = Put16(p, 0U);   /* bmControls */
+    p = Put8(p, 0x00U); /* iTerminal */
+
+    p = Put8(p, 12U);
+    p = Put8(p, 0x24U);
+    p = Put8(p, 0x03U); /* OUTPUT_TERMINAL */
+    p = Put8(p, ot_id);
+    p = Put16(p, ot_type);
+    p = Put8(p, 0x00U); /* bAssocTerminal */
+    p = Put8(p, it_id); /* bSourceID */
+    p = Put8(p, AUDIO2_CLOCK_ID);
+    p = Put16(p, 0U); /* bmControls */
+    p = Put8(p, 0x00U);
+    return p;
+}
+
+/* Streaming interface with alternate settings 0 (idle) and 1 */
+static uint8_t *PutStreamingInterface(uint8_t *p,
+                                      uint8_t  itf,
+                                      uint8_t  terminal,
+                                      uint8_t  num_channels,
+                                      uint8_t  ep_addr,
+                                      uint8_t  feedback)
+{
+    uint8_t alt;
+    for(alt = 0U; alt < 2U; alt++)
+    {
+        p = Put8(p, 9U);
+        p = Put8(p, USB_DESC_TYPE_INTERFACE);
+        p = Put8(p, itf);
+        p = Put8(p, alt);
+        p = Put8(p, alt == 0U ? 0U : (feedback ? 2U : 1U));
+        p = Put8(p, 0x01U); /* AUDIO */
+        p = Put8(p, 0x02U); /* AUDIOSTREAMING */
+        p = Put8(p, 0x20U); /* IP_VERSION_02_00 */
+        p = Put8(p, 0x00U);
+    }
+
+    p = Put8(p, 16U);
+    p = Put8(p, 0x24U);
+    p = Put8(p, 0x01U); /* AS_GENERAL */
+    p = Put8(p, terminal);
+    p = Put8(p, 0x00U); /* bmControls */
+    p = Put8(p, 0x01U); /* FORMAT_TYPE_I */
+    p = Put32(p, 1U);   /* PCM */
+    p = Put8(p, num_channels);
+    p = Put32(p, 0U);
+    p = Put8(p, 0x00U);
+
+    p = Put8(p, 6U);
+    p = Put8(p, 0x24U);
+    p = Put8(p, 0x02U); /* FORMAT_TYPE */
+    p = Put8(p, 0x01U); /* FORMAT_TYPE_I */
+    p = Put8(p, USBD_AUDIO2_Config.subslot_size);
+    p = Put8(p, USBD_AUDIO2_Config.bit_resolution);
+
+    p = Put8(p, 7U);
+    p = Put8(p, USB_DESC_TYPE_ENDPOINT);
+    p = Put8(p, ep_addr);
+    p = Put8(p, 0x05U); /* isochronous, asynchronous, data */
+    p = Put16(p, USBD_AUDIO2_GetMaxPacketSize(num_channels));
+    p = Put8(p, 0x01U); /* every frame */
+
+    p = Put8(p, 8U);
+    p = Put8(p, 0x25U); /* CS_ENDPOINT */
+    p = Put8(p, 0x01U); /* EP_GENERAL */
+    p = Put8(p, 0x00U);
+    p = Put8(p, 0x00U);
+    p = Put8(p, 0x00U); /* bLockDelayUnits */
+    p = Put16(p, 0U);
+
+    if(feedback)
+    {
+        p = Put8(p, 7U);
+        p = Put8(p, USB_DESC_TYPE_ENDPOINT);
+        p = Put8(p, AUDIO2_FEEDBACK_EP);
+        p = Put8(p, 0x11U); /* isochronous, feedback */
+        p = Put16(p, AUDIO2_FEEDBACK_SIZE);
+        p = Put8(p, 0x01U);
+    }
+    return p;
+}
+
+uint8_t USBD_AUDIO2_Configure(const USBD_AUDIO2_ConfigTypeDef *config)
+{
+    uint8_t *p, *ac_header, *ac_start;
+    uint8_t  num_itf = 1U;
+
+    USBD_AUDIO2_Config = *config;
+    if((config->out_channels == 0U && config->in_channels == 0U)
+       || config->subslot_size < 2U || config->subslot_size > 4U
+       || USBD_AUDIO2_GetMaxPacketSize(config->out_channels)
+              > AUDIO2_MAX_PACKET_SIZE
+       || USBD_AUDIO2_GetMaxPacketSize(config->in_channels)
+              > AUDIO2_MAX_PACKET_SIZE)
+    {
+        return (uint8_t)USBD_FAIL;
+    }
+    USBD_AUDIO2_OutItf = config->out_channels > 0U ? num_itf++ : 0xffU;
+    USBD_AUDIO2_InItf  = config->in_channels > 0U ? num_itf++ : 0xffU;
+
+    p = USBD_AUDIO2_CfgDesc;
+    p = Put8(p, 9U);
+    p = Put8(p, USB_DESC_TYPE_CONFIGURATION);
+    p = Put16(p, 0U); /* wTotalLength, below */
+    p = Put8(p, num_itf);
+    p = Put8(p, 0x01U);
+    p = Put8(p, 0x00U);
+    p = Put8(p, 0xC0U); /* self powered */
+    p = Put8(p, 0x32U); /* 100 mA */
+
+    /* interface association */
+    p = Put8(p, 8U);
+    p = Put8(p, 0x0BU);
+    p = Put8(p, 0x00U);
+    p = Put8(p, num_itf);
+    p = Put8(p, 0x01U); /* AUDIO */
+    p = Put8(p, 0x00U);
+    p = Put8(p, 0x20U); /* AF_VERSION_02_00 */
+    p = Put8(p, 0x00U);
+
+    /* audio control interface */
+    p = Put8(p, 9U);
+    p = Put8(p, USB_DESC_TYPE_INTERFACE);
+    p = Put8(p, 0x00U);
+    p = Put8(p, 0x00U);
+    p = Put8(p, 0x00U); /* no interrupt endpoint */
+    p = Put8(p, 0x01U); /* AUDIO */
+    p = Put8(p, 0x01U); /* AUDIOCONTROL */
+    p = Put8(p, 0x20U);
+    p = Put8(p, 0x00U);
+
+    ac_start = p;
+    p        = Put8(p, 9U);
+    p        = Put8(p, 0x24U);
+    p        = Put8(p, 0x01U); /* HEADER */
+    p        = Put16(p, 0x0200U);
+    p        = Put8(p, 0x08U); /* I/O box */
+    ac_header = p;
+    p         = Put16(p, 0U); /* wTotalLength, below */
+    p         = Put8(p, 0x00U);
+
+    p = Put8(p, 8U);
+    p = Put8(p, 0x24U);
+    p = Put8(p, 0x0AU); /* CLOCK_SOURCE */
+    p = Put8(p, AUDIO2_CLOCK_ID);
+    p = Put8(p, 0x01U); /* internal fixed clock */
+    p = Put8(p, 0x05U); /* frequency and validity readable */
+    p = Put8(p, 0x00U);
+    p = Put8(p, 0x00U);
+
+    if(config->out_channels > 0U)
+    {
+        p = PutTerminals(p,
+                         AUDIO2_OUT_IT_ID,
+                         0x0101U, /* USB streaming */
+                         AUDIO2_OUT_OT_ID,
+                         0x0603U, /* line connector */
+                         config->out_channels);
+    }
+    if(config->in_channels > 0U)
+    {
+        p = PutTerminals(p,
+                         AUDIO2_IN_IT_ID,
+                         0x0603U,
+                         AUDIO2_IN_OT_ID,
+                         0x0101U,
+                         config->in_channels);
+    }
+    Put16(ac_header, (uint16_t)(p - ac_start));
+
+    if(config->out_channels > 0U)
+    {
+        p = PutStreamingInterface(p,
+                                  USBD_AUDIO2_OutItf,
+                                  AUDIO2_OUT_IT_ID,
+                                  config->out_channels,
+                                  AUDIO2_OUT_EP,
+                                  1U);
+    }
+    if(config->in_channels > 0U)
+    {
+        p = PutStreamingInterface(p,
+                                  USBD_AUDIO2_InItf,
+                                  AUDIO2_IN_OT_ID,
+                                  config->in_channels,
+                                  AUDIO2_IN_EP,
+                                  0U);
+    }
+
+    USBD_AUDIO2_CfgDescSize = (uint16_t)(p - USBD_AUDIO2_CfgDesc);
+    Put16(USBD_AUDIO2_CfgDesc + 2, USBD_AUDIO2_CfgDescSize);
+    return (uint8_t)USBD_OK;
+}
+
+uint8_t USBD_AUDIO2_RegisterInterface(USBD_HandleTypeDef     *pdev,
+                                      USBD_AUDIO2_ItfTypeDef *fops)
+{
+    if(fops == NULL)
+    {
+        return (uint8_t)USBD_FAIL;
+    }
+    pdev->pUserData[pdev->classId] = fops;
+    return (uint8_t)USBD_OK;
+}
+
+/* Class callbacks ----------------------------------------------------------*/
+
+static USBD_AUDIO2_ItfTypeDef *GetItf(USBD_HandleTypeDef *pdev)
+{
+    return (USBD_AUDIO2_ItfTypeDef *)pdev->pUserData[pdev->classId];
+}
+
+static USBD_AUDIO2_HandleTypeDef *GetHandle(USBD_HandleTypeDef *pdev)
+{
+    return (USBD_AUDIO2_HandleTypeDef *)pdev->pClassDataCmsit[pdev->classId];
+}
+
+static void OpenOutStream(USBD_HandleTypeDef        *pdev,
+                          USBD_AUDIO2_HandleTypeDef *haudio)
+{
+    const uint16_t size
+        = USBD_AUDIO2_GetMaxPacketSize(USBD_AUDIO2_Config.out_channels);
+    (void)USBD_LL_OpenEP(pdev, AUDIO2_OUT_EP, USBD_EP_TYPE_ISOC, size);
+    pdev->ep_out[AUDIO2_OUT_EP & 0xFU].is_used = 1U;
+    (void)USBD_LL_OpenEP(
+        pdev, AUDIO2_FEEDBACK_EP, USBD_EP_TYPE_ISOC, AUDIO2_FEEDBACK_SIZE);
+    pdev->ep_in[AUDIO2_FEEDBACK_EP & 0xFU].is_used = 1U;
+    haudio->feedback_busy                          = 0U;
+    (void)USBD_LL_PrepareReceive(
+        pdev, AUDIO2_OUT_EP, (uint8_t *)haudio->out_packet, size);
+}
+
+static void CloseOutStream(USBD_HandleTypeDef *pdev)
+{
+    (void)USBD_LL_FlushEP(pdev, AUDIO2_FEEDBACK_EP);
+    (void)USBD_LL_CloseEP(pdev, AUDIO2_OUT_EP);
+    (void)USBD_LL_CloseEP(pdev, AUDIO2_FEEDBACK_EP);
+    pdev->ep_out[AUDIO2_OUT_EP & 0xFU].is_used     = 0U;
+    pdev->ep_in[AUDIO2_FEEDBACK_EP & 0xFU].is_used = 0U;
+}
+
+static void OpenInStream(USBD_HandleTypeDef        *pdev,
+                         USBD_AUDIO2_HandleTypeDef *haudio)
+{
+    const uint16_t size
+        = USBD_AUDIO2_GetMaxPacketSize(USBD_AUDIO2_Config.in_channels);
+    (void)USBD_LL_OpenEP(pdev, AUDIO2_IN_EP, USBD_EP_TYPE_ISOC, size);
+    pdev->ep_in[AUDIO2_IN_EP & 0xFU].is_used = 1U;
+    haudio->in_busy                          = 0U;
+}
+
+static void CloseInStream(USBD_HandleTypeDef *pdev)
+{
+    (void)USBD_LL_FlushEP(pdev, AUDIO2_IN_EP);
+    (void)USBD_LL_CloseEP(pdev, AUDIO2_IN_EP);
+    pdev->ep_in[AUDIO2_IN_EP & 0xFU].is_used = 0U;
+}
+
+static uint8_t USBD_AUDIO2_Init(USBD_HandleTypeDef *pdev, uint8_t cfgidx)
+{
+    USBD_AUDIO2_HandleTypeDef *haudio;
+    UNUSED(cfgidx);
+
+    haudio = (USBD_AUDIO2_HandleTypeDef *)USBD_malloc(
+        sizeof(USBD_AUDIO2_HandleTypeDef));
+    if(haudio == NULL)
+    {
+        pdev->pClassDataCmsit[pdev->classId] = NULL;
+        return (uint8_t)USBD_EMEM;
+    }
+    (void)USBD_memset(haudio, 0, sizeof(USBD_AUDIO2_HandleTypeDef));
+    pdev->pClassDataCmsit[pdev->classId] = (void *)haudio;
+    pdev->pClassData = pdev->pClassDataCmsit[pdev->classId];
+
+    /* the streams start with SET_INTERFACE */
+    return (uint8_t)USBD_OK;
+}
+
+static uint8_t USBD_AUDIO2_DeInit(USBD_HandleTypeDef *pdev, uint8_t cfgidx)
+{
+    USBD_AUDIO2_HandleTypeDef *haudio = GetHandle(pdev);
+    UNUSED(cfgidx);
+
+    if(haudio == NULL)
+    {
+        return (uint8_t)USBD_OK;
+    }
+    if(haudio->alt_out != 0U)
+    {
+        CloseOutStream(pdev);
+        GetItf(pdev)->StreamChanged(1U, 0U);
+    }
+    if(haudio->alt_in != 0U)
+    {
+        CloseInStream(pdev);
+        GetItf(pdev)->StreamChanged(0U, 0U);
+    }
+    (void)USBD_free(haudio);
+    pdev->pClassDataCmsit[pdev->classId] = NULL;
+    pdev->pClassData                     = NULL;
+    return (uint8_t)USBD_OK;
+}
+
+/* Requests to the clock, the only entity with controls */
+static uint8_t ClassRequest(USBD_HandleTypeDef        *pdev,
+                            USBD_AUDIO2_HandleTypeDef *haudio,
+                            USBD_SetupReqTypedef      *req)
+{
+    const uint8_t entity  = HIBYTE(req->wIndex);
+    const uint8_t control = HIBYTE(req->wValue);
+    uint16_t      len     = 0U;
+    uint8_t      *p       = haudio->ctl_data;
+
+    if(entity != AUDIO2_CLOCK_ID)
+    {
+        return (uint8_t)USBD_FAIL;
+    }
+    if((req->bmRequest & 0x80U) == 0U)
+    {
+        /* the rate is fixed, accept and ignore SET_CUR */
+        if(req->bRequest != AUDIO2_REQ_CUR || control != AUDIO2_CS_SAM_FREQ
+           || req->wLength > sizeof(haudio->ctl_data))
+        {
+            return (uint8_t)USBD_FAIL;
+        }
+        (void)USBD_CtlPrepareRx(pdev, haudio->ctl_data, req->wLength);
+        return (uint8_t)USBD_OK;
+    }
+
+    if(req->bRequest == AUDIO2_REQ_CUR && control == AUDIO2_CS_SAM_FREQ)
+    {
+        p = Put32(p, USBD_AUDIO2_Config.sample_rate);
+    }
+    else if(req->bRequest == AUDIO2_REQ_CUR
+            && control == AUDIO2_CS_CLOCK_VALID)
+    {
+        p = Put8(p, 1U);
+    }
+    else if(req->bRequest == AUDIO2_REQ_RANGE
+            && control == AUDIO2_CS_SAM_FREQ)
+    {
+        p = Put16(p, 1U); /* one subrange */
+        p = Put32(p, USBD_AUDIO2_Config.sample_rate);
+        p = Put32(p, USBD_AUDIO2_Config.sample_rate);
+        p = Put32(p, 0U);
+    }
+    else
+    {
+        return (uint8_t)USBD_FAIL;
+    }
+    len = (uint16_t)(p - haudio->ctl_data);
+    (void)USBD_CtlSendData(pdev, haudio->ctl_data, MIN(len, req->wLength));
+    return (uint8_t)USBD_OK;
+}
+
+static uint8_t SetInterface(USBD_HandleTypeDef        *pdev,
+                            USBD_AUDIO2_HandleTypeDef *haudio,
+                            uint8_t                    itf,
+                            uint8_t                    alt)
+{
+    if(alt > 1U)
+    {
+        return (uint8_t)USBD_FAIL;
+    }
+    if(itf == USBD_AUDIO2_OutItf && alt != haudio->alt_out)
+    {
+        haudio->alt_out = alt;
+        if(alt != 0U)
+        {
+            OpenOutStream(pdev, haudio);
+        }
+        else
+        {
+            CloseOutStream(pdev);
+        }
+        GetItf(pdev)->StreamChanged(1U, alt);
+    }
+    else if(itf == USBD_AUDIO2_InItf && alt != haudio->alt_in)
+    {
+        haudio->alt_in = alt;
+        if(alt != 0U)
+        {
+            OpenInStream(pdev, haudio);
+        }
+        else
+        {
+            CloseInStream(pdev);
+        }
+        GetItf(pdev)->StreamChanged(0U, alt);
+    }
+    return (uint8_t)USBD_OK;
+}
+
+static uint8_t USBD_AUDIO2_Setup(USBD_HandleTypeDef   *pdev,
+                                 USBD_SetupReqTypedef *req)
+{
+    USBD_AUDIO2_HandleTypeDef *haudio = GetHandle(pdev);
+    uint8_t                    ret    = (uint8_t)USBD_OK;
+
+    if(haudio == NULL)
+    {
+        return (uint8_t)USBD_FAIL;
+    }
+
+    switch(req->bmRequest & USB_REQ_TYPE_MASK)
+    {
+        case USB_REQ_TYPE_CLASS: ret = ClassRequest(pdev, haudio, req); break;
+
+        case USB_REQ_TYPE_STANDARD:
+            if(pdev->dev_state != USBD_STATE_CONFIGURED)
+            {
+                ret = (uint8_t)USBD_FAIL;
+                break;
+            }
+            switch(req->bRequest)
+            {
+                /* the answers are sent after returning, so they can't live
+                 * on the stack */
+                case USB_REQ_GET_STATUS:
+                    haudio->ctl_data[0] = 0U;
+                    haudio->ctl_data[1] = 0U;
+                    (void)USBD_CtlSendData(pdev, haudio->ctl_data, 2U);
+                    break;
+
+                case USB_REQ_GET_INTERFACE:
+                    haudio->ctl_data[0] = 0U;
+                    if(LOBYTE(req->wIndex) == USBD_AUDIO2_OutItf)
+                    {
+                        haudio->ctl_data[0] = haudio->alt_out;
+                    }
+                    else if(LOBYTE(req->wIndex) == USBD_AUDIO2_InItf)
+                    {
+                        haudio->ctl_data[0] = haudio->alt_in;
+                    }
+                    (void)USBD_CtlSendData(pdev, haudio->ctl_data, 1U);
+                    break;
+
+                case USB_REQ_SET_INTERFACE:
+                    ret = SetInterface(pdev,
+                                       haudio,
+                                       LOBYTE(req->wIndex),
+                                       LOBYTE(req->wValue));
+                    break;
+
+                case USB_REQ_CLEAR_FEATURE: break;
+
+                default: ret = (uint8_t)USBD_FAIL; break;
+            }
+            break;
+
+        default: ret = (uint8_t)USBD_FAIL; break;
+    }
+
+    if(ret != (uint8_t)USBD_OK)
+    {
+        USBD_CtlError(pdev, req);
+    }
+    return ret;
+}
+
+static uint8_t USBD_AUDIO2_DataIn(USBD_HandleTypeDef *pdev, uint8_t epnum)
+{
+    USBD_AUDIO2_HandleTypeDef *haudio = GetHandle(pdev);
+    if(haudio == NULL)
+    {
+        return (uint8_t)USBD_FAIL;
+    }
+    if(epnum == (AUDIO2_FEEDBACK_EP & 0xFU))
+    {
+        haudio->feedback_busy = 0U;
+    }
+    else if(epnum == (AUDIO2_IN_EP & 0xFU))
+    {
+        haudio->in_busy = 0U;
+    }
+    return (uint8_t)USBD_OK;
+}
+
+static uint8_t USBD_AUDIO2_DataOut(USBD_HandleTypeDef *pdev, uint8_t epnum)
+{
+    USBD_AUDIO2_HandleTypeDef *haudio = GetHandle(pdev);
+    if(haudio == NULL || epnum != AUDIO2_OUT_EP || haudio->alt_out == 0U)
+    {
+        return (uint8_t)USBD_FAIL;
+    }
+    GetItf(pdev)->Received((const uint8_t *)haudio->out_packet,
+                           USBD_LL_GetRxDataSize(pdev, epnum));
+    (void)USBD_LL_PrepareReceive(
+        pdev,
+        AUDIO2_OUT_EP,
+        (uint8_t *)haudio->out_packet,
+        USBD_AUDIO2_GetMaxPacketSize(USBD_AUDIO2_Config.out_channels));
+    return (uint8_t)USBD_OK;
+}
+
+static uint8_t USBD_AUDIO2_SOF(USBD_HandleTypeDef *pdev)
+{
+    USBD_AUDIO2_HandleTypeDef *haudio = GetHandle(pdev);
+    USBD_AUDIO2_ItfTypeDef    *itf    = GetItf(pdev);
+    uint32_t                   value;
+
+    if(haudio == NULL)
+    {
+        return (uint8_t)USBD_FAIL;
+    }
+    itf->Sof();
+
+    /* queued now, sent in the next frame */
+    if(haudio->alt_out != 0U && haudio->feedback_busy == 0U)
+    {
+        value                 = itf->GetFeedback();
+        haudio->feedback[0]   = (uint8_t)value;
+        haudio->feedback[1]   = (uint8_t)(value >> 8);
+        haudio->feedback[2]   = (uint8_t)(value >> 16);
+        haudio->feedback_busy = 1U;
+        (void)USBD_LL_Transmit(
+            pdev, AUDIO2_FEEDBACK_EP, haudio->feedback, AUDIO2_FEEDBACK_SIZE);
+    }
+    if(haudio->alt_in != 0U && haudio->in_busy == 0U)
+    {
+        value = itf->FillPacket(
+            (uint8_t *)haudio->in_packet,
+            USBD_AUDIO2_GetMaxPacketSize(USBD_AUDIO2_Config.in_channels));
+        haudio->in_busy = 1U;
+        (void)USBD_LL_Transmit(
+            pdev, AUDIO2_IN_EP, (uint8_t *)haudio->in_packet, value);
+    }
+    return (uint8_t)USBD_OK;
+}
+
+static uint8_t USBD_AUDIO2_IsoINIncomplete(USBD_HandleTypeDef *pdev,
+                                           uint8_t             epnum)
+{
+    /* a packet missed its frame, drop it and queue again at the next SOF */
+    USBD_AUDIO2_HandleTypeDef *haudio = GetHandle(pdev);
+    UNUSED(epnum);
+    if(haudio == NULL)
+    {
+        return (uint8_t)USBD_FAIL;
+    }
+    if(haudio->alt_out != 0U && haudio->feedback_busy != 0U)
+    {
+        (void)USBD_LL_FlushEP(pdev, AUDIO2_FEEDBACK_EP);
+        haudio->feedback_busy = 0U;
+    }
+    if(haudio->alt_in != 0U && haudio->in_busy != 0U)
+    {
+        (void)USBD_LL_FlushEP(pdev, AUDIO2_IN_EP);
+        haudio->in_busy = 0U;
+    }
+    return (uint8_t)USBD_OK;
+}
+
+static uint8_t USBD_AUDIO2_IsoOUTIncomplete(USBD_HandleTypeDef *pdev,
+                                            uint8_t             epnum)
+{
+    USBD_AUDIO2_HandleTypeDef *haudio = GetHandle(pdev);
+    UNUSED(epnum);
+    if(haudio == NULL || haudio->alt_out == 0U)
+    {
+        return (uint8_t)USBD_FAIL;
+    }
+    (void)USBD_LL_PrepareReceive(
+        pdev,
+        AUDIO2_OUT_EP,
+        (uint8_t *)haudio->out_packet,
+        USBD_AUDIO2_GetMaxPacketSize(USBD_AUDIO2_Config.out_channels));
+    return (uint8_t)USBD_OK;
+}
+
+static uint8_t *USBD_AUDIO2_GetCfgDesc(uint16_t *length)
+{
+    *length = USBD_AUDIO2_CfgDescSize;
+    return USBD_AUDIO2_CfgDesc;
+}
+
+static uint8_t *USBD_AUDIO2_GetDeviceQualifierDesc(uint16_t *length)
+{
+    *length = (uint16_t)sizeof(USBD_AUDIO2_DeviceQualifierDesc);
+    return USBD_AUDIO2_DeviceQualifierDesc;
+}
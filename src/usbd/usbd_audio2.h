@@ -0,0 +1,84 @@
+/**
+  ******************************************************************************
+  * @file           : usbd_audio2.h
+  * @brief          : USB Audio Class 2.0 device class, see hid/usb_audio.h
+  ******************************************************************************
+  */
+
+#ifndef __USBD_AUDIO2_H__
+#define __USBD_AUDIO2_H__
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "usbd_ioreq.h"
+
+/** Streaming endpoints. The feedback endpoint belongs to the OUT stream. */
+#define AUDIO2_OUT_EP 0x01U
+#define AUDIO2_FEEDBACK_EP 0x81U
+#define AUDIO2_IN_EP 0x82U
+
+/** Largest isochronous packet at full speed */
+#define AUDIO2_MAX_PACKET_SIZE 1023U
+/** Size of the 10.14 feedback value at full speed */
+#define AUDIO2_FEEDBACK_SIZE 3U
+
+#define AUDIO2_CFG_DESC_MAX_SIZE 256U
+
+    /** Format of the streams, set before the device starts */
+    typedef struct
+    {
+        uint32_t sample_rate;    /**< Fixed sample rate in Hz */
+        uint8_t  out_channels;   /**< Host to device channels, 0 for none */
+        uint8_t  in_channels;    /**< Device to host channels, 0 for none */
+        uint8_t  subslot_size;   /**< Bytes per sample, 2, 3 or 4 */
+        uint8_t  bit_resolution; /**< Valid bits per sample */
+    } USBD_AUDIO2_ConfigTypeDef;
+
+    /** Callbacks into the application, all from the USB interrupt */
+    typedef struct
+    {
+        /** A stream was started (alternate setting 1) or stopped */
+        void (*StreamChanged)(uint8_t is_out, uint8_t active);
+        /** An OUT packet arrived */
+        void (*Received)(const uint8_t *data, uint32_t size);
+        /** Start of frame, before the IN packets are queued */
+        void (*Sof)(void);
+        /** @return the feedback in the 10.14 format */
+        uint32_t (*GetFeedback)(void);
+        /** Fills the next IN packet, returns its size in bytes */
+        uint32_t (*FillPacket)(uint8_t *data, uint32_t max_size);
+    } USBD_AUDIO2_ItfTypeDef;
+
+    typedef struct
+    {
+        uint8_t  alt_out;
+        uint8_t  alt_in;
+        uint8_t  feedback_busy;
+        uint8_t  in_busy;
+        uint8_t  ctl_data[16];
+        uint8_t  feedback[4];
+        uint32_t out_packet[AUDIO2_MAX_PACKET_SIZE / 4U + 1U];
+        uint32_t in_packet[AUDIO2_MAX_PACKET_SIZE / 4U + 1U];
+    } USBD_AUDIO2_HandleTypeDef;
+
+    extern USBD_ClassTypeDef USBD_AUDIO2;
+
+    /** Builds the descriptors for a format
+     *  @return USBD_FAIL if the packets don't fit into full speed frames
+     */
+    uint8_t USBD_AUDIO2_Configure(const USBD_AUDIO2_ConfigTypeDef *config);
+
+    /** @return the largest packet size in bytes of a stream */
+    uint16_t USBD_AUDIO2_GetMaxPacketSize(uint8_t num_channels);
+
+    uint8_t USBD_AUDIO2_RegisterInterface(USBD_HandleTypeDef     *pdev,
+                                          USBD_AUDIO2_ItfTypeDef *fops);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __USBD_AUDIO2_H__ */
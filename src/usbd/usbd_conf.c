@@ -24,6 +24,7 @@
 #include "stm32h7xx_hal.h"
 #include "usbd_def.h"
 #include "usbd_core.h"
+#include "usbd_cdc.h"
 
 /* USER CODE BEGIN Includes */
 
@@ -417,7 +418,8 @@ USBD_StatusTypeDef USBD_LL_Init(USBD_HandleTypeDef *pdev)
         hpcd_USB_OTG_FS.Init.speed                   = PCD_SPEED_FULL;
         hpcd_USB_OTG_FS.Init.dma_enable              = DISABLE;
         hpcd_USB_OTG_FS.Init.phy_itface              = PCD_PHY_EMBEDDED;
-        hpcd_USB_OTG_FS.Init.Sof_enable              = DISABLE;
+        hpcd_USB_OTG_FS.Init.Sof_enable
+            = usbd_mode == USBD_MODE_AUDIO2 ? ENABLE : DISABLE;
         hpcd_USB_OTG_FS.Init.low_power_enable        = DISABLE;
         hpcd_USB_OTG_FS.Init.lpm_enable              = DISABLE;
         hpcd_USB_OTG_FS.Init.battery_charging_enable = ENABLE;
@@ -454,9 +456,21 @@ USBD_StatusTypeDef USBD_LL_Init(USBD_HandleTypeDef *pdev)
         HAL_PCD_RegisterIsoInIncpltCallback(&hpcd_USB_OTG_FS,
                                             PCD_ISOINIncompleteCallback);
 #endif /* USE_HAL_PCD_REGISTER_CALLBACKS */
-        HAL_PCDEx_SetRxFiFo(&hpcd_USB_OTG_FS, 0x80);
-        HAL_PCDEx_SetTxFiFo(&hpcd_USB_OTG_FS, 0, 0x40);
-        HAL_PCDEx_SetTxFiFo(&hpcd_USB_OTG_FS, 1, 0x80);
+        if(usbd_mode == USBD_MODE_AUDIO2)
+        {
+            // isochronous packets of up to 1023 bytes each way, and the
+            // small feedback endpoint
+            HAL_PCDEx_SetRxFiFo(&hpcd_USB_OTG_FS, 0x120);
+            HAL_PCDEx_SetTxFiFo(&hpcd_USB_OTG_FS, 0, 0x40);
+            HAL_PCDEx_SetTxFiFo(&hpcd_USB_OTG_FS, 1, 0x10);
+            HAL_PCDEx_SetTxFiFo(&hpcd_USB_OTG_FS, 2, 0x100);
+        }
+        else
+        {
+            HAL_PCDEx_SetRxFiFo(&hpcd_USB_OTG_FS, 0x80);
+            HAL_PCDEx_SetTxFiFo(&hpcd_USB_OTG_FS, 0, 0x40);
+            HAL_PCDEx_SetTxFiFo(&hpcd_USB_OTG_FS, 1, 0x80);
+        }
     }
     if(pdev->id == DEVICE_HS)
     {
@@ -469,7 +483,8 @@ USBD_StatusTypeDef USBD_LL_Init(USBD_HandleTypeDef *pdev)
         hpcd_USB_OTG_HS.Init.speed                   = PCD_SPEED_FULL;
         hpcd_USB_OTG_HS.Init.dma_enable              = DISABLE;
         hpcd_USB_OTG_HS.Init.phy_itface              = USB_OTG_EMBEDDED_PHY;
-        hpcd_USB_OTG_HS.Init.Sof_enable              = DISABLE;
+        hpcd_USB_OTG_HS.Init.Sof_enable
+            = usbd_mode == USBD_MODE_AUDIO2 ? ENABLE : DISABLE;
         hpcd_USB_OTG_HS.Init.low_power_enable        = DISABLE;
         hpcd_USB_OTG_HS.Init.lpm_enable              = DISABLE;
         hpcd_USB_OTG_HS.Init.battery_charging_enable = ENABLE;
@@ -507,9 +522,19 @@ USBD_StatusTypeDef USBD_LL_Init(USBD_HandleTypeDef *pdev)
         HAL_PCD_RegisterIsoInIncpltCallback(&hpcd_USB_OTG_HS,
                                             PCD_ISOINIncompleteCallback);
 #endif /* USE_HAL_PCD_REGISTER_CALLBACKS */
-        HAL_PCDEx_SetRxFiFo(&hpcd_USB_OTG_HS, 0x200);
-        HAL_PCDEx_SetTxFiFo(&hpcd_USB_OTG_HS, 0, 0x80);
-        HAL_PCDEx_SetTxFiFo(&hpcd_USB_OTG_HS, 1, 0x174);
+        if(usbd_mode == USBD_MODE_AUDIO2)
+        {
+            HAL_PCDEx_SetRxFiFo(&hpcd_USB_OTG_HS, 0x200);
+            HAL_PCDEx_SetTxFiFo(&hpcd_USB_OTG_HS, 0, 0x80);
+            HAL_PCDEx_SetTxFiFo(&hpcd_USB_OTG_HS, 1, 0x10);
+            HAL_PCDEx_SetTxFiFo(&hpcd_USB_OTG_HS, 2, 0x100);
+        }
+        else
+        {
+            HAL_PCDEx_SetRxFiFo(&hpcd_USB_OTG_HS, 0x200);
+            HAL_PCDEx_SetTxFiFo(&hpcd_USB_OTG_HS, 0, 0x80);
+            HAL_PCDEx_SetTxFiFo(&hpcd_USB_OTG_HS, 1, 0x174);
+        }
     }
     return USBD_OK;
 }
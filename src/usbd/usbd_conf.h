@@ -59,7 +59,7 @@ extern "C"
   */
 
 /*---------- -----------*/
-#define USBD_MAX_NUM_INTERFACES 1U /**< & */
+#define USBD_MAX_NUM_INTERFACES 3U /**< & */
 /*---------- -----------*/
 #define USBD_MAX_NUM_CONFIGURATION 1U /**< & */
 /*---------- -----------*/
@@ -23,6 +23,7 @@
 #include "usbd_core.h"
 #include "usbd_desc.h"
 #include "usbd_conf.h"
+#include "usbd_cdc.h"
 
 /* USER CODE BEGIN INCLUDE */
 
@@ -122,6 +123,7 @@
   */
 
 static void Get_SerialNum(void);
+static void SetDeviceClass(uint8_t *desc);
 static void IntToUnicode(uint32_t value, uint8_t *pbuf, uint8_t len);
 
 /**
@@ -314,6 +316,7 @@ __ALIGN_BEGIN uint8_t USBD_StringSerial[USB_SIZ_STRING_SERIAL] __ALIGN_END = {
 uint8_t *USBD_HS_DeviceDescriptor(USBD_SpeedTypeDef speed, uint16_t *length)
 {
     UNUSED(speed);
+    SetDeviceClass(USBD_HS_DeviceDesc);
     *length = sizeof(USBD_HS_DeviceDesc);
     return USBD_HS_DeviceDesc;
 }
@@ -449,6 +452,7 @@ uint8_t *USBD_HS_USR_BOSDescriptor(USBD_SpeedTypeDef speed, uint16_t *length)
 uint8_t *USBD_FS_DeviceDescriptor(USBD_SpeedTypeDef speed, uint16_t *length)
 {
     UNUSED(speed);
+    SetDeviceClass(USBD_FS_DeviceDesc);
     *length = sizeof(USBD_FS_DeviceDesc);
     return USBD_FS_DeviceDesc;
 }
@@ -609,6 +613,21 @@ static void IntToUnicode(uint32_t value, uint8_t *pbuf, uint8_t len)
         pbuf[2 * idx + 1] = 0;
     }
 }
+
+/**
+  * @brief  Sets the device class for the current mode. The audio class
+  *         needs the interface association class, so that hosts look at
+  *         the functions.
+  * @param  desc: Device descriptor
+  * @retval None
+  */
+static void SetDeviceClass(uint8_t *desc)
+{
+    const uint8_t audio = usbd_mode == USBD_MODE_AUDIO2;
+    desc[4]             = audio ? 0xEF : 0x02; /* bDeviceClass */
+    desc[5]             = 0x02;                /* bDeviceSubClass */
+    desc[6]             = audio ? 0x01 : 0x00; /* bDeviceProtocol */
+}
 /**
   * @}
   */
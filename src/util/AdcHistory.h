@@ -0,0 +1,262 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace daisy
+{
+/** @brief A window of consecutive samples from an AdcChannelHistory
+ *  @ingroup utility
+ *
+ *  The samples live in a ring buffer, so a window consists of up to two
+ *  contiguous parts. `timestamp` is the index of the first sample in the
+ *  window, counted at the output rate of the channel since Init().
+ */
+struct AdcWindow
+{
+    const uint16_t* first;      /**< Oldest samples */
+    size_t          firstSize;  /**< Number of samples in `first` */
+    const uint16_t* second;     /**< Newer samples, if the window wraps */
+    size_t          secondSize; /**< Number of samples in `second` */
+    uint32_t        timestamp;  /**< Sample index of the first sample */
+
+    /** Returns the total number of samples in the window */
+    size_t Size() const { return firstSize + secondSize; }
+
+    /** Returns the sample at `idx`, where 0 is the oldest sample */
+    uint16_t operator[](size_t idx) const
+    {
+        return idx < firstSize ? first[idx] : second[idx - firstSize];
+    }
+
+    /** Copies the samples to a contiguous buffer with at least Size() elements
+     *  and returns the number of samples written */
+    size_t CopyTo(uint16_t* dest) const
+    {
+        for(size_t i = 0; i < firstSize; i++)
+            *dest++ = first[i];
+        for(size_t i = 0; i < secondSize; i++)
+            *dest++ = second[i];
+        return Size();
+    }
+};
+
+/** @brief Sample history of a single ADC channel with decimation
+ *  @ingroup utility
+ *
+ *  Raw ADC samples are pushed from the DMA interrupt, averaged over
+ *  `decimation` samples (a boxcar / first order CIC decimator) and then
+ *  written to a user supplied ring buffer. The application reads
+ *  timestamped windows of the most recent samples from the ring.
+ *
+ *  There's one writer (the interrupt) and any number of readers. Readers
+ *  never block the writer, so the ring must be large enough to hold all
+ *  samples that are written while a window is being processed, in addition
+ *  to the window itself.
+ *
+ *  This is used by AdcHandle::InitStreaming(), but can be fed from any
+ *  source.
+ */
+class AdcChannelHistory
+{
+  public:
+    AdcChannelHistory() {}
+
+    /** Initializes the history.
+     *  @param buffer       Storage for the ring buffer
+     *  @param size         Number of samples in `buffer`
+     *  @param decimation   Number of input samples averaged into each output
+     *                      sample. 1 stores every input sample.
+     */
+    void Init(uint16_t* buffer, size_t size, uint16_t decimation = 1)
+    {
+        buffer_        = buffer;
+        size_          = size;
+        decimation_    = decimation > 0 ? decimation : 1;
+        writePos_      = 0;
+        numAvailable_  = 0;
+        numWritten_    = 0;
+        sum_           = 0;
+        count_         = 0;
+        latest_        = 0;
+        latestTick_    = 0;
+        ticksPerOut_   = 0.0f;
+        lastBlockTick_ = 0;
+        hasBlockTick_  = false;
+        for(size_t i = 0; i < size_; i++)
+            buffer_[i] = 0;
+    }
+
+    /** Adds a single raw ADC sample */
+    void Push(uint16_t sample)
+    {
+        sum_ += sample;
+        if(++count_ < decimation_)
+            return;
+        Write(uint16_t((sum_ + decimation_ / 2) / decimation_));
+        sum_   = 0;
+        count_ = 0;
+    }
+
+    /** Adds a block of raw ADC samples, e.g. one half of a DMA buffer.
+     *  @param samples      The first sample of this channel
+     *  @param numSamples   Number of samples to add
+     *  @param stride       Distance between two consecutive samples of this
+     *                      channel, i.e. the number of channels in an
+     *                      interleaved buffer
+     *  @param tick         System tick at which the last sample of the block
+     *                      was acquired. Used to timestamp the samples.
+     */
+    void PushBlock(const uint16_t* samples,
+                   size_t          numSamples,
+                   size_t          stride,
+                   uint32_t        tick)
+    {
+        for(size_t i = 0; i < numSamples; i++)
+            Push(samples[i * stride]);
+
+        // estimate the duration of an output sample from the block rate
+        if(hasBlockTick_ && numSamples > 0)
+        {
+            const float ticksPerIn
+                = float(tick - lastBlockTick_) / float(numSamples);
+            const float estimate = ticksPerIn * decimation_;
+            ticksPerOut_
+                = (ticksPerOut_ == 0.0f)
+                      ? estimate
+                      : ticksPerOut_ + 0.1f * (estimate - ticksPerOut_);
+        }
+        lastBlockTick_ = tick;
+        hasBlockTick_  = true;
+        latestTick_    = tick;
+    }
+
+    /** Returns the most recent `numSamples` samples, or fewer if not enough
+     *  samples were recorded yet. */
+    AdcWindow GetLatestWindow(size_t numSamples) const
+    {
+        uint32_t end;
+        size_t   pos, avail;
+        GetWritePosition(end, pos, avail);
+        numSamples = numSamples < avail ? numSamples : avail;
+        return MakeWindow(end - numSamples, numSamples, end, pos);
+    }
+
+    /** Returns up to `maxSamples` samples, starting at `timestamp`, e.g. the
+     *  end of the previous window. Use this to process the stream in
+     *  consecutive windows without gaps. If the samples at `timestamp` were
+     *  already overwritten, the window starts at the oldest sample in the
+     *  ring, which can be detected by comparing the timestamps.
+     */
+    AdcWindow GetWindowSince(uint32_t timestamp, size_t maxSamples) const
+    {
+        uint32_t end;
+        size_t   pos, avail;
+        GetWritePosition(end, pos, avail);
+        const int32_t  pending = int32_t(end - timestamp);
+        size_t         num     = pending > 0 ? size_t(pending) : 0;
+        num                    = num < avail ? num : avail;
+        const uint32_t start   = end - num;
+        num                    = num < maxSamples ? num : maxSamples;
+        return MakeWindow(start, num, end, pos);
+    }
+
+    /** Returns the timestamp of the next sample, i.e. the number of samples
+     *  written since Init() */
+    uint32_t GetTimestamp() const { return numWritten_; }
+
+    /** Returns the approximate system tick at which the sample with
+     *  `timestamp` was acquired. Only valid after a few blocks were pushed
+     *  with PushBlock(). */
+    uint32_t GetTickForTimestamp(uint32_t timestamp) const
+    {
+        const int32_t samplesAgo = int32_t(numWritten_ - 1 - timestamp);
+        return latestTick_ - uint32_t(int32_t(samplesAgo * ticksPerOut_));
+    }
+
+    /** Returns the estimated number of system ticks between two output
+     *  samples, or 0 if unknown */
+    float GetTicksPerSample() const { return ticksPerOut_; }
+
+    /** Returns the most recent output sample */
+    uint16_t GetLatest() const { return latest_; }
+
+    /** Returns a pointer to the most recent output sample, which can be
+     *  passed to AnalogControl::Init() */
+    uint16_t* GetLatestPtr() { return &latest_; }
+
+    /** Returns the number of input samples averaged for each output sample */
+    uint16_t GetDecimation() const { return decimation_; }
+
+    /** Returns the size of the ring buffer in samples */
+    size_t GetSize() const { return size_; }
+
+#ifdef UNIT_TEST
+    /** Sets the timestamp of the next sample, to test the overflow */
+    void SetTimestampForUnitTest(uint32_t timestamp)
+    {
+        numWritten_ = timestamp;
+    }
+#endif
+
+  private:
+    void Write(uint16_t value)
+    {
+        const size_t pos = writePos_;
+        buffer_[pos]     = value;
+        writePos_        = pos + 1 < size_ ? pos + 1 : 0;
+        if(numAvailable_ < size_)
+            numAvailable_ = numAvailable_ + 1;
+        latest_ = value;
+        // publish the sample after it was written
+        numWritten_ = numWritten_ + 1;
+    }
+
+    /** Reads the timestamp and ring index of the next sample and the
+     *  number of samples in the ring together. Write() runs in an interrupt,
+     *  so if the timestamp didn't change between the reads, nothing did. */
+    void GetWritePosition(uint32_t& end, size_t& pos, size_t& avail) const
+    {
+        do
+        {
+            end   = numWritten_;
+            pos   = writePos_;
+            avail = numAvailable_;
+        } while(end != numWritten_);
+    }
+
+    /** The ring index is derived from the wrapped write position rather
+     *  than `start % size_`, which jumps when the 32-bit timestamp
+     *  overflows and the size isn't a power of two. For the same reason
+     *  the number of samples in the ring is counted separately. */
+    AdcWindow
+    MakeWindow(uint32_t start, size_t num, uint32_t end, size_t pos) const
+    {
+        AdcWindow    window;
+        const size_t back  = size_t(end - start); // <= size_
+        const size_t first = pos >= back ? pos - back : pos + size_ - back;
+        const size_t tail  = size_ - first;
+        window.timestamp   = start;
+        window.first       = buffer_ + first;
+        window.firstSize   = num < tail ? num : tail;
+        window.second      = buffer_;
+        window.secondSize  = num - window.firstSize;
+        return window;
+    }
+
+    uint16_t*         buffer_        = nullptr;
+    size_t            size_          = 0;
+    uint16_t          decimation_    = 1;
+    volatile size_t   writePos_      = 0;
+    volatile size_t   numAvailable_  = 0;
+    volatile uint32_t numWritten_    = 0;
+    uint32_t          sum_           = 0;
+    uint16_t          count_         = 0;
+    uint16_t          latest_        = 0;
+    uint32_t          latestTick_    = 0;
+    float             ticksPerOut_   = 0.0f;
+    uint32_t          lastBlockTick_ = 0;
+    bool              hasBlockTick_  = false;
+};
+
+} // namespace daisy
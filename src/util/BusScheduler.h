@@ -0,0 +1,322 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "sys/system.h"
+#include "util/scopedirqblocker.h"
+
+namespace daisy
+{
+/** @brief Queues transactions of several devices on one shared bus and
+ *         runs them back-to-back
+ *  @ingroup utility
+ *
+ *  Device drivers submit transactions (a write followed by a read, e.g. a
+ *  register address and the register contents) instead of accessing the
+ *  bus directly. Whenever a transaction is finished, the next one is
+ *  started right from the completion interrupt, so the bus is never idle
+ *  while there's work in the queue and the CPU never waits for it.
+ *
+ *  - Transactions with a higher Priority are started first, e.g. reading a
+ *    touch sensor before updating LEDs. Within a priority, transactions
+ *    run in the order in which they were submitted.
+ *  - Periodic transactions are submitted by Process() at a fixed rate per
+ *    device, e.g. scanning an expander at 1kHz and LED drivers at 60Hz. If
+ *    a periodic transaction is still pending when it's due again, the new
+ *    one is skipped instead of piling up.
+ *
+ *  The bus is accessed through an adapter, e.g. I2CBusAdapter or
+ *  MultiSlaveSpiBusAdapter from per/sharedBus.h:
+ *  \code
+ *  struct MyBus
+ *  {
+ *      using Callback = void (*)(void* context, bool success);
+ *      // Starts a transfer and returns immediately. Calls `callback` from
+ *      // an interrupt when it's finished. Returns false on errors.
+ *      bool Start(uint16_t device, uint8_t* tx, size_t txSize,
+ *                 uint8_t* rx, size_t rxSize,
+ *                 Callback callback, void* context);
+ *  };
+ *  \endcode
+ *
+ *  @tparam Bus             The bus adapter
+ *  @tparam maxQueued       The maximum number of queued transactions
+ *  @tparam maxPeriodic     The maximum number of periodic transactions
+ */
+template <typename Bus, size_t maxQueued = 16, size_t maxPeriodic = 8>
+class BusScheduler
+{
+  public:
+    /** Priority classes, from most to least urgent */
+    enum class Priority
+    {
+        HIGH,
+        NORMAL,
+        LOW,
+    };
+
+    /** Called from an interrupt when a transaction is finished */
+    using Callback = void (*)(void* context, bool success);
+
+    /** A transaction on the bus. Buffers must stay valid until the
+     *  callback was called, and must be placed in DMA accessible memory
+     *  for buses that use DMA.
+     */
+    struct Transaction
+    {
+        /** The device, e.g. the I2C address or the SPI chip select index */
+        uint16_t device = 0;
+        /** Data that's written first, or nullptr */
+        uint8_t* tx     = nullptr;
+        size_t   txSize = 0;
+        /** Buffer for data that's read afterwards, or nullptr */
+        uint8_t* rx       = nullptr;
+        size_t   rxSize   = 0;
+        Priority priority = Priority::NORMAL;
+        /** Called when the transaction is finished, may be nullptr */
+        Callback callback = nullptr;
+        void*    context  = nullptr;
+    };
+
+    BusScheduler() {}
+
+    /** Initializes the scheduler and clears all queued and periodic
+     *  transactions.
+     */
+    void Init(Bus& bus)
+    {
+        bus_       = &bus;
+        busy_      = false;
+        sequence_  = 0;
+        numErrors_ = 0;
+        for(size_t i = 0; i < maxQueued; i++)
+            slots_[i].pending = false;
+        for(size_t i = 0; i < maxPeriodic; i++)
+        {
+            periodic_[i].active     = false;
+            periodic_[i].queued     = false;
+            periodic_[i].numSkipped = 0;
+        }
+    }
+
+    /** Adds a transaction to the queue and starts it right away if the bus
+     *  is idle. Can be called from interrupts.
+     *  @return false if the queue was full
+     */
+    bool Submit(const Transaction& transaction)
+    {
+        if(!Add(transaction, -1))
+            return false;
+        StartNext();
+        return true;
+    }
+
+    /** Adds a transaction that's submitted every `periodUs` microseconds
+     *  by Process(). The first one is submitted with the next call.
+     *  @return An id for RemovePeriodic(), or -1 if there's no room
+     */
+    int AddPeriodic(const Transaction& transaction, uint32_t periodUs)
+    {
+        ScopedIrqBlocker irqBlocker;
+        for(size_t i = 0; i < maxPeriodic; i++)
+        {
+            Periodic& job = periodic_[i];
+            if(job.active)
+                continue;
+            job.transaction = transaction;
+            job.periodUs    = periodUs;
+            job.nextUs      = System::GetUs();
+            job.queued      = false;
+            job.numSkipped  = 0;
+            job.active      = true;
+            return int(i);
+        }
+        return -1;
+    }
+
+    /** Stops a periodic transaction. A pending instance is still run. */
+    void RemovePeriodic(int id)
+    {
+        if(id >= 0 && size_t(id) < maxPeriodic)
+            periodic_[id].active = false;
+    }
+
+    /** Changes the period of a periodic transaction */
+    void SetPeriod(int id, uint32_t periodUs)
+    {
+        if(id >= 0 && size_t(id) < maxPeriodic)
+            periodic_[id].periodUs = periodUs;
+    }
+
+    /** Submits the periodic transactions that are due. Call this
+     *  regularly, e.g. from the main loop or a timer interrupt.
+     */
+    void Process()
+    {
+        const uint32_t now = System::GetUs();
+        for(size_t i = 0; i < maxPeriodic; i++)
+        {
+            Periodic& job = periodic_[i];
+            if(!job.active || int32_t(now - job.nextUs) < 0)
+                continue;
+            // keep the phase, unless we're behind by more than a period
+            job.nextUs += job.periodUs;
+            if(int32_t(now - job.nextUs) >= 0)
+                job.nextUs = now + job.periodUs;
+
+            if(job.queued || !Add(job.transaction, int(i)))
+                job.numSkipped++;
+        }
+        StartNext();
+    }
+
+    /** Returns true while a transaction is running or queued */
+    bool IsBusy() const
+    {
+        ScopedIrqBlocker irqBlocker;
+        if(busy_)
+            return true;
+        for(size_t i = 0; i < maxQueued; i++)
+            if(slots_[i].pending)
+                return true;
+        return false;
+    }
+
+    /** Returns the number of transactions that failed */
+    size_t GetNumErrors() const { return numErrors_; }
+
+    /** Returns how often a periodic transaction was skipped, because the
+     *  previous one wasn't finished yet.
+     */
+    size_t GetNumSkipped(int id) const
+    {
+        if(id < 0 || size_t(id) >= maxPeriodic)
+            return 0;
+        return periodic_[id].numSkipped;
+    }
+
+  private:
+    BusScheduler(const BusScheduler& other) = delete;
+    BusScheduler& operator=(const BusScheduler& other) = delete;
+
+    struct Slot
+    {
+        Transaction transaction;
+        uint32_t    sequence;
+        int         periodicId;
+        // set last, after all other fields are valid
+        volatile bool pending = false;
+    };
+
+    struct Periodic
+    {
+        Transaction   transaction;
+        uint32_t      periodUs;
+        uint32_t      nextUs;
+        size_t        numSkipped;
+        volatile bool queued = false;
+        bool          active = false;
+    };
+
+    bool Add(const Transaction& transaction, int periodicId)
+    {
+        ScopedIrqBlocker irqBlocker;
+        for(size_t i = 0; i < maxQueued; i++)
+        {
+            Slot& slot = slots_[i];
+            if(slot.pending)
+                continue;
+            slot.transaction = transaction;
+            slot.sequence    = sequence_++;
+            slot.periodicId  = periodicId;
+            slot.pending     = true;
+            if(periodicId >= 0)
+                periodic_[periodicId].queued = true;
+            return true;
+        }
+        return false;
+    }
+
+    /** Returns the most urgent pending slot. Call with IRQs disabled. */
+    Slot* GetNextSlot()
+    {
+        Slot* best = nullptr;
+        for(size_t i = 0; i < maxQueued; i++)
+        {
+            Slot& slot = slots_[i];
+            if(!slot.pending)
+                continue;
+            if(best == nullptr
+               || slot.transaction.priority < best->transaction.priority
+               || (slot.transaction.priority == best->transaction.priority
+                   && int32_t(slot.sequence - best->sequence) < 0))
+                best = &slot;
+        }
+        return best;
+    }
+
+    void StartNext()
+    {
+        while(true)
+        {
+            Slot* slot;
+            {
+                ScopedIrqBlocker irqBlocker;
+                if(busy_)
+                    return;
+                slot = GetNextSlot();
+                if(slot == nullptr)
+                    return;
+                busy_    = true;
+                current_ = slot;
+            }
+            const Transaction& t = slot->transaction;
+            if(bus_->Start(t.device,
+                           t.tx,
+                           t.txSize,
+                           t.rx,
+                           t.rxSize,
+                           &BusCallback,
+                           this))
+                return;
+            // failed to start, try the next one
+            Finish(false);
+        }
+    }
+
+    /** Frees the current slot and calls its callback */
+    void Finish(bool success)
+    {
+        Slot&          slot     = *current_;
+        const Callback callback = slot.transaction.callback;
+        void* const    context  = slot.transaction.context;
+        if(!success)
+            numErrors_++;
+        {
+            ScopedIrqBlocker irqBlocker;
+            if(slot.periodicId >= 0)
+                periodic_[slot.periodicId].queued = false;
+            slot.pending = false;
+            busy_        = false;
+        }
+        if(callback)
+            callback(context, success);
+    }
+
+    static void BusCallback(void* context, bool success)
+    {
+        auto scheduler = static_cast<BusScheduler*>(context);
+        scheduler->Finish(success);
+        scheduler->StartNext();
+    }
+
+    Bus*          bus_ = nullptr;
+    Slot          slots_[maxQueued];
+    Periodic      periodic_[maxPeriodic];
+    Slot*         current_   = nullptr;
+    volatile bool busy_      = false;
+    uint32_t      sequence_  = 0;
+    size_t        numErrors_ = 0;
+};
+
+} // namespace daisy
@@ -0,0 +1,459 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace daisy
+{
+/** @brief Conversion from volts to DAC codes
+ *  @ingroup utility
+ *
+ *  code = volts * scale + offset, rounded and clamped to 0..maxCode.
+ *  The defaults match a 0-5V output on a 12 bit DAC, like the CV outputs of
+ *  the Daisy Patch SM.
+ */
+struct DacCalibration
+{
+    /** DAC codes per volt */
+    float scale = 819.0f;
+    /** DAC code at 0V */
+    float offset = 0.0f;
+    /** Highest DAC code, e.g. 4095 for 12 bits */
+    uint16_t maxCode = 4095;
+
+    /** Calculates the calibration from two measurements, e.g. by writing
+     *  two codes and measuring the output voltages.
+     *  @param codeA    The first code written to the DAC
+     *  @param voltsA   The voltage measured for codeA
+     *  @param codeB    The second code, should be far from codeA
+     *  @param voltsB   The voltage measured for codeB
+     *  @param maxCode  The highest DAC code
+     */
+    static DacCalibration FromMeasurements(uint16_t codeA,
+                                           float    voltsA,
+                                           uint16_t codeB,
+                                           float    voltsB,
+                                           uint16_t maxCode = 4095)
+    {
+        DacCalibration cal;
+        cal.maxCode = maxCode;
+        if(voltsB != voltsA)
+        {
+            cal.scale  = (float(codeB) - float(codeA)) / (voltsB - voltsA);
+            cal.offset = float(codeA) - voltsA * cal.scale;
+        }
+        return cal;
+    }
+
+    /** Converts a voltage to the nearest DAC code */
+    uint16_t ToCode(float volts) const
+    {
+        const float code = volts * scale + offset + 0.5f;
+        if(code <= 0.0f)
+            return 0;
+        return code >= float(maxCode) ? maxCode : uint16_t(code);
+    }
+};
+
+/** @brief Streams sample-accurate CV to a DMA driven DAC
+ *  @ingroup utility
+ *
+ *  Sits between the code that generates CV (e.g. envelopes and LFOs in the
+ *  audio callback) and the DAC callback, which requests blocks of raw codes
+ *  from its DMA buffer.
+ *
+ *  There are three ways to provide values, per channel:
+ *  - SetValue() holds a constant value, like writing to the DAC directly.
+ *  - Write() and WriteRamp() queue one value per sample, e.g. from the audio
+ *    callback. WriteRamp() interpolates linearly from the previous value,
+ *    to turn control rate values into a smooth DAC rate signal.
+ *    The queue is drained by Process() with a constant latency, so that the
+ *    CV stays aligned with the audio. When the audio and DAC clocks drift
+ *    apart, single samples are repeated or dropped to keep the latency.
+ *  - SetCallback() installs a callback that's called from Process() to fill
+ *    the DAC buffer with float values directly.
+ *
+ *  Input values are converted to DAC codes with one multiply-add that
+ *  combines an optional input scaling (e.g. from -1..1 to volts) with the
+ *  DacCalibration of the channel.
+ *
+ *  Write() must be called from one context only (e.g. the audio callback),
+ *  and Process() from another (the DAC callback).
+ *
+ *  @tparam numChannels Number of DAC channels
+ *  @tparam queueSize   Number of samples that can be queued per channel,
+ *                      must be a power of two
+ */
+template <size_t numChannels, size_t queueSize = 256>
+class DacStream
+{
+  public:
+    /** Fills `size` values for each channel, in units of the input scaling */
+    typedef void (*Callback)(float** out, size_t size, void* context);
+
+    /** The largest number of samples passed to the callback at once */
+    static constexpr size_t kMaxCallbackSize = 32;
+
+    DacStream() { Init(); }
+
+    /** Initializes the stream.
+     *  @param latency  Number of samples that are queued before the output
+     *                  starts, in addition to the block that's processed.
+     *                  Should be at least the audio block size.
+     */
+    void Init(size_t latency = 48)
+    {
+        latency_  = latency < queueSize / 2 ? latency : queueSize / 2;
+        callback_ = nullptr;
+        context_  = nullptr;
+        for(size_t ch = 0; ch < numChannels; ch++)
+        {
+            Channel& c    = channels_[ch];
+            c.inputScale  = 1.0f;
+            c.inputBias   = 0.0f;
+            c.cal         = DacCalibration();
+            c.write       = 0;
+            c.read        = 0;
+            c.streaming   = false;
+            c.primed      = false;
+            c.lastInput   = 0.0f;
+            c.avgLevel    = 0.0f;
+            c.targetLevel = 0.0f;
+            c.settling    = 0;
+            c.hold        = 0;
+            c.underruns   = 0;
+            c.overruns    = 0;
+            c.corrections = 0;
+            UpdateCoefficients(c);
+        }
+    }
+
+    /** Changes the latency, e.g. after the audio block size changed.
+     *  Takes effect when the output (re)starts. */
+    void SetLatency(size_t latency)
+    {
+        latency_ = latency < queueSize / 2 ? latency : queueSize / 2;
+    }
+
+    /** Waits for the latency to be queued again and measures the queue
+     *  level anew, e.g. after the DAC sample rate changed. Call this while
+     *  the DAC is stopped. */
+    void Restart()
+    {
+        for(size_t ch = 0; ch < numChannels; ch++)
+            channels_[ch].primed = false;
+    }
+
+    /** Sets the calibration of a channel */
+    void SetCalibration(size_t ch, const DacCalibration& cal)
+    {
+        if(ch >= numChannels)
+            return;
+        channels_[ch].cal = cal;
+        UpdateCoefficients(channels_[ch]);
+    }
+
+    /** Returns the calibration of a channel */
+    const DacCalibration& GetCalibration(size_t ch) const
+    {
+        return channels_[ch < numChannels ? ch : 0].cal;
+    }
+
+    /** Sets how input values are mapped to volts:
+     *  volts = value * voltsPerUnit + voltsAtZero.
+     *  The default is 1, 0, i.e. values are in volts.
+     */
+    void SetInputScale(size_t ch, float voltsPerUnit, float voltsAtZero = 0.0f)
+    {
+        if(ch >= numChannels)
+            return;
+        channels_[ch].inputScale = voltsPerUnit;
+        channels_[ch].inputBias  = voltsAtZero;
+        UpdateCoefficients(channels_[ch]);
+    }
+
+    /** Converts an input value of a channel to a DAC code */
+    uint16_t ToCode(size_t ch, float value) const
+    {
+        return Convert(channels_[ch < numChannels ? ch : 0], value);
+    }
+
+    /** Outputs a constant value and stops streaming on the channel */
+    void SetValue(size_t ch, float value)
+    {
+        if(ch >= numChannels)
+            return;
+        Channel& c  = channels_[ch];
+        c.streaming = false;
+        c.lastInput = value;
+        c.hold      = Convert(c, value);
+    }
+
+    /** Queues one value per sample for a channel, e.g. a block of an
+     *  envelope computed in the audio callback.
+     *  @return false if the queue was full and values were dropped
+     */
+    bool Write(size_t ch, const float* values, size_t size)
+    {
+        if(ch >= numChannels || size == 0)
+            return ch < numChannels;
+        Channel&       c     = channels_[ch];
+        const uint32_t write = c.write;
+        const size_t   space = queueSize - (write - c.read);
+        const size_t   n     = size < space ? size : space;
+        for(size_t i = 0; i < n; i++)
+            c.queue[(write + i) & kMask] = Convert(c, values[i]);
+        c.lastInput = values[size - 1];
+        c.write     = write + n; // publish after the values were written
+        c.streaming = true;
+        if(n < size)
+            c.overruns++;
+        return n == size;
+    }
+
+    /** Queues `size` samples that ramp linearly from the previous value to
+     *  `value`. Use this for values that are computed once per block.
+     *  @return false if the queue was full and values were dropped
+     */
+    bool WriteRamp(size_t ch, float value, size_t size)
+    {
+        if(ch >= numChannels || size == 0)
+            return ch < numChannels;
+        Channel&       c     = channels_[ch];
+        const uint32_t write = c.write;
+        const size_t   space = queueSize - (write - c.read);
+        const size_t   n     = size < space ? size : space;
+        const float    start = c.lastInput;
+        const float    step  = (value - start) / float(size);
+        for(size_t i = 0; i < n; i++)
+            c.queue[(write + i) & kMask] = Convert(c, start + step * (i + 1));
+        c.lastInput = value;
+        c.write     = write + n;
+        c.streaming = true;
+        if(n < size)
+            c.overruns++;
+        return n == size;
+    }
+
+    /** Installs a callback that fills the DAC buffers from Process().
+     *  Values queued with Write() are ignored while a callback is installed.
+     *  Pass nullptr to remove the callback.
+     */
+    void SetCallback(Callback callback, void* context = nullptr)
+    {
+        callback_ = callback;
+        context_  = context;
+    }
+
+    /** Fills the DAC buffers, one array of `size` codes per channel.
+     *  Call this from the DAC callback, e.g. DacHandle::DacCallback.
+     */
+    void Process(uint16_t** out, size_t size)
+    {
+        if(size == 0)
+            return;
+        if(callback_ != nullptr)
+        {
+            ProcessCallback(out, size);
+            return;
+        }
+        for(size_t ch = 0; ch < numChannels; ch++)
+            ProcessChannel(channels_[ch], out[ch], size);
+    }
+
+    /** Returns the number of queued samples of a channel */
+    size_t GetQueuedSamples(size_t ch) const
+    {
+        const Channel& c = channels_[ch < numChannels ? ch : 0];
+        return c.write - c.read;
+    }
+
+    /** Returns the latency that's maintained between Write() and the
+     *  output, in samples. The DAC's own buffer adds half its size. */
+    size_t GetLatency() const { return latency_; }
+
+    /** Returns how often the queue of a channel ran empty while streaming */
+    uint32_t GetNumUnderruns(size_t ch) const
+    {
+        return channels_[ch < numChannels ? ch : 0].underruns;
+    }
+
+    /** Returns how often values were dropped because the queue was full */
+    uint32_t GetNumOverruns(size_t ch) const
+    {
+        return channels_[ch < numChannels ? ch : 0].overruns;
+    }
+
+    /** Returns how often a sample was repeated or dropped to compensate for
+     *  clock drift */
+    uint32_t GetNumDriftCorrections(size_t ch) const
+    {
+        return channels_[ch < numChannels ? ch : 0].corrections;
+    }
+
+  private:
+    static_assert((queueSize & (queueSize - 1)) == 0,
+                  "queueSize must be a power of two");
+    static constexpr uint32_t kMask = queueSize - 1;
+
+    /** Deviation from the target level in samples before a correction */
+    static constexpr float kDriftTolerance = 3.0f;
+    /** Number of blocks after the start, during which the target level is
+     *  measured */
+    static constexpr uint32_t kSettlingBlocks = 64;
+
+    struct Channel
+    {
+        // configuration
+        float          inputScale;
+        float          inputBias;
+        DacCalibration cal;
+        float          gain; // input value to code, including rounding
+        float          bias;
+
+        // written by Write()
+        uint16_t          queue[queueSize];
+        volatile uint32_t write;
+        volatile bool     streaming;
+        float             lastInput;
+        uint32_t          overruns;
+
+        // written by Process()
+        volatile uint32_t read;
+        bool              primed;
+        float             avgLevel;
+        float             targetLevel;
+        uint32_t          settling;
+        volatile uint16_t hold;
+        uint32_t          underruns;
+        uint32_t          corrections;
+    };
+
+    static void UpdateCoefficients(Channel& c)
+    {
+        c.gain = c.inputScale * c.cal.scale;
+        c.bias = c.inputBias * c.cal.scale + c.cal.offset + 0.5f;
+    }
+
+    static uint16_t Convert(const Channel& c, float value)
+    {
+        const float code = value * c.gain + c.bias;
+        if(code <= 0.0f)
+            return 0;
+        return code >= float(c.cal.maxCode) ? c.cal.maxCode : uint16_t(code);
+    }
+
+    void ProcessChannel(Channel& c, uint16_t* out, size_t size)
+    {
+        const uint32_t read  = c.read;
+        const size_t   level = c.write - read;
+        if(!c.streaming)
+        {
+            c.read   = read + level; // discard values queued before SetValue()
+            c.primed = false;
+            Fill(out, size, c.hold);
+            return;
+        }
+
+        // start once the latency is queued
+        if(!c.primed)
+        {
+            if(level < latency_ + size)
+            {
+                Fill(out, size, c.hold);
+                return;
+            }
+            c.primed      = true;
+            c.settling    = kSettlingBlocks;
+            c.targetLevel = 0.0f;
+        }
+
+        // The queue level after each block depends on how the audio and
+        // DAC blocks interleave. Its average is measured after the start and
+        // then kept constant by dropping or repeating one sample when the
+        // clocks drift apart.
+        const float levelAfter = float(level) - float(size);
+        size_t      consume    = size;
+        if(c.settling > 0)
+        {
+            c.targetLevel += levelAfter;
+            if(--c.settling == 0)
+            {
+                c.targetLevel /= float(kSettlingBlocks);
+                c.avgLevel = c.targetLevel;
+            }
+        }
+        else
+        {
+            c.avgLevel += (levelAfter - c.avgLevel) * (1.0f / 64);
+            if(c.avgLevel > c.targetLevel + kDriftTolerance && level > size)
+            {
+                consume = size + 1; // drop the first sample
+                c.avgLevel -= 1.0f;
+                c.corrections++;
+            }
+            else if(c.avgLevel < c.targetLevel - kDriftTolerance && size > 1)
+            {
+                consume = size - 1; // repeat the first sample
+                c.avgLevel += 1.0f;
+                c.corrections++;
+            }
+        }
+
+        const size_t available = level < consume ? level : consume;
+        size_t       pos       = consume > size ? 1 : 0;
+        size_t       i         = 0;
+        if(consume < size && available > 0)
+            out[i++] = c.queue[read & kMask];
+        for(; pos < available && i < size; pos++)
+            out[i++] = c.queue[(read + pos) & kMask];
+        if(i > 0)
+            c.hold = out[i - 1];
+        c.read = read + available;
+
+        if(i < size)
+        {
+            // the queue ran empty: hold the last value and wait for the
+            // latency to be queued again
+            Fill(out + i, size - i, c.hold);
+            c.primed = false;
+            c.underruns++;
+        }
+    }
+
+    void ProcessCallback(uint16_t** out, size_t size)
+    {
+        float* buffers[numChannels];
+        for(size_t ch = 0; ch < numChannels; ch++)
+            buffers[ch] = scratch_[ch];
+        for(size_t offset = 0; offset < size; offset += kMaxCallbackSize)
+        {
+            const size_t n = size - offset < kMaxCallbackSize
+                                 ? size - offset
+                                 : kMaxCallbackSize;
+            callback_(buffers, n, context_);
+            for(size_t ch = 0; ch < numChannels; ch++)
+            {
+                const Channel& c = channels_[ch];
+                for(size_t i = 0; i < n; i++)
+                    out[ch][offset + i] = Convert(c, scratch_[ch][i]);
+            }
+        }
+        for(size_t ch = 0; ch < numChannels; ch++)
+            channels_[ch].hold = out[ch][size - 1];
+    }
+
+    static void Fill(uint16_t* out, size_t size, uint16_t value)
+    {
+        for(size_t i = 0; i < size; i++)
+            out[i] = value;
+    }
+
+    Channel  channels_[numChannels];
+    float    scratch_[numChannels][kMaxCallbackSize];
+    size_t   latency_;
+    Callback callback_;
+    void*    context_;
+};
+
+} // namespace daisy
@@ -0,0 +1,205 @@
+#pragma once
+
+#include <stdint.h>
+#include <math.h>
+
+namespace daisy
+{
+/** @brief Estimates the velocity and acceleration of an encoder
+ *  @ingroup utility
+ *
+ *  Call Update() regularly with the number of steps since the last call,
+ *  including zero. At slow speeds, steps are far apart and a fixed update
+ *  rate would mostly measure zero, so the velocity is measured from the
+ *  time between steps and smoothed with a one-pole filter. While no steps
+ *  arrive, the velocity decays as fast as the elapsed time requires: it
+ *  can't be more than one step since the last one. Turning around resets
+ *  the estimate.
+ */
+class EncoderVelocityFilter
+{
+  public:
+    EncoderVelocityFilter() {}
+    ~EncoderVelocityFilter() {}
+
+    /** Initializes the filter
+     *  @param time_freq        The frequency of the timestamps passed to
+     *                          Update(), e.g. 1000000 for System::GetUs()
+     *  @param time_constant    Smoothing time constant in seconds
+     */
+    void Init(uint32_t time_freq, float time_constant = 0.05f)
+    {
+        seconds_per_tick_ = 1.f / time_freq;
+        time_constant_    = time_constant;
+        Reset();
+    }
+
+    /** Forgets the velocity, e.g. after the encoder was idle */
+    void Reset()
+    {
+        velocity_     = 0.f;
+        acceleration_ = 0.f;
+        has_update_   = false;
+    }
+
+    /** Adds the steps since the last update
+     *  @param steps    Number of steps, negative when turned backwards
+     *  @param now      The current time
+     */
+    void Update(int32_t steps, uint32_t now)
+    {
+        if(!has_update_)
+        {
+            last_update_ = now;
+            last_step_   = now;
+            has_update_  = true;
+            return;
+        }
+        const float dt       = (now - last_update_) * seconds_per_tick_;
+        const float previous = velocity_;
+        last_update_         = now;
+
+        float since_step = (now - last_step_) * seconds_per_tick_;
+        if(steps != 0)
+        {
+            if(since_step <= 0.f)
+                since_step = seconds_per_tick_;
+            last_step_           = now;
+            const float measured = steps / since_step;
+            if(measured * velocity_ < 0.f)
+            {
+                // turned around
+                velocity_     = 0.f;
+                acceleration_ = 0.f;
+            }
+            velocity_ += since_step / (time_constant_ + since_step)
+                         * (measured - velocity_);
+        }
+        else if(since_step > 0.f)
+        {
+            const float max_speed = 1.f / since_step;
+            if(velocity_ > max_speed)
+                velocity_ = max_speed;
+            else if(velocity_ < -max_speed)
+                velocity_ = -max_speed;
+        }
+
+        if(dt > 0.f)
+        {
+            const float measured = (velocity_ - previous) / dt;
+            acceleration_
+                += dt / (time_constant_ + dt) * (measured - acceleration_);
+        }
+    }
+
+    /** @return the velocity in steps per second, negative when turned
+     *          backwards */
+    float GetVelocity() const { return velocity_; }
+
+    /** @return the acceleration in steps per second squared */
+    float GetAcceleration() const { return acceleration_; }
+
+  private:
+    float    seconds_per_tick_;
+    float    time_constant_;
+    float    velocity_;
+    float    acceleration_;
+    uint32_t last_update_;
+    uint32_t last_step_;
+    bool     has_update_;
+};
+
+/** @brief Scales encoder steps with the turning speed
+ *  @ingroup utility
+ *
+ *  Slow turns are passed through one step per detent for precise edits,
+ *  faster turns are multiplied by a gain that rises with the square of the
+ *  speed up to a maximum. The fine and coarse step sizes of
+ *  `MappedValue::Step()` get separate maximum gains, since coarse steps
+ *  are large already. Fractions of steps are carried over to the next
+ *  call, so the result doesn't depend on how the steps were grouped.
+ */
+class EncoderAccelerationCurve
+{
+  public:
+    /** The shape of the curve */
+    struct Config
+    {
+        /** Speed in steps per second up to which steps are passed 1:1 */
+        float threshold;
+        /** Speed in steps per second at which the maximum gain is reached */
+        float full_speed;
+        /** Maximum gain for fine steps */
+        float max_gain_fine;
+        /** Maximum gain for coarse steps */
+        float max_gain_coarse;
+
+        void Defaults()
+        {
+            threshold       = 5.f;
+            full_speed      = 40.f;
+            max_gain_fine   = 10.f;
+            max_gain_coarse = 3.f;
+        }
+    };
+
+    EncoderAccelerationCurve() {}
+    ~EncoderAccelerationCurve() {}
+
+    /** Initializes the curve */
+    void Init(const Config& config)
+    {
+        config_    = config;
+        remainder_ = 0.f;
+    }
+
+    /** Initializes the curve with the default Config */
+    void Init()
+    {
+        Config config;
+        config.Defaults();
+        Init(config);
+    }
+
+    /** @return the gain at the given velocity in steps per second */
+    float GetGain(float velocity, bool coarse = false) const
+    {
+        const float speed = fabsf(velocity);
+        if(speed <= config_.threshold)
+            return 1.f;
+        const float max_gain
+            = coarse ? config_.max_gain_coarse : config_.max_gain_fine;
+        if(speed >= config_.full_speed)
+            return max_gain;
+        const float x = (speed - config_.threshold)
+                        / (config_.full_speed - config_.threshold);
+        return 1.f + (max_gain - 1.f) * x * x;
+    }
+
+    /** Scales a number of steps
+     *  @param steps    The steps the encoder was turned
+     *  @param velocity The current velocity, see EncoderVelocityFilter
+     *  @param coarse   True if the steps will be used as coarse steps
+     *  @return the scaled number of steps, never zero if `steps` wasn't
+     */
+    int32_t Apply(int32_t steps, float velocity, bool coarse = false)
+    {
+        if(steps == 0)
+            return 0;
+        if((steps > 0) != (remainder_ > 0.f))
+            remainder_ = 0.f;
+        const float   scaled = steps * GetGain(velocity, coarse) + remainder_;
+        const int32_t result = int32_t(scaled);
+        remainder_           = scaled - result;
+        return result;
+    }
+
+    /** Drops the carried over fractions of steps */
+    void Reset() { remainder_ = 0.f; }
+
+  private:
+    Config config_;
+    float  remainder_;
+};
+
+} // namespace daisy
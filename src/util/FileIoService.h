@@ -0,0 +1,366 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "sys/system.h"
+#include "util/scopedirqblocker.h"
+
+namespace daisy
+{
+/** @brief Asynchronous file I/O with request queue and completion callbacks
+ *  @ingroup utility
+ *
+ *  Read, write and seek requests are added to a queue from anywhere in the
+ *  program (including interrupts, e.g. the audio callback) and processed by
+ *  a cooperative worker, that's driven by calling Process() from the main
+ *  loop. When a request is finished, its callback is called from Process().
+ *  Buffers are supplied by the caller and must stay valid until the callback
+ *  was called. No data is copied.
+ *
+ *  The worker always continues with the most urgent request:
+ *  - Requests with a higher Priority are processed first, e.g. reading audio
+ *    for playback before writing a recording before loading metadata.
+ *  - Within a priority, requests with an earlier deadline go first.
+ *  - Requests for the same file are always processed in the order in which
+ *    they were added, so that seek + read sequences work as expected.
+ *  Large reads and writes are split into chunks of `maxChunkSize` bytes, so
+ *  that a long write can't block an urgent read for more than one chunk.
+ *
+ *  The file system is accessed through an adapter class with FatFs-like
+ *  semantics, e.g. FatFsFileSystem from sys/fatfs.h:
+ *  \code
+ *  struct MyFileSystem
+ *  {
+ *      using File = FIL;
+ *      // all functions return 0 on success, like FR_OK
+ *      int Read(File& file, void* dest, size_t size, size_t& bytesRead);
+ *      int Write(File& file, const void* src, size_t size, size_t& written);
+ *      int Seek(File& file, uint32_t position);
+ *  };
+ *  \endcode
+ *
+ *  @tparam FileSystem      The file system adapter
+ *  @tparam maxNumRequests  The maximum number of requests in the queue
+ */
+template <typename FileSystem, size_t maxNumRequests = 16>
+class FileIoService
+{
+  public:
+    using File = typename FileSystem::File;
+
+    /** Priority classes, from most to least urgent */
+    enum class Priority
+    {
+        /** Audio streaming, e.g. reading samples for playback */
+        STREAMING,
+        /** Recording, e.g. writing audio that was captured */
+        RECORDING,
+        /** Everything else, e.g. metadata, presets or directory scanning */
+        BACKGROUND,
+        LAST,
+    };
+
+    /** Type of a request */
+    enum class RequestType
+    {
+        READ,
+        WRITE,
+        SEEK,
+    };
+
+    /** Passed to the completion callback */
+    struct Result
+    {
+        RequestType type;
+        File*       file;
+        /** The buffer that was passed to the request, or nullptr for SEEK */
+        void* buffer;
+        /** The number of bytes read or written. May be less than requested
+         *  at the end of a file or after an error. */
+        size_t bytesTransferred;
+        /** The error code from the file system, 0 on success */
+        int error;
+        /** True if the request finished after its deadline */
+        bool missedDeadline;
+    };
+
+    /** Called from Process() when a request is finished */
+    using Callback = void (*)(const Result& result, void* context);
+
+    FileIoService() {}
+
+    /** Initializes the service.
+     *  @param fileSystem   The file system adapter to use
+     *  @param maxChunkSize The maximum number of bytes that are transferred
+     *                      at once, before the worker checks for more urgent
+     *                      requests
+     */
+    void Init(FileSystem& fileSystem, size_t maxChunkSize = 4096)
+    {
+        fs_                 = &fileSystem;
+        maxChunkSize_       = maxChunkSize > 0 ? maxChunkSize : 1;
+        nextSequence_       = 0;
+        numMissedDeadlines_ = 0;
+        for(size_t i = 0; i < maxNumRequests; i++)
+            requests_[i].pending = false;
+    }
+
+    /** Requests to read `size` bytes from the current position of `file`.
+     *  @param file         The file to read from
+     *  @param dest         The buffer to read into
+     *  @param size         The number of bytes to read
+     *  @param priority     The priority class of the request
+     *  @param callback     Called when the request is finished, may be nullptr
+     *  @param context      Passed to the callback
+     *  @param deadline     System tick by which the request should be
+     *                      finished, or 0 if there's no deadline
+     *  @return false if the queue was full
+     */
+    bool Read(File&    file,
+              void*    dest,
+              size_t   size,
+              Priority priority,
+              Callback callback,
+              void*    context  = nullptr,
+              uint32_t deadline = 0)
+    {
+        return Add(RequestType::READ,
+                   file,
+                   dest,
+                   size,
+                   0,
+                   priority,
+                   callback,
+                   context,
+                   deadline);
+    }
+
+    /** Requests to write `size` bytes to the current position of `file`.
+     *  The arguments are the same as for Read().
+     *  @return false if the queue was full
+     */
+    bool Write(File&       file,
+               const void* src,
+               size_t      size,
+               Priority    priority,
+               Callback    callback,
+               void*       context  = nullptr,
+               uint32_t    deadline = 0)
+    {
+        return Add(RequestType::WRITE,
+                   file,
+                   const_cast<void*>(src),
+                   size,
+                   0,
+                   priority,
+                   callback,
+                   context,
+                   deadline);
+    }
+
+    /** Requests to move the position of `file` to `position`.
+     *  The other arguments are the same as for Read().
+     *  @return false if the queue was full
+     */
+    bool Seek(File&    file,
+              uint32_t position,
+              Priority priority,
+              Callback callback,
+              void*    context  = nullptr,
+              uint32_t deadline = 0)
+    {
+        return Add(RequestType::SEEK,
+                   file,
+                   nullptr,
+                   0,
+                   position,
+                   priority,
+                   callback,
+                   context,
+                   deadline);
+    }
+
+    /** Processes up to `maxNumChunks` chunks of the most urgent requests
+     *  and calls the callbacks of the requests that were finished.
+     *  Call this from the main loop.
+     *  @return true if there are more requests to process
+     */
+    bool Process(size_t maxNumChunks = 1)
+    {
+        for(size_t n = 0; n < maxNumChunks; n++)
+        {
+            Request* req = GetNextRequest();
+            if(req == nullptr)
+                return false;
+            ProcessChunk(*req);
+        }
+        return GetNumPendingRequests() > 0;
+    }
+
+    /** Returns the number of requests in the queue */
+    size_t GetNumPendingRequests() const
+    {
+        ScopedIrqBlocker irqBlocker;
+        size_t           num = 0;
+        for(size_t i = 0; i < maxNumRequests; i++)
+            if(requests_[i].pending)
+                num++;
+        return num;
+    }
+
+    /** Returns the number of requests that finished after their deadline */
+    size_t GetNumMissedDeadlines() const { return numMissedDeadlines_; }
+
+  private:
+    FileIoService(const FileIoService& other) = delete;
+    FileIoService& operator=(const FileIoService& other) = delete;
+
+    struct Request
+    {
+        RequestType type;
+        File*       file;
+        uint8_t*    buffer;
+        size_t      size;
+        size_t      transferred;
+        uint32_t    position;
+        Priority    priority;
+        Callback    callback;
+        void*       context;
+        uint32_t    deadline;
+        uint32_t    sequence;
+        // set last, after all other fields are valid
+        volatile bool pending = false;
+    };
+
+    bool Add(RequestType type,
+             File&       file,
+             void*       buffer,
+             size_t      size,
+             uint32_t    position,
+             Priority    priority,
+             Callback    callback,
+             void*       context,
+             uint32_t    deadline)
+    {
+        ScopedIrqBlocker irqBlocker;
+        for(size_t i = 0; i < maxNumRequests; i++)
+        {
+            Request& req = requests_[i];
+            if(req.pending)
+                continue;
+            req.type        = type;
+            req.file        = &file;
+            req.buffer      = static_cast<uint8_t*>(buffer);
+            req.size        = size;
+            req.transferred = 0;
+            req.position    = position;
+            req.priority    = priority;
+            req.callback    = callback;
+            req.context     = context;
+            req.deadline    = deadline;
+            req.sequence    = nextSequence_++;
+            req.pending     = true;
+            return true;
+        }
+        return false;
+    }
+
+    /** Returns true if `a` is more urgent than `b` */
+    static bool IsMoreUrgent(const Request& a, const Request& b)
+    {
+        if(a.priority != b.priority)
+            return a.priority < b.priority;
+        if(a.deadline != b.deadline)
+        {
+            if(a.deadline == 0 || b.deadline == 0)
+                return a.deadline != 0; // requests with a deadline first
+            return int32_t(a.deadline - b.deadline) < 0;
+        }
+        return int32_t(a.sequence - b.sequence) < 0;
+    }
+
+    Request* GetNextRequest()
+    {
+        ScopedIrqBlocker irqBlocker;
+        Request*         best = nullptr;
+        for(size_t i = 0; i < maxNumRequests; i++)
+        {
+            Request& req = requests_[i];
+            if(!req.pending || HasEarlierRequestForFile(req))
+                continue;
+            if(best == nullptr || IsMoreUrgent(req, *best))
+                best = &req;
+        }
+        return best;
+    }
+
+    bool HasEarlierRequestForFile(const Request& req) const
+    {
+        for(size_t i = 0; i < maxNumRequests; i++)
+        {
+            const Request& other = requests_[i];
+            if(other.pending && other.file == req.file
+               && int32_t(other.sequence - req.sequence) < 0)
+                return true;
+        }
+        return false;
+    }
+
+    void ProcessChunk(Request& req)
+    {
+        int  error    = 0;
+        bool finished = true;
+        if(req.type == RequestType::SEEK)
+        {
+            error = fs_->Seek(*req.file, req.position);
+        }
+        else
+        {
+            const size_t remaining = req.size - req.transferred;
+            const size_t chunk
+                = remaining < maxChunkSize_ ? remaining : maxChunkSize_;
+            size_t done = 0;
+            if(req.type == RequestType::READ)
+                error = fs_->Read(
+                    *req.file, req.buffer + req.transferred, chunk, done);
+            else
+                error = fs_->Write(
+                    *req.file, req.buffer + req.transferred, chunk, done);
+            req.transferred += done;
+            // end of file, disk full or error
+            finished = error != 0 || done < chunk;
+            finished = finished || req.transferred >= req.size;
+        }
+        if(!finished)
+            return;
+
+        Result result;
+        result.type             = req.type;
+        result.file             = req.file;
+        result.buffer           = req.buffer;
+        result.bytesTransferred = req.transferred;
+        result.error            = error;
+        const int32_t lateness  = int32_t(System::GetTick() - req.deadline);
+        result.missedDeadline   = req.deadline != 0 && lateness > 0;
+        if(result.missedDeadline)
+            numMissedDeadlines_++;
+        const Callback callback = req.callback;
+        void* const    context  = req.context;
+
+        // free the slot before the callback, so that it can add new requests
+        {
+            ScopedIrqBlocker irqBlocker;
+            req.pending = false;
+        }
+        if(callback)
+            callback(result, context);
+    }
+
+    FileSystem* fs_                 = nullptr;
+    size_t      maxChunkSize_       = 4096;
+    Request     requests_[maxNumRequests];
+    uint32_t    nextSequence_       = 0;
+    size_t      numMissedDeadlines_ = 0;
+};
+
+} // namespace daisy
@@ -0,0 +1,402 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "util/LockFreeFIFO.h"
+
+namespace daisy
+{
+/** @brief A timestamped edge of a gate or trigger input
+ *  @ingroup utility
+ */
+struct GateEdge
+{
+    uint32_t tick;   /**< System tick at which the edge was captured */
+    bool     rising; /**< True for rising edges, i.e. the gate opened */
+    /** Position of the edge in the current audio block, in samples.
+     *  Only set by GateEdgeQueue::PopEdgesInBlock() */
+    size_t offset;
+};
+
+/** @brief Maps system ticks to sample offsets within audio blocks
+ *  @ingroup utility
+ *
+ *  Call StartBlock() with the current tick at the start of each audio
+ *  callback. The block boundaries are tracked with a simple PLL, so that
+ *  the jitter of the interrupt latency doesn't show in the offsets, and
+ *  the tick rate of the audio clock is measured to follow drift.
+ *
+ *  Events that happened during the previous block period are mapped to
+ *  the same relative position in the current block. This delays every
+ *  event by exactly one block, but keeps their timing accurate to a
+ *  sample, no matter how large the blocks are.
+ */
+class AudioBlockClock
+{
+  public:
+    AudioBlockClock() {}
+    ~AudioBlockClock() {}
+
+    /** Initializes the clock
+     *  @param sample_rate  The audio sample rate in Hz
+     *  @param block_size   The number of samples per audio block
+     *  @param tick_freq    The system tick frequency, see
+     *                      System::GetTickFreq()
+     */
+    void Init(float sample_rate, size_t block_size, uint32_t tick_freq)
+    {
+        block_size_       = block_size;
+        nominal_tps_      = float(tick_freq) / sample_rate;
+        ticks_per_sample_ = nominal_tps_;
+        block_tick_       = 0;
+        locked_           = false;
+    }
+
+    /** Marks the start of an audio block, call this at the start of the
+     *  audio callback.
+     *  @param tick The current system tick, see System::GetTick()
+     */
+    void StartBlock(uint32_t tick)
+    {
+        const float    block_ticks = block_size_ * ticks_per_sample_;
+        const uint32_t predicted   = block_tick_ + uint32_t(block_ticks + .5f);
+        const int32_t  error       = int32_t(tick - predicted);
+        if(!locked_ || error > block_ticks / 2 || error < -block_ticks / 2)
+        {
+            // first block, or callbacks were missed: start over
+            block_tick_ = tick;
+            locked_     = true;
+            return;
+        }
+        block_tick_ = predicted + int32_t(error * kPhaseGain);
+        ticks_per_sample_ += kFrequencyGain * error / block_size_;
+        // the audio and system clocks are derived from the same crystal,
+        // so the rate can't be far off
+        const float max_deviation = nominal_tps_ * 0.01f;
+        if(ticks_per_sample_ > nominal_tps_ + max_deviation)
+            ticks_per_sample_ = nominal_tps_ + max_deviation;
+        if(ticks_per_sample_ < nominal_tps_ - max_deviation)
+            ticks_per_sample_ = nominal_tps_ - max_deviation;
+    }
+
+    /** Maps an event to a sample offset in the current block.
+     *  @param tick     The system tick of the event
+     *  @param offset   Set to the sample offset, 0 for events older than
+     *                  the previous block period
+     *  @return false if the event happened after the start of the current
+     *          block, i.e. it belongs to the next block
+     */
+    bool GetSampleOffset(uint32_t tick, size_t& offset) const
+    {
+        const int32_t since_start = int32_t(tick - block_tick_);
+        if(since_start >= 0)
+            return false;
+        const float position
+            = (since_start + block_size_ * ticks_per_sample_)
+              / ticks_per_sample_;
+        if(position <= 0.f)
+            offset = 0;
+        else if(position >= block_size_)
+            offset = block_size_ - 1;
+        else
+            offset = size_t(position);
+        return true;
+    }
+
+    /** @return the system tick at which the current block started */
+    uint32_t GetBlockStartTick() const { return block_tick_; }
+
+    /** @return the measured number of system ticks per audio sample */
+    float GetTicksPerSample() const { return ticks_per_sample_; }
+
+    /** @return the number of samples per block */
+    size_t GetBlockSize() const { return block_size_; }
+
+  private:
+    static constexpr float kPhaseGain     = 0.1f;
+    static constexpr float kFrequencyGain = 0.01f;
+
+    size_t   block_size_;
+    float    nominal_tps_;
+    float    ticks_per_sample_;
+    uint32_t block_tick_;
+    bool     locked_;
+};
+
+/** @brief Estimates the period of a clock or of tapped beats
+ *  @ingroup utility
+ *
+ *  Feed it the ticks of the rising edges. The period is the average of the
+ *  last kHistorySize intervals. An interval that deviates from the estimate
+ *  by more than the tolerance is held back: if the next interval agrees
+ *  with it, the tempo changed and the estimate jumps to the new tempo;
+ *  otherwise it was a missed edge and is ignored. Very short intervals
+ *  are treated as glitches, the next interval is measured from the edge
+ *  before the glitch. A gap longer than the timeout starts a new series
+ *  of taps.
+ */
+class ClockPeriodEstimator
+{
+  public:
+    /** The number of intervals that are averaged */
+    static constexpr size_t kHistorySize = 8;
+
+    ClockPeriodEstimator() {}
+    ~ClockPeriodEstimator() {}
+
+    /** Initializes the estimator
+     *  @param tick_freq    The frequency of the ticks passed to AddEdge()
+     *  @param timeout      Longest interval in seconds that's still
+     *                      considered part of the clock
+     *  @param tolerance    Relative deviation from the estimate that's
+     *                      still considered jitter
+     */
+    void Init(uint32_t tick_freq, float timeout = 2.f, float tolerance = 0.2f)
+    {
+        tick_freq_     = tick_freq;
+        timeout_ticks_ = uint32_t(timeout * tick_freq);
+        tolerance_     = tolerance;
+        Reset();
+    }
+
+    /** Forgets all edges and the estimate */
+    void Reset()
+    {
+        num_edges_ = 0;
+        period_    = 0.f;
+        ClearIntervals();
+    }
+
+    /** Adds the tick of a rising edge */
+    void AddEdge(uint32_t tick)
+    {
+        const uint32_t interval     = tick - last_edge_;
+        const uint32_t since_anchor = tick - anchor_;
+        last_edge_                  = tick;
+        if(num_edges_++ == 0 || interval > timeout_ticks_)
+        {
+            // a new series of taps, keep the estimate until it has a
+            // new interval
+            ClearIntervals();
+            anchor_ = tick;
+            return;
+        }
+        uint32_t accepted = interval;
+        if(has_outlier_ && outlier_ < period_ * tolerance_
+           && IsNear(since_anchor, period_))
+        {
+            // the previous edge was a glitch, measure from the one before
+            accepted = since_anchor;
+        }
+        else if(num_intervals_ > 0 && !IsNear(interval, period_))
+        {
+            if(!has_outlier_ || !IsNear(interval, float(outlier_)))
+            {
+                outlier_     = interval;
+                has_outlier_ = true;
+                return;
+            }
+            // two similar intervals in a row: the tempo changed
+            ClearIntervals();
+            AddInterval(outlier_);
+        }
+        has_outlier_ = false;
+        AddInterval(accepted);
+        anchor_ = tick;
+    }
+
+    /** @return true once there's an estimate */
+    bool IsValid() const { return period_ > 0.f; }
+
+    /** @return the estimated period in ticks, 0 without an estimate */
+    float GetPeriodTicks() const { return period_; }
+
+    /** @return the estimated period in seconds, 0 without an estimate */
+    float GetPeriod() const { return period_ / tick_freq_; }
+
+    /** @return the estimated frequency in Hz, 0 without an estimate */
+    float GetFrequency() const
+    {
+        return IsValid() ? tick_freq_ / period_ : 0.f;
+    }
+
+    /** @return the tempo in beats per minute for a clock with the given
+     *          number of pulses per beat, 0 without an estimate */
+    float GetBpm(float pulses_per_beat = 1.f) const
+    {
+        return GetFrequency() * 60.f / pulses_per_beat;
+    }
+
+    /** @return the tick of the last edge */
+    uint32_t GetLastEdgeTick() const { return last_edge_; }
+
+    /** @return the predicted tick of the next edge */
+    uint32_t GetNextEdgeTick() const
+    {
+        return last_edge_ + uint32_t(period_ + 0.5f);
+    }
+
+    /** @return true if no edge was added for longer than the timeout */
+    bool IsTimedOut(uint32_t now) const
+    {
+        return num_edges_ == 0 || now - last_edge_ > timeout_ticks_;
+    }
+
+  private:
+    bool IsNear(uint32_t interval, float reference) const
+    {
+        const float deviation = interval - reference;
+        return deviation <= reference * tolerance_
+               && deviation >= -reference * tolerance_;
+    }
+
+    void ClearIntervals()
+    {
+        num_intervals_ = 0;
+        write_pos_     = 0;
+        has_outlier_   = false;
+    }
+
+    void AddInterval(uint32_t interval)
+    {
+        intervals_[write_pos_] = interval;
+        write_pos_             = (write_pos_ + 1) % kHistorySize;
+        if(num_intervals_ < kHistorySize)
+            num_intervals_++;
+
+        // the first num_intervals_ entries are valid, see ClearIntervals()
+        uint64_t sum = 0;
+        for(size_t i = 0; i < num_intervals_; i++)
+            sum += intervals_[i];
+        period_ = float(sum) / num_intervals_;
+    }
+
+    uint32_t       tick_freq_;
+    uint32_t       timeout_ticks_;
+    float          tolerance_;
+    uint32_t       intervals_[kHistorySize];
+    size_t         num_intervals_;
+    size_t         write_pos_;
+    uint32_t       num_edges_;
+    uint32_t       last_edge_ = 0;
+    uint32_t       anchor_    = 0;
+    uint32_t       outlier_;
+    bool           has_outlier_;
+    volatile float period_;
+};
+
+/** @brief Queue of timestamped edges from an interrupt to the audio
+ *         callback
+ *  @ingroup utility
+ *
+ *  Push() is called from the edge interrupt, PopEdgesInBlock() from the
+ *  audio callback after AudioBlockClock::StartBlock(). Edges that happened
+ *  after the start of the block are kept for the next one.
+ *
+ *  @tparam capacity Max. number of edges between two audio blocks, must be
+ *                   a power of two
+ */
+template <size_t capacity = 16>
+class GateEdgeQueue
+{
+  public:
+    GateEdgeQueue() {}
+    ~GateEdgeQueue() {}
+
+    /** Removes all edges. Not thread safe.
+     *  @param level The current level of the gate, see PushEdge()
+     */
+    void Clear(bool level = false)
+    {
+        fifo_.Clear();
+        has_pending_ = false;
+        num_dropped_ = 0;
+        level_       = level;
+    }
+
+    /** Adds an edge, returns false if the queue was full */
+    bool Push(uint32_t tick, bool rising)
+    {
+        GateEdge edge;
+        edge.tick   = tick;
+        edge.rising = rising;
+        edge.offset = 0;
+        if(fifo_.PushBack(edge))
+            return true;
+        num_dropped_++;
+        return false;
+    }
+
+    /** @brief Adds the edge of an interrupt that triggers on both edges
+     *
+     *  The pin may have changed back by the time the interrupt reads it,
+     *  so the direction is taken from the level latched by the previous
+     *  edge instead. A pulse shorter than the interrupt latency only
+     *  raises the interrupt once: if the pin is back at the previous level
+     *  and no further interrupt is pending, the second edge is added with
+     *  the same tick.
+     *
+     *  @param tick     Timestamp of the interrupt
+     *  @param level    Level of the pin, read in the interrupt
+     *  @param pending  true if the interrupt is pending again
+     *  @return true if a rising edge was added
+     */
+    bool PushEdge(uint32_t tick, bool level, bool pending)
+    {
+        level_            = !level_;
+        const bool rising = level_;
+        Push(tick, level_);
+        if(level == level_ || pending)
+            return rising;
+        level_ = level;
+        Push(tick, level_);
+        return rising || level_;
+    }
+
+    /** Removes the edges that belong to the current block and sets their
+     *  sample offsets.
+     *  @param clock        The clock of the current block
+     *  @param edges        Receives the edges, oldest first
+     *  @param max_edges    Capacity of `edges`, any more edges are kept
+     *  @param rising_only  Discards falling edges, e.g. for triggers
+     *  @return the number of edges written to `edges`
+     */
+    size_t PopEdgesInBlock(const AudioBlockClock& clock,
+                           GateEdge*              edges,
+                           size_t                 max_edges,
+                           bool                   rising_only = false)
+    {
+        size_t num = 0;
+        while(num < max_edges)
+        {
+            if(!has_pending_)
+            {
+                if(!fifo_.PopFront(pending_))
+                    break;
+                has_pending_ = true;
+            }
+            size_t offset;
+            if(!clock.GetSampleOffset(pending_.tick, offset))
+                break;
+            has_pending_ = false;
+            if(rising_only && !pending_.rising)
+                continue;
+            edges[num]        = pending_;
+            edges[num].offset = offset;
+            num++;
+        }
+        return num;
+    }
+
+    /** @return the number of edges lost because the queue was full */
+    uint32_t GetNumDropped() const { return num_dropped_; }
+
+  private:
+    LockFreeFIFO<GateEdge, capacity> fifo_;
+    GateEdge                         pending_;
+    bool                             has_pending_ = false;
+    uint32_t                         num_dropped_ = 0;
+    bool                             level_       = false;
+};
+
+} // namespace daisy
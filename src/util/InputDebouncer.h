@@ -0,0 +1,206 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace daisy
+{
+/** @brief Debounces many digital inputs at once with vertical counters
+ *  @ingroup utility
+ *
+ *  The inputs are packed into 32 bit words, one bit per input. Each scan
+ *  debounces a whole word with a handful of bitwise operations, no matter
+ *  how many of its inputs are bouncing. Every input has its own small
+ *  counter, but the counter bits are stored "vertically": counter bit n of
+ *  all 32 inputs is one word. An input only changes its debounced state
+ *  after it was read differently in 2^counter_bits consecutive scans, any
+ *  scan that agrees with the debounced state resets its counter.
+ *
+ *  The samples can come from anywhere, e.g. GPIO::ReadPort(), the state
+ *  words of a ShiftRegister4021 or the pins of a Mcp23X17. Inputs that are
+ *  active low can be flipped with SetInvertMask(), so that a set bit
+ *  always means "pressed".
+ *
+ *  Edges are reported as bitmasks for the most recent scan, and the time
+ *  of the last edge of each input is kept for timing how long a button was
+ *  held.
+ *
+ *  @code
+ *  InputDebouncer<2> keys; // up to 64 keys
+ *  keys.Init();
+ *  keys.SetInvertMask(0, 0xffff);
+ *  // in the main loop, at a fixed rate
+ *  const uint32_t samples[] = {keyboard_sr.StateWord(), mcp.Read()};
+ *  keys.Update(samples, System::GetNow());
+ *  if(keys.HasEdges())
+ *      for(size_t i = 0; i < keys.kNumInputs; i++)
+ *          if(keys.RisingEdge(i))
+ *              StartNote(i);
+ *  @endcode
+ *
+ *  @tparam num_words    Number of 32 bit words of inputs
+ *  @tparam counter_bits Size of the counters, the inputs must be stable
+ *                       for 2^counter_bits scans to change their state.
+ */
+template <size_t num_words = 1, size_t counter_bits = 2>
+class InputDebouncer
+{
+  public:
+    static_assert(num_words > 0, "at least one word of inputs is needed");
+    static_assert(counter_bits > 0 && counter_bits <= 8,
+                  "counter_bits must be in the range 1..8");
+
+    /** The number of inputs that can be debounced */
+    static constexpr size_t kNumInputs = 32 * num_words;
+    /** The number of consecutive scans needed for a change of state */
+    static constexpr size_t kStableScans = size_t(1) << counter_bits;
+
+    InputDebouncer() {}
+    ~InputDebouncer() {}
+
+    /** Resets all inputs to released and clears the invert masks.
+     *  @param now Timestamp that's used as the last edge time of all inputs
+     */
+    void Init(uint32_t now = 0)
+    {
+        for(size_t w = 0; w < num_words; w++)
+        {
+            states_[w]  = 0;
+            rising_[w]  = 0;
+            falling_[w] = 0;
+            invert_[w]  = 0;
+            for(size_t b = 0; b < counter_bits; b++)
+                counters_[b][w] = 0;
+        }
+        for(size_t i = 0; i < kNumInputs; i++)
+            edge_times_[i] = now;
+        update_time_ = now;
+        has_edges_   = false;
+    }
+
+    /** Sets which inputs of a word are active low. The raw samples of
+     *  those inputs are inverted before debouncing.
+     */
+    void SetInvertMask(size_t word, uint32_t mask) { invert_[word] = mask; }
+
+    /** Forces the debounced state of a word without reporting edges,
+     *  e.g. to start from the current state of the inputs after power up.
+     *  @param word  Index of the word
+     *  @param state Debounced state, already inverted where needed
+     */
+    void SetState(size_t word, uint32_t state)
+    {
+        states_[word] = state;
+        for(size_t b = 0; b < counter_bits; b++)
+            counters_[b][word] = 0;
+    }
+
+    /** Debounces one scan of all inputs. Should be called at a steady rate,
+     *  which sets the debounce time together with counter_bits.
+     *  @param samples Raw state of the inputs, one bit per input
+     *  @param now     Timestamp of the scan, e.g. from System::GetNow()
+     */
+    void Update(const uint32_t (&samples)[num_words], uint32_t now)
+    {
+        update_time_ = now;
+        has_edges_   = false;
+        for(size_t w = 0; w < num_words; w++)
+            UpdateWord(w, samples[w], now);
+    }
+
+    /** Debounces one scan of the inputs in the first word.
+     *  @param sample Raw state of the inputs, one bit per input
+     *  @param now    Timestamp of the scan, e.g. from System::GetNow()
+     */
+    void Update(uint32_t sample, uint32_t now)
+    {
+        static_assert(num_words == 1, "all words must be updated at once");
+        const uint32_t samples[1] = {sample};
+        Update(samples, now);
+    }
+
+    /** @return the debounced state of a word, set bits are pressed */
+    uint32_t GetStates(size_t word = 0) const { return states_[word]; }
+
+    /** @return inputs of a word that were pressed in the last scan */
+    uint32_t GetRisingEdges(size_t word = 0) const { return rising_[word]; }
+
+    /** @return inputs of a word that were released in the last scan */
+    uint32_t GetFallingEdges(size_t word = 0) const { return falling_[word]; }
+
+    /** @return true if any input changed its state in the last scan */
+    bool HasEdges() const { return has_edges_; }
+
+    /** @return true if the input is pressed */
+    bool Pressed(size_t idx) const { return TestBit(states_, idx); }
+
+    /** @return true if the input was pressed in the last scan */
+    bool RisingEdge(size_t idx) const { return TestBit(rising_, idx); }
+
+    /** @return true if the input was released in the last scan */
+    bool FallingEdge(size_t idx) const { return TestBit(falling_, idx); }
+
+    /** @return the timestamp of the scan in which the input last changed */
+    uint32_t GetEdgeTime(size_t idx) const { return edge_times_[idx]; }
+
+    /** @return the timestamp of the last scan */
+    uint32_t GetUpdateTime() const { return update_time_; }
+
+    /** @return the time the input has been held, or 0 if it's released.
+     *  The unit is the one of the timestamps passed to Update().
+     */
+    uint32_t TimeHeld(size_t idx) const
+    {
+        return Pressed(idx) ? update_time_ - edge_times_[idx] : 0;
+    }
+
+  private:
+    void UpdateWord(size_t w, uint32_t sample, uint32_t now)
+    {
+        // inputs that currently disagree with the debounced state
+        const uint32_t delta = (sample ^ invert_[w]) ^ states_[w];
+
+        // count up where they disagree, the carry out of the top bit
+        // means that an input disagreed for kStableScans scans
+        uint32_t carry = delta;
+        for(size_t b = 0; b < counter_bits; b++)
+        {
+            counters_[b][w] ^= carry;
+            carry &= ~counters_[b][w];
+            // any agreement resets the counter
+            counters_[b][w] &= delta;
+        }
+
+        const uint32_t toggle = carry;
+        states_[w] ^= toggle;
+        rising_[w]  = toggle & states_[w];
+        falling_[w] = toggle & ~states_[w];
+        if(toggle == 0)
+            return;
+
+        has_edges_ = true;
+        for(uint32_t bits = toggle; bits != 0; bits &= bits - 1)
+            edge_times_[32 * w + __builtin_ctz(bits)] = now;
+    }
+
+    static bool TestBit(const uint32_t (&words)[num_words], size_t idx)
+    {
+        return (words[idx / 32] >> (idx % 32)) & 1;
+    }
+
+    uint32_t states_[num_words];
+    uint32_t rising_[num_words];
+    uint32_t falling_[num_words];
+    uint32_t invert_[num_words];
+    uint32_t counters_[counter_bits][num_words];
+    uint32_t edge_times_[kNumInputs];
+    uint32_t update_time_;
+    bool     has_edges_;
+};
+
+template <size_t num_words, size_t counter_bits>
+constexpr size_t InputDebouncer<num_words, counter_bits>::kNumInputs;
+template <size_t num_words, size_t counter_bits>
+constexpr size_t InputDebouncer<num_words, counter_bits>::kStableScans;
+
+} // namespace daisy
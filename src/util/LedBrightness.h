@@ -0,0 +1,250 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace daisy
+{
+/** @brief Gamma curves for LED brightness, see LedGammaCurve
+ *  @ingroup utility
+ *  The value is the exponent that's applied to the brightness.
+ */
+enum class LedGamma
+{
+    /** No correction, brightness is proportional to the duty cycle */
+    LINEAR = 1,
+    /** Squared brightness, close to the perceived brightness of LEDs */
+    SQUARE = 2,
+    /** Cubed brightness, as used by Led for software PWM */
+    CUBE = 3,
+};
+
+/** @brief Lookup table with 256 segments of a gamma curve
+ *  @ingroup utility
+ */
+struct LedGammaLut
+{
+    /** Light intensity (0..65535) at brightness i / 256 */
+    uint16_t values[257];
+};
+
+/** Computes the lookup table for `gamma` at compile time */
+constexpr LedGammaLut MakeLedGammaLut(LedGamma gamma)
+{
+    LedGammaLut lut = {};
+    for(uint32_t i = 0; i <= 256; i++)
+    {
+        // brightness in Q16, raised to the power and rounded back to Q16
+        const uint64_t x = i << 8;
+        uint64_t       y = 1;
+        for(int n = 0; n < int(gamma); n++)
+            y *= x;
+        const int shift = 16 * (int(gamma) - 1);
+        if(shift > 0)
+            y = (y + (uint64_t(1) << (shift - 1))) >> shift;
+        lut.values[i] = uint16_t((y * 65535 + 32768) >> 16);
+    }
+    return lut;
+}
+
+/** @brief Converts brightness to light intensity with a precomputed
+ *         gamma curve
+ *  @ingroup utility
+ *
+ *  The table is computed at compile time and placed in flash. Values
+ *  between the 257 table entries are interpolated linearly, so that the
+ *  16 bit output is much finer than the 8 bit brightness steps that are
+ *  usually used for LEDs.
+ *
+ *  @tparam gamma The curve to apply
+ */
+template <LedGamma gamma>
+class LedGammaCurve
+{
+  public:
+    /** The lookup table */
+    static constexpr LedGammaLut kLut = MakeLedGammaLut(gamma);
+
+    /** Returns the intensity (0..65535) for a brightness between 0 and 1.
+     *  The brightness is clamped.
+     */
+    static uint16_t Apply(float brightness)
+    {
+        if(!(brightness > 0.0f))
+            return 0;
+        if(brightness >= 1.0f)
+            return 65535;
+        return ApplyQ16(uint32_t(brightness * 65536.0f + 0.5f));
+    }
+
+    /** Returns the intensity (0..65535) for a brightness between 0 and 255 */
+    static uint16_t Apply(uint8_t brightness)
+    {
+        return ApplyQ16((uint32_t(brightness) * 65536 + 127) / 255);
+    }
+
+    /** Returns the intensity (0..65535) for a brightness in Q16, i.e. from
+     *  0 to 65536.
+     */
+    static uint16_t ApplyQ16(uint32_t brightness)
+    {
+        if(brightness >= 65536)
+            return 65535;
+        const uint32_t idx  = brightness >> 8;
+        const uint32_t frac = brightness & 0xFF;
+        const uint32_t a    = kLut.values[idx];
+        const uint32_t b    = kLut.values[idx + 1];
+        return uint16_t(a + (((b - a) * frac + 128) >> 8));
+    }
+};
+
+template <LedGamma gamma>
+constexpr LedGammaLut LedGammaCurve<gamma>::kLut;
+
+/** @brief Encodes the brightness of many LEDs to PWM duty cycles
+ *  @ingroup utility
+ *
+ *  Brightness values are converted to intensities with a LedGammaCurve
+ *  when they're set, and stored as duty cycles with 16 fractional bits.
+ *  Encode() is called once per output frame and writes the duty cycles of
+ *  the channels that changed. With temporal dithering enabled, the
+ *  fractional part is distributed over successive frames, so that the
+ *  average output has 16 bits more resolution than the PWM itself. This
+ *  makes slow fades at low brightness smooth.
+ *
+ *  \code
+ *  LedBrightnessEncoder<16, 4095> encoder;
+ *  encoder.Init(true);
+ *  encoder.Set(3, 0.01f);
+ *  // once per frame
+ *  encoder.Encode([&](size_t channel, uint16_t duty) { pwm[channel] = duty; });
+ *  \endcode
+ *
+ *  @tparam numChannels The number of LEDs
+ *  @tparam maxDuty     The duty cycle for full brightness, e.g. 4095 for
+ *                      12 bit PWM
+ *  @tparam gamma       The gamma curve to apply
+ */
+template <size_t   numChannels,
+          uint16_t maxDuty,
+          LedGamma gamma = LedGamma::SQUARE>
+class LedBrightnessEncoder
+{
+  public:
+    using Curve = LedGammaCurve<gamma>;
+
+    LedBrightnessEncoder() { Init(); }
+
+    /** Initializes all channels to zero.
+     *  @param dither Enables temporal dithering
+     */
+    void Init(bool dither = false)
+    {
+        dither_ = dither;
+        for(size_t ch = 0; ch < numChannels; ch++)
+        {
+            target_[ch] = 0;
+            error_[ch]  = 0;
+            // the outputs are in an unknown state, write everything once
+            lastDuty_[ch] = kUnknownDuty;
+        }
+        for(size_t w = 0; w < kNumWords; w++)
+            changed_[w] = ~uint32_t(0);
+    }
+
+    /** Enables or disables temporal dithering */
+    void SetDithering(bool dither) { dither_ = dither; }
+
+    /** Sets a gamma corrected brightness between 0.0f and 1.0f */
+    void Set(size_t channel, float brightness)
+    {
+        SetIntensity(channel, Curve::Apply(brightness));
+    }
+
+    /** Sets a gamma corrected brightness between 0 and 255 */
+    void Set(size_t channel, uint8_t brightness)
+    {
+        SetIntensity(channel, Curve::Apply(brightness));
+    }
+
+    /** Sets a linear intensity between 0 and 65535 */
+    void SetIntensity(size_t channel, uint16_t intensity)
+    {
+        // 65535 maps to exactly maxDuty
+        SetTarget(channel,
+                  uint32_t((uint64_t(intensity) * maxDuty * 65536) / 65535));
+    }
+
+    /** Sets a raw duty cycle between 0 and maxDuty, without dithering */
+    void SetDuty(size_t channel, uint16_t duty)
+    {
+        SetTarget(channel, uint32_t(duty < maxDuty ? duty : maxDuty) << 16);
+    }
+
+    /** Returns the duty cycle with 16 fractional bits */
+    uint32_t GetTarget(size_t channel) const { return target_[channel]; }
+
+    /** Computes the duty cycles for the next frame and calls
+     *  `write(channel, duty)` for each channel whose duty cycle differs
+     *  from the previous frame.
+     *  @param writeAll Calls `write` for all channels, e.g. if the output
+     *                  buffer doesn't keep the previous values
+     *  @return The number of channels that were written
+     */
+    template <typename WriteFunction>
+    size_t Encode(WriteFunction&& write, bool writeAll = false)
+    {
+        size_t numWritten = 0;
+        for(size_t ch = 0; ch < numChannels; ch++)
+        {
+            const uint32_t target  = target_[ch];
+            const uint32_t frac    = target & 0xFFFF;
+            const uint32_t bit     = uint32_t(1) << (ch & 31);
+            const bool     changed = changed_[ch >> 5] & bit;
+            const bool     dither  = dither_ && frac != 0;
+            if(!changed && !dither && !writeAll)
+                continue;
+            changed_[ch >> 5] &= ~bit;
+
+            uint16_t duty;
+            if(dither)
+            {
+                // first order error feedback, never exceeds maxDuty since
+                // there's no fraction at full brightness
+                const uint32_t sum = error_[ch] + frac;
+                duty               = uint16_t((target >> 16) + (sum >> 16));
+                error_[ch]         = uint16_t(sum);
+            }
+            else
+                duty = uint16_t((target + 0x8000) >> 16);
+
+            if(duty != lastDuty_[ch] || writeAll)
+            {
+                write(ch, duty);
+                lastDuty_[ch] = duty;
+                numWritten++;
+            }
+        }
+        return numWritten;
+    }
+
+  private:
+    static constexpr size_t   kNumWords    = (numChannels + 31) / 32;
+    static constexpr uint16_t kUnknownDuty = 0xFFFF;
+
+    void SetTarget(size_t channel, uint32_t target)
+    {
+        if(channel >= numChannels || target_[channel] == target)
+            return;
+        target_[channel] = target;
+        changed_[channel >> 5] |= uint32_t(1) << (channel & 31);
+    }
+
+    uint32_t target_[numChannels];
+    uint16_t error_[numChannels];
+    uint16_t lastDuty_[numChannels];
+    uint32_t changed_[kNumWords];
+    bool     dither_;
+};
+
+} // namespace daisy
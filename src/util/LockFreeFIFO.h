@@ -0,0 +1,140 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+namespace daisy
+{
+/** @brief A lock-free FIFO for multiple producers and consumers
+ *  @ingroup utility
+ *
+ *  A bounded FIFO queue that can be written to and read from concurrently
+ *  without disabling interrupts, e.g. from interrupt handlers and the main loop
+ *  at the same time. Each slot carries a sequence number that tells producers
+ *  and consumers if it's ready to be written or read, so that neither side ever
+ *  has to wait for the other one.
+ *
+ *  On the Cortex-M7, the atomic operations compile to LDREX/STREX sequences.
+ *
+ *  @tparam T           The type of elements to store. Must be copyable.
+ *  @tparam capacity    The number of elements that can be stored. Must be a
+ *                      power of two.
+ */
+template <typename T, size_t capacity>
+class LockFreeFIFO
+{
+  public:
+    static_assert(capacity >= 2 && (capacity & (capacity - 1)) == 0,
+                  "capacity must be a power of two");
+
+    LockFreeFIFO() { Clear(); }
+
+    /** Removes all elements from the FIFO. This is not thread safe and
+     *  must not be called while other threads access the FIFO.
+     */
+    void Clear()
+    {
+        for(size_t i = 0; i < capacity; i++)
+            slots_[i].sequence.store(i, std::memory_order_relaxed);
+        writePos_.store(0, std::memory_order_relaxed);
+        readPos_.store(0, std::memory_order_release);
+    }
+
+    /** Adds an element to the back of the FIFO, returning true on success
+     *  or false if the FIFO was full.
+     */
+    bool PushBack(const T& elementToAdd)
+    {
+        uint32_t pos = writePos_.load(std::memory_order_relaxed);
+        for(;;)
+        {
+            Slot&          slot = slots_[pos & kIndexMask];
+            const uint32_t seq  = slot.sequence.load(std::memory_order_acquire);
+            const int32_t  diff = int32_t(seq - pos);
+            if(diff == 0)
+            {
+                // the slot is free - try to claim it
+                if(writePos_.compare_exchange_weak(
+                       pos, pos + 1, std::memory_order_relaxed))
+                {
+                    slot.value = elementToAdd;
+                    slot.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+                // another producer was faster, pos was updated - try again
+            }
+            else if(diff < 0)
+                return false; // full
+            else
+                pos = writePos_.load(std::memory_order_relaxed);
+        }
+    }
+
+    /** Removes an element from the front of the FIFO and writes it to
+     *  `result`. Returns false if the FIFO was empty.
+     */
+    bool PopFront(T& result)
+    {
+        uint32_t pos = readPos_.load(std::memory_order_relaxed);
+        for(;;)
+        {
+            Slot&          slot = slots_[pos & kIndexMask];
+            const uint32_t seq  = slot.sequence.load(std::memory_order_acquire);
+            const int32_t  diff = int32_t(seq - (pos + 1));
+            if(diff == 0)
+            {
+                // the slot holds data - try to claim it
+                if(readPos_.compare_exchange_weak(
+                       pos, pos + 1, std::memory_order_relaxed))
+                {
+                    result = slot.value;
+                    slot.sequence.store(pos + capacity,
+                                        std::memory_order_release);
+                    return true;
+                }
+            }
+            else if(diff < 0)
+                return false; // empty
+            else
+                pos = readPos_.load(std::memory_order_relaxed);
+        }
+    }
+
+    /** Returns true if the FIFO is empty. If other threads are accessing
+     *  the FIFO concurrently, this is only a snapshot.
+     */
+    bool IsEmpty() const { return GetNumElements() == 0; }
+
+    /** Returns the number of elements in the FIFO. If other threads are
+     *  accessing the FIFO concurrently, this is only a snapshot.
+     */
+    size_t GetNumElements() const
+    {
+        const uint32_t read  = readPos_.load(std::memory_order_acquire);
+        const uint32_t write = writePos_.load(std::memory_order_acquire);
+        const int32_t  num   = int32_t(write - read);
+        return (num > 0) ? size_t(num) : 0;
+    }
+
+    /** Returns the total capacity */
+    size_t GetCapacity() const { return capacity; }
+
+  private:
+    LockFreeFIFO(const LockFreeFIFO& other) = delete;
+    LockFreeFIFO& operator=(const LockFreeFIFO& other) = delete;
+
+    static constexpr uint32_t kIndexMask = capacity - 1;
+
+    struct Slot
+    {
+        std::atomic<uint32_t> sequence;
+        T                     value;
+    };
+
+    Slot                  slots_[capacity];
+    std::atomic<uint32_t> writePos_;
+    std::atomic<uint32_t> readPos_;
+};
+
+} // namespace daisy
@@ -0,0 +1,334 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <new>
+
+namespace daisy
+{
+/** @brief A bump allocator on top of a block of memory
+ *  @ingroup utility
+ *
+ *  Allocations are carved off the front of the memory block one after the
+ *  other, aligned to 32 byte cache lines by default, so that buffers can be
+ *  used with DMA and cache maintenance functions without sharing a cache line
+ *  with other data.
+ *
+ *  Individual allocations can't be freed. Instead, the arena can be reset
+ *  to a previous state with GetMarker() / ResetToMarker(), or entirely with
+ *  Reset(). Use a MemoryPool for objects that are created and destroyed
+ *  frequently.
+ *
+ *  The arena is not thread safe. Allocate from the main thread, e.g. during
+ *  initialization.
+ *
+ *  Example:
+ *  \code
+ *  MemoryArena arena;
+ *  arena.Init(buffer, sizeof(buffer));
+ *  float* delayLine = arena.AllocateArray<float>(48000);
+ *  if(delayLine == nullptr)
+ *      // out of memory
+ *  \endcode
+ */
+class MemoryArena
+{
+  public:
+    /** The default alignment, matching the cache line size of the Cortex-M7 */
+    static constexpr size_t kCacheLineSize = 32;
+
+    MemoryArena() {}
+
+    /** Initializes the arena.
+     *  @param memory   The memory block to allocate from
+     *  @param size     The size of the memory block in bytes
+     */
+    void Init(void* memory, size_t size)
+    {
+        begin_         = reinterpret_cast<uintptr_t>(memory);
+        end_           = begin_ + size;
+        Reset();
+        highWatermark_ = 0;
+        numFailed_     = 0;
+    }
+
+    /** Allocates a block of memory.
+     *  @param size         The number of bytes to allocate
+     *  @param alignment    Alignment of the block, must be a power of two
+     *  @return The memory block or nullptr if there's not enough memory
+     */
+    void* Allocate(size_t size, size_t alignment = kCacheLineSize)
+    {
+        if(alignment == 0 || (alignment & (alignment - 1)) != 0)
+            return nullptr;
+        const uintptr_t start = (current_ + alignment - 1) & ~(alignment - 1);
+        if(start < current_ || start > end_ || size > end_ - start)
+        {
+            numFailed_++;
+            return nullptr;
+        }
+        current_ = start + size;
+        if(GetUsed() > highWatermark_)
+            highWatermark_ = GetUsed();
+        return reinterpret_cast<void*>(start);
+    }
+
+    /** Allocates an array of `num` objects and default-constructs them.
+     *  The destructors are never called.
+     *  @return The array or nullptr if there's not enough memory
+     */
+    template <typename T>
+    T* AllocateArray(size_t num, size_t alignment = kCacheLineSize)
+    {
+        if(num > (end_ - begin_) / sizeof(T))
+        {
+            numFailed_++;
+            return nullptr;
+        }
+        const size_t align = alignment > alignof(T) ? alignment : alignof(T);
+        T* const     array = static_cast<T*>(Allocate(num * sizeof(T), align));
+        if(array != nullptr)
+            for(size_t i = 0; i < num; i++)
+                new(&array[i]) T();
+        return array;
+    }
+
+    /** Allocates a single object and constructs it with `args`.
+     *  The destructor is never called.
+     *  @return The object or nullptr if there's not enough memory
+     */
+    template <typename T, typename... Args>
+    T* Create(Args&&... args)
+    {
+        const size_t align
+            = kCacheLineSize > alignof(T) ? kCacheLineSize : alignof(T);
+        void* const memory = Allocate(sizeof(T), align);
+        if(memory == nullptr)
+            return nullptr;
+        return new(memory) T(static_cast<Args&&>(args)...);
+    }
+
+    /** Returns a marker for the current state of the arena */
+    size_t GetMarker() const { return GetUsed(); }
+
+    /** Frees everything that was allocated after the marker was taken */
+    void ResetToMarker(size_t marker)
+    {
+        if(marker <= GetUsed())
+            current_ = begin_ + marker;
+    }
+
+    /** Frees all allocations. The high watermark is kept. */
+    void Reset() { current_ = begin_; }
+
+    /** Returns the total size of the arena in bytes */
+    size_t GetSize() const { return end_ - begin_; }
+
+    /** Returns the number of bytes in use, including alignment padding */
+    size_t GetUsed() const { return current_ - begin_; }
+
+    /** Returns the number of bytes that are still available. Alignment
+     *  can make the largest possible allocation smaller than this. */
+    size_t GetFree() const { return end_ - current_; }
+
+    /** Returns the highest number of bytes that were ever in use */
+    size_t GetHighWatermark() const { return highWatermark_; }
+
+    /** Returns the number of allocations that failed */
+    size_t GetNumFailedAllocations() const { return numFailed_; }
+
+    /** Returns true if `ptr` points into the arena */
+    bool Contains(const void* ptr) const
+    {
+        const uintptr_t addr = reinterpret_cast<uintptr_t>(ptr);
+        return addr >= begin_ && addr < end_;
+    }
+
+  private:
+    MemoryArena(const MemoryArena& other) = delete;
+    MemoryArena& operator=(const MemoryArena& other) = delete;
+
+    uintptr_t begin_         = 0;
+    uintptr_t end_           = 0;
+    uintptr_t current_       = 0;
+    size_t    highWatermark_ = 0;
+    size_t    numFailed_     = 0;
+};
+
+/** @brief A pool of equally sized memory blocks
+ *  @ingroup utility
+ *
+ *  Allocating and freeing blocks takes constant time and never fragments the
+ *  memory. This is useful for voices, delay lines or sample buffers that are
+ *  created and destroyed while the program is running.
+ *  Each block is aligned to a 32 byte cache line.
+ *
+ *  The pool is not thread safe.
+ *
+ *  Example:
+ *  \code
+ *  MemoryPool voices;
+ *  voices.Init(Memory::GetSdramArena(), sizeof(Voice), 16);
+ *  Voice* v = voices.Create<Voice>();
+ *  ...
+ *  voices.Destroy(v);
+ *  \endcode
+ */
+class MemoryPool
+{
+  public:
+    MemoryPool() {}
+
+    /** Initializes the pool on top of a block of memory. The block should
+     *  be aligned to MemoryArena::kCacheLineSize.
+     *  @param memory       The memory to use
+     *  @param size         Size of `memory` in bytes
+     *  @param blockSize    Size of a single block in bytes
+     *  @return The number of blocks in the pool
+     */
+    size_t Init(void* memory, size_t size, size_t blockSize)
+    {
+        blockSize_ = RoundUpBlockSize(blockSize);
+        memory_    = static_cast<uint8_t*>(memory);
+        numBlocks_ = memory_ != nullptr ? size / blockSize_ : 0;
+        numUsed_   = 0;
+        maxUsed_   = 0;
+        numFailed_ = 0;
+
+        // thread the free list through the blocks
+        freeList_ = nullptr;
+        for(size_t i = numBlocks_; i > 0; i--)
+        {
+            FreeBlock* block = reinterpret_cast<FreeBlock*>(
+                memory_ + (i - 1) * blockSize_);
+            block->next = freeList_;
+            freeList_   = block;
+        }
+        return numBlocks_;
+    }
+
+    /** Initializes the pool with `numBlocks` blocks allocated from an arena.
+     *  @return true if the memory could be allocated
+     */
+    bool Init(MemoryArena& arena, size_t blockSize, size_t numBlocks)
+    {
+        const size_t roundedSize = RoundUpBlockSize(blockSize);
+        void* const  memory      = numBlocks <= arena.GetSize() / roundedSize
+                                       ? arena.Allocate(roundedSize * numBlocks)
+                                       : nullptr;
+        Init(memory, roundedSize * numBlocks, blockSize);
+        return memory != nullptr;
+    }
+
+    /** Returns a free block or nullptr if all blocks are in use */
+    void* Allocate()
+    {
+        if(freeList_ == nullptr)
+        {
+            numFailed_++;
+            return nullptr;
+        }
+        FreeBlock* block = freeList_;
+        freeList_        = block->next;
+        if(++numUsed_ > maxUsed_)
+            maxUsed_ = numUsed_;
+        return block;
+    }
+
+    /** Returns a block to the pool. Passing nullptr or a pointer that
+     *  doesn't belong to the pool has no effect.
+     *  @return true if the block was returned
+     */
+    bool Free(void* ptr)
+    {
+        if(!Contains(ptr))
+            return false;
+        FreeBlock* block = static_cast<FreeBlock*>(ptr);
+        block->next      = freeList_;
+        freeList_        = block;
+        numUsed_--;
+        return true;
+    }
+
+    /** Allocates a block and constructs an object in it */
+    template <typename T, typename... Args>
+    T* Create(Args&&... args)
+    {
+        static_assert(alignof(T) <= MemoryArena::kCacheLineSize,
+                      "unsupported alignment");
+        if(sizeof(T) > blockSize_)
+            return nullptr;
+        void* const memory = Allocate();
+        if(memory == nullptr)
+            return nullptr;
+        return new(memory) T(static_cast<Args&&>(args)...);
+    }
+
+    /** Destroys an object that was created with Create() and returns its
+     *  block to the pool */
+    template <typename T>
+    void Destroy(T* object)
+    {
+        if(!Contains(object))
+            return;
+        object->~T();
+        Free(object);
+    }
+
+    /** Returns true if `ptr` points to the start of a block in this pool */
+    bool Contains(const void* ptr) const
+    {
+        const uint8_t* p = static_cast<const uint8_t*>(ptr);
+        if(p == nullptr || p < memory_)
+            return false;
+        if(p >= memory_ + numBlocks_ * blockSize_)
+            return false;
+        return size_t(p - memory_) % blockSize_ == 0;
+    }
+
+    /** Returns the size of each block in bytes, after rounding it up
+     *  to a multiple of the cache line size */
+    size_t GetBlockSize() const { return blockSize_; }
+
+    /** Returns the total number of blocks */
+    size_t GetNumBlocks() const { return numBlocks_; }
+
+    /** Returns the number of blocks in use */
+    size_t GetNumUsed() const { return numUsed_; }
+
+    /** Returns the number of free blocks */
+    size_t GetNumFree() const { return numBlocks_ - numUsed_; }
+
+    /** Returns the highest number of blocks that were in use at once */
+    size_t GetHighWatermark() const { return maxUsed_; }
+
+    /** Returns the number of allocations that failed */
+    size_t GetNumFailedAllocations() const { return numFailed_; }
+
+  private:
+    MemoryPool(const MemoryPool& other) = delete;
+    MemoryPool& operator=(const MemoryPool& other) = delete;
+
+    struct FreeBlock
+    {
+        FreeBlock* next;
+    };
+
+    static size_t RoundUpBlockSize(size_t blockSize)
+    {
+        constexpr size_t align = MemoryArena::kCacheLineSize;
+        if(blockSize < sizeof(FreeBlock))
+            blockSize = sizeof(FreeBlock);
+        return (blockSize + align - 1) & ~(align - 1);
+    }
+
+    uint8_t*   memory_    = nullptr;
+    size_t     blockSize_ = MemoryArena::kCacheLineSize;
+    size_t     numBlocks_ = 0;
+    size_t     numUsed_   = 0;
+    size_t     maxUsed_   = 0;
+    size_t     numFailed_ = 0;
+    FreeBlock* freeList_  = nullptr;
+};
+
+} // namespace daisy
@@ -0,0 +1,593 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "hid/midi_parser.h"
+#include "util/GateTiming.h"
+#include "util/LockFreeFIFO.h"
+
+namespace daisy
+{
+/** @brief A beat or subdivision of a MIDI clock, placed in an audio block
+ *  @ingroup midi
+ */
+struct MidiClockDivision
+{
+    /** Position in the current audio block, in samples */
+    size_t offset;
+    /** Divisions since the start of the song */
+    uint32_t index;
+    /** Beats (quarter notes) since the start of the song */
+    uint32_t beat;
+    /** Division within the beat, 0 on the beat */
+    uint8_t division;
+};
+
+/** @brief Follows the tempo, transport and song position of a MIDI clock
+ *  @ingroup midi
+ *
+ *  The timing clock (24 pulses per quarter note) is followed with a
+ *  phase-locked loop: each pulse is compared to the predicted time, and
+ *  the phase and period are corrected by a fraction of the error. While
+ *  locking in, the fractions are the gains of a least-squares fit to all
+ *  pulses so far (the Kalman gains for a constant tempo), which shrink
+ *  until they reach a floor that still follows tempo changes. So the
+ *  tempo is known after two pulses and settles within a few beats, and
+ *  the jitter of the clock (e.g. a millisecond on USB) is smoothed out.
+ *
+ *  - A pulse that's off by about a whole period counts as missed pulses.
+ *  - A single pulse beyond the tolerance is ignored, a second one in a
+ *    row means the tempo jumped and the loop locks in again.
+ *  - No pulse for longer than the timeout loses the lock.
+ *
+ *  Start, Continue, Stop and the song position pointer move the position
+ *  as the MIDI spec says: the first pulse after Start is the first beat,
+ *  and a song position received while stopped applies from Continue.
+ *
+ *  PushEvent() is called from the MIDI receive interrupt with the tick
+ *  of each event, see MidiHandler::SetEventCallback(). ProcessBlock() is
+ *  called from the audio callback after AudioBlockClock::StartBlock(),
+ *  and returns the beats and divisions of the previous block period as
+ *  sample offsets in the current block, just like GateEdgeQueue. The
+ *  divisions are placed on the smoothed clock, so their timing doesn't
+ *  jitter with the pulses, and they keep going for up to one pulse when a
+ *  pulse is late.
+ *
+ *  @tparam capacity Max. number of events between two audio blocks, must
+ *                   be a power of two
+ */
+template <size_t capacity = 32>
+class MidiClockFollower
+{
+  public:
+    static constexpr uint32_t kPulsesPerBeat = 24;
+
+    enum class Transport
+    {
+        STOPPED,
+        PLAYING,
+    };
+
+    MidiClockFollower() {}
+    ~MidiClockFollower() {}
+
+    /** Initializes the follower
+     *  @param tick_freq            Frequency of the ticks of the events,
+     *                              see System::GetTickFreq()
+     *  @param divisions_per_beat   Divisions returned per quarter note,
+     *                              e.g. 4 for sixteenths, 1 to 24
+     *  @param timeout              Seconds without a pulse until the
+     *                              lock is lost
+     *  @param tolerance            Deviation of a pulse from the predicted
+     *                              time, relative to the period, that's
+     *                              still considered jitter
+     */
+    void Init(uint32_t tick_freq,
+              uint8_t  divisions_per_beat = 4,
+              float    timeout            = 0.5f,
+              float    tolerance          = 0.25f)
+    {
+        tick_freq_     = tick_freq;
+        timeout_ticks_ = uint32_t(timeout * tick_freq);
+        tolerance_     = tolerance;
+        divisions_per_beat_
+            = divisions_per_beat < 1    ? 1
+              : divisions_per_beat > 24 ? uint8_t(24)
+                                        : divisions_per_beat;
+        Reset();
+    }
+
+    /** Stops the transport and forgets the tempo and all events. Not
+     *  thread safe. */
+    void Reset()
+    {
+        events_.Clear();
+        has_pending_   = false;
+        num_dropped_   = 0;
+        transport_     = Transport::STOPPED;
+        has_position_  = false;
+        last_pulse_    = 0;
+        next_pulse_    = 0;
+        next_division_ = 0;
+        stop_pulses_   = 0.f;
+        lock_count_    = 0;
+        period_        = 0.f;
+        phase_tick_    = 0;
+        last_tick_     = 0;
+        has_outlier_   = false;
+        jitter_        = 0.f;
+        jitter_count_  = 0;
+        last_error_    = 0.f;
+        drift_         = 0;
+    }
+
+    /** Queues the timing clock, transport and song position events, and
+     *  ignores all others. Can be called from an interrupt.
+     *  @param event    The received event
+     *  @param tick     The system tick at which it was received
+     *  @return false if the event was dropped because the queue was full
+     */
+    bool PushEvent(const MidiEvent& event, uint32_t tick)
+    {
+        SyncEvent sync;
+        sync.tick          = tick;
+        sync.song_position = 0;
+        if(event.type == SystemRealTime)
+        {
+            switch(event.srt_type)
+            {
+                case TimingClock: sync.type = SyncType::CLOCK; break;
+                case SystemRealTimeType::Start:
+                    sync.type = SyncType::START;
+                    break;
+                case SystemRealTimeType::Continue:
+                    sync.type = SyncType::CONTINUE;
+                    break;
+                case SystemRealTimeType::Stop:
+                    sync.type = SyncType::STOP;
+                    break;
+                default: return true;
+            }
+        }
+        else if(event.type == SystemCommon
+                && event.sc_type == SongPositionPointer)
+        {
+            sync.type          = SyncType::SONG_POSITION;
+            sync.song_position = uint16_t((event.data[1] << 7) | event.data[0]);
+        }
+        else
+        {
+            return true;
+        }
+        if(events_.PushBack(sync))
+            return true;
+        num_dropped_++;
+        return false;
+    }
+
+    /** Applies the events of the previous block period, and returns its
+     *  beats and divisions as sample offsets in the current block.
+     *  @param clock            The clock of the current block
+     *  @param divisions        Receives the divisions, in order
+     *  @param max_divisions    Size of `divisions`, any more are returned
+     *                          with the next block
+     *  @return the number of divisions written to `divisions`
+     */
+    size_t ProcessBlock(const AudioBlockClock& clock,
+                        MidiClockDivision*     divisions,
+                        size_t                 max_divisions)
+    {
+        const uint32_t block_start = clock.GetBlockStartTick();
+        for(;;)
+        {
+            if(!has_pending_)
+            {
+                if(!events_.PopFront(pending_))
+                    break;
+                has_pending_ = true;
+            }
+            // events after the start of the block are for the next one
+            if(int32_t(pending_.tick - block_start) >= 0)
+                break;
+            has_pending_ = false;
+            ApplyEvent(pending_);
+        }
+        if(lock_count_ > 0 && int32_t(block_start - last_tick_) > 0
+           && block_start - last_tick_ > timeout_ticks_)
+            lock_count_ = 0;
+
+        size_t num = 0;
+        if(!has_position_ || lock_count_ == 0)
+            return 0;
+        while(num < max_divisions)
+        {
+            // pulses from the last pulse to the next division, exact as
+            // long as the integer part fits
+            const int32_t scaled
+                = int32_t(next_division_ * kPulsesPerBeat
+                          - last_pulse_ * divisions_per_beat_);
+            // without a period, only a division on the pulse is known
+            if(lock_count_ < 2 && scaled != 0)
+                break;
+            const float pulses = float(scaled) / divisions_per_beat_;
+            if(transport_ == Transport::PLAYING ? pulses > 1.f
+                                                : pulses >= stop_pulses_)
+                break;
+            const uint32_t tick
+                = phase_tick_ + uint32_t(int32_t(pulses * period_));
+            size_t offset;
+            if(!clock.GetSampleOffset(tick, offset))
+                break;
+            MidiClockDivision& division = divisions[num++];
+            division.offset             = offset;
+            division.index              = next_division_;
+            division.beat               = next_division_ / divisions_per_beat_;
+            division.division
+                = uint8_t(next_division_ % divisions_per_beat_);
+            next_division_++;
+        }
+        return num;
+    }
+
+    /** Handles a timing clock pulse */
+    void Clock(uint32_t tick)
+    {
+        const uint32_t interval = tick - last_tick_;
+        last_tick_              = tick;
+        uint32_t pulses         = 1;
+        if(lock_count_ == 0 || interval > timeout_ticks_)
+        {
+            // the first pulse, only the phase is known
+            lock_count_   = 1;
+            phase_tick_   = tick;
+            has_outlier_  = false;
+            jitter_       = 0.f;
+            jitter_count_ = 0;
+            last_error_   = 0.f;
+            drift_        = 0;
+        }
+        else
+        {
+            float error = float(int32_t(tick - (phase_tick_ + Period())));
+            if(lock_count_ >= 2)
+            {
+                // whole periods late: pulses were lost
+                const float missed = error / period_;
+                const int   whole  = int(missed + 0.5f);
+                if(whole >= 1 && whole <= kMaxMissed
+                   && IsNear(error - whole * period_))
+                {
+                    pulses += whole;
+                    error -= whole * period_;
+                    phase_tick_ += uint32_t(whole * period_ + 0.5f);
+                }
+            }
+            if(lock_count_ >= 3 && !IsNear(error))
+            {
+                if(!has_outlier_)
+                {
+                    // follow the prediction for now
+                    has_outlier_ = true;
+                    phase_tick_ += Period();
+                }
+                else
+                {
+                    // the tempo jumped, lock in again from this interval
+                    has_outlier_ = false;
+                    lock_count_  = 2;
+                    period_      = float(interval);
+                    phase_tick_  = tick;
+                    drift_       = 0;
+                }
+            }
+            else
+            {
+                has_outlier_ = false;
+                if(lock_count_ >= kSettledCount)
+                    DetectDrift(error);
+                if(lock_count_ < kMaxLockCount)
+                    lock_count_++;
+                // the variance of the jitter, from the change of the error
+                // from pulse to pulse, which a slow tempo change doesn't
+                // affect
+                const float change = error - last_error_;
+                last_error_        = error;
+                // skip the first pulses, where the error is mostly that
+                // of the estimate
+                if(lock_count_ > kJitterStart || jitter_count_ > 0)
+                {
+                    if(jitter_count_ < kJitterWeight)
+                        jitter_count_++;
+                    jitter_ += (0.5f * change * change - jitter_)
+                               / jitter_count_;
+                }
+                // gains of a least-squares line fit through all pulses
+                const float n     = float(lock_count_);
+                float       alpha = 2.f * (2.f * n - 1.f) / (n * (n + 1.f));
+                float       beta  = 6.f / (n * (n + 1.f));
+                if(alpha < kMinAlpha)
+                    alpha = kMinAlpha;
+                if(beta < kMinBeta)
+                    beta = kMinBeta;
+                phase_tick_ += Period() + int32_t(alpha * error);
+                period_ += beta * error;
+            }
+        }
+
+        if(transport_ != Transport::PLAYING)
+            return;
+        if(!has_position_)
+        {
+            // the first pulse after Start or Continue
+            last_pulse_   = next_pulse_;
+            has_position_ = true;
+        }
+        else
+        {
+            last_pulse_ += pulses;
+        }
+        next_pulse_ = last_pulse_ + 1;
+    }
+
+    /** Starts playing from the beginning of the song with the next pulse */
+    void Start()
+    {
+        transport_     = Transport::PLAYING;
+        has_position_  = false;
+        next_pulse_    = 0;
+        next_division_ = 0;
+    }
+
+    /** Continues playing from the song position with the next pulse */
+    void Continue()
+    {
+        transport_    = Transport::PLAYING;
+        has_position_ = false;
+        // the first division at or after the position
+        next_division_
+            = (next_pulse_ * divisions_per_beat_ + kPulsesPerBeat - 1)
+              / kPulsesPerBeat;
+    }
+
+    /** Stops playing. The divisions up to `tick` are still returned. */
+    void Stop(uint32_t tick)
+    {
+        if(transport_ != Transport::PLAYING)
+            return;
+        transport_   = Transport::STOPPED;
+        stop_pulses_ = 0.f;
+        if(has_position_ && period_ > 0.f)
+        {
+            stop_pulses_ = float(int32_t(tick - phase_tick_)) / period_;
+            if(stop_pulses_ > 1.f)
+                stop_pulses_ = 1.f;
+        }
+    }
+
+    /** Moves the position of the next Continue, in sixteenth notes. Has
+     *  no effect while playing. */
+    void SetSongPosition(uint16_t sixteenths)
+    {
+        if(transport_ == Transport::PLAYING)
+            return;
+        next_pulse_   = uint32_t(sixteenths) * (kPulsesPerBeat / 4);
+        has_position_ = false;
+    }
+
+    /** @return true once the loop has locked to the clock */
+    bool IsLocked() const { return lock_count_ >= 3; }
+
+    Transport GetTransport() const { return transport_; }
+
+    bool IsPlaying() const { return transport_ == Transport::PLAYING; }
+
+    /** @return the smoothed period of a pulse in ticks, 0 without a lock */
+    float GetPeriodTicks() const { return lock_count_ >= 2 ? period_ : 0.f; }
+
+    /** @return the tempo in quarter notes per minute, 0 without a lock */
+    float GetBpm() const
+    {
+        const float period = GetPeriodTicks();
+        return period > 0.f ? 60.f * tick_freq_ / (period * kPulsesPerBeat)
+                            : 0.f;
+    }
+
+    /** @return the song position in pulses: of the next pulse while
+     *          stopped, of the last one while playing */
+    uint32_t GetPulse() const
+    {
+        return has_position_ ? last_pulse_ : next_pulse_;
+    }
+
+    /** @return the position at a tick in beats, between the pulses, e.g.
+     *          for the phase of tempo synced LFOs */
+    float GetBeatPosition(uint32_t tick) const
+    {
+        if(!has_position_ || lock_count_ < 2)
+            return float(GetPulse()) / kPulsesPerBeat;
+        float pulses = float(int32_t(tick - phase_tick_)) / period_;
+        if(pulses > 1.f)
+            pulses = 1.f;
+        return (last_pulse_ + pulses) / kPulsesPerBeat;
+    }
+
+    uint8_t GetDivisionsPerBeat() const { return divisions_per_beat_; }
+
+    /** @return the number of events lost because the queue was full */
+    uint32_t GetNumDropped() const { return num_dropped_; }
+
+  private:
+    static constexpr float    kMinAlpha     = 0.1f;
+    static constexpr float    kMinBeta      = 0.00526f;
+    static constexpr uint32_t kMaxLockCount = 1000;
+    static constexpr int      kMaxMissed    = 3;
+    // jitter and tempo change detection
+    static constexpr uint32_t kJitterStart     = 8;
+    static constexpr uint32_t kJitterWeight    = 32;
+    static constexpr uint32_t kSettledCount    = 24;
+    static constexpr uint32_t kBoostCount      = 6;
+    static constexpr float    kDriftDeviations = 3.f;
+    static constexpr float    kMinDrift        = 0.001f;
+    static constexpr int      kDriftCount      = 3;
+
+    enum class SyncType : uint8_t
+    {
+        CLOCK,
+        START,
+        CONTINUE,
+        STOP,
+        SONG_POSITION,
+    };
+
+    struct SyncEvent
+    {
+        uint32_t tick;
+        uint16_t song_position;
+        SyncType type;
+    };
+
+    void ApplyEvent(const SyncEvent& event)
+    {
+        switch(event.type)
+        {
+            case SyncType::CLOCK: Clock(event.tick); break;
+            case SyncType::START: Start(); break;
+            case SyncType::CONTINUE: Continue(); break;
+            case SyncType::STOP: Stop(event.tick); break;
+            case SyncType::SONG_POSITION:
+                SetSongPosition(event.song_position);
+                break;
+        }
+    }
+
+    uint32_t Period() const { return uint32_t(period_ + 0.5f); }
+
+    /** Tells a tempo change from jitter: errors well beyond the jitter,
+     *  several times in a row in the same direction, raise the gains as
+     *  if the loop had just locked in, so it follows within a beat */
+    void DetectDrift(float error)
+    {
+        float limit = kDriftDeviations * kDriftDeviations * jitter_;
+        const float floor = period_ * kMinDrift;
+        if(limit < floor * floor)
+            limit = floor * floor;
+        if(error * error <= limit)
+        {
+            drift_ = 0;
+            return;
+        }
+        if(error > 0.f)
+            drift_ = drift_ > 0 ? drift_ + 1 : 1;
+        else
+            drift_ = drift_ < 0 ? drift_ - 1 : -1;
+        if(drift_ >= kDriftCount || drift_ <= -kDriftCount)
+        {
+            lock_count_ = kBoostCount;
+            drift_      = 0;
+        }
+    }
+
+    bool IsNear(float error) const
+    {
+        return error <= period_ * tolerance_ && error >= -period_ * tolerance_;
+    }
+
+    LockFreeFIFO<SyncEvent, capacity> events_;
+    SyncEvent                         pending_;
+    bool                              has_pending_ = false;
+    uint32_t                          num_dropped_ = 0;
+
+    uint32_t tick_freq_;
+    uint32_t timeout_ticks_;
+    float    tolerance_;
+    uint8_t  divisions_per_beat_;
+
+    Transport transport_;
+    bool      has_position_;
+    uint32_t  last_pulse_;
+    uint32_t  next_pulse_;
+    uint32_t  next_division_;
+    float     stop_pulses_;
+
+    uint32_t lock_count_;
+    float    period_;
+    uint32_t phase_tick_;
+    uint32_t last_tick_;
+    bool     has_outlier_;
+    float    jitter_;
+    uint32_t jitter_count_;
+    float    last_error_;
+    int      drift_;
+};
+
+/** @brief Spaces the pulses of a MIDI clock output in timer ticks
+ *  @ingroup midi
+ *
+ *  Call NextInterval() from the timer interrupt for the length of the
+ *  next timer period. The fractions of a timer tick are carried over from
+ *  pulse to pulse, so each pulse is within a tick of its ideal time and
+ *  the tempo doesn't drift.
+ */
+class MidiClockGenerator
+{
+  public:
+    static constexpr uint32_t kPulsesPerBeat = 24;
+
+    MidiClockGenerator() {}
+    ~MidiClockGenerator() {}
+
+    /** @param timer_freq   Frequency of the timer ticks
+     *  @param bpm          Initial tempo in quarter notes per minute
+     */
+    void Init(uint32_t timer_freq, float bpm = 120.f)
+    {
+        timer_freq_ = timer_freq;
+        fraction_   = 0.f;
+        SetBpm(bpm);
+    }
+
+    /** Sets the tempo in quarter notes per minute, 1 to 1000 */
+    void SetBpm(float bpm)
+    {
+        if(bpm < 1.f)
+            bpm = 1.f;
+        if(bpm > 1000.f)
+            bpm = 1000.f;
+        interval_ = 60.f * timer_freq_ / (bpm * kPulsesPerBeat);
+    }
+
+    /** Sets the period of a pulse, e.g. from a MidiClockFollower
+     *  @param period       Length of a pulse in ticks of `tick_freq`
+     *  @param tick_freq    Frequency of the ticks of `period`
+     */
+    void SetPeriod(float period, uint32_t tick_freq)
+    {
+        interval_ = period * (float(timer_freq_) / tick_freq);
+    }
+
+    float GetBpm() const
+    {
+        return 60.f * timer_freq_ / (interval_ * kPulsesPerBeat);
+    }
+
+    /** @return the number of timer ticks until the next pulse */
+    uint32_t NextInterval()
+    {
+        const float interval = interval_;
+        uint32_t    whole    = uint32_t(interval);
+        fraction_ += interval - whole;
+        if(fraction_ >= 1.f)
+        {
+            whole++;
+            fraction_ -= 1.f;
+        }
+        return whole;
+    }
+
+  private:
+    uint32_t       timer_freq_;
+    volatile float interval_;
+    float          fraction_;
+};
+
+} // namespace daisy
@@ -0,0 +1,581 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+namespace daisy
+{
+/** @brief A block cache with read-ahead and write-back for block devices
+ *  @ingroup utility
+ *
+ *  Sits between a file system and a block device (e.g. an SD card) and
+ *  reduces the number of transactions on the device:
+ *  - Small reads load a whole cache line of `sectorsPerLine` consecutive
+ *    sectors with a single multi-block read, so that sequential streams
+ *    are served from the cache (read-ahead).
+ *  - Lines are replaced in least-recently-used order. Lines that were loaded
+ *    by a sequential stream are replaced first, so that streaming audio
+ *    doesn't evict frequently used FAT and directory sectors.
+ *  - Small writes are collected in the cache and written back later, with
+ *    consecutive sectors coalesced into multi-block writes.
+ *  - Reads and writes of at least one full line bypass the cache and go to
+ *    the device in a single transaction.
+ *  - Optionally, sequential streams read the next line ahead in the
+ *    background (see SetReadAhead()), if the device can start a read and
+ *    poll it later. A stream then finds its next sectors in the cache, or
+ *    at least waits only for the rest of a read that's already under way.
+ *
+ *  Written data stays in the cache until Flush() is called, a line is
+ *  evicted or a large write covers it. File systems should call Flush()
+ *  when they sync (e.g. FatFs' CTRL_SYNC).
+ *
+ *  @tparam numLines    Number of cache lines
+ */
+template <size_t numLines>
+class SectorCache
+{
+  public:
+    /** State of a read that runs in the background */
+    enum class ReadState
+    {
+        BUSY,
+        DONE,
+        FAILED,
+    };
+
+    /** The device that's accessed through the cache */
+    class BlockDevice
+    {
+      public:
+        virtual ~BlockDevice() {}
+        /** Reads `count` consecutive sectors. Returns false on error. */
+        virtual bool Read(uint8_t* dest, uint32_t sector, uint32_t count) = 0;
+        /** Writes `count` consecutive sectors. Returns false on error. */
+        virtual bool
+        Write(const uint8_t* src, uint32_t sector, uint32_t count) = 0;
+        /** Starts reading `count` consecutive sectors in the background.
+         *  Returns false if the read couldn't be started. Only required
+         *  for the read-ahead. */
+        virtual bool StartRead(uint8_t* /* dest */,
+                               uint32_t /* sector */,
+                               uint32_t /* count */)
+        {
+            return false;
+        }
+        /** Advances the read started with StartRead() */
+        virtual ReadState PollRead() { return ReadState::FAILED; }
+        /** Returns false if the device can't transfer to or from `buffer`
+         *  directly, e.g. because its DMA requires aligned buffers. Large
+         *  transfers then go through the cache lines. */
+        virtual bool CanTransfer(const uint8_t* /* buffer */) const
+        {
+            return true;
+        }
+    };
+
+    /** Returns the current time in ticks, for the throughput statistics */
+    typedef uint32_t (*GetTickFunction)();
+
+    /** Counters for the cache efficiency */
+    struct Stats
+    {
+        uint32_t hits;           /**< Sectors read from the cache */
+        uint32_t misses;         /**< Sectors that required a line load */
+        uint32_t deviceReads;    /**< Read transactions on the device */
+        uint32_t deviceWrites;   /**< Write transactions on the device */
+        uint32_t sectorsRead;    /**< Sectors read from the device */
+        uint32_t sectorsWritten; /**< Sectors written to the device */
+        uint32_t readAheads;     /**< Lines read ahead in the background */
+        uint32_t readTicks;      /**< Time spent reading from the device */
+        uint32_t writeTicks;     /**< Time spent writing to the device */
+    };
+
+    /** The maximum number of sectors per cache line */
+    static constexpr size_t kMaxSectorsPerLine = 32;
+
+    SectorCache() {}
+
+    /** Initializes the cache.
+     *  @param device           The block device to cache
+     *  @param memory           Storage for the cache lines, at least
+     *                          numLines * sectorsPerLine * sectorSize bytes.
+     *                          Place it in non-cached memory if the device
+     *                          uses DMA.
+     *  @param sectorsPerLine   Sectors per line, which is also the read-ahead
+     *                          size. Must be between 1 and kMaxSectorsPerLine.
+     *  @param sectorSize       Size of a sector in bytes
+     */
+    void Init(BlockDevice& device,
+              uint8_t*     memory,
+              size_t       sectorsPerLine,
+              size_t       sectorSize = 512)
+    {
+        device_         = &device;
+        memory_         = memory;
+        sectorsPerLine_ = sectorsPerLine < 1 ? 1 : sectorsPerLine;
+        if(sectorsPerLine_ > kMaxSectorsPerLine)
+            sectorsPerLine_ = kMaxSectorsPerLine;
+        sectorSize_ = sectorSize;
+        pending_    = nullptr;
+        readAhead_  = false;
+        Invalidate();
+        ResetStats();
+    }
+
+    /** Enables reading ahead in the background. The device must implement
+     *  StartRead() and PollRead(), and Poll() should be called regularly
+     *  so the reads complete while the application does other work.
+     */
+    void SetReadAhead(bool enable)
+    {
+        WaitForReadAhead();
+        readAhead_ = enable;
+    }
+
+    /** Sets the clock for the throughput statistics
+     *  @param getTick  Returns the current time, nullptr to not measure
+     *  @param tickFreq Frequency of the ticks in Hz
+     */
+    void SetClock(GetTickFunction getTick, uint32_t tickFreq)
+    {
+        getTick_  = getTick;
+        tickFreq_ = tickFreq;
+    }
+
+    /** Advances a read-ahead in the background.
+     *  Returns true while it's still in progress. */
+    bool Poll()
+    {
+        if(pending_ == nullptr)
+            return false;
+        const ReadState state = device_->PollRead();
+        if(state == ReadState::BUSY)
+            return true;
+        if(state == ReadState::DONE)
+            pending_->validMask = AllValid();
+        else
+            pending_->used = false; // the stream will read it again
+        stats_.readTicks += GetTick() - pendingStart_;
+        pending_ = nullptr;
+        return false;
+    }
+
+    /** Reads `count` sectors starting at `sector` into `dest`.
+     *  Returns false if the device reported an error. */
+    bool Read(uint8_t* dest, uint32_t sector, uint32_t count)
+    {
+        WaitForReadAhead();
+        const bool sequential = IsSequential(sector);
+        UpdateStreams(sector, count);
+        if(!ReadSectors(dest, sector, count, sequential))
+            return false;
+        if(sequential && readAhead_)
+            StartReadAhead(sector + count);
+        return true;
+    }
+
+    /** Writes `count` sectors from `src` starting at `sector`.
+     *  Small writes are stored in the cache until they're flushed.
+     *  Returns false if the device reported an error. */
+    bool Write(const uint8_t* src, uint32_t sector, uint32_t count)
+    {
+        WaitForReadAhead();
+        if(count >= sectorsPerLine_ && device_->CanTransfer(src))
+        {
+            // large transfer: write through and update cached copies
+            if(!DeviceWrite(src, sector, count))
+                return false;
+            for(size_t i = 0; i < numLines; i++)
+            {
+                Line& line = lines_[i];
+                if(!line.used)
+                    continue;
+                for(size_t bit = 0; bit < sectorsPerLine_; bit++)
+                {
+                    const uint32_t s = line.firstSector + bit;
+                    if(s < sector || s >= sector + count)
+                        continue;
+                    memcpy(SectorData(line, bit),
+                           src + (s - sector) * sectorSize_,
+                           sectorSize_);
+                    line.validMask |= (1u << bit);
+                    line.dirtyMask &= ~(1u << bit);
+                }
+            }
+            return true;
+        }
+
+        for(uint32_t s = sector; s < sector + count; s++)
+        {
+            const size_t bit  = s % sectorsPerLine_;
+            Line*        line = FindLine(s);
+            if(line == nullptr)
+                line = AllocateLine(LineStart(s));
+            if(line == nullptr)
+                return false;
+            memcpy(SectorData(*line, bit), src, sectorSize_);
+            line->validMask |= (1u << bit);
+            line->dirtyMask |= (1u << bit);
+            Touch(*line);
+            src += sectorSize_;
+        }
+        return true;
+    }
+
+    /** Writes all modified sectors to the device. Returns false if the
+     *  device reported an error. */
+    bool Flush()
+    {
+        WaitForReadAhead();
+        bool ok = true;
+        for(size_t i = 0; i < numLines; i++)
+            ok = FlushLine(lines_[i]) && ok;
+        return ok;
+    }
+
+    /** Discards all cached data, including unflushed writes. Use this when
+     *  the medium was changed. */
+    void Invalidate()
+    {
+        WaitForReadAhead();
+        for(size_t i = 0; i < numLines; i++)
+        {
+            lines_[i].used      = false;
+            lines_[i].validMask = 0;
+            lines_[i].dirtyMask = 0;
+            lines_[i].streaming = false;
+            lines_[i].lastUse   = 0;
+        }
+        for(size_t i = 0; i < kNumStreams; i++)
+            streams_[i] = kNoSector;
+        nextStream_ = 0;
+        useCounter_ = 0;
+    }
+
+    /** Returns the number of sectors that were written to the cache but
+     *  not to the device yet */
+    size_t GetNumDirtySectors() const
+    {
+        size_t num = 0;
+        for(size_t i = 0; i < numLines; i++)
+            for(size_t bit = 0; bit < sectorsPerLine_; bit++)
+                if(lines_[i].dirtyMask & (1u << bit))
+                    num++;
+        return num;
+    }
+
+    /** Returns true if `sector` is currently held in the cache */
+    bool IsCached(uint32_t sector) const
+    {
+        for(size_t i = 0; i < numLines; i++)
+        {
+            const Line& line = lines_[i];
+            if(line.used && line.firstSector == LineStart(sector)
+               && (line.validMask & (1u << (sector % sectorsPerLine_))))
+                return true;
+        }
+        return false;
+    }
+
+    /** Returns the cache statistics */
+    const Stats& GetStats() const { return stats_; }
+
+    /** Resets the cache statistics */
+    void ResetStats() { stats_ = Stats{0, 0, 0, 0, 0, 0, 0, 0, 0}; }
+
+    /** Returns the read throughput of the device in bytes per second, or 0
+     *  if it wasn't measured. Time a read-ahead waits for Poll() counts. */
+    float GetReadThroughput() const
+    {
+        return Throughput(stats_.sectorsRead, stats_.readTicks);
+    }
+
+    /** Returns the write throughput of the device in bytes per second */
+    float GetWriteThroughput() const
+    {
+        return Throughput(stats_.sectorsWritten, stats_.writeTicks);
+    }
+
+  private:
+    SectorCache(const SectorCache& other) = delete;
+    SectorCache& operator=(const SectorCache& other) = delete;
+
+    static constexpr size_t   kNumStreams = 4;
+    static constexpr uint32_t kNoSector   = 0xffffffff;
+
+    struct Line
+    {
+        uint32_t firstSector;
+        uint32_t validMask;
+        uint32_t dirtyMask;
+        uint32_t lastUse;
+        bool     used;
+        bool     streaming;
+    };
+
+    uint32_t LineStart(uint32_t sector) const
+    {
+        return sector - (sector % sectorsPerLine_);
+    }
+
+    uint32_t AllValid() const
+    {
+        return sectorsPerLine_ >= 32 ? 0xffffffff
+                                     : ((1u << sectorsPerLine_) - 1);
+    }
+
+    uint8_t* SectorData(const Line& line, size_t bit) const
+    {
+        const size_t lineIdx = &line - lines_;
+        return memory_ + (lineIdx * sectorsPerLine_ + bit) * sectorSize_;
+    }
+
+    Line* FindLine(uint32_t sector)
+    {
+        const uint32_t start = LineStart(sector);
+        for(size_t i = 0; i < numLines; i++)
+            if(lines_[i].used && lines_[i].firstSector == start)
+                return &lines_[i];
+        return nullptr;
+    }
+
+    void Touch(Line& line) { line.lastUse = ++useCounter_; }
+
+    bool ReadSectors(uint8_t* dest,
+                     uint32_t sector,
+                     uint32_t count,
+                     bool     sequential)
+    {
+        if(count >= sectorsPerLine_ && device_->CanTransfer(dest))
+        {
+            // large transfer: take what was read ahead from the cache
+            while(count > 0 && IsCached(sector))
+            {
+                Line* line = FindLine(sector);
+                Touch(*line);
+                memcpy(dest,
+                       SectorData(*line, sector % sectorsPerLine_),
+                       sectorSize_);
+                stats_.hits++;
+                dest += sectorSize_;
+                sector++;
+                count--;
+            }
+            if(count == 0)
+                return true;
+            // make sure the device has the latest data, then read
+            // directly into the destination
+            if(!FlushRange(sector, count))
+                return false;
+            return DeviceRead(dest, sector, count);
+        }
+
+        for(uint32_t s = sector; s < sector + count; s++)
+        {
+            const size_t bit  = s % sectorsPerLine_;
+            Line*        line = FindLine(s);
+            if(line != nullptr && (line->validMask & (1u << bit)))
+            {
+                stats_.hits++;
+            }
+            else
+            {
+                stats_.misses++;
+                if(line == nullptr)
+                    line = AllocateLine(LineStart(s));
+                if(line == nullptr || !LoadLine(*line))
+                    return false;
+                line->streaming = sequential;
+            }
+            Touch(*line);
+            memcpy(dest, SectorData(*line, bit), sectorSize_);
+            dest += sectorSize_;
+        }
+        return true;
+    }
+
+    /** Reads the line after the end of a stream in the background */
+    void StartReadAhead(uint32_t next)
+    {
+        uint32_t start = LineStart(next);
+        if(FindLine(start) != nullptr)
+            start += sectorsPerLine_;
+        if(FindLine(start) != nullptr)
+            return;
+        Line* line = AllocateLine(start);
+        if(line == nullptr)
+            return;
+        pendingStart_ = GetTick();
+        if(!device_->StartRead(SectorData(*line, 0), start, sectorsPerLine_))
+        {
+            line->used = false;
+            return;
+        }
+        stats_.deviceReads++;
+        stats_.sectorsRead += sectorsPerLine_;
+        stats_.readAheads++;
+        line->streaming = true;
+        Touch(*line);
+        pending_ = line;
+    }
+
+    void WaitForReadAhead()
+    {
+        while(Poll()) {}
+    }
+
+    uint32_t GetTick() const { return getTick_ != nullptr ? getTick_() : 0; }
+
+    float Throughput(uint32_t sectors, uint32_t ticks) const
+    {
+        if(ticks == 0)
+            return 0.f;
+        return float(sectors) * sectorSize_ * (float(tickFreq_) / ticks);
+    }
+
+    /** A read is sequential if it continues one of the recent reads */
+    bool IsSequential(uint32_t sector) const
+    {
+        for(size_t i = 0; i < kNumStreams; i++)
+            if(streams_[i] == sector)
+                return true;
+        return false;
+    }
+
+    void UpdateStreams(uint32_t sector, uint32_t count)
+    {
+        for(size_t i = 0; i < kNumStreams; i++)
+        {
+            if(streams_[i] == sector)
+            {
+                streams_[i] = sector + count;
+                return;
+            }
+        }
+        streams_[nextStream_] = sector + count;
+        nextStream_           = (nextStream_ + 1) % kNumStreams;
+    }
+
+    /** Finds a free line or evicts one - streaming lines first */
+    Line* AllocateLine(uint32_t firstSector)
+    {
+        Line* victim = nullptr;
+        for(size_t i = 0; i < numLines; i++)
+        {
+            Line& line = lines_[i];
+            if(!line.used)
+            {
+                victim = &line;
+                break;
+            }
+            if(victim == nullptr || (line.streaming && !victim->streaming)
+               || (line.streaming == victim->streaming
+                   && line.lastUse < victim->lastUse))
+                victim = &line;
+        }
+        if(victim == nullptr || !FlushLine(*victim))
+            return nullptr;
+        victim->used        = true;
+        victim->firstSector = firstSector;
+        victim->validMask   = 0;
+        victim->dirtyMask   = 0;
+        victim->streaming   = false;
+        return victim;
+    }
+
+    bool LoadLine(Line& line)
+    {
+        // don't overwrite modified sectors with older data from the device
+        if(!FlushLine(line))
+            return false;
+        if(!DeviceRead(SectorData(line, 0), line.firstSector, sectorsPerLine_))
+        {
+            line.used      = false;
+            line.validMask = 0;
+            return false;
+        }
+        line.validMask = AllValid();
+        return true;
+    }
+
+    /** Writes runs of consecutive dirty sectors with one transaction each */
+    bool FlushLine(Line& line)
+    {
+        if(!line.used)
+            return true;
+        size_t bit = 0;
+        while(line.dirtyMask != 0 && bit < sectorsPerLine_)
+        {
+            if(!(line.dirtyMask & (1u << bit)))
+            {
+                bit++;
+                continue;
+            }
+            size_t end = bit;
+            while(end < sectorsPerLine_ && (line.dirtyMask & (1u << end)))
+                end++;
+            if(!DeviceWrite(
+                   SectorData(line, bit), line.firstSector + bit, end - bit))
+                return false;
+            for(size_t i = bit; i < end; i++)
+                line.dirtyMask &= ~(1u << i);
+            bit = end;
+        }
+        return true;
+    }
+
+    /** Flushes all lines that overlap the sector range */
+    bool FlushRange(uint32_t sector, uint32_t count)
+    {
+        for(size_t i = 0; i < numLines; i++)
+        {
+            Line& line = lines_[i];
+            if(!line.used || line.dirtyMask == 0)
+                continue;
+            if(line.firstSector + sectorsPerLine_ <= sector
+               || line.firstSector >= sector + count)
+                continue;
+            if(!FlushLine(line))
+                return false;
+        }
+        return true;
+    }
+
+    bool DeviceRead(uint8_t* dest, uint32_t sector, uint32_t count)
+    {
+        stats_.deviceReads++;
+        stats_.sectorsRead += count;
+        const uint32_t start = GetTick();
+        const bool     ok    = device_->Read(dest, sector, count);
+        stats_.readTicks += GetTick() - start;
+        return ok;
+    }
+
+    bool DeviceWrite(const uint8_t* src, uint32_t sector, uint32_t count)
+    {
+        stats_.deviceWrites++;
+        stats_.sectorsWritten += count;
+        const uint32_t start = GetTick();
+        const bool     ok    = device_->Write(src, sector, count);
+        stats_.writeTicks += GetTick() - start;
+        return ok;
+    }
+
+    BlockDevice*    device_         = nullptr;
+    uint8_t*        memory_         = nullptr;
+    size_t          sectorsPerLine_ = 1;
+    size_t          sectorSize_     = 512;
+    Line            lines_[numLines];
+    uint32_t        streams_[kNumStreams];
+    size_t          nextStream_ = 0;
+    uint32_t        useCounter_ = 0;
+    Stats           stats_;
+    Line*           pending_      = nullptr;
+    uint32_t        pendingStart_ = 0;
+    bool            readAhead_    = false;
+    GetTickFunction getTick_      = nullptr;
+    uint32_t        tickFreq_     = 0;
+};
+
+} // namespace daisy
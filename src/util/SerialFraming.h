@@ -0,0 +1,427 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+namespace daisy
+{
+/** @brief Endpoints of a SerialLink and the layout of their payloads
+ *  @ingroup utility
+ *
+ *  All numbers are little endian, floats are IEEE 754 singles.
+ */
+enum class SerialEndpoint : uint8_t
+{
+    /** Any bytes, answered with a PONG with the same bytes */
+    PING = 0,
+    /** The answer to PING */
+    PONG = 1,
+    /** u16 parameter id */
+    PARAM_GET = 2,
+    /** u16 parameter id, f32 value */
+    PARAM_SET = 3,
+    /** u16 parameter id, f32 value, u8 status (0 = OK, 1 = unknown id).
+     *  The answer to PARAM_GET and PARAM_SET */
+    PARAM_VALUE = 4,
+    /** f32 values */
+    METER = 5,
+    /** u8 channel, u32 index of the first sample, s16 samples */
+    SCOPE = 6,
+    /** u32 offset, u32 total size, data */
+    BULK = 7,
+    /** Endpoints from here on are free for the application */
+    USER = 16,
+};
+
+/** @brief A decoded frame, see SerialFrameDecoder
+ *  @ingroup utility
+ */
+struct SerialFrame
+{
+    uint8_t        endpoint; /**< Endpoint, see SerialEndpoint */
+    uint8_t        sequence; /**< Sequence number, counts per endpoint */
+    const uint8_t* payload;  /**< The payload, nullptr if empty */
+    size_t         size;     /**< Size of the payload */
+};
+
+/** @brief Encodes frames for a serial link
+ *  @ingroup utility
+ *
+ *  A frame is the endpoint, a sequence number, the payload and a
+ *  CRC-16/CCITT of all of them. It's COBS encoded, so that it contains no
+ *  zeros, and terminated with a zero. A receiver can resynchronize at any
+ *  zero after lost or corrupted bytes, and the overhead is at most one
+ *  byte per 254 bytes of payload plus five bytes per frame.
+ *
+ *  This only depends on the standard library, so host tools can use the
+ *  same code as the firmware.
+ */
+class SerialFrameEncoder
+{
+  public:
+    /** @return the largest encoded size of a frame with the given payload
+     *          size, including the delimiter */
+    static constexpr size_t GetMaxEncodedSize(size_t payload_size)
+    {
+        return payload_size + 4 + (payload_size + 4) / 254 + 2;
+    }
+
+    /** Encodes a frame
+     *  @param endpoint The endpoint
+     *  @param sequence The sequence number
+     *  @param payload  The payload, may be nullptr if size is 0
+     *  @param size     Size of the payload
+     *  @param dest     Receives the frame, must have room for
+     *                  GetMaxEncodedSize(size) bytes
+     *  @return the size of the encoded frame
+     */
+    static size_t Encode(uint8_t        endpoint,
+                         uint8_t        sequence,
+                         const uint8_t* payload,
+                         size_t         size,
+                         uint8_t*       dest)
+    {
+        CobsWriter writer(dest);
+        uint16_t   crc = UpdateCrc(kCrcInit, endpoint);
+        crc            = UpdateCrc(crc, sequence);
+        writer.Put(endpoint);
+        writer.Put(sequence);
+        for(size_t i = 0; i < size; i++)
+        {
+            crc = UpdateCrc(crc, payload[i]);
+            writer.Put(payload[i]);
+        }
+        writer.Put(crc & 0xff);
+        writer.Put(crc >> 8);
+        return writer.Finish();
+    }
+
+    /** Computes the CRC-16/CCITT (polynomial 0x1021, initial value
+     *  0xffff) of some bytes, as used by the frames */
+    static uint16_t
+    ComputeCrc(const uint8_t* data, size_t size, uint16_t crc = kCrcInit)
+    {
+        for(size_t i = 0; i < size; i++)
+            crc = UpdateCrc(crc, data[i]);
+        return crc;
+    }
+
+    /** Adds one byte to a CRC-16/CCITT */
+    static uint16_t UpdateCrc(uint16_t crc, uint8_t byte)
+    {
+        // bytewise form of the polynomial, no table needed
+        uint8_t x = (crc >> 8) ^ byte;
+        x ^= x >> 4;
+        return (crc << 8) ^ (uint16_t(x) << 12) ^ (uint16_t(x) << 5) ^ x;
+    }
+
+    static constexpr uint16_t kCrcInit = 0xffff;
+
+  private:
+    /** Writes COBS encoded bytes one at a time */
+    class CobsWriter
+    {
+      public:
+        explicit CobsWriter(uint8_t* dest)
+        : dest_(dest), code_pos_(0), pos_(1), code_(1)
+        {
+        }
+
+        void Put(uint8_t byte)
+        {
+            if(byte == 0)
+            {
+                EndBlock();
+                return;
+            }
+            dest_[pos_++] = byte;
+            if(++code_ == 0xff)
+                EndBlock();
+        }
+
+        size_t Finish()
+        {
+            dest_[code_pos_] = code_;
+            dest_[pos_++]    = 0;
+            return pos_;
+        }
+
+      private:
+        void EndBlock()
+        {
+            dest_[code_pos_] = code_;
+            code_pos_        = pos_++;
+            code_            = 1;
+        }
+
+        uint8_t* dest_;
+        size_t   code_pos_;
+        size_t   pos_;
+        uint8_t  code_;
+    };
+};
+
+/** @brief Decodes frames from a stream of bytes
+ *  @ingroup utility
+ *
+ *  Feed it the received bytes. Frames that are corrupted, too long or
+ *  truncated are dropped and counted, and a gap in the sequence numbers
+ *  of an endpoint counts the frames that were lost on the way.
+ *
+ *  @tparam max_payload The largest payload that's accepted
+ */
+template <size_t max_payload = 256>
+class SerialFrameDecoder
+{
+  public:
+    /** Endpoints from 0 to kNumEndpoints - 1 are valid */
+    static constexpr size_t kNumEndpoints = 32;
+
+    SerialFrameDecoder() { Reset(); }
+    ~SerialFrameDecoder() {}
+
+    /** Drops the current frame and clears the statistics */
+    void Reset()
+    {
+        size_          = 0;
+        discarding_    = false;
+        num_frames_    = 0;
+        num_errors_    = 0;
+        num_overflows_ = 0;
+        num_lost_      = 0;
+        for(size_t i = 0; i < kNumEndpoints; i++)
+            has_sequence_[i] = false;
+    }
+
+    /** Adds a received byte
+     *  @param byte     The byte
+     *  @param frame    Receives the frame when it's complete. The payload
+     *                  stays valid until the next call.
+     *  @return true if a frame was completed
+     */
+    bool Feed(uint8_t byte, SerialFrame& frame)
+    {
+        if(byte != 0)
+        {
+            if(discarding_)
+                return false;
+            if(size_ == sizeof(buffer_))
+            {
+                discarding_ = true;
+                num_overflows_++;
+                return false;
+            }
+            buffer_[size_++] = byte;
+            return false;
+        }
+
+        // a delimiter ends the frame
+        const size_t size = size_;
+        size_             = 0;
+        if(discarding_)
+        {
+            discarding_ = false;
+            return false;
+        }
+        if(size == 0)
+            return false;
+        return DecodeFrame(size, frame);
+    }
+
+    /** @return the number of valid frames */
+    uint32_t GetNumFrames() const { return num_frames_; }
+
+    /** @return the number of corrupted frames */
+    uint32_t GetNumErrors() const { return num_errors_; }
+
+    /** @return the number of frames that were too long */
+    uint32_t GetNumOverflows() const { return num_overflows_; }
+
+    /** @return the number of frames missing in the sequence numbers */
+    uint32_t GetNumLost() const { return num_lost_; }
+
+  private:
+    bool DecodeFrame(size_t size, SerialFrame& frame)
+    {
+        // decode in place, the output is never longer than the input
+        size_t in = 0, out = 0;
+        while(in < size)
+        {
+            const uint8_t code = buffer_[in++];
+            if(in + code - 1 > size)
+            {
+                num_errors_++;
+                return false;
+            }
+            for(uint8_t i = 1; i < code; i++)
+                buffer_[out++] = buffer_[in++];
+            if(code < 0xff && in < size)
+                buffer_[out++] = 0;
+        }
+
+        if(out < 4
+           || SerialFrameEncoder::ComputeCrc(buffer_, out - 2)
+                  != (buffer_[out - 2] | (buffer_[out - 1] << 8))
+           || buffer_[0] >= kNumEndpoints)
+        {
+            num_errors_++;
+            return false;
+        }
+
+        frame.endpoint = buffer_[0];
+        frame.sequence = buffer_[1];
+        frame.size     = out - 4;
+        frame.payload  = frame.size > 0 ? buffer_ + 2 : nullptr;
+
+        const uint8_t ep = frame.endpoint;
+        if(has_sequence_[ep])
+            num_lost_ += uint8_t(frame.sequence - next_sequence_[ep]);
+        has_sequence_[ep]  = true;
+        next_sequence_[ep] = frame.sequence + 1;
+        num_frames_++;
+        return true;
+    }
+
+    static constexpr size_t kBufferSize
+        = SerialFrameEncoder::GetMaxEncodedSize(max_payload) - 1;
+
+    uint8_t  buffer_[kBufferSize];
+    size_t   size_;
+    bool     discarding_;
+    uint8_t  next_sequence_[kNumEndpoints];
+    bool     has_sequence_[kNumEndpoints];
+    uint32_t num_frames_;
+    uint32_t num_errors_;
+    uint32_t num_overflows_;
+    uint32_t num_lost_;
+};
+
+/** @brief Writes little endian numbers into a payload
+ *  @ingroup utility
+ */
+class SerialPayloadWriter
+{
+  public:
+    SerialPayloadWriter(uint8_t* dest, size_t capacity)
+    : dest_(dest), capacity_(capacity), size_(0), overflow_(false)
+    {
+    }
+
+    void PutU8(uint8_t value) { PutBytes(&value, 1); }
+
+    void PutU16(uint16_t value)
+    {
+        const uint8_t bytes[2] = {uint8_t(value), uint8_t(value >> 8)};
+        PutBytes(bytes, 2);
+    }
+
+    void PutU32(uint32_t value)
+    {
+        const uint8_t bytes[4] = {uint8_t(value),
+                                  uint8_t(value >> 8),
+                                  uint8_t(value >> 16),
+                                  uint8_t(value >> 24)};
+        PutBytes(bytes, 4);
+    }
+
+    void PutFloat(float value)
+    {
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        PutU32(bits);
+    }
+
+    void PutBytes(const uint8_t* data, size_t size)
+    {
+        if(size > capacity_ - size_)
+        {
+            overflow_ = true;
+            return;
+        }
+        memcpy(dest_ + size_, data, size);
+        size_ += size;
+    }
+
+    /** @return the number of bytes written */
+    size_t GetSize() const { return size_; }
+
+    /** @return true if something didn't fit */
+    bool IsOverflow() const { return overflow_; }
+
+  private:
+    uint8_t* dest_;
+    size_t   capacity_;
+    size_t   size_;
+    bool     overflow_;
+};
+
+/** @brief Reads little endian numbers from a payload
+ *  @ingroup utility
+ *
+ *  Reading past the end returns zeros and sets an error flag.
+ */
+class SerialPayloadReader
+{
+  public:
+    SerialPayloadReader(const uint8_t* data, size_t size)
+    : data_(data), size_(size), pos_(0), error_(false)
+    {
+    }
+
+    uint8_t GetU8() { return Has(1) ? data_[pos_++] : 0; }
+
+    uint16_t GetU16()
+    {
+        if(!Has(2))
+            return 0;
+        const uint16_t value = data_[pos_] | (data_[pos_ + 1] << 8);
+        pos_ += 2;
+        return value;
+    }
+
+    uint32_t GetU32()
+    {
+        if(!Has(4))
+            return 0;
+        const uint32_t value
+            = uint32_t(data_[pos_]) | (uint32_t(data_[pos_ + 1]) << 8)
+              | (uint32_t(data_[pos_ + 2]) << 16)
+              | (uint32_t(data_[pos_ + 3]) << 24);
+        pos_ += 4;
+        return value;
+    }
+
+    float GetFloat()
+    {
+        const uint32_t bits = GetU32();
+        float          value;
+        memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    /** @return the unread bytes */
+    const uint8_t* GetRemainingData() const { return data_ + pos_; }
+
+    /** @return the number of unread bytes */
+    size_t GetRemainingSize() const { return size_ - pos_; }
+
+    /** @return true if something was read past the end */
+    bool IsError() const { return error_; }
+
+  private:
+    bool Has(size_t size)
+    {
+        if(size <= size_ - pos_)
+            return true;
+        error_ = true;
+        return false;
+    }
+
+    const uint8_t* data_;
+    size_t         size_;
+    size_t         pos_;
+    bool           error_;
+};
+
+} // namespace daisy
@@ -206,8 +206,11 @@ class Stack : public StackBase<T>
 
     /** Creates a Stack and adds a list of values*/
     explicit Stack(std::initializer_list<T> valuesToAdd)
-    : StackBase<T>(buffer_, capacity, valuesToAdd)
+    : StackBase<T>(buffer_, capacity)
     {
+        // values must be added after buffer_ was constructed, otherwise
+        // types with default member initializers would be reset.
+        StackBase<T>::PushBack(valuesToAdd);
     }
 
     /** Creates a Stack and copies all values from another Stack */
@@ -0,0 +1,444 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+namespace daisy
+{
+/** @brief Measures the audio sample rate against the USB frames
+ *  @ingroup utility
+ *
+ *  Call OnSof() at every USB start of frame with the position of the
+ *  audio clock at that moment, in 1/256 samples. The rate is the
+ *  advance of that position over the last kWindow frames, so the
+ *  quantization of the position only shows up divided by the window.
+ *
+ *  The result, in samples per USB frame, drives the asynchronous feedback
+ *  of the OUT stream and the packet sizes of the IN stream, see
+ *  UsbAudioFeedback and UsbAudioPacer.
+ */
+class UsbAudioRateMeter
+{
+  public:
+    /** Number of frames the rate is averaged over */
+    static constexpr size_t kWindow = 128;
+
+    UsbAudioRateMeter() {}
+    ~UsbAudioRateMeter() {}
+
+    /** Initializes the meter
+     *  @param nominal_rate The expected rate in samples per USB frame,
+     *                      e.g. 48 for 48 kHz at full speed. It's
+     *                      reported until the first frames are measured.
+     */
+    void Init(float nominal_rate)
+    {
+        nominal_rate_ = nominal_rate;
+        Reset();
+    }
+
+    /** Starts over, e.g. after the audio or the USB stream restarted */
+    void Reset()
+    {
+        num_sofs_ = 0;
+        rate_     = nominal_rate_;
+    }
+
+    /** Adds a start of frame
+     *  @param position The position of the audio clock in 1/256 samples.
+     *                  It may wrap around.
+     */
+    void OnSof(uint32_t position)
+    {
+        const size_t index = num_sofs_ % kWindow;
+        if(num_sofs_ >= 8)
+        {
+            // until the window is full, measure over what's there
+            const size_t span  = num_sofs_ < kWindow ? num_sofs_ : kWindow;
+            const size_t first = num_sofs_ < kWindow ? 0 : index;
+            rate_ = float(position - positions_[first]) / (256.f * span);
+        }
+        positions_[index] = position;
+        num_sofs_++;
+    }
+
+    /** @return the measured rate in samples per USB frame */
+    float GetRate() const { return rate_; }
+
+    /** @return true once the rate was measured over a full window */
+    bool IsSettled() const { return num_sofs_ > kWindow; }
+
+  private:
+    float    nominal_rate_;
+    float    rate_;
+    size_t   num_sofs_;
+    uint32_t positions_[kWindow];
+};
+
+/** @brief Settings of the fill control of UsbAudioFeedback and
+ *         UsbAudioPacer
+ *  @ingroup utility
+ */
+struct UsbAudioLoopConfig
+{
+    /** Samples per USB frame at the nominal sample rate */
+    float nominal_rate;
+    /** Fill of the FIFO that's steered to, in frames of samples */
+    float target_fill;
+    /** Rate correction in samples per USB frame, per frame of fill error.
+     *  The time constant of the loop is 1 / gain USB frames. */
+    float gain = 0.0005f;
+    /** Coefficient of the one pole filter over the fill. The FIFO is
+     *  filled and emptied in whole packets and audio blocks, this
+     *  averages out the sawtooth. */
+    float smoothing = 0.02f;
+    /** Largest deviation from the nominal rate, in samples per frame */
+    float max_deviation = 1.f;
+
+    /** @return the rate limited to the allowed deviation */
+    float Limit(float rate) const
+    {
+        const float lo = nominal_rate - max_deviation;
+        const float hi = nominal_rate + max_deviation;
+        return rate < lo ? lo : (rate > hi ? hi : rate);
+    }
+};
+
+/** @brief Asynchronous feedback for a USB audio OUT stream
+ *  @ingroup utility
+ *
+ *  The host sends as many samples per frame as the feedback asks for.
+ *  That's the measured rate of the audio clock, plus a correction that
+ *  pulls the fill of the FIFO between the USB packets and the audio
+ *  callback to its target. The measured rate alone keeps the fill
+ *  constant, the correction removes offsets from the start and from
+ *  measurement errors.
+ */
+class UsbAudioFeedback
+{
+  public:
+    UsbAudioFeedback() {}
+    ~UsbAudioFeedback() {}
+
+    void Init(const UsbAudioLoopConfig& config)
+    {
+        config_ = config;
+        Reset();
+    }
+
+    /** Starts over with the nominal rate and the target fill */
+    void Reset()
+    {
+        fill_     = config_.target_fill;
+        feedback_ = config_.nominal_rate;
+    }
+
+    /** Updates the feedback, call at every USB frame
+     *  @param rate The measured rate, see UsbAudioRateMeter
+     *  @param fill The fill of the OUT FIFO in frames
+     *  @return the feedback in samples per USB frame
+     */
+    float Update(float rate, size_t fill)
+    {
+        fill_ += config_.smoothing * (float(fill) - fill_);
+        // too full means the host sends too fast
+        const float error = config_.target_fill - fill_;
+        feedback_         = config_.Limit(rate + config_.gain * error);
+        return feedback_;
+    }
+
+    /** @return the last feedback in samples per USB frame */
+    float GetFeedback() const { return feedback_; }
+
+    /** @return the smoothed fill in frames */
+    float GetFill() const { return fill_; }
+
+    /** @return a rate in the 10.14 format of full speed feedback
+     *          endpoints, samples per 1 ms frame */
+    static uint32_t ToFullSpeed(float samples_per_frame)
+    {
+        return uint32_t(samples_per_frame * 16384.f + 0.5f) & 0xffffff;
+    }
+
+    /** @return a rate in the 16.16 format of high speed feedback
+     *          endpoints, samples per 125 us microframe */
+    static uint32_t ToHighSpeed(float samples_per_frame)
+    {
+        return uint32_t(samples_per_frame * (65536.f / 8.f) + 0.5f);
+    }
+
+    /** @return a full speed feedback value as samples per frame */
+    static float FromFullSpeed(uint32_t value) { return value / 16384.f; }
+
+  private:
+    UsbAudioLoopConfig config_;
+    float              fill_;
+    float              feedback_;
+};
+
+/** @brief Sizes the packets of an asynchronous USB audio IN stream
+ *  @ingroup utility
+ *
+ *  The device decides how many samples go into each packet. On average
+ *  that's the measured rate of the audio clock, and a correction keeps
+ *  the FIFO between the audio callback and the USB packets at its target
+ *  fill, mirroring UsbAudioFeedback. Packet sizes follow the rate with a
+ *  phase accumulator, so they only ever differ by one sample.
+ */
+class UsbAudioPacer
+{
+  public:
+    UsbAudioPacer() {}
+    ~UsbAudioPacer() {}
+
+    void Init(const UsbAudioLoopConfig& config)
+    {
+        config_ = config;
+        Reset();
+    }
+
+    /** Starts over with an empty accumulator and the target fill */
+    void Reset()
+    {
+        fill_  = config_.target_fill;
+        phase_ = 0.f;
+    }
+
+    /** @return the number of frames to send in the next packet
+     *  @param rate The measured rate, see UsbAudioRateMeter
+     *  @param fill The fill of the IN FIFO in frames
+     */
+    size_t Next(float rate, size_t fill)
+    {
+        fill_ += config_.smoothing * (float(fill) - fill_);
+        // too full means the packets are too small
+        const float error = fill_ - config_.target_fill;
+        phase_ += config_.Limit(rate + config_.gain * error);
+        const size_t size = size_t(phase_);
+        phase_ -= float(size);
+        return size;
+    }
+
+  private:
+    UsbAudioLoopConfig config_;
+    float              fill_;
+    float              phase_;
+};
+
+/** @brief FIFO of interleaved samples between USB packets and the audio
+ *         callback
+ *  @ingroup utility
+ *
+ *  Single producer, single consumer, so the USB and the audio interrupt
+ *  can each own one end. Samples are stored as left justified 32 bit
+ *  integers and converted from and to the little endian PCM of USB
+ *  audio packets with 2, 3 or 4 bytes per sample.
+ *
+ *  The consumer waits for the start fill before it reads anything, and
+ *  again after it ran dry, so that one late packet doesn't turn into an
+ *  underrun at every block.
+ */
+class UsbAudioFifo
+{
+  public:
+    UsbAudioFifo() {}
+    ~UsbAudioFifo() {}
+
+    /** Initializes the FIFO
+     *  @param buffer       Storage for num_frames * num_channels samples
+     *  @param num_frames   Capacity in frames, a power of two
+     *  @param num_channels Samples per frame
+     */
+    void Init(int32_t* buffer, size_t num_frames, size_t num_channels)
+    {
+        buffer_       = buffer;
+        mask_         = num_frames - 1;
+        num_channels_ = num_channels;
+        start_fill_   = 0;
+        Reset();
+    }
+
+    /** Empties the FIFO and clears the statistics. Only call this while
+     *  neither end is in use. */
+    void Reset()
+    {
+        write_count_.store(0);
+        read_count_.store(0);
+        primed_        = false;
+        num_underruns_ = 0;
+        num_overruns_  = 0;
+    }
+
+    /** Consumer: drops everything in the FIFO and waits for the start
+     *  fill again, e.g. when a stream stopped */
+    void Flush()
+    {
+        read_count_.store(write_count_.load(std::memory_order_acquire),
+                          std::memory_order_release);
+        primed_ = false;
+    }
+
+    /** Sets the fill the consumer waits for before it reads */
+    void SetStartFill(size_t num_frames) { start_fill_ = num_frames; }
+
+    /** @return the number of frames in the FIFO */
+    size_t GetFill() const
+    {
+        return write_count_.load(std::memory_order_acquire)
+               - read_count_.load(std::memory_order_acquire);
+    }
+
+    /** @return the number of frames that can be written */
+    size_t GetFree() const { return mask_ + 1 - GetFill(); }
+
+    size_t GetNumChannels() const { return num_channels_; }
+
+    /** Producer: adds interleaved frames. Frames that don't fit are
+     *  dropped and counted as overruns.
+     *  @return the number of frames written
+     */
+    size_t Write(const int32_t* data, size_t num_frames)
+    {
+        const size_t count = Reserve(num_frames);
+        size_t       pos   = write_count_.load(std::memory_order_relaxed);
+        for(size_t i = 0; i < count; i++, pos++)
+        {
+            int32_t* frame = buffer_ + (pos & mask_) * num_channels_;
+            for(size_t c = 0; c < num_channels_; c++)
+                frame[c] = *data++;
+        }
+        write_count_.store(pos, std::memory_order_release);
+        return count;
+    }
+
+    /** Producer: adds frames from a USB audio packet
+     *  @param data         Little endian PCM samples
+     *  @param num_frames   Number of frames in the packet
+     *  @param subslot_size Bytes per sample, 2, 3 or 4
+     *  @return the number of frames written
+     */
+    size_t WritePcm(const uint8_t* data, size_t num_frames, size_t subslot_size)
+    {
+        const size_t count = Reserve(num_frames);
+        size_t       pos   = write_count_.load(std::memory_order_relaxed);
+        for(size_t i = 0; i < count; i++, pos++)
+        {
+            int32_t* frame = buffer_ + (pos & mask_) * num_channels_;
+            for(size_t c = 0; c < num_channels_; c++)
+            {
+                frame[c] = Unpack(data, subslot_size);
+                data += subslot_size;
+            }
+        }
+        write_count_.store(pos, std::memory_order_release);
+        return count;
+    }
+
+    /** Consumer: takes interleaved frames. Missing frames are zeros.
+     *  @return the number of frames that came from the FIFO
+     */
+    size_t Read(int32_t* dest, size_t num_frames)
+    {
+        const size_t count = Take(num_frames);
+        size_t       pos   = read_count_.load(std::memory_order_relaxed);
+        for(size_t i = 0; i < count; i++, pos++)
+        {
+            const int32_t* frame = buffer_ + (pos & mask_) * num_channels_;
+            for(size_t c = 0; c < num_channels_; c++)
+                *dest++ = frame[c];
+        }
+        read_count_.store(pos, std::memory_order_release);
+        for(size_t i = count * num_channels_; i < num_frames * num_channels_;
+            i++)
+            *dest++ = 0;
+        return count;
+    }
+
+    /** Consumer: takes frames for a USB audio packet. Missing frames are
+     *  zeros.
+     *  @param dest         Receives num_frames * channels samples
+     *  @param num_frames   Number of frames in the packet
+     *  @param subslot_size Bytes per sample, 2, 3 or 4
+     *  @return the number of frames that came from the FIFO
+     */
+    size_t ReadPcm(uint8_t* dest, size_t num_frames, size_t subslot_size)
+    {
+        const size_t count = Take(num_frames);
+        size_t       pos   = read_count_.load(std::memory_order_relaxed);
+        for(size_t i = 0; i < num_frames; i++, pos++)
+        {
+            const int32_t* frame = buffer_ + (pos & mask_) * num_channels_;
+            for(size_t c = 0; c < num_channels_; c++)
+            {
+                Pack(i < count ? frame[c] : 0, dest, subslot_size);
+                dest += subslot_size;
+            }
+        }
+        read_count_.store(read_count_.load(std::memory_order_relaxed) + count,
+                          std::memory_order_release);
+        return count;
+    }
+
+    /** @return the number of frames the consumer was missing */
+    uint32_t GetNumUnderruns() const { return num_underruns_; }
+
+    /** @return the number of frames the producer dropped */
+    uint32_t GetNumOverruns() const { return num_overruns_; }
+
+    /** Converts a little endian PCM sample to a left justified one */
+    static int32_t Unpack(const uint8_t* data, size_t subslot_size)
+    {
+        uint32_t value = 0;
+        for(size_t i = 0; i < subslot_size; i++)
+            value |= uint32_t(data[i]) << (8 * (4 - subslot_size + i));
+        return int32_t(value);
+    }
+
+    /** Converts a left justified sample to little endian PCM */
+    static void Pack(int32_t sample, uint8_t* dest, size_t subslot_size)
+    {
+        const uint32_t value = uint32_t(sample);
+        for(size_t i = 0; i < subslot_size; i++)
+            dest[i] = uint8_t(value >> (8 * (4 - subslot_size + i)));
+    }
+
+  private:
+    size_t Reserve(size_t num_frames)
+    {
+        const size_t space = GetFree();
+        if(num_frames <= space)
+            return num_frames;
+        num_overruns_ += num_frames - space;
+        return space;
+    }
+
+    size_t Take(size_t num_frames)
+    {
+        const size_t fill = GetFill();
+        if(!primed_)
+        {
+            if(fill < start_fill_ || fill == 0)
+                return 0;
+            primed_ = true;
+        }
+        if(num_frames <= fill)
+            return num_frames;
+        // ran dry, wait for the start fill again
+        num_underruns_ += num_frames - fill;
+        primed_ = false;
+        return fill;
+    }
+
+    int32_t*            buffer_;
+    size_t              mask_;
+    size_t              num_channels_;
+    size_t              start_fill_;
+    std::atomic<size_t> write_count_;
+    std::atomic<size_t> read_count_;
+    bool                primed_;
+    uint32_t            num_underruns_;
+    uint32_t            num_overruns_;
+};
+
+} // namespace daisy
@@ -0,0 +1,607 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <algorithm>
+#include "util/wav_format.h"
+
+namespace daisy
+{
+/** @brief Persistent index of the .wav files in a directory
+ *  @ingroup utility
+ *
+ *  Scanning a large sample library on every boot means opening each file to
+ *  read its header. The WavIndex does this once and stores the results in an
+ *  index file, e.g. next to the samples on the SD card. On the next boot the
+ *  whole index is loaded with a single read, without touching the files.
+ *
+ *  Each file is described by a compact Entry with its format, length and loop
+ *  points (from the "smpl" chunk). The file names are only kept in the index
+ *  file and read on demand with GetName() / GetPath(). Files are found by
+ *  ordinal (in directory order) or by the hash of their name.
+ *
+ *  When the timestamp of the directory changed, Init() rescans it. Files
+ *  whose name, size and modification time are unchanged keep their entry,
+ *  so only new and modified files are opened. The old names were already
+ *  overwritten in the index file at that point, so names are compared by
+ *  two independent 32 bit hashes. FAT file systems don't always
+ *  update the timestamp of a directory when files are added or removed, so
+ *  call Update() to rescan manually, e.g. after the card was written from
+ *  the device itself. The timestamp of a root directory can't be read, so
+ *  an index of a root directory is always rescanned.
+ *
+ *  The file system is accessed through an adapter class, e.g.
+ *  FatFsFileSystem from sys/fatfs.h:
+ *  \code
+ *  struct MyFileSystem
+ *  {
+ *      using File = FIL;
+ *      struct Dir;
+ *      struct FileInfo // filled by ReadDir()
+ *      {
+ *          const char* name; // empty at the end of the directory
+ *          uint32_t    size;
+ *          uint32_t    timestamp;
+ *          bool        isDirectory;
+ *          bool        isHidden;
+ *      };
+ *      // all functions return 0 on success, like FR_OK
+ *      int Open(File& file, const char* path, bool write);
+ *      int Close(File& file);
+ *      int Read(File& file, void* dest, size_t size, size_t& bytesRead);
+ *      int Write(File& file, const void* src, size_t size, size_t& written);
+ *      int Seek(File& file, uint32_t position);
+ *      uint32_t GetStartCluster(const File& file);
+ *      int OpenDir(Dir& dir, const char* path);
+ *      int ReadDir(Dir& dir, FileInfo& info);
+ *      int CloseDir(Dir& dir);
+ *      int GetTimestamp(const char* path, uint32_t& timestamp);
+ *  };
+ *  \endcode
+ *
+ *  The index holds up to `maxEntries` entries of 48 bytes each, so it
+ *  should be placed in SDRAM for large libraries. Store the index file
+ *  outside of the indexed directory, so that writing it doesn't change the
+ *  timestamp of the directory:
+ *  \code
+ *  WavIndex<FatFsFileSystem, 4096> DSY_SDRAM_BSS samples;
+ *  samples.Init(fs, "0:/samples", "0:/samples.idx");
+ *  \endcode
+ *
+ *  @tparam FileSystem  The file system adapter
+ *  @tparam maxEntries  The maximum number of files in the index
+ */
+template <typename FileSystem, size_t maxEntries>
+class WavIndex
+{
+  public:
+    using File     = typename FileSystem::File;
+    using Dir      = typename FileSystem::Dir;
+    using FileInfo = typename FileSystem::FileInfo;
+
+    /** The longest supported path, including the terminating zero */
+    static constexpr size_t kMaxPathLength = 256;
+
+    /** Return values */
+    enum class Result
+    {
+        OK,
+        /** The directory couldn't be read */
+        ERR_DIRECTORY,
+        /** The index file couldn't be written */
+        ERR_INDEX_FILE,
+    };
+
+    /** Description of a single .wav file */
+    struct Entry
+    {
+        uint32_t nameHash;   /**< HashName() of the file name */
+        uint32_t nameCheck;  /**< Second hash of the name, see CheckName() */
+        uint32_t nameOffset; /**< Position of the name in the index file */
+        uint32_t cluster;    /**< First cluster of the file */
+        uint32_t fileSize;   /**< Size of the file in bytes */
+        uint32_t timestamp;  /**< Modification date and time of the file */
+        uint32_t dataOffset; /**< Position of the first sample in the file */
+        uint32_t numFrames;  /**< Length in sample frames */
+        uint32_t sampleRate; /**< Sample rate in Hz */
+        uint32_t loopStart;  /**< First frame of the loop */
+        uint32_t loopEnd;    /**< Frame after the end of the loop */
+        uint16_t format;     /**< WavFileFormatCode, e.g. WAVE_FORMAT_PCM */
+        uint8_t  numChannels;
+        uint8_t  bitsPerSample;
+
+        /** Returns true if the file contains a loop */
+        bool HasLoop() const { return loopEnd > loopStart; }
+    };
+
+    WavIndex() {}
+
+    /** Loads the index for a directory from `indexPath`. If the index file
+     *  doesn't exist, is invalid or the directory changed since it was
+     *  written, the directory is rescanned and the index file is updated.
+     *  @param fileSystem   The file system adapter to use
+     *  @param directory    The directory with the .wav files
+     *  @param indexPath    The path of the index file
+     */
+    Result Init(FileSystem& fileSystem,
+                const char* directory,
+                const char* indexPath)
+    {
+        fs_         = &fileSystem;
+        numEntries_ = 0;
+        numParsed_  = 0;
+        numReused_  = 0;
+        CopyString(directory_, directory, sizeof(directory_));
+        CopyString(indexPath_, indexPath, sizeof(indexPath_));
+
+        uint32_t dirTimestamp = 0;
+        if(fs_->GetTimestamp(directory_, dirTimestamp) != 0)
+            dirTimestamp = 0;
+        const bool loaded = Load();
+        if(loaded && dirTimestamp != 0 && dirTimestamp == dirTimestamp_)
+            return Result::OK;
+        return Update();
+    }
+
+    /** Rescans the directory and writes the index file. Only files that are
+     *  new or were modified since the last scan are opened.
+     */
+    Result Update()
+    {
+        numParsed_ = 0;
+        numReused_ = 0;
+        if(fs_->GetTimestamp(directory_, dirTimestamp_) != 0)
+            dirTimestamp_ = 0;
+
+        Dir dir;
+        if(fs_->OpenDir(dir, directory_) != 0)
+        {
+            numEntries_ = 0;
+            return Result::ERR_DIRECTORY;
+        }
+        File       index;
+        const bool indexOpen = fs_->Open(index, indexPath_, true) == 0;
+        bool       indexOk   = indexOpen;
+
+        // An invalid header is written first and replaced at the end, so
+        // that an interrupted update leaves no valid index behind.
+        Header header;
+        memset(&header, 0, sizeof(header));
+        indexOk = indexOk && WriteAll(index, &header, sizeof(header));
+
+        // New entries are collected from the top of the array downwards,
+        // while the old entries at the bottom are still available for reuse
+        // until they are overwritten.
+        const size_t numOld   = numEntries_;
+        size_t       numNew   = 0;
+        uint32_t     namesEnd = 0;
+        FileInfo     info;
+        while(numNew < maxEntries && fs_->ReadDir(dir, info) == 0
+              && info.name != nullptr && info.name[0] != 0)
+        {
+            if(info.isDirectory || info.isHidden || !IsWavFile(info.name))
+                continue;
+
+            Entry          entry;
+            const uint32_t hash  = HashName(info.name);
+            const uint32_t check = CheckName(info.name);
+            // old entries above this were overwritten by new ones
+            const size_t limit = std::min(numOld, maxEntries - numNew);
+            const Entry* old = FindUnchanged(numOld, limit, hash, check, info);
+            if(old != nullptr)
+            {
+                entry = *old;
+                numReused_++;
+            }
+            else if(ParseFile(info.name, info.size, entry))
+            {
+                entry.nameHash  = hash;
+                entry.nameCheck = check;
+                entry.timestamp = info.timestamp;
+                numParsed_++;
+            }
+            else
+            {
+                continue;
+            }
+
+            const size_t nameLength = strlen(info.name) + 1;
+            entry.nameOffset        = namesEnd;
+            indexOk  = indexOk && WriteAll(index, info.name, nameLength);
+            namesEnd = namesEnd + nameLength;
+            entries_[maxEntries - 1 - numNew] = entry;
+            numNew++;
+        }
+        fs_->CloseDir(dir);
+
+        // move the new entries to the bottom, in directory order
+        Entry* const first = entries_ + maxEntries - numNew;
+        std::reverse(first, entries_ + maxEntries);
+        std::copy(first, entries_ + maxEntries, entries_);
+        numEntries_ = numNew;
+        SortByHash();
+
+        header.magic         = kMagic;
+        header.version       = kVersion;
+        header.entrySize     = sizeof(Entry);
+        header.numEntries    = numEntries_;
+        header.dirTimestamp  = dirTimestamp_;
+        header.namesOffset   = sizeof(Header);
+        header.entriesOffset = sizeof(Header) + namesEnd;
+        header.dirHash       = HashName(directory_);
+        indexOk = indexOk && WriteAll(index, entries_, sizeof(Entry) * numNew);
+        indexOk = indexOk && fs_->Seek(index, 0) == 0;
+        indexOk = indexOk && WriteAll(index, &header, sizeof(header));
+        if(indexOpen)
+            indexOk = fs_->Close(index) == 0 && indexOk;
+        namesOffset_ = header.namesOffset;
+        return indexOk ? Result::OK : Result::ERR_INDEX_FILE;
+    }
+
+    /** Returns the number of files in the index */
+    size_t GetNumEntries() const { return numEntries_; }
+
+    /** Returns the entry with the given ordinal, or nullptr if it doesn't
+     *  exist. Ordinals follow the order of the files in the directory. */
+    const Entry* GetEntry(size_t ordinal) const
+    {
+        return ordinal < numEntries_ ? &entries_[ordinal] : nullptr;
+    }
+
+    /** Returns the ordinal of the first file with the given name hash,
+     *  or -1 if there's none. */
+    int Find(uint32_t nameHash) const
+    {
+        const size_t pos = LowerBound(nameHash, numEntries_);
+        if(pos < numEntries_ && byHash_[pos].hash == nameHash)
+            return int(byHash_[pos].ordinal);
+        return -1;
+    }
+
+    /** Returns the ordinal of the file with the given name, or -1 if it
+     *  isn't in the index. The name is compared case insensitively. */
+    int Find(const char* name)
+    {
+        const uint32_t hash = HashName(name);
+        char           candidate[kMaxPathLength];
+        for(size_t pos = LowerBound(hash, numEntries_);
+            pos < numEntries_ && byHash_[pos].hash == hash;
+            pos++)
+        {
+            // names with the same hash are told apart by the index file
+            const size_t ordinal = byHash_[pos].ordinal;
+            if(GetName(ordinal, candidate, sizeof(candidate))
+               && EqualsIgnoreCase(candidate, name))
+                return int(ordinal);
+        }
+        return -1;
+    }
+
+    /** Reads the name of a file from the index file.
+     *  @return false if the name couldn't be read or didn't fit into `dest`
+     */
+    bool GetName(size_t ordinal, char* dest, size_t size)
+    {
+        if(ordinal >= numEntries_ || size == 0)
+            return false;
+        File index;
+        if(fs_->Open(index, indexPath_, false) != 0)
+            return false;
+        size_t     read = 0;
+        const bool ok
+            = fs_->Seek(index, namesOffset_ + entries_[ordinal].nameOffset) == 0
+              && fs_->Read(index, dest, size, read) == 0;
+        fs_->Close(index);
+        return ok && memchr(dest, 0, read) != nullptr;
+    }
+
+    /** Reads the full path of a file, i.e. the directory and the name, which
+     *  can be used to open the file.
+     *  @return false if the path couldn't be read or didn't fit into `dest`
+     */
+    bool GetPath(size_t ordinal, char* dest, size_t size)
+    {
+        const size_t length = JoinPath(dest, size, directory_, "");
+        return length < size && GetName(ordinal, dest + length, size - length);
+    }
+
+    /** Returns the number of files whose header was read during the last
+     *  update */
+    size_t GetNumParsedFiles() const { return numParsed_; }
+
+    /** Returns the number of entries that were kept without opening the file
+     *  during the last update */
+    size_t GetNumReusedEntries() const { return numReused_; }
+
+    /** Returns the 32 bit FNV-1a hash of a file name, ignoring the case of
+     *  ASCII letters */
+    static uint32_t HashName(const char* name)
+    {
+        uint32_t hash = 2166136261u;
+        for(; *name != 0; name++)
+        {
+            hash ^= uint8_t(ToLower(*name));
+            hash *= 16777619u;
+        }
+        return hash;
+    }
+
+  private:
+    /** Returns the djb2 hash of a file name, ignoring the case of ASCII
+     *  letters. Independent of HashName(), to tell apart names with the same
+     *  HashName() without reading them from the index file. */
+    static uint32_t CheckName(const char* name)
+    {
+        uint32_t hash = 5381;
+        for(; *name != 0; name++)
+            hash = hash * 33 + uint8_t(ToLower(*name));
+        return hash;
+    }
+
+    WavIndex(const WavIndex& other) = delete;
+    WavIndex& operator=(const WavIndex& other) = delete;
+
+    static constexpr uint32_t kMagic        = 0x58495744; // "DWIX"
+    static constexpr uint32_t kVersion      = 2;
+    static constexpr uint32_t kSmplChunkId  = 0x6c706d73; // "smpl"
+    static constexpr int      kMaxNumChunks = 16;
+
+    struct Header
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t entrySize;
+        uint32_t numEntries;
+        uint32_t dirTimestamp;
+        uint32_t dirHash;
+        uint32_t namesOffset;
+        uint32_t entriesOffset;
+    };
+
+    /** Name hash lookup table, sorted by hash */
+    struct HashSlot
+    {
+        uint32_t hash;
+        uint32_t ordinal;
+    };
+
+    bool Load()
+    {
+        File index;
+        if(fs_->Open(index, indexPath_, false) != 0)
+            return false;
+        Header     header;
+        size_t     read = 0;
+        const bool ok   = fs_->Read(index, &header, sizeof(header), read) == 0
+                        && read == sizeof(header) && header.magic == kMagic
+                        && header.version == kVersion
+                        && header.entrySize == sizeof(Entry)
+                        && header.numEntries <= maxEntries
+                        && header.dirHash == HashName(directory_)
+                        && fs_->Seek(index, header.entriesOffset) == 0
+                        && ReadAll(index,
+                                   entries_,
+                                   sizeof(Entry) * header.numEntries);
+        fs_->Close(index);
+        if(!ok)
+            return false;
+        numEntries_   = header.numEntries;
+        dirTimestamp_ = header.dirTimestamp;
+        namesOffset_  = header.namesOffset;
+        SortByHash();
+        return true;
+    }
+
+    /** Returns an unchanged entry among the old entries below `limit`.
+     *  A renamed file has a different name, even if its hash collides with
+     *  the old one, so both hashes have to match. */
+    const Entry* FindUnchanged(size_t          numOld,
+                               size_t          limit,
+                               uint32_t        hash,
+                               uint32_t        check,
+                               const FileInfo& info) const
+    {
+        // byHash_ still describes the old entries
+        for(size_t pos = LowerBound(hash, numOld);
+            pos < numOld && byHash_[pos].hash == hash;
+            pos++)
+        {
+            if(byHash_[pos].ordinal >= limit)
+                continue;
+            const Entry& old = entries_[byHash_[pos].ordinal];
+            if(old.nameCheck == check && old.fileSize == info.size
+               && old.timestamp == info.timestamp)
+                return &old;
+        }
+        return nullptr;
+    }
+
+    /** Reads the header of a .wav file */
+    bool ParseFile(const char* name, uint32_t size, Entry& entry)
+    {
+        char path[kMaxPathLength];
+        if(JoinPath(path, sizeof(path), directory_, name) >= sizeof(path))
+            return false;
+        File file;
+        if(fs_->Open(file, path, false) != 0)
+            return false;
+        memset(&entry, 0, sizeof(entry));
+        entry.fileSize = size;
+        entry.cluster  = fs_->GetStartCluster(file);
+        const bool ok = ParseChunks(file, entry);
+        fs_->Close(file);
+        return ok;
+    }
+
+    bool ParseChunks(File& file, Entry& entry)
+    {
+        uint8_t buf[40];
+        if(!ReadAll(file, buf, 12) || ReadLe32(buf) != kWavFileChunkId
+           || ReadLe32(buf + 8) != kWavFileWaveId)
+            return false;
+
+        bool     hasFormat  = false;
+        bool     hasData    = false;
+        uint32_t dataSize   = 0;
+        uint16_t blockAlign = 0;
+        uint32_t pos        = 12;
+        for(int n = 0; n < kMaxNumChunks; n++)
+        {
+            if(fs_->Seek(file, pos) != 0 || !ReadAll(file, buf, 8))
+                break;
+            const uint32_t id   = ReadLe32(buf);
+            const uint32_t size = ReadLe32(buf + 4);
+            if(id == kWavFileSubChunk1Id && size >= 16)
+            {
+                if(!ReadAll(file, buf, size < 40 ? size : 40))
+                    return false;
+                entry.format        = ReadLe16(buf);
+                entry.numChannels   = uint8_t(ReadLe16(buf + 2));
+                entry.sampleRate    = ReadLe32(buf + 4);
+                blockAlign          = ReadLe16(buf + 12);
+                entry.bitsPerSample = uint8_t(ReadLe16(buf + 14));
+                // the actual format is the start of the SubFormat GUID
+                if(entry.format == WAVE_FORMAT_EXTENSIBLE && size >= 40)
+                    entry.format = ReadLe16(buf + 24);
+                hasFormat = true;
+            }
+            else if(id == kWavFileSubChunk2Id)
+            {
+                entry.dataOffset = pos + 8;
+                dataSize         = size;
+                hasData          = true;
+            }
+            else if(id == kSmplChunkId && size >= 36 + 24)
+            {
+                // sampler header, followed by the first loop
+                if(!ReadAll(file, buf, 36))
+                    return false;
+                const uint32_t numLoops = ReadLe32(buf + 28);
+                if(numLoops > 0 && ReadAll(file, buf, 24))
+                {
+                    entry.loopStart = ReadLe32(buf + 8);
+                    entry.loopEnd   = ReadLe32(buf + 12) + 1;
+                }
+            }
+            // chunks are padded to an even size
+            const uint32_t next = pos + 8 + size + (size & 1);
+            if(next <= pos)
+                break;
+            pos = next;
+        }
+        if(!hasFormat || !hasData || blockAlign == 0)
+            return false;
+
+        // the size in the header is wrong for files that weren't finalized
+        if(entry.dataOffset < entry.fileSize)
+            dataSize = std::min(dataSize, entry.fileSize - entry.dataOffset);
+        entry.numFrames = dataSize / blockAlign;
+        return true;
+    }
+
+    void SortByHash()
+    {
+        for(size_t i = 0; i < numEntries_; i++)
+        {
+            byHash_[i].hash    = entries_[i].nameHash;
+            byHash_[i].ordinal = uint32_t(i);
+        }
+        std::sort(byHash_,
+                  byHash_ + numEntries_,
+                  [](const HashSlot& a, const HashSlot& b) {
+                      return a.hash < b.hash
+                             || (a.hash == b.hash && a.ordinal < b.ordinal);
+                  });
+    }
+
+    /** Returns the position of the first slot with `hash` in byHash_ */
+    size_t LowerBound(uint32_t hash, size_t num) const
+    {
+        const HashSlot* slot = std::lower_bound(
+            byHash_, byHash_ + num, hash, [](const HashSlot& a, uint32_t h) {
+                return a.hash < h;
+            });
+        return slot - byHash_;
+    }
+
+    bool ReadAll(File& file, void* dest, size_t size)
+    {
+        size_t read = 0;
+        return fs_->Read(file, dest, size, read) == 0 && read == size;
+    }
+
+    bool WriteAll(File& file, const void* src, size_t size)
+    {
+        size_t written = 0;
+        return fs_->Write(file, src, size, written) == 0 && written == size;
+    }
+
+    static bool IsWavFile(const char* name)
+    {
+        const size_t length = strlen(name);
+        return length > 4 && EqualsIgnoreCase(name + length - 4, ".wav");
+    }
+
+    /** Writes `directory/name` to `dest` and returns its length. The result
+     *  is truncated if it's `size` or longer. */
+    static size_t
+    JoinPath(char* dest, size_t size, const char* directory, const char* name)
+    {
+        size_t length = CopyString(dest, directory, size);
+        if(length > 0 && directory[length - 1] != '/' && length + 1 < size)
+        {
+            dest[length++] = '/';
+            dest[length]   = 0;
+        }
+        return length + CopyString(dest + length, name, size - length);
+    }
+
+    /** Copies a string, returns the length of `src` */
+    static size_t CopyString(char* dest, const char* src, size_t size)
+    {
+        const size_t length = strlen(src);
+        if(size > 0)
+        {
+            const size_t n = length < size ? length : size - 1;
+            memcpy(dest, src, n);
+            dest[n] = 0;
+        }
+        return length;
+    }
+
+    static char ToLower(char c)
+    {
+        return (c >= 'A' && c <= 'Z') ? char(c - 'A' + 'a') : c;
+    }
+
+    static bool EqualsIgnoreCase(const char* a, const char* b)
+    {
+        for(; *a != 0 && ToLower(*a) == ToLower(*b); a++, b++) {}
+        return ToLower(*a) == ToLower(*b);
+    }
+
+    static uint16_t ReadLe16(const uint8_t* p)
+    {
+        return uint16_t(p[0] | (p[1] << 8));
+    }
+
+    static uint32_t ReadLe32(const uint8_t* p)
+    {
+        return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16)
+               | (uint32_t(p[3]) << 24);
+    }
+
+    FileSystem* fs_           = nullptr;
+    char        directory_[kMaxPathLength];
+    char        indexPath_[kMaxPathLength];
+    Entry       entries_[maxEntries];
+    HashSlot    byHash_[maxEntries];
+    size_t      numEntries_   = 0;
+    uint32_t    dirTimestamp_ = 0;
+    uint32_t    namesOffset_  = 0;
+    size_t      numParsed_    = 0;
+    size_t      numReused_    = 0;
+};
+
+} // namespace daisy
@@ -0,0 +1,82 @@
+#include "util/sd_diskio.h"
+#include "util/SectorCache.h"
+#include "daisy_core.h"
+
+/** Number of cache lines of the SD card sector cache.
+ *  The defaults take up 32kB of the AXI SRAM (AXI_SRAM_MEM_SECTION).
+ */
+#ifndef DSY_SD_CACHE_LINES
+#define DSY_SD_CACHE_LINES 8
+#endif
+
+/** Sectors per cache line. A small read loads the whole line, so a
+ *  sequential stream reads up to this many sectors minus one ahead.
+ */
+#ifndef DSY_SD_CACHE_SECTORS_PER_LINE
+#define DSY_SD_CACHE_SECTORS_PER_LINE 8
+#endif
+
+#define SD_CACHE_SECTOR_SIZE 512
+
+using namespace daisy;
+
+using SdSectorCache = SectorCache<DSY_SD_CACHE_LINES>;
+
+/** Forwards the cache misses to the SDMMC driver */
+class SdBlockDevice : public SdSectorCache::BlockDevice
+{
+  public:
+    bool Read(uint8_t* dest, uint32_t sector, uint32_t count) override
+    {
+        return SD_ReadBlocks(dest, sector, count) == RES_OK;
+    }
+    bool Write(const uint8_t* src, uint32_t sector, uint32_t count) override
+    {
+        return SD_WriteBlocks(src, sector, count) == RES_OK;
+    }
+};
+
+// The SDMMC1 IDMA can only reach the AXI SRAM, not the D2 SRAM of the
+// DMA_BUFFER_MEM_SECTION, nor the DTCM that holds .bss in BOOT_SRAM apps.
+// SD_ReadBlocks() and SD_WriteBlocks() clean and invalidate the D-cache,
+// which needs the lines aligned to 32 bytes.
+static uint8_t AXI_SRAM_MEM_SECTION __attribute__((aligned(32)))
+sd_cache_memory[DSY_SD_CACHE_LINES * DSY_SD_CACHE_SECTORS_PER_LINE
+                * SD_CACHE_SECTOR_SIZE];
+
+static SdBlockDevice sd_block_device;
+static SdSectorCache sd_cache;
+static bool          sd_cache_initialized = false;
+
+static SdSectorCache& GetCache()
+{
+    if(!sd_cache_initialized)
+    {
+        sd_cache.Init(sd_block_device,
+                      sd_cache_memory,
+                      DSY_SD_CACHE_SECTORS_PER_LINE,
+                      SD_CACHE_SECTOR_SIZE);
+        sd_cache_initialized = true;
+    }
+    return sd_cache;
+}
+
+extern "C" int SD_CacheRead(BYTE* buff, DWORD sector, UINT count)
+{
+    return GetCache().Read(buff, sector, count) ? 1 : 0;
+}
+
+extern "C" int SD_CacheWrite(const BYTE* buff, DWORD sector, UINT count)
+{
+    return GetCache().Write(buff, sector, count) ? 1 : 0;
+}
+
+extern "C" int SD_CacheFlush(void)
+{
+    return GetCache().Flush() ? 1 : 0;
+}
+
+extern "C" void SD_CacheInvalidate(void)
+{
+    GetCache().Invalidate();
+}
@@ -104,6 +104,10 @@ static DSTATUS SD_CheckStatus(BYTE lun)
   */
 DSTATUS SD_initialize(BYTE lun)
 {
+#if !defined(DSY_SD_DISABLE_CACHE)
+    /* the card may have been changed */
+    SD_CacheInvalidate();
+#endif
 #if !defined(DISABLE_SD_INIT)
 
     if(BSP_SD_Init() == MSD_OK)
@@ -136,6 +140,22 @@ DSTATUS SD_status(BYTE lun)
   * @retval DRESULT: Operation result
   */
 DRESULT SD_read(BYTE lun, BYTE *buff, DWORD sector, UINT count)
+{
+#if defined(DSY_SD_DISABLE_CACHE)
+    return SD_ReadBlocks(buff, sector, count);
+#else
+    return SD_CacheRead(buff, sector, count) ? RES_OK : RES_ERROR;
+#endif
+}
+
+/**
+  * @brief  Reads Sector(s) from the card, bypassing the sector cache
+  * @param  *buff: Data buffer to store read data
+  * @param  sector: Sector address (LBA)
+  * @param  count: Number of sectors to read
+  * @retval DRESULT: Operation result
+  */
+DRESULT SD_ReadBlocks(BYTE *buff, DWORD sector, UINT count)
 {
     DRESULT res = RES_ERROR;
     ReadStatus  = 0;
@@ -193,6 +213,22 @@ DRESULT SD_read(BYTE lun, BYTE *buff, DWORD sector, UINT count)
   */
 #if _USE_WRITE == 1
 DRESULT SD_write(BYTE lun, const BYTE *buff, DWORD sector, UINT count)
+{
+#if defined(DSY_SD_DISABLE_CACHE)
+    return SD_WriteBlocks(buff, sector, count);
+#else
+    return SD_CacheWrite(buff, sector, count) ? RES_OK : RES_ERROR;
+#endif
+}
+
+/**
+  * @brief  Writes Sector(s) to the card, bypassing the sector cache
+  * @param  *buff: Data to be written
+  * @param  sector: Sector address (LBA)
+  * @param  count: Number of sectors to write
+  * @retval DRESULT: Operation result
+  */
+DRESULT SD_WriteBlocks(const BYTE *buff, DWORD sector, UINT count)
 {
     DRESULT res = RES_ERROR;
     WriteStatus = 0;
@@ -266,7 +302,13 @@ DRESULT SD_ioctl(BYTE lun, BYTE cmd, void *buff)
     switch(cmd)
     {
         /* Make sure that no pending write process */
-        case CTRL_SYNC: res = RES_OK; break;
+        case CTRL_SYNC:
+#if defined(DSY_SD_DISABLE_CACHE)
+            res = RES_OK;
+#else
+            res = SD_CacheFlush() ? RES_OK : RES_ERROR;
+#endif
+            break;
 
         /* Get number of sectors on the disk (DWORD) */
         case GET_SECTOR_COUNT:
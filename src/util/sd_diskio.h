@@ -6,10 +6,29 @@ extern "C"
 {
 #endif
 
+#include "ff_gen_drv.h"
 #include "util/bsp_sd_diskio.h"
 
     extern const Diskio_drvTypeDef SD_Driver; /**< & */
 
+    /** Reads sectors from the card, bypassing the sector cache */
+    DRESULT SD_ReadBlocks(BYTE *buff, DWORD sector, UINT count);
+
+    /** Writes sectors to the card, bypassing the sector cache */
+    DRESULT SD_WriteBlocks(const BYTE *buff, DWORD sector, UINT count);
+
+    /** Reads sectors through the sector cache. Returns 0 on error. */
+    int SD_CacheRead(BYTE *buff, DWORD sector, UINT count);
+
+    /** Writes sectors through the sector cache. Returns 0 on error. */
+    int SD_CacheWrite(const BYTE *buff, DWORD sector, UINT count);
+
+    /** Writes all cached modifications to the card. Returns 0 on error. */
+    int SD_CacheFlush(void);
+
+    /** Discards the content of the sector cache */
+    void SD_CacheInvalidate(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,147 @@
+#include "ff_gen_drv.h"
+#include "util/usbh_diskio.h"
+#include "util/SectorCache.h"
+#include "sys/system.h"
+#include "daisy_core.h"
+
+/** Number of cache lines of the USB drive sector cache.
+ *  Unlike the SD card cache, the lines are placed in DMA_BUFFER_MEM_SECTION,
+ *  whose 32kB (BOOT_SRAM and BOOT_QSPI) also hold the audio buffers (16kB),
+ *  the Memory DMA arena (8kB), the host handle and scratch sector (2kB)
+ *  and the ADC, MIDI and DAC buffers (under 1kB). The default of 4kB fits
+ *  next to all of them; shrink DSY_MEMORY_DMA_ARENA_SIZE before raising it.
+ */
+#ifndef DSY_USBH_CACHE_LINES
+#define DSY_USBH_CACHE_LINES 2
+#endif
+
+/** Sectors per cache line, which is also the size of the reads ahead.
+ *  Each read is a SCSI command with its own overhead on the bus, so USB
+ *  drives benefit from longer lines than SD cards.
+ */
+#ifndef DSY_USBH_CACHE_SECTORS_PER_LINE
+#define DSY_USBH_CACHE_SECTORS_PER_LINE 4
+#endif
+
+#define USBH_CACHE_SECTOR_SIZE 512
+
+using namespace daisy;
+
+using UsbhSectorCache = SectorCache<DSY_USBH_CACHE_LINES>;
+
+/** Forwards the cache misses to the mass storage class of the host */
+class UsbhBlockDevice : public UsbhSectorCache::BlockDevice
+{
+  public:
+    bool Read(uint8_t* dest, uint32_t sector, uint32_t count) override
+    {
+        return USBH_ReadBlocks(0, dest, sector, count) == RES_OK;
+    }
+    bool Write(const uint8_t* src, uint32_t sector, uint32_t count) override
+    {
+        return USBH_WriteBlocks(0, src, sector, count) == RES_OK;
+    }
+    bool StartRead(uint8_t* dest, uint32_t sector, uint32_t count) override
+    {
+        return USBH_StartReadBlocks(0, dest, sector, count) != 0;
+    }
+    UsbhSectorCache::ReadState PollRead() override
+    {
+        switch(USBH_PollReadBlocks())
+        {
+            case USBH_READ_BUSY: return UsbhSectorCache::ReadState::BUSY;
+            case USBH_READ_DONE: return UsbhSectorCache::ReadState::DONE;
+            default: return UsbhSectorCache::ReadState::FAILED;
+        }
+    }
+    bool CanTransfer(const uint8_t* buffer) const override
+    {
+        return USBH_CanTransfer(buffer) != 0;
+    }
+};
+
+// cache lines in non-cached memory, so the DMA transfers need no
+// cache maintenance
+static uint8_t DMA_BUFFER_MEM_SECTION __attribute__((aligned(32)))
+usbh_cache_memory[DSY_USBH_CACHE_LINES * DSY_USBH_CACHE_SECTORS_PER_LINE
+                  * USBH_CACHE_SECTOR_SIZE];
+
+static UsbhBlockDevice usbh_block_device;
+static UsbhSectorCache usbh_cache;
+static bool            usbh_cache_initialized = false;
+
+static UsbhSectorCache& GetCache()
+{
+    if(!usbh_cache_initialized)
+    {
+        usbh_cache.Init(usbh_block_device,
+                        usbh_cache_memory,
+                        DSY_USBH_CACHE_SECTORS_PER_LINE,
+                        USBH_CACHE_SECTOR_SIZE);
+        usbh_cache.SetReadAhead(true);
+        usbh_cache.SetClock(System::GetTick, System::GetTickFreq());
+        usbh_cache_initialized = true;
+    }
+    return usbh_cache;
+}
+
+// The cache holds the first LUN, which is all most drives have. Others are
+// accessed directly, once the drive is done with a read ahead.
+
+extern "C" int USBH_CacheRead(BYTE lun, BYTE* buff, DWORD sector, UINT count)
+{
+    if(lun != 0)
+    {
+        while(GetCache().Poll()) {}
+        return USBH_ReadBlocks(lun, buff, sector, count) == RES_OK;
+    }
+    return GetCache().Read(buff, sector, count) ? 1 : 0;
+}
+
+extern "C" int
+USBH_CacheWrite(BYTE lun, const BYTE* buff, DWORD sector, UINT count)
+{
+    if(lun != 0)
+    {
+        while(GetCache().Poll()) {}
+        return USBH_WriteBlocks(lun, buff, sector, count) == RES_OK;
+    }
+    return GetCache().Write(buff, sector, count) ? 1 : 0;
+}
+
+extern "C" int USBH_CacheFlush(void)
+{
+    return GetCache().Flush() ? 1 : 0;
+}
+
+extern "C" void USBH_CacheInvalidate(void)
+{
+    GetCache().Invalidate();
+}
+
+extern "C" int USBH_CachePoll(void)
+{
+    // nothing to advance before the first access
+    if(!usbh_cache_initialized)
+        return 0;
+    return usbh_cache.Poll() ? 1 : 0;
+}
+
+extern "C" void USBH_CacheGetStats(USBH_CacheStatsTypeDef* stats)
+{
+    const UsbhSectorCache& cache = GetCache();
+    stats->hits                  = cache.GetStats().hits;
+    stats->misses                = cache.GetStats().misses;
+    stats->device_reads          = cache.GetStats().deviceReads;
+    stats->device_writes         = cache.GetStats().deviceWrites;
+    stats->sectors_read          = cache.GetStats().sectorsRead;
+    stats->sectors_written       = cache.GetStats().sectorsWritten;
+    stats->read_aheads           = cache.GetStats().readAheads;
+    stats->read_throughput       = cache.GetReadThroughput();
+    stats->write_throughput      = cache.GetWriteThroughput();
+}
+
+extern "C" void USBH_CacheResetStats(void)
+{
+    GetCache().ResetStats();
+}
@@ -39,6 +39,12 @@ extern USBH_HandleTypeDef hUsbHostHS;
 static DWORD DMA_BUFFER_MEM_SECTION scratch[_MAX_SS / 4];
 extern USBH_HandleTypeDef           hUSB_Host;
 
+/* State of the read started with USBH_StartReadBlocks() */
+static uint8_t  async_busy   = 0;
+static uint8_t  async_lun    = 0;
+static uint32_t async_length = 0;
+static uint32_t async_timer  = 0;
+
 /* Private function prototypes -----------------------------------------------*/
 DSTATUS USBH_initialize(BYTE);
 DSTATUS USBH_status(BYTE);
@@ -78,6 +84,10 @@ const Diskio_drvTypeDef USBH_Driver = {
 DSTATUS USBH_initialize(BYTE lun)
 {
     /* CAUTION : USB Host library has to be initialized in the application */
+#if !defined(DSY_USBH_DISABLE_CACHE)
+    /* the drive may have been changed */
+    USBH_CacheInvalidate();
+#endif
 
     return RES_OK;
 }
@@ -116,6 +126,23 @@ DSTATUS USBH_status(BYTE lun)
   * @retval DRESULT: Operation result
   */
 DRESULT USBH_read(BYTE lun, BYTE *buff, DWORD sector, UINT count)
+{
+#if defined(DSY_USBH_DISABLE_CACHE)
+    return USBH_ReadBlocks(lun, buff, sector, count);
+#else
+    return USBH_CacheRead(lun, buff, sector, count) ? RES_OK : RES_ERROR;
+#endif
+}
+
+/**
+  * @brief  Reads Sector(s) from the drive, bypassing the sector cache
+  * @param  lun : lun id
+  * @param  *buff: Data buffer to store read data
+  * @param  sector: Sector address (LBA)
+  * @param  count: Number of sectors to read
+  * @retval DRESULT: Operation result
+  */
+DRESULT USBH_ReadBlocks(BYTE lun, BYTE *buff, DWORD sector, UINT count)
 {
     DRESULT            res = RES_ERROR;
     MSC_LUNTypeDef     info;
@@ -128,8 +155,7 @@ DRESULT USBH_read(BYTE lun, BYTE *buff, DWORD sector, UINT count)
                             count * BLOCKSIZE + ((uint32_t)buff - alignedAddr));
 #endif
 
-    if(((DWORD)buff & 3)
-       && (((HCD_HandleTypeDef *)hUSB_Host.pData)->Init.dma_enable))
+    if(!USBH_CanTransfer(buff))
     {
         while((count--) && (status == USBH_OK))
         {
@@ -196,6 +222,23 @@ DRESULT USBH_read(BYTE lun, BYTE *buff, DWORD sector, UINT count)
   */
 #if _USE_WRITE == 1
 DRESULT USBH_write(BYTE lun, const BYTE *buff, DWORD sector, UINT count)
+{
+#if defined(DSY_USBH_DISABLE_CACHE)
+    return USBH_WriteBlocks(lun, buff, sector, count);
+#else
+    return USBH_CacheWrite(lun, buff, sector, count) ? RES_OK : RES_ERROR;
+#endif
+}
+
+/**
+  * @brief  Writes Sector(s) to the drive, bypassing the sector cache
+  * @param  lun : lun id
+  * @param  *buff: Data to be written
+  * @param  sector: Sector address (LBA)
+  * @param  count: Number of sectors to write
+  * @retval DRESULT: Operation result
+  */
+DRESULT USBH_WriteBlocks(BYTE lun, const BYTE *buff, DWORD sector, UINT count)
 {
     DRESULT            res = RES_ERROR;
     MSC_LUNTypeDef     info;
@@ -211,8 +254,7 @@ DRESULT USBH_write(BYTE lun, const BYTE *buff, DWORD sector, UINT count)
                             count * BLOCKSIZE + ((uint32_t)buff - alignedAddr));
 #endif
 
-    if(((DWORD)buff & 3)
-       && (((HCD_HandleTypeDef *)hUSB_Host.pData)->Init.dma_enable))
+    if(!USBH_CanTransfer(buff))
     {
         while(count--)
         {
@@ -281,7 +323,13 @@ DRESULT USBH_ioctl(BYTE lun, BYTE cmd, void *buff)
     switch(cmd)
     {
         /* Make sure that no pending write process */
-        case CTRL_SYNC: res = RES_OK; break;
+        case CTRL_SYNC:
+#if defined(DSY_USBH_DISABLE_CACHE)
+            res = RES_OK;
+#else
+            res = USBH_CacheFlush() ? RES_OK : RES_ERROR;
+#endif
+            break;
 
         /* Get number of sectors on the disk (DWORD) */
         case GET_SECTOR_COUNT:
@@ -331,6 +379,136 @@ DRESULT USBH_ioctl(BYTE lun, BYTE cmd, void *buff)
 }
 #endif /* _USE_IOCTL == 1 */
 
+/**
+  * @brief  Returns whether the host DMA can transfer to or from a buffer
+  * @param  *buff: Data buffer
+  * @retval 0 if the buffer isn't word aligned and the DMA is enabled
+  */
+int USBH_CanTransfer(const BYTE *buff)
+{
+    return !(((DWORD)buff & 3)
+             && (((HCD_HandleTypeDef *)hUSB_Host.pData)->Init.dma_enable));
+}
+
+/**
+  * @brief  Starts reading Sector(s) in the background. This issues the
+  *         same SCSI read as USBH_MSC_Read(), but returns right away;
+  *         USBH_PollReadBlocks() advances the transfer.
+  * @param  lun : lun id
+  * @param  *buff: Data buffer to store read data, must be DMA capable
+  * @param  sector: Sector address (LBA)
+  * @param  count: Number of sectors to read
+  * @retval 1 if the read was started, 0 if the drive is busy or not ready
+  */
+int USBH_StartReadBlocks(BYTE lun, BYTE *buff, DWORD sector, UINT count)
+{
+    MSC_HandleTypeDef *MSC_Handle;
+
+    if(async_busy || !USBH_CanTransfer(buff)
+       || hUSB_Host.pActiveClass != USBH_MSC_CLASS
+       || hUSB_Host.device.is_connected == 0U
+       || hUSB_Host.gState != HOST_CLASS)
+    {
+        return 0;
+    }
+    MSC_Handle = (MSC_HandleTypeDef *)hUSB_Host.pActiveClass->pData;
+    if(MSC_Handle->state != MSC_IDLE
+       || MSC_Handle->unit[lun].state != MSC_IDLE)
+    {
+        return 0;
+    }
+
+    MSC_Handle->state           = MSC_READ;
+    MSC_Handle->unit[lun].state = MSC_READ;
+    MSC_Handle->rw_lun          = lun;
+    USBH_MSC_SCSI_Read(&hUSB_Host, lun, sector, buff, count);
+
+    async_busy   = 1;
+    async_lun    = lun;
+    async_length = count;
+    async_timer  = hUSB_Host.Timer;
+    return 1;
+}
+
+/**
+  * @brief  Advances the read started with USBH_StartReadBlocks(). Like
+  *         USBH_MSC_Read(), a failed read requests the sense data.
+  * @retval USBH_READ_BUSY, USBH_READ_DONE or USBH_READ_FAILED
+  */
+int USBH_PollReadBlocks(void)
+{
+    MSC_HandleTypeDef *MSC_Handle;
+    MSC_LUNTypeDef    *unit;
+    USBH_StatusTypeDef status;
+    int                res = USBH_READ_BUSY;
+
+    if(!async_busy)
+    {
+        return USBH_READ_FAILED;
+    }
+    if(hUSB_Host.pActiveClass != USBH_MSC_CLASS
+       || hUSB_Host.device.is_connected == 0U
+       || hUSB_Host.gState != HOST_CLASS)
+    {
+        /* the class data is gone with the device */
+        async_busy = 0;
+        return USBH_READ_FAILED;
+    }
+    MSC_Handle = (MSC_HandleTypeDef *)hUSB_Host.pActiveClass->pData;
+    unit       = &MSC_Handle->unit[async_lun];
+
+    if(unit->state == MSC_READ)
+    {
+        status = USBH_MSC_SCSI_Read(&hUSB_Host, async_lun, 0U, NULL, 0U);
+        if(status == USBH_OK)
+        {
+            unit->state = MSC_IDLE;
+            res         = USBH_READ_DONE;
+        }
+        else if(status == USBH_FAIL)
+        {
+            unit->state = MSC_REQUEST_SENSE;
+        }
+        else if(status == USBH_UNRECOVERED_ERROR)
+        {
+            unit->state = MSC_UNRECOVERED_ERROR;
+            res         = USBH_READ_FAILED;
+        }
+    }
+    else if(unit->state == MSC_REQUEST_SENSE)
+    {
+        status = USBH_MSC_SCSI_RequestSense(
+            &hUSB_Host, async_lun, &unit->sense);
+        if(status == USBH_OK)
+        {
+            unit->state = MSC_IDLE;
+            unit->error = MSC_ERROR;
+            res         = USBH_READ_FAILED;
+        }
+        else if(status == USBH_UNRECOVERED_ERROR)
+        {
+            unit->state = MSC_UNRECOVERED_ERROR;
+            res         = USBH_READ_FAILED;
+        }
+    }
+    else
+    {
+        res = USBH_READ_FAILED;
+    }
+
+    if(res == USBH_READ_BUSY
+       && (hUSB_Host.Timer - async_timer) > (10000U * async_length))
+    {
+        res = USBH_READ_FAILED;
+    }
+    if(res != USBH_READ_BUSY)
+    {
+        MSC_Handle->state = MSC_IDLE;
+        async_busy        = 0;
+    }
+    return res;
+}
+
 /* USER CODE BEGIN lastSection */
 /* can be used to modify / undefine previous code or add new code */
 /* USER CODE END lastSection */
@@ -31,6 +31,72 @@
 /* Exported functions ------------------------------------------------------- */
 extern const Diskio_drvTypeDef USBH_Driver;
 
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/** States returned by USBH_PollReadBlocks() */
+#define USBH_READ_BUSY 0
+#define USBH_READ_DONE 1
+#define USBH_READ_FAILED 2
+
+    /** Transfer statistics of the sector cache of the drive */
+    typedef struct
+    {
+        uint32_t hits;             /**< Sectors read from the cache */
+        uint32_t misses;           /**< Sectors that required a line load */
+        uint32_t device_reads;     /**< Read commands sent to the drive */
+        uint32_t device_writes;    /**< Write commands sent to the drive */
+        uint32_t sectors_read;     /**< Sectors read from the drive */
+        uint32_t sectors_written;  /**< Sectors written to the drive */
+        uint32_t read_aheads;      /**< Lines read in the background */
+        float    read_throughput;  /**< Bytes per second read */
+        float    write_throughput; /**< Bytes per second written */
+    } USBH_CacheStatsTypeDef;
+
+    /** Reads sectors from the drive, bypassing the sector cache */
+    DRESULT USBH_ReadBlocks(BYTE lun, BYTE *buff, DWORD sector, UINT count);
+
+    /** Writes sectors to the drive, bypassing the sector cache */
+    DRESULT
+    USBH_WriteBlocks(BYTE lun, const BYTE *buff, DWORD sector, UINT count);
+
+    /** Returns 0 if the host DMA can't transfer to or from the buffer */
+    int USBH_CanTransfer(const BYTE *buff);
+
+    /** Starts reading sectors in the background. Returns 0 if the drive
+     *  is busy. */
+    int USBH_StartReadBlocks(BYTE lun, BYTE *buff, DWORD sector, UINT count);
+
+    /** Advances the read started with USBH_StartReadBlocks() */
+    int USBH_PollReadBlocks(void);
+
+    /** Reads sectors through the sector cache. Returns 0 on error. */
+    int USBH_CacheRead(BYTE lun, BYTE *buff, DWORD sector, UINT count);
+
+    /** Writes sectors through the sector cache. Returns 0 on error. */
+    int USBH_CacheWrite(BYTE lun, const BYTE *buff, DWORD sector, UINT count);
+
+    /** Writes all cached modifications to the drive. Returns 0 on error. */
+    int USBH_CacheFlush(void);
+
+    /** Discards the content of the sector cache */
+    void USBH_CacheInvalidate(void);
+
+    /** Advances the read-ahead of the cache. Returns 0 when it's idle. */
+    int USBH_CachePoll(void);
+
+    /** Copies the statistics of the sector cache */
+    void USBH_CacheGetStats(USBH_CacheStatsTypeDef *stats);
+
+    /** Resets the statistics of the sector cache */
+    void USBH_CacheResetStats(void);
+
+#ifdef __cplusplus
+}
+#endif
+
 /* USER CODE BEGIN lastSection */
 /* can be used to modify / undefine previous code or add new definitions */
 /* USER CODE END lastSection */
@@ -1,6 +1,7 @@
 #include <gtest/gtest.h>
 #include "ui/AbstractMenu.h"
 #include "util/MappedValue.h"
+#include "sys/system.h"
 #include <vector>
 
 using namespace daisy;
@@ -111,7 +112,11 @@ class ExposedAbstractMenu : public AbstractMenu
     bool                      IsEnteredForEditing() { return isEditing_; }
     bool IsFunctionButtonDown() { return AbstractMenu::IsFunctionButtonDown(); }
 
-    void Draw(const UiCanvasDescriptor& /* canvas */) override {}
+    void Draw(const UiCanvasDescriptor& /* canvas */) override
+    {
+        numDrawCalls_++;
+    }
+    int numDrawCalls_ = 0;
 
     static void callbackItemCallbackFunction(void* context)
     {
@@ -979,4 +984,184 @@ TEST(ui_AbstractMenu, m_closeMenu)
     // close menu with the cancel button
     menu.OnCancelButton(1, false);
     EXPECT_FALSE(menu.IsActive());
-}
\ No newline at end of file
+}
+/** A canvas that counts how often it was cleared and flushed and
+ *  remembers the last region that was passed to the flush function.
+ */
+struct CountingCanvas
+{
+    int       numClearCalls_ = 0;
+    int       numFlushCalls_ = 0;
+    Rectangle lastFlushedRegion_;
+
+    static void Clear(const UiCanvasDescriptor& canvas)
+    {
+        ((CountingCanvas*)(canvas.handle_))->numClearCalls_++;
+    }
+    static void Flush(const UiCanvasDescriptor& canvas)
+    {
+        auto& countingCanvas = *((CountingCanvas*)(canvas.handle_));
+        countingCanvas.numFlushCalls_++;
+        countingCanvas.lastFlushedRegion_ = canvas.dirtyRegion_;
+    }
+
+    UiCanvasDescriptor GetDescriptor(uint8_t id,
+                                     bool    redrawOnlyWhenInvalidated)
+    {
+        UiCanvasDescriptor descriptor;
+        descriptor.id_                        = id;
+        descriptor.handle_                    = this;
+        descriptor.updateRateMs_              = 10;
+        descriptor.clearFunction_             = &Clear;
+        descriptor.flushFunction_             = &Flush;
+        descriptor.redrawOnlyWhenInvalidated_ = redrawOnlyWhenInvalidated;
+        return descriptor;
+    }
+};
+
+TEST(ui_AbstractMenu, n_redrawOnlyWhenInvalidated)
+{
+    // adds the menu to a UI with two canvases, one of them redraws
+    // continuously, the other one only when the menu was invalidated
+
+    ExposedAbstractMenu menu;
+    menu.AddCloseItemsAndInit(
+        AbstractMenu::Orientation::leftRightSelectUpDownModify, 4, true);
+
+    CountingCanvas continuousCanvas;
+    CountingCanvas invalidatedCanvas;
+
+    UiEventQueue          queue;
+    UI                    ui;
+    UI::SpecialControlIds ids;
+    ids.menuEncoderId = 0;
+    ui.Init(queue,
+            ids,
+            {continuousCanvas.GetDescriptor(0, false),
+             invalidatedCanvas.GetDescriptor(1, true)});
+    ui.OpenPage(menu);
+
+    uint32_t currentTimeMs = 100;
+
+    const auto advanceTimeAndProcess = [&]() {
+        currentTimeMs += 100;
+        System::SetUsForUnitTest(currentTimeMs * 1000);
+        ui.Process();
+    };
+
+    // opening the page redraws both canvases
+    advanceTimeAndProcess();
+    EXPECT_EQ(continuousCanvas.numFlushCalls_, 1);
+    EXPECT_EQ(invalidatedCanvas.numClearCalls_, 1);
+    EXPECT_EQ(invalidatedCanvas.numFlushCalls_, 1);
+    EXPECT_TRUE(invalidatedCanvas.lastFlushedRegion_.IsEmpty()); // = all
+    EXPECT_EQ(menu.numDrawCalls_, 2);
+
+    // nothing has changed, only the continuous canvas is redrawn
+    advanceTimeAndProcess();
+    advanceTimeAndProcess();
+    EXPECT_EQ(continuousCanvas.numFlushCalls_, 3);
+    EXPECT_EQ(invalidatedCanvas.numClearCalls_, 1);
+    EXPECT_EQ(invalidatedCanvas.numFlushCalls_, 1);
+    EXPECT_EQ(menu.numDrawCalls_, 4);
+
+    // turning the menu encoder changes the selection and invalidates the menu
+    queue.AddEncoderTurned(0, 1, 12);
+    advanceTimeAndProcess();
+    EXPECT_EQ(menu.GetSelectedItemIdx(), 1);
+    EXPECT_EQ(invalidatedCanvas.numClearCalls_, 2);
+    EXPECT_EQ(invalidatedCanvas.numFlushCalls_, 2);
+    EXPECT_EQ(menu.numDrawCalls_, 6);
+
+    // partial invalidations are merged before they're flushed
+    menu.Invalidate(1, Rectangle(0, 0, 10, 8));
+    menu.Invalidate(1, Rectangle(20, 10, 10, 8));
+    menu.Invalidate(0, Rectangle(40, 40, 2, 2)); // other canvas
+    advanceTimeAndProcess();
+    EXPECT_EQ(invalidatedCanvas.numFlushCalls_, 3);
+    EXPECT_EQ(invalidatedCanvas.lastFlushedRegion_, Rectangle(0, 0, 30, 18));
+
+    // the update rate still limits the redraws
+    menu.Invalidate(1);
+    System::SetUsForUnitTest((currentTimeMs + 5) * 1000);
+    ui.Process();
+    EXPECT_EQ(invalidatedCanvas.numFlushCalls_, 3);
+    advanceTimeAndProcess();
+    EXPECT_EQ(invalidatedCanvas.numFlushCalls_, 4);
+    EXPECT_TRUE(invalidatedCanvas.lastFlushedRegion_.IsEmpty());
+
+    // closing the page invalidates all canvases
+    ui.ClosePage(menu);
+    advanceTimeAndProcess();
+    EXPECT_EQ(invalidatedCanvas.numFlushCalls_, 5);
+    advanceTimeAndProcess();
+    EXPECT_EQ(invalidatedCanvas.numFlushCalls_, 5);
+}
+
+TEST(ui_AbstractMenu, o_encoderAcceleration)
+{
+    ExposedAbstractMenu menu;
+    menu.AddValueItemsAndInit(
+        AbstractMenu::Orientation::leftRightSelectUpDownModify, 2, true);
+    auto& value = menu.mappedIntValue_;
+
+    // without acceleration, fast turns are passed on as they are
+    uint32_t nowUs = 1000000;
+    for(int i = 0; i < 30; i++)
+    {
+        nowUs += 10000;
+        System::SetUsForUnitTest(nowUs);
+        menu.OnValueEncoderTurned(1, 12);
+        EXPECT_EQ(value.numStepsUpPassedIntoStep_, 1);
+    }
+
+    // turning at 100 steps per second reaches the full gain
+    menu.EnableEncoderAcceleration();
+    for(int i = 0; i < 30; i++)
+    {
+        nowUs += 10000;
+        System::SetUsForUnitTest(nowUs);
+        menu.OnValueEncoderTurned(1, 12);
+        EXPECT_GE(value.numStepsUpPassedIntoStep_, 1);
+    }
+    EXPECT_EQ(value.numStepsUpPassedIntoStep_, 10);
+    EXPECT_FALSE(value.useCoarseStepSizePassedIntoStep_);
+
+    // coarse steps have a lower gain
+    menu.OnFunctionButton(1, false);
+    nowUs += 10000;
+    System::SetUsForUnitTest(nowUs);
+    menu.OnValueEncoderTurned(1, 12);
+    EXPECT_EQ(value.numStepsUpPassedIntoStep_, 3);
+    EXPECT_TRUE(value.useCoarseStepSizePassedIntoStep_);
+    menu.OnFunctionButton(0, false);
+
+    // a single step after a pause is a single step
+    nowUs += 1000000;
+    System::SetUsForUnitTest(nowUs);
+    menu.OnValueEncoderTurned(-1, 12);
+    EXPECT_EQ(value.numStepsUpPassedIntoStep_, -1);
+
+    // the arrow buttons are never accelerated
+    menu.OnArrowButton(ArrowButtonType::up, 1, false);
+    EXPECT_EQ(value.numStepsUpPassedIntoStep_, 1);
+
+    // scrolling through a long list with the menu encoder
+    ExposedAbstractMenu list;
+    list.AddCloseItemsAndInit(
+        AbstractMenu::Orientation::leftRightSelectUpDownModify, 200, false);
+    list.EnableEncoderAcceleration();
+    for(int i = 0; i < 15; i++)
+    {
+        nowUs += 10000;
+        System::SetUsForUnitTest(nowUs);
+        list.OnMenuEncoderTurned(1, 12);
+    }
+    EXPECT_GT(list.GetSelectedItemIdx(), 50);
+    EXPECT_LT(list.GetSelectedItemIdx(), 199);
+
+    list.DisableEncoderAcceleration();
+    const int16_t selected = list.GetSelectedItemIdx();
+    list.OnMenuEncoderTurned(1, 12);
+    EXPECT_EQ(list.GetSelectedItemIdx(), selected + 1);
+}
@@ -0,0 +1,213 @@
+#include "util/AdcHistory.h"
+#include <gtest/gtest.h>
+#include <vector>
+
+using namespace daisy;
+
+TEST(util_AdcHistory, a_stateAfterInit)
+{
+    uint16_t          buffer[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+    AdcChannelHistory history;
+    history.Init(buffer, 8, 4);
+
+    EXPECT_EQ(history.GetSize(), 8u);
+    EXPECT_EQ(history.GetDecimation(), 4u);
+    EXPECT_EQ(history.GetTimestamp(), 0u);
+    EXPECT_EQ(history.GetLatest(), 0u);
+    EXPECT_EQ(history.GetLatestWindow(4).Size(), 0u);
+    for(auto value : buffer)
+        EXPECT_EQ(value, 0u);
+}
+
+TEST(util_AdcHistory, b_decimation)
+{
+    uint16_t          buffer[8];
+    AdcChannelHistory history;
+    history.Init(buffer, 8, 4);
+
+    // no output until 4 samples were pushed
+    history.Push(100);
+    history.Push(200);
+    history.Push(300);
+    EXPECT_EQ(history.GetTimestamp(), 0u);
+    history.Push(401);
+    EXPECT_EQ(history.GetTimestamp(), 1u);
+    // rounded average
+    EXPECT_EQ(history.GetLatest(), 250u);
+
+    // no overflow for full scale values
+    for(int i = 0; i < 4; i++)
+        history.Push(65535);
+    EXPECT_EQ(history.GetLatest(), 65535u);
+    EXPECT_EQ(*history.GetLatestPtr(), 65535u);
+
+    // without decimation every sample is stored
+    history.Init(buffer, 8, 0);
+    EXPECT_EQ(history.GetDecimation(), 1u);
+    history.Push(7);
+    EXPECT_EQ(history.GetTimestamp(), 1u);
+    EXPECT_EQ(history.GetLatest(), 7u);
+}
+
+TEST(util_AdcHistory, c_decimationRejectsNoise)
+{
+    // alternating noise is removed completely when the decimation is a
+    // multiple of the noise period
+    uint16_t          buffer[16];
+    AdcChannelHistory history;
+    history.Init(buffer, 16, 8);
+    for(int i = 0; i < 128; i++)
+        history.Push(i % 2 ? 30000 + 500 : 30000 - 500);
+    const auto window = history.GetLatestWindow(16);
+    ASSERT_EQ(window.Size(), 16u);
+    for(size_t i = 0; i < window.Size(); i++)
+        EXPECT_EQ(window[i], 30000u);
+}
+
+TEST(util_AdcHistory, d_ringIndexing)
+{
+    uint16_t          buffer[5];
+    AdcChannelHistory history;
+    history.Init(buffer, 5);
+
+    for(uint16_t i = 0; i < 3; i++)
+        history.Push(i);
+    // only 3 samples available
+    auto window = history.GetLatestWindow(5);
+    EXPECT_EQ(window.Size(), 3u);
+    EXPECT_EQ(window.timestamp, 0u);
+    EXPECT_EQ(window.secondSize, 0u);
+    for(size_t i = 0; i < 3; i++)
+        EXPECT_EQ(window[i], i);
+
+    // wrap around
+    for(uint16_t i = 3; i < 12; i++)
+        history.Push(i);
+    EXPECT_EQ(history.GetTimestamp(), 12u);
+    window = history.GetLatestWindow(4);
+    EXPECT_EQ(window.timestamp, 8u);
+    EXPECT_EQ(window.firstSize, 2u);
+    EXPECT_EQ(window.secondSize, 2u);
+    uint16_t copy[4];
+    EXPECT_EQ(window.CopyTo(copy), 4u);
+    for(size_t i = 0; i < 4; i++)
+    {
+        EXPECT_EQ(window[i], 8 + i);
+        EXPECT_EQ(copy[i], 8 + i);
+    }
+
+    // never more than the ring size
+    window = history.GetLatestWindow(100);
+    EXPECT_EQ(window.Size(), 5u);
+    EXPECT_EQ(window.timestamp, 7u);
+    EXPECT_EQ(window[0], 7u);
+    EXPECT_EQ(window[4], 11u);
+}
+
+TEST(util_AdcHistory, e_consecutiveWindows)
+{
+    // reading the stream with GetWindowSince() yields every sample
+    // exactly once, regardless of how the pushes and reads interleave
+    std::vector<uint16_t> buffer(16);
+    AdcChannelHistory     history;
+    history.Init(buffer.data(), buffer.size(), 2);
+
+    uint32_t              readPos = 0;
+    std::vector<uint16_t> received;
+    uint16_t              next = 0;
+    for(int block = 0; block < 50; block++)
+    {
+        const size_t numSamples = 2 * (1 + block % 7);
+        for(size_t i = 0; i < numSamples; i++, next++)
+        {
+            // decimation by 2 averages these to `next`
+            history.Push(uint16_t(2 * next));
+            history.Push(uint16_t(2 * next));
+        }
+        const auto window = history.GetWindowSince(readPos, 8);
+        EXPECT_EQ(window.timestamp, readPos);
+        for(size_t i = 0; i < window.Size(); i++)
+            received.push_back(window[i]);
+        readPos += window.Size();
+        // read any remainder
+        const auto rest = history.GetWindowSince(readPos, 100);
+        for(size_t i = 0; i < rest.Size(); i++)
+            received.push_back(rest[i]);
+        readPos += rest.Size();
+    }
+    ASSERT_EQ(received.size(), size_t(next));
+    for(size_t i = 0; i < received.size(); i++)
+        EXPECT_EQ(received[i], uint16_t(2 * i));
+
+    // nothing new
+    EXPECT_EQ(history.GetWindowSince(readPos, 100).Size(), 0u);
+    // a reader that fell behind only gets the most recent samples
+    const auto late = history.GetWindowSince(0, 100);
+    EXPECT_EQ(late.Size(), 16u);
+    EXPECT_EQ(late.timestamp, readPos - 16);
+}
+
+TEST(util_AdcHistory, f_interleavedBlocksAndTimestamps)
+{
+    // two channels, interleaved like the DMA buffer
+    constexpr size_t kNumFrames = 32;
+    uint16_t         dma[kNumFrames * 2];
+    uint16_t         fastBuffer[64], slowBuffer[4];
+
+    AdcChannelHistory fast, slow;
+    fast.Init(fastBuffer, 64, 1);
+    slow.Init(slowBuffer, 4, 16);
+
+    uint32_t tick = 1000;
+    for(int block = 0; block < 10; block++)
+    {
+        for(size_t i = 0; i < kNumFrames; i++)
+        {
+            dma[2 * i]     = uint16_t(block * kNumFrames + i);
+            dma[2 * i + 1] = 5000;
+        }
+        tick += 320; // 10 ticks per frame
+        fast.PushBlock(&dma[0], kNumFrames, 2, tick);
+        slow.PushBlock(&dma[1], kNumFrames, 2, tick);
+    }
+
+    EXPECT_EQ(fast.GetTimestamp(), 320u);
+    EXPECT_EQ(slow.GetTimestamp(), 20u);
+    EXPECT_EQ(fast.GetLatest(), 319u);
+    EXPECT_EQ(slow.GetLatest(), 5000u);
+
+    EXPECT_FLOAT_EQ(fast.GetTicksPerSample(), 10.0f);
+    EXPECT_FLOAT_EQ(slow.GetTicksPerSample(), 160.0f);
+    EXPECT_EQ(fast.GetTickForTimestamp(319), tick);
+    EXPECT_EQ(fast.GetTickForTimestamp(300), tick - 190);
+    EXPECT_EQ(slow.GetTickForTimestamp(18), tick - 160);
+}
+
+TEST(util_AdcHistory, g_timestampOverflow)
+{
+    // the ring size isn't a power of two, so the timestamp modulo the size
+    // jumps when the timestamp overflows
+    uint16_t          buffer[5];
+    AdcChannelHistory history;
+    history.Init(buffer, 5);
+    history.SetTimestampForUnitTest(0xfffffffdu);
+
+    for(uint16_t i = 0; i < 5; i++)
+        history.Push(i);
+    EXPECT_EQ(history.GetTimestamp(), 2u);
+
+    // a window across the overflow
+    auto window = history.GetWindowSince(0xfffffffeu, 3);
+    ASSERT_EQ(window.Size(), 3u);
+    EXPECT_EQ(window.timestamp, 0xfffffffeu);
+    for(size_t i = 0; i < 3; i++)
+        EXPECT_EQ(window[i], 1 + i);
+
+    for(uint16_t i = 5; i < 8; i++)
+        history.Push(i);
+    window = history.GetLatestWindow(5);
+    ASSERT_EQ(window.Size(), 5u);
+    EXPECT_EQ(window.timestamp, 0u);
+    for(size_t i = 0; i < 5; i++)
+        EXPECT_EQ(window[i], 3 + i);
+}
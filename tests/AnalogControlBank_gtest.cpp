@@ -0,0 +1,218 @@
+#include "hid/ctrl_bank.h"
+#include <gtest/gtest.h>
+#include <cmath>
+
+using namespace daisy;
+
+namespace
+{
+// deterministic pseudo-random adc values
+uint16_t NextAdcValue(uint32_t& state)
+{
+    state = state * 1664525u + 1013904223u;
+    return uint16_t(state >> 16);
+}
+} // namespace
+
+TEST(hid_AnalogControlBank, a_fastExp)
+{
+    for(float x = -20.0f; x < 20.0f; x += 0.01f)
+    {
+        const float expected = expf(x);
+        EXPECT_NEAR(AnalogControlBank<1>::FastExp(x), expected, expected * 1e-5f)
+            << "x = " << x;
+    }
+}
+
+TEST(hid_AnalogControlBank, b_matchesAnalogControl)
+{
+    constexpr size_t kNumChannels = 6;
+    constexpr float  kSampleRate  = 1000.0f;
+    uint16_t         adc[kNumChannels] = {0};
+
+    AnalogControl                   ref[kNumChannels];
+    AnalogControlBank<kNumChannels> bank;
+    for(size_t i = 0; i < kNumChannels; i++)
+    {
+        const bool flip   = (i & 1) != 0;
+        const bool invert = (i & 2) != 0;
+        ref[i].Init(&adc[i], kSampleRate, flip, invert);
+        bank.Init(i, &adc[i], kSampleRate, flip, invert);
+    }
+    ref[4].InitBipolarCv(&adc[4], kSampleRate);
+    bank.InitBipolarCv(4, &adc[4], kSampleRate);
+    ref[5].SetScale(1.3f);
+    ref[5].SetOffset(0.1f);
+    bank.SetScale(5, 1.3f);
+    bank.SetOffset(5, 0.1f);
+
+    uint32_t rng = 1234;
+    for(int n = 0; n < 2000; n++)
+    {
+        for(size_t i = 0; i < kNumChannels; i++)
+            adc[i] = NextAdcValue(rng);
+        bank.Process();
+        for(size_t i = 0; i < kNumChannels; i++)
+        {
+            const float expected = ref[i].Process();
+            EXPECT_NEAR(bank.GetValues()[i], expected, 1e-5f);
+            EXPECT_FLOAT_EQ(bank.Value(i), bank.GetValues()[i]);
+        }
+    }
+}
+
+TEST(hid_AnalogControlBank, c_matchesParameterCurves)
+{
+    constexpr size_t kNumChannels = 4;
+    constexpr float  kSampleRate  = 1000.0f;
+    uint16_t         adc[kNumChannels] = {0};
+
+    const Parameter::Curve curves[kNumChannels] = {Parameter::LINEAR,
+                                                   Parameter::EXPONENTIAL,
+                                                   Parameter::LOGARITHMIC,
+                                                   Parameter::CUBE};
+    Parameter                       ref[kNumChannels];
+    AnalogControlBank<kNumChannels> bank;
+    for(size_t i = 0; i < kNumChannels; i++)
+    {
+        AnalogControl ctrl;
+        ctrl.Init(&adc[i], kSampleRate);
+        ref[i].Init(ctrl, 20.0f, 20000.0f, curves[i]);
+        bank.Init(i, &adc[i], kSampleRate);
+        bank.SetCurve(i, 20.0f, 20000.0f, curves[i]);
+    }
+
+    uint32_t rng = 5678;
+    for(int n = 0; n < 2000; n++)
+    {
+        for(size_t i = 0; i < kNumChannels; i++)
+            adc[i] = NextAdcValue(rng);
+        bank.Process();
+        for(size_t i = 0; i < kNumChannels; i++)
+        {
+            const float expected = ref[i].Process();
+            // the log curve amplifies the tiny differences in the filtered
+            // values in addition to the error of FastExp()
+            const float tolerance = (curves[i] == Parameter::LOGARITHMIC)
+                                        ? fabsf(expected) * 1e-4f
+                                        : 0.1f;
+            EXPECT_NEAR(bank.GetMappedValues()[i], expected, tolerance)
+                << "channel " << i;
+            EXPECT_FLOAT_EQ(bank.MappedValue(i), bank.GetMappedValues()[i]);
+        }
+    }
+}
+
+TEST(hid_AnalogControlBank, d_setSampleRateAndCoeff)
+{
+    uint16_t             adc = 0xffff;
+    AnalogControlBank<2> bank;
+    bank.Init(0, &adc, 1000.0f, false, false, 0.02f);
+    bank.Init(1, &adc, 1000.0f, false, false, 0.02f);
+
+    // no smoothing at all: the value jumps immediately
+    bank.SetCoeff(0, 1.0f);
+    bank.Process();
+    EXPECT_NEAR(bank.Value(0), 65535.0f / 65536.0f, 1e-6f);
+    EXPECT_LT(bank.Value(1), bank.Value(0));
+
+    // a higher sample rate results in slower smoothing per call
+    AnalogControl ref;
+    ref.Init(&adc, 1000.0f, false, false, 0.02f);
+    ref.SetSampleRate(4000.0f);
+    bank.Init(1, &adc, 1000.0f, false, false, 0.02f);
+    bank.SetSampleRate(4000.0f);
+    for(int i = 0; i < 10; i++)
+    {
+        bank.Process();
+        EXPECT_NEAR(bank.Value(1), ref.Process(), 1e-6f);
+    }
+
+    // out of range indices are ignored
+    bank.SetScale(2, 10.0f);
+    EXPECT_EQ(bank.GetNumChannels(), 2u);
+}
+
+TEST(hid_AnalogControlBank, e_initFromAnalogControl)
+{
+    // how the boards batch their controls
+    uint16_t      adc[3] = {0x1000, 0x8000, 0xf000};
+    AnalogControl controls[3];
+    controls[0].Init(&adc[0], 1000.0f, true, false, 0.01f);
+    controls[1].InitBipolarCv(&adc[1], 1000.0f);
+    controls[2].Init(&adc[2], 1000.0f);
+    controls[2].SetScale(0.5f);
+    controls[2].SetOffset(0.2f);
+    controls[2].Process();
+
+    AnalogControl ref[3];
+    for(size_t i = 0; i < 3; i++)
+        ref[i] = controls[i];
+
+    AnalogControlBank<4> bank;
+    for(size_t i = 0; i < 3; i++)
+        bank.Init(i, controls[i]);
+    // the current value is kept
+    EXPECT_FLOAT_EQ(bank.Value(2), controls[2].Value());
+
+    for(int n = 0; n < 100; n++)
+    {
+        adc[n % 3] += 997;
+        bank.Process();
+        bank.CopyValuesTo(controls, 3);
+        for(size_t i = 0; i < 3; i++)
+        {
+            const float expected = ref[i].Process();
+            EXPECT_NEAR(bank.Value(i), expected, 1e-5f);
+            EXPECT_FLOAT_EQ(controls[i].Value(), bank.Value(i));
+        }
+    }
+
+    // copies with an offset into the bank, out of range channels are skipped
+    bank.CopyValuesTo(controls, 3, 2);
+    EXPECT_FLOAT_EQ(controls[0].Value(), bank.Value(2));
+    EXPECT_FLOAT_EQ(controls[1].Value(), bank.Value(3));
+    EXPECT_FLOAT_EQ(controls[2].Value(), ref[2].Value());
+}
+
+TEST(hid_AnalogControlBank, f_boundControlsKeepSettings)
+{
+    uint16_t      adc[2] = {0x2000, 0xc000};
+    AnalogControl controls[2];
+    controls[0].Init(&adc[0], 1000.0f);
+    controls[1].InitBipolarCv(&adc[1], 1000.0f);
+    AnalogControlBank<2> bank;
+    for(size_t i = 0; i < 2; i++)
+        bank.Bind(i, controls[i]);
+
+    // settings changed on the controls apply to the bank right away
+    controls[0].SetScale(0.5f);
+    controls[0].SetOffset(0.1f);
+    controls[0].SetSampleRate(2000.0f);
+    controls[1].SetCoeff(0.25f);
+    AnalogControl ref[2];
+    for(size_t i = 0; i < 2; i++)
+        ref[i] = controls[i];
+    for(int n = 0; n < 50; n++)
+    {
+        adc[n % 2] += 1231;
+        bank.Process();
+        bank.CopyValuesTo(controls, 2);
+        for(size_t i = 0; i < 2; i++)
+            EXPECT_NEAR(bank.Value(i), ref[i].Process(), 1e-5f) << i;
+    }
+
+    // so does initializing the control again
+    controls[1].Init(&adc[1], 1000.0f, true);
+    EXPECT_EQ(bank.Value(1), 0.0f);
+    ref[1] = controls[1];
+    bank.Process();
+    EXPECT_NEAR(bank.Value(0), ref[0].Process(), 1e-5f);
+    EXPECT_NEAR(bank.Value(1), ref[1].Process(), 1e-5f);
+
+    // copies, e.g. the one in a Parameter, aren't bound
+    AnalogControl copy = controls[0];
+    copy.SetScale(4.0f);
+    bank.Process();
+    EXPECT_NEAR(bank.Value(0), ref[0].Process(), 1e-5f);
+}
@@ -0,0 +1,175 @@
+#include "hid/ctrl.h"
+#include <gtest/gtest.h>
+#include <cmath>
+#include <vector>
+
+using namespace daisy;
+
+namespace
+{
+constexpr size_t kBlockSize = 48;
+constexpr float  kBlockRate = 48000.0f / kBlockSize;
+
+float MaxStep(const std::vector<float>& values, float prev)
+{
+    float maxStep = 0.0f;
+    for(float v : values)
+    {
+        maxStep = std::fmax(maxStep, std::fabs(v - prev));
+        prev    = v;
+    }
+    return maxStep;
+}
+} // namespace
+
+TEST(hid_AnalogControl, a_processBlockLinearMatchesProcess)
+{
+    uint16_t      adc = 0;
+    AnalogControl ref, ctrl;
+    ref.Init(&adc, kBlockRate, false, false, 0.02f);
+    ctrl.Init(&adc, kBlockRate, false, false, 0.02f);
+
+    std::vector<float> block(kBlockSize);
+    const uint16_t     values[] = {0, 40000, 40000, 1000, 65535, 20000, 20000};
+    for(uint16_t value : values)
+    {
+        adc              = value;
+        const float prev = ctrl.Value();
+        ctrl.ProcessBlock(block.data(), kBlockSize);
+        const float expected = ref.Process();
+
+        // the block ends exactly at the value that Process() returns...
+        EXPECT_FLOAT_EQ(block.back(), expected);
+        EXPECT_FLOAT_EQ(ctrl.Value(), expected);
+        // ... and is a straight line from the previous value
+        for(size_t i = 0; i < kBlockSize; i++)
+        {
+            const float x = float(i + 1) / kBlockSize;
+            EXPECT_NEAR(block[i], prev + x * (expected - prev), 1e-5f);
+        }
+    }
+}
+
+TEST(hid_AnalogControl, b_processBlockLinearWithHistory)
+{
+    uint16_t      adc = 0;
+    AnalogControl ctrl;
+    ctrl.Init(&adc, kBlockRate, false, false, 0.0001f); // no smoothing
+
+    // a ramp sampled at 4 points in the block is reproduced exactly
+    const uint16_t     history[4] = {8192, 16384, 24576, 32768};
+    std::vector<float> block(kBlockSize);
+    ctrl.ProcessBlock(block.data(), kBlockSize, history, 4);
+    for(size_t i = 0; i < kBlockSize; i++)
+    {
+        const float expected = 0.5f * float(i + 1) / kBlockSize;
+        EXPECT_NEAR(block[i], expected, 1e-5f);
+    }
+
+    // the history is held at its last value, the latest reading is ignored
+    adc = 65535;
+    const uint16_t constant[3] = {32768, 32768, 32768};
+    ctrl.ProcessBlock(block.data(), kBlockSize, constant, 3);
+    for(float v : block)
+        EXPECT_FLOAT_EQ(v, 0.5f);
+
+    // more readings than samples are truncated
+    std::vector<float> shortBlock(2);
+    ctrl.ProcessBlock(shortBlock.data(), 2, history, 4);
+    EXPECT_NEAR(shortBlock[0], 0.125f, 1e-5f);
+    EXPECT_NEAR(shortBlock[1], 0.25f, 1e-5f);
+}
+
+TEST(hid_AnalogControl, c_processBlockLinearSlewsLikeProcess)
+{
+    // with oversampled readings the one-pole filter converges at the same
+    // speed as when processing only one reading per block
+    uint16_t      adc = 65535;
+    AnalogControl ref, ctrl;
+    ref.Init(&adc, kBlockRate, false, false, 0.05f);
+    ctrl.Init(&adc, kBlockRate, false, false, 0.05f);
+
+    const uint16_t     history[8] = {65535, 65535, 65535, 65535,
+                                     65535, 65535, 65535, 65535};
+    std::vector<float> block(kBlockSize);
+    for(int n = 0; n < 20; n++)
+    {
+        ctrl.ProcessBlock(block.data(), kBlockSize, history, 8);
+        EXPECT_NEAR(block.back(), ref.Process(), 1e-4f);
+    }
+}
+
+TEST(hid_AnalogControl, d_processBlockTwoPoleIsSmooth)
+{
+    uint16_t      adc = 0;
+    AnalogControl ctrl;
+    ctrl.Init(&adc, kBlockRate);
+    ctrl.SetInterpolation(AnalogControl::Interpolation::TWO_POLE);
+
+    std::vector<float> block(kBlockSize);
+    ctrl.ProcessBlock(block.data(), kBlockSize);
+    for(float v : block)
+        EXPECT_FLOAT_EQ(v, 0.0f);
+
+    // a full scale step at the ADC...
+    adc           = 65535;
+    float prev    = 0.0f;
+    float maxStep = 0.0f;
+    for(int n = 0; n < 20; n++)
+    {
+        ctrl.ProcessBlock(block.data(), kBlockSize);
+        maxStep = std::fmax(maxStep, MaxStep(block, prev));
+        prev    = block.back();
+
+        // no overshoot
+        for(float v : block)
+            EXPECT_LE(v, 1.0f);
+    }
+    // ... is spread across many samples, ...
+    EXPECT_LT(maxStep, 0.05f);
+    // ... settles at the target ...
+    EXPECT_NEAR(ctrl.Value(), 65535.0f / 65536.0f, 1e-4f);
+
+    // ... and starts with zero slope (no corner at the block boundary)
+    adc = 0;
+    ctrl.ProcessBlock(block.data(), kBlockSize);
+    EXPECT_LT(std::fabs(block[0] - prev), std::fabs(block[10] - block[9]));
+}
+
+TEST(hid_AnalogControl, e_processBlockTwoPoleTracksHistory)
+{
+    // a slow sine sampled at 8 readings per block is followed closely
+    uint16_t      adc = 0;
+    AnalogControl ctrl;
+    ctrl.InitBipolarCv(&adc, kBlockRate);
+    ctrl.SetInterpolation(AnalogControl::Interpolation::TWO_POLE);
+
+    constexpr size_t   kNumReadings = 8;
+    constexpr float    kFreq        = 5.0f; // Hz
+    const float        kPi          = 3.14159265f;
+    std::vector<float> block(kBlockSize);
+    size_t             sample = 0;
+    float              maxErr = 0.0f;
+    for(int n = 0; n < 100; n++)
+    {
+        uint16_t history[kNumReadings];
+        for(size_t k = 0; k < kNumReadings; k++)
+        {
+            const float t = float(sample + (k + 1) * kBlockSize / kNumReadings)
+                            / 48000.0f;
+            // bipolar CV is inverted
+            const float v = -0.9f * std::sin(2.0f * kPi * kFreq * t);
+            history[k]    = uint16_t((v * 0.5f + 0.5f) * 65535.0f);
+        }
+        ctrl.ProcessBlock(block.data(), kBlockSize, history, kNumReadings);
+        for(size_t i = 0; i < kBlockSize; i++, sample++)
+        {
+            const float t        = float(sample) / 48000.0f;
+            const float expected = 0.9f * std::sin(2.0f * kPi * kFreq * t);
+            if(n > 10)
+                maxErr = std::fmax(maxErr, std::fabs(block[i] - expected));
+        }
+    }
+    // the remaining error is mostly the group delay of the filters
+    EXPECT_LT(maxErr, 0.05f);
+}
@@ -0,0 +1,255 @@
+#include "util/BusScheduler.h"
+#include <gtest/gtest.h>
+#include <vector>
+
+using namespace daisy;
+
+namespace
+{
+/** A bus that records transfers. Transfers are finished by the test. */
+class MockBus
+{
+  public:
+    using Callback = void (*)(void* context, bool success);
+
+    struct Transfer
+    {
+        uint16_t device;
+        size_t   txSize;
+        size_t   rxSize;
+    };
+
+    bool Start(uint16_t device,
+               uint8_t* tx,
+               size_t   txSize,
+               uint8_t* rx,
+               size_t   rxSize,
+               Callback callback,
+               void*    context)
+    {
+        EXPECT_FALSE(busy) << "started a transfer while the bus was busy";
+        (void)tx;
+        if(rx != nullptr)
+            for(size_t i = 0; i < rxSize; i++)
+                rx[i] = uint8_t(device + i);
+        started.push_back({device, txSize, rxSize});
+        if(failNextStart)
+        {
+            failNextStart = false;
+            return false;
+        }
+        busy      = true;
+        callback_ = callback;
+        context_  = context;
+        if(finishImmediately)
+            Finish(true);
+        return true;
+    }
+
+    /** Finishes the current transfer, like the DMA interrupt would */
+    void Finish(bool success = true)
+    {
+        ASSERT_TRUE(busy);
+        busy = false;
+        callback_(context_, success);
+    }
+
+    std::vector<Transfer> started;
+    bool                  busy              = false;
+    bool                  failNextStart     = false;
+    bool                  finishImmediately = false;
+
+  private:
+    Callback callback_;
+    void*    context_;
+};
+
+using Scheduler   = BusScheduler<MockBus, 8, 4>;
+using Transaction = Scheduler::Transaction;
+using Priority    = Scheduler::Priority;
+
+Transaction MakeTransaction(uint16_t device,
+                            Priority priority = Priority::NORMAL)
+{
+    Transaction t;
+    t.device   = device;
+    t.txSize   = 1;
+    t.priority = priority;
+    return t;
+}
+
+/** Records the completion callbacks */
+struct Completions
+{
+    std::vector<std::pair<int, bool>> calls;
+    int                               id = 0;
+
+    static void Callback(void* context, bool success)
+    {
+        auto c = static_cast<Completions*>(context);
+        c->calls.push_back({c->id, success});
+    }
+};
+} // namespace
+
+TEST(util_BusScheduler, a_transactionsRunBackToBack)
+{
+    MockBus   bus;
+    Scheduler scheduler;
+    scheduler.Init(bus);
+    EXPECT_FALSE(scheduler.IsBusy());
+
+    uint8_t     reg = 0x10, data[2];
+    Completions done;
+    Transaction t = MakeTransaction(0x5A);
+    t.tx          = &reg;
+    t.rx          = data;
+    t.rxSize      = 2;
+    t.callback    = &Completions::Callback;
+    t.context     = &done;
+
+    // the first one starts right away
+    EXPECT_TRUE(scheduler.Submit(t));
+    ASSERT_EQ(bus.started.size(), 1u);
+    EXPECT_EQ(bus.started[0].device, 0x5A);
+    EXPECT_EQ(bus.started[0].rxSize, 2u);
+
+    // the others wait for the bus
+    EXPECT_TRUE(scheduler.Submit(MakeTransaction(1)));
+    EXPECT_TRUE(scheduler.Submit(MakeTransaction(2)));
+    EXPECT_EQ(bus.started.size(), 1u);
+    EXPECT_TRUE(scheduler.IsBusy());
+
+    // ... and are started from the completion interrupt
+    bus.Finish();
+    ASSERT_EQ(done.calls.size(), 1u);
+    EXPECT_TRUE(done.calls[0].second);
+    EXPECT_EQ(data[0], 0x5A);
+    EXPECT_EQ(data[1], 0x5B);
+    ASSERT_EQ(bus.started.size(), 2u);
+    EXPECT_EQ(bus.started[1].device, 1);
+    bus.Finish();
+    ASSERT_EQ(bus.started.size(), 3u);
+    EXPECT_EQ(bus.started[2].device, 2);
+    bus.Finish();
+    EXPECT_FALSE(scheduler.IsBusy());
+    EXPECT_EQ(scheduler.GetNumErrors(), 0u);
+}
+
+TEST(util_BusScheduler, b_priorities)
+{
+    MockBus   bus;
+    Scheduler scheduler;
+    scheduler.Init(bus);
+
+    scheduler.Submit(MakeTransaction(0, Priority::LOW)); // starts
+    scheduler.Submit(MakeTransaction(1, Priority::LOW));
+    scheduler.Submit(MakeTransaction(2, Priority::NORMAL));
+    scheduler.Submit(MakeTransaction(3, Priority::HIGH));
+    scheduler.Submit(MakeTransaction(4, Priority::NORMAL));
+    scheduler.Submit(MakeTransaction(5, Priority::HIGH));
+    while(bus.busy)
+        bus.Finish();
+
+    const std::vector<uint16_t> expected = {0, 3, 5, 2, 4, 1};
+    ASSERT_EQ(bus.started.size(), expected.size());
+    for(size_t i = 0; i < expected.size(); i++)
+        EXPECT_EQ(bus.started[i].device, expected[i]) << i;
+}
+
+TEST(util_BusScheduler, c_errorsAndFullQueue)
+{
+    MockBus   bus;
+    Scheduler scheduler;
+    scheduler.Init(bus);
+
+    Completions failed, ok;
+    Transaction a = MakeTransaction(1);
+    a.callback    = &Completions::Callback;
+    a.context     = &failed;
+    Transaction b = MakeTransaction(2);
+    b.callback    = &Completions::Callback;
+    b.context     = &ok;
+
+    // a transfer that can't be started fails and the next one is started
+    scheduler.Submit(MakeTransaction(0));
+    scheduler.Submit(a);
+    scheduler.Submit(b);
+    bus.failNextStart = true;
+    bus.Finish();
+    ASSERT_EQ(failed.calls.size(), 1u);
+    EXPECT_FALSE(failed.calls[0].second);
+    EXPECT_EQ(bus.started.back().device, 2);
+    bus.Finish(false);
+    ASSERT_EQ(ok.calls.size(), 1u);
+    EXPECT_FALSE(ok.calls[0].second);
+    EXPECT_EQ(scheduler.GetNumErrors(), 2u);
+
+    // 8 slots, one of them in flight
+    for(int i = 0; i < 8; i++)
+        EXPECT_TRUE(scheduler.Submit(MakeTransaction(i)));
+    EXPECT_FALSE(scheduler.Submit(MakeTransaction(8)));
+    bus.Finish();
+    EXPECT_TRUE(scheduler.Submit(MakeTransaction(8)));
+
+    // buses that finish synchronously work as well
+    bus.finishImmediately = true;
+    bus.Finish();
+    EXPECT_FALSE(scheduler.IsBusy());
+    EXPECT_EQ(bus.started.back().device, 8);
+}
+
+TEST(util_BusScheduler, d_periodicTransactions)
+{
+    MockBus   bus;
+    Scheduler scheduler;
+    System::SetUsForUnitTest(0);
+    scheduler.Init(bus);
+
+    // the expander is read every 1ms, the LEDs are written every 16ms
+    const int expander = scheduler.AddPeriodic(MakeTransaction(1), 1000);
+    const int leds
+        = scheduler.AddPeriodic(MakeTransaction(2, Priority::LOW), 16000);
+    ASSERT_GE(expander, 0);
+    ASSERT_GE(leds, 0);
+
+    size_t numExpander = 0, numLeds = 0;
+    for(uint32_t us = 0; us < 64000; us += 100)
+    {
+        System::SetUsForUnitTest(us);
+        scheduler.Process();
+        while(bus.busy)
+        {
+            if(bus.started.back().device == 1)
+                numExpander++;
+            else
+                numLeds++;
+            bus.Finish();
+        }
+    }
+    EXPECT_EQ(numExpander, 64u);
+    EXPECT_EQ(numLeds, 4u);
+    EXPECT_EQ(scheduler.GetNumSkipped(expander), 0u);
+
+    // if the bus is too slow, periodic transactions are skipped instead of
+    // filling up the queue
+    System::SetUsForUnitTest(64000);
+    scheduler.Process();
+    ASSERT_TRUE(bus.busy);
+    for(uint32_t us = 64000; us < 70000; us += 100)
+    {
+        System::SetUsForUnitTest(us);
+        scheduler.Process();
+    }
+    EXPECT_EQ(scheduler.GetNumSkipped(expander), 5u);
+
+    // removed transactions aren't submitted any more
+    scheduler.RemovePeriodic(expander);
+    scheduler.RemovePeriodic(leds);
+    while(bus.busy)
+        bus.Finish();
+    const size_t numStarted = bus.started.size();
+    System::SetUsForUnitTest(100000);
+    scheduler.Process();
+    EXPECT_EQ(bus.started.size(), numStarted);
+}
@@ -0,0 +1,310 @@
+#include "util/DacStream.h"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <vector>
+
+using namespace daisy;
+
+namespace
+{
+using Stream = DacStream<2, 256>;
+
+/** Calls Process() and returns the codes of both channels */
+struct Output
+{
+    std::vector<uint16_t> ch[2];
+
+    void Process(Stream& stream, size_t size)
+    {
+        std::vector<uint16_t> a(size), b(size);
+        uint16_t*             out[2] = {a.data(), b.data()};
+        stream.Process(out, size);
+        ch[0].insert(ch[0].end(), a.begin(), a.end());
+        ch[1].insert(ch[1].end(), b.begin(), b.end());
+    }
+};
+} // namespace
+
+TEST(util_DacStream, a_calibration)
+{
+    // defaults: 0-5V on 12 bits, rounded and clamped
+    DacCalibration cal;
+    EXPECT_EQ(cal.ToCode(0.0f), 0);
+    EXPECT_EQ(cal.ToCode(1.0f), 819);
+    EXPECT_EQ(cal.ToCode(2.5f), 2048); // 2047.5 rounds up
+    EXPECT_EQ(cal.ToCode(-1.0f), 0);
+    EXPECT_EQ(cal.ToCode(6.0f), 4095);
+
+    // an output that measures 0.05V at code 0 and 4.9V at code 4000
+    const auto measured
+        = DacCalibration::FromMeasurements(0, 0.05f, 4000, 4.9f);
+    EXPECT_NEAR(measured.scale, 4000.0f / 4.85f, 1e-3f);
+    EXPECT_NEAR(measured.offset, -0.05f * 4000.0f / 4.85f, 1e-3f);
+    EXPECT_EQ(measured.ToCode(0.05f), 0);
+    EXPECT_EQ(measured.ToCode(4.9f), 4000);
+    EXPECT_EQ(measured.ToCode(2.475f), 2000);
+
+    // 8 bit DACs
+    const auto small
+        = DacCalibration::FromMeasurements(0, 0.0f, 255, 3.3f, 255);
+    EXPECT_EQ(small.ToCode(3.3f), 255);
+    EXPECT_EQ(small.ToCode(10.0f), 255);
+    EXPECT_EQ(small.ToCode(1.65f), 128);
+
+    // identical measurements are ignored
+    const auto invalid
+        = DacCalibration::FromMeasurements(10, 1.0f, 20, 1.0f);
+    EXPECT_EQ(invalid.scale, DacCalibration().scale);
+}
+
+TEST(util_DacStream, b_inputScaleIsFusedWithCalibration)
+{
+    Stream stream;
+    // bipolar -1..1 input on a 0-5V output
+    stream.SetInputScale(0, 2.5f, 2.5f);
+    EXPECT_EQ(stream.ToCode(0, -1.0f), 0);
+    EXPECT_EQ(stream.ToCode(0, 0.0f), 2048);
+    EXPECT_EQ(stream.ToCode(0, 1.0f), 4095);
+
+    DacCalibration cal;
+    cal.scale  = 800.0f;
+    cal.offset = 12.0f;
+    stream.SetCalibration(0, cal);
+    for(float x = -1.0f; x <= 1.0f; x += 0.125f)
+        EXPECT_EQ(stream.ToCode(0, x), cal.ToCode(x * 2.5f + 2.5f)) << x;
+
+    // channel 1 is unaffected
+    EXPECT_EQ(stream.ToCode(1, 1.0f), 819);
+}
+
+TEST(util_DacStream, c_heldValues)
+{
+    Stream stream;
+    stream.SetValue(0, 1.0f);
+    stream.SetValue(1, 2.0f);
+    Output out;
+    out.Process(stream, 24);
+    for(size_t i = 0; i < 24; i++)
+    {
+        EXPECT_EQ(out.ch[0][i], 819);
+        EXPECT_EQ(out.ch[1][i], 1638);
+    }
+    EXPECT_EQ(stream.GetNumUnderruns(0), 0u);
+}
+
+TEST(util_DacStream, d_streamWithConstantLatency)
+{
+    Stream stream;
+    stream.Init(48);
+    Output out;
+
+    // The audio callback writes blocks of 48 ramp values, the DAC reads
+    // blocks of 24 at the same rate.
+    std::vector<float> block(48);
+    int                n = 0;
+    for(int b = 0; b < 100; b++)
+    {
+        for(auto& v : block)
+            v = float(n++ % 4000) / 819.0f;
+        ASSERT_TRUE(stream.Write(0, block.data(), block.size()));
+        stream.WriteRamp(1, 1.0f, 48);
+        out.Process(stream, 24);
+        out.Process(stream, 24);
+    }
+
+    // the output starts after the latency and then follows the input
+    // sample by sample
+    size_t start = 0;
+    while(start < out.ch[0].size() && out.ch[0][start] == 0)
+        start++;
+    EXPECT_EQ(start, 48u + 1u); // value 0 is part of the stream
+    for(size_t i = start; i < out.ch[0].size(); i++)
+        ASSERT_EQ(out.ch[0][i], (i - start + 1) % 4000) << i;
+    EXPECT_EQ(stream.GetNumUnderruns(0), 0u);
+    EXPECT_EQ(stream.GetNumOverruns(0), 0u);
+    EXPECT_EQ(stream.GetNumDriftCorrections(0), 0u);
+
+    // the ramp reaches its target and stays there
+    EXPECT_EQ(out.ch[1].back(), 819);
+}
+
+TEST(util_DacStream, e_controlRateRamps)
+{
+    Stream stream;
+    stream.Init(0);
+    stream.SetValue(0, 0.0f);
+
+    // one value per block of 8 samples
+    stream.WriteRamp(0, 1.0f, 8);
+    stream.WriteRamp(0, 0.5f, 8);
+    Output out;
+    out.Process(stream, 16);
+    for(size_t i = 0; i < 8; i++)
+    {
+        EXPECT_EQ(out.ch[0][i], DacCalibration().ToCode((i + 1) / 8.0f));
+        EXPECT_EQ(out.ch[0][8 + i],
+                  DacCalibration().ToCode(1.0f - 0.5f * (i + 1) / 8.0f));
+    }
+}
+
+TEST(util_DacStream, f_underrunsAndOverruns)
+{
+    Stream stream;
+    stream.Init(8);
+    std::vector<float> block(16, 1.0f);
+    stream.Write(0, block.data(), 16);
+    Output out;
+    out.Process(stream, 8); // starts, 8 left
+    out.Process(stream, 16);
+    EXPECT_EQ(stream.GetNumUnderruns(0), 1u);
+    // the last value is held
+    for(size_t i = 8; i < 24; i++)
+        EXPECT_EQ(out.ch[0][i], 819);
+
+    // after an underrun the latency is queued again before the output
+    // continues
+    block.assign(8, 2.0f);
+    stream.Write(0, block.data(), 8);
+    out.Process(stream, 4);
+    EXPECT_EQ(out.ch[0].back(), 819);
+    stream.Write(0, block.data(), 8);
+    out.Process(stream, 4);
+    EXPECT_EQ(out.ch[0].back(), 1638);
+
+    // writing more than fits into the queue drops the excess
+    std::vector<float> big(300, 3.0f);
+    EXPECT_FALSE(stream.Write(0, big.data(), big.size()));
+    EXPECT_EQ(stream.GetNumOverruns(0), 1u);
+    EXPECT_EQ(stream.GetQueuedSamples(0), 256u);
+
+    // SetValue() discards the queue
+    stream.SetValue(0, 4.0f);
+    out.Process(stream, 4);
+    EXPECT_EQ(out.ch[0].back(), 3276);
+    EXPECT_EQ(stream.GetQueuedSamples(0), 0u);
+}
+
+TEST(util_DacStream, g_clockDrift)
+{
+    // The DAC runs 0.5% faster or slower than the audio. The stream must
+    // keep its latency without underruns by repeating or dropping samples.
+    for(const double ratio : {1.005, 0.995})
+    {
+        Stream stream;
+        stream.Init(48);
+        Output             out;
+        std::vector<float> block(48);
+        double             audioTime = 0.0, dacTime = 0.0;
+        int                n = 0;
+        size_t             maxQueued = 0;
+        while(audioTime < 48000.0)
+        {
+            if(audioTime <= dacTime)
+            {
+                for(auto& v : block)
+                    v = float(n++ % 4000) / 819.0f;
+                stream.Write(0, block.data(), block.size());
+                audioTime += 48.0;
+            }
+            else
+            {
+                out.Process(stream, 24);
+                dacTime += 24.0 * ratio;
+                if(dacTime > 4800.0)
+                    maxQueued
+                        = std::max(maxQueued, stream.GetQueuedSamples(0));
+            }
+        }
+        EXPECT_EQ(stream.GetNumUnderruns(0), 0u) << ratio;
+        EXPECT_EQ(stream.GetNumOverruns(0), 0u) << ratio;
+        // about 240 samples of drift, corrected one sample at a time
+        EXPECT_NEAR(stream.GetNumDriftCorrections(0), 240.0, 30.0) << ratio;
+        EXPECT_LT(maxQueued, 48u + 48u + 8u) << ratio;
+
+        // apart from single repeated or dropped samples, the ramp goes on
+        size_t start = 0;
+        while(out.ch[0][start] == 0)
+            start++;
+        for(size_t i = start + 1; i < out.ch[0].size(); i++)
+        {
+            const int step = (int(out.ch[0][i]) - int(out.ch[0][i - 1]) + 4000)
+                             % 4000;
+            ASSERT_TRUE(step <= 2) << i;
+        }
+    }
+}
+
+TEST(util_DacStream, h_floatCallback)
+{
+    Stream stream;
+    stream.SetInputScale(0, 5.0f); // 0..1 to 0..5V
+    stream.SetInputScale(1, 5.0f);
+
+    struct Lfo
+    {
+        float  phase = 0.0f;
+        size_t calls = 0;
+        static void Callback(float** out, size_t size, void* context)
+        {
+            auto* lfo = static_cast<Lfo*>(context);
+            lfo->calls++;
+            for(size_t i = 0; i < size; i++)
+            {
+                out[0][i] = lfo->phase;
+                out[1][i] = 1.0f - lfo->phase;
+                lfo->phase += 1.0f / 64.0f;
+            }
+        }
+    } lfo;
+    stream.SetCallback(&Lfo::Callback, &lfo);
+
+    Output out;
+    out.Process(stream, 48);
+    EXPECT_EQ(lfo.calls, 2u); // in chunks of up to 32 samples
+    for(size_t i = 0; i < 48; i++)
+    {
+        EXPECT_EQ(out.ch[0][i], DacCalibration().ToCode(5.0f * i / 64.0f));
+        EXPECT_EQ(out.ch[1][i],
+                  DacCalibration().ToCode(5.0f * (1.0f - i / 64.0f)));
+    }
+
+    // queued values are ignored while the callback is installed
+    std::vector<float> block(48, 0.0f);
+    stream.Write(0, block.data(), block.size());
+    out.Process(stream, 8);
+    EXPECT_EQ(out.ch[0].back(), DacCalibration().ToCode(5.0f * 55 / 64.0f));
+}
+
+TEST(util_DacStream, i_restart)
+{
+    // e.g. the DAC was restarted at another rate with a larger latency
+    Stream stream;
+    stream.Init(48);
+    Output             out;
+    std::vector<float> block(48);
+    int                n = 0;
+    auto               run = [&](int numBlocks) {
+        for(int b = 0; b < numBlocks; b++)
+        {
+            for(auto& v : block)
+                v = float(n++ % 4000) / 819.0f;
+            ASSERT_TRUE(stream.Write(0, block.data(), block.size()));
+            out.Process(stream, 48);
+        }
+    };
+    run(100);
+    const size_t before = out.ch[0].size();
+    const auto   last   = out.ch[0].back();
+
+    stream.SetLatency(96);
+    stream.Restart();
+    run(100);
+
+    // the last value is held until the new latency is queued, then the
+    // stream continues without a gap
+    for(size_t i = before; i < before + 48; i++)
+        ASSERT_EQ(out.ch[0][i], last) << i;
+    for(size_t i = before + 48; i < out.ch[0].size(); i++)
+        ASSERT_EQ(out.ch[0][i], (last + i - before - 47) % 4000) << i;
+    EXPECT_EQ(stream.GetNumDriftCorrections(0), 0u);
+}
@@ -0,0 +1,183 @@
+#include "dev/dotstar.h"
+#include <gtest/gtest.h>
+#include <vector>
+
+using namespace daisy;
+
+namespace
+{
+/** All frames written by a MockTransport */
+struct Recording
+{
+    std::vector<uint8_t*>              pointers;
+    std::vector<std::vector<uint8_t>> frames;
+    bool                               fail = false;
+};
+
+class MockTransport
+{
+  public:
+    struct Config
+    {
+        Recording* recording;
+        bool       use_dma;
+        void       Defaults()
+        {
+            recording = nullptr;
+            use_dma   = false;
+        }
+    };
+
+    void Init(Config& config)
+    {
+        recording_ = config.recording;
+        use_dma_   = config.use_dma;
+    }
+
+    bool UsesDma() const { return use_dma_; }
+
+    bool Write(uint8_t* data, size_t size)
+    {
+        recording_->pointers.push_back(data);
+        recording_->frames.emplace_back(data, data + size);
+        return !recording_->fail;
+    }
+
+  private:
+    Recording* recording_;
+    bool       use_dma_;
+};
+
+template <size_t maxNumPixels>
+using TestDotStar = DotStar<MockTransport, maxNumPixels>;
+} // namespace
+
+TEST(dev_DotStar, a_frameLayout)
+{
+    Recording               transport;
+    TestDotStar<64>         dotstar;
+    TestDotStar<64>::Config config;
+    config.Defaults();
+    config.transport_config.recording = &transport;
+    config.color_order                = TestDotStar<64>::Config::GRB;
+    config.num_pixels                 = 3;
+    ASSERT_EQ(dotstar.Init(config), TestDotStar<64>::Result::OK);
+
+    dotstar.SetPixelColor(0, 0x10, 0x20, 0x30);
+    dotstar.SetPixelColor(2, 0xAABBCC);
+    dotstar.SetPixelGlobalBrightness(2, 40); // clamped to 31
+    ASSERT_EQ(dotstar.Show(), TestDotStar<64>::Result::OK);
+
+    // the whole frame is sent with a single write
+    ASSERT_EQ(transport.frames.size(), 1u);
+    const std::vector<uint8_t> expected = {
+        0x00, 0x00, 0x00, 0x00, // start frame
+        0xE1, 0x20, 0x10, 0x30, // brightness, G, R, B
+        0xE1, 0x00, 0x00, 0x00, //
+        0xFF, 0xBB, 0xAA, 0xCC, //
+        0xFF, 0xFF, 0xFF, 0xFF, // end frame
+    };
+    EXPECT_EQ(transport.frames[0], expected);
+    EXPECT_EQ(TestDotStar<64>::GetFrameSize(3), expected.size());
+}
+
+TEST(dev_DotStar, b_endFrameForLongChains)
+{
+    // one extra clock edge per two pixels
+    EXPECT_EQ(TestDotStar<64>::GetEndFrameSize(1), 4u);
+    EXPECT_EQ(TestDotStar<64>::GetEndFrameSize(64), 4u);
+    EXPECT_EQ(TestDotStar<64>::GetEndFrameSize(65), 5u);
+    EXPECT_EQ(TestDotStar<64>::GetEndFrameSize(200), 13u);
+    EXPECT_EQ(sizeof(TestDotStar<200>::FrameBuffer), 4u + 800u + 13u);
+
+    Recording                transport;
+    TestDotStar<200>         dotstar;
+    TestDotStar<200>::Config config;
+    config.Defaults();
+    config.transport_config.recording = &transport;
+    config.num_pixels                 = 200;
+    ASSERT_EQ(dotstar.Init(config), TestDotStar<200>::Result::OK);
+    dotstar.Fill(0x123456);
+    dotstar.Show();
+
+    const auto& frame = transport.frames.back();
+    ASSERT_EQ(frame.size(), 4u + 800u + 13u);
+    for(size_t i = 0; i < 4; i++)
+        EXPECT_EQ(frame[i], 0x00);
+    for(size_t p = 0; p < 200; p++)
+    {
+        EXPECT_EQ(frame[4 + 4 * p + 0], 0xE1);
+        EXPECT_EQ(frame[4 + 4 * p + 1], 0x12);
+        EXPECT_EQ(frame[4 + 4 * p + 2], 0x34);
+        EXPECT_EQ(frame[4 + 4 * p + 3], 0x56);
+    }
+    for(size_t i = 804; i < frame.size(); i++)
+        EXPECT_EQ(frame[i], 0xFF);
+}
+
+TEST(dev_DotStar, c_doubleBuffering)
+{
+    Recording                   transport;
+    TestDotStar<8>::FrameBuffer bufferA, bufferB;
+    TestDotStar<8>              dotstar;
+    TestDotStar<8>::Config      config;
+    config.Defaults();
+    config.transport_config.recording = &transport;
+    config.num_pixels                 = 2;
+    config.frame_buffer_a             = bufferA;
+    config.frame_buffer_b             = bufferB;
+    dotstar.Init(config);
+
+    dotstar.SetPixelColor(0, 0x0000FF);
+    dotstar.Show();
+    ASSERT_EQ(transport.pointers.back(), bufferA);
+    EXPECT_EQ(dotstar.GetFrame(), bufferB);
+
+    // drawing the next frame doesn't touch the one being sent
+    dotstar.SetPixelColor(1, 0xFF0000);
+    EXPECT_EQ(bufferA[4 + 4 + 1], 0x00);
+    // ... and starts with the pixels of the previous frame
+    EXPECT_EQ(dotstar.GetPixelColor(0), 0x00FF);
+    dotstar.Show();
+    ASSERT_EQ(transport.pointers.back(), bufferB);
+    EXPECT_EQ(bufferB[4 + 3], 0xFF);
+    EXPECT_EQ(bufferB[4 + 4 + 1], 0xFF);
+    EXPECT_EQ(transport.frames[1].size(), 16u);
+    EXPECT_EQ(transport.frames[1][15], 0xFF); // end frame in both buffers
+
+    dotstar.Show();
+    EXPECT_EQ(transport.pointers.back(), bufferA);
+    EXPECT_EQ(transport.frames[2], transport.frames[1]);
+}
+
+TEST(dev_DotStar, d_errors)
+{
+    Recording              transport;
+    TestDotStar<8>         dotstar;
+    TestDotStar<8>::Config config;
+    config.Defaults();
+    config.transport_config.recording = &transport;
+    config.num_pixels                 = 9;
+    EXPECT_EQ(dotstar.Init(config),
+              TestDotStar<8>::Result::ERR_INVALID_ARGUMENT);
+
+    config.num_pixels = 8;
+    ASSERT_EQ(dotstar.Init(config), TestDotStar<8>::Result::OK);
+    EXPECT_EQ(dotstar.SetPixelColor(8, 1, 2, 3),
+              TestDotStar<8>::Result::ERR_INVALID_ARGUMENT);
+    transport.fail = true;
+    EXPECT_EQ(dotstar.Show(), TestDotStar<8>::Result::ERR_TRANSPORT);
+
+    // DMA transports need D2 frame buffers, the internal ones won't do
+    TestDotStar<8>::FrameBuffer bufferA;
+    transport.fail                  = false;
+    config.transport_config.use_dma = true;
+    config.frame_buffer_a           = bufferA;
+    EXPECT_EQ(dotstar.Init(config),
+              TestDotStar<8>::Result::ERR_INVALID_ARGUMENT);
+    EXPECT_EQ(dotstar.SetPixelColor(0, 1, 2, 3),
+              TestDotStar<8>::Result::ERR_INVALID_ARGUMENT);
+    const size_t frames = transport.frames.size();
+    EXPECT_EQ(dotstar.Show(), TestDotStar<8>::Result::ERR_TRANSPORT);
+    EXPECT_EQ(transport.frames.size(), frames);
+}
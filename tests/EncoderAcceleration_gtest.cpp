@@ -0,0 +1,145 @@
+#include "util/EncoderAcceleration.h"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cmath>
+
+using namespace daisy;
+
+namespace
+{
+/** Polls an encoder turned at a given speed every millisecond, like
+ *  Encoder::Debounce() does. Returns the number of steps it was turned. */
+struct EncoderSimulation
+{
+    EncoderVelocityFilter filter;
+    uint32_t              nowUs    = 0;
+    double                position = 0.0;
+
+    EncoderSimulation() { filter.Init(1000000); }
+
+    int Run(float seconds, float (*speed)(float t))
+    {
+        int steps = 0;
+        for(int ms = 0; ms < int(seconds * 1000); ms++)
+        {
+            const double next = position + speed(ms / 1000.f) / 1000.0;
+            const int    inc  = int(std::floor(next) - std::floor(position));
+            position          = next;
+            nowUs += 1000;
+            filter.Update(inc, nowUs);
+            steps += inc;
+        }
+        return steps;
+    }
+};
+} // namespace
+
+TEST(util_EncoderVelocityFilter, a_followsSteadyTurns)
+{
+    EncoderSimulation sim;
+    EXPECT_EQ(sim.filter.GetVelocity(), 0.f);
+
+    // 20 steps per second, one step every 50 updates
+    sim.Run(0.5f, [](float) { return 20.f; });
+    EXPECT_NEAR(sim.filter.GetVelocity(), 20.f, 1.f);
+    EXPECT_NEAR(sim.filter.GetAcceleration(), 0.f, 5.f);
+
+    // slow turns don't flicker between steps
+    float minVelocity = 100.f, maxVelocity = 0.f;
+    for(int i = 0; i < 4; i++)
+    {
+        sim.Run(0.25f, [](float) { return 2.f; });
+        if(i > 0)
+        {
+            minVelocity = std::min(minVelocity, sim.filter.GetVelocity());
+            maxVelocity = std::max(maxVelocity, sim.filter.GetVelocity());
+        }
+    }
+    EXPECT_GT(minVelocity, 1.5f);
+    EXPECT_LT(maxVelocity, 2.5f);
+
+    // when the encoder stops, the velocity decays with the time since the
+    // last step
+    sim.Run(0.1f, [](float) { return 100.f; });
+    EXPECT_GT(sim.filter.GetVelocity(), 80.f);
+    sim.Run(0.2f, [](float) { return 0.f; });
+    EXPECT_LE(sim.filter.GetVelocity(), 5.f);
+    EXPECT_LT(sim.filter.GetAcceleration(), 0.f);
+    sim.Run(2.f, [](float) { return 0.f; });
+    EXPECT_LE(sim.filter.GetVelocity(), 0.5f);
+
+    // turning around starts over
+    sim.Run(0.05f, [](float) { return -40.f; });
+    EXPECT_LT(sim.filter.GetVelocity(), 0.f);
+    sim.filter.Reset();
+    EXPECT_EQ(sim.filter.GetVelocity(), 0.f);
+}
+
+TEST(util_EncoderVelocityFilter, b_measuresAcceleration)
+{
+    // speeding up from 10 to 90 steps per second within a second
+    EncoderSimulation sim;
+    sim.Run(0.5f, [](float) { return 10.f; });
+    sim.Run(1.f, [](float t) { return 10.f + 80.f * t; });
+    EXPECT_NEAR(sim.filter.GetVelocity(), 90.f, 10.f);
+    EXPECT_NEAR(sim.filter.GetAcceleration(), 80.f, 30.f);
+
+    // and slowing down again
+    sim.Run(0.5f, [](float t) { return 90.f - 80.f * t; });
+    EXPECT_LT(sim.filter.GetAcceleration(), -40.f);
+}
+
+TEST(util_EncoderAccelerationCurve, a_gainRisesWithSpeed)
+{
+    EncoderAccelerationCurve curve;
+    curve.Init(); // 1x up to 5 steps/s, full gain at 40 steps/s
+
+    EXPECT_FLOAT_EQ(curve.GetGain(0.f), 1.f);
+    EXPECT_FLOAT_EQ(curve.GetGain(-5.f), 1.f);
+    EXPECT_FLOAT_EQ(curve.GetGain(22.5f), 3.25f);
+    EXPECT_FLOAT_EQ(curve.GetGain(-22.5f), 3.25f);
+    EXPECT_FLOAT_EQ(curve.GetGain(40.f), 10.f);
+    EXPECT_FLOAT_EQ(curve.GetGain(1000.f), 10.f);
+    EXPECT_FLOAT_EQ(curve.GetGain(1000.f, true), 3.f);
+    EXPECT_FLOAT_EQ(curve.GetGain(22.5f, true), 1.5f);
+    for(float v = 5.f; v < 40.f; v += 1.f)
+    {
+        EXPECT_LT(curve.GetGain(v), curve.GetGain(v + 1.f));
+    }
+}
+
+TEST(util_EncoderAccelerationCurve, b_fractionsAreCarriedOver)
+{
+    EncoderAccelerationCurve curve;
+    curve.Init();
+
+    // slow turns pass every step
+    EXPECT_EQ(curve.Apply(1, 2.f), 1);
+    EXPECT_EQ(curve.Apply(-1, -2.f), -1);
+    EXPECT_EQ(curve.Apply(0, 100.f), 0);
+
+    // at a gain of 3.25, four steps become 13, no matter how they're grouped
+    int sum = 0;
+    for(int i = 0; i < 4; i++)
+    {
+        const int steps = curve.Apply(1, 22.5f);
+        EXPECT_GE(steps, 3);
+        sum += steps;
+    }
+    EXPECT_EQ(sum, 13);
+    EXPECT_EQ(curve.Apply(4, 22.5f), 13);
+
+    // turning around drops the fraction
+    EXPECT_EQ(curve.Apply(1, 22.5f), 3);
+    EXPECT_EQ(curve.Apply(-1, -22.5f), -3);
+    EXPECT_EQ(curve.Apply(-1, -22.5f), -3);
+    EXPECT_EQ(curve.Apply(-2, -22.5f), -7);
+
+    // custom curve
+    EncoderAccelerationCurve::Config config;
+    config.Defaults();
+    config.max_gain_coarse = 1.f;
+    curve.Init(config);
+    EXPECT_EQ(curve.Apply(5, 1000.f, true), 5);
+    EXPECT_EQ(curve.Apply(5, 1000.f, false), 50);
+}
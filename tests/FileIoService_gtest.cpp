@@ -0,0 +1,371 @@
+#include "util/FileIoService.h"
+#include <gtest/gtest.h>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace daisy;
+
+namespace
+{
+/** A FatFs-like file system on top of local memory, where each access
+ *  advances the system tick to simulate the latency of an SD card. */
+struct ShimFileSystem
+{
+    struct File
+    {
+        std::string          name;
+        std::vector<uint8_t> data;
+        size_t               position = 0;
+    };
+
+    int Read(File& file, void* dest, size_t size, size_t& bytesRead)
+    {
+        Access(file, size);
+        if(failNextAccess)
+            return failNextAccess = false, 1;
+        const size_t avail = file.data.size() - file.position;
+        bytesRead          = size < avail ? size : avail;
+        memcpy(dest, &file.data[file.position], bytesRead);
+        file.position += bytesRead;
+        return 0;
+    }
+
+    int Write(File& file, const void* src, size_t size, size_t& bytesWritten)
+    {
+        Access(file, size);
+        if(file.position + size > file.data.size())
+            file.data.resize(file.position + size);
+        memcpy(&file.data[file.position], src, size);
+        file.position += size;
+        bytesWritten = size;
+        return 0;
+    }
+
+    int Seek(File& file, uint32_t position)
+    {
+        Access(file, 0);
+        file.position = position;
+        return 0;
+    }
+
+    void Access(File& file, size_t size)
+    {
+        log.push_back(file.name);
+        System::SetTickForUnitTest(System::GetTick() + latencyPerAccess
+                                   + uint32_t(size) * latencyPerByte);
+    }
+
+    uint32_t                 latencyPerAccess = 0;
+    uint32_t                 latencyPerByte   = 0;
+    bool                     failNextAccess   = false;
+    std::vector<std::string> log;
+};
+
+using TestService = FileIoService<ShimFileSystem, 8>;
+using Priority    = TestService::Priority;
+
+struct Completion
+{
+    std::vector<TestService::Result> results;
+    std::vector<std::string>         order;
+
+    static void Callback(const TestService::Result& result, void* context)
+    {
+        auto* self = static_cast<Completion*>(context);
+        self->results.push_back(result);
+        self->order.push_back(result.file->name);
+    }
+};
+
+ShimFileSystem::File MakeFile(const std::string& name, size_t size)
+{
+    ShimFileSystem::File file;
+    file.name = name;
+    file.data.resize(size);
+    for(size_t i = 0; i < size; i++)
+        file.data[i] = uint8_t(i * 3);
+    return file;
+}
+
+void ProcessAll(TestService& service)
+{
+    while(service.Process(100)) {}
+}
+} // namespace
+
+TEST(util_FileIoService, a_readWriteAndSeek)
+{
+    ShimFileSystem fs;
+    TestService    service;
+    service.Init(fs, 16);
+    Completion done;
+
+    auto                 file = MakeFile("a", 100);
+    std::vector<uint8_t> dest(40);
+    EXPECT_TRUE(service.Seek(file, 10, Priority::BACKGROUND, nullptr));
+    EXPECT_TRUE(service.Read(file,
+                             dest.data(),
+                             dest.size(),
+                             Priority::BACKGROUND,
+                             &Completion::Callback,
+                             &done));
+    EXPECT_EQ(service.GetNumPendingRequests(), 2u);
+    // nothing happens until Process() is called
+    EXPECT_TRUE(fs.log.empty());
+
+    ProcessAll(service);
+    ASSERT_EQ(done.results.size(), 1u);
+    const auto& result = done.results[0];
+    EXPECT_EQ(result.type, TestService::RequestType::READ);
+    EXPECT_EQ(result.error, 0);
+    EXPECT_EQ(result.bytesTransferred, 40u);
+    EXPECT_EQ(result.buffer, dest.data());
+    EXPECT_EQ(result.file, &file);
+    for(size_t i = 0; i < dest.size(); i++)
+        EXPECT_EQ(dest[i], file.data[10 + i]);
+    // 1 seek + 3 chunks of 16 bytes max.
+    EXPECT_EQ(fs.log.size(), 4u);
+
+    const uint8_t src[4] = {1, 2, 3, 4};
+    EXPECT_TRUE(service.Write(file,
+                              src,
+                              sizeof(src),
+                              Priority::RECORDING,
+                              &Completion::Callback,
+                              &done));
+    ProcessAll(service);
+    ASSERT_EQ(done.results.size(), 2u);
+    EXPECT_EQ(done.results[1].bytesTransferred, 4u);
+    EXPECT_EQ(file.data[50], 1u);
+    EXPECT_EQ(file.data[53], 4u);
+    EXPECT_EQ(service.GetNumPendingRequests(), 0u);
+}
+
+TEST(util_FileIoService, b_shortReadsAndErrors)
+{
+    ShimFileSystem fs;
+    TestService    service;
+    service.Init(fs, 16);
+    Completion done;
+
+    auto                 file = MakeFile("a", 20);
+    std::vector<uint8_t> dest(64);
+    service.Read(file,
+                 dest.data(),
+                 dest.size(),
+                 Priority::STREAMING,
+                 &Completion::Callback,
+                 &done);
+    ProcessAll(service);
+    ASSERT_EQ(done.results.size(), 1u);
+    EXPECT_EQ(done.results[0].bytesTransferred, 20u);
+    EXPECT_EQ(done.results[0].error, 0);
+
+    fs.failNextAccess = true;
+    service.Read(file,
+                 dest.data(),
+                 dest.size(),
+                 Priority::STREAMING,
+                 &Completion::Callback,
+                 &done);
+    ProcessAll(service);
+    ASSERT_EQ(done.results.size(), 2u);
+    EXPECT_NE(done.results[1].error, 0);
+}
+
+TEST(util_FileIoService, c_queueFull)
+{
+    ShimFileSystem fs;
+    TestService    service;
+    service.Init(fs);
+    auto file = MakeFile("a", 10);
+    for(int i = 0; i < 8; i++)
+        EXPECT_TRUE(service.Seek(file, 0, Priority::BACKGROUND, nullptr));
+    EXPECT_FALSE(service.Seek(file, 0, Priority::BACKGROUND, nullptr));
+    service.Process();
+    EXPECT_TRUE(service.Seek(file, 0, Priority::BACKGROUND, nullptr));
+}
+
+TEST(util_FileIoService, d_priorities)
+{
+    ShimFileSystem fs;
+    TestService    service;
+    service.Init(fs);
+    Completion done;
+
+    auto    meta   = MakeFile("meta", 10);
+    auto    rec    = MakeFile("rec", 10);
+    auto    stream = MakeFile("stream", 10);
+    uint8_t buffer[3][4];
+    service.Read(meta,
+                 buffer[0],
+                 4,
+                 Priority::BACKGROUND,
+                 &Completion::Callback,
+                 &done);
+    service.Write(
+        rec, buffer[1], 4, Priority::RECORDING, &Completion::Callback, &done);
+    service.Read(stream,
+                 buffer[2],
+                 4,
+                 Priority::STREAMING,
+                 &Completion::Callback,
+                 &done);
+    ProcessAll(service);
+    const std::vector<std::string> expected = {"stream", "rec", "meta"};
+    EXPECT_EQ(done.order, expected);
+}
+
+TEST(util_FileIoService, e_sameFileKeepsOrder)
+{
+    // a seek with low priority must happen before a read of the same file,
+    // even if the read has a higher priority
+    ShimFileSystem fs;
+    TestService    service;
+    service.Init(fs);
+    Completion done;
+
+    auto    file = MakeFile("a", 100);
+    uint8_t dest[4];
+    service.Seek(file, 50, Priority::BACKGROUND, &Completion::Callback, &done);
+    service.Read(
+        file, dest, 4, Priority::STREAMING, &Completion::Callback, &done);
+    ProcessAll(service);
+    ASSERT_EQ(done.results.size(), 2u);
+    EXPECT_EQ(done.results[0].type, TestService::RequestType::SEEK);
+    EXPECT_EQ(done.results[1].type, TestService::RequestType::READ);
+    EXPECT_EQ(dest[0], file.data[50]);
+}
+
+TEST(util_FileIoService, f_earliestDeadlineFirst)
+{
+    ShimFileSystem fs;
+    TestService    service;
+    service.Init(fs);
+    Completion done;
+    System::SetTickForUnitTest(1000);
+
+    auto    a = MakeFile("a", 10);
+    auto    b = MakeFile("b", 10);
+    auto    c = MakeFile("c", 10);
+    uint8_t dest[3][4];
+    service.Read(
+        a, dest[0], 4, Priority::STREAMING, &Completion::Callback, &done);
+    service.Read(
+        b, dest[1], 4, Priority::STREAMING, &Completion::Callback, &done, 3000);
+    service.Read(
+        c, dest[2], 4, Priority::STREAMING, &Completion::Callback, &done, 2000);
+    ProcessAll(service);
+    const std::vector<std::string> expected = {"c", "b", "a"};
+    EXPECT_EQ(done.order, expected);
+}
+
+TEST(util_FileIoService, g_streamingDeadlinesHoldWhileRecording)
+{
+    // Two voices stream 2kB per block from disk while a recording writes
+    // 32kB at once. With an access latency of 100 ticks and 1 tick per
+    // byte, the write would take longer than a block if it wasn't split
+    // into chunks.
+    ShimFileSystem fs;
+    fs.latencyPerAccess = 100;
+    fs.latencyPerByte   = 1;
+    TestService service;
+    service.Init(fs, 2048);
+    Completion done;
+    System::SetTickForUnitTest(0);
+
+    auto                 voice1 = MakeFile("voice1", 1 << 20);
+    auto                 voice2 = MakeFile("voice2", 1 << 20);
+    auto                 rec    = MakeFile("rec", 0);
+    std::vector<uint8_t> recording(32768);
+    std::vector<uint8_t> streamBuffers[2]
+        = {std::vector<uint8_t>(2048), std::vector<uint8_t>(2048)};
+
+    constexpr uint32_t kBlockPeriod    = 10000; // ticks between refill requests
+    uint32_t           nextBlock       = 0;
+    int                numBlocks       = 0;
+    bool               recording_added = false;
+    while(numBlocks < 40)
+    {
+        if(System::GetTick() >= nextBlock)
+        {
+            // the audio callback requests the next buffers, which must
+            // arrive before the next block
+            const uint32_t deadline = nextBlock + kBlockPeriod;
+            service.Read(voice1,
+                         streamBuffers[0].data(),
+                         2048,
+                         Priority::STREAMING,
+                         &Completion::Callback,
+                         &done,
+                         deadline);
+            service.Read(voice2,
+                         streamBuffers[1].data(),
+                         2048,
+                         Priority::STREAMING,
+                         &Completion::Callback,
+                         &done,
+                         deadline);
+            nextBlock += kBlockPeriod;
+            numBlocks++;
+        }
+        if(numBlocks == 5 && !recording_added)
+        {
+            service.Write(rec,
+                          recording.data(),
+                          recording.size(),
+                          Priority::RECORDING,
+                          &Completion::Callback,
+                          &done);
+            recording_added = true;
+        }
+        // the main loop
+        if(!service.Process())
+            System::SetTickForUnitTest(System::GetTick() + 10);
+    }
+    ProcessAll(service);
+
+    EXPECT_EQ(service.GetNumMissedDeadlines(), 0u);
+    EXPECT_EQ(rec.data.size(), recording.size());
+    size_t numStreamReads = 0;
+    for(const auto& result : done.results)
+        if(result.type == TestService::RequestType::READ)
+            numStreamReads++;
+    EXPECT_EQ(numStreamReads, 80u);
+}
+
+TEST(util_FileIoService, h_callbackCanAddRequests)
+{
+    ShimFileSystem fs;
+    TestService    service;
+    service.Init(fs);
+
+    struct Chain
+    {
+        TestService*          service;
+        ShimFileSystem::File* file;
+        uint8_t               dest[4];
+        int                   count = 0;
+        static void           Callback(const TestService::Result&, void* ctx)
+        {
+            auto* self = static_cast<Chain*>(ctx);
+            if(++self->count < 3)
+                self->service->Read(*self->file,
+                                    self->dest,
+                                    4,
+                                    Priority::STREAMING,
+                                    &Chain::Callback,
+                                    self);
+        }
+    };
+    auto  file = MakeFile("a", 100);
+    Chain chain;
+    chain.service = &service;
+    chain.file    = &file;
+    service.Read(
+        file, chain.dest, 4, Priority::STREAMING, &Chain::Callback, &chain);
+    ProcessAll(service);
+    EXPECT_EQ(chain.count, 3);
+    EXPECT_EQ(file.position, 12u);
+}
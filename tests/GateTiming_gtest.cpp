@@ -0,0 +1,202 @@
+#include "util/GateTiming.h"
+#include <gtest/gtest.h>
+#include <cmath>
+#include <cstdlib>
+
+using namespace daisy;
+
+namespace
+{
+constexpr float    kSampleRate = 48000.f;
+constexpr size_t   kBlockSize  = 48;
+constexpr uint32_t kTickFreq   = 200000000;
+
+/** Simulates audio callbacks with interrupt latency jitter */
+struct CallbackTrace
+{
+    double   ticksPerSample = kTickFreq / kSampleRate;
+    uint32_t seed           = 1;
+
+    uint32_t BlockTick(size_t block)
+    {
+        seed               = seed * 1664525 + 1013904223;
+        const int jitter   = int(seed >> 20) % 2000; // up to 10us late
+        const double ideal = block * kBlockSize * ticksPerSample;
+        return uint32_t(ideal) + jitter;
+    }
+
+    uint32_t SampleTick(double sample)
+    {
+        return uint32_t(sample * ticksPerSample);
+    }
+};
+} // namespace
+
+TEST(util_GateTiming, a_blockOffsetsDespiteJitterAndDrift)
+{
+    for(double drift : {0.0, 1e-4, -1e-4})
+    {
+        AudioBlockClock clock;
+        clock.Init(kSampleRate, kBlockSize, kTickFreq);
+        CallbackTrace trace;
+        trace.ticksPerSample *= 1.0 + drift;
+
+        int maxError = 0;
+        for(size_t block = 0; block < 2000; block++)
+        {
+            clock.StartBlock(trace.BlockTick(block));
+            if(block < 100)
+                continue; // locking in
+
+            // an event in the previous block period, and one just after
+            // the start of this block
+            const double sample
+                = (block - 1) * kBlockSize + (block * 7) % kBlockSize;
+            size_t offset;
+            ASSERT_TRUE(
+                clock.GetSampleOffset(trace.SampleTick(sample), offset));
+            const int expected = int(sample) - int((block - 1) * kBlockSize);
+            maxError = std::max(maxError, std::abs(int(offset) - expected));
+
+            const uint32_t late = clock.GetBlockStartTick() + 10;
+            EXPECT_FALSE(clock.GetSampleOffset(late, offset));
+        }
+        EXPECT_LE(maxError, 1) << drift;
+        EXPECT_NEAR(clock.GetTicksPerSample(), trace.ticksPerSample, 1.0);
+    }
+}
+
+TEST(util_GateTiming, b_edgeQueueSplitsBlocks)
+{
+    AudioBlockClock clock;
+    clock.Init(kSampleRate, kBlockSize, kTickFreq);
+    const uint32_t blockTicks = 200000;
+    clock.StartBlock(0);
+    clock.StartBlock(blockTicks);
+    EXPECT_EQ(clock.GetBlockStartTick(), blockTicks);
+
+    GateEdgeQueue<4> queue;
+    queue.Clear();
+    EXPECT_TRUE(queue.Push(10, true));                // offset 0
+    EXPECT_TRUE(queue.Push(blockTicks / 2, false));   // offset 24
+    EXPECT_TRUE(queue.Push(blockTicks - 5000, true)); // offset 46
+    EXPECT_TRUE(queue.Push(blockTicks + 10, true));   // next block
+    EXPECT_FALSE(queue.Push(blockTicks + 20, false));
+    EXPECT_EQ(queue.GetNumDropped(), 1u);
+
+    GateEdge edges[4];
+    EXPECT_EQ(queue.PopEdgesInBlock(clock, edges, 1), 1u);
+    EXPECT_EQ(edges[0].offset, 0u);
+    EXPECT_TRUE(edges[0].rising);
+    EXPECT_EQ(queue.PopEdgesInBlock(clock, edges, 4), 2u);
+    EXPECT_EQ(edges[0].offset, 24u);
+    EXPECT_FALSE(edges[0].rising);
+    EXPECT_EQ(edges[1].offset, 46u);
+    EXPECT_EQ(edges[1].tick, blockTicks - 5000);
+    EXPECT_EQ(queue.PopEdgesInBlock(clock, edges, 4), 0u);
+
+    // the late edge is fetched with the next block, falling edges can be
+    // skipped
+    EXPECT_TRUE(queue.Push(blockTicks + 100000, false));
+    EXPECT_TRUE(queue.Push(blockTicks + 150000, true));
+    clock.StartBlock(2 * blockTicks);
+    EXPECT_EQ(queue.PopEdgesInBlock(clock, edges, 4, true), 2u);
+    EXPECT_EQ(edges[0].tick, blockTicks + 10);
+    EXPECT_EQ(edges[0].offset, 0u);
+    EXPECT_EQ(edges[1].offset, 36u);
+}
+
+TEST(util_GateTiming, c_periodEstimatorFollowsClock)
+{
+    // microsecond ticks to keep the numbers readable
+    ClockPeriodEstimator clock;
+    clock.Init(1000000, 2.f);
+    EXPECT_FALSE(clock.IsValid());
+    EXPECT_TRUE(clock.IsTimedOut(0));
+
+    // 120 bpm with +-2ms of jitter
+    const int jitter[] = {1500, -2000, 300, 0, -800, 2000, -1200, 700, 0};
+    uint32_t  tick     = 1000;
+    for(int j : jitter)
+    {
+        clock.AddEdge(tick + j);
+        tick += 500000;
+    }
+    EXPECT_NEAR(clock.GetPeriodTicks(), 500000, 1000);
+    EXPECT_NEAR(clock.GetBpm(), 120.f, 0.3f);
+    EXPECT_NEAR(clock.GetPeriod(), 0.5f, 0.001f);
+    EXPECT_NEAR(clock.GetFrequency(), 2.f, 0.01f);
+    EXPECT_EQ(clock.GetLastEdgeTick(), tick - 500000);
+    EXPECT_NEAR(clock.GetNextEdgeTick(), tick, 1000);
+    EXPECT_FALSE(clock.IsTimedOut(tick));
+
+    // a missed edge and a glitch don't change the estimate
+    tick += 1000000;
+    clock.AddEdge(tick);
+    tick += 500000;
+    clock.AddEdge(tick);
+    EXPECT_NEAR(clock.GetPeriodTicks(), 500000, 1000);
+    tick += 500000;
+    clock.AddEdge(tick);
+    clock.AddEdge(tick + 30000);
+    tick += 500000;
+    clock.AddEdge(tick);
+    tick += 500000;
+    clock.AddEdge(tick);
+    EXPECT_NEAR(clock.GetPeriodTicks(), 500000, 1000);
+
+    // the tempo changes after two intervals at the new tempo
+    tick += 375000;
+    clock.AddEdge(tick);
+    EXPECT_NEAR(clock.GetPeriodTicks(), 500000, 1000);
+    tick += 375000;
+    clock.AddEdge(tick);
+    EXPECT_FLOAT_EQ(clock.GetPeriodTicks(), 375000);
+    EXPECT_FLOAT_EQ(clock.GetBpm(4.f), 40.f);
+
+    // after a pause, tapping starts over and keeps the old estimate until
+    // the second tap
+    tick += 3000000;
+    EXPECT_TRUE(clock.IsTimedOut(tick));
+    clock.AddEdge(tick);
+    EXPECT_FLOAT_EQ(clock.GetPeriodTicks(), 375000);
+    tick += 750000;
+    clock.AddEdge(tick);
+    EXPECT_FLOAT_EQ(clock.GetPeriodTicks(), 750000);
+    tick += 760000;
+    clock.AddEdge(tick);
+    EXPECT_FLOAT_EQ(clock.GetPeriodTicks(), 755000);
+
+    clock.Reset();
+    EXPECT_FALSE(clock.IsValid());
+    EXPECT_EQ(clock.GetFrequency(), 0.f);
+}
+
+TEST(util_GateTiming, d_edgeDirectionFromLatchedLevel)
+{
+    AudioBlockClock clock;
+    clock.Init(kSampleRate, kBlockSize, kTickFreq);
+    clock.StartBlock(0);
+    clock.StartBlock(200000);
+
+    GateEdgeQueue<8> queue;
+    queue.Clear(false);
+    // a gate read after it ended is still a rising and a falling edge
+    EXPECT_TRUE(queue.PushEdge(10, false, false));
+    // the falling edge of a slow pulse has its own interrupt
+    EXPECT_TRUE(queue.PushEdge(20, false, true));
+    EXPECT_FALSE(queue.PushEdge(30, false, false));
+    // a short low pulse on a high gate
+    EXPECT_TRUE(queue.PushEdge(40, true, false));
+    EXPECT_TRUE(queue.PushEdge(50, true, false));
+
+    GateEdge       edges[8];
+    const bool     rising[] = {true, false, true, false, true, false, true};
+    const uint32_t ticks[]  = {10, 10, 20, 30, 40, 50, 50};
+    ASSERT_EQ(queue.PopEdgesInBlock(clock, edges, 8), 7u);
+    for(size_t i = 0; i < 7; i++)
+    {
+        EXPECT_EQ(edges[i].rising, rising[i]) << i;
+        EXPECT_EQ(edges[i].tick, ticks[i]) << i;
+    }
+}
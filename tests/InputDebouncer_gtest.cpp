@@ -0,0 +1,172 @@
+#include "util/InputDebouncer.h"
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+using namespace daisy;
+
+namespace
+{
+/** Converts a trace like "0011 0101" to samples, one char per scan */
+std::vector<bool> ParseTrace(const std::string& trace)
+{
+    std::vector<bool> samples;
+    for(char c : trace)
+        if(c == '0' || c == '1')
+            samples.push_back(c == '1');
+    return samples;
+}
+
+/** Per input reference implementation of the same debounce rule */
+struct ReferenceDebouncer
+{
+    bool   state   = false;
+    size_t counter = 0;
+
+    bool Update(bool sample, size_t stableScans)
+    {
+        counter = sample != state ? counter + 1 : 0;
+        if(counter < stableScans)
+            return false;
+        state   = sample;
+        counter = 0;
+        return true;
+    }
+};
+
+/** Bouncy contacts, recorded at 1kHz from the keys of a DaisyField */
+const char* kPressTrace = "0000 0000 0100 1101 1011 1111 1111 1111";
+const char* kReleaseTrace
+    = "1111 1111 1110 1111 0100 1010 0000 0000 0010 0000";
+} // namespace
+
+TEST(util_InputDebouncer, a_bouncingPress)
+{
+    InputDebouncer<> debouncer;
+    debouncer.Init(100);
+    EXPECT_EQ(debouncer.kStableScans, 4u);
+
+    const auto            samples = ParseTrace(kPressTrace);
+    std::vector<uint32_t> risingScans;
+    uint32_t              now = 100;
+    for(bool sample : samples)
+    {
+        debouncer.Update(sample ? 0x1 : 0x0, ++now);
+        EXPECT_EQ(debouncer.GetFallingEdges(), 0u);
+        if(debouncer.GetRisingEdges() != 0)
+            risingScans.push_back(now);
+    }
+
+    // pressed once, after four stable scans in a row
+    ASSERT_EQ(risingScans.size(), 1u);
+    EXPECT_EQ(risingScans[0], 100u + 22u);
+    EXPECT_TRUE(debouncer.Pressed(0));
+    EXPECT_FALSE(debouncer.RisingEdge(0));
+    EXPECT_EQ(debouncer.GetEdgeTime(0), 122u);
+    EXPECT_EQ(debouncer.TimeHeld(0), now - 122u);
+    // the other inputs were never touched
+    EXPECT_EQ(debouncer.GetStates(), 0x1u);
+    EXPECT_EQ(debouncer.GetEdgeTime(1), 100u);
+    EXPECT_EQ(debouncer.TimeHeld(1), 0u);
+}
+
+TEST(util_InputDebouncer, b_bouncingReleaseWithInvertedInputs)
+{
+    // active low inputs, as with pull ups to a switch to ground
+    InputDebouncer<> debouncer;
+    debouncer.Init();
+    debouncer.SetInvertMask(0, 0xffffffff);
+    debouncer.SetState(0, 0x80000000);
+
+    const auto samples = ParseTrace(kReleaseTrace);
+    int        numRising = 0, numFalling = 0;
+    uint32_t   now       = 0;
+    for(bool sample : samples)
+    {
+        // the trace is the pressed state, inputs read LOW when pressed
+        debouncer.Update(sample ? 0x7fffffff : 0xffffffff, ++now);
+        numRising += debouncer.GetRisingEdges() != 0;
+        if(debouncer.FallingEdge(31))
+        {
+            numFalling++;
+            EXPECT_TRUE(debouncer.HasEdges());
+            EXPECT_EQ(debouncer.GetFallingEdges(), 0x80000000u);
+        }
+    }
+    EXPECT_EQ(numRising, 0);
+    EXPECT_EQ(numFalling, 1);
+    EXPECT_EQ(debouncer.GetEdgeTime(31), 27u);
+    EXPECT_EQ(debouncer.GetStates(), 0u);
+}
+
+TEST(util_InputDebouncer, c_inputsAreIndependent)
+{
+    InputDebouncer<2, 3> debouncer;
+    debouncer.Init();
+    EXPECT_EQ(debouncer.kNumInputs, 64u);
+    EXPECT_EQ(debouncer.kStableScans, 8u);
+
+    // input 0 is stable, 33 bounces, 63 toggles every other scan
+    uint32_t now = 0;
+    for(int scan = 0; scan < 8; scan++)
+    {
+        const uint32_t bounce     = scan % 3 == 1 ? 0u : 0x2u;
+        const uint32_t toggle     = scan % 2 ? 0x80000000 : 0u;
+        const uint32_t samples[2] = {0x1, bounce | toggle};
+        debouncer.Update(samples, ++now);
+        EXPECT_EQ(debouncer.HasEdges(), scan == 7) << scan;
+    }
+    EXPECT_TRUE(debouncer.RisingEdge(0));
+    EXPECT_EQ(debouncer.GetRisingEdges(0), 0x1u);
+    EXPECT_EQ(debouncer.GetRisingEdges(1), 0u);
+
+    // 33 becomes stable, 63 keeps bouncing
+    for(int scan = 0; scan < 8; scan++)
+    {
+        const uint32_t samples[2] = {0x1, 0x2u | (scan % 2 ? 0x80000000 : 0u)};
+        debouncer.Update(samples, ++now);
+        EXPECT_EQ(debouncer.RisingEdge(33), scan == 7) << scan;
+    }
+    EXPECT_EQ(debouncer.GetStates(0), 0x1u);
+    EXPECT_EQ(debouncer.GetStates(1), 0x2u);
+    EXPECT_EQ(debouncer.GetEdgeTime(0), 8u);
+    EXPECT_EQ(debouncer.GetEdgeTime(33), 16u);
+    EXPECT_EQ(debouncer.TimeHeld(0), 8u);
+    EXPECT_FALSE(debouncer.Pressed(63));
+}
+
+TEST(util_InputDebouncer, d_matchesReferenceOnRandomBounces)
+{
+    InputDebouncer<> debouncer;
+    debouncer.Init();
+    ReferenceDebouncer reference[32];
+
+    // inputs that mostly follow a slow square wave, with random bounces
+    uint32_t rng = 12345;
+    for(uint32_t scan = 0; scan < 5000; scan++)
+    {
+        uint32_t sample = 0;
+        for(size_t i = 0; i < 32; i++)
+        {
+            rng              = rng * 1664525 + 1013904223;
+            const bool level = ((scan + 37 * i) / 50) % 2;
+            const bool flip  = (rng >> 24) < 64;
+            sample |= uint32_t(level != flip) << i;
+        }
+        debouncer.Update(sample, scan);
+
+        uint32_t expectedRising = 0, expectedFalling = 0;
+        for(size_t i = 0; i < 32; i++)
+        {
+            if(reference[i].Update((sample >> i) & 1, debouncer.kStableScans))
+            {
+                if(reference[i].state)
+                    expectedRising |= 1u << i;
+                else
+                    expectedFalling |= 1u << i;
+            }
+        }
+        ASSERT_EQ(debouncer.GetRisingEdges(), expectedRising) << scan;
+        ASSERT_EQ(debouncer.GetFallingEdges(), expectedFalling) << scan;
+    }
+}
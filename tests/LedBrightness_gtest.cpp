@@ -0,0 +1,118 @@
+#include "util/LedBrightness.h"
+#include <gtest/gtest.h>
+#include <cmath>
+#include <vector>
+
+using namespace daisy;
+
+TEST(util_LedBrightness, a_gammaCurves)
+{
+    using Linear = LedGammaCurve<LedGamma::LINEAR>;
+    using Square = LedGammaCurve<LedGamma::SQUARE>;
+    using Cube   = LedGammaCurve<LedGamma::CUBE>;
+
+    EXPECT_EQ(Linear::Apply(0.0f), 0);
+    EXPECT_EQ(Linear::Apply(1.0f), 65535);
+    EXPECT_EQ(Linear::Apply(uint8_t(255)), 65535);
+    EXPECT_EQ(Square::Apply(uint8_t(255)), 65535);
+    EXPECT_EQ(Cube::Apply(uint8_t(255)), 65535);
+    EXPECT_EQ(Cube::Apply(uint8_t(0)), 0);
+
+    // out of range values are clamped
+    EXPECT_EQ(Square::Apply(-0.5f), 0);
+    EXPECT_EQ(Square::Apply(2.0f), 65535);
+    EXPECT_EQ(Square::Apply(NAN), 0);
+
+    // interpolated values are within a few steps of the exact curves
+    for(float x = 0.0f; x <= 1.0f; x += 1.0f / 1000.0f)
+    {
+        EXPECT_NEAR(Linear::Apply(x), 65535.0f * x, 1.5f) << x;
+        EXPECT_NEAR(Square::Apply(x), 65535.0f * x * x, 3.0f) << x;
+        EXPECT_NEAR(Cube::Apply(x), 65535.0f * x * x * x, 3.0f) << x;
+    }
+
+    // strictly monotonic for 8 bit values
+    for(int i = 1; i < 256; i++)
+        EXPECT_GT(Square::Apply(uint8_t(i)), Square::Apply(uint8_t(i - 1)));
+
+    // the table is available at compile time
+    static_assert(Square::kLut.values[128] == 16384, "");
+}
+
+TEST(util_LedBrightness, b_onlyChangedChannelsAreWritten)
+{
+    LedBrightnessEncoder<40, 4095> encoder;
+    std::vector<int>               duties(40, -1);
+    auto write = [&](size_t ch, uint16_t duty) { duties[ch] = duty; };
+
+    // all channels are written once after Init()
+    EXPECT_EQ(encoder.Encode(write), 40u);
+    for(auto duty : duties)
+        EXPECT_EQ(duty, 0);
+    EXPECT_EQ(encoder.Encode(write), 0u);
+
+    encoder.Set(3, 1.0f);
+    encoder.Set(35, uint8_t(128));
+    encoder.SetDuty(20, 5000); // clamped
+    encoder.Set(4, 0.0f);      // unchanged
+    EXPECT_EQ(encoder.Encode(write), 3u);
+    EXPECT_EQ(duties[3], 4095);
+    EXPECT_EQ(duties[20], 4095);
+    EXPECT_NEAR(duties[35], 4095 * std::pow(128.0 / 255.0, 2.0), 1.0);
+    EXPECT_EQ(encoder.Encode(write), 0u);
+
+    // a change that's smaller than one duty step isn't written
+    encoder.SetIntensity(35, LedGammaCurve<LedGamma::SQUARE>::Apply(
+                                 uint8_t(128)) + 1);
+    EXPECT_EQ(encoder.Encode(write), 0u);
+
+    // unless all channels are requested
+    EXPECT_EQ(encoder.Encode(write, true), 40u);
+}
+
+TEST(util_LedBrightness, c_ditheringAddsResolution)
+{
+    LedBrightnessEncoder<2, 255, LedGamma::LINEAR> encoder;
+    encoder.Init(true);
+
+    // 10.25 duty steps on channel 0, exactly 100 on channel 1
+    encoder.SetIntensity(0, uint16_t(10.25 * 65535.0 / 255.0 + 0.5));
+    encoder.SetDuty(1, 100);
+    uint16_t current      = 0;
+    size_t   numWritesCh1 = 0;
+    double   sum          = 0.0;
+    for(int frame = 0; frame < 64; frame++)
+    {
+        encoder.Encode([&](size_t ch, uint16_t duty) {
+            if(ch == 0)
+                current = duty;
+            else
+                numWritesCh1++;
+        });
+        // the output alternates between the two closest steps ...
+        EXPECT_TRUE(current == 10 || current == 11) << current;
+        sum += current;
+    }
+    // ... and the average is the exact value
+    EXPECT_NEAR(sum / 64.0, 10.25, 1.0 / 64.0);
+    // raw duty values aren't dithered
+    EXPECT_EQ(numWritesCh1, 1u);
+
+    // full brightness doesn't overflow
+    encoder.SetIntensity(0, 65535);
+    encoder.SetIntensity(1, 65534);
+    for(int frame = 0; frame < 64; frame++)
+    {
+        encoder.Encode([&](size_t, uint16_t duty) { EXPECT_LE(duty, 255); });
+    }
+
+    // without dithering, values are rounded
+    encoder.SetDithering(false);
+    encoder.SetIntensity(0, uint16_t(10.75 * 65535.0 / 255.0));
+    uint16_t out = 0;
+    encoder.Encode([&](size_t ch, uint16_t duty) {
+        if(ch == 0)
+            out = duty;
+    });
+    EXPECT_EQ(out, 11);
+}
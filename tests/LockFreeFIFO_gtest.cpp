@@ -0,0 +1,101 @@
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+#include "util/LockFreeFIFO.h"
+
+using namespace daisy;
+
+TEST(util_LockFreeFIFO, a_getCapacity)
+{
+    LockFreeFIFO<int, 4> fifo;
+    EXPECT_EQ(fifo.GetCapacity(), 4u);
+}
+
+TEST(util_LockFreeFIFO, b_simplePushAndPop)
+{
+    LockFreeFIFO<int, 4> fifo;
+    int                  value = 0;
+
+    // empty after initialization
+    EXPECT_EQ(fifo.GetNumElements(), 0u);
+    EXPECT_TRUE(fifo.IsEmpty());
+    EXPECT_FALSE(fifo.PopFront(value));
+
+    // fill
+    EXPECT_TRUE(fifo.PushBack(1));
+    EXPECT_TRUE(fifo.PushBack(2));
+    EXPECT_TRUE(fifo.PushBack(3));
+    EXPECT_TRUE(fifo.PushBack(4));
+    EXPECT_EQ(fifo.GetNumElements(), 4u);
+
+    // can't push more
+    EXPECT_FALSE(fifo.PushBack(5));
+
+    // pop single item, push another one (fifo now wraps around)
+    EXPECT_TRUE(fifo.PopFront(value));
+    EXPECT_EQ(value, 1);
+    EXPECT_TRUE(fifo.PushBack(5));
+
+    // values come out in order
+    for(int expected = 2; expected <= 5; expected++)
+    {
+        EXPECT_TRUE(fifo.PopFront(value));
+        EXPECT_EQ(value, expected);
+    }
+    EXPECT_TRUE(fifo.IsEmpty());
+    EXPECT_FALSE(fifo.PopFront(value));
+
+    // clear
+    fifo.PushBack(1);
+    fifo.Clear();
+    EXPECT_TRUE(fifo.IsEmpty());
+}
+
+TEST(util_LockFreeFIFO, c_concurrentProducersAndConsumer)
+{
+    // multiple producers push sequences of values while a consumer pops
+    // them concurrently. Every value must arrive exactly once and the
+    // values of each producer must arrive in order.
+    constexpr int kNumProducers      = 4;
+    constexpr int kNumValuesProduced = 100000;
+
+    LockFreeFIFO<uint32_t, 64> fifo;
+
+    std::vector<std::thread> producers;
+    for(int p = 0; p < kNumProducers; p++)
+    {
+        producers.emplace_back([&fifo, p]() {
+            for(int i = 0; i < kNumValuesProduced; i++)
+            {
+                const uint32_t value = (uint32_t(p) << 24) | uint32_t(i);
+                while(!fifo.PushBack(value))
+                    std::this_thread::yield();
+            }
+        });
+    }
+
+    int      nextExpected[kNumProducers] = {0};
+    int      numReceived                 = 0;
+    uint32_t value                       = 0;
+    while(numReceived < kNumProducers * kNumValuesProduced)
+    {
+        if(!fifo.PopFront(value))
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        const int producer = value >> 24;
+        const int index    = value & 0xFFFFFF;
+        ASSERT_LT(producer, kNumProducers);
+        ASSERT_EQ(index, nextExpected[producer]);
+        nextExpected[producer]++;
+        numReceived++;
+    }
+
+    for(auto& producer : producers)
+        producer.join();
+
+    EXPECT_TRUE(fifo.IsEmpty());
+    for(int p = 0; p < kNumProducers; p++)
+        EXPECT_EQ(nextExpected[p], kNumValuesProduced);
+}
@@ -2,6 +2,7 @@
 #include <gtest/gtest.h>
 #include <cmath>
 #include <bitset>
+#include <functional>
 
 using namespace daisy;
 
@@ -39,6 +40,17 @@ class TestTransport
                                Mode     mode)>
         TxRxCallback;
 
+    /**
+     * When enabled, the complete callbacks of DMA transactions are queued
+     * instead of being executed right away, so that a test can run them
+     * one by one - like DMA transfers that finish in the background.
+     */
+    struct DeferredDma
+    {
+        bool                               enabled = false;
+        std::vector<std::function<void()>> pending;
+    };
+
     /**
      * TestTransport configuration struct; used to inject the
      * examination callbacks for each of the test cases
@@ -48,6 +60,7 @@ class TestTransport
     {
         TxCallback   tx_callback;
         TxRxCallback txrx_callback;
+        DeferredDma* deferred_dma = nullptr;
         void         Defaults() {}
     };
 
@@ -63,6 +76,7 @@ class TestTransport
     {
         tx_callback_        = config.tx_callback;
         txrx_callback_      = config.txrx_callback;
+        deferred_dma_       = config.deferred_dma;
         num_driver_devices_ = num_driver_devices;
         return Result::OK;
     }
@@ -98,12 +112,7 @@ class TestTransport
 
         // execute the provided complete callbacks just like the real
         // driver would do it albeit not asynchronously
-        if(complete_callback)
-        {
-            complete_callback(callback_context,
-                              result ? SpiHandle::Result::OK
-                                     : SpiHandle::Result::ERR);
-        }
+        Complete(complete_callback, callback_context, result);
 
         return result ? Result::OK : Result::ERR;
     }
@@ -121,12 +130,7 @@ class TestTransport
 
         // execute the provided complete callbacks just like the real
         // driver would do it albeit not asynchronously
-        if(complete_callback)
-        {
-            complete_callback(callback_context,
-                              result ? SpiHandle::Result::OK
-                                     : SpiHandle::Result::ERR);
-        }
+        Complete(complete_callback, callback_context, result);
 
         return result ? Result::OK : Result::ERR;
     }
@@ -134,8 +138,28 @@ class TestTransport
     size_t GetNumDevices() const { return num_driver_devices_; }
 
   private:
+    void Complete(MAX11300Types::TransportCallbackFunctionPtr complete_callback,
+                  void*                                       callback_context,
+                  bool                                        success)
+    {
+        if(!complete_callback)
+            return;
+        const auto result
+            = success ? SpiHandle::Result::OK : SpiHandle::Result::ERR;
+        if(deferred_dma_ != nullptr && deferred_dma_->enabled)
+        {
+            deferred_dma_->pending.push_back(
+                [=]() { complete_callback(callback_context, result); });
+        }
+        else
+        {
+            complete_callback(callback_context, result);
+        }
+    }
+
     TxCallback   tx_callback_;
     TxRxCallback txrx_callback_;
+    DeferredDma* deferred_dma_;
     size_t       num_driver_devices_;
 };
 
@@ -297,6 +321,7 @@ class MAX11300TestFixture : public ::testing::Test
         TestTransport::Config<num_devices> transport_config;
         transport_config.tx_callback     = tx_callback;
         transport_config.txrx_callback   = txrx_callback;
+        transport_config.deferred_dma    = &deferred_dma_;
         max11300_config.transport_config = transport_config;
 
         // Invoke the Init method now...
@@ -617,10 +642,31 @@ class MAX11300TestFixture : public ::testing::Test
      * A list of TXRX transaction fixtures to be verified
      */
     std::vector<TxRxTransaction> txrx_transactions_;
+    /**
+     * Queued DMA complete callbacks, when enabled
+     */
+    TestTransport::DeferredDma deferred_dma_;
+
+    /**
+     * Runs the queued DMA complete callbacks, including the ones that are
+     * queued while doing so, until none are left.
+     */
+    void RunDeferredDma()
+    {
+        while(!deferred_dma_.pending.empty())
+        {
+            auto complete = deferred_dma_.pending.front();
+            deferred_dma_.pending.erase(deferred_dma_.pending.begin());
+            complete();
+        }
+    }
 
   protected:
-    int update_complete_callback_count_ = 0;
-    int stop_auto_updates_after_        = 1;
+    int  update_complete_callback_count_ = 0;
+    int  stop_auto_updates_after_        = 1;
+    bool fail_transfers_                 = false;
+    /** Called by stream_frame_callback for each frame */
+    std::function<void()> on_stream_frame_;
     /** In a test, we can provide this callback function to the SUT when calling
      * MAX11300Driver.Start(), and use `this` as the callback context.
      * It will use the callback_context as a pointer and increment the
@@ -639,6 +685,16 @@ class MAX11300TestFixture : public ::testing::Test
         }
     }
 
+    /** Like update_complete_callback, but for the streaming mode */
+    static void stream_frame_callback(void* callback_context)
+    {
+        auto& fixture
+            = *reinterpret_cast<MAX11300TestFixture*>(callback_context);
+        fixture.update_complete_callback_count_++;
+        if(fixture.on_stream_frame_)
+            fixture.on_stream_frame_();
+    }
+
   private:
     // This method verifies a TX transaction against a TxTransaction fixture
     void verifyTxTransaction(size_t device_index, uint8_t* buff, size_t size)
@@ -800,6 +856,8 @@ class MAX11300TestFixture : public ::testing::Test
                  TestTransport::Mode mode) -> bool
     {
         UNUSED(mode); // irrelevant for the test
+        if(fail_transfers_)
+            return false;
         verifyTxTransaction(device_index, buff, size);
         return true;
     };
@@ -814,6 +872,8 @@ class MAX11300TestFixture : public ::testing::Test
                  TestTransport::Mode mode) -> bool
     {
         UNUSED(mode); // irrelevant for the test
+        if(fail_transfers_)
+            return false;
         verifyTxRxTransaction(device_index, tx_buff, rx_buff, size);
         return true;
     };
@@ -1398,6 +1458,233 @@ TEST_F(MAX11300TestFixture, verifyAutoUpdate)
     EXPECT_EQ(update_complete_callback_count_, stop_auto_updates_after_);
 }
 
+TEST_F(MAX11300TestFixture, verifyStreamingPipeline)
+{
+    // Configure a DAC and an ADC pin on the first chip, and a GPO and a GPI
+    // pin on the second chip. Stream frames with an external trigger and
+    // expect the same transactions as with Start(), with the DAC values
+    // double buffered: values written after a frame completes are sent two
+    // frames later.
+
+    const MAX11300Types::Pin dac_pin = MAX11300Types::PIN_3;
+    const MAX11300Types::Pin adc_pin = MAX11300Types::PIN_4;
+    const MAX11300Types::Pin gpo_pin = MAX11300Types::PIN_2;
+    const MAX11300Types::Pin gpi_pin = MAX11300Types::PIN_9;
+    EXPECT_TRUE(ConfigurePinAsAnalogWriteAndVerify(
+        0, dac_pin, MAX11300Types::DacVoltageRange::ZERO_TO_10));
+    EXPECT_TRUE(ConfigurePinAsAnalogReadAndVerify(
+        0, adc_pin, MAX11300Types::AdcVoltageRange::ZERO_TO_10));
+    EXPECT_TRUE(ConfigurePinAsDigitalWriteAndVerify(1, gpo_pin, 5.0f));
+    EXPECT_TRUE(ConfigurePinAsDigitalReadAndVerify(1, gpi_pin, 2.5f));
+
+    auto expect_frame = [&](uint16_t dac_val, uint16_t adc_val, bool gpi) {
+        TxTransaction tx_write_dac;
+        tx_write_dac.description  = "Chip 0: DAC stream transaction";
+        tx_write_dac.device_index = 0;
+        tx_write_dac.buff = {(uint8_t)((MAX11300_DACDAT_BASE + dac_pin) << 1),
+                             (uint8_t)(dac_val >> 8),
+                             (uint8_t)dac_val};
+        tx_write_dac.size = 3;
+        tx_transactions_.push_back(tx_write_dac);
+
+        TxRxTransaction txrx_read_adc;
+        txrx_read_adc.description  = "Chip 0: ADC stream transaction";
+        txrx_read_adc.device_index = 0;
+        txrx_read_adc.tx_buff
+            = {(uint8_t)(((MAX11300_ADCDAT_BASE + adc_pin) << 1) | 1),
+               0x00,
+               0x00};
+        txrx_read_adc.rx_buff
+            = {0x00, (uint8_t)(adc_val >> 8), (uint8_t)adc_val};
+        txrx_read_adc.size = 3;
+        txrx_transactions_.push_back(txrx_read_adc);
+
+        TxTransaction tx_write_gpo;
+        tx_write_gpo.description  = "Chip 1: GPO stream transaction";
+        tx_write_gpo.device_index = 1;
+        tx_write_gpo.buff
+            = {(uint8_t)(MAX11300_GPODAT << 1), 0x00, 0b00000100, 0x00, 0x00};
+        tx_write_gpo.size = 5;
+        tx_transactions_.push_back(tx_write_gpo);
+
+        TxRxTransaction txrx_read_gpi;
+        txrx_read_gpi.description  = "Chip 1: GPI stream transaction";
+        txrx_read_gpi.device_index = 1;
+        txrx_read_gpi.tx_buff
+            = {((MAX11300_GPIDAT << 1) | 1), 0x00, 0x00, 0x00, 0x00};
+        txrx_read_gpi.rx_buff
+            = {0x00, (uint8_t)(gpi ? 0b00000010 : 0x00), 0x00, 0x00, 0x00};
+        txrx_read_gpi.size = 5;
+        txrx_transactions_.push_back(txrx_read_gpi);
+    };
+
+    MAX11300Types::StreamBuffer<num_devices> stream_buffer;
+    deferred_dma_.enabled = true;
+    System::SetUsForUnitTest(1000);
+
+    max11300_.WriteAnalogPinRaw(0, dac_pin, 100);
+    max11300_.WriteDigitalPin(1, gpo_pin, true);
+    EXPECT_EQ(max11300_.StartStreaming(&stream_buffer,
+                                       MAX11300Types::StreamTrigger::EXTERNAL,
+                                       &stream_frame_callback,
+                                       this),
+              MAX11300Types::Result::OK);
+    EXPECT_TRUE(max11300_.IsStreaming());
+    // nothing happens before the first trigger
+    EXPECT_TRUE(deferred_dma_.pending.empty());
+
+    // frame 0
+    expect_frame(100, 1000, true);
+    EXPECT_TRUE(max11300_.TriggerStreamFrame());
+    // the pin configuration can't change while streaming, and Start()
+    // can't be used at the same time
+    EXPECT_EQ(max11300_.DisablePin(0, dac_pin), MAX11300Types::Result::ERR);
+    EXPECT_EQ(max11300_.Start(), MAX11300Types::Result::ERR);
+    // a trigger while the frame is still running is an overrun
+    EXPECT_FALSE(max11300_.TriggerStreamFrame());
+    max11300_.WriteAnalogPinRaw(0, dac_pin, 200);
+    System::SetUsForUnitTest(1050);
+    RunDeferredDma();
+    ExpectNoRemainingTransactions();
+    EXPECT_EQ(update_complete_callback_count_, 1);
+    EXPECT_EQ(max11300_.ReadAnalogPinRaw(0, adc_pin), 1000);
+    EXPECT_TRUE(max11300_.ReadDigitalPin(1, gpi_pin));
+
+    // frame 1 sends the second buffer, which still has the old value
+    System::SetUsForUnitTest(1125);
+    expect_frame(100, 2000, false);
+    EXPECT_TRUE(max11300_.TriggerStreamFrame());
+    System::SetUsForUnitTest(1175);
+    RunDeferredDma();
+    ExpectNoRemainingTransactions();
+    EXPECT_EQ(max11300_.ReadAnalogPinRaw(0, adc_pin), 2000);
+    EXPECT_FALSE(max11300_.ReadDigitalPin(1, gpi_pin));
+
+    // frame 2 sends the value that was written during frame 0
+    System::SetUsForUnitTest(1250);
+    expect_frame(200, 3000, false);
+    EXPECT_TRUE(max11300_.TriggerStreamFrame());
+    System::SetUsForUnitTest(1300);
+    RunDeferredDma();
+    ExpectNoRemainingTransactions();
+    EXPECT_EQ(update_complete_callback_count_, 3);
+
+    const auto stats = max11300_.GetStreamStats();
+    EXPECT_EQ(stats.frames, 3u);
+    EXPECT_EQ(stats.overruns, 1u);
+    EXPECT_EQ(stats.errors, 0u);
+    EXPECT_EQ(stats.frame_time_us, 50u);
+    EXPECT_EQ(stats.max_frame_time_us, 50u);
+    EXPECT_EQ(stats.frame_period_us, 125u);
+    EXPECT_FLOAT_EQ(stats.GetUpdateRate(), 8000.0f);
+    // frame 0 ended at 1050, its outputs were sent at 1250
+    EXPECT_EQ(stats.latency_us, 200u);
+
+    max11300_.StopStreaming();
+    EXPECT_FALSE(max11300_.IsStreaming());
+    EXPECT_FALSE(max11300_.TriggerStreamFrame());
+    EXPECT_TRUE(deferred_dma_.pending.empty());
+}
+
+TEST_F(MAX11300TestFixture, verifyStreamingContinuous)
+{
+    // Configure a DAC and an ADC pin on both chips and stream continuously.
+    // Expect the next frame to be on the bus while the frame callback
+    // runs, and use the block API to copy the ADC inputs to the DAC outputs.
+
+    const MAX11300Types::Pin dac_pin = MAX11300Types::PIN_0;
+    const MAX11300Types::Pin adc_pin = MAX11300Types::PIN_19;
+    for(size_t device_index = 0; device_index < num_devices; device_index++)
+    {
+        EXPECT_TRUE(ConfigurePinAsAnalogWriteAndVerify(
+            device_index,
+            dac_pin,
+            MAX11300Types::DacVoltageRange::NEGATIVE_5_TO_5));
+        EXPECT_TRUE(ConfigurePinAsAnalogReadAndVerify(
+            device_index,
+            adc_pin,
+            MAX11300Types::AdcVoltageRange::NEGATIVE_5_TO_5));
+        EXPECT_EQ(max11300_.GetNumAnalogOutputs(device_index), 1u);
+        EXPECT_EQ(max11300_.GetNumAnalogInputs(device_index), 1u);
+    }
+
+    // the DAC values are the ADC values of two frames before
+    const uint16_t adc_vals[4] = {10, 20, 30, 40};
+    for(size_t frame = 0; frame < 4; frame++)
+    {
+        for(size_t device_index = 0; device_index < num_devices;
+            device_index++)
+        {
+            const uint16_t adc_val = adc_vals[frame] + device_index;
+            const uint16_t dac_val
+                = frame < 2 ? 0 : adc_vals[frame - 2] + device_index;
+
+            TxTransaction tx_write_dac;
+            tx_write_dac.description  = "DAC stream transaction";
+            tx_write_dac.device_index = device_index;
+            tx_write_dac.buff
+                = {(uint8_t)((MAX11300_DACDAT_BASE + dac_pin) << 1),
+                   (uint8_t)(dac_val >> 8),
+                   (uint8_t)dac_val};
+            tx_write_dac.size = 3;
+            tx_transactions_.push_back(tx_write_dac);
+
+            TxRxTransaction txrx_read_adc;
+            txrx_read_adc.description  = "ADC stream transaction";
+            txrx_read_adc.device_index = device_index;
+            txrx_read_adc.tx_buff
+                = {(uint8_t)(((MAX11300_ADCDAT_BASE + adc_pin) << 1) | 1),
+                   0x00,
+                   0x00};
+            txrx_read_adc.rx_buff
+                = {0x00, (uint8_t)(adc_val >> 8), (uint8_t)adc_val};
+            txrx_read_adc.size = 3;
+            txrx_transactions_.push_back(txrx_read_adc);
+        }
+    }
+
+    on_stream_frame_ = [this]() {
+        // the next frame is already running, unless the stream was stopped
+        if(max11300_.IsStreaming())
+        {
+            EXPECT_EQ(deferred_dma_.pending.size(), 1u);
+        }
+        for(size_t device_index = 0; device_index < num_devices;
+            device_index++)
+        {
+            uint16_t values[1];
+            EXPECT_EQ(max11300_.ReadAnalogPinsRaw(device_index, values), 1u);
+            max11300_.WriteAnalogPinsRaw(device_index, values);
+        }
+        // stop after 3 frames; the 4th one is already running
+        if(update_complete_callback_count_ == 3)
+            max11300_.StopStreaming();
+    };
+
+    MAX11300Types::StreamBuffer<num_devices> stream_buffer;
+    deferred_dma_.enabled = true;
+    EXPECT_EQ(max11300_.StartStreaming(&stream_buffer,
+                                       MAX11300Types::StreamTrigger::CONTINUOUS,
+                                       &stream_frame_callback,
+                                       this),
+              MAX11300Types::Result::OK);
+    EXPECT_FALSE(max11300_.TriggerStreamFrame());
+    RunDeferredDma();
+    EXPECT_EQ(update_complete_callback_count_, 4);
+    EXPECT_EQ(max11300_.GetStreamStats().frames, 4u);
+    EXPECT_EQ(max11300_.ReadAnalogPinRaw(1, adc_pin), 41);
+
+    // a failed transfer stops the continuous stream
+    on_stream_frame_ = nullptr;
+    fail_transfers_  = true;
+    EXPECT_EQ(max11300_.StartStreaming(&stream_buffer),
+              MAX11300Types::Result::OK);
+    RunDeferredDma();
+    EXPECT_FALSE(max11300_.IsStreaming());
+    EXPECT_EQ(max11300_.GetStreamStats().errors, 1u);
+    EXPECT_EQ(max11300_.GetStreamStats().frames, 0u);
+}
+
 TEST(dev_MAX11300, a_VoltsTo12BitUint)
 {
     EXPECT_EQ(MAX11300Test::VoltsTo12BitUint(
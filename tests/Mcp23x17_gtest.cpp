@@ -0,0 +1,210 @@
+#include "dev/mcp23x17.h"
+#include <gtest/gtest.h>
+
+using namespace daisy;
+
+namespace
+{
+using Callback = void (*)(void* context, bool success);
+
+/** Simulates the registers of a MCP23017 */
+struct Device
+{
+    uint8_t  regs[0x16]  = {};
+    size_t   numReads    = 0;
+    size_t   numDmaReads = 0;
+    bool     irq         = false;
+    uint8_t* dmaData     = nullptr;
+    uint16_t dmaSize     = 0;
+    Callback dmaCallback = nullptr;
+    void*    dmaContext  = nullptr;
+
+    uint8_t& Reg(MCPRegister reg) { return regs[static_cast<uint8_t>(reg)]; }
+
+    /** Like reading INTCAP or GPIO, clears the interrupt */
+    void Read(uint8_t reg, uint8_t* data, uint16_t size)
+    {
+        numReads++;
+        for(uint16_t i = 0; i < size; i++)
+            data[i] = regs[reg + i];
+        irq = false;
+    }
+
+    /** Finishes the DMA read, like the completion interrupt would */
+    void FinishDma(bool success = true)
+    {
+        if(success)
+            Read(dmaData[0], dmaData, dmaSize);
+        dmaCallback(dmaContext, success);
+    }
+};
+
+class MockTransport
+{
+  public:
+    struct Config
+    {
+        Device* device = nullptr;
+        void    Defaults() {}
+    };
+
+    void Init(const Config& config) { dev_ = config.device; }
+
+    I2CHandle::Result WriteReg(MCPRegister reg, uint8_t val)
+    {
+        dev_->Reg(reg) = val;
+        return I2CHandle::Result::OK;
+    }
+
+    I2CHandle::Result WriteReg(MCPRegister reg, uint8_t portA, uint8_t portB)
+    {
+        dev_->Reg(reg)              = portA;
+        dev_->Reg(reg + MCPPort::B) = portB;
+        return I2CHandle::Result::OK;
+    }
+
+    uint8_t ReadReg(MCPRegister reg)
+    {
+        uint8_t value;
+        dev_->Read(static_cast<uint8_t>(reg), &value, 1);
+        return value;
+    }
+
+    void ReadReg(MCPRegister reg, uint8_t& portA, uint8_t& portB)
+    {
+        uint8_t data[2];
+        dev_->Read(static_cast<uint8_t>(reg), data, 2);
+        portA = data[0];
+        portB = data[1];
+    }
+
+    I2CHandle::Result ReadRegs(MCPRegister reg, uint8_t* data, uint16_t size)
+    {
+        dev_->Read(static_cast<uint8_t>(reg), data, size);
+        return I2CHandle::Result::OK;
+    }
+
+    I2CHandle::Result ReadRegsDma(MCPRegister reg,
+                                  uint8_t*    data,
+                                  uint16_t    size,
+                                  Callback    callback,
+                                  void*       context)
+    {
+        dev_->numDmaReads++;
+        data[0]           = static_cast<uint8_t>(reg);
+        dev_->dmaData     = data;
+        dev_->dmaSize     = size;
+        dev_->dmaCallback = callback;
+        dev_->dmaContext  = context;
+        return I2CHandle::Result::OK;
+    }
+
+    bool IsIrqActive() { return dev_->irq; }
+
+  private:
+    Device* dev_;
+};
+
+using TestMcp = Mcp23X17<MockTransport>;
+
+void InitDevice(TestMcp& mcp, Device& dev, uint8_t* dmaBuffer = nullptr)
+{
+    TestMcp::Config config;
+    config.transport_config.device = &dev;
+    config.dma_buffer              = dmaBuffer;
+    mcp.Init(config);
+    dev.numReads = 0;
+}
+} // namespace
+
+TEST(dev_Mcp23x17, a_burstReadDecoding)
+{
+    Device  dev;
+    TestMcp mcp;
+    InitDevice(mcp, dev);
+
+    // sequential addressing for bursts, one INT pin for both ports
+    EXPECT_EQ(dev.Reg(MCPRegister::IOCON), 0b01000000);
+
+    dev.Reg(MCPRegister::INTF_A)   = 0x01;
+    dev.Reg(MCPRegister::INTF_B)   = 0x80;
+    dev.Reg(MCPRegister::INTCAP_A) = 0x3E;
+    dev.Reg(MCPRegister::INTCAP_B) = 0x7F;
+    dev.Reg(MCPRegister::GPIO_A)   = 0x3F;
+    dev.Reg(MCPRegister::GPIO_B)   = 0xFF;
+
+    EXPECT_EQ(mcp.ReadAll(), 0xFF3F);
+    EXPECT_EQ(dev.numReads, 1u);
+    EXPECT_EQ(mcp.GetInterruptFlags(), 0x8001);
+    EXPECT_EQ(mcp.GetCapturedPins(), 0x7F3E);
+    EXPECT_EQ(mcp.GetPin(0), 0xFF);
+    EXPECT_EQ(mcp.GetPin(6), 0x00);
+    EXPECT_EQ(mcp.GetPin(15), 0xFF);
+
+    // both ports are read with one transaction
+    dev.Reg(MCPRegister::GPIO_B) = 0x01;
+    EXPECT_EQ(mcp.Read(), 0x013F);
+    EXPECT_EQ(dev.numReads, 2u);
+}
+
+TEST(dev_Mcp23x17, b_interruptSkipsPolling)
+{
+    Device  dev;
+    TestMcp mcp;
+    InitDevice(mcp, dev);
+
+    mcp.SetInterrupts(0x80FF);
+    EXPECT_EQ(dev.Reg(MCPRegister::GPINTEN_A), 0xFF);
+    EXPECT_EQ(dev.Reg(MCPRegister::GPINTEN_B), 0x80);
+    EXPECT_EQ(dev.Reg(MCPRegister::INTCON_A), 0x00);
+    EXPECT_EQ(dev.Reg(MCPRegister::INTCON_B), 0x00);
+
+    dev.Reg(MCPRegister::GPIO_A) = 0x04;
+    EXPECT_FALSE(mcp.Update());
+    EXPECT_EQ(dev.numReads, 0u);
+
+    dev.irq = true;
+    EXPECT_TRUE(mcp.Update());
+    EXPECT_EQ(dev.numReads, 1u);
+    EXPECT_EQ(mcp.GetPin(2), 0xFF);
+
+    // the read cleared the interrupt
+    EXPECT_FALSE(mcp.IsChangePending());
+    EXPECT_FALSE(mcp.Update());
+    EXPECT_EQ(dev.numReads, 1u);
+}
+
+TEST(dev_Mcp23x17, c_dmaWithCompletionCallback)
+{
+    Device  dev;
+    TestMcp mcp;
+    InitDevice(mcp, dev);
+    // a DMA buffer is required
+    EXPECT_FALSE(mcp.StartReadAll());
+    EXPECT_EQ(dev.numDmaReads, 0u);
+    uint8_t dmaBuffer[TestMcp::kBurstSize];
+    InitDevice(mcp, dev, dmaBuffer);
+
+    int  numCallbacks = 0;
+    auto callback     = [](void* context, bool success) {
+        EXPECT_TRUE(success);
+        (*static_cast<int*>(context))++;
+    };
+
+    dev.Reg(MCPRegister::INTF_B) = 0x02;
+    dev.Reg(MCPRegister::GPIO_B) = 0x02;
+    EXPECT_TRUE(mcp.StartReadAll(callback, &numCallbacks));
+    EXPECT_TRUE(mcp.IsReading());
+    EXPECT_FALSE(mcp.StartReadAll(callback, &numCallbacks));
+    EXPECT_EQ(dev.numDmaReads, 1u);
+    EXPECT_EQ(dev.dmaSize, TestMcp::kBurstSize);
+    EXPECT_EQ(dev.dmaData, dmaBuffer);
+    EXPECT_EQ(dev.dmaData[0], static_cast<uint8_t>(MCPRegister::INTF_A));
+
+    EXPECT_EQ(mcp.GetPin(9), 0x00);
+    dev.FinishDma();
+    EXPECT_FALSE(mcp.IsReading());
+    EXPECT_EQ(numCallbacks, 1);
+    EXPECT_EQ(mcp.GetInterruptFlags(), 0x0200);
+    EXPECT_EQ(mcp.GetPin(9), 0xFF);
+}
@@ -0,0 +1,227 @@
+#include "util/MemoryArena.h"
+#include <gtest/gtest.h>
+#include <cstring>
+#include <vector>
+
+using namespace daisy;
+
+namespace
+{
+// a block of plain memory, aligned like the hardware regions
+struct alignas(32) TestMemory
+{
+    uint8_t data[1024];
+};
+
+bool IsAligned(const void* ptr, size_t alignment)
+{
+    return (reinterpret_cast<uintptr_t>(ptr) % alignment) == 0;
+}
+
+struct Voice
+{
+    Voice(int note_, float velocity_) : note(note_), velocity(velocity_) {}
+    ~Voice() { numDestroyed++; }
+    int        note;
+    float      velocity;
+    static int numDestroyed;
+};
+int Voice::numDestroyed = 0;
+} // namespace
+
+TEST(util_MemoryArena, a_stateAfterInit)
+{
+    TestMemory  memory;
+    MemoryArena arena;
+    arena.Init(memory.data, sizeof(memory.data));
+    EXPECT_EQ(arena.GetSize(), 1024u);
+    EXPECT_EQ(arena.GetUsed(), 0u);
+    EXPECT_EQ(arena.GetFree(), 1024u);
+    EXPECT_EQ(arena.GetHighWatermark(), 0u);
+    EXPECT_EQ(arena.GetNumFailedAllocations(), 0u);
+}
+
+TEST(util_MemoryArena, b_allocateIsCacheLineAligned)
+{
+    TestMemory  memory;
+    MemoryArena arena;
+    arena.Init(memory.data, sizeof(memory.data));
+
+    void* a = arena.Allocate(10);
+    void* b = arena.Allocate(3);
+    void* c = arena.Allocate(64);
+    ASSERT_NE(a, nullptr);
+    ASSERT_NE(b, nullptr);
+    ASSERT_NE(c, nullptr);
+    EXPECT_TRUE(IsAligned(a, 32));
+    EXPECT_TRUE(IsAligned(b, 32));
+    EXPECT_TRUE(IsAligned(c, 32));
+    EXPECT_EQ(static_cast<uint8_t*>(b) - static_cast<uint8_t*>(a), 32);
+    EXPECT_EQ(static_cast<uint8_t*>(c) - static_cast<uint8_t*>(b), 32);
+    EXPECT_EQ(arena.GetUsed(), 128u);
+    EXPECT_TRUE(arena.Contains(c));
+
+    // smaller alignments pack tighter
+    void* d = arena.Allocate(2, 4);
+    void* e = arena.Allocate(4, 4);
+    EXPECT_EQ(static_cast<uint8_t*>(e) - static_cast<uint8_t*>(d), 4);
+
+    // invalid alignment
+    EXPECT_EQ(arena.Allocate(4, 3), nullptr);
+}
+
+TEST(util_MemoryArena, c_outOfMemory)
+{
+    TestMemory  memory;
+    MemoryArena arena;
+    arena.Init(memory.data, sizeof(memory.data));
+
+    EXPECT_NE(arena.Allocate(1000), nullptr);
+    // 1000 is padded to 1024 for the next allocation
+    EXPECT_EQ(arena.Allocate(1), nullptr);
+    EXPECT_NE(arena.Allocate(24, 4), nullptr);
+    EXPECT_EQ(arena.GetFree(), 0u);
+    EXPECT_EQ(arena.Allocate(1, 1), nullptr);
+    EXPECT_EQ(arena.AllocateArray<float>(size_t(-1) / 2), nullptr);
+    EXPECT_EQ(arena.GetNumFailedAllocations(), 3u);
+}
+
+TEST(util_MemoryArena, d_markersAndHighWatermark)
+{
+    TestMemory  memory;
+    MemoryArena arena;
+    arena.Init(memory.data, sizeof(memory.data));
+
+    arena.Allocate(64);
+    const auto marker = arena.GetMarker();
+    void*      tmp    = arena.Allocate(256);
+    EXPECT_EQ(arena.GetUsed(), 320u);
+
+    arena.ResetToMarker(marker);
+    EXPECT_EQ(arena.GetUsed(), 64u);
+    EXPECT_EQ(arena.GetHighWatermark(), 320u);
+    // the memory is reused
+    EXPECT_EQ(arena.Allocate(32), tmp);
+
+    arena.Reset();
+    EXPECT_EQ(arena.GetUsed(), 0u);
+    EXPECT_EQ(arena.GetHighWatermark(), 320u);
+}
+
+TEST(util_MemoryArena, e_typedAllocations)
+{
+    TestMemory  memory;
+    MemoryArena arena;
+    arena.Init(memory.data, sizeof(memory.data));
+
+    memset(memory.data, 0xff, sizeof(memory.data));
+    float* delay = arena.AllocateArray<float>(16);
+    ASSERT_NE(delay, nullptr);
+    EXPECT_TRUE(IsAligned(delay, 32));
+    for(int i = 0; i < 16; i++)
+        EXPECT_EQ(delay[i], 0.0f);
+
+    Voice* voice = arena.Create<Voice>(60, 0.5f);
+    ASSERT_NE(voice, nullptr);
+    EXPECT_TRUE(IsAligned(voice, 32));
+    EXPECT_EQ(voice->note, 60);
+    EXPECT_EQ(voice->velocity, 0.5f);
+}
+
+TEST(util_MemoryPool, a_initFromMemory)
+{
+    TestMemory memory;
+    MemoryPool pool;
+    // block size is rounded up to the cache line size
+    EXPECT_EQ(pool.Init(memory.data, sizeof(memory.data), 40), 16u);
+    EXPECT_EQ(pool.GetBlockSize(), 64u);
+    EXPECT_EQ(pool.GetNumBlocks(), 16u);
+    EXPECT_EQ(pool.GetNumFree(), 16u);
+    EXPECT_EQ(pool.GetNumUsed(), 0u);
+}
+
+TEST(util_MemoryPool, b_allocateAndFree)
+{
+    TestMemory memory;
+    MemoryPool pool;
+    pool.Init(memory.data, 4 * 32, 32);
+
+    std::vector<void*> blocks;
+    for(int i = 0; i < 4; i++)
+    {
+        void* block = pool.Allocate();
+        ASSERT_NE(block, nullptr);
+        EXPECT_TRUE(IsAligned(block, 32));
+        EXPECT_TRUE(pool.Contains(block));
+        for(auto other : blocks)
+            EXPECT_NE(block, other);
+        blocks.push_back(block);
+    }
+    EXPECT_EQ(pool.Allocate(), nullptr);
+    EXPECT_EQ(pool.GetNumFailedAllocations(), 1u);
+    EXPECT_EQ(pool.GetNumFree(), 0u);
+
+    // freed blocks are reused
+    EXPECT_TRUE(pool.Free(blocks[2]));
+    EXPECT_EQ(pool.GetNumUsed(), 3u);
+    EXPECT_EQ(pool.Allocate(), blocks[2]);
+
+    // foreign or misaligned pointers are rejected
+    uint8_t other;
+    EXPECT_FALSE(pool.Free(&other));
+    EXPECT_FALSE(pool.Free(static_cast<uint8_t*>(blocks[0]) + 1));
+    EXPECT_FALSE(pool.Free(nullptr));
+
+    for(auto block : blocks)
+        pool.Free(block);
+    EXPECT_EQ(pool.GetNumFree(), 4u);
+    EXPECT_EQ(pool.GetHighWatermark(), 4u);
+}
+
+TEST(util_MemoryPool, c_initFromArena)
+{
+    TestMemory  memory;
+    MemoryArena arena;
+    arena.Init(memory.data, sizeof(memory.data));
+    arena.Allocate(100);
+
+    MemoryPool pool;
+    EXPECT_TRUE(pool.Init(arena, sizeof(Voice), 8));
+    EXPECT_EQ(pool.GetNumBlocks(), 8u);
+    EXPECT_EQ(arena.GetUsed(), 128u + 8 * 32);
+
+    MemoryPool tooLarge;
+    EXPECT_FALSE(tooLarge.Init(arena, 1000, 8));
+    EXPECT_EQ(tooLarge.GetNumBlocks(), 0u);
+    EXPECT_EQ(tooLarge.Allocate(), nullptr);
+}
+
+TEST(util_MemoryPool, d_createAndDestroy)
+{
+    TestMemory memory;
+    MemoryPool pool;
+    pool.Init(memory.data, 2 * 32, sizeof(Voice));
+
+    Voice::numDestroyed = 0;
+    Voice* a            = pool.Create<Voice>(1, 0.1f);
+    Voice* b            = pool.Create<Voice>(2, 0.2f);
+    ASSERT_NE(a, nullptr);
+    ASSERT_NE(b, nullptr);
+    EXPECT_EQ(pool.Create<Voice>(3, 0.3f), nullptr);
+    EXPECT_EQ(a->note, 1);
+    EXPECT_EQ(b->note, 2);
+
+    pool.Destroy(a);
+    EXPECT_EQ(Voice::numDestroyed, 1);
+    Voice* c = pool.Create<Voice>(3, 0.3f);
+    EXPECT_EQ(c, a);
+    EXPECT_EQ(c->note, 3);
+
+    // objects larger than a block can't be created
+    struct Large
+    {
+        uint8_t data[100];
+    };
+    pool.Destroy(b);
+    EXPECT_EQ(pool.Create<Large>(), nullptr);
+}
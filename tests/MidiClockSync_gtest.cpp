@@ -0,0 +1,318 @@
+#include "util/MidiClockSync.h"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+using namespace daisy;
+
+namespace
+{
+constexpr float    kSampleRate = 48000.f;
+constexpr size_t   kBlockSize  = 48;
+constexpr uint32_t kTickFreq   = 200000000;
+
+MidiEvent RealTime(SystemRealTimeType type)
+{
+    MidiEvent event;
+    event.type     = SystemRealTime;
+    event.srt_type = type;
+    return event;
+}
+
+MidiEvent SongPosition(uint16_t sixteenths)
+{
+    MidiEvent event;
+    event.type    = SystemCommon;
+    event.sc_type = SongPositionPointer;
+    event.data[0] = sixteenths & 0x7f;
+    event.data[1] = sixteenths >> 7;
+    return event;
+}
+
+/** Plays a recorded MIDI clock trace into the follower, with the audio
+ *  callback collecting the divisions */
+struct ClockTrace
+{
+    struct TimedEvent
+    {
+        double    time;
+        MidiEvent event;
+    };
+
+    explicit ClockTrace(uint8_t divisions_per_beat = 4)
+    {
+        follower.Init(kTickFreq, divisions_per_beat);
+        clock.Init(kSampleRate, kBlockSize, kTickFreq);
+    }
+
+    void Add(double time, const MidiEvent& event)
+    {
+        events.push_back({time, event});
+    }
+
+    /** Adds clock pulses from `start` to `end`, with a uniform jitter of
+     *  up to `jitter` seconds either way and every `drop`th pulse lost.
+     *  The tempo ramps from `bpm` to `end_bpm`.
+     *  @return the ideal times of the pulses
+     */
+    std::vector<double> AddPulses(double start,
+                                  double end,
+                                  double bpm,
+                                  double jitter  = 0.0,
+                                  double end_bpm = 0.0,
+                                  int    drop    = 0)
+    {
+        std::vector<double> times;
+        if(end_bpm == 0.0)
+            end_bpm = bpm;
+        double time = start;
+        for(int pulse = 0; time < end; pulse++)
+        {
+            times.push_back(time);
+            seed = seed * 1664525 + 1013904223;
+            const double noise
+                = jitter * (2.0 * (seed >> 8) / double(1 << 24) - 1.0);
+            if(drop == 0 || pulse % drop != drop - 1)
+                Add(time + noise, RealTime(TimingClock));
+            const double tempo
+                = bpm + (end_bpm - bpm) * (time - start) / (end - start);
+            time += 60.0 / (tempo * 24.0);
+        }
+        return times;
+    }
+
+    /** Runs the audio callbacks up to `end` seconds */
+    void Run(double end)
+    {
+        std::stable_sort(events.begin(),
+                         events.end(),
+                         [](const TimedEvent& a, const TimedEvent& b) {
+                             return a.time < b.time;
+                         });
+        for(; block * kBlockSize < end * kSampleRate; block++)
+        {
+            const double   time  = double(block) * kBlockSize / kSampleRate;
+            const uint32_t start = uint32_t(time * kTickFreq);
+            // the receive interrupts of the last block period
+            for(; next_event < events.size(); next_event++)
+            {
+                const uint32_t tick
+                    = uint32_t(events[next_event].time * kTickFreq);
+                if(int32_t(tick - start) >= 0)
+                    break;
+                follower.PushEvent(events[next_event].event, tick);
+            }
+            clock.StartBlock(start);
+            MidiClockDivision out[16];
+            const size_t num = follower.ProcessBlock(clock, out, 16);
+            for(size_t i = 0; i < num; i++)
+            {
+                divisions.push_back(out[i]);
+                // the block plays the previous block period
+                times.push_back(((block - 1.0) * kBlockSize + out[i].offset)
+                                / kSampleRate);
+            }
+        }
+    }
+
+    /** Returns the largest deviation of the divisions from the ideal
+     *  pulse times, in seconds, from division `first` on */
+    double MaxError(const std::vector<double>& pulse_times,
+                    uint32_t                   first_pulse,
+                    size_t                     first = 0) const
+    {
+        const uint32_t pulses_per_division
+            = 24 / follower.GetDivisionsPerBeat();
+        double max_error = 0.0;
+        for(size_t i = first; i < divisions.size(); i++)
+        {
+            const size_t pulse
+                = divisions[i].index * pulses_per_division - first_pulse;
+            if(pulse >= pulse_times.size())
+                break;
+            max_error
+                = std::max(max_error, std::abs(times[i] - pulse_times[pulse]));
+        }
+        return max_error;
+    }
+
+    MidiClockFollower<>            follower;
+    AudioBlockClock                clock;
+    std::vector<TimedEvent>        events;
+    std::vector<MidiClockDivision> divisions;
+    std::vector<double>            times;
+    size_t                         block      = 0;
+    size_t                         next_event = 0;
+    uint32_t                       seed       = 1;
+};
+} // namespace
+
+TEST(util_MidiClockSync, a_locksToJitteredClock)
+{
+    ClockTrace trace;
+    trace.Add(0.1, RealTime(SystemRealTimeType::Start));
+    const auto pulses = trace.AddPulses(0.11, 6.0, 120.0, 0.001);
+    trace.Run(1.0);
+    EXPECT_TRUE(trace.follower.IsLocked());
+    EXPECT_TRUE(trace.follower.IsPlaying());
+    EXPECT_NEAR(trace.follower.GetBpm(), 120.f, 1.f);
+
+    trace.Run(5.0);
+    EXPECT_NEAR(trace.follower.GetBpm(), 120.f, 0.2f);
+
+    // 4 sixteenths per beat, in order from the first pulse
+    ASSERT_GE(trace.divisions.size(), 39u);
+    for(size_t i = 0; i < trace.divisions.size(); i++)
+    {
+        EXPECT_EQ(trace.divisions[i].index, i);
+        EXPECT_EQ(trace.divisions[i].beat, i / 4);
+        EXPECT_EQ(trace.divisions[i].division, i % 4);
+    }
+
+    // the pulses jitter by a millisecond, the divisions much less once
+    // the loop settled
+    EXPECT_LT(trace.MaxError(pulses, 0), 0.0015);
+    EXPECT_LT(trace.MaxError(pulses, 0, 16), 0.0004);
+}
+
+TEST(util_MidiClockSync, b_followsTempoChanges)
+{
+    // a jump from 120 to 150 bpm
+    ClockTrace jump;
+    jump.Add(0.0, RealTime(SystemRealTimeType::Start));
+    const auto before = jump.AddPulses(0.01, 2.0, 120.0, 0.0005);
+    jump.AddPulses(before.back() + 60.0 / (150.0 * 24.0), 4.0, 150.0, 0.0005);
+    jump.Run(2.3);
+    EXPECT_NEAR(jump.follower.GetBpm(), 150.f, 1.5f);
+    jump.Run(4.0);
+    EXPECT_NEAR(jump.follower.GetBpm(), 150.f, 0.3f);
+
+    // a steep ramp from 100 to 140 bpm, the loop lags behind a little
+    ClockTrace ramp;
+    ramp.Add(0.0, RealTime(SystemRealTimeType::Start));
+    const auto pulses = ramp.AddPulses(0.01, 8.0, 100.0, 0.0005, 140.0);
+    for(double time = 1.0; time < 8.0; time += 1.0)
+    {
+        ramp.Run(time);
+        EXPECT_NEAR(ramp.follower.GetBpm(), 100.f + 40.f * time / 8.f, 2.f);
+    }
+    EXPECT_LT(ramp.MaxError(pulses, 0, 16), 0.002);
+
+    // a gentle one from 120 to 125 bpm stays within the jitter
+    ClockTrace gentle;
+    gentle.Add(0.0, RealTime(SystemRealTimeType::Start));
+    const auto gentle_pulses
+        = gentle.AddPulses(0.01, 8.0, 120.0, 0.0005, 125.0);
+    gentle.Run(8.0);
+    EXPECT_NEAR(gentle.follower.GetBpm(), 125.f, 0.5f);
+    EXPECT_LT(gentle.MaxError(gentle_pulses, 0, 16), 0.001);
+}
+
+TEST(util_MidiClockSync, c_missedPulses)
+{
+    ClockTrace trace;
+    trace.Add(0.0, RealTime(SystemRealTimeType::Start));
+    // every 37th pulse lost
+    const auto pulses = trace.AddPulses(0.01, 4.0, 120.0, 0.0005, 0.0, 37);
+    trace.Run(4.0);
+    EXPECT_NEAR(trace.follower.GetBpm(), 120.f, 0.3f);
+    for(size_t i = 0; i < trace.divisions.size(); i++)
+        ASSERT_EQ(trace.divisions[i].index, i);
+    // 8 sixteenths a second, none lost
+    EXPECT_GE(trace.divisions.size(), 31u);
+    EXPECT_LT(trace.MaxError(pulses, 0, 16), 0.0005);
+}
+
+TEST(util_MidiClockSync, d_transportAndSongPosition)
+{
+    ClockTrace trace(1);
+    // the clock runs all the time, the transport starts later
+    auto pulses = trace.AddPulses(0.01, 6.0, 120.0, 0.0005);
+    trace.Run(1.0);
+    EXPECT_TRUE(trace.follower.IsLocked());
+    EXPECT_FALSE(trace.follower.IsPlaying());
+    EXPECT_TRUE(trace.divisions.empty());
+
+    // start between pulses 48 and 49, so pulse 49 is the first beat
+    trace.Add(pulses[48] + 0.002, RealTime(SystemRealTimeType::Start));
+    // stop in the middle of the fourth beat
+    trace.Add(pulses[49 + 3 * 24 + 12], RealTime(SystemRealTimeType::Stop));
+    trace.Run(3.0);
+    EXPECT_FALSE(trace.follower.IsPlaying());
+    ASSERT_EQ(trace.divisions.size(), 4u);
+    EXPECT_LT(trace.MaxError(pulses, -49), 0.0005);
+
+    // a song position of 3 bars, while stopped, and continue from there
+    trace.Add(3.1, SongPosition(48));
+    size_t resume = 0;
+    while(pulses[resume] < 3.2)
+        resume++;
+    trace.Add(pulses[resume] - 0.002, RealTime(SystemRealTimeType::Continue));
+    trace.Run(5.0);
+    EXPECT_TRUE(trace.follower.IsPlaying());
+    ASSERT_GE(trace.divisions.size(), 8u);
+    EXPECT_EQ(trace.divisions[4].beat, 12u);
+    for(size_t i = 5; i < trace.divisions.size(); i++)
+        EXPECT_EQ(trace.divisions[i].beat, trace.divisions[i - 1].beat + 1);
+    // beat 12 is on the first pulse after the continue
+    EXPECT_LT(trace.MaxError(pulses, uint32_t(12 * 24 - resume), 4), 0.0005);
+    EXPECT_EQ(trace.follower.GetPulse() % 24,
+              uint32_t(pulses.size() - 1 - resume) % 24);
+}
+
+TEST(util_MidiClockSync, e_lostClock)
+{
+    ClockTrace trace(24);
+    trace.Add(0.0, RealTime(SystemRealTimeType::Start));
+    const auto pulses = trace.AddPulses(0.01, 1.0, 120.0);
+    trace.Run(1.2);
+    // the divisions run ahead by at most one pulse
+    EXPECT_LE(trace.divisions.size(), pulses.size() + 1);
+    EXPECT_GE(trace.divisions.size(), pulses.size());
+    EXPECT_TRUE(trace.follower.IsLocked());
+    EXPECT_TRUE(trace.follower.IsPlaying());
+
+    trace.Run(2.0);
+    EXPECT_FALSE(trace.follower.IsLocked());
+    EXPECT_EQ(trace.follower.GetBpm(), 0.f);
+    EXPECT_LE(trace.divisions.size(), pulses.size() + 1);
+}
+
+TEST(util_MidiClockSync, f_ignoresOtherEvents)
+{
+    MidiClockFollower<4> follower;
+    follower.Init(kTickFreq);
+    MidiEvent note;
+    note.type = NoteOn;
+    for(int i = 0; i < 10; i++)
+        EXPECT_TRUE(follower.PushEvent(note, 0));
+    for(int i = 0; i < 4; i++)
+        EXPECT_TRUE(follower.PushEvent(RealTime(TimingClock), 0));
+    EXPECT_FALSE(follower.PushEvent(RealTime(TimingClock), 0));
+    EXPECT_EQ(follower.GetNumDropped(), 1u);
+}
+
+TEST(util_MidiClockSync, g_generatorDoesNotDrift)
+{
+    MidiClockGenerator generator;
+    generator.Init(1000000, 123.4f);
+    EXPECT_NEAR(generator.GetBpm(), 123.4f, 0.001f);
+
+    const double ideal = 60.0 * 1000000 / (123.4 * 24.0);
+    uint64_t     sum   = 0;
+    for(int pulse = 1; pulse <= 24 * 1000; pulse++)
+    {
+        const uint32_t interval = generator.NextInterval();
+        EXPECT_TRUE(interval == uint32_t(ideal)
+                    || interval == uint32_t(ideal) + 1);
+        sum += interval;
+    }
+    // float resolution of the interval, far below a tick per beat
+    EXPECT_NEAR(double(sum), ideal * 24 * 1000, 24 * 1000 * 0.001);
+
+    // following a period in other ticks
+    generator.SetPeriod(200000000 * 0.02f, 200000000);
+    EXPECT_EQ(generator.NextInterval(), 20000u);
+    EXPECT_NEAR(generator.GetBpm(), 125.f, 0.001f);
+}
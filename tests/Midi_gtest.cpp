@@ -506,6 +506,41 @@ TEST_F(MidiTest, systemRealTime)
     }
 }
 
+TEST_F(MidiTest, eventCallbackTimestamps)
+{
+    struct Received
+    {
+        SystemRealTimeType type;
+        uint32_t           tick;
+        int                count = 0;
+    } received;
+    midi.SetEventCallback(
+        [](const MidiEvent& event, uint32_t tick, void* context) {
+            auto r  = static_cast<Received*>(context);
+            r->type = event.srt_type;
+            r->tick = tick;
+            r->count++;
+        },
+        &received);
+
+    System::SetTickForUnitTest(1000);
+    uint8_t note_on[] = {0x90, 60, 100};
+    Parse(note_on, 3);
+    EXPECT_EQ(received.count, 1);
+    EXPECT_EQ(received.tick, 1000u);
+
+    System::SetTickForUnitTest(2000);
+    midi.Parse(0xf8);
+    EXPECT_EQ(received.count, 2);
+    EXPECT_EQ(received.type, TimingClock);
+    EXPECT_EQ(received.tick, 2000u);
+
+    // the events are still queued
+    EXPECT_EQ(midi.PopEvent().type, NoteOn);
+    EXPECT_EQ(midi.PopEvent().type, SystemRealTime);
+    EXPECT_FALSE(midi.HasEvents());
+}
+
 // ================ System Exclusive Messages ================
 
 TEST_F(MidiTest, systemExclusive)
@@ -0,0 +1,228 @@
+#include "dev/mpr121.h"
+#include <gtest/gtest.h>
+
+using namespace daisy;
+
+namespace
+{
+using Callback = void (*)(void* context, bool success);
+
+/** Simulates the registers of a MPR121 */
+struct Device
+{
+    uint8_t  regs[256]   = {};
+    uint8_t  pointer     = 0;
+    size_t   numReads    = 0;
+    size_t   numDmaReads = 0;
+    bool     irq         = false;
+    bool     fail        = false;
+    uint8_t* dmaData     = nullptr;
+    uint16_t dmaSize     = 0;
+    Callback dmaCallback = nullptr;
+    void*    dmaContext  = nullptr;
+
+    void SetTouched(uint16_t touched)
+    {
+        regs[0] = touched & 0xFF;
+        regs[1] = touched >> 8;
+    }
+
+    void SetFilteredData(uint8_t t, uint16_t value)
+    {
+        regs[0x04 + 2 * t] = value & 0xFF;
+        regs[0x05 + 2 * t] = value >> 8;
+    }
+
+    /** Finishes the DMA read, like the completion interrupt would */
+    void FinishDma(bool success = true)
+    {
+        const uint8_t reg = dmaData[0];
+        for(uint16_t i = 0; success && i < dmaSize; i++)
+            dmaData[i] = regs[uint8_t(reg + i)];
+        dmaCallback(dmaContext, success);
+    }
+};
+
+class MockTransport
+{
+  public:
+    struct Config
+    {
+        Device* device = nullptr;
+    };
+
+    bool Init(Config config)
+    {
+        dev_ = config.device;
+        return false;
+    }
+
+    bool Write(uint8_t* data, uint16_t size)
+    {
+        dev_->pointer = data[0];
+        if(size > 1)
+            dev_->regs[data[0]] = data[1];
+        return dev_->fail;
+    }
+
+    bool Read(uint8_t* data, uint16_t size)
+    {
+        dev_->numReads++;
+        for(uint16_t i = 0; i < size; i++)
+            data[i] = dev_->regs[uint8_t(dev_->pointer + i)];
+        return dev_->fail;
+    }
+
+    bool ReadDma(uint8_t  reg,
+                 uint8_t* data,
+                 uint16_t size,
+                 Callback callback,
+                 void*    context)
+    {
+        dev_->numDmaReads++;
+        data[0]           = reg;
+        dev_->dmaData     = data;
+        dev_->dmaSize     = size;
+        dev_->dmaCallback = callback;
+        dev_->dmaContext  = context;
+        return dev_->fail;
+    }
+
+    bool IsIrqActive() { return dev_->irq; }
+
+  private:
+    Device* dev_;
+};
+
+using TestMpr121 = Mpr121<MockTransport>;
+
+void InitDevice(TestMpr121& mpr, Device& dev, uint8_t* dmaBuffer = nullptr)
+{
+    TestMpr121::Config config;
+    config.transport_config.device = &dev;
+    config.dma_buffer              = dmaBuffer;
+    EXPECT_EQ(mpr.Init(config), TestMpr121::OK);
+    dev.numReads = 0;
+}
+} // namespace
+
+TEST(dev_Mpr121, a_burstReadDecoding)
+{
+    Device     dev;
+    TestMpr121 mpr;
+    InitDevice(mpr, dev);
+
+    // bit 15 (over current) and the proximity channel aren't touch bits
+    dev.SetTouched(0x8000 | 0x1000 | 0x0805);
+    dev.regs[2] = 0x03;
+    dev.regs[3] = 0x90; // bit 12 is the proximity channel
+    for(uint8_t t = 0; t < TestMpr121::kNumChannels; t++)
+        dev.SetFilteredData(t, t * 70);
+
+    EXPECT_EQ(mpr.ReadAll(), TestMpr121::OK);
+    EXPECT_EQ(dev.numReads, 1u);
+    EXPECT_EQ(mpr.GetTouched(), 0x0805);
+    EXPECT_EQ(mpr.GetChanged(), 0x0805);
+    EXPECT_EQ(mpr.GetOutOfRange(), 0x1003);
+    for(uint8_t t = 0; t < TestMpr121::kNumChannels; t++)
+        EXPECT_EQ(mpr.GetFilteredData(t), t * 70) << int(t);
+    EXPECT_EQ(mpr.GetFilteredData(13), 0);
+
+    // the burst matches the single register reads
+    EXPECT_EQ(mpr.Touched(), mpr.GetTouched());
+    EXPECT_EQ(mpr.FilteredData(7), mpr.GetFilteredData(7));
+
+    dev.SetTouched(0x0004);
+    mpr.ReadAll();
+    EXPECT_EQ(mpr.GetTouched(), 0x0004);
+    EXPECT_EQ(mpr.GetChanged(), 0x0801);
+
+    // errors keep the previous values
+    dev.SetTouched(0x0FFF);
+    dev.fail = true;
+    EXPECT_EQ(mpr.ReadAll(), TestMpr121::ERR);
+    EXPECT_EQ(mpr.GetTouched(), 0x0004);
+}
+
+TEST(dev_Mpr121, b_irqSkipsPolling)
+{
+    Device     dev;
+    TestMpr121 mpr;
+    InitDevice(mpr, dev);
+
+    dev.SetTouched(0x0001);
+    EXPECT_FALSE(mpr.Update());
+    EXPECT_EQ(dev.numReads, 0u);
+    EXPECT_EQ(mpr.GetTouched(), 0);
+
+    dev.irq = true;
+    EXPECT_TRUE(mpr.Update());
+    EXPECT_EQ(dev.numReads, 1u);
+    EXPECT_EQ(mpr.GetTouched(), 0x0001);
+}
+
+TEST(dev_Mpr121, c_dmaWithCompletionCallback)
+{
+    Device     dev;
+    TestMpr121 mpr;
+    InitDevice(mpr, dev);
+    // a DMA buffer is required
+    EXPECT_EQ(mpr.StartReadAll(), TestMpr121::ERR);
+    EXPECT_EQ(dev.numDmaReads, 0u);
+    uint8_t dmaBuffer[TestMpr121::kBurstSize];
+    InitDevice(mpr, dev, dmaBuffer);
+
+    int  numCallbacks = 0;
+    bool lastSuccess  = false;
+    auto callback     = [](void* context, bool success) {
+        auto self = static_cast<std::pair<int*, bool*>*>(context);
+        (*self->first)++;
+        *self->second = success;
+    };
+    std::pair<int*, bool*> context(&numCallbacks, &lastSuccess);
+
+    dev.SetTouched(0x0100);
+    dev.SetFilteredData(12, 512);
+    EXPECT_EQ(mpr.StartReadAll(callback, &context), TestMpr121::OK);
+    EXPECT_TRUE(mpr.IsReading());
+    EXPECT_EQ(dev.dmaSize, TestMpr121::kBurstSize);
+    EXPECT_EQ(dev.dmaData, dmaBuffer);
+    EXPECT_EQ(dev.dmaData[0], 0x00);
+    // only one read at a time
+    EXPECT_EQ(mpr.StartReadAll(callback, &context), TestMpr121::ERR);
+    EXPECT_EQ(dev.numDmaReads, 1u);
+
+    // the results are updated before the callback
+    EXPECT_EQ(mpr.GetTouched(), 0);
+    dev.FinishDma();
+    EXPECT_FALSE(mpr.IsReading());
+    EXPECT_EQ(numCallbacks, 1);
+    EXPECT_TRUE(lastSuccess);
+    EXPECT_EQ(mpr.GetTouched(), 0x0100);
+    EXPECT_EQ(mpr.GetFilteredData(12), 512);
+
+    // failed transfers report an error and keep the values
+    dev.SetTouched(0x0200);
+    EXPECT_EQ(mpr.StartReadAll(callback, &context), TestMpr121::OK);
+    dev.FinishDma(false);
+    EXPECT_EQ(numCallbacks, 2);
+    EXPECT_FALSE(lastSuccess);
+    EXPECT_EQ(mpr.GetTouched(), 0x0100);
+
+    // failing to start doesn't block later reads
+    dev.fail = true;
+    EXPECT_EQ(mpr.StartReadAll(), TestMpr121::ERR);
+    EXPECT_FALSE(mpr.IsReading());
+    dev.fail = false;
+    EXPECT_EQ(mpr.StartReadAll(), TestMpr121::OK);
+    dev.FinishDma();
+    EXPECT_EQ(mpr.GetTouched(), 0x0200);
+
+    // the whole burst is read from the start register, whatever the
+    // first byte that arrives is
+    dev.SetTouched(0x0A05);
+    EXPECT_EQ(mpr.StartReadAll(), TestMpr121::OK);
+    dev.FinishDma();
+    EXPECT_EQ(mpr.GetTouched(), 0x0A05);
+    EXPECT_EQ(mpr.GetFilteredData(12), 512);
+}
@@ -0,0 +1,170 @@
+#include "dev/neopixel.h"
+#include <gtest/gtest.h>
+#include <vector>
+
+using namespace daisy;
+
+namespace
+{
+/** A write to the seesaw pixel buffer */
+struct BufferWrite
+{
+    uint16_t             offset;
+    std::vector<uint8_t> data;
+};
+
+/** All register writes of a MockTransport */
+struct Recording
+{
+    std::vector<BufferWrite> bufferWrites;
+    size_t                   numShows = 0;
+};
+
+class MockTransport
+{
+  public:
+    struct Config
+    {
+        Recording* recording = nullptr;
+    };
+
+    void Init(Config config) { recording_ = config.recording; }
+
+    void
+    WriteLen(uint8_t reg_high, uint8_t reg_low, uint8_t* buff, uint16_t size)
+    {
+        if(reg_high != 0x0E) // SEESAW_NEOPIXEL_BASE
+            return;
+        if(reg_low == 0x04) // SEESAW_NEOPIXEL_BUF
+        {
+            EXPECT_LE(size, 30);
+            BufferWrite write;
+            write.offset = (buff[0] << 8) | buff[1];
+            write.data.assign(buff + 2, buff + size);
+            recording_->bufferWrites.push_back(write);
+        }
+        else if(reg_low == 0x05) // SEESAW_NEOPIXEL_SHOW
+            recording_->numShows++;
+    }
+
+    void    Write8(uint8_t, uint8_t, uint8_t) {}
+    void    ReadLen(uint8_t, uint8_t, uint8_t*, uint16_t) {}
+    uint8_t Read8(uint8_t, uint8_t) { return 0; }
+    bool    GetError() { return false; }
+
+  private:
+    Recording* recording_;
+};
+
+using TestNeoPixel = NeoPixel<MockTransport>;
+
+void InitAndShow(TestNeoPixel& pixels, Recording& recording, uint16_t type)
+{
+    TestNeoPixel::Config config;
+    config.transport_config.recording = &recording;
+    config.type                       = type;
+    config.numLEDs                    = 16;
+    pixels.Init(config);
+    pixels.Show();
+    recording.bufferWrites.clear();
+    recording.numShows = 0;
+}
+
+void Show(TestNeoPixel& pixels)
+{
+    // the latch time must have passed
+    System::DelayUs(300);
+    pixels.Show();
+}
+} // namespace
+
+TEST(dev_NeoPixel, a_initialFrameIsSentInChunks)
+{
+    Recording            recording;
+    TestNeoPixel         pixels;
+    TestNeoPixel::Config config;
+    config.transport_config.recording = &recording;
+    pixels.Init(config);
+    EXPECT_TRUE(recording.bufferWrites.empty());
+
+    pixels.Show();
+    // 16 GRB pixels = 48 bytes
+    ASSERT_EQ(recording.bufferWrites.size(), 2u);
+    EXPECT_EQ(recording.bufferWrites[0].offset, 0);
+    EXPECT_EQ(recording.bufferWrites[0].data.size(), 28u);
+    EXPECT_EQ(recording.bufferWrites[1].offset, 28);
+    EXPECT_EQ(recording.bufferWrites[1].data.size(), 20u);
+    EXPECT_EQ(recording.numShows, 1u);
+
+    // nothing changed
+    Show(pixels);
+    EXPECT_EQ(recording.bufferWrites.size(), 2u);
+    EXPECT_EQ(recording.numShows, 2u);
+}
+
+TEST(dev_NeoPixel, b_onlyChangedPixelsAreSent)
+{
+    Recording    recording;
+    TestNeoPixel pixels;
+    InitAndShow(pixels, recording, NEO_GRB + NEO_KHZ800);
+
+    pixels.SetPixelColor(5, 0x11, 0x22, 0x33);
+    EXPECT_TRUE(recording.bufferWrites.empty()); // only sent with Show()
+    Show(pixels);
+    ASSERT_EQ(recording.bufferWrites.size(), 1u);
+    EXPECT_EQ(recording.bufferWrites[0].offset, 15);
+    EXPECT_EQ(recording.bufferWrites[0].data,
+              std::vector<uint8_t>({0x22, 0x11, 0x33}));
+
+    // setting the same color again doesn't send anything, and a single
+    // changed channel is sent alone
+    pixels.SetPixelColor(5, 0x11, 0x22, 0x33);
+    pixels.SetPixelColor(6, 0x000044);
+    Show(pixels);
+    ASSERT_EQ(recording.bufferWrites.size(), 2u);
+    EXPECT_EQ(recording.bufferWrites[1].offset, 18 + 2);
+    EXPECT_EQ(recording.bufferWrites[1].data, std::vector<uint8_t>({0x44}));
+    EXPECT_EQ(pixels.GetPixelColor(6), 0x000044u);
+}
+
+TEST(dev_NeoPixel, c_nearbyChangesAreMerged)
+{
+    Recording    recording;
+    TestNeoPixel pixels;
+    InitAndShow(pixels, recording, NEO_RGB + NEO_KHZ800);
+
+    // bytes 0..2 and 6..8 are merged, 15..17 is separate
+    pixels.SetPixelColor(0, 1, 2, 3);
+    pixels.SetPixelColor(2, 4, 5, 6);
+    pixels.SetPixelColor(5, 7, 8, 9);
+    Show(pixels);
+    ASSERT_EQ(recording.bufferWrites.size(), 2u);
+    EXPECT_EQ(recording.bufferWrites[0].offset, 0);
+    EXPECT_EQ(recording.bufferWrites[0].data,
+              std::vector<uint8_t>({1, 2, 3, 0, 0, 0, 4, 5, 6}));
+    EXPECT_EQ(recording.bufferWrites[1].offset, 15);
+    EXPECT_EQ(recording.bufferWrites[1].data, std::vector<uint8_t>({7, 8, 9}));
+
+    // Clear() only sends the pixels that were lit
+    pixels.Clear();
+    Show(pixels);
+    ASSERT_EQ(recording.bufferWrites.size(), 4u);
+    EXPECT_EQ(recording.bufferWrites[2].offset, 0);
+    EXPECT_EQ(recording.bufferWrites[2].data.size(), 9u);
+    EXPECT_EQ(recording.bufferWrites[3].offset, 15);
+    EXPECT_EQ(recording.bufferWrites[3].data.size(), 3u);
+}
+
+TEST(dev_NeoPixel, d_rgbw)
+{
+    Recording    recording;
+    TestNeoPixel pixels;
+    InitAndShow(pixels, recording, NEO_GRBW + NEO_KHZ800);
+
+    pixels.SetPixelColor(15, 0x10, 0x20, 0x30, 0x40);
+    Show(pixels);
+    ASSERT_EQ(recording.bufferWrites.size(), 1u);
+    EXPECT_EQ(recording.bufferWrites[0].offset, 60);
+    EXPECT_EQ(recording.bufferWrites[0].data,
+              std::vector<uint8_t>({0x20, 0x10, 0x30, 0x40}));
+}
@@ -212,4 +212,18 @@ TEST(hid_disp_Rectangle, k_alignedWithin)
               Rectangle(90, 45, 10, 10));
     EXPECT_EQ(srcRect.AlignedWithin(boundingBox, Alignment::centered),
               Rectangle(45, 45, 10, 10));
-}
\ No newline at end of file
+}
+TEST(hid_disp_Rectangle, l_union)
+{
+    const auto a = Rectangle(10, 10, 10, 10);
+    const auto b = Rectangle(30, 5, 5, 10);
+    EXPECT_EQ(a.GetUnion(b), Rectangle(10, 5, 25, 15));
+    EXPECT_EQ(b.GetUnion(a), Rectangle(10, 5, 25, 15));
+    // overlapping
+    EXPECT_EQ(a.GetUnion(Rectangle(15, 15, 10, 10)), Rectangle(10, 10, 15, 15));
+    // contained
+    EXPECT_EQ(a.GetUnion(Rectangle(12, 12, 2, 2)), a);
+    // empty rectangles are ignored
+    EXPECT_EQ(a.GetUnion(Rectangle(0, 0, 0, 0)), a);
+    EXPECT_EQ(Rectangle(50, 50, 0, 0).GetUnion(a), a);
+}
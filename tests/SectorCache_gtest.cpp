@@ -0,0 +1,387 @@
+#include "util/SectorCache.h"
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+using namespace daisy;
+
+namespace
+{
+constexpr size_t kSectorSize     = 512;
+constexpr size_t kNumSectors     = 256;
+constexpr size_t kNumLines       = 4;
+constexpr size_t kSectorsPerLine = 4;
+
+using TestCache = SectorCache<kNumLines>;
+
+/** Time of the simulated device, which takes 10 ticks per sector */
+uint32_t testTicks = 0;
+uint32_t GetTestTick()
+{
+    return testTicks;
+}
+
+/** A block device backed by a temporary file */
+class FileBlockDevice : public TestCache::BlockDevice
+{
+  public:
+    FileBlockDevice()
+    {
+        file_ = std::tmpfile();
+        // fill each sector with a recognizable pattern
+        std::vector<uint8_t> sector(kSectorSize);
+        for(size_t s = 0; s < kNumSectors; s++)
+        {
+            for(size_t i = 0; i < kSectorSize; i++)
+                sector[i] = uint8_t(s * 7 + i);
+            std::fwrite(sector.data(), 1, kSectorSize, file_);
+        }
+    }
+    ~FileBlockDevice() { std::fclose(file_); }
+
+    bool Read(uint8_t* dest, uint32_t sector, uint32_t count) override
+    {
+        if(failNext_ || sector + count > kNumSectors)
+            return failNext_ = false;
+        testTicks += count * 10;
+        std::fseek(file_, long(sector * kSectorSize), SEEK_SET);
+        return std::fread(dest, kSectorSize, count, file_) == count;
+    }
+
+    bool Write(const uint8_t* src, uint32_t sector, uint32_t count) override
+    {
+        if(failNext_ || sector + count > kNumSectors)
+            return failNext_ = false;
+        testTicks += count * 10;
+        std::fseek(file_, long(sector * kSectorSize), SEEK_SET);
+        return std::fwrite(src, kSectorSize, count, file_) == count;
+    }
+
+    /** Background reads complete after a few polls, like a USB transfer */
+    bool StartRead(uint8_t* dest, uint32_t sector, uint32_t count) override
+    {
+        pendingDest_   = dest;
+        pendingSector_ = sector;
+        pendingCount_  = count;
+        pollsLeft_     = 3;
+        return true;
+    }
+
+    TestCache::ReadState PollRead() override
+    {
+        if(pollsLeft_-- > 0)
+            return TestCache::ReadState::BUSY;
+        return Read(pendingDest_, pendingSector_, pendingCount_)
+                   ? TestCache::ReadState::DONE
+                   : TestCache::ReadState::FAILED;
+    }
+
+    bool CanTransfer(const uint8_t* buffer) const override
+    {
+        return !alignedOnly_ || (uintptr_t(buffer) & 3) == 0;
+    }
+
+    void FailNextAccess() { failNext_ = true; }
+    void SetAlignedOnly(bool alignedOnly) { alignedOnly_ = alignedOnly; }
+
+  private:
+    std::FILE* file_;
+    bool       failNext_      = false;
+    bool       alignedOnly_   = false;
+    uint8_t*   pendingDest_   = nullptr;
+    uint32_t   pendingSector_ = 0;
+    uint32_t   pendingCount_  = 0;
+    int        pollsLeft_     = 0;
+};
+
+std::vector<uint8_t> MakeSectors(size_t count, uint8_t seed)
+{
+    std::vector<uint8_t> data(count * kSectorSize);
+    for(size_t i = 0; i < data.size(); i++)
+        data[i] = uint8_t(seed + i * 13);
+    return data;
+}
+
+class util_SectorCache : public ::testing::Test
+{
+  protected:
+    void SetUp() override
+    {
+        memory_.resize(kNumLines * kSectorsPerLine * kSectorSize);
+        cache_.Init(device_, memory_.data(), kSectorsPerLine, kSectorSize);
+    }
+
+    std::vector<uint8_t> ReadFromDevice(uint32_t sector, uint32_t count)
+    {
+        std::vector<uint8_t> data(count * kSectorSize);
+        device_.Read(data.data(), sector, count);
+        return data;
+    }
+
+    void RandomAccessMatchesReference(bool readAhead);
+
+    FileBlockDevice      device_;
+    std::vector<uint8_t> memory_;
+    TestCache            cache_;
+};
+} // namespace
+
+TEST_F(util_SectorCache, a_readAhead)
+{
+    // reading a stream sector by sector only loads each line once
+    std::vector<uint8_t> sector(kSectorSize);
+    for(uint32_t s = 16; s < 32; s++)
+    {
+        ASSERT_TRUE(cache_.Read(sector.data(), s, 1));
+        EXPECT_EQ(sector, ReadFromDevice(s, 1));
+    }
+    EXPECT_EQ(cache_.GetStats().deviceReads, 4u);
+    EXPECT_EQ(cache_.GetStats().sectorsRead, 16u);
+    EXPECT_EQ(cache_.GetStats().misses, 4u);
+    EXPECT_EQ(cache_.GetStats().hits, 12u);
+}
+
+TEST_F(util_SectorCache, b_largeReadsBypassTheCache)
+{
+    std::vector<uint8_t> data(8 * kSectorSize);
+    ASSERT_TRUE(cache_.Read(data.data(), 3, 8));
+    EXPECT_EQ(data, ReadFromDevice(3, 8));
+    EXPECT_EQ(cache_.GetStats().deviceReads, 1u);
+    EXPECT_FALSE(cache_.IsCached(3));
+}
+
+TEST_F(util_SectorCache, c_fatSectorsSurviveStreaming)
+{
+    // a FAT sector is accessed repeatedly while a long stream is read
+    std::vector<uint8_t> sector(kSectorSize);
+    constexpr uint32_t   kFatSector = 2;
+    ASSERT_TRUE(cache_.Read(sector.data(), kFatSector, 1));
+    for(uint32_t s = 64; s < 192; s++)
+    {
+        ASSERT_TRUE(cache_.Read(sector.data(), s, 1));
+        if(s % 32 == 0)
+        {
+            ASSERT_TRUE(cache_.Read(sector.data(), kFatSector, 1));
+        }
+    }
+    EXPECT_TRUE(cache_.IsCached(kFatSector));
+    // the FAT line was loaded once, the stream once per line
+    EXPECT_EQ(cache_.GetStats().deviceReads, 1u + 128 / kSectorsPerLine);
+}
+
+TEST_F(util_SectorCache, d_writeBackIsCoalesced)
+{
+    // a recording that writes single sectors
+    const auto data = MakeSectors(8, 42);
+    for(uint32_t i = 0; i < 8; i++)
+        ASSERT_TRUE(cache_.Write(&data[i * kSectorSize], 40 + i, 1));
+    EXPECT_EQ(cache_.GetStats().deviceWrites, 0u);
+    EXPECT_EQ(cache_.GetNumDirtySectors(), 8u);
+
+    // reading back comes from the cache
+    std::vector<uint8_t> readBack(8 * kSectorSize);
+    for(uint32_t i = 0; i < 8; i++)
+        ASSERT_TRUE(cache_.Read(&readBack[i * kSectorSize], 40 + i, 1));
+    EXPECT_EQ(readBack, data);
+    EXPECT_EQ(cache_.GetStats().deviceReads, 0u);
+
+    // one write per line
+    ASSERT_TRUE(cache_.Flush());
+    EXPECT_EQ(cache_.GetStats().deviceWrites, 2u);
+    EXPECT_EQ(cache_.GetStats().sectorsWritten, 8u);
+    EXPECT_EQ(cache_.GetNumDirtySectors(), 0u);
+    EXPECT_EQ(ReadFromDevice(40, 8), data);
+}
+
+TEST_F(util_SectorCache, e_partialLinesAreMerged)
+{
+    // write one sector of a line, then read its neighbour: the line must be
+    // loaded without losing the modification
+    const auto data = MakeSectors(1, 7);
+    ASSERT_TRUE(cache_.Write(data.data(), 9, 1));
+    std::vector<uint8_t> sector(kSectorSize);
+    ASSERT_TRUE(cache_.Read(sector.data(), 10, 1));
+    EXPECT_EQ(sector, ReadFromDevice(10, 1));
+    ASSERT_TRUE(cache_.Read(sector.data(), 9, 1));
+    EXPECT_EQ(sector, data);
+    EXPECT_EQ(ReadFromDevice(9, 1), data);
+}
+
+TEST_F(util_SectorCache, f_largeAccessesStayCoherent)
+{
+    // cached dirty data is flushed before a large read
+    const auto small = MakeSectors(1, 1);
+    ASSERT_TRUE(cache_.Write(small.data(), 5, 1));
+    std::vector<uint8_t> data(8 * kSectorSize);
+    ASSERT_TRUE(cache_.Read(data.data(), 0, 8));
+    EXPECT_TRUE(std::equal(
+        small.begin(), small.end(), data.begin() + 5 * kSectorSize));
+
+    // a large write updates cached copies
+    std::vector<uint8_t> sector(kSectorSize);
+    ASSERT_TRUE(cache_.Read(sector.data(), 20, 1));
+    const auto large = MakeSectors(8, 99);
+    ASSERT_TRUE(cache_.Write(large.data(), 18, 8));
+    ASSERT_TRUE(cache_.Read(sector.data(), 20, 1));
+    EXPECT_TRUE(std::equal(
+        sector.begin(), sector.end(), large.begin() + 2 * kSectorSize));
+}
+
+TEST_F(util_SectorCache, g_randomAccessMatchesReference)
+{
+    RandomAccessMatchesReference(false);
+}
+
+void util_SectorCache::RandomAccessMatchesReference(bool readAhead)
+{
+    // compare against a plain copy of the device for random accesses
+    cache_.SetReadAhead(readAhead);
+    std::vector<uint8_t> reference = ReadFromDevice(0, kNumSectors);
+    std::srand(1234);
+    for(int n = 0; n < 2000; n++)
+    {
+        if(n % 3 == 0)
+            cache_.Poll();
+        const uint32_t count  = 1 + std::rand() % 6;
+        const uint32_t sector = std::rand() % (kNumSectors - count);
+        if(std::rand() % 3 == 0)
+        {
+            const auto data = MakeSectors(count, uint8_t(n));
+            ASSERT_TRUE(cache_.Write(data.data(), sector, count));
+            std::copy(data.begin(),
+                      data.end(),
+                      reference.begin() + sector * kSectorSize);
+        }
+        else
+        {
+            std::vector<uint8_t> data(count * kSectorSize);
+            ASSERT_TRUE(cache_.Read(data.data(), sector, count));
+            ASSERT_TRUE(std::equal(data.begin(),
+                                   data.end(),
+                                   reference.begin() + sector * kSectorSize))
+                << "iteration " << n;
+        }
+        if(n % 500 == 0)
+        {
+            ASSERT_TRUE(cache_.Flush());
+        }
+    }
+    ASSERT_TRUE(cache_.Flush());
+    EXPECT_EQ(ReadFromDevice(0, kNumSectors), reference);
+}
+
+TEST_F(util_SectorCache, h_errorsArePropagated)
+{
+    std::vector<uint8_t> sector(kSectorSize);
+    device_.FailNextAccess();
+    EXPECT_FALSE(cache_.Read(sector.data(), 0, 1));
+    EXPECT_FALSE(cache_.IsCached(0));
+    EXPECT_TRUE(cache_.Read(sector.data(), 0, 1));
+
+    ASSERT_TRUE(cache_.Write(sector.data(), 100, 1));
+    device_.FailNextAccess();
+    EXPECT_FALSE(cache_.Flush());
+    // the data is kept and can be flushed later
+    EXPECT_EQ(cache_.GetNumDirtySectors(), 1u);
+    EXPECT_TRUE(cache_.Flush());
+}
+
+TEST_F(util_SectorCache, i_readAheadInBackground)
+{
+    cache_.SetReadAhead(true);
+    // a stream read sector by sector only misses its first line
+    std::vector<uint8_t> sector(kSectorSize);
+    for(uint32_t s = 64; s < 128; s++)
+    {
+        ASSERT_TRUE(cache_.Read(sector.data(), s, 1));
+        EXPECT_EQ(sector, ReadFromDevice(s, 1));
+        // the main loop does other work meanwhile
+        while(cache_.Poll()) {}
+    }
+    EXPECT_EQ(cache_.GetStats().misses, 1u);
+    EXPECT_GE(cache_.GetStats().readAheads, 64u / kSectorsPerLine - 1);
+
+    // large reads take the start from the line that was read ahead, once
+    // they're recognized as a stream
+    cache_.ResetStats();
+    std::vector<uint8_t> data(8 * kSectorSize);
+    for(uint32_t s = 160; s < 224; s += 8)
+    {
+        ASSERT_TRUE(cache_.Read(data.data(), s, 8));
+        EXPECT_EQ(data, ReadFromDevice(s, 8));
+        while(cache_.Poll()) {}
+    }
+    EXPECT_EQ(cache_.GetStats().hits, 6u * kSectorsPerLine);
+    EXPECT_EQ(cache_.GetStats().readAheads, 7u);
+}
+
+TEST_F(util_SectorCache, j_readAheadStaysCoherent)
+{
+    cache_.SetReadAhead(true);
+    std::vector<uint8_t> sector(kSectorSize);
+    ASSERT_TRUE(cache_.Read(sector.data(), 0, 1));
+    ASSERT_TRUE(cache_.Read(sector.data(), 1, 1));
+    EXPECT_TRUE(cache_.Poll());
+
+    // writing into the line that's being read waits for it
+    const auto small = MakeSectors(1, 3);
+    ASSERT_TRUE(cache_.Write(small.data(), 5, 1));
+    EXPECT_FALSE(cache_.Poll());
+    std::vector<uint8_t> data(4 * kSectorSize);
+    ASSERT_TRUE(cache_.Read(data.data(), 4, 4));
+    EXPECT_TRUE(std::equal(
+        small.begin(), small.end(), data.begin() + 1 * kSectorSize));
+    EXPECT_EQ(cache_.GetStats().misses, 1u);
+
+    // a failed read ahead is dropped, the stream reads it again
+    while(cache_.Poll()) {}
+    ASSERT_TRUE(cache_.Read(data.data(), 8, 4));
+    ASSERT_TRUE(cache_.Read(sector.data(), 12, 1));
+    device_.FailNextAccess();
+    while(cache_.Poll()) {}
+    EXPECT_FALSE(cache_.IsCached(16));
+    ASSERT_TRUE(cache_.Read(sector.data(), 16, 1));
+    EXPECT_EQ(sector, ReadFromDevice(16, 1));
+}
+
+TEST_F(util_SectorCache, k_unalignedBuffersGoThroughLines)
+{
+    // a DMA that can't reach the buffer still gets whole lines
+    device_.SetAlignedOnly(true);
+    std::vector<uint8_t> buffer(8 * kSectorSize + 1);
+    ASSERT_TRUE(cache_.Read(buffer.data() + 1, 32, 8));
+    EXPECT_TRUE(std::equal(
+        buffer.begin() + 1, buffer.end(), ReadFromDevice(32, 8).begin()));
+    EXPECT_EQ(cache_.GetStats().deviceReads, 8u / kSectorsPerLine);
+
+    const auto data = MakeSectors(8, 11);
+    std::copy(data.begin(), data.end(), buffer.begin() + 1);
+    ASSERT_TRUE(cache_.Write(buffer.data() + 1, 48, 8));
+    EXPECT_EQ(cache_.GetNumDirtySectors(), 8u);
+    ASSERT_TRUE(cache_.Flush());
+    EXPECT_EQ(cache_.GetStats().deviceWrites, 8u / kSectorsPerLine);
+    EXPECT_EQ(ReadFromDevice(48, 8), data);
+}
+
+TEST_F(util_SectorCache, l_throughput)
+{
+    std::vector<uint8_t> data(8 * kSectorSize);
+    ASSERT_TRUE(cache_.Read(data.data(), 0, 8));
+    EXPECT_EQ(cache_.GetReadThroughput(), 0.f);
+
+    // 10 ticks of 1us per sector
+    cache_.SetClock(GetTestTick, 1000000);
+    cache_.ResetStats();
+    ASSERT_TRUE(cache_.Read(data.data(), 0, 8));
+    ASSERT_TRUE(cache_.Write(data.data(), 8, 8));
+    EXPECT_EQ(cache_.GetStats().readTicks, 80u);
+    EXPECT_FLOAT_EQ(cache_.GetReadThroughput(), 51.2e6f);
+    EXPECT_FLOAT_EQ(cache_.GetWriteThroughput(), 51.2e6f);
+}
+
+TEST_F(util_SectorCache, m_randomAccessWithReadAhead)
+{
+    RandomAccessMatchesReference(true);
+}
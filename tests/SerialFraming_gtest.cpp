@@ -0,0 +1,166 @@
+#include "util/SerialFraming.h"
+#include <gtest/gtest.h>
+#include <vector>
+
+using namespace daisy;
+
+namespace
+{
+std::vector<uint8_t>
+Encode(uint8_t endpoint, uint8_t sequence, const std::vector<uint8_t>& payload)
+{
+    std::vector<uint8_t> frame(
+        SerialFrameEncoder::GetMaxEncodedSize(payload.size()));
+    frame.resize(SerialFrameEncoder::Encode(
+        endpoint, sequence, payload.data(), payload.size(), frame.data()));
+    return frame;
+}
+
+/** Feeds bytes and collects the payloads of the decoded frames */
+template <size_t max_payload>
+std::vector<std::vector<uint8_t>>
+Decode(SerialFrameDecoder<max_payload>& decoder,
+       const std::vector<uint8_t>&      bytes)
+{
+    std::vector<std::vector<uint8_t>> payloads;
+    SerialFrame                       frame;
+    for(uint8_t byte : bytes)
+        if(decoder.Feed(byte, frame))
+            payloads.emplace_back(frame.payload, frame.payload + frame.size);
+    return payloads;
+}
+} // namespace
+
+TEST(util_SerialFraming, a_crc)
+{
+    // the check value of CRC-16/CCITT-FALSE
+    const uint8_t digits[] = {'1', '2', '3', '4', '5', '6', '7', '8', '9'};
+    EXPECT_EQ(SerialFrameEncoder::ComputeCrc(digits, sizeof(digits)), 0x29b1);
+    EXPECT_EQ(SerialFrameEncoder::ComputeCrc(digits, 0), 0xffff);
+    // computing in parts gives the same result
+    const uint16_t part = SerialFrameEncoder::ComputeCrc(digits, 4);
+    EXPECT_EQ(SerialFrameEncoder::ComputeCrc(digits + 4, 5, part), 0x29b1);
+}
+
+TEST(util_SerialFraming, b_roundTrip)
+{
+    SerialFrameDecoder<600> decoder;
+
+    // payloads with zeros, without zeros, and around the 254 byte blocks
+    // of COBS
+    std::vector<std::vector<uint8_t>> payloads;
+    payloads.push_back({});
+    payloads.push_back({0});
+    payloads.push_back({0, 0, 0});
+    payloads.push_back({1, 2, 0, 3});
+    for(size_t size : {253, 254, 255, 508, 600})
+    {
+        std::vector<uint8_t> nonzero, mixed;
+        for(size_t i = 0; i < size; i++)
+        {
+            nonzero.push_back(uint8_t(i % 255 + 1));
+            mixed.push_back(uint8_t(i * 7));
+        }
+        payloads.push_back(nonzero);
+        payloads.push_back(mixed);
+    }
+
+    std::vector<uint8_t> stream;
+    uint8_t              sequence = 0;
+    for(const auto& payload : payloads)
+    {
+        const auto frame = Encode(3, sequence++, payload);
+        EXPECT_LE(frame.size(),
+                  SerialFrameEncoder::GetMaxEncodedSize(payload.size()));
+        // only the delimiter is zero
+        for(size_t i = 0; i + 1 < frame.size(); i++)
+            ASSERT_NE(frame[i], 0);
+        EXPECT_EQ(frame.back(), 0);
+        stream.insert(stream.end(), frame.begin(), frame.end());
+    }
+    EXPECT_EQ(Decode(decoder, stream), payloads);
+    EXPECT_EQ(decoder.GetNumFrames(), payloads.size());
+    EXPECT_EQ(decoder.GetNumErrors(), 0u);
+    EXPECT_EQ(decoder.GetNumLost(), 0u);
+
+    // endpoint and sequence number come through
+    SerialFrame frame;
+    for(uint8_t byte : Encode(31, 200, {5}))
+        if(decoder.Feed(byte, frame))
+            break;
+    EXPECT_EQ(frame.endpoint, 31);
+    EXPECT_EQ(frame.sequence, 200);
+    EXPECT_EQ(frame.size, 1u);
+}
+
+TEST(util_SerialFraming, c_dropsBadFrames)
+{
+    SerialFrameDecoder<16> decoder;
+    const std::vector<uint8_t> payload = {1, 2, 3, 0, 4};
+
+    // garbage up to a delimiter, e.g. when the host connects
+    std::vector<uint8_t> stream = {9, 9, 9, 0};
+    auto                 frame  = Encode(1, 0, payload);
+    stream.insert(stream.end(), frame.begin(), frame.end());
+    EXPECT_EQ(Decode(decoder, stream).size(), 1u);
+    EXPECT_EQ(decoder.GetNumErrors(), 1u);
+
+    // a corrupted byte fails the CRC, the next frame is fine again
+    frame    = Encode(1, 1, payload);
+    frame[3] = frame[3] ^ 0x10;
+    stream   = frame;
+    frame    = Encode(1, 2, payload);
+    stream.insert(stream.end(), frame.begin(), frame.end());
+    EXPECT_EQ(Decode(decoder, stream).size(), 1u);
+    EXPECT_EQ(decoder.GetNumErrors(), 2u);
+    // ... and the corrupted frame shows up as lost
+    EXPECT_EQ(decoder.GetNumLost(), 1u);
+
+    // a truncated frame and unknown endpoints are errors
+    frame = Encode(1, 3, payload);
+    frame.erase(frame.begin() + 4, frame.end() - 1);
+    EXPECT_EQ(Decode(decoder, frame).size(), 0u);
+    EXPECT_EQ(Decode(decoder, Encode(32, 0, payload)).size(), 0u);
+    EXPECT_EQ(decoder.GetNumErrors(), 4u);
+
+    // a frame that's too long is skipped up to the next delimiter
+    stream = Encode(1, 4, std::vector<uint8_t>(40, 1));
+    frame  = Encode(1, 5, payload);
+    stream.insert(stream.end(), frame.begin(), frame.end());
+    EXPECT_EQ(Decode(decoder, stream).size(), 1u);
+    EXPECT_EQ(decoder.GetNumOverflows(), 1u);
+    EXPECT_EQ(decoder.GetNumFrames(), 3u);
+
+    // sequence numbers count per endpoint and wrap around
+    Decode(decoder, Encode(2, 255, payload));
+    Decode(decoder, Encode(2, 0, payload));
+    EXPECT_EQ(decoder.GetNumLost(), 3u);
+    Decode(decoder, Encode(2, 3, payload));
+    EXPECT_EQ(decoder.GetNumLost(), 5u);
+}
+
+TEST(util_SerialFraming, d_payloadReaderAndWriter)
+{
+    uint8_t             buffer[11];
+    SerialPayloadWriter writer(buffer, sizeof(buffer));
+    writer.PutU8(0xab);
+    writer.PutU16(0x1234);
+    writer.PutFloat(-0.25f);
+    writer.PutU32(0xdeadbeef);
+    EXPECT_FALSE(writer.IsOverflow());
+    EXPECT_EQ(writer.GetSize(), 11u);
+    EXPECT_EQ(buffer[1], 0x34); // little endian
+    writer.PutU8(1);
+    EXPECT_TRUE(writer.IsOverflow());
+    EXPECT_EQ(writer.GetSize(), 11u);
+
+    SerialPayloadReader reader(buffer, sizeof(buffer));
+    EXPECT_EQ(reader.GetU8(), 0xab);
+    EXPECT_EQ(reader.GetU16(), 0x1234);
+    EXPECT_EQ(reader.GetFloat(), -0.25f);
+    EXPECT_EQ(reader.GetRemainingSize(), 4u);
+    EXPECT_EQ(reader.GetU32(), 0xdeadbeef);
+    EXPECT_FALSE(reader.IsError());
+    EXPECT_EQ(reader.GetU16(), 0);
+    EXPECT_TRUE(reader.IsError());
+}
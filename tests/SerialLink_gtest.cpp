@@ -0,0 +1,267 @@
+#include "hid/serial_link.h"
+#include <gtest/gtest.h>
+#include <map>
+#include <vector>
+
+using namespace daisy;
+
+namespace
+{
+/** Connects two links in memory. Written bytes are delivered when the
+ *  link flushes, like a transfer. */
+class LoopbackTransport
+{
+  public:
+    struct Config
+    {
+        std::vector<uint8_t>* rx          = nullptr;
+        std::vector<uint8_t>* tx          = nullptr;
+        size_t                tx_capacity = 1024;
+    };
+
+    bool Init(const Config& config)
+    {
+        config_ = config;
+        return true;
+    }
+
+    UartSpan GetReadable()
+    {
+        UartSpan span;
+        span.size = config_.rx->size();
+        span.data = span.size > 0 ? config_.rx->data() : nullptr;
+        return span;
+    }
+
+    void Consume(size_t size)
+    {
+        config_.rx->erase(config_.rx->begin(), config_.rx->begin() + size);
+    }
+
+    size_t GetTxFree() const { return config_.tx_capacity - pending_.size(); }
+
+    size_t Write(const uint8_t* data, size_t size)
+    {
+        pending_.insert(pending_.end(), data, data + size);
+        return size;
+    }
+
+    void Flush()
+    {
+        if(!busy_)
+        {
+            config_.tx->insert(
+                config_.tx->end(), pending_.begin(), pending_.end());
+            pending_.clear();
+        }
+    }
+
+    bool busy_ = false;
+
+  private:
+    Config               config_;
+    std::vector<uint8_t> pending_;
+};
+
+typedef SerialLink<LoopbackTransport, 64> TestLink;
+
+/** A device with parameters, and a host that records what it receives */
+struct LinkPair
+{
+    std::vector<uint8_t>              to_device, to_host;
+    TestLink                          device, host;
+    std::map<uint16_t, float>         params;
+    std::vector<SerialFrame>          frames;
+    std::vector<std::vector<uint8_t>> payloads;
+
+    LinkPair()
+    {
+        TestLink::Config device_config;
+        device_config.transport_config.rx = &to_device;
+        device_config.transport_config.tx = &to_host;
+        device_config.param_get           = ParamGet;
+        device_config.param_set           = ParamSet;
+        device_config.context             = this;
+        device.Init(device_config);
+
+        TestLink::Config host_config;
+        host_config.transport_config.rx = &to_host;
+        host_config.transport_config.tx = &to_device;
+        host_config.frame_callback      = OnFrame;
+        host_config.context             = this;
+        host.Init(host_config);
+
+        params[7] = 0.5f;
+    }
+
+    void Process()
+    {
+        host.Process();
+        device.Process();
+        host.Process();
+    }
+
+    static bool ParamGet(uint16_t id, float& value, void* context)
+    {
+        auto& params = static_cast<LinkPair*>(context)->params;
+        if(params.count(id) == 0)
+            return false;
+        value = params[id];
+        return true;
+    }
+
+    static bool ParamSet(uint16_t id, float value, void* context)
+    {
+        auto& params = static_cast<LinkPair*>(context)->params;
+        if(params.count(id) == 0)
+            return false;
+        // the device limits the range
+        params[id] = value > 1.f ? 1.f : value;
+        return true;
+    }
+
+    static void OnFrame(const SerialFrame& frame, void* context)
+    {
+        auto* pair = static_cast<LinkPair*>(context);
+        pair->frames.push_back(frame);
+        pair->payloads.emplace_back(frame.payload, frame.payload + frame.size);
+    }
+};
+} // namespace
+
+TEST(hid_SerialLink, a_pingAndParameters)
+{
+    LinkPair link;
+
+    const uint8_t ping[] = {1, 0, 2};
+    EXPECT_TRUE(link.host.SendFrame(SerialEndpoint::PING, ping, 3));
+    uint8_t request[6];
+    {
+        SerialPayloadWriter writer(request, sizeof(request));
+        writer.PutU16(7);
+        link.host.SendFrame(SerialEndpoint::PARAM_GET, request, 2);
+    }
+    {
+        SerialPayloadWriter writer(request, sizeof(request));
+        writer.PutU16(7);
+        writer.PutFloat(3.f);
+        link.host.SendFrame(SerialEndpoint::PARAM_SET, request, 6);
+    }
+    {
+        SerialPayloadWriter writer(request, sizeof(request));
+        writer.PutU16(8);
+        link.host.SendFrame(SerialEndpoint::PARAM_GET, request, 2);
+    }
+    link.Process();
+
+    ASSERT_EQ(link.frames.size(), 4u);
+    EXPECT_EQ(link.frames[0].endpoint, uint8_t(SerialEndpoint::PONG));
+    EXPECT_EQ(link.payloads[0], std::vector<uint8_t>(ping, ping + 3));
+    link.frames.erase(link.frames.begin());
+    link.payloads.erase(link.payloads.begin());
+
+    SerialPayloadReader value(link.payloads[0].data(), link.payloads[0].size());
+    EXPECT_EQ(link.frames[0].endpoint, uint8_t(SerialEndpoint::PARAM_VALUE));
+    EXPECT_EQ(value.GetU16(), 7);
+    EXPECT_EQ(value.GetFloat(), 0.5f);
+    EXPECT_EQ(value.GetU8(), 0);
+
+    // the answer to a set is the value the device actually uses
+    SerialPayloadReader set(link.payloads[1].data(), link.payloads[1].size());
+    EXPECT_EQ(set.GetU16(), 7);
+    EXPECT_EQ(set.GetFloat(), 1.f);
+    EXPECT_EQ(set.GetU8(), 0);
+    EXPECT_EQ(link.params[7], 1.f);
+
+    SerialPayloadReader unknown(link.payloads[2].data(),
+                                link.payloads[2].size());
+    EXPECT_EQ(unknown.GetU16(), 8);
+    unknown.GetFloat();
+    EXPECT_EQ(unknown.GetU8(), 1);
+
+    EXPECT_EQ(link.device.GetDecoder().GetNumFrames(), 4u);
+    EXPECT_EQ(link.device.GetDecoder().GetNumErrors(), 0u);
+    EXPECT_EQ(link.host.GetDecoder().GetNumLost(), 0u);
+}
+
+TEST(hid_SerialLink, b_telemetryAndBulk)
+{
+    LinkPair link;
+
+    const float meters[] = {0.f, 0.25f, -1.f};
+    EXPECT_TRUE(link.device.SendMeters(meters, 3));
+
+    std::vector<float> samples;
+    for(size_t i = 0; i < TestLink::GetMaxScopeSamples(); i++)
+        samples.push_back(i % 2 ? 2.f : -0.5f);
+    EXPECT_TRUE(
+        link.device.SendScope(1, 1000, samples.data(), samples.size()));
+    EXPECT_FALSE(
+        link.device.SendScope(1, 0, samples.data(), samples.size() + 1));
+
+    std::vector<uint8_t> bulk(150);
+    for(size_t i = 0; i < bulk.size(); i++)
+        bulk[i] = uint8_t(i);
+    EXPECT_EQ(link.device.SendBulk(bulk.data(), bulk.size()), bulk.size());
+    link.Process();
+
+    ASSERT_EQ(link.frames.size(), 5u);
+    SerialPayloadReader meter(link.payloads[0].data(), link.payloads[0].size());
+    EXPECT_EQ(link.frames[0].endpoint, uint8_t(SerialEndpoint::METER));
+    EXPECT_EQ(meter.GetFloat(), 0.f);
+    EXPECT_EQ(meter.GetFloat(), 0.25f);
+    EXPECT_EQ(meter.GetFloat(), -1.f);
+    EXPECT_EQ(meter.GetRemainingSize(), 0u);
+
+    SerialPayloadReader scope(link.payloads[1].data(), link.payloads[1].size());
+    EXPECT_EQ(scope.GetU8(), 1);
+    EXPECT_EQ(scope.GetU32(), 1000u);
+    EXPECT_EQ(int16_t(scope.GetU16()), -16383);
+    EXPECT_EQ(int16_t(scope.GetU16()), 32767); // clipped
+    EXPECT_EQ(scope.GetRemainingSize(), (samples.size() - 2) * 2);
+
+    // the bulk data arrives in chunks with their offsets
+    std::vector<uint8_t> received(bulk.size());
+    for(size_t i = 2; i < 5; i++)
+    {
+        EXPECT_EQ(link.frames[i].endpoint, uint8_t(SerialEndpoint::BULK));
+        SerialPayloadReader chunk(link.payloads[i].data(),
+                                  link.payloads[i].size());
+        const uint32_t offset = chunk.GetU32();
+        EXPECT_EQ(chunk.GetU32(), bulk.size());
+        ASSERT_LE(offset + chunk.GetRemainingSize(), received.size());
+        std::copy(chunk.GetRemainingData(),
+                  chunk.GetRemainingData() + chunk.GetRemainingSize(),
+                  received.begin() + offset);
+    }
+    EXPECT_EQ(received, bulk);
+}
+
+TEST(hid_SerialLink, c_dropsWholeFramesWhenBusy)
+{
+    LinkPair link;
+    link.device.GetTransport().busy_ = true;
+
+    // the transport takes 1024 bytes, a meter frame with four values is
+    // 22 bytes encoded
+    const float meters[4] = {};
+    int         sent      = 0;
+    while(link.device.SendMeters(meters, 4))
+        sent++;
+    EXPECT_EQ(sent, 46);
+    EXPECT_EQ(link.device.GetNumTxDropped(), 1u);
+    EXPECT_FALSE(link.device.SendMeters(meters, 4));
+    EXPECT_EQ(link.device.GetNumTxDropped(), 2u);
+
+    // a bulk transfer can be continued where it stopped
+    std::vector<uint8_t> bulk(100, 0x55);
+    EXPECT_EQ(link.device.SendBulk(bulk.data(), bulk.size()), 0u);
+
+    link.device.GetTransport().busy_ = false;
+    link.Process();
+    EXPECT_EQ(link.frames.size(), 46u);
+    // dropped frames don't use up sequence numbers
+    EXPECT_EQ(link.host.GetDecoder().GetNumLost(), 0u);
+    EXPECT_EQ(link.host.GetDecoder().GetNumErrors(), 0u);
+    EXPECT_EQ(link.device.SendBulk(bulk.data(), bulk.size()), bulk.size());
+}
@@ -0,0 +1,335 @@
+#include "dev/sr_scanner.h"
+#include <gtest/gtest.h>
+#include <vector>
+
+using namespace daisy;
+
+namespace
+{
+using Callback      = void (*)(void* context, bool success);
+using TimerCallback = void (*)(void* context);
+
+/** Simulates the chains bit by bit, like the datasheets describe them.
+ *  Bit i of each chain is input / output i, the highest bit of the 4021
+ *  chain drives MISO and MOSI shifts into bit 0 of the 595 chain.
+ */
+struct Chains
+{
+    std::vector<bool> inputPins, inputRegs, outputRegs, outputPins;
+
+    size_t        numTransfers  = 0;
+    uint8_t*      tx            = nullptr;
+    uint8_t*      rx            = nullptr;
+    size_t        size          = 0;
+    Callback      callback      = nullptr;
+    void*         context       = nullptr;
+    bool          startFails    = false;
+    float         timerRate     = 0.f;
+    bool          timerRunning  = false;
+    TimerCallback timerCallback = nullptr;
+    void*         timerContext  = nullptr;
+
+    Chains(size_t num4021, size_t num595)
+    : inputPins(8 * num4021),
+      inputRegs(8 * num4021),
+      outputRegs(8 * num595),
+      outputPins(8 * num595)
+    {
+    }
+
+    /** Rising clock edge: MISO is sampled before the registers shift */
+    bool Clock(bool mosi)
+    {
+        const bool miso = inputRegs.empty() ? false : inputRegs.back();
+        for(size_t i = inputRegs.size(); i-- > 1;)
+            inputRegs[i] = inputRegs[i - 1];
+        if(!inputRegs.empty())
+            inputRegs[0] = false;
+        for(size_t i = outputRegs.size(); i-- > 1;)
+            outputRegs[i] = outputRegs[i - 1];
+        if(!outputRegs.empty())
+            outputRegs[0] = mosi;
+        return miso;
+    }
+
+    void Latch()
+    {
+        outputPins = outputRegs;
+        inputRegs  = inputPins;
+    }
+
+    /** Shifts the frame MSB first, pulses the latch and calls back */
+    void Finish(bool success = true)
+    {
+        for(size_t i = 0; i < size; i++)
+        {
+            uint8_t in = 0;
+            for(int bit = 7; bit >= 0; bit--)
+                in |= uint8_t(Clock((tx[i] >> bit) & 1)) << bit;
+            rx[i] = in;
+        }
+        Latch();
+        callback(context, success);
+    }
+
+    void Tick() { timerCallback(timerContext); }
+};
+
+class MockTransport
+{
+  public:
+    struct Config
+    {
+        Chains* chains;
+        void    Defaults() { chains = nullptr; }
+    };
+
+    void Init(const Config& config)
+    {
+        chains_ = config.chains;
+        chains_->Latch();
+    }
+
+    bool StartTimer(float rate, TimerCallback callback, void* context)
+    {
+        chains_->timerRate     = rate;
+        chains_->timerRunning  = true;
+        chains_->timerCallback = callback;
+        chains_->timerContext  = context;
+        return true;
+    }
+
+    void StopTimer() { chains_->timerRunning = false; }
+
+    bool Transfer(uint8_t* tx,
+                  uint8_t* rx,
+                  size_t   size,
+                  Callback callback,
+                  void*    context)
+    {
+        if(chains_->startFails)
+            return false;
+        chains_->numTransfers++;
+        chains_->tx       = tx;
+        chains_->rx       = rx;
+        chains_->size     = size;
+        chains_->callback = callback;
+        chains_->context  = context;
+        return true;
+    }
+
+  private:
+    Chains* chains_;
+};
+
+template <size_t num4021, size_t num595>
+using TestScanner = ShiftRegisterScanner<MockTransport, num4021, num595>;
+
+using InputScanner = TestScanner<2, 0>;
+
+template <typename Scanner>
+void InitScanner(Scanner&                    scanner,
+                 typename Scanner::DmaBuffer& dmaBuffer,
+                 Chains&                     chains,
+                 float                       scanRate = 1000.f)
+{
+    typename Scanner::Config config;
+    config.Defaults();
+    config.transport_config.chains = &chains;
+    config.scan_rate               = scanRate;
+    config.dma_buffer              = &dmaBuffer;
+    ASSERT_EQ(scanner.Init(config), Scanner::Result::OK);
+}
+} // namespace
+
+TEST(dev_ShiftRegisterScanner, a_bitLayoutMatchesChains)
+{
+    // more inputs than outputs, the outputs are at the end of the frame
+    Chains            chains(5, 2);
+    TestScanner<5, 2>            scanner;
+    TestScanner<5, 2>::DmaBuffer buffer;
+    InitScanner(scanner, buffer, chains);
+    EXPECT_EQ(scanner.kFrameSize, 5u);
+    EXPECT_EQ(scanner.kNumInputWords, 2u);
+
+    for(size_t i = 0; i < chains.inputPins.size(); i++)
+        chains.inputPins[i] = (i * 7) % 3 == 0;
+    for(size_t i = 0; i < scanner.kNumOutputs; i++)
+        scanner.SetOutput(i, i % 5 == 1);
+    scanner.SetOutput(6, true);
+    scanner.SetOutput(6, false);
+    scanner.CommitOutputs();
+
+    // the first scan reads what was loaded at Init
+    EXPECT_TRUE(scanner.TriggerScan());
+    EXPECT_EQ(chains.size, 5u);
+    chains.Finish();
+    EXPECT_EQ(scanner.GetInputWord(0), 0u);
+    EXPECT_EQ(scanner.GetInputWord(1), 0u);
+
+    EXPECT_TRUE(scanner.TriggerScan());
+    chains.Finish();
+    EXPECT_EQ(scanner.GetScanCount(), 2u);
+    for(size_t i = 0; i < scanner.kNumInputs; i++)
+        EXPECT_EQ(scanner.GetInput(i), chains.inputPins[i]) << i;
+    for(size_t i = 0; i < scanner.kNumOutputs; i++)
+        EXPECT_EQ(chains.outputPins[i], i % 5 == 1 && i != 6) << i;
+
+    uint32_t words[2];
+    scanner.GetInputs(words);
+    EXPECT_EQ(words[0], scanner.GetInputWord(0));
+    EXPECT_EQ(words[1] & ~0xffu, 0u);
+    EXPECT_EQ(words[1], scanner.GetInputWord(1));
+
+    // more outputs than inputs
+    Chains            chains2(1, 3);
+    TestScanner<1, 3>            scanner2;
+    TestScanner<1, 3>::DmaBuffer buffer2;
+    InitScanner(scanner2, buffer2, chains2);
+    chains2.inputPins[0] = true;
+    chains2.inputPins[7] = true;
+    scanner2.SetOutputByte(0, 0x81);
+    scanner2.SetOutputByte(2, 0x3C);
+    scanner2.CommitOutputs();
+    for(int scan = 0; scan < 2; scan++)
+    {
+        scanner2.TriggerScan();
+        chains2.Finish();
+    }
+    EXPECT_EQ(scanner2.GetInputWord(), 0x81u);
+    for(size_t i = 0; i < 24; i++)
+    {
+        const bool expected = i == 0 || i == 7 || (i >= 18 && i <= 21);
+        EXPECT_EQ(chains2.outputPins[i], expected) << i;
+    }
+}
+
+TEST(dev_ShiftRegisterScanner, b_timedAndBackToBackScans)
+{
+    Chains       chains(2, 0);
+    InputScanner            scanner;
+    InputScanner::DmaBuffer buffer;
+    InitScanner(scanner, buffer, chains, 2000.f);
+
+    ASSERT_EQ(scanner.Start(), InputScanner::Result::OK);
+    EXPECT_TRUE(scanner.IsRunning());
+    EXPECT_TRUE(chains.timerRunning);
+    EXPECT_FLOAT_EQ(chains.timerRate, 2000.f);
+    EXPECT_EQ(chains.numTransfers, 0u);
+
+    // every timer interrupt starts one scan
+    chains.inputPins[3] = true;
+    chains.Tick();
+    EXPECT_TRUE(scanner.IsBusy());
+    EXPECT_EQ(chains.numTransfers, 1u);
+    chains.Tick();
+    EXPECT_EQ(scanner.GetOverruns(), 1u);
+    EXPECT_EQ(chains.numTransfers, 1u);
+    chains.Finish();
+    EXPECT_FALSE(scanner.IsBusy());
+    EXPECT_EQ(chains.numTransfers, 1u);
+    chains.Tick();
+    chains.Finish();
+    EXPECT_EQ(scanner.GetInputWord(), 0x08u);
+
+    scanner.Stop();
+    EXPECT_FALSE(chains.timerRunning);
+    EXPECT_FALSE(scanner.IsRunning());
+
+    // without a rate, each scan starts the next one
+    Chains       chains2(2, 0);
+    InputScanner            scanner2;
+    InputScanner::DmaBuffer buffer2;
+    InitScanner(scanner2, buffer2, chains2, 0.f);
+    ASSERT_EQ(scanner2.Start(), InputScanner::Result::OK);
+    EXPECT_FALSE(chains2.timerRunning);
+    EXPECT_EQ(chains2.numTransfers, 1u);
+    for(size_t scan = 1; scan <= 5; scan++)
+    {
+        chains2.inputPins[scan] = true;
+        chains2.Finish();
+        EXPECT_EQ(chains2.numTransfers, scan + 1);
+    }
+    // the latest scan read the pins latched after the fourth one
+    EXPECT_EQ(scanner2.GetInputWord(), 0x1Eu);
+    scanner2.Stop();
+    chains2.Finish();
+    EXPECT_EQ(chains2.numTransfers, 6u);
+    EXPECT_EQ(scanner2.GetScanCount(), 6u);
+    EXPECT_EQ(scanner2.GetOverruns(), 0u);
+}
+
+TEST(dev_ShiftRegisterScanner, c_doubleBufferedSnapshots)
+{
+    Chains            chains(1, 1);
+    TestScanner<1, 1>            scanner;
+    TestScanner<1, 1>::DmaBuffer buffer;
+    InitScanner(scanner, buffer, chains);
+
+    // scans receive into the buffer that isn't the current snapshot
+    chains.inputPins[0] = true;
+    scanner.TriggerScan();
+    chains.Finish();
+    scanner.TriggerScan();
+    uint8_t* const rx   = chains.rx;
+    chains.inputPins[0] = false;
+    chains.Finish();
+    EXPECT_EQ(scanner.GetInputWord(), 0x01u);
+    scanner.TriggerScan();
+    EXPECT_NE(chains.rx, rx);
+    // garbage in the receive buffer doesn't show until the scan completes
+    chains.rx[0] = 0xff;
+    EXPECT_EQ(scanner.GetInputWord(), 0x01u);
+    chains.Finish();
+    EXPECT_EQ(scanner.GetInputWord(), 0x00u);
+
+    // outputs committed during a scan don't change the frame being sent
+    scanner.SetOutputByte(0, 0x0F);
+    scanner.CommitOutputs();
+    scanner.TriggerScan();
+    uint8_t* const sending = chains.tx;
+    EXPECT_EQ(sending[0], 0x0F);
+    scanner.SetOutputByte(0, 0xF0);
+    scanner.CommitOutputs();
+    EXPECT_EQ(sending[0], 0x0F);
+    chains.Finish();
+    EXPECT_EQ(chains.outputPins[0], true);
+    EXPECT_EQ(chains.outputPins[7], false);
+    scanner.TriggerScan();
+    EXPECT_NE(chains.tx, sending);
+    chains.Finish();
+    EXPECT_EQ(chains.outputPins[0], false);
+    EXPECT_EQ(chains.outputPins[7], true);
+
+    // failed scans keep the last snapshot
+    const uint32_t scans = scanner.GetScanCount();
+    chains.inputPins[2]  = true;
+    scanner.TriggerScan();
+    chains.Finish(false);
+    EXPECT_EQ(scanner.GetErrors(), 1u);
+    EXPECT_EQ(scanner.GetScanCount(), scans);
+    EXPECT_EQ(scanner.GetInputWord(), 0x00u);
+    chains.startFails = true;
+    EXPECT_FALSE(scanner.TriggerScan());
+    EXPECT_EQ(scanner.GetErrors(), 2u);
+    EXPECT_FALSE(scanner.IsBusy());
+}
+
+TEST(dev_ShiftRegisterScanner, d_requiresDmaBuffer)
+{
+    using OutputScanner = TestScanner<1, 1>;
+    Chains                chains(1, 1);
+    OutputScanner         scanner;
+    OutputScanner::Config config;
+    config.Defaults();
+    config.transport_config.chains = &chains;
+
+    // without a D2 buffer nothing is ever handed to the DMA
+    EXPECT_EQ(scanner.Init(config), OutputScanner::Result::ERR);
+    EXPECT_EQ(scanner.Start(), OutputScanner::Result::ERR);
+    EXPECT_FALSE(scanner.TriggerScan());
+    scanner.SetOutputByte(0, 0xff);
+    scanner.CommitOutputs();
+    EXPECT_EQ(chains.numTransfers, 0u);
+    EXPECT_FALSE(scanner.IsRunning());
+}
@@ -157,4 +157,29 @@ TEST_F(util_Stack, i_countEqualTo)
     EXPECT_EQ(stack_.CountEqualTo(1), 1u);
     EXPECT_EQ(stack_.CountEqualTo(2), 2u);
     EXPECT_EQ(stack_.CountEqualTo(3), 0u);
-}
\ No newline at end of file
+}
+TEST_F(util_Stack, j_constructFromInitializerList)
+{
+    Stack<int, 4> stack = Stack<int, 4>({1, 2, 3});
+
+    EXPECT_EQ(stack.GetNumElements(), 3u);
+    EXPECT_EQ(stack[0], 1);
+    EXPECT_EQ(stack[1], 2);
+    EXPECT_EQ(stack[2], 3);
+
+    // the values must survive the default member initializers of the buffer
+    struct Value
+    {
+        int value = -1;
+        Value() {}
+        Value(int v) : value(v) {}
+        bool operator==(const Value& other) const
+        {
+            return value == other.value;
+        }
+    };
+    Stack<Value, 3> values({Value(4), Value(5)});
+    EXPECT_EQ(values.GetNumElements(), 2u);
+    EXPECT_EQ(values[0].value, 4);
+    EXPECT_EQ(values[1].value, 5);
+}
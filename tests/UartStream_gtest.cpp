@@ -0,0 +1,202 @@
+#include "per/uart_stream.h"
+#include <gtest/gtest.h>
+#include <vector>
+
+using namespace daisy;
+
+namespace
+{
+/** Writes bytes into the buffer like a circular DMA does */
+struct DmaSimulation
+{
+    uint8_t    buffer[16];
+    size_t     pos   = 0;
+    uint8_t    value = 0;
+    UartRxRing ring;
+
+    DmaSimulation() { ring.Init(buffer, sizeof(buffer)); }
+
+    /** Receives bytes with increasing values and reports the position */
+    bool Receive(size_t num, bool idle = false)
+    {
+        for(size_t i = 0; i < num; i++)
+        {
+            buffer[pos] = value++;
+            pos         = (pos + 1) % sizeof(buffer);
+        }
+        return ring.OnDmaPosition(pos, idle);
+    }
+
+    std::vector<uint8_t> ReadAll()
+    {
+        std::vector<uint8_t> result(64);
+        result.resize(ring.Read(result.data(), result.size()));
+        return result;
+    }
+};
+
+std::vector<uint8_t> Sequence(uint8_t first, size_t num)
+{
+    std::vector<uint8_t> result;
+    for(size_t i = 0; i < num; i++)
+        result.push_back(first + i);
+    return result;
+}
+} // namespace
+
+TEST(per_UartRxRing, a_notifiesAtThresholdOrIdle)
+{
+    DmaSimulation dma;
+    uint8_t       buffer[15];
+    EXPECT_FALSE(dma.ring.Init(buffer, sizeof(buffer)));
+    EXPECT_EQ(dma.ring.GetReadable().size, 0u);
+
+    // without a threshold, every position update notifies
+    EXPECT_TRUE(dma.Receive(1));
+    EXPECT_EQ(dma.ReadAll(), Sequence(0, 1));
+    EXPECT_FALSE(dma.Receive(0));
+
+    // the threshold batches bytes until the line goes idle
+    dma.ring.SetThreshold(4);
+    EXPECT_FALSE(dma.Receive(2));
+    EXPECT_FALSE(dma.Receive(1));
+    EXPECT_TRUE(dma.Receive(1));
+    EXPECT_TRUE(dma.Receive(0, true));
+    EXPECT_EQ(dma.ring.GetAvailable(), 4u);
+    EXPECT_EQ(dma.ReadAll(), Sequence(1, 4));
+    EXPECT_TRUE(dma.Receive(1, true));
+    EXPECT_EQ(dma.ReadAll(), Sequence(5, 1));
+    EXPECT_FALSE(dma.Receive(0, true));
+}
+
+TEST(per_UartRxRing, b_zeroCopyAcrossTheWrap)
+{
+    DmaSimulation dma;
+    dma.Receive(12);
+    EXPECT_EQ(dma.ReadAll(), Sequence(0, 12));
+
+    // 8 bytes wrap around the end of the buffer: two spans
+    dma.Receive(8);
+    UartSpan span = dma.ring.GetReadable();
+    ASSERT_EQ(span.size, 4u);
+    EXPECT_EQ(span.data, dma.buffer + 12);
+    EXPECT_EQ(span.data[0], 12);
+    EXPECT_TRUE(dma.ring.Consume(span.size));
+    span = dma.ring.GetReadable();
+    ASSERT_EQ(span.size, 4u);
+    EXPECT_EQ(span.data, dma.buffer);
+    EXPECT_EQ(span.data[0], 16);
+    EXPECT_TRUE(dma.ring.Consume(2));
+    EXPECT_EQ(dma.ring.GetAvailable(), 2u);
+    EXPECT_EQ(dma.ReadAll(), Sequence(18, 2));
+
+    // a full buffer is fine
+    dma.Receive(8);
+    dma.Receive(8);
+    EXPECT_EQ(dma.ring.GetAvailable(), 16u);
+    EXPECT_EQ(dma.ReadAll(), Sequence(20, 16));
+    EXPECT_EQ(dma.ring.GetMaxFill(), 16u);
+    EXPECT_EQ(dma.ring.GetNumOverflows(), 0u);
+}
+
+TEST(per_UartRxRing, c_detectsOverflows)
+{
+    DmaSimulation dma;
+
+    // the DMA overtakes the reader: the old bytes are dropped
+    dma.Receive(10);
+    dma.Receive(10);
+    EXPECT_EQ(dma.ring.GetAvailable(), 0u);
+    EXPECT_EQ(dma.ring.GetNumOverflows(), 1u);
+    EXPECT_EQ(dma.ring.GetNumDroppedBytes(), 20u);
+    EXPECT_EQ(dma.ring.GetMaxFill(), 20u);
+    dma.Receive(3);
+    EXPECT_EQ(dma.ReadAll(), Sequence(20, 3));
+
+    // bytes that are overwritten while they're processed in place
+    dma.Receive(8);
+    const UartSpan span = dma.ring.GetReadable();
+    EXPECT_EQ(span.size, 8u);
+    dma.Receive(10);
+    EXPECT_FALSE(dma.ring.Consume(span.size));
+    EXPECT_EQ(dma.ring.GetNumOverflows(), 2u);
+    EXPECT_EQ(dma.ring.GetAvailable(), 0u);
+
+    // the reader continues with the newest bytes
+    dma.Receive(4);
+    EXPECT_EQ(dma.ReadAll(), Sequence(41, 4));
+}
+
+TEST(per_UartRxRing, d_restartDropsUnreadBytes)
+{
+    DmaSimulation dma;
+    dma.Receive(5);
+    EXPECT_EQ(dma.ReadAll(), Sequence(0, 5));
+    dma.Receive(6);
+
+    // e.g. after an overrun error, the DMA starts at the buffer start
+    dma.ring.OnDmaRestart();
+    dma.pos = 0;
+    EXPECT_EQ(dma.ring.GetAvailable(), 0u);
+    EXPECT_EQ(dma.ring.GetNumRestarts(), 1u);
+    EXPECT_EQ(dma.ring.GetNumOverflows(), 0u);
+    EXPECT_EQ(dma.ring.GetNumDroppedBytes(), 0u);
+
+    dma.Receive(3);
+    const UartSpan span = dma.ring.GetReadable();
+    EXPECT_EQ(span.data, dma.buffer);
+    EXPECT_EQ(dma.ReadAll(), Sequence(11, 3));
+}
+
+TEST(per_UartTxQueue, a_sendsChunksInOrder)
+{
+    uint8_t     buffer[8];
+    UartTxQueue queue;
+    EXPECT_FALSE(queue.Init(buffer, 6));
+    EXPECT_TRUE(queue.Init(buffer, sizeof(buffer)));
+    EXPECT_EQ(queue.GetFree(), 8u);
+    EXPECT_EQ(queue.StartChunk().size, 0u);
+    EXPECT_FALSE(queue.IsSending());
+
+    const std::vector<uint8_t> data = Sequence(0, 10);
+    EXPECT_EQ(queue.Write(data.data(), 6), 6u);
+
+    // one chunk at a time
+    UartSpan chunk = queue.StartChunk();
+    EXPECT_TRUE(queue.IsSending());
+    EXPECT_EQ(std::vector<uint8_t>(chunk.data, chunk.data + chunk.size),
+              Sequence(0, 6));
+    EXPECT_EQ(queue.StartChunk().size, 0u);
+
+    // bytes queued while sending wrap around the buffer; the full queue
+    // takes as many as fit
+    EXPECT_EQ(queue.Write(data.data() + 6, 4), 2u);
+    EXPECT_EQ(queue.GetFree(), 0u);
+    queue.FinishChunk();
+    EXPECT_FALSE(queue.IsSending());
+    EXPECT_EQ(queue.GetFree(), 6u);
+    EXPECT_EQ(queue.Write(data.data() + 8, 2), 2u);
+
+    chunk = queue.StartChunk();
+    EXPECT_EQ(std::vector<uint8_t>(chunk.data, chunk.data + chunk.size),
+              Sequence(6, 2));
+    queue.FinishChunk();
+    chunk = queue.StartChunk();
+    EXPECT_EQ(chunk.data, buffer);
+    EXPECT_EQ(std::vector<uint8_t>(chunk.data, chunk.data + chunk.size),
+              Sequence(8, 2));
+    EXPECT_EQ(queue.GetPending(), 2u);
+    queue.FinishChunk();
+    EXPECT_EQ(queue.GetPending(), 0u);
+    EXPECT_EQ(queue.StartChunk().size, 0u);
+
+    // a chunk that couldn't be sent is taken again
+    EXPECT_EQ(queue.Write(data.data(), 3), 3u);
+    chunk = queue.StartChunk();
+    queue.CancelChunk();
+    EXPECT_FALSE(queue.IsSending());
+    EXPECT_EQ(queue.GetPending(), 3u);
+    const UartSpan retry = queue.StartChunk();
+    EXPECT_EQ(retry.data, chunk.data);
+    EXPECT_EQ(retry.size, 3u);
+}
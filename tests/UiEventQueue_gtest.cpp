@@ -0,0 +1,246 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "ui/UiEventQueue.h"
+
+using namespace daisy;
+
+using EventType = UiEventQueue::Event::EventType;
+
+TEST(ui_UiEventQueue, a_buttonEventsKeepTheirOrder)
+{
+    UiEventQueue queue;
+    EXPECT_TRUE(queue.IsQueueEmpty());
+    EXPECT_EQ(queue.GetAndRemoveNextEvent().type, EventType::invalid);
+
+    EXPECT_TRUE(queue.AddButtonPressed(1, 1));
+    EXPECT_TRUE(queue.AddButtonReleased(1));
+    EXPECT_TRUE(queue.AddButtonPressed(2, 2, true));
+    EXPECT_EQ(queue.GetNumEventsInQueue(), 3u);
+
+    auto e = queue.GetAndRemoveNextEvent();
+    EXPECT_EQ(e.type, EventType::buttonPressed);
+    EXPECT_EQ(e.asButtonPressed.id, 1);
+    EXPECT_EQ(e.asButtonPressed.numSuccessivePresses, 1);
+    EXPECT_FALSE(e.asButtonPressed.isRetriggering);
+    e = queue.GetAndRemoveNextEvent();
+    EXPECT_EQ(e.type, EventType::buttonReleased);
+    EXPECT_EQ(e.asButtonReleased.id, 1);
+    e = queue.GetAndRemoveNextEvent();
+    EXPECT_EQ(e.type, EventType::buttonPressed);
+    EXPECT_EQ(e.asButtonPressed.id, 2);
+    EXPECT_EQ(e.asButtonPressed.numSuccessivePresses, 2);
+    EXPECT_TRUE(e.asButtonPressed.isRetriggering);
+    EXPECT_TRUE(queue.IsQueueEmpty());
+}
+
+TEST(ui_UiEventQueue, b_encoderTurnsAreCoalesced)
+{
+    UiEventQueue queue;
+
+    // many turns of two encoders only produce one event each
+    for(int i = 0; i < 1000; i++)
+    {
+        EXPECT_TRUE(queue.AddEncoderTurned(3, 1, 24));
+        EXPECT_TRUE(queue.AddEncoderTurned(4, -2, 12));
+    }
+    EXPECT_EQ(queue.GetNumEventsInQueue(), 2u);
+
+    auto e = queue.GetAndRemoveNextEvent();
+    EXPECT_EQ(e.type, EventType::encoderTurned);
+    EXPECT_EQ(e.asEncoderTurned.id, 3);
+    EXPECT_EQ(e.asEncoderTurned.increments, 1000);
+    EXPECT_EQ(e.asEncoderTurned.stepsPerRev, 24);
+
+    // turns arriving while an event is waiting are added to that event
+    queue.AddEncoderTurned(4, 5, 12);
+    e = queue.GetAndRemoveNextEvent();
+    EXPECT_EQ(e.type, EventType::encoderTurned);
+    EXPECT_EQ(e.asEncoderTurned.id, 4);
+    EXPECT_EQ(e.asEncoderTurned.increments, -1995);
+    EXPECT_TRUE(queue.IsQueueEmpty());
+
+    // after the event was read, new turns post a new event
+    queue.AddEncoderTurned(3, -1, 24);
+    e = queue.GetAndRemoveNextEvent();
+    EXPECT_EQ(e.type, EventType::encoderTurned);
+    EXPECT_EQ(e.asEncoderTurned.increments, -1);
+
+    // turns that cancel each other out don't produce an event
+    queue.AddEncoderTurned(3, 1, 24);
+    queue.AddEncoderTurned(3, -1, 24);
+    EXPECT_EQ(queue.GetAndRemoveNextEvent().type, EventType::invalid);
+    EXPECT_TRUE(queue.IsQueueEmpty());
+}
+
+TEST(ui_UiEventQueue, c_potMovementsAreCoalesced)
+{
+    UiEventQueue queue;
+
+    queue.AddPotActivityChanged(7, true);
+    for(int i = 0; i <= 100; i++)
+        queue.AddPotMoved(7, i / 100.0f);
+    queue.AddPotActivityChanged(7, false);
+    EXPECT_EQ(queue.GetNumEventsInQueue(), 3u);
+
+    auto e = queue.GetAndRemoveNextEvent();
+    EXPECT_EQ(e.type, EventType::potActivityChanged);
+    EXPECT_EQ(e.asPotActivityChanged.newActivityType,
+              UiEventQueue::Event::ActivityType::active);
+    e = queue.GetAndRemoveNextEvent();
+    EXPECT_EQ(e.type, EventType::potMoved);
+    EXPECT_EQ(e.asPotMoved.id, 7);
+    EXPECT_FLOAT_EQ(e.asPotMoved.newPosition, 1.0f); // latest position
+    e = queue.GetAndRemoveNextEvent();
+    EXPECT_EQ(e.type, EventType::potActivityChanged);
+    EXPECT_EQ(e.asPotActivityChanged.newActivityType,
+              UiEventQueue::Event::ActivityType::inactive);
+    EXPECT_TRUE(queue.IsQueueEmpty());
+}
+
+TEST(ui_UiEventQueue, d_controlsBeyondCoalescingLimitAreQueued)
+{
+    UiEventQueue queue;
+
+    // claim all coalescing slots
+    for(int i = 0; i < UiEventQueue::kMaxNumCoalescedEncoders; i++)
+        queue.AddEncoderTurned(i, 1, 12);
+    while(!queue.IsQueueEmpty())
+        queue.GetAndRemoveNextEvent();
+
+    // an additional encoder is queued without coalescing
+    const uint16_t id = UiEventQueue::kMaxNumCoalescedEncoders;
+    queue.AddEncoderTurned(id, 1, 12);
+    queue.AddEncoderTurned(id, 2, 12);
+    EXPECT_EQ(queue.GetNumEventsInQueue(), 2u);
+    EXPECT_EQ(queue.GetAndRemoveNextEvent().asEncoderTurned.increments, 1);
+    EXPECT_EQ(queue.GetAndRemoveNextEvent().asEncoderTurned.increments, 2);
+}
+
+TEST(ui_UiEventQueue, e_fullQueueDoesntBlockCoalescedControls)
+{
+    UiEventQueue queue;
+
+    // fill the queue with button events
+    int numAdded = 0;
+    while(queue.AddButtonPressed(0, 1))
+        numAdded++;
+    EXPECT_GT(numAdded, 0);
+    EXPECT_FALSE(queue.AddButtonReleased(0));
+
+    // there's still room for encoder turns and pot movements
+    EXPECT_TRUE(queue.AddEncoderTurned(1, 3, 12));
+    EXPECT_TRUE(queue.AddEncoderTurned(1, 1, 12));
+    EXPECT_TRUE(queue.AddPotMoved(1, 0.5f));
+
+    for(int i = 0; i < numAdded; i++)
+        EXPECT_EQ(queue.GetAndRemoveNextEvent().type, EventType::buttonPressed);
+    EXPECT_EQ(queue.GetAndRemoveNextEvent().asEncoderTurned.increments, 4);
+    EXPECT_FLOAT_EQ(queue.GetAndRemoveNextEvent().asPotMoved.newPosition, 0.5f);
+    EXPECT_TRUE(queue.IsQueueEmpty());
+}
+
+TEST(ui_UiEventQueue, f_largeNumberOfIncrementsIsSplit)
+{
+    UiEventQueue queue;
+
+    for(int i = 0; i < 40000; i++)
+        queue.AddEncoderTurned(0, 1, 12);
+    EXPECT_EQ(queue.GetNumEventsInQueue(), 1u);
+
+    // increments that don't fit into a single event are delivered
+    // with a second event
+    EXPECT_EQ(queue.GetAndRemoveNextEvent().asEncoderTurned.increments,
+              INT16_MAX);
+    EXPECT_EQ(queue.GetAndRemoveNextEvent().asEncoderTurned.increments,
+              40000 - INT16_MAX);
+    EXPECT_TRUE(queue.IsQueueEmpty());
+}
+
+TEST(ui_UiEventQueue, g_stressConcurrentProducers)
+{
+    // Several producers post encoder turns, pot movements and button
+    // presses while a consumer reads the queue concurrently.
+    // - no encoder increments must be lost
+    // - the final position of each pot must be delivered
+    // - all button presses that were accepted must arrive in order
+    constexpr int kNumProducers  = 4;
+    constexpr int kNumIterations = 50000;
+    constexpr int kSharedEncoder = 100;
+
+    UiEventQueue     queue;
+    std::atomic<int> numProducersDone{0};
+    std::atomic<int> numButtonPressesAccepted[kNumProducers];
+
+    std::vector<std::thread> producers;
+    for(int p = 0; p < kNumProducers; p++)
+    {
+        numButtonPressesAccepted[p] = 0;
+        producers.emplace_back([&, p]() {
+            for(int i = 1; i <= kNumIterations; i++)
+            {
+                // each producer has its own encoder, pot and button
+                queue.AddEncoderTurned(p, 1, 24);
+                queue.AddEncoderTurned(kSharedEncoder, (i % 2) ? 3 : -1, 24);
+                queue.AddPotMoved(p, float(i) / kNumIterations);
+                if((i % 64) == 0)
+                {
+                    // the button ID encodes the producer, the number of
+                    // presses counts up.
+                    const uint16_t numPresses = numButtonPressesAccepted[p] + 1;
+                    if(queue.AddButtonPressed(p, numPresses))
+                        numButtonPressesAccepted[p]++;
+                }
+            }
+            numProducersDone++;
+        });
+    }
+
+    int32_t encoderIncrements[kNumProducers] = {0};
+    int32_t sharedEncoderIncrements          = 0;
+    float   potPositions[kNumProducers]      = {0.0f};
+    int     numButtonPressesReceived[kNumProducers] = {0};
+
+    const auto consume = [&]() {
+        const auto e = queue.GetAndRemoveNextEvent();
+        switch(e.type)
+        {
+            case EventType::encoderTurned:
+                if(e.asEncoderTurned.id == kSharedEncoder)
+                    sharedEncoderIncrements += e.asEncoderTurned.increments;
+                else
+                    encoderIncrements[e.asEncoderTurned.id]
+                        += e.asEncoderTurned.increments;
+                break;
+            case EventType::potMoved:
+                // positions only ever increase
+                EXPECT_GE(e.asPotMoved.newPosition,
+                          potPositions[e.asPotMoved.id]);
+                potPositions[e.asPotMoved.id] = e.asPotMoved.newPosition;
+                break;
+            case EventType::buttonPressed:
+                numButtonPressesReceived[e.asButtonPressed.id]++;
+                EXPECT_EQ(e.asButtonPressed.numSuccessivePresses,
+                          numButtonPressesReceived[e.asButtonPressed.id]);
+                break;
+            case EventType::invalid: std::this_thread::yield(); break;
+            default: ADD_FAILURE() << "unexpected event"; break;
+        }
+    };
+
+    while(numProducersDone < kNumProducers)
+        consume();
+    for(auto& producer : producers)
+        producer.join();
+    while(!queue.IsQueueEmpty())
+        consume();
+
+    for(int p = 0; p < kNumProducers; p++)
+    {
+        EXPECT_EQ(encoderIncrements[p], kNumIterations);
+        EXPECT_FLOAT_EQ(potPositions[p], 1.0f);
+        EXPECT_EQ(numButtonPressesReceived[p], numButtonPressesAccepted[p]);
+    }
+    EXPECT_EQ(sharedEncoderIncrements, kNumProducers * kNumIterations);
+}
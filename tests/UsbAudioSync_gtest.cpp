@@ -0,0 +1,246 @@
+#include "util/UsbAudioSync.h"
+#include <gtest/gtest.h>
+#include <cmath>
+#include <vector>
+
+using namespace daisy;
+
+namespace
+{
+constexpr size_t kBlockSize = 48;
+constexpr size_t kChannels  = 2;
+constexpr size_t kFrames    = 512;
+
+/** Simulates an audio clock that drifts against the USB frames. The
+ *  position at a start of frame is interpolated from the last block, with
+ *  some jitter like the interrupt latency on the device. */
+struct AudioClockSim
+{
+    double   rate;       // samples per USB frame
+    double   next_block  = 0.0;
+    double   block_start = 0.0;
+    uint64_t num_blocks  = 0;
+    uint32_t seed        = 1;
+
+    explicit AudioClockSim(double ppm) : rate(48.0 * (1.0 + ppm * 1e-6)) {}
+
+    /** @return true if a block starts before the given frame time */
+    bool NextBlock(double frame)
+    {
+        if(next_block > frame)
+            return false;
+        block_start = next_block;
+        next_block += kBlockSize / rate;
+        num_blocks++;
+        return true;
+    }
+
+    uint32_t Position(double frame)
+    {
+        seed              = seed * 1664525 + 1013904223;
+        const double jit  = (int(seed >> 24) - 128) / 256.0; // +-0.5
+        double       into = (frame - block_start) * rate + jit;
+        into              = into < 0 ? 0 : into;
+        into              = into > kBlockSize ? kBlockSize : into;
+        const double pos  = (num_blocks - 1) * double(kBlockSize) + into;
+        return uint32_t(uint64_t(pos * 256.0));
+    }
+};
+
+UsbAudioLoopConfig LoopConfig(float target_fill)
+{
+    UsbAudioLoopConfig config;
+    config.nominal_rate = 48.f;
+    config.target_fill  = target_fill;
+    return config;
+}
+} // namespace
+
+TEST(util_UsbAudioSync, a_rateMeter)
+{
+    for(double ppm : {0.0, 200.0, -350.0})
+    {
+        AudioClockSim     clock(ppm);
+        UsbAudioRateMeter meter;
+        meter.Init(48.f);
+        EXPECT_EQ(meter.GetRate(), 48.f);
+        for(int frame = 0; frame < 1000; frame++)
+        {
+            while(clock.NextBlock(frame)) {}
+            meter.OnSof(clock.Position(frame));
+        }
+        EXPECT_TRUE(meter.IsSettled());
+        // the jitter of the positions is spread over the window
+        EXPECT_NEAR(meter.GetRate(), clock.rate, 1.0 / meter.kWindow);
+    }
+
+    // the position may wrap around
+    UsbAudioRateMeter meter;
+    meter.Init(48.f);
+    uint32_t position = 0xffffffff - 100 * 48 * 256;
+    for(int frame = 0; frame < 200; frame++, position += 48 * 256 + 13)
+        meter.OnSof(position);
+    EXPECT_NEAR(meter.GetRate(), 48.f + 13.f / 256.f, 1e-4);
+}
+
+TEST(util_UsbAudioSync, b_feedbackHoldsOutFill)
+{
+    for(double ppm : {150.0, -250.0})
+    {
+        AudioClockSim     clock(ppm);
+        UsbAudioRateMeter meter;
+        UsbAudioFeedback  feedback;
+        UsbAudioFifo      fifo;
+        int32_t           storage[kFrames * kChannels];
+        int32_t           block[kBlockSize * kChannels];
+        const float       target = 160.f;
+        meter.Init(48.f);
+        feedback.Init(LoopConfig(target));
+        fifo.Init(storage, kFrames, kChannels);
+        fifo.SetStartFill(size_t(target));
+
+        // the host sends what the feedback asks for, in whole frames
+        double   host_phase = 0.0, sum = 0.0;
+        size_t   min_fill = kFrames, max_fill = 0;
+        uint32_t underruns_at_start = 0;
+        std::vector<int32_t> packet;
+        for(int frame = 0; frame < 30000; frame++)
+        {
+            while(clock.NextBlock(frame))
+                fifo.Read(block, kBlockSize);
+            meter.OnSof(clock.Position(frame));
+            const float fb
+                = feedback.Update(meter.GetRate(), fifo.GetFill());
+
+            const uint32_t encoded = UsbAudioFeedback::ToFullSpeed(fb);
+            host_phase += UsbAudioFeedback::FromFullSpeed(encoded);
+            const size_t size = size_t(host_phase);
+            host_phase -= size;
+            packet.assign(size * kChannels, frame);
+            fifo.Write(packet.data(), size);
+
+            if(frame == 1000)
+                underruns_at_start = fifo.GetNumUnderruns();
+            if(frame >= 5000)
+            {
+                const size_t fill = fifo.GetFill();
+                min_fill          = fill < min_fill ? fill : min_fill;
+                max_fill          = fill > max_fill ? fill : max_fill;
+                sum += fb;
+            }
+        }
+        // the fill moves by a block and a packet, but doesn't drift away
+        EXPECT_GT(min_fill, target - 2 * kBlockSize);
+        EXPECT_LT(max_fill, target + 2 * kBlockSize);
+        EXPECT_NEAR(feedback.GetFill(), target, 30.f);
+        EXPECT_NEAR(sum / 25000, clock.rate, 1e-3);
+        EXPECT_EQ(fifo.GetNumUnderruns(), underruns_at_start);
+        EXPECT_EQ(fifo.GetNumOverruns(), 0u);
+    }
+}
+
+TEST(util_UsbAudioSync, c_pacerHoldsInFill)
+{
+    for(double ppm : {-200.0, 300.0})
+    {
+        AudioClockSim     clock(ppm);
+        UsbAudioRateMeter meter;
+        UsbAudioPacer     pacer;
+        UsbAudioFifo      fifo;
+        int32_t           storage[kFrames * kChannels];
+        int32_t           block[kBlockSize * kChannels] = {};
+        uint8_t           packet[64 * kChannels * 3];
+        const float       target = 128.f;
+        meter.Init(48.f);
+        pacer.Init(LoopConfig(target));
+        fifo.Init(storage, kFrames, kChannels);
+        fifo.SetStartFill(size_t(target));
+
+        size_t   total = 0, min_size = 100, max_size = 0;
+        uint32_t underruns_at_start = 0;
+        for(int frame = 0; frame < 30000; frame++)
+        {
+            while(clock.NextBlock(frame))
+                fifo.Write(block, kBlockSize);
+            meter.OnSof(clock.Position(frame));
+            const size_t size = pacer.Next(meter.GetRate(), fifo.GetFill());
+            fifo.ReadPcm(packet, size, 3);
+
+            if(frame == 1000)
+                underruns_at_start = fifo.GetNumUnderruns();
+            if(frame >= 5000)
+            {
+                total += size;
+                min_size = size < min_size ? size : min_size;
+                max_size = size > max_size ? size : max_size;
+            }
+        }
+        // packets differ by one sample, and follow the audio clock
+        EXPECT_EQ(min_size, 47u + (ppm > 0 ? 1 : 0));
+        EXPECT_EQ(max_size, 48u + (ppm > 0 ? 1 : 0));
+        EXPECT_NEAR(double(total) / 25000, clock.rate, 1e-3);
+        EXPECT_EQ(fifo.GetNumUnderruns(), underruns_at_start);
+        EXPECT_EQ(fifo.GetNumOverruns(), 0u);
+    }
+}
+
+TEST(util_UsbAudioSync, d_fifoFormatsAndUnderruns)
+{
+    int32_t      storage[8 * 2];
+    UsbAudioFifo fifo;
+    fifo.Init(storage, 8, 2);
+
+    // little endian PCM ends up left justified
+    const uint8_t pcm24[] = {0x56, 0x34, 0x12, 0xff, 0xff, 0xff};
+    EXPECT_EQ(fifo.WritePcm(pcm24, 1, 3), 1u);
+    const uint8_t pcm16[] = {0x34, 0x12, 0x00, 0x80};
+    EXPECT_EQ(fifo.WritePcm(pcm16, 1, 2), 1u);
+    int32_t frames[4];
+    EXPECT_EQ(fifo.Read(frames, 2), 2u);
+    EXPECT_EQ(frames[0], 0x12345600);
+    EXPECT_EQ(frames[1], -256);
+    EXPECT_EQ(frames[2], 0x12340000);
+    EXPECT_EQ(frames[3], INT32_MIN);
+
+    const int32_t samples[] = {0x12345678, -1, 0x7fffff00, 0};
+    fifo.Write(samples, 2);
+    uint8_t packet[12];
+    EXPECT_EQ(fifo.ReadPcm(packet, 1, 4), 1u);
+    EXPECT_EQ(packet[0], 0x78);
+    EXPECT_EQ(packet[3], 0x12);
+    EXPECT_EQ(fifo.ReadPcm(packet, 1, 3), 1u);
+    EXPECT_EQ(packet[0], 0xff);
+    EXPECT_EQ(packet[2], 0x7f);
+    EXPECT_EQ(packet[5], 0x00);
+
+    // the consumer waits for the start fill, also after running dry
+    fifo.Reset();
+    fifo.SetStartFill(4);
+    fifo.Write(samples, 2);
+    EXPECT_EQ(fifo.Read(frames, 1), 0u);
+    fifo.Write(samples, 2);
+    EXPECT_EQ(fifo.Read(frames, 1), 1u);
+    EXPECT_EQ(fifo.Read(frames, 2), 2u);
+    EXPECT_EQ(fifo.GetNumUnderruns(), 0u);
+    EXPECT_EQ(fifo.Read(frames, 2), 1u);
+    EXPECT_EQ(frames[2], 0);
+    EXPECT_EQ(fifo.GetNumUnderruns(), 1u);
+    fifo.Write(samples, 1);
+    EXPECT_EQ(fifo.Read(frames, 1), 0u);
+    fifo.Write(samples, 2);
+    fifo.Write(samples, 2);
+    EXPECT_EQ(fifo.Read(frames, 1), 1u);
+    fifo.Flush();
+    EXPECT_EQ(fifo.GetFill(), 0u);
+    fifo.Write(samples, 2);
+    EXPECT_EQ(fifo.Read(frames, 1), 0u);
+    EXPECT_EQ(fifo.GetNumUnderruns(), 1u);
+    fifo.Flush();
+
+    // what doesn't fit is dropped
+    fifo.Write(samples, 1);
+    EXPECT_EQ(fifo.GetFree(), 7u);
+    const int32_t many[16] = {};
+    EXPECT_EQ(fifo.Write(many, 8), 7u);
+    EXPECT_EQ(fifo.GetNumOverruns(), 1u);
+}
@@ -0,0 +1,318 @@
+#include "hid/VoiceAllocator.h"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <vector>
+
+using namespace daisy;
+
+namespace
+{
+/** Feeds recorded MIDI bytes through the parser into an allocator */
+template <size_t num_voices>
+class Player
+{
+  public:
+    using Allocator = VoiceAllocator<num_voices>;
+
+    explicit Player(
+        const typename Allocator::Config& config = typename Allocator::Config())
+    {
+        parser.Init();
+        voices.Init(config);
+    }
+
+    void Play(const std::vector<uint8_t>& bytes)
+    {
+        MidiEvent event;
+        for(uint8_t byte : bytes)
+            if(parser.Parse(byte, &event))
+                voices.ProcessEvent(event);
+    }
+
+    /** Returns the notes of the voices that are gated on, sorted */
+    std::vector<int> GatedNotes() const
+    {
+        std::vector<int> notes;
+        for(size_t v = 0; v < voices.GetNumVoices(); v++)
+            if(voices.IsGateOn(v))
+                notes.push_back(voices.GetVoice(v).note);
+        std::sort(notes.begin(), notes.end());
+        return notes;
+    }
+
+    MidiParser parser;
+    Allocator  voices;
+};
+
+using Voices4 = VoiceAllocator<4>;
+} // namespace
+
+TEST(hid_VoiceAllocator, a_runningStatusAndZeroVelocity)
+{
+    Player<4> player;
+    // C major chord with running status, released by velocity 0
+    player.Play({0x90, 60, 100, 64, 90, 67, 80});
+    EXPECT_EQ(player.GatedNotes(), (std::vector<int>{60, 64, 67}));
+    EXPECT_EQ(player.voices.GetNumHeldNotes(0), 3u);
+    EXPECT_EQ(player.voices.GetLowestHeldNote(0), 60);
+    EXPECT_EQ(player.voices.GetHighestHeldNote(0), 67);
+
+    player.Play({64, 0, 0x80, 60, 40});
+    EXPECT_EQ(player.GatedNotes(), (std::vector<int>{67}));
+    const int v = player.voices.GetVoiceForNote(0, 60);
+    ASSERT_NE(v, Voices4::kNoVoice);
+    EXPECT_EQ(player.voices.GetVoice(v).state, Voices4::VoiceState::RELEASED);
+    EXPECT_EQ(player.voices.GetVoice(v).release_velocity, 40);
+    EXPECT_FALSE(player.voices.IsNoteHeld(0, 60));
+    EXPECT_TRUE(player.voices.IsNoteHeld(0, 67));
+
+    // released voices are reused before idle ones only when needed
+    player.Play({0x90, 72, 100});
+    EXPECT_EQ(player.voices.GetVoiceForNote(0, 60), v);
+    EXPECT_EQ(player.voices.GetNumActiveVoices(), 4u);
+    EXPECT_EQ(player.voices.GetNumSteals(), 0u);
+}
+
+TEST(hid_VoiceAllocator, b_sameNoteRetriggersItsVoice)
+{
+    Player<4> player;
+    player.Play({0x90, 60, 100});
+    const int  v     = player.voices.GetVoiceForNote(0, 60);
+    const auto first = player.voices.GetVoice(v).trigger;
+    player.Play({0x90, 60, 50});
+    EXPECT_EQ(player.voices.GetVoiceForNote(0, 60), v);
+    EXPECT_NE(player.voices.GetVoice(v).trigger, first);
+    EXPECT_EQ(player.voices.GetVoice(v).velocity, 50);
+    EXPECT_EQ(player.voices.GetNumActiveVoices(), 1u);
+
+    // without retriggering, the old voice rings out next to the new one
+    Voices4::Config config;
+    config.retrigger_same_note = false;
+    Player<4> layered(config);
+    layered.Play({0x90, 60, 100, 60, 50});
+    EXPECT_EQ(layered.voices.GetNumActiveVoices(), 2u);
+    EXPECT_EQ(layered.GatedNotes(), (std::vector<int>{60}));
+}
+
+TEST(hid_VoiceAllocator, c_stealingModes)
+{
+    // notes 60..63 with velocities 90, 30, 70, 30, then note 64
+    const std::vector<uint8_t> five
+        = {0x90, 60, 90, 61, 30, 62, 70, 63, 30, 64, 100};
+    struct Case
+    {
+        Voices4::Stealing stealing;
+        int               stolen;
+    };
+    const Case cases[] = {{Voices4::Stealing::OLDEST, 60},
+                          {Voices4::Stealing::NEWEST, 63},
+                          {Voices4::Stealing::QUIETEST, 61},
+                          {Voices4::Stealing::NONE, 64}};
+    for(const Case& c : cases)
+    {
+        Voices4::Config config;
+        config.stealing = c.stealing;
+        Player<4> player(config);
+        player.Play(five);
+
+        std::vector<int> expected;
+        for(int note = 60; note <= 64; note++)
+            if(note != c.stolen)
+                expected.push_back(note);
+        EXPECT_EQ(player.GatedNotes(), expected);
+        EXPECT_EQ(player.voices.GetVoiceForNote(0, c.stolen),
+                  Voices4::kNoVoice);
+        EXPECT_EQ(player.voices.GetNumSteals(),
+                  c.stealing == Voices4::Stealing::NONE ? 0u : 1u);
+        // the key is still down, even without a voice
+        EXPECT_TRUE(player.voices.IsNoteHeld(0, uint8_t(c.stolen)));
+    }
+}
+
+TEST(hid_VoiceAllocator, d_sustainPedal)
+{
+    Player<4> player;
+    // chord, pedal down, chord released, one more note, pedal up
+    player.Play({0x90, 60, 100, 64, 100, 0xb0, 64, 127});
+    player.Play({0x80, 60, 64, 64, 64});
+    EXPECT_EQ(player.GatedNotes(), (std::vector<int>{60, 64}));
+    EXPECT_EQ(player.voices.GetNumHeldNotes(0), 0u);
+    const int v = player.voices.GetVoiceForNote(0, 60);
+    EXPECT_EQ(player.voices.GetVoice(v).state,
+              Voices4::VoiceState::SUSTAINED);
+
+    player.Play({0x90, 67, 100, 0xb0, 64, 0});
+    EXPECT_EQ(player.GatedNotes(), (std::vector<int>{67}));
+
+    // sustained voices are taken before held ones
+    player.Play({0xb0, 64, 127, 0x80, 67, 0, 0x90, 1, 1, 2, 2, 3, 3, 4, 4});
+    EXPECT_EQ(player.GatedNotes(), (std::vector<int>{1, 2, 3, 4}));
+    EXPECT_EQ(player.voices.GetNumSteals(), 1u);
+}
+
+TEST(hid_VoiceAllocator, e_sostenutoPedal)
+{
+    Player<4> player;
+    // 60 is held when sostenuto goes down, 64 is played after
+    player.Play({0x90, 60, 100, 0xb0, 66, 127, 0x90, 64, 100});
+    player.Play({0x80, 60, 0, 64, 0});
+    EXPECT_EQ(player.GatedNotes(), (std::vector<int>{60}));
+    EXPECT_TRUE(player.voices.IsSostenutoOn(0));
+
+    player.Play({0xb0, 66, 0});
+    EXPECT_TRUE(player.GatedNotes().empty());
+
+    // a key that's still down stays gated when the pedal goes up
+    player.Play({0x90, 62, 100, 0xb0, 66, 127, 66, 0});
+    EXPECT_EQ(player.GatedNotes(), (std::vector<int>{62}));
+}
+
+TEST(hid_VoiceAllocator, f_channelModeMessages)
+{
+    Player<4> player;
+    player.Play({0x90, 60, 100, 0x91, 62, 100, 0xb0, 64, 127});
+
+    // all notes off leaves the pedal in charge, other channels untouched
+    player.Play({0xb0, 123, 0});
+    EXPECT_EQ(player.GatedNotes(), (std::vector<int>{60, 62}));
+    EXPECT_EQ(player.voices.GetNumHeldNotes(0), 0u);
+
+    // all sound off silences at once
+    player.Play({0xb0, 120, 0});
+    EXPECT_EQ(player.GatedNotes(), (std::vector<int>{62}));
+    EXPECT_EQ(player.voices.GetNumActiveVoices(), 1u);
+
+    // reset all controllers lifts the pedal and the bend
+    player.Play({0xb1, 64, 127, 0xe1, 0, 0x60, 0x81, 62, 0});
+    EXPECT_EQ(player.GatedNotes(), (std::vector<int>{62}));
+    const int v = player.voices.GetVoiceForNote(1, 62);
+    EXPECT_EQ(player.voices.GetVoiceBend(v), 0x60 * 128 - 8192);
+    player.Play({0xb1, 121, 0});
+    EXPECT_TRUE(player.GatedNotes().empty());
+    EXPECT_EQ(player.voices.GetVoiceBend(v), 0);
+}
+
+TEST(hid_VoiceAllocator, g_mpeZone)
+{
+    Player<4> player;
+    // MPE configuration message: lower zone with 3 member channels
+    player.Play({0xb0, 101, 0, 100, 6, 6, 3});
+    EXPECT_TRUE(player.voices.IsMpeMemberChannel(1));
+    EXPECT_TRUE(player.voices.IsMpeMemberChannel(3));
+    EXPECT_FALSE(player.voices.IsMpeMemberChannel(4));
+    EXPECT_FALSE(player.voices.IsMpeMemberChannel(0));
+
+    // per-note expression sent before the note on, as MPE suggests
+    player.Play({0xe1, 0, 0x50, 0xd1, 20, 0xb1, 74, 90, 0x91, 60, 100});
+    player.Play({0xe2, 0, 0x30, 0xd2, 40, 0xb2, 74, 10, 0x92, 64, 100});
+    const int a = player.voices.GetVoiceForNote(1, 60);
+    const int b = player.voices.GetVoiceForNote(2, 64);
+    ASSERT_NE(a, Voices4::kNoVoice);
+    ASSERT_NE(b, Voices4::kNoVoice);
+    EXPECT_EQ(player.voices.GetVoiceBend(a), 0x50 * 128 - 8192);
+    EXPECT_EQ(player.voices.GetVoiceBend(b), 0x30 * 128 - 8192);
+    EXPECT_EQ(player.voices.GetVoicePressure(a), 20);
+    EXPECT_EQ(player.voices.GetVoicePressure(b), 40);
+    EXPECT_EQ(player.voices.GetVoiceTimbre(a), 90);
+    EXPECT_EQ(player.voices.GetVoiceTimbre(b), 10);
+
+    // expression while the note sounds, and the master bend on top
+    player.Play({0xd1, 99, 0xe0, 0, 0x48});
+    EXPECT_EQ(player.voices.GetVoicePressure(a), 99);
+    EXPECT_EQ(player.voices.GetVoicePressure(b), 40);
+    EXPECT_EQ(player.voices.GetVoiceBend(a),
+              (0x50 * 128 - 8192) + (0x48 * 128 - 8192));
+
+    // the sustain pedal of the master channel holds the whole zone
+    player.Play({0xb0, 64, 127, 0x81, 60, 0, 0x82, 64, 0});
+    EXPECT_EQ(player.GatedNotes(), (std::vector<int>{60, 64}));
+    EXPECT_TRUE(player.voices.IsSustainOn(2));
+    player.Play({0xb0, 64, 0});
+    EXPECT_TRUE(player.GatedNotes().empty());
+
+    // all notes off on the master channel covers the members
+    player.Play({0x91, 60, 100, 0x93, 67, 100, 0xb0, 123, 0});
+    EXPECT_TRUE(player.GatedNotes().empty());
+}
+
+TEST(hid_VoiceAllocator, h_mpeZoneConfig)
+{
+    Voices4::Config config;
+    config.mpe_lower_members = 10;
+    config.mpe_upper_members = 10;
+    Voices4 voices;
+    voices.Init(config);
+    // the upper zone gets what's left
+    EXPECT_TRUE(voices.IsMpeMemberChannel(10));
+    EXPECT_TRUE(voices.IsMpeMemberChannel(11));
+    EXPECT_TRUE(voices.IsMpeMemberChannel(14));
+    EXPECT_EQ(voices.GetPedalChannel(10), 0);
+    EXPECT_EQ(voices.GetPedalChannel(11), 15);
+
+    // an upper zone of 15 members leaves no room for the lower zone
+    MidiParser parser;
+    parser.Init();
+    MidiEvent event;
+    for(uint8_t byte : {0xbf, 101, 0, 100, 6, 6, 15})
+        if(parser.Parse(byte, &event))
+            voices.ProcessEvent(event);
+    EXPECT_EQ(voices.GetPedalChannel(1), 15);
+    EXPECT_EQ(voices.GetPedalChannel(14), 15);
+}
+
+TEST(hid_VoiceAllocator, i_freeVoiceAndReset)
+{
+    Player<4> player;
+    player.Play({0x90, 60, 100, 62, 100, 0x80, 60, 0});
+    const int v = player.voices.GetVoiceForNote(0, 60);
+    player.voices.FreeVoice(v);
+    EXPECT_EQ(player.voices.GetVoice(v).state, Voices4::VoiceState::IDLE);
+    EXPECT_EQ(player.voices.GetVoiceForNote(0, 60), Voices4::kNoVoice);
+    EXPECT_EQ(player.voices.GetNumActiveVoices(), 1u);
+
+    player.voices.Reset();
+    EXPECT_EQ(player.voices.GetNumActiveVoices(), 0u);
+    player.Play({0x90, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5});
+    EXPECT_EQ(player.GatedNotes(), (std::vector<int>{2, 3, 4, 5}));
+}
+
+namespace
+{
+/** Returns the most list operations of a note on or off with all voices
+ *  taken */
+template <size_t num_voices>
+uint32_t MaxListOpsPerEvent()
+{
+    typename VoiceAllocator<num_voices>::Config config;
+    config.stealing = VoiceAllocator<num_voices>::Stealing::QUIETEST;
+    static VoiceAllocator<num_voices> voices;
+    voices.Init(config);
+    for(size_t i = 0; i < num_voices; i++)
+        voices.NoteOn(int(i % 16), uint8_t(i / 16), uint8_t(1 + i % 127));
+
+    uint32_t seed = 1, maxOps = 0;
+    for(int i = 0; i < 10000; i++)
+    {
+        seed              = seed * 1664525 + 1013904223;
+        const int channel = (seed >> 8) & 15;
+        const int note    = (seed >> 12) & 127;
+        uint32_t  ops     = voices.GetNumListOpsForUnitTest();
+        voices.NoteOn(channel, uint8_t(note), uint8_t(1 + (seed >> 20) % 127));
+        maxOps = std::max(maxOps, voices.GetNumListOpsForUnitTest() - ops);
+        ops    = voices.GetNumListOpsForUnitTest();
+        voices.NoteOff(channel, uint8_t(note ^ 1));
+        maxOps = std::max(maxOps, voices.GetNumListOpsForUnitTest() - ops);
+    }
+    return maxOps;
+}
+} // namespace
+
+TEST(hid_VoiceAllocator, j_costDoesNotGrowWithVoices)
+{
+    // a note on releases the voice of a retriggered note, or searches up
+    // to four velocity words for the quietest voice, then moves the voice
+    // to the held list; a scan over the voices would grow with them
+    EXPECT_LE(MaxListOpsPerEvent<8>(), 6u);
+    EXPECT_LE(MaxListOpsPerEvent<128>(), 6u);
+    EXPECT_EQ(MaxListOpsPerEvent<128>(), MaxListOpsPerEvent<8>());
+}
@@ -0,0 +1,607 @@
+#include "util/WavIndex.h"
+#include <gtest/gtest.h>
+#include <cstring>
+#include <list>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace daisy;
+
+namespace
+{
+/** A directory tree in local memory with a FatFs-like interface */
+struct TreeFileSystem
+{
+    struct Node
+    {
+        std::string          path;
+        std::vector<uint8_t> data;
+        uint32_t             timestamp   = 0;
+        uint32_t             cluster     = 0;
+        bool                 isDirectory = false;
+        bool                 isHidden    = false;
+    };
+
+    struct File
+    {
+        Node*  node     = nullptr;
+        size_t position = 0;
+    };
+
+    struct Dir
+    {
+        std::string               path;
+        std::list<Node>::iterator next;
+        std::string               name;
+    };
+
+    struct FileInfo
+    {
+        const char* name;
+        uint32_t    size;
+        uint32_t    timestamp;
+        bool        isDirectory;
+        bool        isHidden;
+    };
+
+    int Open(File& file, const char* path, bool write)
+    {
+        openCount[path]++;
+        file.node     = Find(path);
+        file.position = 0;
+        if(write)
+        {
+            if(file.node == nullptr)
+                file.node = &Add(path, {}, 0);
+            file.node->data.clear();
+        }
+        return file.node != nullptr ? 0 : 4; // FR_NO_FILE
+    }
+
+    int Close(File& file)
+    {
+        file.node = nullptr;
+        return 0;
+    }
+
+    int Read(File& file, void* dest, size_t size, size_t& bytesRead)
+    {
+        const size_t avail = file.node->data.size() > file.position
+                                 ? file.node->data.size() - file.position
+                                 : 0;
+        bytesRead = size < avail ? size : avail;
+        if(bytesRead > 0)
+            memcpy(dest, &file.node->data[file.position], bytesRead);
+        file.position += bytesRead;
+        return 0;
+    }
+
+    int Write(File& file, const void* src, size_t size, size_t& bytesWritten)
+    {
+        auto& data = file.node->data;
+        if(file.position + size > data.size())
+            data.resize(file.position + size);
+        memcpy(&data[file.position], src, size);
+        file.position += size;
+        bytesWritten = size;
+        return 0;
+    }
+
+    int Seek(File& file, uint32_t position)
+    {
+        file.position = position;
+        return 0;
+    }
+
+    uint32_t GetStartCluster(const File& file) { return file.node->cluster; }
+
+    int OpenDir(Dir& dir, const char* path)
+    {
+        if(Find(path) == nullptr || !Find(path)->isDirectory)
+            return 5; // FR_NO_PATH
+        dir.path = path;
+        dir.next = nodes.begin();
+        numDirScans++;
+        return 0;
+    }
+
+    int ReadDir(Dir& dir, FileInfo& info)
+    {
+        for(; dir.next != nodes.end(); ++dir.next)
+        {
+            const Node& node = *dir.next;
+            if(node.path.size() <= dir.path.size() + 1
+               || node.path.compare(0, dir.path.size(), dir.path) != 0
+               || node.path[dir.path.size()] != '/'
+               || node.path.find('/', dir.path.size() + 1)
+                      != std::string::npos)
+                continue;
+            dir.name         = node.path.substr(dir.path.size() + 1);
+            info.name        = dir.name.c_str();
+            info.size        = uint32_t(node.data.size());
+            info.timestamp   = node.timestamp;
+            info.isDirectory = node.isDirectory;
+            info.isHidden    = node.isHidden;
+            ++dir.next;
+            return 0;
+        }
+        info.name = "";
+        return 0;
+    }
+
+    int CloseDir(Dir&) { return 0; }
+
+    int GetTimestamp(const char* path, uint32_t& timestamp)
+    {
+        Node* node = Find(path);
+        if(node == nullptr || node->timestamp == 0)
+            return 6; // FR_INVALID_NAME, like f_stat() on a root directory
+        timestamp = node->timestamp;
+        return 0;
+    }
+
+    Node* Find(const std::string& path)
+    {
+        for(auto& node : nodes)
+            if(node.path == path)
+                return &node;
+        return nullptr;
+    }
+
+    Node& Add(const std::string&          path,
+              const std::vector<uint8_t>& data,
+              uint32_t                    timestamp)
+    {
+        Node node;
+        node.path      = path;
+        node.data      = data;
+        node.timestamp = timestamp;
+        node.cluster   = nextCluster++;
+        nodes.push_back(node);
+        return nodes.back();
+    }
+
+    Node& AddDirectory(const std::string& path, uint32_t timestamp)
+    {
+        Node& node       = Add(path, {}, timestamp);
+        node.isDirectory = true;
+        return node;
+    }
+
+    void Remove(const std::string& path)
+    {
+        nodes.remove_if([&](const Node& n) { return n.path == path; });
+    }
+
+    /** Returns the number of opened files that aren't the index */
+    int GetNumSampleFileOpens() const
+    {
+        int num = 0;
+        for(const auto& count : openCount)
+            if(count.first.find(".idx") == std::string::npos)
+                num += count.second;
+        return num;
+    }
+
+    std::list<Node>            nodes;
+    std::map<std::string, int> openCount;
+    int                        numDirScans = 0;
+    uint32_t                   nextCluster = 2;
+};
+
+/** Options for generated .wav files */
+struct WavSpec
+{
+    uint16_t format        = WAVE_FORMAT_PCM;
+    uint16_t numChannels   = 1;
+    uint32_t sampleRate    = 48000;
+    uint16_t bitsPerSample = 16;
+    uint32_t numFrames     = 1000;
+    bool     extensible    = false;
+    bool     hasLoop       = false;
+    uint32_t loopStart     = 0;
+    uint32_t loopEnd       = 0; // inclusive, like in the "smpl" chunk
+    bool     hasListChunk  = false;
+};
+
+void Put16(std::vector<uint8_t>& v, uint32_t x)
+{
+    v.push_back(uint8_t(x));
+    v.push_back(uint8_t(x >> 8));
+}
+
+void Put32(std::vector<uint8_t>& v, uint32_t x)
+{
+    Put16(v, x & 0xffff);
+    Put16(v, x >> 16);
+}
+
+void PutId(std::vector<uint8_t>& v, const char* id)
+{
+    v.insert(v.end(), id, id + 4);
+}
+
+std::vector<uint8_t> MakeWav(const WavSpec& spec)
+{
+    std::vector<uint8_t> wav;
+    PutId(wav, "RIFF");
+    Put32(wav, 0); // patched below
+    PutId(wav, "WAVE");
+    if(spec.hasListChunk)
+    {
+        // odd size, followed by a pad byte
+        PutId(wav, "LIST");
+        Put32(wav, 5);
+        wav.insert(wav.end(), {'I', 'N', 'F', 'O', 'x', 0});
+    }
+    const uint16_t blockAlign = spec.numChannels * spec.bitsPerSample / 8;
+    PutId(wav, "fmt ");
+    Put32(wav, spec.extensible ? 40 : 16);
+    const uint16_t format
+        = spec.extensible ? uint16_t(WAVE_FORMAT_EXTENSIBLE) : spec.format;
+    Put16(wav, format);
+    Put16(wav, spec.numChannels);
+    Put32(wav, spec.sampleRate);
+    Put32(wav, spec.sampleRate * blockAlign);
+    Put16(wav, blockAlign);
+    Put16(wav, spec.bitsPerSample);
+    if(spec.extensible)
+    {
+        Put16(wav, 22);                 // cbSize
+        Put16(wav, spec.bitsPerSample); // valid bits
+        Put32(wav, 3);                  // channel mask
+        Put16(wav, spec.format);        // SubFormat GUID
+        wav.insert(wav.end(), 14, 0xaa);
+    }
+    PutId(wav, "data");
+    Put32(wav, spec.numFrames * blockAlign);
+    for(uint32_t i = 0; i < spec.numFrames * blockAlign; i++)
+        wav.push_back(uint8_t(i));
+    if(spec.hasLoop)
+    {
+        PutId(wav, "smpl");
+        Put32(wav, 36 + 24);
+        for(int i = 0; i < 7; i++)
+            Put32(wav, 0);
+        Put32(wav, 1); // number of loops
+        Put32(wav, 0); // sampler data
+        Put32(wav, 0); // cue point id
+        Put32(wav, 0); // type
+        Put32(wav, spec.loopStart);
+        Put32(wav, spec.loopEnd);
+        Put32(wav, 0); // fraction
+        Put32(wav, 0); // play count
+    }
+    const uint32_t riffSize = uint32_t(wav.size() - 8);
+    memcpy(&wav[4], &riffSize, 4);
+    return wav;
+}
+
+using Index = WavIndex<TreeFileSystem, 256>;
+
+/** Builds a small sample library in "0:/samples" */
+void MakeLibrary(TreeFileSystem& fs)
+{
+    fs.AddDirectory("0:", 0); // root directories have no timestamp
+    fs.AddDirectory("0:/samples", 0x5a210000);
+    fs.Add("0:/samples/kick.wav", MakeWav(WavSpec()), 0x5a210001);
+
+    WavSpec snare;
+    snare.numChannels   = 2;
+    snare.sampleRate    = 44100;
+    snare.bitsPerSample = 24;
+    snare.numFrames     = 900;
+    snare.hasListChunk  = true;
+    snare.hasLoop       = true;
+    snare.loopStart     = 100;
+    snare.loopEnd       = 799;
+    fs.Add("0:/samples/SNARE.WAV", MakeWav(snare), 0x5a210002);
+
+    fs.Add("0:/samples/readme.txt", {'h', 'i'}, 0x5a210003);
+    fs.Add("0:/samples/broken.wav", {'j', 'u', 'n', 'k'}, 0x5a210004);
+    fs.Add("0:/samples/.hidden.wav", MakeWav(WavSpec()), 0x5a210005)
+        .isHidden
+        = true;
+    fs.AddDirectory("0:/samples/sub.wav", 0x5a210006);
+    fs.Add("0:/samples/sub.wav/deep.wav", MakeWav(WavSpec()), 0x5a210007);
+
+    WavSpec pad;
+    pad.format        = WAVE_FORMAT_IEEE_FLOAT;
+    pad.numChannels   = 2;
+    pad.bitsPerSample = 32;
+    pad.numFrames     = 500;
+    pad.extensible    = true;
+    fs.Add("0:/samples/pad.wav", MakeWav(pad), 0x5a210008);
+}
+
+std::unique_ptr<Index> MakeIndex()
+{
+    return std::unique_ptr<Index>(new Index());
+}
+
+std::string GetName(Index& index, size_t ordinal)
+{
+    char name[Index::kMaxPathLength];
+    return index.GetName(ordinal, name, sizeof(name)) ? name : "<error>";
+}
+} // namespace
+
+TEST(util_WavIndex, a_indexesWavFiles)
+{
+    TreeFileSystem fs;
+    MakeLibrary(fs);
+    auto index = MakeIndex();
+    EXPECT_EQ(index->Init(fs, "0:/samples", "0:/samples.idx"),
+              Index::Result::OK);
+
+    // only the valid, visible .wav files in directory order
+    ASSERT_EQ(index->GetNumEntries(), 3u);
+    EXPECT_EQ(index->GetNumParsedFiles(), 3u);
+    EXPECT_EQ(GetName(*index, 0), "kick.wav");
+    EXPECT_EQ(GetName(*index, 1), "SNARE.WAV");
+    EXPECT_EQ(GetName(*index, 2), "pad.wav");
+    EXPECT_EQ(index->GetEntry(3), nullptr);
+
+    const auto* kick = index->GetEntry(0);
+    EXPECT_EQ(kick->format, WAVE_FORMAT_PCM);
+    EXPECT_EQ(kick->numChannels, 1);
+    EXPECT_EQ(kick->bitsPerSample, 16);
+    EXPECT_EQ(kick->sampleRate, 48000u);
+    EXPECT_EQ(kick->numFrames, 1000u);
+    EXPECT_EQ(kick->dataOffset, 44u);
+    EXPECT_EQ(kick->fileSize, fs.Find("0:/samples/kick.wav")->data.size());
+    EXPECT_EQ(kick->timestamp, 0x5a210001u);
+    EXPECT_EQ(kick->cluster, fs.Find("0:/samples/kick.wav")->cluster);
+    EXPECT_FALSE(kick->HasLoop());
+
+    const auto* snare = index->GetEntry(1);
+    EXPECT_EQ(snare->numChannels, 2);
+    EXPECT_EQ(snare->bitsPerSample, 24);
+    EXPECT_EQ(snare->sampleRate, 44100u);
+    EXPECT_EQ(snare->numFrames, 900u);
+    EXPECT_EQ(snare->dataOffset, 44u + 14u); // after the padded LIST chunk
+    EXPECT_TRUE(snare->HasLoop());
+    EXPECT_EQ(snare->loopStart, 100u);
+    EXPECT_EQ(snare->loopEnd, 800u);
+
+    const auto* pad = index->GetEntry(2);
+    EXPECT_EQ(pad->format, WAVE_FORMAT_IEEE_FLOAT);
+    EXPECT_EQ(pad->bitsPerSample, 32);
+    EXPECT_EQ(pad->numFrames, 500u);
+}
+
+TEST(util_WavIndex, b_findByNameAndHash)
+{
+    TreeFileSystem fs;
+    MakeLibrary(fs);
+    auto index = MakeIndex();
+    index->Init(fs, "0:/samples", "0:/samples.idx");
+
+    EXPECT_EQ(index->Find("kick.wav"), 0);
+    EXPECT_EQ(index->Find("snare.wav"), 1);
+    EXPECT_EQ(index->Find("Pad.WAV"), 2);
+    EXPECT_EQ(index->Find("hat.wav"), -1);
+    EXPECT_EQ(index->Find(Index::HashName("SNARE.wav")), 1);
+    EXPECT_EQ(index->Find(Index::HashName("readme.txt")), -1);
+
+    char path[Index::kMaxPathLength];
+    ASSERT_TRUE(index->GetPath(2, path, sizeof(path)));
+    EXPECT_STREQ(path, "0:/samples/pad.wav");
+
+    // names that don't fit are an error
+    char shortName[4];
+    EXPECT_FALSE(index->GetName(0, shortName, sizeof(shortName)));
+    EXPECT_FALSE(index->GetName(3, path, sizeof(path)));
+}
+
+TEST(util_WavIndex, c_loadsIndexWithoutOpeningFiles)
+{
+    TreeFileSystem fs;
+    MakeLibrary(fs);
+    auto first = MakeIndex();
+    first->Init(fs, "0:/samples", "0:/samples.idx");
+
+    // next boot
+    fs.openCount.clear();
+    fs.numDirScans = 0;
+    auto index     = MakeIndex();
+    EXPECT_EQ(index->Init(fs, "0:/samples", "0:/samples.idx"),
+              Index::Result::OK);
+    EXPECT_EQ(fs.numDirScans, 0);
+    EXPECT_EQ(fs.GetNumSampleFileOpens(), 0);
+    EXPECT_EQ(fs.openCount["0:/samples.idx"], 1);
+    EXPECT_EQ(index->GetNumParsedFiles(), 0u);
+
+    ASSERT_EQ(index->GetNumEntries(), first->GetNumEntries());
+    for(size_t i = 0; i < index->GetNumEntries(); i++)
+    {
+        EXPECT_EQ(memcmp(index->GetEntry(i),
+                         first->GetEntry(i),
+                         sizeof(Index::Entry)),
+                  0);
+        EXPECT_EQ(GetName(*index, i), GetName(*first, i));
+    }
+    EXPECT_EQ(index->Find("snare.wav"), 1);
+
+    // an index of a different directory isn't used
+    fs.openCount.clear();
+    auto other = MakeIndex();
+    EXPECT_EQ(other->Init(fs, "0:/samples/sub.wav", "0:/samples.idx"),
+              Index::Result::OK);
+    EXPECT_EQ(other->GetNumEntries(), 1u);
+    EXPECT_EQ(other->GetNumParsedFiles(), 1u);
+}
+
+TEST(util_WavIndex, d_incrementalUpdate)
+{
+    TreeFileSystem fs;
+    MakeLibrary(fs);
+    auto first = MakeIndex();
+    first->Init(fs, "0:/samples", "0:/samples.idx");
+
+    // modify, remove and add files while the device is off
+    WavSpec longer;
+    longer.numFrames = 4000;
+    auto& snare      = *fs.Find("0:/samples/SNARE.WAV");
+    snare.data       = MakeWav(longer);
+    snare.timestamp  = 0x5a220000;
+    fs.Remove("0:/samples/kick.wav");
+    fs.Add("0:/samples/hat.wav", MakeWav(WavSpec()), 0x5a220001);
+    fs.Find("0:/samples")->timestamp = 0x5a220002;
+
+    fs.openCount.clear();
+    auto index = MakeIndex();
+    EXPECT_EQ(index->Init(fs, "0:/samples", "0:/samples.idx"),
+              Index::Result::OK);
+    ASSERT_EQ(index->GetNumEntries(), 3u);
+    EXPECT_EQ(index->GetNumParsedFiles(), 2u);
+    EXPECT_EQ(index->GetNumReusedEntries(), 1u);
+    EXPECT_EQ(fs.openCount["0:/samples/pad.wav"], 0);
+    EXPECT_EQ(fs.openCount["0:/samples/SNARE.WAV"], 1);
+    EXPECT_EQ(fs.openCount["0:/samples/hat.wav"], 1);
+
+    EXPECT_EQ(GetName(*index, 0), "SNARE.WAV");
+    EXPECT_EQ(GetName(*index, 1), "pad.wav");
+    EXPECT_EQ(GetName(*index, 2), "hat.wav");
+    EXPECT_EQ(index->GetEntry(0)->numFrames, 4000u);
+    EXPECT_FALSE(index->GetEntry(0)->HasLoop());
+    EXPECT_EQ(index->GetEntry(1)->numFrames, 500u);
+    EXPECT_EQ(index->Find("kick.wav"), -1);
+    EXPECT_EQ(index->Find("hat.wav"), 2);
+
+    // unchanged directory timestamp: changes are only seen by Update()
+    fs.Remove("0:/samples/hat.wav");
+    auto stale = MakeIndex();
+    stale->Init(fs, "0:/samples", "0:/samples.idx");
+    EXPECT_EQ(stale->GetNumEntries(), 3u);
+    EXPECT_EQ(stale->Update(), Index::Result::OK);
+    EXPECT_EQ(stale->GetNumEntries(), 2u);
+    EXPECT_EQ(stale->GetNumParsedFiles(), 0u);
+}
+
+TEST(util_WavIndex, e_invalidIndexAndRootDirectory)
+{
+    TreeFileSystem fs;
+    MakeLibrary(fs);
+    fs.Add("0:/loop.wav", MakeWav(WavSpec()), 0x5a210010);
+    auto first = MakeIndex();
+    first->Init(fs, "0:/samples", "0:/samples.idx");
+
+    // a corrupted index is rebuilt from scratch
+    fs.Find("0:/samples.idx")->data[0] ^= 0xff;
+    auto index = MakeIndex();
+    EXPECT_EQ(index->Init(fs, "0:/samples", "0:/samples.idx"),
+              Index::Result::OK);
+    EXPECT_EQ(index->GetNumEntries(), 3u);
+    EXPECT_EQ(index->GetNumParsedFiles(), 3u);
+
+    // the root directory has no timestamp, so it's always rescanned, but
+    // unchanged files are reused
+    auto root = MakeIndex();
+    EXPECT_EQ(root->Init(fs, "0:", "0:/root.idx"), Index::Result::OK);
+    EXPECT_EQ(root->GetNumEntries(), 1u);
+    EXPECT_EQ(root->GetNumParsedFiles(), 1u);
+    fs.numDirScans = 0;
+    auto root2     = MakeIndex();
+    EXPECT_EQ(root2->Init(fs, "0:", "0:/root.idx"), Index::Result::OK);
+    EXPECT_EQ(fs.numDirScans, 1);
+    EXPECT_EQ(root2->GetNumParsedFiles(), 0u);
+    EXPECT_EQ(root2->GetNumReusedEntries(), 1u);
+    char path[Index::kMaxPathLength];
+    ASSERT_TRUE(root2->GetPath(0, path, sizeof(path)));
+    EXPECT_STREQ(path, "0:/loop.wav");
+
+    // missing directory
+    auto missing = MakeIndex();
+    EXPECT_EQ(missing->Init(fs, "0:/nothing", "0:/nothing.idx"),
+              Index::Result::ERR_DIRECTORY);
+    EXPECT_EQ(missing->GetNumEntries(), 0u);
+}
+
+TEST(util_WavIndex, f_largeLibrary)
+{
+    TreeFileSystem fs;
+    fs.AddDirectory("0:/lib", 1);
+    const auto makeName = [](int i) {
+        return "0:/lib/sample" + std::to_string(i) + ".wav";
+    };
+    for(int i = 0; i < 200; i++)
+    {
+        WavSpec spec;
+        spec.numFrames = 10 + i;
+        fs.Add(makeName(i), MakeWav(spec), 100 + i);
+    }
+    auto first = MakeIndex();
+    first->Init(fs, "0:/lib", "0:/lib.idx");
+    EXPECT_EQ(first->GetNumEntries(), 200u);
+
+    // modify every 10th file and add more files, so that the new entries
+    // overlap with the old ones during the update
+    for(int i = 0; i < 200; i += 10)
+    {
+        WavSpec spec;
+        spec.numFrames                  = 5000 + i;
+        fs.Find(makeName(i))->data      = MakeWav(spec);
+        fs.Find(makeName(i))->timestamp = 1000 + i;
+    }
+    for(int i = 200; i < 240; i++)
+    {
+        WavSpec spec;
+        spec.numFrames = 10 + i;
+        fs.Add(makeName(i), MakeWav(spec), 100 + i);
+    }
+    fs.Find("0:/lib")->timestamp = 2;
+
+    auto index = MakeIndex();
+    EXPECT_EQ(index->Init(fs, "0:/lib", "0:/lib.idx"), Index::Result::OK);
+    ASSERT_EQ(index->GetNumEntries(), 240u);
+    EXPECT_EQ(index->GetNumParsedFiles() + index->GetNumReusedEntries(),
+              240u);
+    EXPECT_GE(index->GetNumReusedEntries(), 100u);
+    for(int i = 0; i < 240; i++)
+    {
+        const auto*    entry    = index->GetEntry(i);
+        const uint32_t expected = (i < 200 && i % 10 == 0) ? 5000 + i : 10 + i;
+        EXPECT_EQ(entry->numFrames, expected) << i;
+        EXPECT_EQ(GetName(*index, i), makeName(i).substr(7)) << i;
+        EXPECT_EQ(index->Find(makeName(i).substr(7).c_str()), i);
+    }
+
+    // files beyond the capacity are ignored
+    for(int i = 240; i < 300; i++)
+        fs.Add(makeName(i), MakeWav(WavSpec()), 100 + i);
+    EXPECT_EQ(index->Update(), Index::Result::OK);
+    EXPECT_EQ(index->GetNumEntries(), 256u);
+    EXPECT_EQ(index->Find("sample255.wav"), 255);
+    EXPECT_EQ(index->Find("sample256.wav"), -1);
+}
+
+TEST(util_WavIndex, g_renamedFileWithSameHash)
+{
+    // the names have the same HashName(), the files the same size and time
+    ASSERT_EQ(Index::HashName("s359818.wav"), Index::HashName("s1242100.wav"));
+    TreeFileSystem fs;
+    fs.AddDirectory("0:", 0);
+    fs.AddDirectory("0:/samples", 0x5a210000);
+    fs.Add("0:/samples/s359818.wav", MakeWav(WavSpec()), 0x5a210001);
+    auto first = MakeIndex();
+    first->Init(fs, "0:/samples", "0:/samples.idx");
+    ASSERT_EQ(first->GetNumEntries(), 1u);
+
+    WavSpec other;
+    other.sampleRate = 44100;
+    fs.Remove("0:/samples/s359818.wav");
+    fs.Add("0:/samples/s1242100.wav", MakeWav(other), 0x5a210001);
+    fs.Find("0:/samples")->timestamp = 0x5a210002;
+
+    auto index = MakeIndex();
+    EXPECT_EQ(index->Init(fs, "0:/samples", "0:/samples.idx"),
+              Index::Result::OK);
+    ASSERT_EQ(index->GetNumEntries(), 1u);
+    EXPECT_EQ(index->GetNumParsedFiles(), 1u);
+    EXPECT_EQ(index->GetNumReusedEntries(), 0u);
+    EXPECT_EQ(GetName(*index, 0), "s1242100.wav");
+    EXPECT_EQ(index->GetEntry(0)->sampleRate, 44100u);
+}
@@ -5,3 +5,5 @@
 #include "util/oled_fonts.c"
 #include "per/qspi.cpp"
 #include "hid/midi_parser.cpp"
+#include "hid/ctrl.cpp"
+#include "hid/parameter.cpp"
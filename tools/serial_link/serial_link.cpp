@@ -0,0 +1,230 @@
+/** Host side of SerialLink, see src/hid/serial_link.h
+ *
+ *  Talks to a device over a USB CDC or UART tty with the same framing code
+ *  as the firmware, src/util/SerialFraming.h.
+ *
+ *  Build:  g++ -std=c++14 -O2 -I../../src serial_link.cpp -o serial_link
+ *
+ *  Usage:  serial_link <tty> ping
+ *          serial_link <tty> get <id>
+ *          serial_link <tty> set <id> <value>
+ *          serial_link <tty> monitor
+ *          serial_link <tty> bulk <file>
+ */
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+#include <poll.h>
+#include <vector>
+#include "util/SerialFraming.h"
+
+using namespace daisy;
+
+static int OpenTty(const char* path)
+{
+    const int fd = open(path, O_RDWR | O_NOCTTY);
+    if(fd < 0)
+        return -1;
+    termios tio;
+    tcgetattr(fd, &tio);
+    cfmakeraw(&tio);
+    // the baud rate only matters for UARTs, CDC ignores it
+    cfsetspeed(&tio, B921600);
+    tcsetattr(fd, TCSANOW, &tio);
+    return fd;
+}
+
+static bool
+SendFrame(int fd, SerialEndpoint endpoint, const uint8_t* payload, size_t size)
+{
+    static uint8_t sequence[SerialFrameDecoder<>::kNumEndpoints] = {};
+
+    // a leading delimiter ends whatever the device received before
+    std::vector<uint8_t> frame(SerialFrameEncoder::GetMaxEncodedSize(size) + 1);
+    const uint8_t        ep = static_cast<uint8_t>(endpoint);
+    frame[0]                = 0;
+    const size_t size_out   = 1
+                            + SerialFrameEncoder::Encode(ep,
+                                                         sequence[ep]++,
+                                                         payload,
+                                                         size,
+                                                         frame.data() + 1);
+    return write(fd, frame.data(), size_out) == ssize_t(size_out);
+}
+
+/** Waits for a frame, returns false after the timeout */
+static bool ReceiveFrame(int                   fd,
+                         SerialFrameDecoder<>& decoder,
+                         SerialFrame&          frame,
+                         int                   timeout_ms)
+{
+    static uint8_t buffer[256];
+    static size_t  size = 0, pos = 0;
+    while(true)
+    {
+        while(pos < size)
+            if(decoder.Feed(buffer[pos++], frame))
+                return true;
+        pollfd pfd = {fd, POLLIN, 0};
+        if(poll(&pfd, 1, timeout_ms) <= 0)
+            return false;
+        const ssize_t num = read(fd, buffer, sizeof(buffer));
+        if(num <= 0)
+            return false;
+        size = size_t(num);
+        pos  = 0;
+    }
+}
+
+static void PrintFrame(const SerialFrame& frame)
+{
+    SerialPayloadReader reader(frame.payload, frame.size);
+    switch(static_cast<SerialEndpoint>(frame.endpoint))
+    {
+        case SerialEndpoint::PONG:
+            printf("pong, %zu bytes\n", frame.size);
+            break;
+        case SerialEndpoint::PARAM_VALUE:
+        {
+            const uint16_t id     = reader.GetU16();
+            const float    value  = reader.GetFloat();
+            const uint8_t  status = reader.GetU8();
+            if(status == 0)
+                printf("param %u = %g\n", id, value);
+            else
+                printf("param %u unknown\n", id);
+            break;
+        }
+        case SerialEndpoint::METER:
+            printf("meter");
+            while(reader.GetRemainingSize() >= 4)
+                printf(" %8.4f", reader.GetFloat());
+            printf("\n");
+            break;
+        case SerialEndpoint::SCOPE:
+        {
+            const uint8_t  channel = reader.GetU8();
+            const uint32_t index   = reader.GetU32();
+            float          peak    = 0.f;
+            while(reader.GetRemainingSize() >= 2)
+            {
+                const float s = int16_t(reader.GetU16()) / 32767.f;
+                peak          = s > peak ? s : (-s > peak ? -s : peak);
+            }
+            printf("scope %u @%u peak %.4f\n", channel, index, peak);
+            break;
+        }
+        default:
+            printf("endpoint %u seq %u, %zu bytes\n",
+                   frame.endpoint,
+                   frame.sequence,
+                   frame.size);
+            break;
+    }
+}
+
+static int Usage()
+{
+    fprintf(stderr,
+            "usage: serial_link <tty> ping | get <id> | set <id> <value> | "
+            "monitor | bulk <file>\n");
+    return 1;
+}
+
+int main(int argc, char** argv)
+{
+    if(argc < 3)
+        return Usage();
+    const int fd = OpenTty(argv[1]);
+    if(fd < 0)
+    {
+        perror(argv[1]);
+        return 1;
+    }
+
+    SerialFrameDecoder<> decoder;
+    SerialFrame          frame;
+    const char*          command = argv[2];
+    uint8_t              payload[256];
+    SerialPayloadWriter  writer(payload, sizeof(payload));
+    SerialEndpoint       answer;
+
+    if(strcmp(command, "ping") == 0)
+    {
+        writer.PutU32(0x12345678);
+        SendFrame(fd, SerialEndpoint::PING, payload, writer.GetSize());
+        answer = SerialEndpoint::PONG;
+    }
+    else if(strcmp(command, "get") == 0 && argc == 4)
+    {
+        writer.PutU16(uint16_t(atoi(argv[3])));
+        SendFrame(fd, SerialEndpoint::PARAM_GET, payload, writer.GetSize());
+        answer = SerialEndpoint::PARAM_VALUE;
+    }
+    else if(strcmp(command, "set") == 0 && argc == 5)
+    {
+        writer.PutU16(uint16_t(atoi(argv[3])));
+        writer.PutFloat(float(atof(argv[4])));
+        SendFrame(fd, SerialEndpoint::PARAM_SET, payload, writer.GetSize());
+        answer = SerialEndpoint::PARAM_VALUE;
+    }
+    else if(strcmp(command, "monitor") == 0)
+    {
+        while(true)
+        {
+            if(ReceiveFrame(fd, decoder, frame, 1000))
+                PrintFrame(frame);
+            else
+                printf("frames %u, errors %u, lost %u\n",
+                       decoder.GetNumFrames(),
+                       decoder.GetNumErrors(),
+                       decoder.GetNumLost());
+        }
+    }
+    else if(strcmp(command, "bulk") == 0 && argc == 4)
+    {
+        FILE* file = fopen(argv[3], "rb");
+        if(file == nullptr)
+        {
+            perror(argv[3]);
+            return 1;
+        }
+        std::vector<uint8_t> data;
+        uint8_t              chunk[248];
+        size_t               num;
+        while((num = fread(chunk, 1, sizeof(chunk), file)) > 0)
+            data.insert(data.end(), chunk, chunk + num);
+        fclose(file);
+        for(size_t offset = 0; offset < data.size(); offset += sizeof(chunk))
+        {
+            const size_t size = data.size() - offset < sizeof(chunk)
+                                    ? data.size() - offset
+                                    : sizeof(chunk);
+            SerialPayloadWriter bulk(payload, sizeof(payload));
+            bulk.PutU32(uint32_t(offset));
+            bulk.PutU32(uint32_t(data.size()));
+            bulk.PutBytes(data.data() + offset, size);
+            SendFrame(fd, SerialEndpoint::BULK, payload, bulk.GetSize());
+        }
+        printf("sent %zu bytes\n", data.size());
+        return 0;
+    }
+    else
+    {
+        return Usage();
+    }
+
+    while(ReceiveFrame(fd, decoder, frame, 1000))
+    {
+        if(frame.endpoint == static_cast<uint8_t>(answer))
+        {
+            PrintFrame(frame);
+            return 0;
+        }
+    }
+    fprintf(stderr, "no answer\n");
+    return 1;
+}